@@ -3,14 +3,16 @@ import hashlib
 from Bio import AlignIO
 from Bio.Align import MultipleSeqAlignment
 from collections import defaultdict
+from gubbins.session import filter_alignment_with_library
 
 
 class PreProcessFasta(object):
 
-    def __init__(self, input_filename, verbose=False, filter_percentage=25):
+    def __init__(self, input_filename, verbose=False, filter_percentage=25, threads=1):
         self.input_filename = input_filename
         self.verbose = verbose
         self.filter_percentage = filter_percentage
+        self.threads = threads
 
     def hash_sequences(self):
         sequence_hash_to_taxa = defaultdict(list)
@@ -78,6 +80,11 @@ class PreProcessFasta(object):
 
     def remove_duplicate_sequences_and_sequences_missing_too_much_data(self, output_filename,
                                                                        remove_identical_sequences=None):
+        # libgubbins reads the alignment once rather than three times, if it can be loaded
+        taxa_to_remove = filter_alignment_with_library(self.input_filename, output_filename, self.filter_percentage,
+                                                       remove_identical_sequences, self.threads)
+        if taxa_to_remove is not None:
+            return taxa_to_remove
 
         if not remove_identical_sequences:
             taxa_to_remove = self.taxa_missing_too_much_data()
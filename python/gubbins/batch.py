@@ -0,0 +1,138 @@
+# encoding: utf-8
+# Wellcome Trust Sanger Institute
+# Copyright (C) 2013  Wellcome Trust Sanger Institute
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+#
+
+"""Runs Gubbins on the alignments of many lineages in one go, sharing the cores out between them"""
+
+import collections
+import concurrent.futures
+import copy
+import os
+import sys
+import time
+
+from gubbins import common, utils
+
+BatchJob = collections.namedtuple("BatchJob", ["alignment_filename", "prefix", "starting_tree", "directory"])
+
+
+def read_batch_manifest(manifest_filename):
+    """Returns a job for each line of the manifest, which has an alignment and optionally the prefix of its outputs
+    and a starting tree, separated by tabs. Blank lines and lines starting with # are skipped. Each job runs in a
+    directory named after its prefix, next to the manifest"""
+    manifest_directory = os.path.dirname(os.path.abspath(manifest_filename))
+    jobs = []
+    prefixes = set()
+    with open(manifest_filename) as manifest_file:
+        for line in manifest_file:
+            fields = line.rstrip("\n").split("\t")
+            if fields[0].strip() == "" or fields[0].startswith("#"):
+                continue
+            alignment_filename = os.path.join(manifest_directory, fields[0])
+            prefix = fields[1] if len(fields) > 1 and fields[1] != "" \
+                else os.path.splitext(os.path.basename(alignment_filename))[0]
+            starting_tree = os.path.join(manifest_directory, fields[2]) \
+                if len(fields) > 2 and fields[2] != "" else None
+            if prefix in prefixes:
+                sys.exit("The prefix " + prefix + " is used by more than one alignment in the manifest")
+            prefixes.add(prefix)
+            jobs.append(BatchJob(alignment_filename, prefix, starting_tree, os.path.join(manifest_directory, prefix)))
+    return jobs
+
+
+def threads_for_next_job(free_threads, number_of_waiting_jobs):
+    """The free threads are shared between the jobs still waiting, so with fewer jobs than threads each one builds
+    its trees and scans its branches on several, and with more they all get one"""
+    return max(1, free_threads // max(1, number_of_waiting_jobs))
+
+
+def run_batch_job(input_args, job, threads):
+    """Runs one lineage in its own directory with everything it prints going to gubbins.log there, returning how
+    long it took and the error which stopped it, if there was one"""
+    start_time = time.time()
+    job_args = copy.copy(input_args)
+    job_args.alignment_filename = job.alignment_filename
+    job_args.prefix = job.prefix
+    job_args.starting_tree = job.starting_tree
+    job_args.threads = threads
+    job_args.batch = None
+    current_directory = os.getcwd()
+    os.makedirs(job.directory, exist_ok=True)
+    os.chdir(job.directory)
+
+    # The tree builders write to the file descriptors directly, so they are redirected rather than sys.stdout
+    sys.stdout.flush()
+    sys.stderr.flush()
+    saved_stdout = os.dup(1)
+    saved_stderr = os.dup(2)
+    log_descriptor = os.open("gubbins.log", os.O_WRONLY | os.O_CREAT | os.O_TRUNC, 0o644)
+    os.dup2(log_descriptor, 1)
+    os.dup2(log_descriptor, 2)
+    error = None
+    try:
+        common.parse_and_run(job_args)
+    except SystemExit as exit_error:
+        error = str(exit_error.code)
+    except Exception as exception:
+        error = repr(exception)
+    finally:
+        sys.stdout.flush()
+        sys.stderr.flush()
+        os.dup2(saved_stdout, 1)
+        os.dup2(saved_stderr, 2)
+        for descriptor in [saved_stdout, saved_stderr, log_descriptor]:
+            os.close(descriptor)
+        os.chdir(current_directory)
+    return time.time() - start_time, error
+
+
+def run_batch(input_args):
+    """Runs every alignment in the manifest given by input_args.batch with the rest of the options, on worker
+    processes which each run many lineages, starting each one with its share of the threads which are free"""
+    printer = utils.VerbosePrinter(True, "\n")
+    jobs = read_batch_manifest(input_args.batch)
+    if len(jobs) == 0:
+        sys.exit("There are no alignments in the manifest")
+    total_threads = max(1, input_args.threads if input_args.threads is not None else 1)
+    printer.print("\nRunning Gubbins on " + str(len(jobs)) + " alignments with " + str(total_threads) + " threads...")
+
+    waiting_jobs = collections.deque(jobs)
+    running_jobs = {}
+    free_threads = total_threads
+    failed_jobs = []
+    with concurrent.futures.ProcessPoolExecutor(max_workers=min(len(jobs), total_threads)) as executor:
+        while waiting_jobs or running_jobs:
+            while waiting_jobs and free_threads > 0:
+                threads = threads_for_next_job(free_threads, len(waiting_jobs))
+                job = waiting_jobs.popleft()
+                running_jobs[executor.submit(run_batch_job, input_args, job, threads)] = (job, threads)
+                free_threads -= threads
+            finished, _ = concurrent.futures.wait(running_jobs, return_when=concurrent.futures.FIRST_COMPLETED)
+            for future in finished:
+                job, threads = running_jobs.pop(future)
+                free_threads += threads
+                run_time, error = future.result()
+                if error is None:
+                    printer.print(job.prefix + ": done on " + str(threads) + " threads in {:.2f} s".format(run_time))
+                else:
+                    printer.print(job.prefix + ": failed after {:.2f} s: ".format(run_time) + error)
+                    failed_jobs.append(job)
+    if failed_jobs:
+        sys.exit(str(len(failed_jobs)) + " of the " + str(len(jobs)) + " alignments failed, their gubbins.log files "
+                 "say why: " + ", ".join(job.prefix for job in failed_jobs))
+    printer.print("...finished all of the alignments.")
@@ -0,0 +1,386 @@
+# encoding: utf-8
+# Wellcome Trust Sanger Institute
+# Copyright (C) 2013  Wellcome Trust Sanger Institute
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+#
+
+"""Times whole runs of run_gubbins.py and single gubbins -r calls on the example data and on made up lineages of
+any size, across numbers of threads, and compares the results with a stored baseline"""
+
+import collections
+import json
+import operator
+import os
+import random
+import shutil
+import subprocess
+import sys
+import time
+
+from gubbins.run_profile import read_profile_report, aggregate_profile_reports
+
+BenchmarkDataset = collections.namedtuple("BenchmarkDataset", ["name", "alignment_filename", "starting_tree",
+                                                               "internal_alignment_filename", "number_of_taxa"])
+
+BENCHMARK_MODES = ["run_gubbins", "gubbins"]
+COMPARED_MEASUREMENTS = ["wall_seconds", "peak_rss_kb", "bytes_read", "bytes_written"]
+BASES = "ACGT"
+
+
+def example_datasets(example_data_directory, names=("PMEN1", "ST239")):
+    """The example data which is there. The full alignment is used if it has been downloaded next to the outputs
+    as NAME.aln, as the READMEs describe, and otherwise the polymorphic sites which are kept in the repository"""
+    datasets = []
+    for name in names:
+        directory = os.path.join(example_data_directory, name)
+        for filename in [name + ".aln", name + ".filtered_polymorphic_sites.fasta"]:
+            alignment_filename = os.path.join(directory, filename)
+            if os.path.exists(alignment_filename):
+                datasets.append(BenchmarkDataset(name, alignment_filename, None, None,
+                                                 count_sequences(alignment_filename)))
+                break
+    return datasets
+
+
+def count_sequences(alignment_filename):
+    with open(alignment_filename) as alignment_file:
+        return sum(1 for line in alignment_file if line.startswith(">"))
+
+
+def write_synthetic_lineages(directory, number_of_taxa, genome_length, seed=1, mutations_per_branch=20.0,
+                             recombinations_per_branch=0.05, recombination_length=5000):
+    """Makes up a lineage which evolved down a random binary tree, with point mutations on every branch and some
+    branches taking in a block of a diverged sequence. Writes the leaves, the tree with its internal nodes labelled
+    and the sequences of the internal nodes, so gubbins -r can be run without building a tree.
+    The same seed always gives the same files"""
+    random_numbers = random.Random(seed)
+    name = "synthetic_" + str(number_of_taxa)
+    os.makedirs(directory, exist_ok=True)
+    alignment_filename = os.path.join(directory, name + ".aln")
+    tree_filename = os.path.join(directory, name + ".tre")
+    internal_alignment_filename = os.path.join(directory, name + ".internal.aln")
+
+    # Split random leaves until there are enough
+    children = [[]]
+    lengths = [0.0]
+    leaves = [0]
+    while len(leaves) < number_of_taxa:
+        parent = leaves.pop(random_numbers.randrange(len(leaves)))
+        for _ in range(2):
+            children[parent].append(len(children))
+            leaves.append(len(children))
+            children.append([])
+            lengths.append(random_numbers.expovariate(1.0))
+
+    names = {}
+    for node in range(len(children)):
+        names[node] = ("taxon_" if len(children[node]) == 0 else "internal_") + str(node)
+    with open(tree_filename, "w") as tree_file:
+        tree_file.write(newick_string(0, children, lengths, names) + ";\n")
+
+    # Only the sequences on the path down to the current node are kept
+    with open(alignment_filename, "w") as alignment_file, \
+            open(internal_alignment_filename, "w") as internal_alignment_file:
+        root_sequence = bytearray("".join(random_numbers.choice(BASES) for _ in range(genome_length)).encode())
+        stack = [(0, root_sequence)]
+        while len(stack) > 0:
+            node, sequence = stack.pop()
+            output_file = alignment_file if len(children[node]) == 0 else internal_alignment_file
+            output_file.write(">" + names[node] + "\n" + sequence.decode() + "\n")
+            for child in reversed(children[node]):
+                child_sequence = bytearray(sequence)
+                evolve_branch(child_sequence, lengths[child]*mutations_per_branch, random_numbers)
+                if random_numbers.random() < recombinations_per_branch:
+                    import_recombination(child_sequence, recombination_length, random_numbers)
+                stack.append((child, child_sequence))
+    return BenchmarkDataset(name, alignment_filename, tree_filename, internal_alignment_filename, number_of_taxa)
+
+
+def newick_string(root, children, lengths, names):
+    """Written without recursion, so deep trees dont run out of stack"""
+    parts = []
+    stack = [(root, 0)]
+    while len(stack) > 0:
+        node, next_child = stack.pop()
+        if next_child == 0 and len(children[node]) > 0:
+            parts.append("(")
+        if next_child < len(children[node]):
+            if next_child > 0:
+                parts.append(",")
+            stack.append((node, next_child + 1))
+            stack.append((children[node][next_child], 0))
+            continue
+        if len(children[node]) > 0:
+            parts.append(")")
+        parts.append(names[node])
+        if node != root:
+            parts.append(":{:.6f}".format(lengths[node]/100))
+    return "".join(parts)
+
+
+def evolve_branch(sequence, expected_mutations, random_numbers):
+    number_of_mutations = int(expected_mutations) + (1 if random_numbers.random() < expected_mutations % 1 else 0)
+    for _ in range(number_of_mutations):
+        mutate_base(sequence, random_numbers.randrange(len(sequence)), random_numbers)
+
+
+def import_recombination(sequence, recombination_length, random_numbers, divergence=0.05):
+    """A block of the sequence replaced with one from a distant lineage, so it has far more snps than the rest"""
+    length = min(recombination_length, len(sequence))
+    start = random_numbers.randrange(len(sequence) - length + 1)
+    for _ in range(int(length*divergence)):
+        mutate_base(sequence, start + random_numbers.randrange(length), random_numbers)
+
+
+def mutate_base(sequence, position, random_numbers):
+    other_bases = BASES.replace(chr(sequence[position]), "")
+    sequence[position] = ord(random_numbers.choice(other_bases))
+
+
+def read_vcf_positions(vcf_filename):
+    """The 1-based positions of the rows of a vcf, reading only up to the second column of each line"""
+    positions = []
+    with open(vcf_filename) as vcf_file:
+        for line in vcf_file:
+            if not line.startswith("#"):
+                positions.append(int(line.split("\t", 2)[1]))
+    return positions
+
+
+def write_alignment_columns(alignment_filenames, positions, output_filename):
+    """Writes the bases at the 1-based positions of every sequence in the alignments to one file"""
+    if len(positions) == 0:
+        get_columns = lambda sequence: b""
+    elif len(positions) == 1:
+        get_columns = lambda sequence: bytes([sequence[positions[0] - 1]])
+    else:
+        column_getter = operator.itemgetter(*[position - 1 for position in positions])
+        get_columns = lambda sequence: bytes(column_getter(sequence))
+    with open(output_filename, "wb") as output_file:
+        for alignment_filename in alignment_filenames:
+            with open(alignment_filename, "rb") as alignment_file:
+                for name, sequence in read_fasta_records(alignment_file):
+                    output_file.write(b">" + name + b"\n" + get_columns(sequence) + b"\n")
+
+
+def read_fasta_records(alignment_file):
+    name = None
+    lines = []
+    for line in alignment_file:
+        line = line.rstrip(b"\r\n")
+        if line.startswith(b">"):
+            if name is not None:
+                yield name, b"".join(lines)
+            name = line[1:].split()[0]
+            lines = []
+        else:
+            lines.append(line)
+    if name is not None:
+        yield name, b"".join(lines)
+
+
+def measure_command(command, directory, log_filename):
+    """Runs the command in the directory, returning its wall time, the peak memory of it or any of its children and
+    the bytes it read from and wrote to disk, along with an error if it failed"""
+    start_time = time.time()
+    with open(log_filename, "a") as log_file:
+        log_file.write(" ".join(command) + "\n")
+        log_file.flush()
+        try:
+            process = subprocess.Popen(command, cwd=directory, stdout=log_file, stderr=subprocess.STDOUT)
+        except OSError as error:
+            return {"wall_seconds": 0.0, "peak_rss_kb": 0, "block_bytes_read": 0, "block_bytes_written": 0,
+                    "error": str(error)}
+        _, status, usage = os.wait4(process.pid, 0)
+        process.returncode = os.WEXITSTATUS(status) if os.WIFEXITED(status) else -1
+    measurement = {"wall_seconds": time.time() - start_time, "peak_rss_kb": usage.ru_maxrss,
+                   "block_bytes_read": usage.ru_inblock*512, "block_bytes_written": usage.ru_oublock*512,
+                   "error": None}
+    if process.returncode != 0:
+        measurement["error"] = "exited with " + str(process.returncode) + ", see " + log_filename
+    return measurement
+
+
+def add_profile_to_measurement(measurement, profile_filename, is_summary):
+    """Adds the bytes of the inputs and outputs and the time of each phase from the profile the run wrote"""
+    if not os.path.exists(profile_filename):
+        return measurement
+    if is_summary:
+        with open(profile_filename) as profile_file:
+            total = json.load(profile_file)["total"]
+    else:
+        total = aggregate_profile_reports([read_profile_report(profile_filename, 1)])["total"]
+    measurement["bytes_read"] = total["bytes_read"]
+    measurement["bytes_written"] = total["bytes_written"]
+    measurement["phases"] = {phase["name"]: phase["wall_seconds"] for phase in total["phases"]}
+    return measurement
+
+
+def benchmark_run_gubbins(dataset, threads, working_directory, run_gubbins_exec, extra_arguments=()):
+    """A whole run of the Python driver, in an empty directory"""
+    run_directory = os.path.join(working_directory, dataset.name + ".run_gubbins." + str(threads))
+    shutil.rmtree(run_directory, ignore_errors=True)
+    os.makedirs(run_directory)
+    profile_filename = os.path.join(run_directory, "profile.json")
+    command = [run_gubbins_exec, "--threads", str(threads), "--profile", profile_filename]
+    if dataset.starting_tree is not None:
+        command.extend(["--starting_tree", os.path.abspath(dataset.starting_tree)])
+    command.extend(extra_arguments)
+    command.append(os.path.abspath(dataset.alignment_filename))
+    measurement = measure_command(command, run_directory, os.path.join(run_directory, "benchmark.log"))
+    return add_profile_to_measurement(measurement, profile_filename, True)
+
+
+def prepare_gubbins_inputs(dataset, working_directory, gubbins_exec):
+    """Finds the snps of a made up lineage and puts its internal sequences next to the leaves at the same columns,
+    as the driver would before calling gubbins -r. Returns the directory with the inputs, or None if they cant be
+    made without reconstructing the ancestors"""
+    if dataset.internal_alignment_filename is None:
+        return None
+    input_directory = os.path.join(working_directory, dataset.name + ".gubbins_inputs")
+    joint_alignment_filename = os.path.join(input_directory, "joint.aln")
+    if os.path.exists(joint_alignment_filename):
+        return input_directory
+    shutil.rmtree(input_directory, ignore_errors=True)
+    os.makedirs(input_directory)
+    shutil.copyfile(dataset.alignment_filename, os.path.join(input_directory, "alignment.aln"))
+    measurement = measure_command([gubbins_exec, "alignment.aln"], input_directory,
+                                  os.path.join(input_directory, "benchmark.log"))
+    if measurement["error"] is not None:
+        sys.exit("Couldnt find the snps of " + dataset.name + ": " + measurement["error"])
+    positions = read_vcf_positions(os.path.join(input_directory, "alignment.aln.gaps.vcf"))
+    write_alignment_columns([dataset.alignment_filename, dataset.internal_alignment_filename], positions,
+                            joint_alignment_filename + ".tmp")
+    os.rename(joint_alignment_filename + ".tmp", joint_alignment_filename)
+    return input_directory
+
+
+def benchmark_gubbins(dataset, threads, working_directory, gubbins_exec, min_snps=3, min_window_size=100,
+                      max_window_size=10000):
+    """A single gubbins -r call with the tree the lineage was made with"""
+    input_directory = prepare_gubbins_inputs(dataset, working_directory, gubbins_exec)
+    if input_directory is None:
+        return None
+    run_directory = os.path.join(working_directory, dataset.name + ".gubbins." + str(threads))
+    shutil.rmtree(run_directory, ignore_errors=True)
+    os.makedirs(run_directory)
+    shutil.copyfile(dataset.starting_tree, os.path.join(run_directory, "tree.tre"))
+    profile_filename = os.path.join(run_directory, "profile.json")
+    command = [gubbins_exec, "-r", "-v", os.path.join(input_directory, "alignment.aln.gaps.vcf"),
+               "-f", os.path.join(input_directory, "alignment.aln"), "-t", "tree.tre", "-m", str(min_snps),
+               "-a", str(min_window_size), "-b", str(max_window_size), "-j", str(threads), "-p", profile_filename,
+               os.path.join(input_directory, "joint.aln")]
+    measurement = measure_command(command, run_directory, os.path.join(run_directory, "benchmark.log"))
+    return add_profile_to_measurement(measurement, profile_filename, False)
+
+
+def run_benchmarks(datasets, thread_counts, modes, working_directory, gubbins_exec="gubbins",
+                   run_gubbins_exec="run_gubbins.py", repeats=1, printer=print):
+    """Runs every mode on every dataset with each number of threads, keeping the fastest of the repeats"""
+    results = []
+    for dataset in datasets:
+        for mode in modes:
+            for threads in thread_counts:
+                best = None
+                for _ in range(repeats):
+                    if mode == "run_gubbins":
+                        measurement = benchmark_run_gubbins(dataset, threads, working_directory, run_gubbins_exec)
+                    else:
+                        measurement = benchmark_gubbins(dataset, threads, working_directory, gubbins_exec)
+                    if measurement is None:
+                        break
+                    if best is None or (measurement["error"] is None and
+                                        (best["error"] is not None or
+                                         measurement["wall_seconds"] < best["wall_seconds"])):
+                        best = measurement
+                if best is None:
+                    printer("Skipping " + mode + " on " + dataset.name + ", which has no internal sequences")
+                    break
+                best.update({"dataset": dataset.name, "taxa": dataset.number_of_taxa, "mode": mode,
+                             "threads": threads})
+                results.append(best)
+                printer("{} {} {} threads: {:.2f} s, {} KB peak{}".format(
+                    dataset.name, mode, threads, best["wall_seconds"], best["peak_rss_kb"],
+                    "" if best["error"] is None else " (" + best["error"] + ")"))
+    return results
+
+
+def scaling_curves(results):
+    """The speed up and efficiency of each run compared with the fewest threads the same dataset and mode ran with"""
+    fewest_threads = {}
+    for result in results:
+        if result["error"] is not None:
+            continue
+        key = (result["dataset"], result["mode"])
+        if key not in fewest_threads or result["threads"] < fewest_threads[key]["threads"]:
+            fewest_threads[key] = result
+    curves = []
+    for result in results:
+        key = (result["dataset"], result["mode"])
+        if result["error"] is not None or key not in fewest_threads:
+            continue
+        reference = fewest_threads[key]
+        speed_up = reference["wall_seconds"]/result["wall_seconds"] if result["wall_seconds"] > 0 else 0.0
+        curves.append({"dataset": result["dataset"], "taxa": result["taxa"], "mode": result["mode"],
+                       "threads": result["threads"], "wall_seconds": result["wall_seconds"], "speed_up": speed_up,
+                       "efficiency": speed_up*reference["threads"]/result["threads"]})
+    return curves
+
+
+def write_scaling_curves(curves, filename):
+    with open(filename, "w") as curves_file:
+        curves_file.write("dataset\ttaxa\tmode\tthreads\twall_seconds\tspeed_up\tefficiency\n")
+        for curve in curves:
+            curves_file.write("{}\t{}\t{}\t{}\t{:.3f}\t{:.3f}\t{:.3f}\n".format(
+                curve["dataset"], curve["taxa"], curve["mode"], curve["threads"], curve["wall_seconds"],
+                curve["speed_up"], curve["efficiency"]))
+
+
+def compare_with_baseline(results, baseline_results, tolerance=0.1, minimum_seconds=0.05):
+    """Returns a description of each measurement or phase which got worse by more than the tolerance. Times which
+    went up by less than minimum_seconds are left out, since short runs vary by more than that anyway"""
+    baseline_by_key = {(result["dataset"], result["mode"], result["threads"]): result for result in baseline_results}
+    regressions = []
+    for result in results:
+        key = (result["dataset"], result["mode"], result["threads"])
+        baseline = baseline_by_key.get(key)
+        label = "{} {} {} threads".format(*key)
+        if baseline is None:
+            continue
+        if result["error"] is not None:
+            if baseline["error"] is None:
+                regressions.append(label + " failed: " + result["error"])
+            continue
+        measurements = [(name, result.get(name), baseline.get(name)) for name in COMPARED_MEASUREMENTS]
+        for phase, wall_seconds in result.get("phases", {}).items():
+            measurements.append(("phase " + phase, wall_seconds, baseline.get("phases", {}).get(phase)))
+        for name, value, baseline_value in measurements:
+            if value is None or baseline_value is None or value <= baseline_value*(1 + tolerance):
+                continue
+            if (name == "wall_seconds" or name.startswith("phase ")) and value - baseline_value < minimum_seconds:
+                continue
+            regressions.append("{} {} went from {:g} to {:g}".format(label, name, baseline_value, value))
+    return regressions
+
+
+def write_benchmark_results(results, filename):
+    with open(filename, "w") as results_file:
+        json.dump({"results": results}, results_file, indent=2)
+
+
+def read_benchmark_results(filename):
+    with open(filename) as results_file:
+        return json.load(results_file)["results"]
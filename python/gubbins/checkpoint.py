@@ -0,0 +1,95 @@
+# encoding: utf-8
+# Wellcome Trust Sanger Institute
+# Copyright (C) 2013  Wellcome Trust Sanger Institute
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+#
+
+
+"""Checkpoints of iterative runs, so a run which stops part way can carry on from its last completed iteration"""
+
+import hashlib
+import json
+import os
+import re
+
+CHECKPOINT_VERSION = 1
+
+
+def checksum_file(filename):
+    """Returns the SHA-256 of the file as hex, reading it a MB at a time"""
+    file_hash = hashlib.sha256()
+    with open(filename, "rb") as input_file:
+        for block in iter(lambda: input_file.read(1024*1024), b""):
+            file_hash.update(block)
+    return file_hash.hexdigest()
+
+
+def checksum_files(filenames):
+    """Returns the checksums of the files which exist, by filename"""
+    return {filename: checksum_file(filename) for filename in filenames
+            if filename is not None and os.path.exists(filename)}
+
+
+def write_checkpoint(checkpoint_filename, state, input_checksums, options, retained_filenames):
+    """Records the state of the run with the checksums of its inputs and of the files it needs to carry on. The
+    checkpoint is written next to the old one and then moved over it, so it is never left half written."""
+    checkpoint = {"version": CHECKPOINT_VERSION, "input_checksums": input_checksums, "options": options,
+                  "retained_files": checksum_files(retained_filenames), "state": state}
+    temporary_filename = checkpoint_filename + ".tmp"
+    with open(temporary_filename, "w") as checkpoint_file:
+        json.dump(checkpoint, checkpoint_file, indent=1, sort_keys=True)
+        checkpoint_file.flush()
+        os.fsync(checkpoint_file.fileno())
+    os.replace(temporary_filename, checkpoint_filename)
+
+
+def read_checkpoint(checkpoint_filename, input_checksums, options):
+    """Returns the state recorded in the checkpoint, or None if there isnt one. Raises ValueError if the checkpoint
+    was made from other inputs or options, or a file which the run needs to carry on has gone or changed."""
+    if not os.path.exists(checkpoint_filename):
+        return None
+    with open(checkpoint_filename) as checkpoint_file:
+        checkpoint = json.load(checkpoint_file)
+    if checkpoint.get("version") != CHECKPOINT_VERSION:
+        raise ValueError("The checkpoint was written by another version of Gubbins")
+    if checkpoint["input_checksums"] != input_checksums:
+        raise ValueError("The input files have changed since the checkpoint was written")
+    if checkpoint["options"] != options:
+        raise ValueError("The options are different from those the checkpoint was written with")
+    for filename, checksum in sorted(checkpoint["retained_files"].items()):
+        if not os.path.exists(filename) or checksum_file(filename) != checksum:
+            raise ValueError("The file " + filename + " has gone or changed since the checkpoint was written")
+    return checkpoint["state"]
+
+
+def remove_partial_iteration_files(directories, basename, iteration, verbose=False):
+    """Removes the files left in the directories by an iteration which didnt complete, before it is run again. RAxML
+    and IQ-TREE refuse to overwrite the outputs of an earlier run with the same name."""
+    iteration_name = re.escape(basename + ".iteration_" + str(iteration))
+    iteration_regex = re.compile("^(RAxML_\\w+\\.)?" + iteration_name + "(\\..*)?$")
+    for directory in directories:
+        for filename in os.listdir(directory):
+            full_path = os.path.join(directory, filename)
+            if iteration_regex.match(filename) is not None and os.path.isfile(full_path):
+                if verbose:
+                    print("Deleting file: " + full_path)
+                os.remove(full_path)
+
+
+def remove_checkpoint(checkpoint_filename):
+    """Removes the checkpoint once the run has finished"""
+    if os.path.exists(checkpoint_filename):
+        os.remove(checkpoint_filename)
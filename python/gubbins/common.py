@@ -39,6 +39,10 @@ from gubbins.PreProcessFasta import PreProcessFasta
 from gubbins.ValidateFastaAlignment import ValidateFastaAlignment
 from gubbins.treebuilders import FastTree, IQTree, RAxML
 from gubbins import utils
+from gubbins.session import open_gubbins_session
+from gubbins.run_profile import read_profile_report, write_profile_summary, merge_trace_files
+from gubbins.checkpoint import checksum_files, read_checkpoint, write_checkpoint, remove_checkpoint, \
+    remove_partial_iteration_files
 
 
 def parse_and_run(input_args, program_description=""):
@@ -96,6 +100,8 @@ def parse_and_run(input_args, program_description=""):
         sys.exit("The names in the starting tree do not match the names in the alignment file")
     if number_of_sequences_in_alignment(input_args.alignment_filename) < 3:
         sys.exit("3 or more sequences are required.")
+    if input_args.contigs is not None and not os.path.exists(input_args.contigs):
+        sys.exit("The contigs file does not exist")
 
     # Check - and potentially correct - further input parameters
     check_and_fix_window_size(input_args)
@@ -111,48 +117,115 @@ def parse_and_run(input_args, program_description=""):
     gaps_vcf_filename = base_filename + ".gaps.vcf"
     joint_sequences_filename = base_filename + ".seq.joint.aln"
 
+    # After each iteration the state of the run is recorded, so with --resume it can carry on from there
+    checkpoint_filename = base_filename + ".checkpoint.json"
+    checkpoint_inputs = checksum_files([input_args.alignment_filename, input_args.starting_tree, input_args.contigs])
+    checkpoint_options = resumable_options(input_args)
+    checkpoint = None
+    if input_args.resume:
+        try:
+            checkpoint = read_checkpoint(checkpoint_filename, checkpoint_inputs, checkpoint_options)
+        except ValueError as error:
+            sys.exit(str(error) + ". Please rerun without the --resume option to start again.")
+        if checkpoint is None:
+            printer.print("There is no checkpoint to resume from, so the run starts from the beginning.")
+        else:
+            basename = checkpoint["basename"]
+
     # Check if intermediate files from a previous run exist
-    intermediate_files = [basename + ".iteration_"]
-    if not input_args.no_cleanup:
-        utils.delete_files(".", intermediate_files, "", input_args.verbose)
-    if utils.do_files_exist(".", intermediate_files, "", input_args.verbose):
-        sys.exit("Intermediate files from a previous run exist. Please rerun without the --no_cleanup option "
-                 "to automatically delete them or with the --use_time_stamp to add a unique prefix.")
+    if checkpoint is None:
+        intermediate_files = [basename + ".iteration_"]
+        if not input_args.no_cleanup:
+            utils.delete_files(".", intermediate_files, "", input_args.verbose)
+        if utils.do_files_exist(".", intermediate_files, "", input_args.verbose):
+            sys.exit("Intermediate files from a previous run exist. Please rerun without the --no_cleanup option "
+                     "to automatically delete them or with the --use_time_stamp to add a unique prefix.")
     printer.print("...done. Run time: {:.2f} s".format(time.time() - start_time))
 
-    # Filter the input alignment and save as temporary alignment file
-    printer.print("\nFiltering input alignment...")
-    temp_working_dir = tempfile.mkdtemp(dir=os.getcwd())
-    temp_alignment_filename = temp_working_dir + "/" + base_filename
-
-    pre_process_fasta = PreProcessFasta(input_args.alignment_filename, input_args.verbose,
-                                        input_args.filter_percentage)
-    taxa_removed = pre_process_fasta.remove_duplicate_sequences_and_sequences_missing_too_much_data(
-        temp_alignment_filename, input_args.remove_identical_sequences)
-    input_args.alignment_filename = temp_alignment_filename
-
-    # If a starting tree has been provided make sure that taxa filtered out in the previous step are removed from it
-    if input_args.starting_tree:
-        (tree_base_directory, tree_base_filename) = os.path.split(input_args.starting_tree)
-        temp_starting_tree = temp_working_dir + '/' + tree_base_filename
-        filter_out_removed_taxa_from_tree(input_args.starting_tree, temp_starting_tree, taxa_removed)
-        input_args.starting_tree = temp_starting_tree
-    printer.print("...done. Run time: {:.2f} s".format(time.time() - start_time))
+    # Each run of gubbins writes a profile into the working directory, and they are added up at the end
+    profile_filenames = []
+    trace_filenames = []
+    first_iteration = 1
+    converged = False
+    gubbins_outputs = None
+    gubbins_input_tree_name = None
+    if checkpoint is None:
+        # Filter the input alignment and save as temporary alignment file
+        printer.print("\nFiltering input alignment...")
+        temp_working_dir = tempfile.mkdtemp(dir=os.getcwd())
+        temp_alignment_filename = temp_working_dir + "/" + base_filename
+
+        pre_process_fasta = PreProcessFasta(input_args.alignment_filename, input_args.verbose,
+                                            input_args.filter_percentage, input_args.threads)
+        taxa_removed = pre_process_fasta.remove_duplicate_sequences_and_sequences_missing_too_much_data(
+            temp_alignment_filename, input_args.remove_identical_sequences)
+        input_args.alignment_filename = temp_alignment_filename
+
+        # If a starting tree has been provided make sure that taxa filtered out in the previous step are removed from it
+        if input_args.starting_tree:
+            (tree_base_directory, tree_base_filename) = os.path.split(input_args.starting_tree)
+            temp_starting_tree = temp_working_dir + '/' + tree_base_filename
+            filter_out_removed_taxa_from_tree(input_args.starting_tree, temp_starting_tree, taxa_removed)
+            input_args.starting_tree = temp_starting_tree
+        printer.print("...done. Run time: {:.2f} s".format(time.time() - start_time))
 
-    # Find all SNP sites with Gubbins
-    gubbins_command = " ".join([gubbins_exec, input_args.alignment_filename])
-    printer.print(["\nRunning Gubbins to detect SNPs...", gubbins_command])
-    try:
-        subprocess.check_call(gubbins_command, shell=True)
-    except subprocess.SubprocessError:
-        sys.exit("Gubbins crashed, please ensure you have enough free memory")
-    printer.print("...done. Run time: {:.2f} s".format(time.time() - start_time))
-    reconvert_fasta_file(snp_alignment_filename, snp_alignment_filename)
-    reconvert_fasta_file(gaps_alignment_filename, base_filename + ".start")
+        # Find all SNP sites with Gubbins
+        snp_sites_profile_filename = temp_working_dir + "/snp_sites.profile.json"
+        gubbins_command = create_snp_sites_command(
+            gubbins_exec, input_args.alignment_filename,
+            profile_filename=snp_sites_profile_filename if input_args.profile is not None else None,
+            contigs_filename=input_args.contigs, max_memory=input_args.max_memory)
+        printer.print(["\nRunning Gubbins to detect SNPs...", gubbins_command])
+        try:
+            subprocess.check_call(gubbins_command, shell=True)
+        except subprocess.SubprocessError:
+            sys.exit("Gubbins crashed, please ensure you have enough free memory")
+        printer.print("...done. Run time: {:.2f} s".format(time.time() - start_time))
+        if input_args.profile is not None:
+            profile_filenames.append((0, snp_sites_profile_filename))
+        reconvert_fasta_file(snp_alignment_filename, snp_alignment_filename)
+        reconvert_fasta_file(gaps_alignment_filename, base_filename + ".start")
+    else:
+        # The filtered alignment, its SNPs and the trees of the completed iterations are all still there
+        printer.print("\nResuming after iteration " + str(checkpoint["completed_iterations"]) + "...")
+        temp_working_dir = checkpoint["temp_working_dir"]
+        input_args.alignment_filename = checkpoint["alignment_filename"]
+        input_args.starting_tree = checkpoint["starting_tree"]
+        profile_filenames = [tuple(profile) for profile in checkpoint["profile_filenames"]]
+        trace_filenames = [tuple(trace) for trace in checkpoint["trace_filenames"]]
+        tree_file_names = checkpoint["tree_file_names"]
+        current_tree_name = checkpoint["current_tree_name"]
+        current_tree_name_with_internal_nodes = current_tree_name + ".internal"
+        converged = checkpoint["converged"]
+        gubbins_outputs = checkpoint["gubbins_outputs"]
+        gubbins_input_tree_name = checkpoint["gubbins_input_tree_name"]
+        # A run which had converged only has its final outputs left to write
+        first_iteration = input_args.iterations + 1 if converged else checkpoint["completed_iterations"] + 1
+        # The iteration the run stopped in is run again, so the tree builders find none of its outputs
+        remove_partial_iteration_files([current_directory, temp_working_dir], basename, first_iteration,
+                                       input_args.verbose)
+        if first_iteration > 2 and input_args.tree_builder == "hybrid":
+            tree_builder = sequence_reconstructor
+            alignment_suffix = ".phylip"
+        printer.print("...done. Run time: {:.2f} s".format(time.time() - start_time))
+
+    # Branches with the same sequences at both ends as in the last iteration reuse its scans
+    branch_scan_cache_directory = temp_working_dir + "/branch_scans"
+
+    # Recombinations are detected inside this process if libgubbins can be loaded, so the vcf is only read once
+    gubbins_session = open_gubbins_session(gaps_vcf_filename, input_args.alignment_filename, input_args.min_snps,
+                                           input_args.min_window_size, input_args.max_window_size,
+                                           input_args.threads, alignment_cache=True,
+                                           multi_block=input_args.multi_block,
+                                           branch_scan_cache_directory=branch_scan_cache_directory,
+                                           max_memory=input_args.max_memory,
+                                           binary_branch_snps=input_args.binary_branch_snps,
+                                           sparse_ancestors=input_args.sparse_ancestors,
+                                           ancestral_reconstruction=input_args.ancestral_reconstruction)
 
     # Start the main loop
     printer.print("\nEntering the main loop.")
-    for i in range(1, input_args.iterations+1):
+    for i in range(first_iteration, input_args.iterations+1):
         printer.print("\n*** Iteration " + str(i) + " ***")
 
         # 1.1. Construct the tree-building command depending on the iteration and employed options
@@ -202,61 +275,88 @@ def parse_and_run(input_args, program_description=""):
         else:
             root_tree(current_tree_name, temp_rooted_tree)
 
-        # 3.1. Construct the command for ancestral state reconstruction depending on the iteration and employed options
-        ancestral_sequence_basename = current_basename + ".internal"
-        sequence_reconstruction_command = sequence_reconstructor.internal_sequence_reconstruction_command(
-            os.path.abspath(base_filename + alignment_suffix), os.path.abspath(temp_rooted_tree),
-            ancestral_sequence_basename)
-        raw_internal_sequence_filename \
-            = temp_working_dir + "/" + sequence_reconstructor.asr_prefix \
-            + ancestral_sequence_basename + sequence_reconstructor.asr_suffix
-        processed_internal_sequence_filename = temp_working_dir + "/" + ancestral_sequence_basename + ".aln"
-        raw_internal_rooted_tree_filename \
-            = temp_working_dir + "/" + sequence_reconstructor.asr_tree_prefix \
-            + ancestral_sequence_basename + sequence_reconstructor.asr_tree_suffix
-
-        # 3.2. Reconstruct the ancestral sequence
-        printer.print(["\nReconstructing ancestral sequences with " + sequence_reconstructor.executable + "...",
-                       sequence_reconstruction_command])
-        os.chdir(temp_working_dir)
-        try:
-            subprocess.check_call(sequence_reconstruction_command, shell=True)
-        except subprocess.SubprocessError:
-            sys.exit("Failed while reconstructing the ancestral sequences.")
-        os.chdir(current_directory)
-
-        # 3.3. Join ancestral sequences with given sequences
         current_tree_name_with_internal_nodes = current_tree_name + ".internal"
-        sequence_reconstructor.convert_raw_ancestral_states_to_fasta(raw_internal_sequence_filename,
-                                                                     processed_internal_sequence_filename)
-        concatenate_fasta_files([snp_alignment_filename, processed_internal_sequence_filename],
-                                joint_sequences_filename)
-        transfer_internal_node_labels_to_tree(raw_internal_rooted_tree_filename, temp_rooted_tree,
-                                              current_tree_name_with_internal_nodes, sequence_reconstructor)
-        printer.print("...done. Run time: {:.2f} s".format(time.time() - start_time))
+        if input_args.ancestral_reconstruction != "external":
+            # 3. Gubbins reconstructs the ancestral sequences itself from the leaves, for the labelled internal nodes
+            label_internal_nodes_of_tree(temp_rooted_tree, current_tree_name_with_internal_nodes,
+                                         internal_node_label_prefix)
+            shutil.copyfile(base_filename + ".start", gaps_alignment_filename)
+        else:
+            # 3.1. Construct the command for ancestral state reconstruction depending on the iteration and employed
+            # options
+            ancestral_sequence_basename = current_basename + ".internal"
+            sequence_reconstruction_command = sequence_reconstructor.internal_sequence_reconstruction_command(
+                os.path.abspath(base_filename + alignment_suffix), os.path.abspath(temp_rooted_tree),
+                ancestral_sequence_basename)
+            raw_internal_sequence_filename \
+                = temp_working_dir + "/" + sequence_reconstructor.asr_prefix \
+                + ancestral_sequence_basename + sequence_reconstructor.asr_suffix
+            processed_internal_sequence_filename = temp_working_dir + "/" + ancestral_sequence_basename + ".aln"
+            raw_internal_rooted_tree_filename \
+                = temp_working_dir + "/" + sequence_reconstructor.asr_tree_prefix \
+                + ancestral_sequence_basename + sequence_reconstructor.asr_tree_suffix
+
+            # 3.2. Reconstruct the ancestral sequence
+            printer.print(["\nReconstructing ancestral sequences with " + sequence_reconstructor.executable + "...",
+                           sequence_reconstruction_command])
+            os.chdir(temp_working_dir)
+            try:
+                subprocess.check_call(sequence_reconstruction_command, shell=True)
+            except subprocess.SubprocessError:
+                sys.exit("Failed while reconstructing the ancestral sequences.")
+            os.chdir(current_directory)
 
-        # 4. Reinsert gaps (cp15 note: something is wonky here, the process is at the very least terribly inefficient)
-        printer.print("\nReinserting gaps into the alignment...")
-        shutil.copyfile(base_filename + ".start", gaps_alignment_filename)
-        reinsert_gaps_into_fasta_file(joint_sequences_filename, gaps_vcf_filename, gaps_alignment_filename)
-        if not os.path.exists(gaps_alignment_filename) \
-                or not ValidateFastaAlignment(gaps_alignment_filename).is_input_fasta_file_valid():
-            sys.exit("There is a problem with your FASTA file after running internal sequence reconstruction. "
-                     "Please check this intermediate file is valid: " + gaps_alignment_filename)
-        printer.print("...done. Run time: {:.2f} s".format(time.time() - start_time))
+            # 3.3. Join ancestral sequences with given sequences
+            sequence_reconstructor.convert_raw_ancestral_states_to_fasta(raw_internal_sequence_filename,
+                                                                         processed_internal_sequence_filename)
+            concatenate_fasta_files([snp_alignment_filename, processed_internal_sequence_filename],
+                                    joint_sequences_filename)
+            transfer_internal_node_labels_to_tree(raw_internal_rooted_tree_filename, temp_rooted_tree,
+                                                  current_tree_name_with_internal_nodes, sequence_reconstructor)
+            printer.print("...done. Run time: {:.2f} s".format(time.time() - start_time))
+
+            # 4. Reinsert gaps, appending the gapped ancestral sequences to the leaf sequences
+            printer.print("\nReinserting gaps into the alignment...")
+            shutil.copyfile(base_filename + ".start", gaps_alignment_filename)
+            if gubbins_session is not None:
+                gubbins_session.reinsert_gaps(joint_sequences_filename, gaps_alignment_filename)
+            else:
+                reinsert_gaps_command = create_reinsert_gaps_command(gubbins_exec, joint_sequences_filename,
+                                                                     gaps_vcf_filename, gaps_alignment_filename)
+                try:
+                    subprocess.check_call(reinsert_gaps_command, shell=True)
+                except subprocess.SubprocessError:
+                    sys.exit("Failed while reinserting gaps into the alignment")
+            if not os.path.exists(gaps_alignment_filename) \
+                    or not ValidateFastaAlignment(gaps_alignment_filename).is_input_fasta_file_valid():
+                sys.exit("There is a problem with your FASTA file after running internal sequence reconstruction. "
+                         "Please check this intermediate file is valid: " + gaps_alignment_filename)
+            printer.print("...done. Run time: {:.2f} s".format(time.time() - start_time))
 
         # 5. Detect recombination sites with Gubbins (cp15 note: copy file with internal nodes back and forth to
         # ensure all created files have the desired name structure and to avoid fiddling with the Gubbins C program)
         shutil.copyfile(current_tree_name_with_internal_nodes, current_tree_name)
-        gubbins_command = create_gubbins_command(
-            gubbins_exec, gaps_alignment_filename, gaps_vcf_filename, current_tree_name,
-            input_args.alignment_filename, input_args.min_snps, input_args.min_window_size, input_args.max_window_size)
-        printer.print(["\nRunning Gubbins to detect recombinations...", gubbins_command])
-        try:
-            subprocess.check_call(gubbins_command, shell=True)
-        except subprocess.SubprocessError:
-            sys.exit("Failed while running Gubbins. Please ensure you have enough free memory")
+        # Before the last iteration only the files which the next one reads are written
+        if i < input_args.iterations:
+            next_alignment_suffix = ".phylip" if input_args.tree_builder == "hybrid" and i == 1 else alignment_suffix
+            gubbins_outputs = intermediate_gubbins_outputs(next_alignment_suffix)
+            gubbins_input_tree_name = temp_working_dir + "/" + current_tree_name + ".gubbins_input"
+            shutil.copyfile(current_tree_name, gubbins_input_tree_name)
+        else:
+            gubbins_outputs = None
+        profile_filename = None
+        if input_args.profile is not None:
+            profile_filename = temp_working_dir + "/iteration_" + str(i) + ".profile.json"
+        trace_filename = None
+        if input_args.trace is not None:
+            trace_filename = temp_working_dir + "/iteration_" + str(i) + ".trace.json"
+            trace_filenames.append((i, trace_filename))
+        detect_recombinations(gubbins_session, gubbins_exec, input_args, gaps_alignment_filename, gaps_vcf_filename,
+                              current_tree_name, branch_scan_cache_directory, printer, profile_filename,
+                              trace_filename, gubbins_outputs)
         printer.print("...done. Run time: {:.2f} s".format(time.time() - start_time))
+        if profile_filename is not None:
+            profile_filenames.append((i, profile_filename))
         shutil.copyfile(current_tree_name, current_tree_name_with_internal_nodes)
 
         # 6. Check for convergence
@@ -268,15 +368,49 @@ def parse_and_run(input_args, program_description=""):
                 current_recomb_file, previous_recomb_files = get_recombination_files(tree_file_names)
                 if have_recombinations_been_seen_before(current_recomb_file, previous_recomb_files):
                     printer.print("Convergence after " + str(i) + " iterations: Recombinations observed before.")
-                    break
+                    converged = True
             else:
                 if has_tree_been_seen_before(tree_file_names, input_args.converge_method):
                     printer.print("Convergence after " + str(i) + " iterations: Tree observed before.")
-                    break
+                    converged = True
+        with open(current_tree_name) as current_tree_file:
+            current_tree = current_tree_file.read()
+        checkpoint_state = {"basename": basename, "temp_working_dir": temp_working_dir,
+                            "alignment_filename": input_args.alignment_filename,
+                            "starting_tree": input_args.starting_tree, "completed_iterations": i,
+                            "converged": converged, "current_tree_name": current_tree_name,
+                            "current_tree": current_tree, "tree_file_names": tree_file_names,
+                            "recombination_fingerprint": read_recombination_fingerprint(current_tree_name + ".tab"),
+                            "gubbins_outputs": gubbins_outputs, "gubbins_input_tree_name": gubbins_input_tree_name,
+                            "profile_filenames": profile_filenames, "trace_filenames": trace_filenames}
+        write_checkpoint(checkpoint_filename, checkpoint_state, checkpoint_inputs, checkpoint_options,
+                         checkpoint_retained_files(input_args.alignment_filename, base_filename, tree_file_names,
+                                                   gubbins_input_tree_name))
+        if converged:
+            break
         printer.print("...done. Run time: {:.2f} s".format(time.time() - start_time))
-    else:
+    if not converged:
         printer.print("Maximum number of iterations (" + str(input_args.iterations) + ") reached.")
+    if gubbins_outputs is not None:
+        # Converged before the last iteration, so the rest of its files are written by running it again, which
+        # reuses the scans of all of its branches
+        printer.print("\nWriting all of the outputs of the last iteration...")
+        shutil.copyfile(gubbins_input_tree_name, current_tree_name)
+        detect_recombinations(gubbins_session, gubbins_exec, input_args, gaps_alignment_filename, gaps_vcf_filename,
+                              current_tree_name, branch_scan_cache_directory, printer)
+        shutil.copyfile(current_tree_name, current_tree_name_with_internal_nodes)
+        remove_internal_node_labels_from_tree(current_tree_name_with_internal_nodes, current_tree_name)
+        printer.print("...done. Run time: {:.2f} s".format(time.time() - start_time))
     printer.print("\nExiting the main loop.")
+    if gubbins_session is not None:
+        gubbins_session.close()
+    if input_args.profile is not None:
+        profile_reports = [read_profile_report(filename, iteration) for iteration, filename in profile_filenames]
+        write_profile_summary([report for report in profile_reports if report is not None], input_args.profile)
+        printer.print("Profile written to " + input_args.profile)
+    if input_args.trace is not None:
+        merge_trace_files(trace_filenames, input_args.trace)
+        printer.print("Trace written to " + input_args.trace)
 
     # Create the final output
     printer.print("\nCreating the final output...")
@@ -285,6 +419,7 @@ def parse_and_run(input_args, program_description=""):
     output_filenames_to_final_filenames = translation_of_filenames_to_final_filenames(
         current_tree_name, input_args.prefix)
     utils.rename_files(output_filenames_to_final_filenames)
+    remove_checkpoint(checkpoint_filename)
 
     # Cleanup intermediate files
     if not input_args.no_cleanup:
@@ -294,11 +429,116 @@ def parse_and_run(input_args, program_description=""):
     printer.print("...finished. Total run time: {:.2f} s".format(time.time() - start_time))
 
 
+def detect_recombinations(gubbins_session, gubbins_exec, input_args, alignment_filename, vcf_filename, tree_name,
+                          branch_scan_cache_directory, printer, profile_filename=None, trace_filename=None,
+                          outputs=None):
+    """Runs Gubbins on the tree, in the session if there is one or otherwise with the executable, writing only the
+    outputs named if they are given"""
+    if gubbins_session is not None:
+        printer.print("\nRunning Gubbins to detect recombinations...")
+        if profile_filename is not None:
+            gubbins_session.start_profile(profile_filename)
+        if trace_filename is not None:
+            gubbins_session.start_trace(trace_filename)
+        gubbins_session.load_sequences_from_file(alignment_filename)
+        gubbins_session.run_iteration(tree_name, outputs=outputs)
+        if profile_filename is not None:
+            gubbins_session.write_profile_report()
+        if trace_filename is not None:
+            gubbins_session.write_trace()
+    else:
+        gubbins_command = create_gubbins_command(
+            gubbins_exec, alignment_filename, vcf_filename, tree_name,
+            input_args.alignment_filename, input_args.min_snps, input_args.min_window_size,
+            input_args.max_window_size, input_args.threads, alignment_cache=True,
+            multi_block=input_args.multi_block, profile_filename=profile_filename,
+            trace_filename=trace_filename, branch_scan_cache_directory=branch_scan_cache_directory,
+            max_memory=input_args.max_memory, outputs=outputs,
+            binary_branch_snps=input_args.binary_branch_snps, sparse_ancestors=input_args.sparse_ancestors,
+            ancestral_reconstruction=input_args.ancestral_reconstruction)
+        printer.print(["\nRunning Gubbins to detect recombinations...", gubbins_command])
+        try:
+            subprocess.check_call(gubbins_command, shell=True)
+        except subprocess.SubprocessError:
+            sys.exit("Failed while running Gubbins. Please ensure you have enough free memory")
+
+
+def resumable_options(input_args):
+    """The options which change what each iteration does, so a run can only be resumed with the same ones"""
+    return {option: getattr(input_args, option, None) for option in
+            ["tree_builder", "raxml_model", "outgroup", "filter_percentage", "remove_identical_sequences",
+             "min_snps", "min_window_size", "max_window_size", "converge_method", "multi_block",
+             "ancestral_reconstruction", "use_time_stamp"]}
+
+
+def checkpoint_retained_files(alignment_filename, base_filename, tree_file_names, gubbins_input_tree_name):
+    """The files which a resumed run reads: the filtered alignment, its SNPs and the trees, recombinations and
+    alignments of the completed iterations"""
+    retained_files = [alignment_filename, gubbins_input_tree_name]
+    for starting_file in [base_filename + suffix for suffix in
+                          [".gaps.vcf", ".start", ".snp_sites.aln", ".phylip", ".gaps.snp_sites.aln"]]:
+        retained_files.append(starting_file)
+    for tree_file_name in tree_file_names:
+        retained_files.extend([tree_file_name + suffix for suffix in
+                               ["", ".internal", ".tab", ".tab.fingerprint", ".phylip", ".snp_sites.aln"]])
+    return retained_files
+
+
+def intermediate_gubbins_outputs(next_alignment_suffix):
+    """The outputs of Gubbins which the next iteration reads: the recombinations, to check for convergence, and the
+    alignment the next tree is built from"""
+    return ["tab", "phylip" if next_alignment_suffix == ".phylip" else "snp_sites"]
+
+
+def create_snp_sites_command(gubbins_exec, alignment_filename, profile_filename=None, contigs_filename=None,
+                             max_memory=None):
+    command = [gubbins_exec, "-c"]
+    if profile_filename is not None:
+        command.extend(["-p", profile_filename])
+    if contigs_filename is not None:
+        command.extend(["-k", contigs_filename])
+    if max_memory is not None:
+        command.extend(["-M", str(max_memory)])
+    command.append(alignment_filename)
+    return " ".join(command)
+
+
 def create_gubbins_command(gubbins_exec, alignment_filename, vcf_filename, current_tree_name,
-                           original_alignment_filename, min_snps, min_window_size, max_window_size):
+                           original_alignment_filename, min_snps, min_window_size, max_window_size, threads=1,
+                           alignment_cache=False, multi_block=False, profile_filename=None,
+                           trace_filename=None, branch_scan_cache_directory=None, max_memory=None, outputs=None,
+                           binary_branch_snps=False, sparse_ancestors=False, ancestral_reconstruction="external"):
     command = [gubbins_exec, "-r", "-v", vcf_filename, "-a", str(min_window_size),
                "-b", str(max_window_size), "-f", original_alignment_filename, "-t", current_tree_name,
-               "-m", str(min_snps), alignment_filename]
+               "-m", str(min_snps)]
+    if threads is not None and threads > 1:
+        command.extend(["-j", str(threads)])
+    if alignment_cache:
+        command.append("-c")
+    if multi_block:
+        command.append("-x")
+    if profile_filename is not None:
+        command.extend(["-p", profile_filename])
+    if trace_filename is not None:
+        command.extend(["-e", trace_filename])
+    if branch_scan_cache_directory is not None:
+        command.extend(["-w", branch_scan_cache_directory])
+    if max_memory is not None:
+        command.extend(["-M", str(max_memory)])
+    if outputs is not None:
+        command.extend(["-O", ",".join(outputs)])
+    if binary_branch_snps:
+        command.append("-y")
+    if sparse_ancestors:
+        command.append("-d")
+    if ancestral_reconstruction != "external":
+        command.extend(["-A", ancestral_reconstruction])
+    command.append(alignment_filename)
+    return " ".join(command)
+
+
+def create_reinsert_gaps_command(gubbins_exec, alignment_filename, vcf_filename, output_alignment_filename):
+    command = [gubbins_exec, "-g", "-v", vcf_filename, "-o", output_alignment_filename, alignment_filename]
     return " ".join(command)
 
 
@@ -515,6 +755,18 @@ def transfer_internal_node_labels_to_tree(source_tree_filename, destination_tree
         output_file.write(output_tree_string.replace('\'', ''))
 
 
+def label_internal_nodes_of_tree(input_tree_filename, output_tree_filename, internal_node_label_prefix):
+    """Names the internal nodes of the tree in pre-order, so Gubbins can reconstruct their sequences"""
+    tree = dendropy.Tree.get_from_path(input_tree_filename, 'newick', preserve_underscores=True)
+    for index, internal_node in enumerate(tree.preorder_internal_node_iter()):
+        internal_node.label = None
+        internal_node.taxon = dendropy.Taxon(internal_node_label_prefix + str(index + 1))
+
+    output_tree_string = tree_as_string(tree, suppress_internal=False, suppress_rooting=False)
+    with open(output_tree_filename, 'w+') as output_file:
+        output_file.write(output_tree_string.replace('\'', ''))
+
+
 def remove_internal_node_labels_from_tree(input_filename, output_filename):
     tree = dendropy.Tree.get_from_path(input_filename, 'newick', preserve_underscores=True)
     output_tree_string = tree_as_string(tree)
@@ -534,7 +786,7 @@ def reinsert_gaps_into_fasta_file(input_fasta_filename, input_vcf_file, output_f
         for vcf_line in vcf_file:
             if re.match('^#CHROM', vcf_line) is not None:
                 sample_names = vcf_line.rstrip().split('\t')[9:]
-            elif re.match('^\d', vcf_line) is not None:
+            elif re.match('^[^#\s]', vcf_line) is not None:
                 # If the alternate is only a gap it wont have a base in this column
                 if re.match('^([^\t]+\t){3}([ACGTacgt])\t([^ACGTacgt])\t', vcf_line) is not None:
                     m = re.match('^([^\t]+\t){3}([ACGTacgt])\t([^ACGTacgt])\t', vcf_line)
@@ -592,17 +844,34 @@ def get_recombination_files(basenames):
 def have_recombinations_been_seen_before(current_file, previous_files):
     if not os.path.exists(current_file):
         return False
-    current_file_recombinations = extract_recombinations_from_embl(current_file)
+    current_file_recombinations = None
+    current_fingerprint = read_recombination_fingerprint(current_file)
 
     for previous_file in previous_files:
         if not os.path.exists(previous_file):
             continue
+        # Different fingerprints mean different recombinations, so the files are only read when they match
+        previous_fingerprint = read_recombination_fingerprint(previous_file)
+        if current_fingerprint is not None and previous_fingerprint is not None \
+                and current_fingerprint != previous_fingerprint:
+            continue
+        if current_file_recombinations is None:
+            current_file_recombinations = extract_recombinations_from_embl(current_file)
         previous_file_recombinations = extract_recombinations_from_embl(previous_file)
         if current_file_recombinations == previous_file_recombinations:
             return True
     return False
 
 
+def read_recombination_fingerprint(recombination_filename):
+    """Returns the fingerprint written by Gubbins next to the tab file, or None if there isnt one"""
+    fingerprint_filename = recombination_filename + ".fingerprint"
+    if not os.path.exists(fingerprint_filename):
+        return None
+    with open(fingerprint_filename, "r") as fingerprint_file:
+        return fingerprint_file.read().strip()
+
+
 def extract_recombinations_from_embl(filename):
     with open(filename, "r") as fh:
         sequences_to_coords = {}
@@ -641,8 +910,13 @@ def has_tree_been_seen_before(tree_file_names, converge_method):
         if os.path.exists(tree_file_name):
             tree_files_which_exist.append(tree_file_name)
 
+    # Trees with different splits cant be the same, so only those with the same hash are compared in full
+    current_tree_hash = read_tree_bipartitions_hash(tree_files_which_exist[-1], converge_method)
     for tree_file_name in tree_files_which_exist:
         if tree_file_name is not tree_files_which_exist[-1]:
+            tree_hash = read_tree_bipartitions_hash(tree_file_name, converge_method)
+            if current_tree_hash is not None and tree_hash is not None and current_tree_hash != tree_hash:
+                continue
             if converge_method == 'weighted_robinson_foulds':
                 current_rf_distance = robinson_foulds_distance(
                     tree_file_name, tree_files_which_exist[-1])
@@ -657,6 +931,21 @@ def has_tree_been_seen_before(tree_file_names, converge_method):
     return False
 
 
+def read_tree_bipartitions_hash(tree_filename, converge_method):
+    """Returns the hash of the splits written by Gubbins next to the tree, only counting the splits with a length
+    for the weighted distance, or None if there isnt one"""
+    bipartitions_filename = tree_filename + ".bipartitions"
+    if not os.path.exists(bipartitions_filename):
+        return None
+    with open(bipartitions_filename, "r") as bipartitions_file:
+        fields = bipartitions_file.read().split()
+    if len(fields) < 2:
+        return None
+    if converge_method == 'weighted_robinson_foulds':
+        return fields[1]
+    return fields[0]
+
+
 def robinson_foulds_distance(input_tree_name, output_tree_name):
     tns = dendropy.TaxonNamespace()
     input_tree = dendropy.Tree.get_from_path(input_tree_name, 'newick', taxon_namespace=tns)
@@ -679,6 +968,8 @@ def translation_of_filenames_to_final_filenames(input_prefix, output_prefix):
     input_names_to_output_names = {
         str(input_prefix) + ".vcf":             str(output_prefix) + ".summary_of_snp_distribution.vcf",
         str(input_prefix) + ".branch_snps.tab": str(output_prefix) + ".branch_base_reconstruction.embl",
+        str(input_prefix) + ".branch_snps.bin": str(output_prefix) + ".branch_base_reconstruction.bin",
+        str(input_prefix) + ".branch_snps.nodes": str(output_prefix) + ".branch_base_reconstruction.nodes",
         str(input_prefix) + ".tab":             str(output_prefix) + ".recombination_predictions.embl",
         str(input_prefix) + ".gff":             str(output_prefix) + ".recombination_predictions.gff",
         str(input_prefix) + ".stats":           str(output_prefix) + ".per_branch_statistics.csv",
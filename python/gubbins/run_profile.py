@@ -0,0 +1,88 @@
+# encoding: utf-8
+# Wellcome Trust Sanger Institute
+# Copyright (C) 2013  Wellcome Trust Sanger Institute
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+#
+
+"""Collects the profiles and traces the gubbins executable or library writes for each iteration"""
+
+import json
+import os
+
+BRANCH_COUNTERS = ["snps", "passes", "windows", "candidate_blocks", "trimming_steps", "accepted_blocks"]
+
+
+def read_profile_report(filename, iteration):
+    """Returns the report in the file labelled with the iteration, or None if it wasnt written"""
+    if not os.path.exists(filename):
+        return None
+    with open(filename) as report_file:
+        report = json.load(report_file)
+    report["iteration"] = iteration
+    return report
+
+
+def aggregate_profile_reports(reports):
+    """Adds up the times of each phase, the bytes read and written and the branch counters of every report.
+    The peak memory is the largest of any report, since each one covers a separate run."""
+    phases = {}
+    total = {"wall_seconds": 0.0, "cpu_seconds": 0.0, "peak_rss_kb": 0, "bytes_read": 0, "bytes_written": 0,
+             "branches": 0}
+    for counter in BRANCH_COUNTERS:
+        total[counter] = 0
+    for report in reports:
+        total["wall_seconds"] += report["wall_seconds"]
+        total["cpu_seconds"] += report["cpu_seconds"]
+        total["peak_rss_kb"] = max(total["peak_rss_kb"], report["peak_rss_kb"])
+        for phase in report["phases"]:
+            if phase["name"] not in phases:
+                phases[phase["name"]] = {"name": phase["name"], "count": 0, "wall_seconds": 0.0, "cpu_seconds": 0.0}
+            for key in ["count", "wall_seconds", "cpu_seconds"]:
+                phases[phase["name"]][key] += phase[key]
+        for profiled_file in report["files"]:
+            for key in ["bytes_read", "bytes_written"]:
+                if profiled_file.get(key, -1) > 0:
+                    total[key] += profiled_file[key]
+        for branch in report["branches"]:
+            total["branches"] += 1
+            for counter in BRANCH_COUNTERS:
+                total[counter] += branch[counter]
+    # dicts keep the order the phases were first seen in
+    total["phases"] = list(phases.values())
+    return {"iterations": reports, "total": total}
+
+
+def write_profile_summary(reports, filename):
+    """Writes every report and their totals to the file as JSON"""
+    with open(filename, "w") as summary_file:
+        json.dump(aggregate_profile_reports(reports), summary_file, indent=2)
+
+
+def merge_trace_files(trace_filenames, filename):
+    """Writes the Chrome traces of the iterations to one file, with each iteration shown as its own process"""
+    trace_events = []
+    for iteration, trace_filename in trace_filenames:
+        if not os.path.exists(trace_filename):
+            continue
+        with open(trace_filename) as trace_file:
+            events = json.load(trace_file)["traceEvents"]
+        trace_events.append({"name": "process_name", "ph": "M", "pid": iteration, "tid": 0,
+                             "args": {"name": "iteration " + str(iteration)}})
+        for event in events:
+            event["pid"] = iteration
+            trace_events.append(event)
+    with open(filename, "w") as merged_file:
+        json.dump({"displayTimeUnit": "ms", "traceEvents": trace_events}, merged_file)
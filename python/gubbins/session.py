@@ -0,0 +1,282 @@
+# encoding: utf-8
+# Wellcome Trust Sanger Institute
+# Copyright (C) 2013  Wellcome Trust Sanger Institute
+#
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+#
+
+
+import ctypes
+import ctypes.util
+import os
+import sys
+
+
+class GubbinsLibraryNotFound(OSError):
+    """libgubbins isnt installed, so the executable is used instead"""
+
+
+def load_gubbins_library(library_filename=None):
+    """Loads libgubbins, from GUBBINS_LIBRARY if it is set or otherwise from the library path. A library which
+    is found but cant be loaded, such as one missing a library it links to, is an error rather than not found"""
+    if library_filename is None:
+        library_filename = os.environ.get("GUBBINS_LIBRARY") or ctypes.util.find_library("gubbins")
+    if library_filename is None or (os.sep in library_filename and not os.path.exists(library_filename)):
+        raise GubbinsLibraryNotFound("libgubbins could not be found")
+    try:
+        library = ctypes.CDLL(library_filename)
+    except OSError as error:
+        raise OSError("libgubbins was found at " + library_filename + " but could not be loaded: " + str(error))
+
+    library.create_gubbins_session.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_int, ctypes.c_int,
+                                               ctypes.c_int, ctypes.c_int]
+    library.create_gubbins_session.restype = ctypes.c_void_p
+    library.load_gubbins_session_sequences_from_file.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+    library.load_gubbins_session_sequences_from_file.restype = ctypes.c_int
+    library.load_gubbins_session_sequences.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_char_p),
+                                                       ctypes.c_void_p, ctypes.c_int, ctypes.c_int, ctypes.c_size_t]
+    library.load_gubbins_session_sequences.restype = ctypes.c_int
+    library.run_gubbins_session_iteration.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+    library.run_gubbins_session_iteration.restype = ctypes.c_int
+    library.reinsert_gaps_with_gubbins_session.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_char_p]
+    library.reinsert_gaps_with_gubbins_session.restype = ctypes.c_int
+    library.free_gubbins_session.argtypes = [ctypes.c_void_p]
+    library.free_gubbins_session.restype = None
+    library.set_alignment_cache.argtypes = [ctypes.c_int]
+    library.set_alignment_cache.restype = None
+    library.set_multi_block_acceptance.argtypes = [ctypes.c_int]
+    library.set_multi_block_acceptance.restype = None
+    library.set_branch_scan_cache_directory.argtypes = [ctypes.c_char_p]
+    library.set_branch_scan_cache_directory.restype = None
+    library.set_binary_branch_snps.argtypes = [ctypes.c_int]
+    library.set_binary_branch_snps.restype = None
+    library.set_matrix_memory_budget.argtypes = [ctypes.c_size_t]
+    library.set_matrix_memory_budget.restype = None
+    library.set_sparse_sequence_rows.argtypes = [ctypes.c_int]
+    library.set_sparse_sequence_rows.restype = None
+    library.parse_ancestral_reconstruction.argtypes = [ctypes.c_char_p]
+    library.parse_ancestral_reconstruction.restype = ctypes.c_int
+    library.set_ancestral_reconstruction.argtypes = [ctypes.c_int]
+    library.set_ancestral_reconstruction.restype = None
+    library.parse_selected_outputs.argtypes = [ctypes.c_char_p]
+    library.parse_selected_outputs.restype = ctypes.c_int
+    library.set_selected_outputs.argtypes = [ctypes.c_int]
+    library.set_selected_outputs.restype = None
+    library.filter_alignment_file.argtypes = [ctypes.c_char_p, ctypes.c_char_p, ctypes.c_char_p, ctypes.c_double,
+                                              ctypes.c_int, ctypes.c_int]
+    library.filter_alignment_file.restype = ctypes.c_int
+    library.start_profile.argtypes = [ctypes.c_char_p]
+    library.start_profile.restype = None
+    library.write_profile_report.argtypes = []
+    library.write_profile_report.restype = None
+    library.start_trace.argtypes = [ctypes.c_char_p]
+    library.start_trace.restype = None
+    library.write_trace.argtypes = []
+    library.write_trace.restype = None
+    return library
+
+
+# What the session functions return, from gubbins_session.h
+GUBBINS_SESSION_OK = 0
+GUBBINS_SESSION_MISSING_FILE = 1
+GUBBINS_SESSION_SEQUENCES_NOT_LOADED = 2
+
+# What filter_alignment_file returns, from alignment_filter.h
+ALIGNMENT_FILTER_OK = 0
+ALIGNMENT_FILTER_TOO_FEW_SEQUENCES = 1
+ALIGNMENT_FILTER_CANNOT_WRITE_OUTPUT = 2
+ALIGNMENT_FILTER_CANNOT_WRITE_REMOVED_TAXA = 3
+
+
+def check_session_status(status, filename):
+    """Raises the error for a status returned by libgubbins, which prints the details itself"""
+    if status == GUBBINS_SESSION_MISSING_FILE:
+        raise FileNotFoundError(filename)
+    if status == GUBBINS_SESSION_SEQUENCES_NOT_LOADED:
+        raise RuntimeError("The sequences have to be loaded before running an iteration on " + filename)
+    if status != GUBBINS_SESSION_OK:
+        raise RuntimeError("libgubbins failed with status " + str(status) + " on " + filename)
+
+
+def check_alignment_filter_status(status, output_filename, removed_taxa_filename):
+    """Exits with the message the Python filter would have given for a status returned by filter_alignment_file"""
+    if status == ALIGNMENT_FILTER_TOO_FEW_SEQUENCES:
+        sys.exit("Not enough sequences are left after removing duplicates.Please check you input data.")
+    if status == ALIGNMENT_FILTER_CANNOT_WRITE_OUTPUT:
+        sys.exit("Cannot write to the FASTA file '" + output_filename + "'")
+    if status == ALIGNMENT_FILTER_CANNOT_WRITE_REMOVED_TAXA:
+        sys.exit("Cannot write the removed sequences to '" + removed_taxa_filename + "'")
+    if status != ALIGNMENT_FILTER_OK:
+        sys.exit("libgubbins failed with status " + str(status) + " while filtering the alignment")
+
+
+def rows_of_bases(bases):
+    """Returns the address, number of rows, row length and row stride of a 2D array of single bytes.
+    numpy arrays (dtype uint8 or S1) and writable buffers are used in place rather than copied."""
+    if hasattr(bases, "__array_interface__"):
+        interface = bases.__array_interface__
+        shape = interface["shape"]
+        strides = interface.get("strides") or (shape[1] if len(shape) == 2 else 1, 1)
+        address = interface["data"][0]
+    else:
+        view = memoryview(bases)
+        shape = view.shape
+        strides = view.strides
+        address = ctypes.addressof(ctypes.c_char.from_buffer(view))
+    if len(shape) != 2 or strides[1] != 1:
+        raise ValueError("The bases have to be a 2D array of single bytes with each row contiguous")
+    return address, shape[0], shape[1], strides[0]
+
+
+class GubbinsSession:
+    """Runs Gubbins iterations inside this process through libgubbins, keeping the vcf loaded between them"""
+
+    def __init__(self, vcf_filename, original_alignment_filename, min_snps, min_window_size, max_window_size,
+                 threads=1, alignment_cache=False, multi_block=False, branch_scan_cache_directory=None,
+                 max_memory=None, binary_branch_snps=False, sparse_ancestors=False, ancestral_reconstruction="external",
+                 library=None):
+        """Opens the session, reusing the scans of unchanged branches from branch_scan_cache_directory if it is given.
+        Matrices of bases bigger than max_memory MB are kept in files mapped into memory, and with sparse_ancestors
+        the sequences in the tree are kept as their differences from their parents. With an ancestral_reconstruction
+        of parsimony or joint the internal nodes missing from the loaded sequences are reconstructed from the leaves"""
+        self.library = library if library is not None else load_gubbins_library()
+        self.library.set_alignment_cache(1 if alignment_cache else 0)
+        self.library.set_multi_block_acceptance(1 if multi_block else 0)
+        self.library.set_branch_scan_cache_directory(
+            branch_scan_cache_directory.encode() if branch_scan_cache_directory is not None else None)
+        self.library.set_matrix_memory_budget(max_memory*1024*1024 if max_memory is not None else 0)
+        self.library.set_binary_branch_snps(1 if binary_branch_snps else 0)
+        self.library.set_sparse_sequence_rows(1 if sparse_ancestors else 0)
+        self.library.set_ancestral_reconstruction(
+            self.library.parse_ancestral_reconstruction(ancestral_reconstruction.encode()))
+        for filename in [vcf_filename, original_alignment_filename]:
+            if not os.path.exists(filename):
+                raise FileNotFoundError(filename)
+        self.session = self.library.create_gubbins_session(
+            vcf_filename.encode(), original_alignment_filename.encode(), min_snps, min_window_size,
+            max_window_size, threads if threads is not None else 1)
+        if self.session is None:
+            raise OSError("libgubbins could not start a session with " + vcf_filename + " and "
+                          + original_alignment_filename)
+
+    def load_sequences_from_file(self, alignment_filename):
+        """Loads the leaf and ancestral sequences for the next iteration from a multi FASTA file"""
+        if not os.path.exists(alignment_filename):
+            raise FileNotFoundError(alignment_filename)
+        check_session_status(
+            self.library.load_gubbins_session_sequences_from_file(self.session, alignment_filename.encode()),
+            alignment_filename)
+
+    def load_sequences(self, sample_names, bases, sequence_length=None):
+        """Loads the sequences for the next iteration from one row of bases per name, using only the first
+        sequence_length bases of each row if it is given"""
+        address, number_of_rows, row_length, row_stride = rows_of_bases(bases)
+        if sequence_length is not None:
+            if sequence_length > row_length:
+                raise ValueError("The rows of bases are shorter than " + str(sequence_length))
+            row_length = sequence_length
+        if number_of_rows != len(sample_names):
+            raise ValueError("There are " + str(number_of_rows) + " rows of bases but "
+                             + str(len(sample_names)) + " names")
+        names = (ctypes.c_char_p * len(sample_names))(*[name.encode() for name in sample_names])
+        check_session_status(self.library.load_gubbins_session_sequences(self.session, names, address, number_of_rows,
+                                                                         row_length, row_stride), "rows of bases")
+
+    def run_iteration(self, tree_filename, outputs=None):
+        """Detects recombinations on the tree with the loaded sequences, writing the same files as the executable,
+        or only those in outputs if it is given"""
+        if not os.path.exists(tree_filename):
+            raise FileNotFoundError(tree_filename)
+        output_names = ",".join(outputs) if outputs is not None else "all"
+        self.library.set_selected_outputs(self.library.parse_selected_outputs(output_names.encode()))
+        check_session_status(self.library.run_gubbins_session_iteration(self.session, tree_filename.encode()),
+                             tree_filename)
+
+    def reinsert_gaps(self, alignment_filename, output_alignment_filename):
+        """Appends the sequences of the alignment which arent samples in the vcf, such as the ancestors, to the
+        output with the gap only columns of the vcf put back in"""
+        if not os.path.exists(alignment_filename):
+            raise FileNotFoundError(alignment_filename)
+        check_session_status(self.library.reinsert_gaps_with_gubbins_session(
+            self.session, alignment_filename.encode(), output_alignment_filename.encode()), alignment_filename)
+
+    def start_profile(self, profile_filename):
+        """Times everything the session does from now on, until write_profile_report writes it to the file"""
+        self.library.start_profile(profile_filename.encode())
+
+    def write_profile_report(self):
+        """Writes the profile started with start_profile"""
+        self.library.write_profile_report()
+
+    def start_trace(self, trace_filename):
+        """Records when each branch is scanned, and on which thread, until write_trace writes it to the file"""
+        self.library.start_trace(trace_filename.encode())
+
+    def write_trace(self):
+        """Writes the trace started with start_trace"""
+        self.library.write_trace()
+
+    def close(self):
+        """Frees everything held by the session"""
+        if self.session is not None:
+            self.library.free_gubbins_session(self.session)
+            self.session = None
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, exc_type, exc_value, traceback):
+        self.close()
+
+
+def filter_alignment_with_library(input_filename, output_filename, filter_percentage, remove_identical_sequences,
+                                  threads=1):
+    """Writes the alignment without the sequences missing more than filter_percentage of their bases and, if asked,
+    all but the last of each set of identical sequences, in one pass with libgubbins. Returns the names of the
+    removed sequences, or None if libgubbins cant be loaded so the alignment has to be filtered in Python"""
+    library = load_installed_gubbins_library()
+    if library is None:
+        return None
+    removed_taxa_filename = output_filename + ".removed_taxa"
+    status = library.filter_alignment_file(input_filename.encode(), output_filename.encode(),
+                                           removed_taxa_filename.encode(), filter_percentage,
+                                           1 if remove_identical_sequences else 0,
+                                           threads if threads is not None else 1)
+    check_alignment_filter_status(status, output_filename, removed_taxa_filename)
+    with open(removed_taxa_filename) as removed_taxa_file:
+        removed_taxa = [line.rstrip("\n") for line in removed_taxa_file]
+    os.remove(removed_taxa_filename)
+    return removed_taxa
+
+
+def load_installed_gubbins_library():
+    """Returns libgubbins, or None if it isnt installed or is an older one without the functions used here, so the
+    executable is used instead. A library which is found but cant be loaded raises an OSError."""
+    try:
+        return load_gubbins_library()
+    except GubbinsLibraryNotFound:
+        return None
+    except AttributeError as error:
+        sys.stderr.write("Warning: libgubbins is older than this version of Gubbins, so the executable is used "
+                         "instead (" + str(error) + ")\n")
+        return None
+
+
+def open_gubbins_session(*args, **kwargs):
+    """Returns a session if libgubbins is installed, otherwise None so the executable is used instead"""
+    library = load_installed_gubbins_library()
+    if library is None:
+        return None
+    return GubbinsSession(*args, library=library, **kwargs)
@@ -0,0 +1,55 @@
+#! /usr/bin/env python3
+# encoding: utf-8
+
+"""
+Tests reading the manifest of a batch and sharing out its threads.
+"""
+
+import unittest
+import os
+import tempfile
+from gubbins import batch
+
+
+class TestBatch(unittest.TestCase):
+
+    def test_manifest_gives_a_job_for_each_alignment(self):
+        with tempfile.TemporaryDirectory() as directory:
+            manifest_filename = os.path.join(directory, "manifest.tsv")
+            with open(manifest_filename, "w") as manifest_file:
+                manifest_file.write("# lineages\nlineage_1.aln\n\nlineage_2.aln\tsecond\nlineage_3.aln\t\ttree.tre\n")
+            jobs = batch.read_batch_manifest(manifest_filename)
+            assert [job.prefix for job in jobs] == ["lineage_1", "second", "lineage_3"]
+            assert jobs[0].alignment_filename == os.path.join(directory, "lineage_1.aln")
+            assert jobs[0].starting_tree is None
+            assert jobs[1].directory == os.path.join(directory, "second")
+            assert jobs[2].starting_tree == os.path.join(directory, "tree.tre")
+
+    def test_manifest_with_the_same_prefix_twice_is_rejected(self):
+        with tempfile.TemporaryDirectory() as directory:
+            manifest_filename = os.path.join(directory, "manifest.tsv")
+            with open(manifest_filename, "w") as manifest_file:
+                manifest_file.write("a/lineage.aln\nb/lineage.aln\n")
+            with self.assertRaises(SystemExit):
+                batch.read_batch_manifest(manifest_filename)
+
+    def test_threads_are_shared_between_the_waiting_jobs(self):
+        assert batch.threads_for_next_job(32, 4) == 8
+        assert batch.threads_for_next_job(24, 3) == 8
+        assert batch.threads_for_next_job(8, 300) == 1
+        assert batch.threads_for_next_job(5, 1) == 5
+
+    def test_failed_jobs_are_reported_without_stopping_the_batch(self):
+        class ArgsObject:
+            pass
+        input_args = ArgsObject()
+        with tempfile.TemporaryDirectory() as directory:
+            job = batch.BatchJob(os.path.join(directory, "missing.aln"), "missing", None,
+                                 os.path.join(directory, "missing"))
+            run_time, error = batch.run_batch_job(input_args, job, 2)
+            assert error is not None
+            assert os.path.exists(os.path.join(directory, "missing", "gubbins.log"))
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,103 @@
+#! /usr/bin/env python3
+# encoding: utf-8
+
+"""
+Tests making up lineages for the benchmarks, working out the scaling curves and comparing with a baseline.
+"""
+
+import unittest
+import os
+import sys
+import tempfile
+from gubbins import benchmark
+
+
+class TestBenchmark(unittest.TestCase):
+
+    def test_synthetic_lineage_has_a_sequence_for_every_node_of_its_tree(self):
+        with tempfile.TemporaryDirectory() as directory:
+            dataset = benchmark.write_synthetic_lineages(directory, 50, 2000, seed=3)
+            assert dataset.number_of_taxa == 50
+            with open(dataset.alignment_filename, "rb") as alignment_file:
+                leaves = dict(benchmark.read_fasta_records(alignment_file))
+            with open(dataset.internal_alignment_filename, "rb") as alignment_file:
+                internal_nodes = dict(benchmark.read_fasta_records(alignment_file))
+            assert len(leaves) == 50
+            assert len(internal_nodes) == 49
+            assert all(len(sequence) == 2000 for sequence in list(leaves.values()) + list(internal_nodes.values()))
+            with open(dataset.starting_tree) as tree_file:
+                tree = tree_file.read()
+            for name in list(leaves.keys()) + list(internal_nodes.keys()):
+                assert name.decode() in tree
+            assert len(set(leaves.values())) > 1
+
+    def test_same_seed_makes_the_same_lineage(self):
+        with tempfile.TemporaryDirectory() as first_directory, tempfile.TemporaryDirectory() as second_directory:
+            first = benchmark.write_synthetic_lineages(first_directory, 20, 1000, seed=7)
+            second = benchmark.write_synthetic_lineages(second_directory, 20, 1000, seed=7)
+            for first_filename, second_filename in [(first.alignment_filename, second.alignment_filename),
+                                                    (first.starting_tree, second.starting_tree)]:
+                with open(first_filename) as first_file, open(second_filename) as second_file:
+                    assert first_file.read() == second_file.read()
+
+    def test_columns_at_the_vcf_positions_are_written_for_every_sequence(self):
+        with tempfile.TemporaryDirectory() as directory:
+            vcf_filename = os.path.join(directory, "snps.vcf")
+            with open(vcf_filename, "w") as vcf_file:
+                vcf_file.write("##fileformat=VCFv4.1\n#CHROM\tPOS\tID\n1\t2\t.\n1\t5\t.\n")
+            leaves_filename = os.path.join(directory, "leaves.aln")
+            internal_filename = os.path.join(directory, "internal.aln")
+            with open(leaves_filename, "w") as leaves_file:
+                leaves_file.write(">a\nACGTA\n>b\nAC\nGTT\n")
+            with open(internal_filename, "w") as internal_file:
+                internal_file.write(">n1 ancestor\nAGGTC\n")
+            joint_filename = os.path.join(directory, "joint.aln")
+            positions = benchmark.read_vcf_positions(vcf_filename)
+            assert positions == [2, 5]
+            benchmark.write_alignment_columns([leaves_filename, internal_filename], positions, joint_filename)
+            with open(joint_filename) as joint_file:
+                assert joint_file.read() == ">a\nCA\n>b\nCT\n>n1\nGC\n"
+
+    def test_measured_command_gives_its_time_and_memory(self):
+        with tempfile.TemporaryDirectory() as directory:
+            log_filename = os.path.join(directory, "benchmark.log")
+            measurement = benchmark.measure_command([sys.executable, "-c", "print('hello')"], directory,
+                                                    log_filename)
+            assert measurement["error"] is None
+            assert measurement["wall_seconds"] > 0
+            assert measurement["peak_rss_kb"] > 0
+            with open(log_filename) as log_file:
+                assert "hello" in log_file.read()
+            failed = benchmark.measure_command([sys.executable, "-c", "import sys; sys.exit(2)"], directory,
+                                               log_filename)
+            assert failed["error"].startswith("exited with 2")
+
+    def test_scaling_curves_are_relative_to_the_fewest_threads(self):
+        results = [{"dataset": "d", "taxa": 10, "mode": "gubbins", "threads": 1, "wall_seconds": 8.0, "error": None},
+                   {"dataset": "d", "taxa": 10, "mode": "gubbins", "threads": 4, "wall_seconds": 4.0, "error": None},
+                   {"dataset": "d", "taxa": 10, "mode": "gubbins", "threads": 8, "wall_seconds": 0.0,
+                    "error": "exited with 1"}]
+        curves = benchmark.scaling_curves(results)
+        assert len(curves) == 2
+        assert curves[1]["threads"] == 4
+        assert curves[1]["speed_up"] == 2.0
+        assert curves[1]["efficiency"] == 0.5
+
+    def test_only_changes_beyond_the_tolerance_are_regressions(self):
+        baseline = [{"dataset": "d", "mode": "gubbins", "threads": 2, "wall_seconds": 10.0, "peak_rss_kb": 1000,
+                     "bytes_read": 100, "bytes_written": 100, "phases": {"scan_branches": 5.0, "read_vcf": 0.01},
+                     "error": None}]
+        results = [{"dataset": "d", "mode": "gubbins", "threads": 2, "wall_seconds": 10.5, "peak_rss_kb": 1500,
+                    "bytes_read": 100, "bytes_written": 99, "phases": {"scan_branches": 6.0, "read_vcf": 0.03},
+                    "error": None},
+                   {"dataset": "new", "mode": "gubbins", "threads": 2, "wall_seconds": 99.0, "error": None}]
+        regressions = benchmark.compare_with_baseline(results, baseline, tolerance=0.1)
+        assert len(regressions) == 2
+        assert "peak_rss_kb" in regressions[0]
+        assert "phase scan_branches" in regressions[1]
+        results[0]["error"] = "exited with 1"
+        assert benchmark.compare_with_baseline(results, baseline)[0].startswith("d gubbins 2 threads failed")
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,80 @@
+#! /usr/bin/env python3
+# encoding: utf-8
+
+"""
+Tests of the checkpoints which let an iterative run be resumed.
+"""
+
+import unittest
+import os
+import shutil
+import tempfile
+from gubbins import checkpoint
+
+
+class TestCheckpoint(unittest.TestCase):
+
+    def setUp(self):
+        self.working_directory = tempfile.mkdtemp()
+        self.alignment_filename = os.path.join(self.working_directory, 'input.aln')
+        self.tree_filename = os.path.join(self.working_directory, 'input.aln.iteration_1.tre')
+        self.checkpoint_filename = os.path.join(self.working_directory, 'input.aln.checkpoint.json')
+        with open(self.alignment_filename, 'w') as alignment_file:
+            alignment_file.write('>a\nACGT\n>b\nACGA\n>c\nTCGA\n')
+        with open(self.tree_filename, 'w') as tree_file:
+            tree_file.write('((a:1,b:1):1,c:1);\n')
+        self.inputs = checkpoint.checksum_files([self.alignment_filename, None])
+        self.options = {'tree_builder': 'raxml', 'min_snps': 3}
+        checkpoint.write_checkpoint(self.checkpoint_filename, {'completed_iterations': 1}, self.inputs, self.options,
+                                    [self.tree_filename, os.path.join(self.working_directory, 'not_written.tab')])
+
+    def tearDown(self):
+        shutil.rmtree(self.working_directory)
+
+    def test_state_is_read_back_with_the_same_inputs_and_options(self):
+        state = checkpoint.read_checkpoint(self.checkpoint_filename, self.inputs, self.options)
+        assert state == {'completed_iterations': 1}
+        assert not os.path.exists(self.checkpoint_filename + '.tmp')
+
+    def test_no_state_without_a_checkpoint(self):
+        checkpoint.remove_checkpoint(self.checkpoint_filename)
+        assert checkpoint.read_checkpoint(self.checkpoint_filename, self.inputs, self.options) is None
+
+    def test_changed_input_is_refused(self):
+        with open(self.alignment_filename, 'a') as alignment_file:
+            alignment_file.write('>d\nTCGT\n')
+        with self.assertRaises(ValueError):
+            checkpoint.read_checkpoint(self.checkpoint_filename,
+                                       checkpoint.checksum_files([self.alignment_filename]), self.options)
+
+    def test_different_options_are_refused(self):
+        with self.assertRaises(ValueError):
+            checkpoint.read_checkpoint(self.checkpoint_filename, self.inputs, {'tree_builder': 'raxml', 'min_snps': 5})
+
+    def test_missing_tree_of_a_completed_iteration_is_refused(self):
+        os.remove(self.tree_filename)
+        with self.assertRaises(ValueError):
+            checkpoint.read_checkpoint(self.checkpoint_filename, self.inputs, self.options)
+
+    def test_partial_iteration_is_removed_before_resuming(self):
+        temp_working_dir = os.path.join(self.working_directory, 'tmp')
+        os.mkdir(temp_working_dir)
+        partial_filenames = [os.path.join(self.working_directory, 'input.aln.iteration_2.tre'),
+                             os.path.join(temp_working_dir, 'RAxML_info.input.aln.iteration_2'),
+                             os.path.join(temp_working_dir, 'RAxML_result.input.aln.iteration_2.internal'),
+                             os.path.join(temp_working_dir, 'input.aln.iteration_2.ckp.gz')]
+        other_iteration_filename = os.path.join(temp_working_dir, 'input.aln.iteration_20.ckp.gz')
+        for filename in partial_filenames + [other_iteration_filename]:
+            with open(filename, 'w') as partial_file:
+                partial_file.write('partial')
+        state = checkpoint.read_checkpoint(self.checkpoint_filename, self.inputs, self.options)
+        checkpoint.remove_partial_iteration_files([self.working_directory, temp_working_dir], 'input.aln',
+                                                  state['completed_iterations'] + 1)
+        assert not any(os.path.exists(filename) for filename in partial_filenames)
+        assert os.path.exists(other_iteration_filename)
+        assert os.path.exists(self.tree_filename)
+        assert checkpoint.read_checkpoint(self.checkpoint_filename, self.inputs, self.options) == state
+
+
+if __name__ == "__main__":
+    unittest.main()
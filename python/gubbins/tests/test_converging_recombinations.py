@@ -7,6 +7,8 @@ Tests if the same recombinations are seen in multiple iterations
 
 import unittest
 import os
+import shutil
+import tempfile
 from gubbins import common
 
 modules_dir = os.path.dirname(os.path.abspath(common.__file__))
@@ -33,6 +35,31 @@ class TestConvergingRecombinations(unittest.TestCase):
              os.path.join(data_dir, 'small_recombination.embl'),
              os.path.join(data_dir, 'small_recombination_different.embl')])
 
+    def test_different_fingerprints_are_different_without_reading_the_files(self):
+        with tempfile.TemporaryDirectory() as working_dir:
+            current_file = os.path.join(working_dir, 'current.tab')
+            previous_file = os.path.join(working_dir, 'previous.tab')
+            shutil.copyfile(os.path.join(data_dir, 'small_recombination.embl'), current_file)
+            shutil.copyfile(os.path.join(data_dir, 'small_recombination.embl'), previous_file)
+            with open(current_file + '.fingerprint', 'w') as fingerprint_file:
+                fingerprint_file.write('0000000000000001 6\n')
+            with open(previous_file + '.fingerprint', 'w') as fingerprint_file:
+                fingerprint_file.write('0000000000000002 6\n')
+            assert not common.have_recombinations_been_seen_before(current_file, [previous_file])
+
+    def test_same_fingerprints_are_checked_against_the_files(self):
+        with tempfile.TemporaryDirectory() as working_dir:
+            current_file = os.path.join(working_dir, 'current.tab')
+            previous_file = os.path.join(working_dir, 'previous.tab')
+            shutil.copyfile(os.path.join(data_dir, 'small_recombination.embl'), current_file)
+            shutil.copyfile(os.path.join(data_dir, 'small_recombination_different.embl'), previous_file)
+            for filename in [current_file, previous_file]:
+                with open(filename + '.fingerprint', 'w') as fingerprint_file:
+                    fingerprint_file.write('0000000000000001 6\n')
+            assert common.read_recombination_fingerprint(current_file) == '0000000000000001 6'
+            assert not common.have_recombinations_been_seen_before(current_file, [previous_file])
+            assert common.have_recombinations_been_seen_before(current_file, [previous_file, current_file])
+
     def test_get_recombination_files(self):
         assert common.get_recombination_files(['AAA', 'BBB', 'CCC']) == ('CCC.tab', ['AAA.tab', 'BBB.tab'])
 
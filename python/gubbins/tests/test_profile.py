@@ -0,0 +1,69 @@
+#! /usr/bin/env python3
+# encoding: utf-8
+
+"""
+Tests adding up the profiles of the Gubbins iterations.
+"""
+
+import unittest
+import json
+import os
+import tempfile
+from gubbins import run_profile
+
+
+def profile_report(wall_seconds, peak_rss_kb, phase_seconds, snps):
+    return {"wall_seconds": wall_seconds, "cpu_seconds": wall_seconds / 2, "peak_rss_kb": peak_rss_kb,
+            "phases": [{"name": "load_tree", "count": 1, "wall_seconds": phase_seconds, "cpu_seconds": phase_seconds},
+                       {"name": "scan_branches", "count": 2, "wall_seconds": phase_seconds,
+                        "cpu_seconds": phase_seconds}],
+            "files": [{"filename": "a.tre", "bytes_read": 10}, {"filename": "a.tre", "bytes_written": 20},
+                      {"filename": "missing", "bytes_written": -1}],
+            "branches": [{"taxon": "N1", "snps": snps, "passes": 1, "windows": 3, "candidate_blocks": 2,
+                          "trimming_steps": 4, "accepted_blocks": 1}]}
+
+
+class TestProfile(unittest.TestCase):
+
+    def test_reports_are_added_up_over_the_iterations(self):
+        total = run_profile.aggregate_profile_reports([profile_report(2.0, 100, 0.5, 7),
+                                                       profile_report(4.0, 300, 1.5, 5)])["total"]
+        assert total["wall_seconds"] == 6.0
+        assert total["cpu_seconds"] == 3.0
+        assert total["peak_rss_kb"] == 300
+        assert [phase["name"] for phase in total["phases"]] == ["load_tree", "scan_branches"]
+        assert total["phases"][1]["count"] == 4
+        assert total["phases"][1]["wall_seconds"] == 2.0
+        assert (total["bytes_read"], total["bytes_written"]) == (20, 40)
+        assert (total["branches"], total["snps"], total["trimming_steps"]) == (2, 12, 8)
+
+    def test_missing_report_is_skipped(self):
+        assert run_profile.read_profile_report('/nonexistent/profile.json', 1) is None
+
+    def test_report_is_labelled_with_its_iteration(self):
+        with tempfile.TemporaryDirectory() as directory:
+            filename = os.path.join(directory, 'iteration_1.profile.json')
+            with open(filename, 'w') as report_file:
+                json.dump(profile_report(1.0, 10, 0.5, 3), report_file)
+            assert run_profile.read_profile_report(filename, 1)["iteration"] == 1
+
+    def test_traces_of_the_iterations_are_merged_as_processes(self):
+        with tempfile.TemporaryDirectory() as directory:
+            trace_filenames = []
+            for iteration in [1, 2]:
+                filename = os.path.join(directory, 'iteration_' + str(iteration) + '.trace.json')
+                with open(filename, 'w') as trace_file:
+                    json.dump({"traceEvents": [{"name": "get_blocks", "ph": "X", "pid": 1, "tid": 0, "ts": 1.0,
+                                                "dur": 2.0, "args": {"node": 3}}]}, trace_file)
+                trace_filenames.append((iteration, filename))
+            trace_filenames.append((3, os.path.join(directory, 'missing.trace.json')))
+            merged_filename = os.path.join(directory, 'merged.json')
+            run_profile.merge_trace_files(trace_filenames, merged_filename)
+            with open(merged_filename) as merged_file:
+                events = json.load(merged_file)["traceEvents"]
+            assert [event["pid"] for event in events if event["ph"] == "X"] == [1, 2]
+            assert len([event for event in events if event["ph"] == "M"]) == 2
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -0,0 +1,98 @@
+#! /usr/bin/env python3
+# encoding: utf-8
+
+"""
+Tests of the in process session with libgubbins.
+"""
+
+import unittest
+import ctypes
+import ctypes.util
+import os
+import shutil
+import tempfile
+from unittest import mock
+from gubbins import session
+
+modules_dir = os.path.dirname(os.path.abspath(session.__file__))
+data_dir = os.path.join(modules_dir, 'tests', 'data')
+# The library built in this tree, for when it isnt installed
+built_library_filename = os.path.join(modules_dir, '..', '..', 'src', '.libs', 'libgubbins.so')
+
+
+class TestSession(unittest.TestCase):
+
+    def test_rows_of_a_buffer_are_used_in_place(self):
+        bases = bytearray(b'ACGTNxxTTGGAxx')
+        rows = memoryview(bases).cast('B', [2, 7])
+        address, number_of_rows, row_length, row_stride = session.rows_of_bases(rows)
+        assert (number_of_rows, row_length, row_stride) == (2, 7, 7)
+        assert ctypes.string_at(address + row_stride, 5) == b'TTGGA'
+
+    def test_rows_of_bases_have_to_be_two_dimensional(self):
+        with self.assertRaises(ValueError):
+            session.rows_of_bases(bytearray(b'ACGT'))
+
+    def test_no_session_without_libgubbins(self):
+        with self.assertRaises(OSError):
+            session.load_gubbins_library('/nonexistent/libgubbins.so')
+
+    def test_statuses_from_libgubbins_are_raised(self):
+        session.check_session_status(session.GUBBINS_SESSION_OK, 'tree.tre')
+        with self.assertRaises(FileNotFoundError):
+            session.check_session_status(session.GUBBINS_SESSION_MISSING_FILE, 'tree.tre')
+        with self.assertRaises(RuntimeError):
+            session.check_session_status(session.GUBBINS_SESSION_SEQUENCES_NOT_LOADED, 'tree.tre')
+
+    def test_alignment_filtered_in_python_without_libgubbins(self):
+        with mock.patch.dict(os.environ, {"GUBBINS_LIBRARY": "/nonexistent/libgubbins.so"}):
+            assert session.filter_alignment_with_library('input.aln', 'output.aln', 25, True) is None
+
+    def test_failed_filtering_exits_catchably(self):
+        session.check_alignment_filter_status(session.ALIGNMENT_FILTER_OK, 'output.aln', 'output.aln.removed_taxa')
+        with self.assertRaises(SystemExit) as context:
+            session.check_alignment_filter_status(session.ALIGNMENT_FILTER_TOO_FEW_SEQUENCES, 'output.aln',
+                                                  'output.aln.removed_taxa')
+        assert 'Not enough sequences' in str(context.exception)
+        with self.assertRaises(SystemExit):
+            session.check_alignment_filter_status(session.ALIGNMENT_FILTER_CANNOT_WRITE_OUTPUT, 'output.aln',
+                                                  'output.aln.removed_taxa')
+
+    def test_found_library_which_cant_be_loaded_is_an_error(self):
+        with tempfile.NamedTemporaryFile(suffix='.so') as broken_library:
+            broken_library.write(b'not a library')
+            broken_library.flush()
+            with mock.patch.dict(os.environ, {"GUBBINS_LIBRARY": broken_library.name}):
+                with self.assertRaises(OSError):
+                    session.open_gubbins_session('input.vcf', 'input.aln', 3, 100, 10000)
+
+    def test_iteration_run_in_a_real_session(self):
+        library_filename = os.environ.get("GUBBINS_LIBRARY") or ctypes.util.find_library("gubbins")
+        if library_filename is None and os.path.exists(built_library_filename):
+            library_filename = built_library_filename
+        if library_filename is None:
+            self.skipTest("libgubbins isnt installed or built")
+        working_directory = tempfile.mkdtemp()
+        try:
+            prefix = os.path.join(working_directory, 'multiple_recombinations')
+            for suffix in ['.aln.vcf', '.aln.snp_sites.aln', '.original.tre']:
+                shutil.copyfile(os.path.join(data_dir, 'session_multiple_recombinations' + suffix), prefix + suffix)
+            shutil.copyfile(prefix + '.original.tre', prefix + '.tre')
+            library = session.load_gubbins_library(library_filename)
+            with session.GubbinsSession(prefix + '.aln.vcf', prefix + '.aln.snp_sites.aln', 3, 100, 10000,
+                                        library=library) as gubbins_session:
+                gubbins_session.load_sequences_from_file(prefix + '.aln.snp_sites.aln')
+                gubbins_session.run_iteration(prefix + '.tre')
+                with self.assertRaises(RuntimeError):
+                    gubbins_session.run_iteration(prefix + '.tre')
+            with open(prefix + '.tre') as tree_file, \
+                    open(os.path.join(data_dir, 'session_multiple_recombinations.expected.tre')) as expected_file:
+                assert tree_file.read() == expected_file.read()
+            with open(prefix + '.tre.tab') as recombinations_file:
+                assert recombinations_file.read().count('misc_feature') == 3
+        finally:
+            shutil.rmtree(working_directory)
+
+
+if __name__ == "__main__":
+    unittest.main()
@@ -9,6 +9,8 @@ import unittest
 import shutil
 import os
 import filecmp
+import tempfile
+from unittest import mock
 from gubbins import common, treebuilders
 
 
@@ -34,6 +36,25 @@ class TestTreeMethods(unittest.TestCase):
                                                  'gubbins/tests/data/robinson_foulds_distance_tree2.tre'],
                                                 'weighted_robinson_foulds') == 0
 
+    def test_trees_with_different_bipartitions_are_not_compared(self):
+        with tempfile.TemporaryDirectory() as working_dir:
+            tree_file_names = []
+            for i, hashes in enumerate(['0000000000000001 0000000000000002 9', '0000000000000003 0000000000000002 9',
+                                        '0000000000000001 0000000000000004 9']):
+                tree_file_name = os.path.join(working_dir, 'iteration_' + str(i))
+                shutil.copyfile('gubbins/tests/data/robinson_foulds_distance_tree1.tre', tree_file_name)
+                with open(tree_file_name + '.bipartitions', 'w') as bipartitions_file:
+                    bipartitions_file.write(hashes + '\n')
+                tree_file_names.append(tree_file_name)
+            assert common.read_tree_bipartitions_hash(tree_file_names[0], 'robinson_foulds') == '0000000000000001'
+            assert common.read_tree_bipartitions_hash(tree_file_names[0], 'weighted_robinson_foulds') \
+                == '0000000000000002'
+            with mock.patch.object(common, 'robinson_foulds_distance', side_effect=AssertionError):
+                assert not common.has_tree_been_seen_before(tree_file_names, 'weighted_robinson_foulds')
+            with mock.patch.object(common, 'symmetric_difference', return_value=0.0) as symmetric_difference:
+                assert common.has_tree_been_seen_before(tree_file_names, 'robinson_foulds')
+                symmetric_difference.assert_called_once_with(tree_file_names[0], tree_file_names[2])
+
     def test_root_tree(self):
         common.root_tree('gubbins/tests/data/unrooted_tree.newick', 'gubbins/tests/data/actual_rooted_tree.newick')
         assert filecmp.cmp('gubbins/tests/data/actual_rooted_tree.newick',
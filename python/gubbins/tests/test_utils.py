@@ -22,11 +22,53 @@ class TestUtilities(unittest.TestCase):
     def test_gubbins_command(self):
         assert common.create_gubbins_command('AAA', 'BBB', 'CCC', 'DDD', 'EEE', 5, 10, 200) \
                == 'AAA -r -v CCC -a 10 -b 200 -f EEE -t DDD -m 5 BBB'
+        assert common.create_gubbins_command('AAA', 'BBB', 'CCC', 'DDD', 'EEE', 5, 10, 200, 4) \
+               == 'AAA -r -v CCC -a 10 -b 200 -f EEE -t DDD -m 5 -j 4 BBB'
+        assert common.create_gubbins_command('AAA', 'BBB', 'CCC', 'DDD', 'EEE', 5, 10, 200, 4, alignment_cache=True) \
+               == 'AAA -r -v CCC -a 10 -b 200 -f EEE -t DDD -m 5 -j 4 -c BBB'
+        assert common.create_gubbins_command('AAA', 'BBB', 'CCC', 'DDD', 'EEE', 5, 10, 200, multi_block=True) \
+               == 'AAA -r -v CCC -a 10 -b 200 -f EEE -t DDD -m 5 -x BBB'
+        assert common.create_gubbins_command('AAA', 'BBB', 'CCC', 'DDD', 'EEE', 5, 10, 200,
+                                             profile_filename='FFF') \
+               == 'AAA -r -v CCC -a 10 -b 200 -f EEE -t DDD -m 5 -p FFF BBB'
+        assert common.create_gubbins_command('AAA', 'BBB', 'CCC', 'DDD', 'EEE', 5, 10, 200,
+                                             trace_filename='FFF') \
+               == 'AAA -r -v CCC -a 10 -b 200 -f EEE -t DDD -m 5 -e FFF BBB'
+        assert common.create_gubbins_command('AAA', 'BBB', 'CCC', 'DDD', 'EEE', 5, 10, 200,
+                                             branch_scan_cache_directory='FFF') \
+               == 'AAA -r -v CCC -a 10 -b 200 -f EEE -t DDD -m 5 -w FFF BBB'
+        assert common.create_gubbins_command('AAA', 'BBB', 'CCC', 'DDD', 'EEE', 5, 10, 200, max_memory=512) \
+               == 'AAA -r -v CCC -a 10 -b 200 -f EEE -t DDD -m 5 -M 512 BBB'
+        assert common.create_gubbins_command('AAA', 'BBB', 'CCC', 'DDD', 'EEE', 5, 10, 200,
+                                             outputs=['tab', 'phylip']) \
+               == 'AAA -r -v CCC -a 10 -b 200 -f EEE -t DDD -m 5 -O tab,phylip BBB'
+        assert common.create_gubbins_command('AAA', 'BBB', 'CCC', 'DDD', 'EEE', 5, 10, 200, binary_branch_snps=True) \
+               == 'AAA -r -v CCC -a 10 -b 200 -f EEE -t DDD -m 5 -y BBB'
+        assert common.create_gubbins_command('AAA', 'BBB', 'CCC', 'DDD', 'EEE', 5, 10, 200, sparse_ancestors=True) \
+               == 'AAA -r -v CCC -a 10 -b 200 -f EEE -t DDD -m 5 -d BBB'
+        assert common.create_gubbins_command('AAA', 'BBB', 'CCC', 'DDD', 'EEE', 5, 10, 200,
+                                             ancestral_reconstruction='parsimony') \
+               == 'AAA -r -v CCC -a 10 -b 200 -f EEE -t DDD -m 5 -A parsimony BBB'
+
+    def test_intermediate_gubbins_outputs(self):
+        assert common.intermediate_gubbins_outputs('.phylip') == ['tab', 'phylip']
+        assert common.intermediate_gubbins_outputs('.snp_sites.aln') == ['tab', 'snp_sites']
+
+    def test_snp_sites_command(self):
+        assert common.create_snp_sites_command('AAA', 'BBB') == 'AAA -c BBB'
+        assert common.create_snp_sites_command('AAA', 'BBB', profile_filename='CCC') == 'AAA -c -p CCC BBB'
+        assert common.create_snp_sites_command('AAA', 'BBB', contigs_filename='CCC') == 'AAA -c -k CCC BBB'
+        assert common.create_snp_sites_command('AAA', 'BBB', max_memory=512) == 'AAA -c -M 512 BBB'
+
+    def test_reinsert_gaps_command(self):
+        assert common.create_reinsert_gaps_command('AAA', 'BBB', 'CCC', 'DDD') == 'AAA -g -v CCC -o DDD BBB'
 
     def test_translation_of_filenames_to_final_filenames(self):
         assert common.translation_of_filenames_to_final_filenames('AAA', 'test') == {
             'AAA.vcf':             'test.summary_of_snp_distribution.vcf',
             'AAA.branch_snps.tab': 'test.branch_base_reconstruction.embl',
+            'AAA.branch_snps.bin': 'test.branch_base_reconstruction.bin',
+            'AAA.branch_snps.nodes': 'test.branch_base_reconstruction.nodes',
             'AAA.tab':             'test.recombination_predictions.embl',
             'AAA.gff':             'test.recombination_predictions.gff',
             'AAA.stats':           'test.per_branch_statistics.csv',
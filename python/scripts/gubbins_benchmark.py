@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+# encoding: utf-8
+#
+# Wellcome Trust Sanger Institute
+# Copyright (C) 2013  Wellcome Trust Sanger Institute
+# 
+# This program is free software; you can redistribute it and/or
+# modify it under the terms of the GNU General Public License
+# as published by the Free Software Foundation; either version 2
+# of the License, or (at your option) any later version.
+# 
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+# 
+# You should have received a copy of the GNU General Public License
+# along with this program; if not, write to the Free Software
+# Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+#
+
+import argparse
+import multiprocessing
+import os
+import sys
+import gubbins.benchmark as benchmark
+
+
+def default_thread_counts():
+    """Powers of two up to the number of cores, and the number of cores itself"""
+    cores = multiprocessing.cpu_count()
+    thread_counts = []
+    threads = 1
+    while threads < cores and threads <= 64:
+        thread_counts.append(threads)
+        threads *= 2
+    thread_counts.append(min(cores, 64))
+    return ",".join(str(threads) for threads in thread_counts)
+
+
+def comma_separated_integers(text):
+    return [int(value) for value in text.split(",") if value != ""]
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Times whole runs of run_gubbins.py and single gubbins -r calls on the example data and on made '
+                    'up lineages, with the time of each phase, the peak memory and the bytes read and written, and '
+                    'compares them with a baseline from an earlier version',
+        formatter_class=argparse.ArgumentDefaultsHelpFormatter)
+    parser.add_argument('--example_data',      help='Directory with the PMEN1 and ST239 example data')
+    parser.add_argument('--taxa',              help='Numbers of taxa in the made up lineages, separated by commas',
+                        type=comma_separated_integers, default="100,1000,5000,20000")
+    parser.add_argument('--genome_length',     help='Length of the made up genomes', type=int, default=100000)
+    parser.add_argument('--seed',              help='Seed for making up the lineages', type=int, default=1)
+    parser.add_argument('--threads',           help='Numbers of threads to run with, separated by commas',
+                        type=comma_separated_integers, default=default_thread_counts())
+    parser.add_argument('--modes',             help='What to time: whole run_gubbins.py runs, single gubbins -r '
+                                                    'calls, or both', default="run_gubbins,gubbins")
+    parser.add_argument('--repeats',           help='Times to run each one, keeping the fastest', type=int, default=1)
+    parser.add_argument('--working_directory', help='Where the lineages are made and everything is run',
+                        default="gubbins_benchmark")
+    parser.add_argument('--output',            help='JSON file for the results, which can be the baseline next time',
+                        default="gubbins_benchmark.json")
+    parser.add_argument('--curves',            help='Tab separated file of the speed up with each number of threads',
+                        default="gubbins_benchmark.scaling.tsv")
+    parser.add_argument('--baseline',          help='Results of an earlier run to compare with. Exits with an error '
+                                                    'if anything got worse by more than the tolerance')
+    parser.add_argument('--tolerance',         help='Fraction a time, memory or number of bytes can go up by before '
+                                                    'it counts as worse', type=float, default=0.1)
+    parser.add_argument('--gubbins_exec',      help='The gubbins executable', default="gubbins")
+    parser.add_argument('--run_gubbins_exec',  help='The run_gubbins.py script', default="run_gubbins.py")
+    input_args = parser.parse_args()
+
+    modes = [mode for mode in input_args.modes.split(",") if mode != ""]
+    for mode in modes:
+        if mode not in benchmark.BENCHMARK_MODES:
+            parser.error("unknown mode " + mode + ", it can be " + " or ".join(benchmark.BENCHMARK_MODES))
+    working_directory = os.path.abspath(input_args.working_directory)
+    os.makedirs(working_directory, exist_ok=True)
+
+    datasets = []
+    if input_args.example_data is not None:
+        datasets.extend(benchmark.example_datasets(input_args.example_data))
+    for number_of_taxa in input_args.taxa:
+        print("Making up a lineage of " + str(number_of_taxa) + " taxa...")
+        datasets.append(benchmark.write_synthetic_lineages(os.path.join(working_directory, "lineages"),
+                                                           number_of_taxa, input_args.genome_length,
+                                                           seed=input_args.seed))
+
+    results = benchmark.run_benchmarks(datasets, input_args.threads, modes, working_directory,
+                                       gubbins_exec=input_args.gubbins_exec,
+                                       run_gubbins_exec=input_args.run_gubbins_exec, repeats=input_args.repeats)
+    benchmark.write_benchmark_results(results, input_args.output)
+    benchmark.write_scaling_curves(benchmark.scaling_curves(results), input_args.curves)
+    print("Results written to " + input_args.output + " and " + input_args.curves)
+
+    if input_args.baseline is not None:
+        regressions = benchmark.compare_with_baseline(results, benchmark.read_benchmark_results(input_args.baseline),
+                                                      tolerance=input_args.tolerance)
+        for regression in regressions:
+            print("Worse than the baseline: " + regression)
+        if len(regressions) > 0:
+            sys.exit(1)
+        print("Nothing is worse than the baseline")
+
+
+if __name__ == '__main__':
+    main()
@@ -22,6 +22,7 @@
 import argparse
 import pkg_resources
 import gubbins.common
+import gubbins.batch
 
 
 def main():
@@ -31,7 +32,11 @@ def main():
                     'Harris S.R. "Rapid phylogenetic analysis of large samples of recombinant bacterial whole genome '
                     'sequences using Gubbins". Nucleic Acids Res. 2015 Feb 18;43(3):e15. doi: 10.1093/nar/gku1196.',
         formatter_class=argparse.ArgumentDefaultsHelpFormatter)
-    parser.add_argument('alignment_filename',        help='Multifasta alignment file')
+    parser.add_argument('alignment_filename',        help='Multifasta alignment file', nargs='?')
+    parser.add_argument('--batch',                   help='Manifest of the alignments to run, one on each line with '
+                                                          'optionally a prefix and a starting tree after tabs. Each one '
+                                                          'runs in a directory named after its prefix, with the threads '
+                                                          'shared out between them')
     parser.add_argument('--outgroup',          '-o', help='Outgroup name for rerooting. A list of comma separated '
                                                           'names can be used if they form a clade')
     parser.add_argument('--starting_tree',     '-s', help='Starting tree')
@@ -47,7 +52,8 @@ def main():
                         type=int, default=25)
     parser.add_argument('--prefix',            '-p', help='Add a prefix to the final output filenames')
     parser.add_argument('--threads',           '-c', help='Number of threads to run with RAXML, but only if a PTHREADS '
-                                                         'version is available', type=int,  default=1)
+                                                         'version is available, and to scan branches for recombinations',
+                        type=int,  default=1)
     parser.add_argument('--converge_method',   '-z', help='Criteria to use to know when to halt iterations',
                         default='weighted_robinson_foulds', choices=['weighted_robinson_foulds', 'robinson_foulds',
                                                                      'recombination'])
@@ -58,5 +64,41 @@ def main():
     parser.add_argument('--raxml_model',       '-r', help='RAxML model', default='GTRCAT',
                         choices=['GTRGAMMA', 'GTRCAT'])
     parser.add_argument('--remove_identical_sequences', '-d', help='Remove identical sequences', action='store_true')
+    parser.add_argument('--multi_block',             help='Accept all of the significant recombination blocks which '
+                                                          'dont overlap in each pass of a branch, rather than one at a '
+                                                          'time', action='store_true')
+    parser.add_argument('--contigs',                 help='File of the contigs the alignment is made of, in the order '
+                                                          'they are joined, with a name and a length on each line, so '
+                                                          'recombinations dont cross from one into the next and the VCF '
+                                                          'and GFF files give positions within each contig')
+    parser.add_argument('--binary_branch_snps',      help='Write the SNPs on each branch as binary columns with a '
+                                                          'dictionary of the nodes, which can be read from a memory map, '
+                                                          'rather than as EMBL features', action='store_true')
+    parser.add_argument('--sparse_ancestors',        help='Keep each sequence in the tree as its differences from the '
+                                                          'sequence of its parent, which needs much less memory for '
+                                                          'big trees', action='store_true')
+    parser.add_argument('--ancestral_reconstruction', help='Reconstruct the ancestral sequences with RAxML or IQ-TREE '
+                                                           '(external), or inside Gubbins with parsimony or a joint '
+                                                           'maximum likelihood under the Jukes-Cantor model, which '
+                                                           'skips writing the alignment out for them',
+                        default='external', choices=['external', 'parsimony', 'joint'])
+    parser.add_argument('--max_memory',              help='Most memory in MB to hold the matrices of bases in, bigger '
+                                                          'ones are kept in files mapped into memory so the alignment '
+                                                          'can be larger than RAM', type=int)
+    parser.add_argument('--profile',                 help='Write the time, memory and input and output sizes of each '
+                                                          'phase of every Gubbins run, added up over the iterations, to '
+                                                          'this JSON file')
+    parser.add_argument('--trace',                   help='Write when each branch was scanned, and on which thread, '
+                                                          'in every iteration to this Chrome trace JSON file, which '
+                                                          'chrome://tracing and Perfetto open')
+    parser.add_argument('--resume',                  help='Carry on from the last completed iteration recorded in the '
+                                                          'checkpoint of an earlier run with the same inputs and '
+                                                          'options', action='store_true')
 
-    gubbins.common.parse_and_run(parser.parse_args(), parser.description)
+    input_args = parser.parse_args()
+    if input_args.batch is not None:
+        gubbins.batch.run_batch(input_args)
+    elif input_args.alignment_filename is None:
+        parser.error("an alignment file or a --batch manifest is needed")
+    else:
+        gubbins.common.parse_and_run(input_args, parser.description)
@@ -13,6 +13,7 @@ setuptools.setup(
     entry_points={
         "console_scripts": [
             "run_gubbins.py = scripts.run_gubbins:main",
+            "gubbins_benchmark.py = scripts.gubbins_benchmark:main",
         ]
     },
     test_suite='nose.collector',
@@ -24,51 +24,33 @@
 #include "branch_sequences.h"
 #include "gff_file.h"
 #include "string_cat.h"
+#include "parse_phylip.h"
+#include "binomial_statistics.h"
+#include "bgzf_file.h"
+#include "tree_traversal.h"
+#include "profile.h"
+#include "block_tab_file.h"
+#include "output_selection.h"
+#include "branch_snp_columns.h"
 
 
 #define STR_OUT	"out"
 
-newick_node* build_newick_tree(char * filename, FILE *vcf_file_pointer,int * snp_locations, int number_of_snps, char** column_names, int number_of_columns,int length_of_original_genome,int min_snps, int window_min, int window_max)
+newick_node* build_newick_tree(char * filename, int * snp_locations, int number_of_snps, int length_of_original_genome,int min_snps, int window_min, int window_max, int num_threads)
 {
-	int iLen, iMaxLen;
 	char *pcTreeStr;
-	char *pcInputFile;
-	char *pcOutputFile;
-	char acStrArray[256];
 	newick_node *root;
-    char *returnchar;
-	
-	FILE *f;
 	
 	// Initialize memory management procedure
 	seqMemInit();
 	
-	pcInputFile = NULL;
-	pcOutputFile = NULL;
-	
-	pcInputFile = filename;
-
-	// Open tree file
-	f = fopen(pcInputFile, "r+");
-	
-	// Read in tree string
-	pcTreeStr = NULL;
-	iLen = 0;
-	iMaxLen = 0;
-	while (1)
-	{
-		memset(acStrArray, '\0', 256);
-		returnchar = fgets(acStrArray, 255, f);
-		if (acStrArray[0] == '\0' && feof(f))
-		{
-			break;
-		}
-		inputString(acStrArray, &pcTreeStr, &iLen, &iMaxLen);
-	}
-	fclose(f);
-	
-	// Parse tree string
+	// Read in and parse the tree string
+	start_profile_phase("load_tree");
+	pcTreeStr = read_tree_file(filename);
 	root = parseTree(pcTreeStr);
+	free(pcTreeStr);
+	bind_sequence_indices_to_nodes(root);
+	end_profile_phase("load_tree");
 	
 	// output tab file
   FILE * block_file_pointer;
@@ -76,15 +58,22 @@ newick_node* build_newick_tree(char * filename, FILE *vcf_file_pointer,int * snp
   char block_file_extension[5]= {".tab"};
 	memcpy(block_file_name, filename, size_of_string(filename) +1);
 	concat_strings_created_with_malloc(block_file_name,block_file_extension);
-	block_file_pointer = fopen(block_file_name, "w");
+	// Files which werent selected are left unopened and nothing is printed to them
+	block_file_pointer = is_output_selected(GUBBINS_OUTPUT_TAB) ? open_output_file(block_file_name) : NULL;
+	reset_recombination_fingerprint();
 	
-	// output tab file
+	// output tab file, or the binary columns which are written once every branch has been scanned
   FILE * branch_snps_file_pointer;
   char branch_snps_file_name[MAX_FILENAME_SIZE]= {""};
   char branchtab_extension[18]= {".branch_snps.tab"};
+  char branch_columns_extension[18]= {".branch_snps.bin"};
 	memcpy(branch_snps_file_name, filename, size_of_string(filename) +1);
-	concat_strings_created_with_malloc(branch_snps_file_name,branchtab_extension);
-	branch_snps_file_pointer = fopen(branch_snps_file_name, "w");
+	concat_strings_created_with_malloc(branch_snps_file_name, get_binary_branch_snps() ? branch_columns_extension : branchtab_extension);
+	branch_snps_file_pointer = NULL;
+	if(is_output_selected(GUBBINS_OUTPUT_BRANCH_SNPS))
+	{
+		branch_snps_file_pointer = get_binary_branch_snps() ? open_branch_snp_columns_file(branch_snps_file_name) : open_output_file(branch_snps_file_name);
+	}
 	
 	// output gff file
 	FILE * gff_file_pointer;
@@ -92,23 +81,102 @@ newick_node* build_newick_tree(char * filename, FILE *vcf_file_pointer,int * snp
   memcpy(gff_file_name, filename, size_of_string(filename) +1);
   char gff_extension[5]= {".gff"};
 	concat_strings_created_with_malloc(gff_file_name,gff_extension);
-	gff_file_pointer = fopen(gff_file_name, "w");
+	gff_file_pointer = is_output_selected(GUBBINS_OUTPUT_GFF) ? open_output_file(gff_file_name) : NULL;
 	print_gff_header(gff_file_pointer,length_of_original_genome);
 	
-	char * root_sequence;
+	const char * root_sequence;
+	
+	// Window and block sizes never exceed the larger of these
+	initialise_log_factorial_table(length_of_original_genome > window_max ? length_of_original_genome : window_max);
 
-	carry_unambiguous_gaps_up_tree(root);
-	root_sequence = generate_branch_sequences(root, vcf_file_pointer, snp_locations, number_of_snps, column_names, number_of_columns,root_sequence, length_of_original_genome, block_file_pointer,gff_file_pointer,min_snps,branch_snps_file_pointer,window_min, window_max);
-	free(root_sequence);
 	int * parent_recombinations;
-	fill_in_recombinations_with_gaps(root, parent_recombinations, 0, 0,0,root->block_coordinates,length_of_original_genome,snp_locations,number_of_snps);
+	if(num_threads > 1)
+	{
+		// The gaps are carried up in the same tasks as the scans, so each node only waits for its own children
+		start_profile_phase("scan_branches");
+		root_sequence = generate_branch_sequences_on_tree_tasks(root, snp_locations, number_of_snps, length_of_original_genome, block_file_pointer, gff_file_pointer, min_snps, branch_snps_file_pointer, window_min, window_max, num_threads);
+		release_sequence_views();
+		end_profile_phase("scan_branches");
+		start_profile_phase("fill_in_recombinations_with_gaps");
+		fill_in_recombinations_with_gaps_on_tree_tasks(root, parent_recombinations, 0, 0,0,root->block_coordinates,length_of_original_genome,snp_locations,number_of_snps, num_threads);
+		end_profile_phase("fill_in_recombinations_with_gaps");
+	}
+	else
+	{
+		start_profile_phase("carry_unambiguous_gaps_up_tree");
+		carry_unambiguous_gaps_up_tree(root);
+		end_profile_phase("carry_unambiguous_gaps_up_tree");
+		start_profile_phase("scan_branches");
+		root_sequence = generate_branch_sequences(root, snp_locations, number_of_snps, root_sequence, length_of_original_genome, block_file_pointer,gff_file_pointer,min_snps,branch_snps_file_pointer,window_min, window_max, num_threads);
+		release_sequence_views();
+		end_profile_phase("scan_branches");
+		start_profile_phase("fill_in_recombinations_with_gaps");
+		fill_in_recombinations_with_gaps(root, parent_recombinations, 0, 0,0,root->block_coordinates,length_of_original_genome,snp_locations,number_of_snps);
+		end_profile_phase("fill_in_recombinations_with_gaps");
+	}
+	free_binomial_statistics();
 
-	fclose(block_file_pointer);
-	fclose(gff_file_pointer);
-	fclose(branch_snps_file_pointer);
+	if(block_file_pointer != NULL)
+	{
+		fclose(block_file_pointer);
+	}
+	if(gff_file_pointer != NULL)
+	{
+		fclose(gff_file_pointer);
+	}
+	if(branch_snps_file_pointer != NULL)
+	{
+		if(get_binary_branch_snps())
+		{
+			char dictionary_file_name[MAX_FILENAME_SIZE] = {""};
+			get_branch_snp_dictionary_filename(branch_snps_file_name, dictionary_file_name);
+			write_branch_snp_columns(branch_snps_file_pointer, dictionary_file_name);
+		}
+		fclose(branch_snps_file_pointer);
+	}
+	
+	// next to the tab file, so the driver can check for convergence without reading it
+	char fingerprint_file_name[MAX_FILENAME_SIZE] = {""};
+	char fingerprint_extension[18] = {".tab.fingerprint"};
+	memcpy(fingerprint_file_name, filename, size_of_string(filename) +1);
+	concat_strings_created_with_malloc(fingerprint_file_name,fingerprint_extension);
+	write_recombination_fingerprint(fingerprint_file_name);
+	record_profile_output_file(fingerprint_file_name);
 	return root;
 }
 
+// Look up the sequence for each node once, so the tree passes dont need to search by name
+void bind_sequence_indices_to_nodes(newick_node *root)
+{
+	tree_traversal traversal;
+	int i;
+	build_tree_traversal(root, &traversal);
+	for(i = 0; i < traversal.number_of_nodes; i++)
+	{
+		traversal.pre_order[i]->sequence_index = find_sequence_index_from_sample_name(traversal.pre_order[i]->taxon);
+	}
+	
+	// With sparse rows each sequence is kept as its differences from the sequence of its parent
+	int * parent_sequence_indices = (int *) calloc(traversal.number_of_nodes+1, sizeof(int));
+	int * sequence_indices = (int *) calloc(traversal.number_of_nodes+1, sizeof(int));
+	for(i = 0; i < traversal.number_of_nodes; i++)
+	{
+		sequence_indices[i] = traversal.pre_order[i]->sequence_index;
+		parent_sequence_indices[i] = traversal.pre_order[i]->parent != NULL ? traversal.pre_order[i]->parent->sequence_index : -1;
+	}
+	encode_sequence_rows_as_differences(sequence_indices, parent_sequence_indices, traversal.number_of_nodes);
+	free(parent_sequence_indices);
+	
+	// The branches are scanned in post-order, so the sequences of a subtree are read one after another
+	for(i = 0; i < traversal.number_of_nodes; i++)
+	{
+		sequence_indices[i] = traversal.post_order[i]->sequence_index;
+	}
+	order_sequence_storage(sequence_indices, traversal.number_of_nodes);
+	free(sequence_indices);
+	free_tree_traversal(&traversal);
+}
+
 char * strip_quotes(char *taxon)
 {
 	int i = 0;
@@ -128,235 +196,289 @@ char * strip_quotes(char *taxon)
 	return taxon;
 }
 
-newick_node* parseTree(char *str)
+// The nodes, child links and taxon names of a tree are laid out in three blocks, sized from a count of
+// the delimiters in the tree string, and released along with everything else by seqFreeAll
+void initialise_newick_arena(newick_arena * arena, char *str)
 {
-	newick_node *node;
-	newick_child *child;
 	char *pcCurrent;
-	char *pcStart;
-	char *pcColon = NULL;
-	char cTemp;
-	int iCount;
-
-	pcStart = str;
-	
-	if (*pcStart != '(')
+	int length_of_string = 0;
+	arena->maximum_number_of_nodes = 1;
+	arena->number_of_internal_nodes = 0;
+	for(pcCurrent = str; *pcCurrent != '\0'; pcCurrent++)
 	{
-		// Leaf node. Separate taxon name from distance. If distance not exist then take care of taxon name only
-		pcCurrent = str;
-		while (*pcCurrent != '\0')
+		if(*pcCurrent == '(')
 		{
-			if (*pcCurrent == ':')
-			{
-				pcColon = pcCurrent;
-			}
-			pcCurrent++;
+			arena->number_of_internal_nodes++;
+			arena->maximum_number_of_nodes++;
 		}
-		node = (newick_node*)seqMalloc(sizeof(newick_node));
-		if (pcColon == NULL)
+		else if(*pcCurrent == ',')
 		{
-			// Taxon only
-			node->taxon = (char*)seqMalloc(strlen(pcStart) + 1);
-			memcpy(node->taxon, pcStart, strlen(pcStart));
+			arena->maximum_number_of_nodes++;
 		}
-		else
+		length_of_string++;
+	}
+	arena->nodes = (newick_node *) seqMalloc(arena->maximum_number_of_nodes*sizeof(newick_node));
+	arena->children = (newick_child *) seqMalloc(arena->maximum_number_of_nodes*sizeof(newick_child));
+	arena->taxa = (char *) seqMalloc(length_of_string + arena->maximum_number_of_nodes);
+	arena->number_of_nodes = 0;
+	arena->number_of_children = 0;
+	arena->length_of_taxa = 0;
+}
+
+newick_node* new_newick_node(newick_arena * arena)
+{
+	newick_node *node = &arena->nodes[arena->number_of_nodes];
+	arena->number_of_nodes++;
+	node->number_of_blocks = 0;
+	node->total_bases_removed_excluding_gaps = 0;
+	node->sequence_index = -1;
+	node->block_coordinates =  (int **) calloc((3),sizeof(int *));
+	node->block_coordinates[0] = (int*) calloc((3),sizeof(int ));
+	node->block_coordinates[1] = (int*) calloc((3),sizeof(int ));
+	node->block_snp_counts = (int*) calloc((3),sizeof(int ));
+	node->block_likelihoods = (double*) calloc((3),sizeof(double ));
+	return node;
+}
+
+// Adds a node after the last child of the parent
+newick_node* add_newick_child(newick_arena * arena, newick_node *parent, newick_child **last_child)
+{
+	newick_child *child = &arena->children[arena->number_of_children];
+	arena->number_of_children++;
+	child->node = new_newick_node(arena);
+	child->node->parent = parent;
+	if(*last_child == NULL)
+	{
+		parent->child = child;
+	}
+	else
+	{
+		(*last_child)->next = child;
+	}
+	*last_child = child;
+	parent->childNum++;
+	return child->node;
+}
+
+// Copies the characters from start up to end with the quotes taken out, as strip_quotes would
+char* copy_taxon(newick_arena * arena, char *start, char *end)
+{
+	char *taxon = arena->taxa + arena->length_of_taxa;
+	char *pcCurrent;
+	int length_of_taxon = 0;
+	for(pcCurrent = start; pcCurrent < end; pcCurrent++)
+	{
+		if(*pcCurrent != '\'')
 		{
-			// Taxon
-			*pcColon = '\0';
-			node->taxon = (char*)seqMalloc(strlen(pcStart) + 1);
-			memcpy(node->taxon, pcStart, strlen(pcStart));
-			*pcColon = ':';
-			// Distance
-			pcColon++;
-			node->dist = (float)atof(pcColon);
+			taxon[length_of_taxon] = *pcCurrent;
+			length_of_taxon++;
 		}
-		node->taxon = strip_quotes(node->taxon);
-		node->number_of_blocks = 0;
-		node->childNum = 0;
 	}
-	else
+	taxon[length_of_taxon] = '\0';
+	arena->length_of_taxa += length_of_taxon + 1;
+	return taxon;
+}
+
+// A leaf runs up to the next ',' or ')'. The taxon is everything before the last ':' and the distance everything after it.
+char* parse_newick_leaf(newick_arena * arena, newick_node *node, char *pcStart)
+{
+	char *pcCurrent;
+	char *pcColon = NULL;
+	for(pcCurrent = pcStart; *pcCurrent != '\0' && *pcCurrent != ',' && *pcCurrent != ')'; pcCurrent++)
 	{
-		// Create node
-		node = (newick_node*)seqMalloc(sizeof(newick_node));
-		child = NULL;
-		// Search for all child nodes
-		// Find all ',' until corresponding ')' is encountered
-		iCount = 0;
-		pcStart++;
-		pcCurrent = pcStart;
-		while (iCount >= 0)
+		if (*pcCurrent == ':')
 		{
-			switch (*pcCurrent)
-			{
-				case '(':
-					// Find corresponding ')' by counting
-					pcStart = pcCurrent;
-					pcCurrent++;
-					iCount++;
-					while (iCount > 0)
-					{
-						if (*pcCurrent == '(')
-						{
-							iCount++;
-						}
-						else if (*pcCurrent == ')')
-						{
-							iCount--;
-						}
-						pcCurrent++;
-					}
-					while (*pcCurrent != ',' && *pcCurrent != ')')
-					{
-						pcCurrent++;
-					}
- 					cTemp = *pcCurrent;
-					*pcCurrent = '\0';
-					// Create a child node
-					if (child == NULL)
-					{
-						node->child = (newick_child*)seqMalloc(sizeof(newick_child));
-						node->childNum = 1;
-						child = node->child;
-					}
-					else
-					{
-						child->next = (newick_child*)seqMalloc(sizeof(newick_child));
-						node->childNum++;
-						child = child->next;
-					}
-					child->node = parseTree(pcStart);
-					*pcCurrent = cTemp;
-					if (*pcCurrent != ')')
-					{
-						pcCurrent++;
-					}
-				break;
+			pcColon = pcCurrent;
+		}
+	}
+	if (pcColon == NULL)
+	{
+		node->taxon = copy_taxon(arena, pcStart, pcCurrent);
+	}
+	else
+	{
+		node->taxon = copy_taxon(arena, pcStart, pcColon);
+		node->dist = (float)atof(pcColon + 1);
+	}
+	return pcCurrent;
+}
 
-				case ')':
-					// End of tihs tree. Go to next part to retrieve distance
-					iCount--;
-				break;
+// After the ')' of an internal node there is an optional name and then an optional ':' and distance
+char* parse_newick_internal_node_label(newick_arena * arena, newick_node *node, char *pcStart)
+{
+	char *pcCurrent = pcStart;
+	if (*pcCurrent == ':')
+	{
+		node->dist = (float)atof(pcCurrent + 1);
+	}
+	else if (*pcCurrent != ';' && *pcCurrent != '\0' && *pcCurrent != ',' && *pcCurrent != ')')
+	{
+		while (*pcCurrent != ':' && *pcCurrent != ';' && *pcCurrent != '\0' && *pcCurrent != ',' && *pcCurrent != ')')
+		{
+			pcCurrent++;
+		}
+		node->taxon = copy_taxon(arena, pcStart, pcCurrent);
+		if (*pcCurrent == ':')
+		{
+			node->dist = (float)atof(pcCurrent + 1);
+		}
+	}
+	while (*pcCurrent != '\0' && *pcCurrent != ',' && *pcCurrent != ')')
+	{
+		pcCurrent++;
+	}
+	return pcCurrent;
+}
 
-				case ',':
-					// Impossible separation since according to the algorithm, this symbol will never encountered.
-					// Currently don't handle this and don't create any node
-				break;
+// A single pass over the tree string, keeping a stack of the internal nodes which are still open so
+// deep trees dont use up the call stack
+newick_node* parseTree(char *str)
+{
+	newick_arena arena;
+	newick_node *root;
+	char *pcCurrent;
+	int depth = 0;
 
-				default:
-					// leaf node encountered
-					pcStart = pcCurrent;
-					while (*pcCurrent != ',' && *pcCurrent != ')')
-					{
-						pcCurrent++;
-					}
-					cTemp = *pcCurrent;
-					*pcCurrent = '\0';
-					// Create a child node
-					if (child == NULL)
-					{
-						node->child = (newick_child*)seqMalloc(sizeof(newick_child));
-						node->childNum = 1;
-						child = node->child;
-					}
-					else
-					{
-						child->next = (newick_child*)seqMalloc(sizeof(newick_child));
-						node->childNum++;
-						child = child->next;
-					}
-					child->node = parseTree(pcStart);
-					*pcCurrent = cTemp;
-					if (*pcCurrent != ')')
-					{
-						pcCurrent++;
-					}
-				break;
-			}
+	initialise_newick_arena(&arena, str);
+	root = new_newick_node(&arena);
+	if (*str != '(')
+	{
+		// The whole string is one leaf
+		char *pcColon = strrchr(str, ':');
+		if (pcColon == NULL)
+		{
+			root->taxon = copy_taxon(&arena, str, str + strlen(str));
 		}
-
-		// If start at ':', then the internal node has no name.
-		pcCurrent++;
-		if (*pcCurrent == ':')
+		else
 		{
-			pcStart = pcCurrent + 1;
-			while (*pcCurrent != '\0' && *pcCurrent != ';')
-			{
-				pcCurrent++;
-			}
-			cTemp = *pcCurrent;
-			*pcCurrent = '\0';
-			node->dist = (float)atof(pcStart);
-			*pcCurrent = cTemp;
+			root->taxon = copy_taxon(&arena, str, pcColon);
+			root->dist = (float)atof(pcColon + 1);
 		}
-		else if (*pcCurrent != ';' && *pcCurrent != '\0')
+		build_taxon_sets(root);
+		return root;
+	}
+
+	newick_node ** open_nodes = (newick_node **) calloc(arena.number_of_internal_nodes + 1, sizeof(newick_node *));
+	newick_child ** last_children = (newick_child **) calloc(arena.number_of_internal_nodes + 1, sizeof(newick_child *));
+	open_nodes[depth] = root;
+	depth++;
+	pcCurrent = str + 1;
+	while (depth > 0 && *pcCurrent != '\0')
+	{
+		switch (*pcCurrent)
 		{
-			// Find ':' to retrieve distance, if any.
-			// At this time *pcCurrent should equal to ')'
-			pcStart = pcCurrent;
-			while (*pcCurrent != ':' && *pcCurrent != '\0' && *pcCurrent != ';')
-			{
+			case '(':
+				open_nodes[depth] = add_newick_child(&arena, open_nodes[depth-1], &last_children[depth-1]);
+				last_children[depth] = NULL;
+				depth++;
 				pcCurrent++;
-			}
-			cTemp = *pcCurrent;
-			*pcCurrent = '\0';
-			node->taxon = seqMalloc(strlen(pcStart) + 1);
-			memcpy(node->taxon, pcStart, strlen(pcStart));
-			node->taxon = strip_quotes(node->taxon);
-			
-			*pcCurrent = cTemp;
-			pcCurrent++;
-			pcStart = pcCurrent;
-			while (*pcCurrent != '\0' && *pcCurrent != ';')
-			{
+			break;
+
+			case ',':
 				pcCurrent++;
-			}
-			cTemp = *pcCurrent;
-			*pcCurrent = '\0';
-			node->dist = (float)atof(pcStart);
-			*pcCurrent = cTemp;
+			break;
+
+			case ')':
+				depth--;
+				pcCurrent = parse_newick_internal_node_label(&arena, open_nodes[depth], pcCurrent + 1);
+			break;
+
+			default:
+				pcCurrent = parse_newick_leaf(&arena, add_newick_child(&arena, open_nodes[depth-1], &last_children[depth-1]), pcCurrent);
+			break;
 		}
 	}
+	free(open_nodes);
+	free(last_children);
+	build_taxon_sets(root);
+	return root;
+}
 
-	node->number_of_blocks = 0;
-	node->total_bases_removed_excluding_gaps = 0;
-	node->block_coordinates =  (int **) calloc((3),sizeof(int *));	
-	node->block_coordinates[0] = (int*) calloc((3),sizeof(int ));
-	node->block_coordinates[1] = (int*) calloc((3),sizeof(int ));
+// Reads the whole tree file in one go
+char* read_tree_file(char * filename)
+{
+	FILE *f;
+	long length_of_file;
+	size_t length_read;
+	char *tree_string;
 
-	return node;
+	f = fopen(filename, "r");
+	record_profile_input_file(filename);
+	if(f == NULL)
+	{
+		printf("Cannot open the tree file '%s'\n", filename);
+		exit(1);
+	}
+	fseek(f, 0, SEEK_END);
+	length_of_file = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	tree_string = (char *) calloc(length_of_file + 1, sizeof(char));
+	length_read = fread(tree_string, 1, length_of_file, f);
+	tree_string[length_read] = '\0';
+	fclose(f);
+	return tree_string;
 }
 
 
 
+// Written with a stack of the internal nodes which are still open rather than by recursion, so deep trees can be printed
 void print_tree(newick_node *root, FILE * outputfile)
 {
-	newick_child *child;
-	if (root->childNum == 0)
-	{
-		fprintf(outputfile,"%s:%0.6f", root->taxon, root->dist);
-	}
-	else
+	int capacity = 64;
+	int depth = 0;
+	newick_node ** open_nodes = (newick_node **) malloc(capacity*sizeof(newick_node *));
+	newick_child ** next_children = (newick_child **) malloc(capacity*sizeof(newick_child *));
+	newick_node * node = root;
+	
+	while(node != NULL)
 	{
-		child = root->child;
-		fprintf(outputfile,"(");
-		while (child != NULL)
+		if (node->childNum == 0)
 		{
-			print_tree(child->node,outputfile);
-			if (child->next != NULL)
-			{
-				fprintf(outputfile,",");
-			}
-			child = child->next;
+			fprintf(outputfile,"%s:%0.6f", node->taxon, node->dist);
 		}
-		if (root->taxon != NULL)
+		else
 		{
-			fprintf(outputfile,")%s:%0.6f", root->taxon, root->dist);
+			fprintf(outputfile,"(");
+			if(depth == capacity)
+			{
+				capacity *= 2;
+				open_nodes = (newick_node **) realloc(open_nodes, capacity*sizeof(newick_node *));
+				next_children = (newick_child **) realloc(next_children, capacity*sizeof(newick_child *));
+			}
+			open_nodes[depth] = node;
+			next_children[depth] = node->child;
+			depth++;
 		}
-		else
+		
+		// Close every node which has no children left, then move on to the next child
+		node = NULL;
+		while(depth > 0 && node == NULL)
 		{
-			fprintf(outputfile,"):%0.6f", root->dist);
+			newick_child * child = next_children[depth-1];
+			if(child == NULL)
+			{
+				depth--;
+				if (open_nodes[depth]->taxon != NULL)
+				{
+					fprintf(outputfile,")%s:%0.6f", open_nodes[depth]->taxon, open_nodes[depth]->dist);
+				}
+				else
+				{
+					fprintf(outputfile,"):%0.6f", open_nodes[depth]->dist);
+				}
+			}
+			else
+			{
+				if(child != open_nodes[depth-1]->child)
+				{
+					fprintf(outputfile,",");
+				}
+				node = child->node;
+				next_children[depth-1] = child->next;
+			}
 		}
 	}
+	free(open_nodes);
+	free(next_children);
 	fflush(outputfile);
 }
-
@@ -20,6 +20,7 @@
  *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
+#include "taxon_sets.h"
 
 typedef struct newick_child
 {
@@ -30,7 +31,6 @@ typedef struct newick_child
 typedef struct newick_node
 {
 	char *taxon;
-	char *taxon_names;
 	char *seq;
 	
 	float dist;
@@ -39,24 +39,57 @@ typedef struct newick_node
 	int num_recombinations;
   int number_of_snps;
   int current_node_id;
+  int sequence_index;
   int number_of_blocks;
+  int traversal_index;
 	int total_bases_removed_excluding_gaps;
   int ** block_coordinates;
+  int * block_snp_counts;
+  double * block_likelihoods;
+  taxon_set taxa;
   
 	struct newick_child *child;
 	struct newick_node *parent;
 } newick_node;
 
+typedef struct newick_arena
+{
+	newick_node *nodes;
+	newick_child *children;
+	char *taxa;
+	int maximum_number_of_nodes;
+	int number_of_internal_nodes;
+	int number_of_nodes;
+	int number_of_children;
+	int length_of_taxa;
+} newick_arena;
+
 #define MAX_FILENAME_SIZE 1024
 
 #ifdef __NEWICKFORM_C__
 newick_node* parseTree(char *str);
-newick_node* build_newick_tree(char * filename, FILE *vcf_file_pointer,int * snp_locations, int number_of_snps, char** column_names, int number_of_columns,  int length_of_original_genome,int min_snps, int window_min, int window_max);
+char* read_tree_file(char * filename);
+void initialise_newick_arena(newick_arena * arena, char *str);
+newick_node* new_newick_node(newick_arena * arena);
+newick_node* add_newick_child(newick_arena * arena, newick_node *parent, newick_child **last_child);
+char* copy_taxon(newick_arena * arena, char *start, char *end);
+char* parse_newick_leaf(newick_arena * arena, newick_node *node, char *pcStart);
+char* parse_newick_internal_node_label(newick_arena * arena, newick_node *node, char *pcStart);
+void bind_sequence_indices_to_nodes(newick_node *root);
+newick_node* build_newick_tree(char * filename, int * snp_locations, int number_of_snps,  int length_of_original_genome,int min_snps, int window_min, int window_max, int num_threads);
 void print_tree(newick_node *root, FILE * outputfile);
 char* strip_quotes(char *taxon);
 #else
 extern newick_node* parseTree(char *str);
-extern newick_node* build_newick_tree(char * filename, FILE *vcf_file_pointer,int * snp_locations, int number_of_snps, char** column_names, int number_of_columns, int length_of_original_genome,int min_snps, int window_min, int window_max);
+extern char* read_tree_file(char * filename);
+extern void initialise_newick_arena(newick_arena * arena, char *str);
+extern newick_node* new_newick_node(newick_arena * arena);
+extern newick_node* add_newick_child(newick_arena * arena, newick_node *parent, newick_child **last_child);
+extern char* copy_taxon(newick_arena * arena, char *start, char *end);
+extern char* parse_newick_leaf(newick_arena * arena, newick_node *node, char *pcStart);
+extern char* parse_newick_internal_node_label(newick_arena * arena, newick_node *node, char *pcStart);
+extern void bind_sequence_indices_to_nodes(newick_node *root);
+extern newick_node* build_newick_tree(char * filename, int * snp_locations, int number_of_snps, int length_of_original_genome,int min_snps, int window_min, int window_max, int num_threads);
 extern void print_tree(newick_node *root, FILE * outputfile);
 extern char* strip_quotes(char *taxon);
 #endif
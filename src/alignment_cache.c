@@ -0,0 +1,231 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "alignment_cache.h"
+#include "alignment_file.h"
+#include "string_cat.h"
+#include "snp_sites.h"
+
+int alignment_cache_enabled = 0;
+
+void set_alignment_cache(int enabled)
+{
+	alignment_cache_enabled = enabled;
+}
+
+void alignment_cache_filename(char filename[], char cache_filename[])
+{
+	memcpy(cache_filename, filename, size_of_string(filename) +1);
+	concat_strings_created_with_malloc(cache_filename, ALIGNMENT_CACHE_EXTENSION);
+}
+
+// Checksums the first and last part of the file, which is enough to catch an alignment being
+// rewritten without having to read all of a large one every time
+uint32_t alignment_checksum(char filename[], off_t file_size)
+{
+	unsigned char * buffer = (unsigned char *) malloc(ALIGNMENT_CHECKSUM_SAMPLE_SIZE);
+	uLong checksum = crc32(0L, Z_NULL, 0);
+	ssize_t bytes_read;
+	int file_descriptor = open(filename, O_RDONLY);
+	if(file_descriptor < 0)
+	{
+		free(buffer);
+		return 0;
+	}
+	
+	bytes_read = pread(file_descriptor, buffer, ALIGNMENT_CHECKSUM_SAMPLE_SIZE, 0);
+	if(bytes_read > 0)
+	{
+		checksum = crc32(checksum, buffer, bytes_read);
+	}
+	if(file_size > ALIGNMENT_CHECKSUM_SAMPLE_SIZE)
+	{
+		bytes_read = pread(file_descriptor, buffer, ALIGNMENT_CHECKSUM_SAMPLE_SIZE, file_size - ALIGNMENT_CHECKSUM_SAMPLE_SIZE);
+		if(bytes_read > 0)
+		{
+			checksum = crc32(checksum, buffer, bytes_read);
+		}
+	}
+	close(file_descriptor);
+	free(buffer);
+	return (uint32_t) checksum;
+}
+
+// Returns 1 if the cache file belongs to this version of the alignment
+int read_alignment_cache_header(char filename[], struct stat * file_status, int cache_file_descriptor, alignment_cache_header * header)
+{
+	struct stat cache_status;
+	if(pread(cache_file_descriptor, header, sizeof(alignment_cache_header), 0) != sizeof(alignment_cache_header) ||
+	   fstat(cache_file_descriptor, &cache_status) != 0)
+	{
+		return 0;
+	}
+	if(memcmp(header->magic, ALIGNMENT_CACHE_MAGIC, sizeof(header->magic)) != 0 ||
+	   header->cache_size != (uint64_t) cache_status.st_size ||
+	   header->input_size != (uint64_t) file_status->st_size ||
+	   header->input_modification_time != (int64_t) file_status->st_mtime)
+	{
+		return 0;
+	}
+	return header->input_checksum == alignment_checksum(filename, file_status->st_size);
+}
+
+// Map the cache in place of the alignment, returning 0 if caching is off or there isnt a valid one
+int read_alignment_cache(loaded_alignment * alignment, char filename[], struct stat * file_status)
+{
+	char cache_filename[MAX_FILENAME_SIZE] = {""};
+	alignment_cache_header header;
+	int i;
+	
+	if(alignment_cache_enabled == 0)
+	{
+		return 0;
+	}
+	alignment_cache_filename(filename, cache_filename);
+	int cache_file_descriptor = open(cache_filename, O_RDONLY);
+	if(cache_file_descriptor < 0)
+	{
+		return 0;
+	}
+	if(read_alignment_cache_header(filename, file_status, cache_file_descriptor, &header) == 0)
+	{
+		close(cache_file_descriptor);
+		return 0;
+	}
+	
+	char * data = (char *) mmap(NULL, header.cache_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, cache_file_descriptor, 0);
+	close(cache_file_descriptor);
+	if(data == MAP_FAILED)
+	{
+		return 0;
+	}
+	alignment->data = data;
+	alignment->data_size = header.cache_size;
+	alignment->data_is_mapped = 1;
+	
+	alignment_cache_record * records = (alignment_cache_record *) (data + sizeof(alignment_cache_header));
+	for(i = 0; i < header.number_of_sequences; i++)
+	{
+		add_alignment_record(alignment, records[i].record_offset, data + records[i].name_offset, data + records[i].sequence_offset, (int) records[i].sequence_length);
+	}
+	return 1;
+}
+
+// The cache is written to a temporary file and renamed, so a run which is killed part way through
+// never leaves a truncated cache behind. If it cant be written the alignment is just parsed next time.
+void write_alignment_cache(loaded_alignment * alignment, char filename[], struct stat * file_status)
+{
+	char cache_filename[MAX_FILENAME_SIZE] = {""};
+	char temporary_cache_filename[MAX_FILENAME_SIZE] = {""};
+	alignment_cache_header header;
+	int i;
+	
+	if(alignment_cache_enabled == 0)
+	{
+		return;
+	}
+	alignment_cache_filename(filename, cache_filename);
+	memcpy(temporary_cache_filename, cache_filename, size_of_string(cache_filename) +1);
+	concat_strings_created_with_malloc(temporary_cache_filename, ".tmp");
+	FILE * cache_file_pointer = fopen(temporary_cache_filename, "w");
+	if(cache_file_pointer == NULL)
+	{
+		return;
+	}
+	
+	alignment_cache_record * records = (alignment_cache_record *) calloc(alignment->number_of_sequences+1, sizeof(alignment_cache_record));
+	uint64_t offset = sizeof(alignment_cache_header) + alignment->number_of_sequences*sizeof(alignment_cache_record);
+	for(i = 0; i < alignment->number_of_sequences; i++)
+	{
+		records[i].record_offset = alignment->record_offsets[i];
+		records[i].sequence_length = alignment->sequence_lengths[i];
+		records[i].name_offset = offset;
+		offset += strlen(alignment->sequence_names[i]) + 1;
+		records[i].sequence_offset = offset;
+		offset += alignment->sequence_lengths[i] + 1;
+	}
+	
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, ALIGNMENT_CACHE_MAGIC, sizeof(header.magic));
+	header.input_size = file_status->st_size;
+	header.input_modification_time = file_status->st_mtime;
+	header.input_checksum = alignment_checksum(filename, file_status->st_size);
+	header.number_of_sequences = alignment->number_of_sequences;
+	header.cache_size = offset;
+	
+	int write_failed = fwrite(&header, sizeof(header), 1, cache_file_pointer) != 1;
+	if(alignment->number_of_sequences > 0)
+	{
+		write_failed |= fwrite(records, sizeof(alignment_cache_record), alignment->number_of_sequences, cache_file_pointer) != (size_t) alignment->number_of_sequences;
+	}
+	for(i = 0; i < alignment->number_of_sequences; i++)
+	{
+		write_failed |= fwrite(alignment->sequence_names[i], 1, strlen(alignment->sequence_names[i]) + 1, cache_file_pointer) != strlen(alignment->sequence_names[i]) + 1;
+		write_failed |= fwrite(alignment->sequences[i], 1, alignment->sequence_lengths[i], cache_file_pointer) != (size_t) alignment->sequence_lengths[i];
+		write_failed |= fputc('\0', cache_file_pointer) == EOF;
+	}
+	write_failed |= fclose(cache_file_pointer) != 0;
+	free(records);
+	
+	if(write_failed || rename(temporary_cache_filename, cache_filename) != 0)
+	{
+		remove(temporary_cache_filename);
+	}
+}
+
+// The length of the first sequence from a valid cache without mapping the rest of it, or -1
+int cached_genome_length(char filename[])
+{
+	char cache_filename[MAX_FILENAME_SIZE] = {""};
+	alignment_cache_header header;
+	alignment_cache_record first_record;
+	struct stat file_status;
+	int length_of_genome = -1;
+	
+	if(alignment_cache_enabled == 0 || stat(filename, &file_status) != 0)
+	{
+		return -1;
+	}
+	alignment_cache_filename(filename, cache_filename);
+	int cache_file_descriptor = open(cache_filename, O_RDONLY);
+	if(cache_file_descriptor < 0)
+	{
+		return -1;
+	}
+	if(read_alignment_cache_header(filename, &file_status, cache_file_descriptor, &header))
+	{
+		length_of_genome = 0;
+		if(header.number_of_sequences > 0 &&
+		   pread(cache_file_descriptor, &first_record, sizeof(first_record), sizeof(alignment_cache_header)) == sizeof(first_record))
+		{
+			length_of_genome = (int) first_record.sequence_length;
+		}
+	}
+	close(cache_file_descriptor);
+	return length_of_genome;
+}
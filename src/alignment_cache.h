@@ -0,0 +1,60 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _ALIGNMENT_CACHE_H_
+#define _ALIGNMENT_CACHE_H_
+
+#include <stdint.h>
+#include <sys/stat.h>
+#include "alignment_file.h"
+
+// A binary copy of an indexed alignment written next to it, so later runs can map the names and
+// sequences straight in rather than parsing the text again. It is only used if the size, modification
+// time and a checksum of the start and end of the alignment still match.
+typedef struct alignment_cache_header
+{
+	char magic[8];
+	uint64_t input_size;
+	int64_t input_modification_time;
+	uint32_t input_checksum;
+	int32_t number_of_sequences;
+	uint64_t cache_size;
+} alignment_cache_header;
+
+typedef struct alignment_cache_record
+{
+	uint64_t name_offset;
+	uint64_t sequence_offset;
+	uint64_t record_offset;
+	int64_t sequence_length;
+} alignment_cache_record;
+
+void set_alignment_cache(int enabled);
+void alignment_cache_filename(char filename[], char cache_filename[]);
+uint32_t alignment_checksum(char filename[], off_t file_size);
+int read_alignment_cache_header(char filename[], struct stat * file_status, int cache_file_descriptor, alignment_cache_header * header);
+int read_alignment_cache(loaded_alignment * alignment, char filename[], struct stat * file_status);
+void write_alignment_cache(loaded_alignment * alignment, char filename[], struct stat * file_status);
+int cached_genome_length(char filename[]);
+
+#define ALIGNMENT_CACHE_MAGIC "GUBALN01"
+#define ALIGNMENT_CACHE_EXTENSION ".gubbins_cache"
+#define ALIGNMENT_CHECKSUM_SAMPLE_SIZE 1048576
+
+#endif
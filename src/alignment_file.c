@@ -21,16 +21,257 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <zlib.h>
 #include <regex.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include "kseq.h"
 #include "vcf.h"
 #include "alignment_file.h"
 #include "snp_sites.h"
 #include "string_cat.h"
+#include "snp_detection.h"
+#include "alignment_cache.h"
+#include "compressed_reader.h"
+#include "sample_name_pool.h"
 
-KSEQ_INIT(gzFile, gzread)
+KSEQ_INIT(compressed_reader *, read_compressed_reader)
+
+loaded_alignment * cached_alignment = NULL;
+
+// Returns the alignment if it is the one in memory and the file hasnt changed since it was read
+loaded_alignment * find_loaded_alignment(char filename[])
+{
+	struct stat file_status;
+	if(cached_alignment == NULL || strcmp(cached_alignment->filename, filename) != 0 || stat(filename, &file_status) != 0)
+	{
+		return NULL;
+	}
+	
+	if(file_status.st_dev != cached_alignment->device || file_status.st_ino != cached_alignment->inode ||
+	   file_status.st_size != cached_alignment->file_size || file_status.st_mtime != cached_alignment->modification_time)
+	{
+		return NULL;
+	}
+	return cached_alignment;
+}
+
+// Read and index the whole file once, replacing any alignment which was in memory before
+loaded_alignment * load_alignment(char filename[])
+{
+	loaded_alignment * alignment = find_loaded_alignment(filename);
+	if(alignment != NULL)
+	{
+		return alignment;
+	}
+	free_loaded_alignment();
+	
+	struct stat file_status;
+	if(stat(filename, &file_status) != 0)
+	{
+		printf("Cannot read alignment because file '%s' doesnt exist\n",filename);
+		exit(1);
+	}
+	
+	alignment = (loaded_alignment *) calloc(1, sizeof(loaded_alignment));
+	alignment->filename = (char *) calloc(strlen(filename)+1, sizeof(char));
+	memcpy(alignment->filename, filename, strlen(filename)+1);
+	alignment->device = file_status.st_dev;
+	alignment->inode = file_status.st_ino;
+	alignment->file_size = file_status.st_size;
+	alignment->modification_time = file_status.st_mtime;
+	
+	if(read_alignment_cache(alignment, filename, &file_status) == 0)
+	{
+		read_alignment_data(alignment, filename);
+		index_alignment_records(alignment);
+		write_alignment_cache(alignment, filename, &file_status);
+	}
+	
+	cached_alignment = alignment;
+	return alignment;
+}
+
+// Uncompressed files are mapped privately, so the pages are only copied if a record has to be rewritten in place
+void read_alignment_data(loaded_alignment * alignment, char filename[])
+{
+	unsigned char magic_number[2] = {0, 0};
+	int file_descriptor = open(filename, O_RDONLY);
+	if(file_descriptor < 0)
+	{
+		printf("Cannot open alignment file '%s'\n",filename);
+		exit(1);
+	}
+	
+	if(read(file_descriptor, magic_number, 2) == 2 && magic_number[0] == 0x1f && magic_number[1] == 0x8b)
+	{
+		compressed_reader * reader = open_compressed_reader_from_descriptor(file_descriptor);
+		size_t capacity = MAX_READ_BUFFER;
+		int bytes_read;
+		alignment->data = (char *) malloc(capacity);
+		while((bytes_read = read_compressed_reader(reader, alignment->data + alignment->data_size, capacity - alignment->data_size)) > 0)
+		{
+			alignment->data_size += bytes_read;
+			if(alignment->data_size == capacity)
+			{
+				capacity *= 2;
+				alignment->data = (char *) realloc(alignment->data, capacity);
+			}
+		}
+		close_compressed_reader(reader);
+		return;
+	}
+	
+	if(alignment->file_size > 0)
+	{
+		alignment->data = (char *) mmap(NULL, alignment->file_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file_descriptor, 0);
+		if(alignment->data == MAP_FAILED)
+		{
+			printf("Cannot map alignment file '%s'\n",filename);
+			exit(1);
+		}
+		alignment->data_size = alignment->file_size;
+		alignment->data_is_mapped = 1;
+		madvise(alignment->data, alignment->data_size, MADV_SEQUENTIAL);
+	}
+	close(file_descriptor);
+}
+
+// Split the data into records the same way kseq does for FASTA. Names are terminated in place and
+// sequences which span several lines are moved together, so every sequence is one contiguous run of bases.
+void index_alignment_records(loaded_alignment * alignment)
+{
+	char * data = alignment->data;
+	size_t data_size = alignment->data_size;
+	size_t position = 0;
+	
+	while(position < data_size && data[position] != '>' && data[position] != '@')
+	{
+		position++;
+	}
+	
+	while(position < data_size)
+	{
+		size_t record_offset = position;
+		position++;
+		
+		size_t name_start = position;
+		while(position < data_size && !isspace(data[position]))
+		{
+			position++;
+		}
+		if(position >= data_size)
+		{
+			// The name runs to the end of the data, so there is nowhere to terminate it in place
+			alignment->trailing_sequence_name = (char *) calloc(position - name_start + 1, sizeof(char));
+			memcpy(alignment->trailing_sequence_name, data + name_start, position - name_start);
+			add_alignment_record(alignment, record_offset, alignment->trailing_sequence_name, data + position, 0);
+			break;
+		}
+		
+		char delimiter = data[position];
+		data[position] = '\0';
+		position++;
+		if(delimiter != '\n')
+		{
+			// Skip the comment
+			while(position < data_size && data[position] != '\n')
+			{
+				position++;
+			}
+			position++;
+		}
+		
+		size_t sequence_start = position;
+		size_t sequence_end = position;
+		while(position < data_size && data[position] != '>' && data[position] != '+' && data[position] != '@')
+		{
+			if(data[position] == '\n')
+			{
+				position++;
+				continue;
+			}
+			char * end_of_line = memchr(data + position, '\n', data_size - position);
+			size_t line_end = (end_of_line == NULL) ? data_size : (size_t)(end_of_line - data);
+			if(sequence_end != position)
+			{
+				memmove(data + sequence_end, data + position, line_end - position);
+			}
+			sequence_end += line_end - position;
+			position = line_end;
+		}
+		add_alignment_record(alignment, record_offset, data + name_start, data + sequence_start, sequence_end - sequence_start);
+		
+		if(position < data_size && data[position] == '+')
+		{
+			// FASTQ, skip the quality line(s) which are the same length as the sequence
+			size_t quality_length = 0;
+			while(position < data_size && data[position] != '\n')
+			{
+				position++;
+			}
+			position++;
+			while(position < data_size && quality_length < sequence_end - sequence_start)
+			{
+				if(data[position] != '\n')
+				{
+					quality_length++;
+				}
+				position++;
+			}
+			while(position < data_size && data[position] != '>' && data[position] != '@')
+			{
+				position++;
+			}
+		}
+	}
+}
+
+void add_alignment_record(loaded_alignment * alignment, size_t record_offset, char * sequence_name, char * sequence, int sequence_length)
+{
+	if(alignment->number_of_sequences == alignment->capacity)
+	{
+		alignment->capacity = (alignment->capacity == 0) ? 64 : alignment->capacity*2;
+		alignment->sequence_names   = (char **) realloc(alignment->sequence_names, alignment->capacity*sizeof(char *));
+		alignment->sequences        = (char **) realloc(alignment->sequences, alignment->capacity*sizeof(char *));
+		alignment->sequence_lengths = (int *) realloc(alignment->sequence_lengths, alignment->capacity*sizeof(int));
+		alignment->record_offsets   = (size_t *) realloc(alignment->record_offsets, alignment->capacity*sizeof(size_t));
+	}
+	alignment->sequence_names[alignment->number_of_sequences] = sequence_name;
+	alignment->sequences[alignment->number_of_sequences] = sequence;
+	alignment->sequence_lengths[alignment->number_of_sequences] = sequence_length;
+	alignment->record_offsets[alignment->number_of_sequences] = record_offset;
+	alignment->number_of_sequences++;
+}
+
+void free_loaded_alignment()
+{
+	if(cached_alignment == NULL)
+	{
+		return;
+	}
+	
+	if(cached_alignment->data_is_mapped)
+	{
+		munmap(cached_alignment->data, cached_alignment->data_size);
+	}
+	else
+	{
+		free(cached_alignment->data);
+	}
+	free(cached_alignment->sequence_names);
+	free(cached_alignment->sequences);
+	free(cached_alignment->sequence_lengths);
+	free(cached_alignment->record_offsets);
+	free(cached_alignment->trailing_sequence_name);
+	free(cached_alignment->filename);
+	free(cached_alignment);
+	cached_alignment = NULL;
+}
 
 // Given a file handle, return the length of the current line
 int line_length(FILE * alignment_file_pointer)
@@ -65,34 +306,40 @@ void advance_to_sequence_name(FILE * alignment_file_pointer)
 
 void get_bases_for_each_snp(char filename[], int snp_locations[], char ** bases_for_snps, int length_of_genome, int number_of_snps)
 {
-  int l;
-  int i = 0;
   int sequence_number = 0;
-	
-	gzFile fp;
-	kseq_t *seq;
-	
-	fp = gzopen(filename, "r");
-	seq = kseq_init(fp);
+	loaded_alignment * alignment = load_alignment(filename);
+  
+	for(sequence_number = 0; sequence_number < alignment->number_of_sequences; sequence_number++)
+	{
+    fill_in_bases_for_each_snp(alignment->sequences[sequence_number], sequence_number, snp_locations, bases_for_snps, number_of_snps);
+  }
+}
 
+// Fills in the bases for two sets of snps from the same read of each sequence
+void get_bases_for_each_snp_including_and_excluding_gaps(char filename[], int snp_locations_including_gaps[], char ** bases_for_snps_including_gaps, int number_of_snps_including_gaps, int snp_locations_excluding_gaps[], char ** bases_for_snps_excluding_gaps, int number_of_snps_excluding_gaps)
+{
+  int sequence_number = 0;
+	loaded_alignment * alignment = load_alignment(filename);
   
-	while ((l = kseq_read(seq)) >= 0) 
+	for(sequence_number = 0; sequence_number < alignment->number_of_sequences; sequence_number++)
 	{
-    
-    for(i = 0; i< number_of_snps; i++)
-		{
-			bases_for_snps[i][sequence_number] = toupper(((char *) seq->seq.s)[snp_locations[i]]);
-			// Present gaps and unknowns in the same way to Gubbins
-			if(bases_for_snps[i][sequence_number] == 'N')
-			{
-				bases_for_snps[i][sequence_number]  = '-';
-			}
-		}
-    sequence_number++;
+    fill_in_bases_for_each_snp(alignment->sequences[sequence_number], sequence_number, snp_locations_including_gaps, bases_for_snps_including_gaps, number_of_snps_including_gaps);
+    fill_in_bases_for_each_snp(alignment->sequences[sequence_number], sequence_number, snp_locations_excluding_gaps, bases_for_snps_excluding_gaps, number_of_snps_excluding_gaps);
   }
+}
 
-	kseq_destroy(seq);
-	gzclose(fp);
+void fill_in_bases_for_each_snp(char * sequence, int sequence_number, int snp_locations[], char ** bases_for_snps, int number_of_snps)
+{
+  int i = 0;
+  for(i = 0; i< number_of_snps; i++)
+	{
+		bases_for_snps[i][sequence_number] = toupper(sequence[snp_locations[i]]);
+		// Present gaps and unknowns in the same way to Gubbins
+		if(bases_for_snps[i][sequence_number] == 'N')
+		{
+			bases_for_snps[i][sequence_number]  = '-';
+		}
+	}
 }
 
 
@@ -104,130 +351,98 @@ int genome_length(char filename[])
 		printf("Cannot calculate genome_length because file '%s' doesnt exist\n",filename);
 		exit(0);
   }
+  
+	loaded_alignment * alignment = find_loaded_alignment(filename);
+	if(alignment != NULL)
+	{
+		return (alignment->number_of_sequences > 0) ? alignment->sequence_lengths[0] : 0;
+	}
+	length_of_genome = cached_genome_length(filename);
+	if(length_of_genome >= 0)
+	{
+		return length_of_genome;
+	}
 
-	gzFile fp;
+	// Only the first sequence is needed, so theres no point reading the rest of the file
+	compressed_reader * fp;
 	kseq_t *seq;
 	
-	fp = gzopen(filename, "r");
+	fp = open_compressed_reader(filename);
 	seq = kseq_init(fp);
   kseq_read(seq);
 
   length_of_genome = seq->seq.l;
 
 	kseq_destroy(seq);
-	gzclose(fp);
+	close_compressed_reader(fp);
 	return length_of_genome;
 }
 
 
 int number_of_sequences_in_file(char filename[])
 {
-  int number_of_sequences = 0;
-  int l;
-	
-	gzFile fp;
-	kseq_t *seq;
-	
-	fp = gzopen(filename, "r");
-	seq = kseq_init(fp);
-  
-	while ((l = kseq_read(seq)) >= 0) {
-    number_of_sequences++;
-	}
-	kseq_destroy(seq);
-	gzclose(fp);
-	return number_of_sequences;
+	return load_alignment(filename)->number_of_sequences;
 }
 
 
 int build_reference_sequence(char reference_sequence[], char filename[])
 {
 	int i;
+	loaded_alignment * alignment = load_alignment(filename);
+	if(alignment->number_of_sequences == 0)
+	{
+		reference_sequence[0] = '\0';
+		return 1;
+	}
 	
-	int length_of_genome;
-
-	gzFile fp;
-	kseq_t *seq;
-	
-	fp = gzopen(filename, "r");
-	seq = kseq_init(fp);
-  kseq_read(seq);
-
-	for(i = 0; i < seq->seq.l; i++)
+	char * sequence = alignment->sequences[0];
+	int length_of_sequence = alignment->sequence_lengths[0];
+	for(i = 0; i < length_of_sequence; i++)
 	{
-		reference_sequence[i] = toupper(seq->seq.s[i]);
+		reference_sequence[i] = toupper(sequence[i]);
 		if(reference_sequence[i] == 'N')
 		{
 			reference_sequence[i]  = '-';
 		}
 	}
-    if(reference_sequence[seq->seq.l] != '\0')
+    if(reference_sequence[length_of_sequence] != '\0')
     {
-      reference_sequence[seq->seq.l]  =   '\0';
+      reference_sequence[length_of_sequence]  =   '\0';
     }
-	
-	kseq_destroy(seq);
-	gzclose(fp);
 	return 1;
 }
 
 int detect_snps(char reference_sequence[], char filename[], int length_of_genome, int exclude_gaps)
 {
-  int i;
   int number_of_snps = 0;
-  int l;
-  
-  gzFile fp;
-  kseq_t *seq;
+  int sequence_number;
+  loaded_alignment * alignment = load_alignment(filename);
   
-  fp = gzopen(filename, "r");
-  seq = kseq_init(fp);
   // First sequence is the reference sequence so skip it
-  kseq_read(seq);
-  
-  while ((l = kseq_read(seq)) >= 0) {
-    for(i = 0; i < length_of_genome; i++)
-    {
-    
-      if(exclude_gaps)
-      {
-        // If there is an indel in the reference sequence, replace with the first proper base you find
-        if((reference_sequence[i] == '-' && seq->seq.s[i] != '-' ) || (toupper(reference_sequence[i]) == 'N' && seq->seq.s[i] != 'N' ))
-        {
-          reference_sequence[i] = toupper(seq->seq.s[i]);
-        }
-        
-        if(reference_sequence[i] != '*' && seq->seq.s[i] != '-' && toupper(seq->seq.s[i]) != 'N' && reference_sequence[i] != toupper(seq->seq.s[i]))
-        {
-          reference_sequence[i] = '*';
-          number_of_snps++;
-        }
-      }
-      else
-      {
-	
-				char input_base = toupper(seq->seq.s[i]);
-				if(input_base == 'N')
-				{
-					input_base = '-';
-				}
-	
-        if(reference_sequence[i] != '*' && reference_sequence[i] != input_base)
-        {
-         reference_sequence[i] = '*';
-         number_of_snps++;
-        }
-      }
-    }
-    
+  for(sequence_number = 1; sequence_number < alignment->number_of_sequences; sequence_number++) {
+    int length_to_compare = (alignment->sequence_lengths[sequence_number] < length_of_genome) ? alignment->sequence_lengths[sequence_number] : length_of_genome;
+    number_of_snps += mark_snps(reference_sequence, alignment->sequences[sequence_number], length_to_compare, exclude_gaps);
   }
 
-  kseq_destroy(seq);
-  gzclose(fp);
-
   return number_of_snps;
 }
 
+// Find the snps for both definitions of a snp in one scan of the alignment, each sequence is compared
+// against both references while it is still in the cache.
+void detect_snps_including_and_excluding_gaps(char reference_sequence_including_gaps[], char reference_sequence_excluding_gaps[], char filename[], int length_of_genome, int * number_of_snps_including_gaps, int * number_of_snps_excluding_gaps)
+{
+  int sequence_number;
+  loaded_alignment * alignment = load_alignment(filename);
+  *number_of_snps_including_gaps = 0;
+  *number_of_snps_excluding_gaps = 0;
+  
+  for(sequence_number = 1; sequence_number < alignment->number_of_sequences; sequence_number++) {
+    int length_to_compare = (alignment->sequence_lengths[sequence_number] < length_of_genome) ? alignment->sequence_lengths[sequence_number] : length_of_genome;
+    *number_of_snps_including_gaps += mark_snps(reference_sequence_including_gaps, alignment->sequences[sequence_number], length_to_compare, 0);
+    *number_of_snps_excluding_gaps += mark_snps(reference_sequence_excluding_gaps, alignment->sequences[sequence_number], length_to_compare, 1);
+  }
+}
+
 
 
 
@@ -260,24 +475,26 @@ char * read_line(char sequence[], FILE * pFilePtr)
 
 void get_sample_names_for_header(char filename[], char ** sequence_names, int number_of_samples)
 {
-  int l;
   int i = 0;
-	
-	gzFile fp;
-	kseq_t *seq;
-	
-	fp = gzopen(filename, "r");
-	seq = kseq_init(fp);
+	loaded_alignment * alignment = load_alignment(filename);
   
-	while ((l = kseq_read(seq)) >= 0) {
-		memcpy(sequence_names[i], seq->name.s, size_of_string(seq->name.s)+1);
-    i++;
+	for(i = 0; i < alignment->number_of_sequences && i < number_of_samples; i++) {
+		memcpy(sequence_names[i], alignment->sequence_names[i], size_of_string(alignment->sequence_names[i])+1);
 	}
-	kseq_destroy(seq);
-	gzclose(fp);
 
 }
 
+// The names are borrowed from the sample name pool, so they outlast the loaded alignment
+void get_pooled_sample_names_for_header(char filename[], char ** sequence_names, int number_of_samples)
+{
+  int i = 0;
+	loaded_alignment * alignment = load_alignment(filename);
+  
+	for(i = 0; i < alignment->number_of_sequences && i < number_of_samples; i++) {
+		sequence_names[i] = pool_sample_name(alignment->sequence_names[i]);
+	}
+}
+
 char filter_invalid_characters(char input_char)
 {
 	regex_t regex;
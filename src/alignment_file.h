@@ -20,9 +20,32 @@
 #ifndef _ALIGNMENT_FILE_H_
 #define _ALIGNMENT_FILE_H_
 
+#include <sys/types.h>
 #include "kseq.h"
 
+// An alignment read into memory in a single pass. Uncompressed files are mapped rather than copied, so
+// sequences which are on one line point straight into the file. The names and sequences are indexed by record.
+typedef struct loaded_alignment
+{
+	char * filename;
+	dev_t device;
+	ino_t inode;
+	off_t file_size;
+	time_t modification_time;
+	char * data;
+	size_t data_size;
+	int data_is_mapped;
+	int number_of_sequences;
+	int capacity;
+	char ** sequence_names;
+	char ** sequences;
+	int * sequence_lengths;
+	size_t * record_offsets;
+	char * trailing_sequence_name;
+} loaded_alignment;
+
 int detect_snps(char reference_sequence[],  char filename[], int length_of_genome, int exclude_gaps);
+void detect_snps_including_and_excluding_gaps(char reference_sequence_including_gaps[], char reference_sequence_excluding_gaps[], char filename[], int length_of_genome, int * number_of_snps_including_gaps, int * number_of_snps_excluding_gaps);
 int line_length(FILE * alignment_file_pointer);
 int build_reference_sequence(char reference_sequence[], char filename[]);
 void advance_to_sequence(FILE * alignment_file_pointer);
@@ -31,8 +54,17 @@ int genome_length(char filename[]);
 char * read_line(char sequence[], FILE * pFilePtr);
 int number_of_sequences_in_file(char filename[]);
 void get_sample_names_for_header(char filename[], char ** sequence_names, int number_of_samples);
+void get_pooled_sample_names_for_header(char filename[], char ** sequence_names, int number_of_samples);
 char filter_invalid_characters(char input_char);
 void get_bases_for_each_snp(char filename[], int snp_locations[], char ** bases_for_snps, int length_of_genome, int number_of_snps);
+void get_bases_for_each_snp_including_and_excluding_gaps(char filename[], int snp_locations_including_gaps[], char ** bases_for_snps_including_gaps, int number_of_snps_including_gaps, int snp_locations_excluding_gaps[], char ** bases_for_snps_excluding_gaps, int number_of_snps_excluding_gaps);
+void fill_in_bases_for_each_snp(char * sequence, int sequence_number, int snp_locations[], char ** bases_for_snps, int number_of_snps);
+loaded_alignment * load_alignment(char filename[]);
+loaded_alignment * find_loaded_alignment(char filename[]);
+void read_alignment_data(loaded_alignment * alignment, char filename[]);
+void index_alignment_records(loaded_alignment * alignment);
+void add_alignment_record(loaded_alignment * alignment, size_t record_offset, char * sequence_name, char * sequence, int sequence_length);
+void free_loaded_alignment();
 
 #define MAX_READ_BUFFER 65536
 #define MAX_READ_BUFFER_SMALL 1024
@@ -0,0 +1,321 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "alignment_filter.h"
+#include "alignment_file.h"
+#include "branch_scan_cache.h"
+#include "output_buffer.h"
+
+// Removes the sequences with more than filter_percentage of their bases missing (n, N or -) and, if asked, all but the
+// last of each set of identical sequences, writing the rest to the output with 60 bases to a line. The names of the
+// removed sequences are written one to a line to removed_taxa_filename. It is run from python, so rather than exiting it
+// returns ALIGNMENT_FILTER_OK or what went wrong, for the caller to report.
+int filter_alignment_file(char input_filename[], char output_filename[], char removed_taxa_filename[], double filter_percentage, int remove_identical_sequences, int num_threads)
+{
+	int i;
+	loaded_alignment * alignment = load_alignment(input_filename);
+	int number_of_sequences = alignment->number_of_sequences;
+	double * missing_data_percentages = (double *) calloc(number_of_sequences+1, sizeof(double));
+	uint64_t * sequence_hashes = (uint64_t *) calloc(number_of_sequences+1, sizeof(uint64_t));
+	int * is_removed = (int *) calloc(number_of_sequences+1, sizeof(int));
+	int * kept_sequence_indices = (int *) calloc(number_of_sequences+1, sizeof(int));
+	int number_of_kept_sequences = 0;
+	int status = ALIGNMENT_FILTER_OK;
+	
+	measure_sequences_in_parallel(alignment, missing_data_percentages, sequence_hashes, num_threads);
+	if(remove_identical_sequences)
+	{
+		flag_identical_sequences(alignment, sequence_hashes, is_removed);
+	}
+	for(i = 0; i < number_of_sequences; i++)
+	{
+		if(missing_data_percentages[i] > filter_percentage)
+		{
+			printf("Excluded sequence %s because it had %g percentage missing data while a maximum of %g is allowed\n", alignment->sequence_names[i], missing_data_percentages[i], filter_percentage);
+			is_removed[i] = 1;
+		}
+		if(!is_removed[i])
+		{
+			kept_sequence_indices[number_of_kept_sequences] = i;
+			number_of_kept_sequences++;
+		}
+	}
+	if(number_of_kept_sequences <= 1)
+	{
+		status = ALIGNMENT_FILTER_TOO_FEW_SEQUENCES;
+	}
+	
+	FILE * output_file_pointer = status == ALIGNMENT_FILTER_OK ? fopen(output_filename, "w") : NULL;
+	if(status == ALIGNMENT_FILTER_OK && output_file_pointer == NULL)
+	{
+		status = ALIGNMENT_FILTER_CANNOT_WRITE_OUTPUT;
+	}
+	if(output_file_pointer != NULL)
+	{
+		output_buffer buffer;
+		filtered_alignment_rows rows = {alignment, kept_sequence_indices};
+		initialise_output_buffer(&buffer, output_file_pointer, OUTPUT_BUFFER_SIZE);
+		write_rows(&buffer, &rows, number_of_kept_sequences, maximum_filtered_alignment_row_length, format_filtered_alignment_row, num_threads);
+		free_output_buffer(&buffer);
+		fclose(output_file_pointer);
+	}
+	
+	if(status == ALIGNMENT_FILTER_OK && removed_taxa_filename != NULL && removed_taxa_filename[0] != '\0')
+	{
+		FILE * removed_taxa_file_pointer = fopen(removed_taxa_filename, "w");
+		if(removed_taxa_file_pointer == NULL)
+		{
+			status = ALIGNMENT_FILTER_CANNOT_WRITE_REMOVED_TAXA;
+		}
+		else
+		{
+			for(i = 0; i < number_of_sequences; i++)
+			{
+				if(is_removed[i])
+				{
+					fprintf(removed_taxa_file_pointer, "%s\n", alignment->sequence_names[i]);
+				}
+			}
+			fclose(removed_taxa_file_pointer);
+		}
+	}
+	
+	free(missing_data_percentages);
+	free(sequence_hashes);
+	free(is_removed);
+	free(kept_sequence_indices);
+	// Run from python the messages would otherwise come out after its own
+	fflush(stdout);
+	return status;
+}
+
+void measure_sequences_in_parallel(loaded_alignment * alignment, double * missing_data_percentages, uint64_t * sequence_hashes, int num_threads)
+{
+	int i;
+	int number_of_ranges = num_threads > 1 ? num_threads : 1;
+	if(number_of_ranges > alignment->number_of_sequences)
+	{
+		number_of_ranges = alignment->number_of_sequences > 0 ? alignment->number_of_sequences : 1;
+	}
+	int sequences_per_range = (alignment->number_of_sequences + number_of_ranges - 1)/number_of_ranges;
+	alignment_filter_range * ranges = (alignment_filter_range *) calloc(number_of_ranges, sizeof(alignment_filter_range));
+	pthread_t * threads = (pthread_t *) calloc(number_of_ranges, sizeof(pthread_t));
+	for(i = 0; i < number_of_ranges; i++)
+	{
+		ranges[i].alignment = alignment;
+		ranges[i].first_sequence = i*sequences_per_range;
+		ranges[i].end_sequence = (i+1)*sequences_per_range < alignment->number_of_sequences ? (i+1)*sequences_per_range : alignment->number_of_sequences;
+		ranges[i].missing_data_percentages = missing_data_percentages;
+		ranges[i].sequence_hashes = sequence_hashes;
+	}
+	if(number_of_ranges == 1)
+	{
+		measure_sequences_in_range(&ranges[0]);
+	}
+	else
+	{
+		for(i = 0; i < number_of_ranges; i++)
+		{
+			pthread_create(&threads[i], NULL, measure_sequences_in_range, &ranges[i]);
+		}
+		for(i = 0; i < number_of_ranges; i++)
+		{
+			pthread_join(threads[i], NULL);
+		}
+	}
+	free(threads);
+	free(ranges);
+}
+
+void * measure_sequences_in_range(void * range_pointer)
+{
+	alignment_filter_range * range = (alignment_filter_range *) range_pointer;
+	int i;
+	for(i = range->first_sequence; i < range->end_sequence; i++)
+	{
+		char * sequence = range->alignment->sequences[i];
+		int sequence_length = range->alignment->sequence_lengths[i];
+		// An empty sequence is all missing
+		range->missing_data_percentages[i] = sequence_length > 0 ? (double) count_missing_bases(sequence, sequence_length)*100/sequence_length : 100;
+		range->sequence_hashes[i] = hash_sequence_row(sequence, sequence_length, 0);
+	}
+	return NULL;
+}
+
+// Eight bases at a time, with n folded into N by setting the lower case bit
+int count_missing_bases(char * sequence, int sequence_length)
+{
+	int number_of_missing_bases = 0;
+	int i = 0;
+	for(; i + 8 <= sequence_length; i += 8)
+	{
+		uint64_t word;
+		memcpy(&word, sequence + i, sizeof(word));
+		number_of_missing_bases += count_matching_bytes(word | REPEATED_BYTES(0x20), REPEATED_BYTES('n'));
+		number_of_missing_bases += count_matching_bytes(word, REPEATED_BYTES('-'));
+	}
+	for(; i < sequence_length; i++)
+	{
+		number_of_missing_bases += (sequence[i] == 'n' || sequence[i] == 'N' || sequence[i] == '-');
+	}
+	return number_of_missing_bases;
+}
+
+// The bytes which are 0 after the xor have their high bit clear after adding 0x7f to their low 7 bits
+int count_matching_bytes(uint64_t word, uint64_t pattern)
+{
+	uint64_t difference = word ^ pattern;
+	uint64_t nonzero_bytes = ((difference & REPEATED_BYTES(0x7f)) + REPEATED_BYTES(0x7f)) | difference;
+	return __builtin_popcountll(~nonzero_bytes & REPEATED_BYTES(0x80));
+}
+
+// Sequences with the same hash are compared in full, and each is removed in favour of the last sequence it is identical to
+void flag_identical_sequences(loaded_alignment * alignment, uint64_t * sequence_hashes, int * is_removed)
+{
+	int i, j, k;
+	int number_of_sequences = alignment->number_of_sequences;
+	indexed_sequence_hash * sorted_hashes = (indexed_sequence_hash *) calloc(number_of_sequences+1, sizeof(indexed_sequence_hash));
+	int * kept_sequence = (int *) calloc(number_of_sequences+1, sizeof(int));
+	int * distinct_sequences = (int *) calloc(number_of_sequences+1, sizeof(int));
+	for(i = 0; i < number_of_sequences; i++)
+	{
+		sorted_hashes[i].hash = sequence_hashes[i];
+		sorted_hashes[i].sequence_index = i;
+		kept_sequence[i] = i;
+	}
+	qsort(sorted_hashes, number_of_sequences, sizeof(indexed_sequence_hash), compare_indexed_sequence_hashes);
+	
+	for(i = 0; i < number_of_sequences; i = j)
+	{
+		for(j = i + 1; j < number_of_sequences && sorted_hashes[j].hash == sorted_hashes[i].hash; j++);
+		
+		// From the last sequence back, so the one kept of each identical set is its last
+		int number_of_distinct_sequences = 0;
+		for(k = j - 1; k >= i; k--)
+		{
+			int sequence_index = sorted_hashes[k].sequence_index;
+			int distinct_index;
+			for(distinct_index = 0; distinct_index < number_of_distinct_sequences; distinct_index++)
+			{
+				int other_index = distinct_sequences[distinct_index];
+				if(alignment->sequence_lengths[other_index] == alignment->sequence_lengths[sequence_index] && memcmp(alignment->sequences[other_index], alignment->sequences[sequence_index], alignment->sequence_lengths[sequence_index]) == 0)
+				{
+					kept_sequence[sequence_index] = other_index;
+					is_removed[sequence_index] = 1;
+					break;
+				}
+			}
+			if(distinct_index == number_of_distinct_sequences)
+			{
+				distinct_sequences[number_of_distinct_sequences] = sequence_index;
+				number_of_distinct_sequences++;
+			}
+		}
+	}
+	
+	for(i = 0; i < number_of_sequences; i++)
+	{
+		if(is_removed[i])
+		{
+			printf("Sequences in %s and %s are identical, removing %s from analysis\n", alignment->sequence_names[i], alignment->sequence_names[kept_sequence[i]], alignment->sequence_names[i]);
+		}
+	}
+	free(sorted_hashes);
+	free(kept_sequence);
+	free(distinct_sequences);
+}
+
+// By hash and then by position, so identical sequences come out in the order of the alignment
+int compare_indexed_sequence_hashes(const void * a, const void * b)
+{
+	const indexed_sequence_hash * first = (const indexed_sequence_hash *) a;
+	const indexed_sequence_hash * second = (const indexed_sequence_hash *) b;
+	if(first->hash != second->hash)
+	{
+		return first->hash < second->hash ? -1 : 1;
+	}
+	return first->sequence_index - second->sequence_index;
+}
+
+// The rest of the name line after the name, which the loader leaves in place between the name and the sequence.
+// A cached alignment keeps the names apart from the sequences, so has no descriptions.
+size_t get_sequence_description_length(loaded_alignment * alignment, int sequence_index, char ** description)
+{
+	char * sequence_name = alignment->sequence_names[sequence_index];
+	char * start_of_description = sequence_name + strlen(sequence_name) + 1;
+	char * end_of_description = alignment->sequences[sequence_index] - 1;
+	*description = start_of_description;
+	if(alignment->sequence_lengths[sequence_index] == 0 || end_of_description <= start_of_description || memchr(start_of_description, '\n', end_of_description - start_of_description) != NULL)
+	{
+		return 0;
+	}
+	while(end_of_description > start_of_description && (end_of_description[-1] == '\r' || end_of_description[-1] == ' '))
+	{
+		end_of_description--;
+	}
+	return end_of_description - start_of_description;
+}
+
+size_t maximum_filtered_alignment_row_length(void * rows, int row_index)
+{
+	filtered_alignment_rows * filtered_rows = (filtered_alignment_rows *) rows;
+	int sequence_index = filtered_rows->sequence_indices[row_index];
+	char * description;
+	size_t description_length = get_sequence_description_length(filtered_rows->alignment, sequence_index, &description);
+	int sequence_length = filtered_rows->alignment->sequence_lengths[sequence_index];
+	return strlen(filtered_rows->alignment->sequence_names[sequence_index]) + description_length + 4 + sequence_length + sequence_length/FILTERED_ALIGNMENT_LINE_LENGTH;
+}
+
+// The name line, with any description after the name, and the bases with a newline every FILTERED_ALIGNMENT_LINE_LENGTH bases
+size_t format_filtered_alignment_row(void * rows, int row_index, char * destination)
+{
+	filtered_alignment_rows * filtered_rows = (filtered_alignment_rows *) rows;
+	int sequence_index = filtered_rows->sequence_indices[row_index];
+	char * sequence_name = filtered_rows->alignment->sequence_names[sequence_index];
+	char * sequence = filtered_rows->alignment->sequences[sequence_index];
+	int sequence_length = filtered_rows->alignment->sequence_lengths[sequence_index];
+	char * description;
+	size_t description_length = get_sequence_description_length(filtered_rows->alignment, sequence_index, &description);
+	size_t name_length = strlen(sequence_name);
+	size_t length = 0;
+	int base_counter;
+	
+	destination[length++] = '>';
+	memcpy(destination + length, sequence_name, name_length);
+	length += name_length;
+	if(description_length > 0)
+	{
+		destination[length++] = ' ';
+		memcpy(destination + length, description, description_length);
+		length += description_length;
+	}
+	destination[length++] = '\n';
+	for(base_counter = 0; base_counter < sequence_length; base_counter += FILTERED_ALIGNMENT_LINE_LENGTH)
+	{
+		int bases_on_line = sequence_length - base_counter < FILTERED_ALIGNMENT_LINE_LENGTH ? sequence_length - base_counter : FILTERED_ALIGNMENT_LINE_LENGTH;
+		memcpy(destination + length, sequence + base_counter, bases_on_line);
+		length += bases_on_line;
+		destination[length++] = '\n';
+	}
+	return length;
+}
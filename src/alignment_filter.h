@@ -0,0 +1,69 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _ALIGNMENT_FILTER_H_
+#define _ALIGNMENT_FILTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "alignment_file.h"
+
+// A share of the sequences of an alignment for one thread to count the missing bases of and hash
+typedef struct alignment_filter_range
+{
+	loaded_alignment * alignment;
+	int first_sequence;
+	int end_sequence;
+	double * missing_data_percentages;
+	uint64_t * sequence_hashes;
+} alignment_filter_range;
+
+// A sequence's hash with its position in the alignment, so they can be sorted together
+typedef struct indexed_sequence_hash
+{
+	uint64_t hash;
+	int sequence_index;
+} indexed_sequence_hash;
+
+// The records of an alignment which are kept, for write_rows
+typedef struct filtered_alignment_rows
+{
+	loaded_alignment * alignment;
+	int * sequence_indices;
+} filtered_alignment_rows;
+
+int filter_alignment_file(char input_filename[], char output_filename[], char removed_taxa_filename[], double filter_percentage, int remove_identical_sequences, int num_threads);
+void measure_sequences_in_parallel(loaded_alignment * alignment, double * missing_data_percentages, uint64_t * sequence_hashes, int num_threads);
+void * measure_sequences_in_range(void * range_pointer);
+int count_missing_bases(char * sequence, int sequence_length);
+int count_matching_bytes(uint64_t word, uint64_t pattern);
+void flag_identical_sequences(loaded_alignment * alignment, uint64_t * sequence_hashes, int * is_removed);
+int compare_indexed_sequence_hashes(const void * a, const void * b);
+size_t maximum_filtered_alignment_row_length(void * rows, int row_index);
+size_t format_filtered_alignment_row(void * rows, int row_index, char * destination);
+size_t get_sequence_description_length(loaded_alignment * alignment, int sequence_index, char ** description);
+
+#define FILTERED_ALIGNMENT_LINE_LENGTH 60
+#define ALIGNMENT_FILTER_OK 0
+#define ALIGNMENT_FILTER_TOO_FEW_SEQUENCES 1
+#define ALIGNMENT_FILTER_CANNOT_WRITE_OUTPUT 2
+#define ALIGNMENT_FILTER_CANNOT_WRITE_REMOVED_TAXA 3
+#define REPEATED_BYTES(x) ((uint64_t) (x) * 0x0101010101010101ULL)
+
+#endif
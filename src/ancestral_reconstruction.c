@@ -0,0 +1,444 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "ancestral_reconstruction.h"
+#include "parse_phylip.h"
+#include "seqUtil.h"
+#include "tree_scaling.h"
+
+// Set with set_ancestral_reconstruction, the internal nodes without a sequence are then reconstructed from the leaves
+int ancestral_reconstruction = ANCESTRAL_RECONSTRUCTION_NONE;
+static const char reconstructed_bases[4] = {'A','C','G','T'};
+
+void set_ancestral_reconstruction(int method)
+{
+	ancestral_reconstruction = method;
+}
+
+int get_ancestral_reconstruction()
+{
+	return ancestral_reconstruction;
+}
+
+int parse_ancestral_reconstruction(char * method_name)
+{
+	if(strcmp(method_name, "none") == 0 || strcmp(method_name, "external") == 0)
+	{
+		return ANCESTRAL_RECONSTRUCTION_NONE;
+	}
+	if(strcmp(method_name, "parsimony") == 0)
+	{
+		return ANCESTRAL_RECONSTRUCTION_PARSIMONY;
+	}
+	if(strcmp(method_name, "joint") == 0)
+	{
+		return ANCESTRAL_RECONSTRUCTION_JOINT;
+	}
+	printf("Unknown ancestral reconstruction '%s', the methods are external, parsimony and joint\n", method_name);
+	exit(1);
+}
+
+int index_of_base(char base)
+{
+	switch(toupper(base))
+	{
+		case 'A': return 0;
+		case 'C': return 1;
+		case 'G': return 2;
+		case 'T': return 3;
+		default: return -1;
+	}
+}
+
+// The loaded sequences are put back with the reconstructed internal nodes of the tree after them. The leaves have to be loaded,
+// and internal nodes without a name are reconstructed so their children have a parent, but arent kept.
+void reconstruct_missing_ancestral_sequences(char tree_filename[])
+{
+	int i;
+	if(ancestral_reconstruction == ANCESTRAL_RECONSTRUCTION_NONE)
+	{
+		return;
+	}
+	
+	seqMemInit();
+	char * tree_string = read_tree_file(tree_filename);
+	newick_node * root = parseTree(tree_string);
+	free(tree_string);
+	tree_traversal traversal;
+	build_tree_traversal(root, &traversal);
+	
+	int number_of_samples = number_of_samples_from_parse_phylip();
+	int number_of_columns = number_of_snps_in_phylip();
+	char ** sample_names = (char **) calloc(number_of_samples + traversal.number_of_nodes + 1, sizeof(char *));
+	char ** sample_sequences = (char **) calloc(number_of_samples + traversal.number_of_nodes + 1, sizeof(char *));
+	int * sequence_lengths = (int *) calloc(number_of_samples + traversal.number_of_nodes + 1, sizeof(int));
+	get_sample_names_from_parse_phylip(sample_names);
+	for(i = 0; i < number_of_samples; i++)
+	{
+		sample_sequences[i] = (char *) calloc(number_of_columns+1, sizeof(char));
+		get_sequence_for_sample_index(sample_sequences[i], i);
+		sequence_lengths[i] = number_of_columns;
+	}
+	
+	char ** node_sequences = (char **) calloc(traversal.number_of_nodes+1, sizeof(char *));
+	int * is_reconstructed = (int *) calloc(traversal.number_of_nodes+1, sizeof(int));
+	int number_of_reconstructed_samples = 0;
+	for(i = 0; i < traversal.number_of_nodes; i++)
+	{
+		newick_node * node = traversal.pre_order[i];
+		int sequence_index = node->taxon != NULL ? find_sequence_index_from_sample_name(node->taxon) : -1;
+		if(sequence_index >= 0)
+		{
+			node_sequences[i] = sample_sequences[sequence_index];
+		}
+		else if(node->childNum > 0)
+		{
+			node_sequences[i] = (char *) calloc(number_of_columns+1, sizeof(char));
+			is_reconstructed[i] = 1;
+			number_of_reconstructed_samples += node->taxon != NULL;
+		}
+	}
+	
+	if(number_of_reconstructed_samples > 0)
+	{
+		reconstruct_ancestral_sequences(&traversal, node_sequences, is_reconstructed, number_of_columns, ancestral_reconstruction);
+		int number_of_kept_samples = number_of_samples;
+		for(i = 0; i < traversal.number_of_nodes; i++)
+		{
+			if(is_reconstructed[i] && traversal.pre_order[i]->taxon != NULL)
+			{
+				sample_names[number_of_kept_samples] = traversal.pre_order[i]->taxon;
+				sample_sequences[number_of_kept_samples] = node_sequences[i];
+				sequence_lengths[number_of_kept_samples] = number_of_columns;
+				node_sequences[i] = NULL;
+				number_of_kept_samples++;
+			}
+		}
+		free_sample_statistics();
+		freeup_memory();
+		load_sequences_from_rows(sample_names, sample_sequences, sequence_lengths, number_of_kept_samples, number_of_columns);
+		for(i = number_of_samples; i < number_of_kept_samples; i++)
+		{
+			free(sample_sequences[i]);
+		}
+	}
+	
+	for(i = 0; i < traversal.number_of_nodes; i++)
+	{
+		if(is_reconstructed[i])
+		{
+			free(node_sequences[i]);
+		}
+	}
+	for(i = 0; i < number_of_samples; i++)
+	{
+		free(sample_sequences[i]);
+	}
+	free(node_sequences);
+	free(is_reconstructed);
+	free(sample_names);
+	free(sample_sequences);
+	free(sequence_lengths);
+	free_tree_traversal(&traversal);
+	cleanup_node_memory(root);
+	seqFreeAll();
+}
+
+// The sequences are in the pre-order of the traversal. Those which are reconstructed are written over, a NULL sequence has
+// nothing known about it, and the others are what was seen, where only A, C, G and T tell the reconstruction anything.
+void reconstruct_ancestral_sequences(tree_traversal * traversal, char ** node_sequences, int * is_reconstructed, int number_of_columns, int method)
+{
+	if(method == ANCESTRAL_RECONSTRUCTION_JOINT)
+	{
+		reconstruct_ancestral_sequences_with_joint_likelihood(traversal, node_sequences, is_reconstructed, number_of_columns);
+	}
+	else if(method == ANCESTRAL_RECONSTRUCTION_PARSIMONY)
+	{
+		reconstruct_ancestral_sequences_with_parsimony(traversal, node_sequences, is_reconstructed, number_of_columns);
+	}
+}
+
+void initialise_base_state_sets(base_state_sets * state_sets, int number_of_columns)
+{
+	int base;
+	state_sets->number_of_words = (number_of_columns + 63)/64;
+	for(base = 0; base < 4; base++)
+	{
+		state_sets->bases[base] = (uint64_t *) calloc(state_sets->number_of_words+1, sizeof(uint64_t));
+	}
+}
+
+// Anything other than A, C, G or T could be any of them, as could every column of a missing sequence
+void set_base_state_sets_from_sequence(base_state_sets * state_sets, char * sequence, int number_of_columns)
+{
+	int word_index, column, base;
+	for(word_index = 0; word_index < state_sets->number_of_words; word_index++)
+	{
+		uint64_t base_words[4] = {0, 0, 0, 0};
+		uint64_t any_base_word = 0;
+		int last_column = (word_index+1)*64 < number_of_columns ? (word_index+1)*64 : number_of_columns;
+		for(column = word_index*64; column < last_column; column++)
+		{
+			uint64_t bit = (uint64_t) 1 << (column - word_index*64);
+			int base_index = sequence != NULL ? index_of_base(sequence[column]) : -1;
+			if(base_index < 0)
+			{
+				any_base_word |= bit;
+			}
+			else
+			{
+				base_words[base_index] |= bit;
+			}
+		}
+		for(base = 0; base < 4; base++)
+		{
+			state_sets->bases[base][word_index] = base_words[base] | any_base_word;
+		}
+	}
+}
+
+void free_base_state_sets(base_state_sets * state_sets)
+{
+	int base;
+	for(base = 0; base < 4; base++)
+	{
+		free(state_sets->bases[base]);
+		state_sets->bases[base] = NULL;
+	}
+}
+
+// Fitch parsimony a word of 64 columns at a time. On the way up each node keeps the bases its children share, or all
+// of their bases where they share none. On the way down a node takes its parent's base if it can, otherwise its first base.
+void reconstruct_ancestral_sequences_with_parsimony(tree_traversal * traversal, char ** node_sequences, int * is_reconstructed, int number_of_columns)
+{
+	int i, word_index, base;
+	base_state_sets * state_sets = (base_state_sets *) calloc(traversal->number_of_nodes+1, sizeof(base_state_sets));
+	for(i = 0; i < traversal->number_of_nodes; i++)
+	{
+		newick_node * node = traversal->post_order[i];
+		int node_index = node->traversal_index;
+		base_state_sets * node_sets = &state_sets[node_index];
+		initialise_base_state_sets(node_sets, number_of_columns);
+		if(!is_reconstructed[node_index] || node->childNum == 0)
+		{
+			set_base_state_sets_from_sequence(node_sets, node_sequences[node_index], number_of_columns);
+			continue;
+		}
+		
+		newick_child * child = node->child;
+		for(base = 0; base < 4; base++)
+		{
+			memcpy(node_sets->bases[base], state_sets[child->node->traversal_index].bases[base], node_sets->number_of_words*sizeof(uint64_t));
+		}
+		for(child = child->next; child != NULL; child = child->next)
+		{
+			base_state_sets * child_sets = &state_sets[child->node->traversal_index];
+			for(word_index = 0; word_index < node_sets->number_of_words; word_index++)
+			{
+				uint64_t shared[4];
+				uint64_t any_shared = 0;
+				for(base = 0; base < 4; base++)
+				{
+					shared[base] = node_sets->bases[base][word_index] & child_sets->bases[base][word_index];
+					any_shared |= shared[base];
+				}
+				for(base = 0; base < 4; base++)
+				{
+					node_sets->bases[base][word_index] = shared[base] | ((node_sets->bases[base][word_index] | child_sets->bases[base][word_index]) & ~any_shared);
+				}
+			}
+		}
+	}
+	
+	// The sets are cut down to the one base chosen for each column, parents first
+	for(i = 0; i < traversal->number_of_nodes; i++)
+	{
+		newick_node * node = traversal->pre_order[i];
+		base_state_sets * node_sets = &state_sets[node->traversal_index];
+		base_state_sets * parent_sets = (node->parent != NULL) ? &state_sets[node->parent->traversal_index] : NULL;
+		for(word_index = 0; word_index < node_sets->number_of_words; word_index++)
+		{
+			uint64_t earlier_bases = 0;
+			uint64_t from_parent = 0;
+			uint64_t chosen[4];
+			for(base = 0; base < 4; base++)
+			{
+				chosen[base] = node_sets->bases[base][word_index] & ~earlier_bases;
+				earlier_bases |= node_sets->bases[base][word_index];
+				if(parent_sets != NULL)
+				{
+					from_parent |= node_sets->bases[base][word_index] & parent_sets->bases[base][word_index];
+				}
+			}
+			for(base = 0; base < 4; base++)
+			{
+				uint64_t parent_base = parent_sets != NULL ? node_sets->bases[base][word_index] & parent_sets->bases[base][word_index] : 0;
+				node_sets->bases[base][word_index] = parent_base | (chosen[base] & ~from_parent);
+			}
+		}
+		
+		if(is_reconstructed[node->traversal_index])
+		{
+			char * node_sequence = node_sequences[node->traversal_index];
+			for(base = 0; base < 4; base++)
+			{
+				for(word_index = 0; word_index < node_sets->number_of_words; word_index++)
+				{
+					uint64_t chosen_word = node_sets->bases[base][word_index];
+					while(chosen_word != 0)
+					{
+						node_sequence[word_index*64 + __builtin_ctzll(chosen_word)] = reconstructed_bases[base];
+						chosen_word &= chosen_word - 1;
+					}
+				}
+			}
+		}
+	}
+	
+	for(i = 0; i < traversal->number_of_nodes; i++)
+	{
+		free_base_state_sets(&state_sets[i]);
+	}
+	free(state_sets);
+}
+
+// The most likely bases of all the internal nodes together (Pupko et al. 2000), under the Jukes Cantor model with the
+// branch lengths of the tree. Each node keeps, for every base its parent could have, the best it can do below itself
+// and the base which does it, so the bases are then read off from the root down.
+void reconstruct_ancestral_sequences_with_joint_likelihood(tree_traversal * traversal, char ** node_sequences, int * is_reconstructed, int number_of_columns)
+{
+	int i, column, parent_base, base;
+	int number_of_nodes = traversal->number_of_nodes;
+	double * log_same_base = (double *) calloc(number_of_nodes+1, sizeof(double));
+	double * log_other_base = (double *) calloc(number_of_nodes+1, sizeof(double));
+	double * best_below = (double *) calloc(4*(number_of_nodes+1), sizeof(double));
+	char * best_base = (char *) calloc(4*(number_of_nodes+1), sizeof(char));
+	char * chosen_base = (char *) calloc(number_of_nodes+1, sizeof(char));
+	int * column_base = (int *) calloc(number_of_columns+1, sizeof(int));
+	for(i = 0; i < number_of_nodes; i++)
+	{
+		// A branch of length 0 would make any change impossible, rather than just unlikely
+		double branch_length = traversal->pre_order[i]->dist > MINIMUM_RECONSTRUCTION_BRANCH_LENGTH ? traversal->pre_order[i]->dist : MINIMUM_RECONSTRUCTION_BRANCH_LENGTH;
+		double decay = exp(-4.0*branch_length/3.0);
+		log_same_base[i] = log(0.25 + 0.75*decay);
+		log_other_base[i] = log(0.25 - 0.25*decay);
+	}
+	
+	// Where only one base is seen in a column every node is most likely to have it, which is most of an alignment
+	for(column = 0; column < number_of_columns; column++)
+	{
+		column_base[column] = NO_BASE_IN_COLUMN;
+	}
+	for(i = 0; i < number_of_nodes; i++)
+	{
+		if(is_reconstructed[i] || node_sequences[i] == NULL)
+		{
+			continue;
+		}
+		for(column = 0; column < number_of_columns; column++)
+		{
+			int seen_base = index_of_base(node_sequences[i][column]);
+			if(seen_base >= 0 && column_base[column] != seen_base)
+			{
+				column_base[column] = (column_base[column] == NO_BASE_IN_COLUMN) ? seen_base : MORE_THAN_ONE_BASE_IN_COLUMN;
+			}
+		}
+	}
+	
+	for(column = 0; column < number_of_columns; column++)
+	{
+		if(column_base[column] != MORE_THAN_ONE_BASE_IN_COLUMN)
+		{
+			for(i = 0; i < number_of_nodes; i++)
+			{
+				if(is_reconstructed[i])
+				{
+					node_sequences[i][column] = reconstructed_bases[column_base[column] == NO_BASE_IN_COLUMN ? 0 : column_base[column]];
+				}
+			}
+			continue;
+		}
+		
+		for(i = 0; i < number_of_nodes; i++)
+		{
+			newick_node * node = traversal->post_order[i];
+			int node_index = node->traversal_index;
+			double below[4] = {0, 0, 0, 0};
+			newick_child * child;
+			for(child = node->child; child != NULL; child = child->next)
+			{
+				for(base = 0; base < 4; base++)
+				{
+					below[base] += best_below[4*child->node->traversal_index + base];
+				}
+			}
+			
+			int seen_base = (!is_reconstructed[node_index] && node_sequences[node_index] != NULL) ? index_of_base(node_sequences[node_index][column]) : -1;
+			for(parent_base = 0; parent_base < 4; parent_base++)
+			{
+				// The root has no parent, so every base it could have starts out as likely
+				double best = -HUGE_VAL;
+				int best_choice = 0;
+				for(base = 0; base < 4; base++)
+				{
+					if(seen_base >= 0 && base != seen_base)
+					{
+						continue;
+					}
+					double log_likelihood = below[base];
+					if(node->parent != NULL)
+					{
+						log_likelihood += (base == parent_base) ? log_same_base[node_index] : log_other_base[node_index];
+					}
+					if(log_likelihood > best)
+					{
+						best = log_likelihood;
+						best_choice = base;
+					}
+				}
+				// A leaf with nothing known about it says nothing about its parent
+				best_below[4*node_index + parent_base] = (node->childNum == 0 && seen_base < 0) ? 0 : best;
+				best_base[4*node_index + parent_base] = best_choice;
+			}
+		}
+		
+		for(i = 0; i < number_of_nodes; i++)
+		{
+			newick_node * node = traversal->pre_order[i];
+			int from_base = (node->parent != NULL) ? chosen_base[node->parent->traversal_index] : 0;
+			chosen_base[i] = best_base[4*i + from_base];
+			if(is_reconstructed[i])
+			{
+				node_sequences[i][column] = reconstructed_bases[(int) chosen_base[i]];
+			}
+		}
+	}
+	
+	free(log_same_base);
+	free(log_other_base);
+	free(best_below);
+	free(best_base);
+	free(chosen_base);
+	free(column_base);
+}
@@ -0,0 +1,52 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _ANCESTRAL_RECONSTRUCTION_H_
+#define _ANCESTRAL_RECONSTRUCTION_H_
+#include <stdint.h>
+#include "Newickform.h"
+#include "tree_traversal.h"
+
+// The A, C, G and T which each node can have, as one bit per column for each base, 64 columns to a word
+typedef struct base_state_sets
+{
+	uint64_t * bases[4];
+	int number_of_words;
+} base_state_sets;
+
+void set_ancestral_reconstruction(int method);
+int get_ancestral_reconstruction();
+int parse_ancestral_reconstruction(char * method_name);
+void reconstruct_missing_ancestral_sequences(char tree_filename[]);
+void reconstruct_ancestral_sequences(tree_traversal * traversal, char ** node_sequences, int * is_reconstructed, int number_of_columns, int method);
+void reconstruct_ancestral_sequences_with_parsimony(tree_traversal * traversal, char ** node_sequences, int * is_reconstructed, int number_of_columns);
+void reconstruct_ancestral_sequences_with_joint_likelihood(tree_traversal * traversal, char ** node_sequences, int * is_reconstructed, int number_of_columns);
+void initialise_base_state_sets(base_state_sets * state_sets, int number_of_columns);
+void set_base_state_sets_from_sequence(base_state_sets * state_sets, char * sequence, int number_of_columns);
+void free_base_state_sets(base_state_sets * state_sets);
+int index_of_base(char base);
+
+#define ANCESTRAL_RECONSTRUCTION_NONE 0
+#define ANCESTRAL_RECONSTRUCTION_PARSIMONY 1
+#define ANCESTRAL_RECONSTRUCTION_JOINT 2
+#define MINIMUM_RECONSTRUCTION_BRANCH_LENGTH 0.000001
+#define NO_BASE_IN_COLUMN -2
+#define MORE_THAN_ONE_BASE_IN_COLUMN -1
+
+#endif
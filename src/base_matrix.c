@@ -0,0 +1,153 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "base_matrix.h"
+#include "matrix_storage.h"
+
+#if defined(__SSE2__)
+#define SSE2_TRANSPOSE
+#include <emmintrin.h>
+#endif
+
+void allocate_base_matrix(char ** rows, int number_of_rows, int number_of_columns)
+{
+	int i;
+	if(number_of_rows <= 0)
+	{
+		return;
+	}
+	char * bases = (char *) allocate_matrix_storage((size_t) number_of_rows*(number_of_columns+1));
+	for(i = 0; i < number_of_rows; i++)
+	{
+		rows[i] = bases + (size_t) i*(number_of_columns+1);
+	}
+}
+
+void free_base_matrix(char ** rows, int number_of_rows)
+{
+	if(number_of_rows > 0)
+	{
+		free_matrix_storage(rows[0]);
+	}
+}
+
+// destination_rows[column][row] = source_rows[row][column], done a tile at a time so both sides stay in cache
+void transpose_base_matrix(char ** source_rows, int number_of_rows, int number_of_columns, char ** destination_rows)
+{
+	transpose_base_matrix_rows(source_rows, 0, number_of_rows, number_of_columns, destination_rows);
+}
+
+// Each thread transposes its own band of source rows, which is a band of columns in every destination row.
+// The bands are a multiple of a cache line wide, so threads only share the lines at the edges of their bands.
+void transpose_base_matrix_in_parallel(char ** source_rows, int number_of_rows, int number_of_columns, char ** destination_rows, int num_threads)
+{
+	int i;
+	int rows_per_band = num_threads > 1 ? (number_of_rows + num_threads - 1)/num_threads : number_of_rows;
+	rows_per_band = (rows_per_band + BASE_MATRIX_BAND_ALIGNMENT - 1)/BASE_MATRIX_BAND_ALIGNMENT*BASE_MATRIX_BAND_ALIGNMENT;
+	if(rows_per_band >= number_of_rows)
+	{
+		transpose_base_matrix(source_rows, number_of_rows, number_of_columns, destination_rows);
+		return;
+	}
+	
+	int number_of_bands = (number_of_rows + rows_per_band - 1)/rows_per_band;
+	base_matrix_band * bands = (base_matrix_band *) calloc(number_of_bands, sizeof(base_matrix_band));
+	pthread_t * threads = (pthread_t *) calloc(number_of_bands, sizeof(pthread_t));
+	for(i = 0; i < number_of_bands; i++)
+	{
+		bands[i].source_rows = source_rows;
+		bands[i].first_row = i*rows_per_band;
+		bands[i].end_row = (i+1)*rows_per_band < number_of_rows ? (i+1)*rows_per_band : number_of_rows;
+		bands[i].number_of_columns = number_of_columns;
+		bands[i].destination_rows = destination_rows;
+		pthread_create(&threads[i], NULL, transpose_base_matrix_band, &bands[i]);
+	}
+	for(i = 0; i < number_of_bands; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+	free(bands);
+}
+
+void * transpose_base_matrix_band(void * band_pointer)
+{
+	base_matrix_band * band = (base_matrix_band *) band_pointer;
+	transpose_base_matrix_rows(band->source_rows, band->first_row, band->end_row, band->number_of_columns, band->destination_rows);
+	return NULL;
+}
+
+void transpose_base_matrix_rows(char ** source_rows, int first_source_row, int end_source_row, int number_of_columns, char ** destination_rows)
+{
+	int first_row, first_column;
+	for(first_row = first_source_row; first_row < end_source_row; first_row += BASE_MATRIX_TILE_SIZE)
+	{
+		int rows_in_tile = end_source_row - first_row < BASE_MATRIX_TILE_SIZE ? end_source_row - first_row : BASE_MATRIX_TILE_SIZE;
+		for(first_column = 0; first_column < number_of_columns; first_column += BASE_MATRIX_TILE_SIZE)
+		{
+			int columns_in_tile = number_of_columns - first_column < BASE_MATRIX_TILE_SIZE ? number_of_columns - first_column : BASE_MATRIX_TILE_SIZE;
+			transpose_base_tile(source_rows, first_row, first_column, rows_in_tile, columns_in_tile, destination_rows);
+		}
+	}
+}
+
+void transpose_base_tile(char ** source_rows, int first_row, int first_column, int number_of_rows, int number_of_columns, char ** destination_rows)
+{
+	int i, j;
+#ifdef SSE2_TRANSPOSE
+	if(number_of_rows == BASE_MATRIX_TILE_SIZE && number_of_columns == BASE_MATRIX_TILE_SIZE)
+	{
+		__m128i tile[BASE_MATRIX_TILE_SIZE];
+		__m128i interleaved[BASE_MATRIX_TILE_SIZE];
+		int round;
+		for(i = 0; i < BASE_MATRIX_TILE_SIZE; i++)
+		{
+			tile[i] = _mm_loadu_si128((__m128i *) (source_rows[first_row + i] + first_column));
+		}
+		// Interleaving row i with row i+8 four times over moves the row index into the byte index and back
+		for(round = 0; round < 4; round++)
+		{
+			for(i = 0; i < BASE_MATRIX_TILE_SIZE/2; i++)
+			{
+				interleaved[2*i] = _mm_unpacklo_epi8(tile[i], tile[i + BASE_MATRIX_TILE_SIZE/2]);
+				interleaved[2*i+1] = _mm_unpackhi_epi8(tile[i], tile[i + BASE_MATRIX_TILE_SIZE/2]);
+			}
+			for(i = 0; i < BASE_MATRIX_TILE_SIZE; i++)
+			{
+				tile[i] = interleaved[i];
+			}
+		}
+		for(i = 0; i < BASE_MATRIX_TILE_SIZE; i++)
+		{
+			_mm_storeu_si128((__m128i *) (destination_rows[first_column + i] + first_row), tile[i]);
+		}
+		return;
+	}
+#endif
+	for(i = 0; i < number_of_rows; i++)
+	{
+		for(j = 0; j < number_of_columns; j++)
+		{
+			destination_rows[first_column + j][first_row + i] = source_rows[first_row + i][first_column + j];
+		}
+	}
+}
@@ -0,0 +1,46 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _BASE_MATRIX_H_
+#define _BASE_MATRIX_H_
+
+// A matrix of bases is a list of row pointers into one contiguous block, with each row terminated by a '\0'.
+// The block comes from the matrix storage, so it is mapped from a file if it doesnt fit in the memory budget.
+void allocate_base_matrix(char ** rows, int number_of_rows, int number_of_columns);
+void free_base_matrix(char ** rows, int number_of_rows);
+// The rows of the source which one thread transposes
+typedef struct base_matrix_band
+{
+	char ** source_rows;
+	int first_row;
+	int end_row;
+	int number_of_columns;
+	char ** destination_rows;
+} base_matrix_band;
+
+void transpose_base_matrix(char ** source_rows, int number_of_rows, int number_of_columns, char ** destination_rows);
+void transpose_base_matrix_in_parallel(char ** source_rows, int number_of_rows, int number_of_columns, char ** destination_rows, int num_threads);
+void * transpose_base_matrix_band(void * band_pointer);
+void transpose_base_matrix_rows(char ** source_rows, int first_source_row, int end_source_row, int number_of_columns, char ** destination_rows);
+void transpose_base_tile(char ** source_rows, int first_row, int first_column, int number_of_rows, int number_of_columns, char ** destination_rows);
+
+#define BASE_MATRIX_TILE_SIZE 16
+#define BASE_MATRIX_BAND_ALIGNMENT 64
+
+#endif
@@ -0,0 +1,216 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "bgzf_file.h"
+#include "profile.h"
+
+int compress_output_files = 0;
+int output_compression_threads = 1;
+
+// The end of file marker is an empty block
+static const unsigned char bgzf_end_of_file_block[28] = {
+	0x1f, 0x8b, 0x08, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0x06, 0x00, 0x42, 0x43, 0x02, 0x00,
+	0x1b, 0x00, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+
+void set_output_compression(int compress, int num_threads)
+{
+	compress_output_files = compress;
+	output_compression_threads = (num_threads < 1) ? 1 : num_threads;
+}
+
+// A plain file normally, or a stream which BGZF compresses everything written to it
+FILE * open_output_file(char filename[])
+{
+	FILE * file_pointer = fopen(filename, "w");
+	record_profile_output_file(filename);
+	if(compress_output_files == 0 || file_pointer == NULL)
+	{
+		return file_pointer;
+	}
+	
+	cookie_io_functions_t bgzf_functions = {NULL, write_bgzf_file, NULL, close_bgzf_file};
+	FILE * compressed_file_pointer = fopencookie(open_bgzf_file(file_pointer, output_compression_threads), "w", bgzf_functions);
+	if(compressed_file_pointer == NULL)
+	{
+		printf("Cannot open compressed output file '%s'\n", filename);
+		exit(1);
+	}
+	return compressed_file_pointer;
+}
+
+bgzf_file * open_bgzf_file(FILE * file_pointer, int num_threads)
+{
+	int i;
+	bgzf_file * compressed_file = (bgzf_file *) calloc(1, sizeof(bgzf_file));
+	compressed_file->file_pointer = file_pointer;
+	compressed_file->num_threads = num_threads;
+	compressed_file->capacity = (size_t) num_threads*BGZF_BLOCK_DATA_SIZE;
+	compressed_file->uncompressed = (char *) malloc(compressed_file->capacity);
+	compressed_file->blocks = (bgzf_block *) calloc(num_threads, sizeof(bgzf_block));
+	for(i = 0; i < num_threads; i++)
+	{
+		compressed_file->blocks[i].compressed = (unsigned char *) malloc(BGZF_MAX_BLOCK_SIZE);
+	}
+	return compressed_file;
+}
+
+ssize_t write_bgzf_file(void * cookie, const char * data, size_t size)
+{
+	bgzf_file * compressed_file = (bgzf_file *) cookie;
+	size_t bytes_written = 0;
+	while(bytes_written < size)
+	{
+		size_t bytes_to_copy = compressed_file->capacity - compressed_file->uncompressed_length;
+		if(bytes_to_copy > size - bytes_written)
+		{
+			bytes_to_copy = size - bytes_written;
+		}
+		memcpy(compressed_file->uncompressed + compressed_file->uncompressed_length, data + bytes_written, bytes_to_copy);
+		compressed_file->uncompressed_length += bytes_to_copy;
+		bytes_written += bytes_to_copy;
+		
+		if(compressed_file->uncompressed_length == compressed_file->capacity)
+		{
+			compress_bgzf_blocks(compressed_file);
+		}
+	}
+	return size;
+}
+
+int close_bgzf_file(void * cookie)
+{
+	int i;
+	bgzf_file * compressed_file = (bgzf_file *) cookie;
+	compress_bgzf_blocks(compressed_file);
+	fwrite(bgzf_end_of_file_block, 1, sizeof(bgzf_end_of_file_block), compressed_file->file_pointer);
+	int status = fclose(compressed_file->file_pointer);
+	
+	for(i = 0; i < compressed_file->num_threads; i++)
+	{
+		free(compressed_file->blocks[i].compressed);
+	}
+	free(compressed_file->blocks);
+	free(compressed_file->uncompressed);
+	free(compressed_file);
+	return status;
+}
+
+// Split whatever is waiting into blocks, compress them at the same time and write them out in order
+void compress_bgzf_blocks(bgzf_file * compressed_file)
+{
+	int i;
+	int number_of_blocks = 0;
+	size_t offset;
+	pthread_t threads[compressed_file->num_threads];
+	
+	for(offset = 0; offset < compressed_file->uncompressed_length; offset += BGZF_BLOCK_DATA_SIZE)
+	{
+		bgzf_block * block = &compressed_file->blocks[number_of_blocks];
+		block->uncompressed = compressed_file->uncompressed + offset;
+		block->uncompressed_length = compressed_file->uncompressed_length - offset;
+		if(block->uncompressed_length > BGZF_BLOCK_DATA_SIZE)
+		{
+			block->uncompressed_length = BGZF_BLOCK_DATA_SIZE;
+		}
+		number_of_blocks++;
+	}
+	
+	for(i = 1; i < number_of_blocks; i++)
+	{
+		pthread_create(&threads[i], NULL, compress_bgzf_block, &compressed_file->blocks[i]);
+	}
+	if(number_of_blocks > 0)
+	{
+		compress_bgzf_block(&compressed_file->blocks[0]);
+	}
+	for(i = 1; i < number_of_blocks; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+	
+	for(i = 0; i < number_of_blocks; i++)
+	{
+		fwrite(compressed_file->blocks[i].compressed, 1, compressed_file->blocks[i].compressed_length, compressed_file->file_pointer);
+	}
+	compressed_file->uncompressed_length = 0;
+}
+
+void * compress_bgzf_block(void * block)
+{
+	bgzf_block * current_block = (bgzf_block *) block;
+	unsigned char * compressed = current_block->compressed;
+	size_t compressed_data_length = deflate_bgzf_data(current_block, Z_DEFAULT_COMPRESSION);
+	
+	// Data which doesnt compress is stored instead, which always fits in a block
+	if(compressed_data_length == 0)
+	{
+		compressed_data_length = deflate_bgzf_data(current_block, Z_NO_COMPRESSION);
+		if(compressed_data_length == 0)
+		{
+			printf("Cannot compress the output\n");
+			exit(1);
+		}
+	}
+	current_block->compressed_length = BGZF_HEADER_SIZE + compressed_data_length + BGZF_FOOTER_SIZE;
+	
+	// gzip header with the BC extra field giving the size of the block
+	memcpy(compressed, bgzf_end_of_file_block, 16);
+	compressed[16] = (current_block->compressed_length - 1) & 0xff;
+	compressed[17] = ((current_block->compressed_length - 1) >> 8) & 0xff;
+	
+	unsigned long crc = crc32(0L, (Bytef *) current_block->uncompressed, current_block->uncompressed_length);
+	unsigned char * footer = compressed + BGZF_HEADER_SIZE + compressed_data_length;
+	write_little_endian_integer(footer, crc);
+	write_little_endian_integer(footer + 4, current_block->uncompressed_length);
+	return NULL;
+}
+
+// Returns the number of deflated bytes, or 0 if they didnt fit in a block
+size_t deflate_bgzf_data(bgzf_block * block, int compression_level)
+{
+	z_stream stream;
+	int status;
+	memset(&stream, 0, sizeof(stream));
+	if(deflateInit2(&stream, compression_level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		printf("Cannot initialise the compressor\n");
+		exit(1);
+	}
+	stream.next_in = (Bytef *) block->uncompressed;
+	stream.avail_in = block->uncompressed_length;
+	stream.next_out = block->compressed + BGZF_HEADER_SIZE;
+	stream.avail_out = BGZF_MAX_BLOCK_SIZE - BGZF_HEADER_SIZE - BGZF_FOOTER_SIZE;
+	status = deflate(&stream, Z_FINISH);
+	deflateEnd(&stream);
+	return (status == Z_STREAM_END) ? stream.total_out : 0;
+}
+
+void write_little_endian_integer(unsigned char * destination, unsigned long value)
+{
+	destination[0] = value & 0xff;
+	destination[1] = (value >> 8) & 0xff;
+	destination[2] = (value >> 16) & 0xff;
+	destination[3] = (value >> 24) & 0xff;
+}
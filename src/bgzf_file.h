@@ -0,0 +1,61 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _BGZF_FILE_H_
+#define _BGZF_FILE_H_
+
+#include <stdio.h>
+#include <sys/types.h>
+
+// BGZF is gzip made of independent blocks of at most 64KB, so it can be compressed a block per thread
+// and still be read back by anything which reads gzip, including kseq and the vcf reader.
+typedef struct bgzf_block
+{
+	char * uncompressed;
+	size_t uncompressed_length;
+	unsigned char * compressed;
+	size_t compressed_length;
+} bgzf_block;
+
+typedef struct bgzf_file
+{
+	FILE * file_pointer;
+	int num_threads;
+	char * uncompressed;
+	size_t uncompressed_length;
+	size_t capacity;
+	bgzf_block * blocks;
+} bgzf_file;
+
+void set_output_compression(int compress, int num_threads);
+FILE * open_output_file(char filename[]);
+bgzf_file * open_bgzf_file(FILE * file_pointer, int num_threads);
+ssize_t write_bgzf_file(void * cookie, const char * data, size_t size);
+int close_bgzf_file(void * cookie);
+void compress_bgzf_blocks(bgzf_file * compressed_file);
+void * compress_bgzf_block(void * block);
+size_t deflate_bgzf_data(bgzf_block * block, int compression_level);
+void write_little_endian_integer(unsigned char * destination, unsigned long value);
+
+#define BGZF_BLOCK_DATA_SIZE 65280
+#define BGZF_MAX_BLOCK_SIZE 65536
+#define BGZF_HEADER_SIZE 18
+#define BGZF_FOOTER_SIZE 8
+
+#endif
@@ -0,0 +1,165 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *  
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <pthread.h>
+#include "binomial_statistics.h"
+
+// Tables used by the binomial tests in calculate_cutoff and p_value_test.
+//
+// log10(n!) is taken from lgamma rather than summing log10(x) term by term as reduce_factorial does. The two
+// agree to within about 1e-11 in log10 for genome sized n, so the binomial terms agree to a relative error of
+// around 1e-10. A cutoff or p-value test can only come out differently if the tail sum is that close to the
+// threshold.
+
+double * log10_factorial_table;
+int log10_factorial_table_size;
+
+cutoff_cache_entry * cutoff_cache;
+int cutoff_cache_size;
+int cutoff_cache_entries;
+pthread_mutex_t cutoff_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Build the table before any threads are started. Values outside it are calculated directly.
+void initialise_log_factorial_table(int maximum_value)
+{
+	int i;
+	free(log10_factorial_table);
+	log10_factorial_table_size = maximum_value + 1;
+	log10_factorial_table = (double *) calloc(log10_factorial_table_size, sizeof(double));
+	for(i = 0; i < log10_factorial_table_size; i++)
+	{
+		log10_factorial_table[i] = lgamma(i + 1.0)/log(10.0);
+	}
+}
+
+double log10_factorial(int n)
+{
+	if(n < log10_factorial_table_size)
+	{
+		return log10_factorial_table[n];
+	}
+	return lgamma(n + 1.0)/log(10.0);
+}
+
+// Equivalent to reduce_factorial(n,k) - reduce_factorial(k,k), including its results when k is larger than n
+double log10_binomial_coefficient(int n, int k)
+{
+	if(k <= 0)
+	{
+		return 0.0;
+	}
+	else if(k == n + 1)
+	{
+		return -INFINITY;
+	}
+	else if(k > n + 1)
+	{
+		return NAN;
+	}
+	return log10_factorial(n) - log10_factorial(n - k) - log10_factorial(k);
+}
+
+unsigned int hash_cutoff_key(int branch_genome_size, int window_size, int num_branch_snps)
+{
+	unsigned int hash = (unsigned int) branch_genome_size;
+	hash = hash*31u + (unsigned int) window_size;
+	hash = hash*31u + (unsigned int) num_branch_snps;
+	return hash ^ (hash >> 16);
+}
+
+int find_cached_cutoff(int branch_genome_size, int window_size, int num_branch_snps, int * cutoff)
+{
+	int found = 0;
+	pthread_mutex_lock(&cutoff_cache_lock);
+	if(cutoff_cache != NULL)
+	{
+		int i = hash_cutoff_key(branch_genome_size, window_size, num_branch_snps) % cutoff_cache_size;
+		while(cutoff_cache[i].used == 1)
+		{
+			if(cutoff_cache[i].branch_genome_size == branch_genome_size && cutoff_cache[i].window_size == window_size && cutoff_cache[i].num_branch_snps == num_branch_snps)
+			{
+				*cutoff = cutoff_cache[i].cutoff;
+				found = 1;
+				break;
+			}
+			i = (i + 1) % cutoff_cache_size;
+		}
+	}
+	pthread_mutex_unlock(&cutoff_cache_lock);
+	return found;
+}
+
+int insert_cutoff_into_cache(cutoff_cache_entry * cache, int cache_size, cutoff_cache_entry * entry)
+{
+	int i = hash_cutoff_key(entry->branch_genome_size, entry->window_size, entry->num_branch_snps) % cache_size;
+	while(cache[i].used == 1)
+	{
+		if(cache[i].branch_genome_size == entry->branch_genome_size && cache[i].window_size == entry->window_size && cache[i].num_branch_snps == entry->num_branch_snps)
+		{
+			return 0;
+		}
+		i = (i + 1) % cache_size;
+	}
+	cache[i] = *entry;
+	cache[i].used = 1;
+	return 1;
+}
+
+// The cache is kept at most half full, doubling in size when needed
+void add_cached_cutoff(int branch_genome_size, int window_size, int num_branch_snps, int cutoff)
+{
+	int i;
+	cutoff_cache_entry entry = {branch_genome_size, window_size, num_branch_snps, cutoff, 1};
+	
+	pthread_mutex_lock(&cutoff_cache_lock);
+	if(cutoff_cache == NULL || (cutoff_cache_entries + 1)*2 > cutoff_cache_size)
+	{
+		int new_cache_size = (cutoff_cache == NULL) ? INITIAL_CUTOFF_CACHE_SIZE : cutoff_cache_size*2;
+		cutoff_cache_entry * new_cache = (cutoff_cache_entry *) calloc(new_cache_size, sizeof(cutoff_cache_entry));
+		for(i = 0; i < cutoff_cache_size && cutoff_cache != NULL; i++)
+		{
+			if(cutoff_cache[i].used == 1)
+			{
+				insert_cutoff_into_cache(new_cache, new_cache_size, &cutoff_cache[i]);
+			}
+		}
+		free(cutoff_cache);
+		cutoff_cache = new_cache;
+		cutoff_cache_size = new_cache_size;
+	}
+	cutoff_cache_entries += insert_cutoff_into_cache(cutoff_cache, cutoff_cache_size, &entry);
+	pthread_mutex_unlock(&cutoff_cache_lock);
+}
+
+void free_binomial_statistics()
+{
+	free(log10_factorial_table);
+	log10_factorial_table = NULL;
+	log10_factorial_table_size = 0;
+	
+	pthread_mutex_lock(&cutoff_cache_lock);
+	free(cutoff_cache);
+	cutoff_cache = NULL;
+	cutoff_cache_size = 0;
+	cutoff_cache_entries = 0;
+	pthread_mutex_unlock(&cutoff_cache_lock);
+}
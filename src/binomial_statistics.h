@@ -0,0 +1,43 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *  
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _BINOMIAL_STATISTICS_H_
+#define _BINOMIAL_STATISTICS_H_
+
+typedef struct cutoff_cache_entry
+{
+	int branch_genome_size;
+	int window_size;
+	int num_branch_snps;
+	int cutoff;
+	int used;
+} cutoff_cache_entry;
+
+void initialise_log_factorial_table(int maximum_value);
+double log10_factorial(int n);
+double log10_binomial_coefficient(int n, int k);
+int find_cached_cutoff(int branch_genome_size, int window_size, int num_branch_snps, int * cutoff);
+int insert_cutoff_into_cache(cutoff_cache_entry * cache, int cache_size, cutoff_cache_entry * entry);
+void add_cached_cutoff(int branch_genome_size, int window_size, int num_branch_snps, int cutoff);
+unsigned int hash_cutoff_key(int branch_genome_size, int window_size, int num_branch_snps);
+void free_binomial_statistics();
+
+#define INITIAL_CUTOFF_CACHE_SIZE 1024
+
+#endif
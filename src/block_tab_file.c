@@ -20,10 +20,24 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <pthread.h>
 #include "block_tab_file.h"
+#include "branch_snp_columns.h"
 
-void print_block_details(FILE * block_file_pointer, int start_coordinate, int end_coordinate, int number_of_snps, char * current_node_id, char * parent_node_id, char * taxon_names, int number_of_child_nodes, double  neg_log_likelihood)
+// The hashes of every taxon and coordinates of the blocks printed since the last reset. They are added up so
+// the fingerprint doesnt depend on the order the branches were scanned in, or on which thread.
+uint64_t recombination_fingerprint = 0;
+int number_of_fingerprinted_recombinations = 0;
+pthread_mutex_t recombination_fingerprint_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Without a tab file the block still goes into the fingerprint, which is always written
+void print_block_details(FILE * block_file_pointer, int start_coordinate, int end_coordinate, int number_of_snps, char * current_node_id, char * parent_node_id, taxon_set * taxa, int number_of_child_nodes, double  neg_log_likelihood)
 {
+  add_taxa_to_recombination_fingerprint(start_coordinate, end_coordinate, taxa);
+  if(block_file_pointer == NULL)
+  {
+  	return;
+  }
   fprintf(block_file_pointer, "FT   misc_feature    %d..%d\n", start_coordinate, end_coordinate);
   fprintf(block_file_pointer, "FT                   /node=\"%s->%s\"\n",parent_node_id,current_node_id);
   fprintf(block_file_pointer, "FT                   /neg_log_likelihood=\"%f\"\n",neg_log_likelihood);
@@ -36,13 +50,136 @@ void print_block_details(FILE * block_file_pointer, int start_coordinate, int en
 	{
 		fprintf(block_file_pointer, "FT                   /colour=\"4\"\n");
 	}
-  fprintf(block_file_pointer, "FT                   /taxa=\"%s\"\n",taxon_names);
+  fprintf(block_file_pointer, "FT                   /taxa=\"");
+  print_taxon_names(block_file_pointer, taxa);
+  fprintf(block_file_pointer, "\"\n");
   fprintf(block_file_pointer, "FT                   /SNP_count=\"%d\"\n",number_of_snps);
   fflush(block_file_pointer);
 }
 
+void reset_recombination_fingerprint()
+{
+	pthread_mutex_lock(&recombination_fingerprint_lock);
+	recombination_fingerprint = 0;
+	number_of_fingerprinted_recombinations = 0;
+	pthread_mutex_unlock(&recombination_fingerprint_lock);
+}
+
+// Each taxon in the block counts separately, as the driver compares the coordinates of each taxon
+void add_block_to_recombination_fingerprint(int start_coordinate, int end_coordinate, char * taxon_names)
+{
+	int number_of_taxa = 0;
+	uint64_t block_hash = hash_recombinations_of_taxon_names(taxon_names, start_coordinate, end_coordinate, &number_of_taxa);
+	
+	pthread_mutex_lock(&recombination_fingerprint_lock);
+	recombination_fingerprint += block_hash;
+	number_of_fingerprinted_recombinations += number_of_taxa;
+	pthread_mutex_unlock(&recombination_fingerprint_lock);
+}
+
+// The same as adding the names of the set, without writing them out
+void add_taxa_to_recombination_fingerprint(int start_coordinate, int end_coordinate, taxon_set * taxa)
+{
+	uint64_t block_hash = 0;
+	int number_of_taxa = 0;
+	int i;
+	for(i = taxa->first_leaf; i < taxa->first_leaf + taxa->number_of_leaves; i++)
+	{
+		block_hash += hash_recombinations_of_taxon_names(taxa->leaves->taxa[i], start_coordinate, end_coordinate, &number_of_taxa);
+	}
+	
+	pthread_mutex_lock(&recombination_fingerprint_lock);
+	recombination_fingerprint += block_hash;
+	number_of_fingerprinted_recombinations += number_of_taxa;
+	pthread_mutex_unlock(&recombination_fingerprint_lock);
+}
+
+// Names with spaces in them count as one taxon for each word, as the driver splits the names on spaces
+uint64_t hash_recombinations_of_taxon_names(char * taxon_names, int start_coordinate, int end_coordinate, int * number_of_taxa)
+{
+	uint64_t hash = 0;
+	char * taxon = taxon_names;
+	while(*taxon != '\0')
+	{
+		if(*taxon == ' ')
+		{
+			taxon++;
+			continue;
+		}
+		size_t taxon_length = strcspn(taxon, " ");
+		hash += hash_recombination(taxon, taxon_length, start_coordinate, end_coordinate);
+		(*number_of_taxa)++;
+		taxon += taxon_length;
+	}
+	return hash;
+}
+
+// FNV-1a over the name then the coordinates, with a final mix so that sums of the hashes dont cancel out
+uint64_t hash_recombination(char * taxon, size_t taxon_length, int start_coordinate, int end_coordinate)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	size_t i;
+	for(i = 0; i < taxon_length; i++)
+	{
+		hash ^= (unsigned char) taxon[i];
+		hash *= 1099511628211ULL;
+	}
+	hash ^= (uint64_t)(uint32_t) start_coordinate;
+	hash *= 1099511628211ULL;
+	hash ^= (uint64_t)(uint32_t) end_coordinate << 32;
+	hash *= 1099511628211ULL;
+	
+	hash ^= hash >> 30;
+	hash *= 0xbf58476d1ce4e5b9ULL;
+	hash ^= hash >> 27;
+	hash *= 0x94d049bb133111ebULL;
+	hash ^= hash >> 31;
+	return hash;
+}
+
+uint64_t get_recombination_fingerprint()
+{
+	return recombination_fingerprint;
+}
+
+// The fingerprint and the number of taxon recombinations behind it, on one line. Files with different
+// fingerprints never have the same recombinations, so only those with the same need to be compared in full.
+void write_recombination_fingerprint(char filename[])
+{
+	FILE * fingerprint_file_pointer = fopen(filename, "w");
+	if(fingerprint_file_pointer == NULL)
+	{
+		printf("Cannot write the recombination fingerprint to '%s'\n", filename);
+		exit(1);
+	}
+	fprintf(fingerprint_file_pointer, "%016llx %d\n", (unsigned long long) recombination_fingerprint, number_of_fingerprinted_recombinations);
+	fclose(fingerprint_file_pointer);
+}
+
+
+void print_branch_snp_details(FILE * branch_snps_file_pointer, char * current_node_id, char * parent_node_id, int * branches_snp_sites, int number_of_branch_snps, char * branch_snp_sequence, char * branch_snp_ancestor_sequence, taxon_set * taxa)
+{
+	if(branch_snps_file_pointer == NULL)
+	{
+		return;
+	}
+	if(get_binary_branch_snps())
+	{
+		add_branch_snps_to_columns(current_node_id, parent_node_id, branches_snp_sites, number_of_branch_snps, branch_snp_sequence, branch_snp_ancestor_sequence, taxa);
+		return;
+	}
+	if(number_of_branch_snps == 0)
+	{
+		return;
+	}
+	// Every snp on the branch repeats the names, so they are only written out once for the branch
+	char * taxon_names = copy_taxon_names(taxa);
+	print_branch_snp_features(branch_snps_file_pointer, current_node_id, parent_node_id, branches_snp_sites, number_of_branch_snps, branch_snp_sequence, branch_snp_ancestor_sequence, taxon_names);
+	free(taxon_names);
+}
 
-void print_branch_snp_details(FILE * branch_snps_file_pointer, char * current_node_id, char * parent_node_id, int * branches_snp_sites, int number_of_branch_snps, char * branch_snp_sequence, char * branch_snp_ancestor_sequence,char * taxon_names)
+// One EMBL feature for each snp on the branch
+void print_branch_snp_features(FILE * branch_snps_file_pointer, char * current_node_id, char * parent_node_id, int * branches_snp_sites, int number_of_branch_snps, char * branch_snp_sequence, char * branch_snp_ancestor_sequence,char * taxon_names)
 {
 	int i = 0;
 	for(i=0; i< number_of_branch_snps; i++)
@@ -19,7 +19,19 @@
 
 #ifndef _BLOCK_TAB_FILE_H_
 #define _BLOCK_TAB_FILE_H_
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include "taxon_sets.h"
 
-void print_block_details(FILE * block_file_pointer, int start_coordinate, int end_coordinate, int number_of_snps, char * current_node_id, char * parent_node_id, char * taxon_names,int number_of_child_nodes, double  neg_log_likelihood);
-void print_branch_snp_details(FILE * branch_snps_file_pointer, char * current_node_id, char * parent_node_id, int * branches_snp_sites, int number_of_branch_snps, char * branch_snp_sequence, char * branch_snp_ancestor_sequence,char * taxon_names);
+void print_block_details(FILE * block_file_pointer, int start_coordinate, int end_coordinate, int number_of_snps, char * current_node_id, char * parent_node_id, taxon_set * taxa, int number_of_child_nodes, double  neg_log_likelihood);
+void print_branch_snp_details(FILE * branch_snps_file_pointer, char * current_node_id, char * parent_node_id, int * branches_snp_sites, int number_of_branch_snps, char * branch_snp_sequence, char * branch_snp_ancestor_sequence, taxon_set * taxa);
+void print_branch_snp_features(FILE * branch_snps_file_pointer, char * current_node_id, char * parent_node_id, int * branches_snp_sites, int number_of_branch_snps, char * branch_snp_sequence, char * branch_snp_ancestor_sequence,char * taxon_names);
+void reset_recombination_fingerprint();
+void add_block_to_recombination_fingerprint(int start_coordinate, int end_coordinate, char * taxon_names);
+void add_taxa_to_recombination_fingerprint(int start_coordinate, int end_coordinate, taxon_set * taxa);
+uint64_t hash_recombinations_of_taxon_names(char * taxon_names, int start_coordinate, int end_coordinate, int * number_of_taxa);
+uint64_t hash_recombination(char * taxon, size_t taxon_length, int start_coordinate, int end_coordinate);
+uint64_t get_recombination_fingerprint();
+void write_recombination_fingerprint(char filename[]);
 #endif
\ No newline at end of file
@@ -0,0 +1,460 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include "branch_scan_cache.h"
+#include "string_cat.h"
+#include "profile.h"
+#include "contigs.h"
+
+char branch_scan_cache_directory[MAX_FILENAME_SIZE] = {""};
+
+// The cache from the last run, and the caches of the shards of this one, mapped read only so the worker threads can all look in them
+branch_scan_cache_file * cached_branch_scan_files = NULL;
+int number_of_cached_branch_scan_files = 0;
+uint64_t branch_scan_parameters_hash = 0;
+int branch_scan_shard_index = -1;
+
+branch_scan_result * branch_scan_results = NULL;
+int number_of_branch_scan_results = 0;
+int branch_scan_results_capacity = 0;
+int number_of_reused_branch_scans = 0;
+pthread_mutex_t branch_scan_results_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void set_branch_scan_cache_directory(char * directory)
+{
+	if(directory == NULL)
+	{
+		branch_scan_cache_directory[0] = '\0';
+		return;
+	}
+	memcpy(branch_scan_cache_directory, directory, size_of_string(directory) +1);
+}
+
+int branch_scan_cache_enabled()
+{
+	return branch_scan_cache_directory[0] != '\0';
+}
+
+// A shard of the tree writes its scans to a file of its own, so the shards can run at the same time
+void set_branch_scan_shard(int shard_index)
+{
+	branch_scan_shard_index = shard_index;
+}
+
+// Returns 0 if the path of the cache, with room for the .tmp it is written to first, wont fit in MAX_FILENAME_SIZE
+int branch_scan_cache_filename(char cache_filename[])
+{
+	int length;
+	if(branch_scan_shard_index >= 0)
+	{
+		length = snprintf(cache_filename, MAX_FILENAME_SIZE, "%s/%s%d%s", branch_scan_cache_directory, BRANCH_SCAN_SHARD_PREFIX, branch_scan_shard_index, BRANCH_SCAN_SHARD_SUFFIX);
+	}
+	else
+	{
+		length = snprintf(cache_filename, MAX_FILENAME_SIZE, "%s/%s", branch_scan_cache_directory, BRANCH_SCAN_CACHE_FILENAME);
+	}
+	return length >= 0 && length + strlen(".tmp") < MAX_FILENAME_SIZE;
+}
+
+// Maps the scans from the last run if they were made with the same parameters, otherwise starts with none. Outside
+// of a shard the scans left by the shards of the tree are mapped too, so only the branches above them are scanned.
+void open_branch_scan_cache(uint64_t parameters_hash)
+{
+	char cache_filename[MAX_FILENAME_SIZE] = {""};
+	
+	close_branch_scan_cache();
+	branch_scan_parameters_hash = parameters_hash;
+	number_of_reused_branch_scans = 0;
+	if(branch_scan_cache_enabled() == 0)
+	{
+		return;
+	}
+	if(branch_scan_cache_filename(cache_filename) == 0)
+	{
+		return;
+	}
+	map_branch_scan_cache_file(cache_filename, parameters_hash, 0);
+	if(branch_scan_shard_index >= 0)
+	{
+		return;
+	}
+	
+	DIR * cache_directory = opendir(branch_scan_cache_directory);
+	struct dirent * entry;
+	if(cache_directory == NULL)
+	{
+		return;
+	}
+	while((entry = readdir(cache_directory)) != NULL)
+	{
+		size_t name_length = strlen(entry->d_name);
+		if(strncmp(entry->d_name, BRANCH_SCAN_SHARD_PREFIX, strlen(BRANCH_SCAN_SHARD_PREFIX)) != 0 ||
+		   name_length <= strlen(BRANCH_SCAN_SHARD_SUFFIX) ||
+		   strcmp(entry->d_name + name_length - strlen(BRANCH_SCAN_SHARD_SUFFIX), BRANCH_SCAN_SHARD_SUFFIX) != 0)
+		{
+			continue;
+		}
+		int filename_length = snprintf(cache_filename, MAX_FILENAME_SIZE, "%s/%s", branch_scan_cache_directory, entry->d_name);
+		if(filename_length < 0 || filename_length >= MAX_FILENAME_SIZE)
+		{
+			continue;
+		}
+		map_branch_scan_cache_file(cache_filename, parameters_hash, 1);
+	}
+	closedir(cache_directory);
+}
+
+// Returns 1 if the file is a whole cache made with the same parameters, and adds it to the ones looked in
+int map_branch_scan_cache_file(char * cache_filename, uint64_t parameters_hash, int is_shard)
+{
+	branch_scan_cache_header header;
+	struct stat cache_status;
+	int cache_file_descriptor = open(cache_filename, O_RDONLY);
+	if(cache_file_descriptor < 0)
+	{
+		return 0;
+	}
+	if(pread(cache_file_descriptor, &header, sizeof(header), 0) != sizeof(header) ||
+	   fstat(cache_file_descriptor, &cache_status) != 0 ||
+	   memcmp(header.magic, BRANCH_SCAN_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+	   header.cache_size != (uint64_t) cache_status.st_size ||
+	   header.parameters_hash != parameters_hash ||
+	   header.number_of_results < 0 ||
+	   sizeof(header) + header.number_of_results*sizeof(branch_scan_cache_record) > header.cache_size)
+	{
+		close(cache_file_descriptor);
+		return 0;
+	}
+	
+	char * data = (char *) mmap(NULL, header.cache_size, PROT_READ, MAP_PRIVATE, cache_file_descriptor, 0);
+	close(cache_file_descriptor);
+	if(data == MAP_FAILED)
+	{
+		return 0;
+	}
+	record_profile_input_file(cache_filename);
+	cached_branch_scan_files = (branch_scan_cache_file *) realloc(cached_branch_scan_files, (number_of_cached_branch_scan_files +1)*sizeof(branch_scan_cache_file));
+	branch_scan_cache_file * cache_file = &cached_branch_scan_files[number_of_cached_branch_scan_files];
+	memcpy(cache_file->filename, cache_filename, size_of_string(cache_filename) +1);
+	cache_file->data = data;
+	cache_file->size = header.cache_size;
+	cache_file->records = (branch_scan_cache_record *) (data + sizeof(header));
+	cache_file->number_of_records = header.number_of_results;
+	cache_file->is_shard = is_shard;
+	number_of_cached_branch_scan_files++;
+	return 1;
+}
+
+void close_branch_scan_cache()
+{
+	int i;
+	for(i = 0; i < number_of_cached_branch_scan_files; i++)
+	{
+		munmap(cached_branch_scan_files[i].data, cached_branch_scan_files[i].size);
+	}
+	free(cached_branch_scan_files);
+	cached_branch_scan_files = NULL;
+	number_of_cached_branch_scan_files = 0;
+	
+	for(i = 0; i < number_of_branch_scan_results; i++)
+	{
+		free(branch_scan_results[i].blocks);
+		free(branch_scan_results[i].recombinations);
+	}
+	free(branch_scan_results);
+	branch_scan_results = NULL;
+	number_of_branch_scan_results = 0;
+	branch_scan_results_capacity = 0;
+}
+
+// The number of branches which werent scanned in the last tree, as their scans were reused
+int get_number_of_reused_branch_scans()
+{
+	return number_of_reused_branch_scans;
+}
+
+uint64_t hash_branch_scan_parameters(int * snp_locations, int number_of_snps, int length_of_original_genome, int min_snps, int window_min, int window_max, int multi_block_acceptance)
+{
+	int parameters[6] = {number_of_snps, length_of_original_genome, min_snps, window_min, window_max, multi_block_acceptance};
+	uint64_t hash = hash_sequence_row((const char *) parameters, sizeof(parameters), 0);
+	
+	// The windows are clipped at the ends of the contigs, so the scans depend on where they are
+	int i;
+	for(i = 0; contigs_have_been_given() && i < get_number_of_contigs(); i++)
+	{
+		int contig_boundaries[2] = {get_contig_start(i), get_contig_end(i, length_of_original_genome)};
+		hash = hash_sequence_row((const char *) contig_boundaries, sizeof(contig_boundaries), hash);
+	}
+	return hash_sequence_row((const char *) snp_locations, number_of_snps*sizeof(int), hash);
+}
+
+// Two independent hashes of both rows, as a collision would silently give a branch the wrong blocks
+branch_scan_cache_key get_branch_scan_cache_key(const char * child_sequence, const char * parent_sequence, int length_of_sequences)
+{
+	branch_scan_cache_key key;
+	key.hashes[0] = hash_sequence_row(parent_sequence, length_of_sequences, hash_sequence_row(child_sequence, length_of_sequences, 0x9e3779b97f4a7c15ULL));
+	key.hashes[1] = hash_sequence_row(parent_sequence, length_of_sequences, hash_sequence_row(child_sequence, length_of_sequences, 0xc2b2ae3d27d4eb4fULL));
+	return key;
+}
+
+// Eight bytes at a time, then whatever is left over, with a final mix of all the bits
+uint64_t hash_sequence_row(const char * sequence, int length_of_sequence, uint64_t seed)
+{
+	uint64_t hash = seed ^ ((uint64_t) length_of_sequence * 0xff51afd7ed558ccdULL);
+	uint64_t word;
+	int i = 0;
+	for(; i + 8 <= length_of_sequence; i += 8)
+	{
+		memcpy(&word, sequence + i, sizeof(word));
+		hash ^= word * 0x87c37b91114253d5ULL;
+		hash = ((hash << 31) | (hash >> 33)) * 0x4cf5ad432745937fULL;
+	}
+	for(; i < length_of_sequence; i++)
+	{
+		hash ^= (unsigned char) sequence[i];
+		hash *= 1099511628211ULL;
+	}
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdULL;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ULL;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+// Puts the result from last time on the child node as if it had just been scanned, returning 0 if there isnt one
+int reuse_branch_scan(branch_scan_cache_key * key, newick_node * child_node)
+{
+	int i;
+	branch_scan_cache_record * record = NULL;
+	branch_scan_cache_file * cache_file = NULL;
+	for(i = 0; i < number_of_cached_branch_scan_files && record == NULL; i++)
+	{
+		cache_file = &cached_branch_scan_files[i];
+		record = (branch_scan_cache_record *) bsearch(key, cache_file->records, cache_file->number_of_records, sizeof(branch_scan_cache_record), compare_branch_scan_cache_keys);
+	}
+	if(record == NULL || record->number_of_blocks < 0 || record->num_recombinations < 0 ||
+	   record->data_offset + record->number_of_blocks*sizeof(branch_scan_cache_block) + record->num_recombinations*sizeof(int32_t) > cache_file->size)
+	{
+		return 0;
+	}
+	
+	child_node->number_of_snps = record->number_of_snps;
+	child_node->total_bases_removed_excluding_gaps = record->total_bases_removed_excluding_gaps;
+	child_node->number_of_blocks = record->number_of_blocks;
+	child_node->block_coordinates[0] = (int *) realloc(child_node->block_coordinates[0], (record->number_of_blocks +1)*sizeof(int));
+	child_node->block_coordinates[1] = (int *) realloc(child_node->block_coordinates[1], (record->number_of_blocks +1)*sizeof(int));
+	child_node->block_snp_counts = (int *) realloc(child_node->block_snp_counts, (record->number_of_blocks +1)*sizeof(int));
+	child_node->block_likelihoods = (double *) realloc(child_node->block_likelihoods, (record->number_of_blocks +1)*sizeof(double));
+	char * data = cache_file->data + record->data_offset;
+	for(i = 0; i < record->number_of_blocks; i++)
+	{
+		branch_scan_cache_block block;
+		memcpy(&block, data + i*sizeof(branch_scan_cache_block), sizeof(block));
+		child_node->block_coordinates[0][i] = block.start;
+		child_node->block_coordinates[1][i] = block.end;
+		child_node->block_snp_counts[i] = block.snp_count;
+		child_node->block_likelihoods[i] = block.likelihood;
+	}
+	
+	data += record->number_of_blocks*sizeof(branch_scan_cache_block);
+	child_node->num_recombinations = record->num_recombinations;
+	child_node->recombinations = (int *) calloc(record->num_recombinations +1, sizeof(int));
+	for(i = 0; i < record->num_recombinations; i++)
+	{
+		int32_t recombination;
+		memcpy(&recombination, data + i*sizeof(int32_t), sizeof(recombination));
+		child_node->recombinations[i] = recombination;
+	}
+	
+	// and kept for the next run
+	save_branch_scan(key, child_node);
+	pthread_mutex_lock(&branch_scan_results_lock);
+	number_of_reused_branch_scans++;
+	pthread_mutex_unlock(&branch_scan_results_lock);
+	return 1;
+}
+
+void save_branch_scan(branch_scan_cache_key * key, newick_node * child_node)
+{
+	add_branch_scan_result(key, child_node->number_of_snps, child_node->total_bases_removed_excluding_gaps, child_node->number_of_blocks, child_node->block_coordinates, child_node->block_snp_counts, child_node->block_likelihoods, child_node->num_recombinations, child_node->recombinations);
+}
+
+void add_branch_scan_result(branch_scan_cache_key * key, int number_of_snps, int total_bases_removed_excluding_gaps, int number_of_blocks, int ** block_coordinates, int * block_snp_counts, double * block_likelihoods, int num_recombinations, int * recombinations)
+{
+	int i;
+	if(branch_scan_cache_enabled() == 0)
+	{
+		return;
+	}
+	branch_scan_result result;
+	memset(&result, 0, sizeof(result));
+	result.record.key = *key;
+	result.record.number_of_snps = number_of_snps;
+	result.record.total_bases_removed_excluding_gaps = total_bases_removed_excluding_gaps;
+	result.record.number_of_blocks = number_of_blocks;
+	result.record.num_recombinations = num_recombinations;
+	result.blocks = (branch_scan_cache_block *) calloc(number_of_blocks +1, sizeof(branch_scan_cache_block));
+	for(i = 0; i < number_of_blocks; i++)
+	{
+		result.blocks[i].start = block_coordinates[0][i];
+		result.blocks[i].end = block_coordinates[1][i];
+		result.blocks[i].snp_count = block_snp_counts[i];
+		result.blocks[i].likelihood = block_likelihoods[i];
+	}
+	result.recombinations = (int32_t *) calloc(num_recombinations +1, sizeof(int32_t));
+	for(i = 0; i < num_recombinations; i++)
+	{
+		result.recombinations[i] = recombinations[i];
+	}
+	
+	pthread_mutex_lock(&branch_scan_results_lock);
+	if(number_of_branch_scan_results == branch_scan_results_capacity)
+	{
+		branch_scan_results_capacity = 2*branch_scan_results_capacity + 64;
+		branch_scan_results = (branch_scan_result *) realloc(branch_scan_results, branch_scan_results_capacity*sizeof(branch_scan_result));
+	}
+	branch_scan_results[number_of_branch_scan_results] = result;
+	number_of_branch_scan_results++;
+	pthread_mutex_unlock(&branch_scan_results_lock);
+}
+
+// Replaces the cache with the scans of this run, sorted for looking up. It goes to a temporary file which is
+// renamed, so a run which is killed part way through leaves the last cache in place rather than a truncated one.
+void write_branch_scan_cache()
+{
+	char cache_filename[MAX_FILENAME_SIZE] = {""};
+	char temporary_cache_filename[MAX_FILENAME_SIZE] = {""};
+	branch_scan_cache_header header;
+	int i;
+	
+	if(branch_scan_cache_enabled() == 0)
+	{
+		return;
+	}
+	if(mkdir(branch_scan_cache_directory, 0777) != 0 && errno != EEXIST)
+	{
+		return;
+	}
+	if(branch_scan_cache_filename(cache_filename) == 0)
+	{
+		return;
+	}
+	memcpy(temporary_cache_filename, cache_filename, size_of_string(cache_filename) +1);
+	concat_strings_created_with_malloc(temporary_cache_filename, ".tmp");
+	FILE * cache_file_pointer = fopen(temporary_cache_filename, "w");
+	if(cache_file_pointer == NULL)
+	{
+		return;
+	}
+	
+	// Identical branches give identical results, so only one of each is kept
+	qsort(branch_scan_results, number_of_branch_scan_results, sizeof(branch_scan_result), compare_branch_scan_results);
+	int number_of_unique_results = 0;
+	for(i = 0; i < number_of_branch_scan_results; i++)
+	{
+		if(number_of_unique_results > 0 && compare_branch_scan_results(&branch_scan_results[i], &branch_scan_results[number_of_unique_results-1]) == 0)
+		{
+			free(branch_scan_results[i].blocks);
+			free(branch_scan_results[i].recombinations);
+			continue;
+		}
+		branch_scan_results[number_of_unique_results] = branch_scan_results[i];
+		number_of_unique_results++;
+	}
+	number_of_branch_scan_results = number_of_unique_results;
+	
+	uint64_t offset = sizeof(header) + number_of_branch_scan_results*sizeof(branch_scan_cache_record);
+	for(i = 0; i < number_of_branch_scan_results; i++)
+	{
+		branch_scan_cache_record * record = &branch_scan_results[i].record;
+		record->data_offset = offset;
+		offset += record->number_of_blocks*sizeof(branch_scan_cache_block) + record->num_recombinations*sizeof(int32_t);
+		offset = (offset + 7) & ~((uint64_t) 7);
+	}
+	
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, BRANCH_SCAN_CACHE_MAGIC, sizeof(header.magic));
+	header.parameters_hash = branch_scan_parameters_hash;
+	header.number_of_results = number_of_branch_scan_results;
+	header.cache_size = offset;
+	
+	int write_failed = fwrite(&header, sizeof(header), 1, cache_file_pointer) != 1;
+	for(i = 0; i < number_of_branch_scan_results; i++)
+	{
+		write_failed |= fwrite(&branch_scan_results[i].record, sizeof(branch_scan_cache_record), 1, cache_file_pointer) != 1;
+	}
+	for(i = 0; i < number_of_branch_scan_results; i++)
+	{
+		branch_scan_cache_record * record = &branch_scan_results[i].record;
+		size_t data_size = record->number_of_blocks*sizeof(branch_scan_cache_block) + record->num_recombinations*sizeof(int32_t);
+		char padding[8] = {0};
+		write_failed |= fwrite(branch_scan_results[i].blocks, sizeof(branch_scan_cache_block), record->number_of_blocks, cache_file_pointer) != (size_t) record->number_of_blocks;
+		write_failed |= fwrite(branch_scan_results[i].recombinations, sizeof(int32_t), record->num_recombinations, cache_file_pointer) != (size_t) record->num_recombinations;
+		write_failed |= fwrite(padding, 1, ((data_size + 7) & ~((size_t) 7)) - data_size, cache_file_pointer) != ((data_size + 7) & ~((size_t) 7)) - data_size;
+	}
+	write_failed |= fclose(cache_file_pointer) != 0;
+	
+	if(write_failed || rename(temporary_cache_filename, cache_filename) != 0)
+	{
+		remove(temporary_cache_filename);
+		return;
+	}
+	record_profile_output_file(cache_filename);
+	
+	// The scans of the shards are all in the cache now
+	for(i = 0; i < number_of_cached_branch_scan_files; i++)
+	{
+		if(cached_branch_scan_files[i].is_shard)
+		{
+			remove(cached_branch_scan_files[i].filename);
+		}
+	}
+}
+
+int compare_branch_scan_cache_keys(const void * a, const void * b)
+{
+	const branch_scan_cache_key * key_a = (const branch_scan_cache_key *) a;
+	const branch_scan_cache_key * key_b = (const branch_scan_cache_key *) b;
+	int i;
+	for(i = 0; i < 2; i++)
+	{
+		if(key_a->hashes[i] != key_b->hashes[i])
+		{
+			return key_a->hashes[i] < key_b->hashes[i] ? -1 : 1;
+		}
+	}
+	return 0;
+}
+
+int compare_branch_scan_results(const void * a, const void * b)
+{
+	return compare_branch_scan_cache_keys(&((const branch_scan_result *) a)->record.key, &((const branch_scan_result *) b)->record.key);
+}
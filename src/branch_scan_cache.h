@@ -0,0 +1,105 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _BRANCH_SCAN_CACHE_H_
+#define _BRANCH_SCAN_CACHE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include "Newickform.h"
+
+// What the scan of a branch left on the child node, kept in a directory between runs so a branch with the same
+// child and parent sequences as last time takes the same blocks without being scanned again. The scans are only
+// reused if every other input to them, such as the snp locations and window sizes, is the same too.
+typedef struct branch_scan_cache_header
+{
+	char magic[8];
+	uint64_t parameters_hash;
+	int64_t number_of_results;
+	uint64_t cache_size;
+} branch_scan_cache_header;
+
+typedef struct branch_scan_cache_key
+{
+	uint64_t hashes[2];
+} branch_scan_cache_key;
+
+// The blocks and then the recombinations of the result are at data_offset in the cache file
+typedef struct branch_scan_cache_record
+{
+	branch_scan_cache_key key;
+	int32_t number_of_snps;
+	int32_t total_bases_removed_excluding_gaps;
+	int32_t number_of_blocks;
+	int32_t num_recombinations;
+	uint64_t data_offset;
+} branch_scan_cache_record;
+
+typedef struct branch_scan_cache_block
+{
+	int32_t start;
+	int32_t end;
+	int32_t snp_count;
+	int32_t padding;
+	double likelihood;
+} branch_scan_cache_block;
+
+// A cache file mapped into memory, either the one kept from the last run or one written by a shard of the tree
+typedef struct branch_scan_cache_file
+{
+	char filename[MAX_FILENAME_SIZE];
+	char * data;
+	size_t size;
+	branch_scan_cache_record * records;
+	int64_t number_of_records;
+	int is_shard;
+} branch_scan_cache_file;
+
+// A result from this run, which is written out with the rest once every branch has been scanned
+typedef struct branch_scan_result
+{
+	branch_scan_cache_record record;
+	branch_scan_cache_block * blocks;
+	int32_t * recombinations;
+} branch_scan_result;
+
+void set_branch_scan_cache_directory(char * directory);
+int branch_scan_cache_enabled();
+void set_branch_scan_shard(int shard_index);
+int branch_scan_cache_filename(char cache_filename[]);
+void open_branch_scan_cache(uint64_t parameters_hash);
+int map_branch_scan_cache_file(char * cache_filename, uint64_t parameters_hash, int is_shard);
+void close_branch_scan_cache();
+int get_number_of_reused_branch_scans();
+uint64_t hash_branch_scan_parameters(int * snp_locations, int number_of_snps, int length_of_original_genome, int min_snps, int window_min, int window_max, int multi_block_acceptance);
+branch_scan_cache_key get_branch_scan_cache_key(const char * child_sequence, const char * parent_sequence, int length_of_sequences);
+uint64_t hash_sequence_row(const char * sequence, int length_of_sequence, uint64_t seed);
+int reuse_branch_scan(branch_scan_cache_key * key, newick_node * child_node);
+void save_branch_scan(branch_scan_cache_key * key, newick_node * child_node);
+void add_branch_scan_result(branch_scan_cache_key * key, int number_of_snps, int total_bases_removed_excluding_gaps, int number_of_blocks, int ** block_coordinates, int * block_snp_counts, double * block_likelihoods, int num_recombinations, int * recombinations);
+void write_branch_scan_cache();
+int compare_branch_scan_cache_keys(const void * a, const void * b);
+int compare_branch_scan_results(const void * a, const void * b);
+
+#define BRANCH_SCAN_CACHE_MAGIC "GUBBSC01"
+#define BRANCH_SCAN_CACHE_FILENAME "branch_scans.gubbins_cache"
+#define BRANCH_SCAN_SHARD_PREFIX "branch_scans.shard"
+#define BRANCH_SCAN_SHARD_SUFFIX ".gubbins_cache"
+
+#endif
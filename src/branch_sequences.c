@@ -31,6 +31,26 @@
 #include "block_tab_file.h"
 #include "gff_file.h"
 #include "string_cat.h"
+#include "binomial_statistics.h"
+#include "tree_traversal.h"
+#include "interval_set.h"
+#include "genome_bitset.h"
+#include "profile.h"
+#include "trace_events.h"
+#include "branch_scan_cache.h"
+#include "contigs.h"
+#include "tree_shards.h"
+#include "tree_task_scheduler.h"
+
+branch_scan_workspace * branch_scan_workspaces = NULL;
+int number_of_branch_scan_workspaces = 0;
+int multi_block_acceptance = 0;
+
+// Whether all of the significant blocks which dont overlap are taken in each pass of a branch, rather than only the best one
+void set_multi_block_acceptance(int accept_multiple_blocks)
+{
+	multi_block_acceptance = accept_multiple_blocks;
+}
 
 int node_counter = 0;
 
@@ -109,244 +129,822 @@ int get_list_of_snp_indices_which_fall_in_downstream_recombinations(int ** curre
 // Go through the tree and build up the recombinations list from root to branch. Print out each sample name and a list of recombinations
 void fill_in_recombinations_with_gaps(newick_node *root, int * parent_recombinations, int parent_num_recombinations, int current_total_snps,int num_blocks, int ** current_block_coordinates,int length_of_original_genome,int * snp_locations, int number_of_snps )
 {
-	newick_child *child;
-	int * current_recombinations;
-	int num_current_recombinations = 0 ;
-	char * child_sequence = (char *) calloc((length_of_original_genome +1),sizeof(char));
+	tree_traversal traversal;
+	recombination_path path;
+	int i;
+	build_tree_traversal(root, &traversal);
 	
-	current_recombinations = (int *) calloc((root->num_recombinations+1+parent_num_recombinations),sizeof(int));
-	num_current_recombinations = copy_and_concat_integer_arrays(root->recombinations, root->num_recombinations,parent_recombinations, parent_num_recombinations, current_recombinations);
+	// The path holds the recombinations and blocks from the root down to the current node. Each node only adds
+	// its own, and going back up to a parent rewinds the path to where it was when the parent finished.
+	initialise_recombination_path(&path, number_of_snps);
+	push_recombinations_onto_path(&path, parent_recombinations, parent_num_recombinations);
+	push_blocks_onto_path(&path, current_block_coordinates, num_blocks);
+	recombination_path_mark above_root = get_recombination_path_mark(&path);
+	above_root.total_snps = current_total_snps;
+	recombination_path_mark * node_marks = (recombination_path_mark *) calloc(traversal.number_of_nodes+1, sizeof(recombination_path_mark));
+	
+	for(i = 0; i < traversal.number_of_nodes; i++)
+	{
+		newick_node * node = traversal.pre_order[i];
+		recombination_path_mark * parent_mark = (node == root) ? &above_root : &node_marks[node->parent->traversal_index];
+		rewind_recombination_path(&path, parent_mark);
+		fill_in_recombinations_with_gaps_for_node(node, &path, parent_mark, length_of_original_genome, snp_locations, number_of_snps);
+		node_marks[node->traversal_index] = get_recombination_path_mark(&path);
+		node_marks[node->traversal_index].total_snps = parent_mark->total_snps + node->number_of_snps;
+	}
+	
+	free(node_marks);
+	free_recombination_path(&path);
+	free_tree_traversal(&traversal);
+}
+
+// Mask out the recombinations of a node and all of its ancestors. The path is left with the node's own recombinations and blocks on the end.
+void fill_in_recombinations_with_gaps_for_node(newick_node *root, recombination_path * path, recombination_path_mark * parent_mark, int length_of_original_genome, int * snp_locations, int number_of_snps)
+{
+	const char * child_sequence;
+	int num_blocks = parent_mark->num_blocks;
+	int current_total_snps = parent_mark->total_snps;
 	
  	// overwrite the bases of snps with N's
- 	int i;
  	int sequence_index;
- 	sequence_index = find_sequence_index_from_sample_name(root->taxon);
+ 	sequence_index = root->sequence_index;
  	
- 	set_number_of_recombinations_for_sample(root->taxon,root->num_recombinations);
- 	set_number_of_snps_for_sample(root->taxon,root->number_of_snps);
+ 	set_number_of_recombinations_for_sample_index(sequence_index,root->num_recombinations);
+ 	set_number_of_snps_for_sample_index(sequence_index,root->number_of_snps);
 	
-	get_sequence_for_sample_name(child_sequence, root->taxon);
-	int genome_length_excluding_blocks_and_gaps = calculate_genome_length_excluding_blocks_and_gaps(child_sequence, length_of_original_genome, current_block_coordinates, num_blocks);
+	child_sequence = get_sequence_view_for_node(root);
+	union_of_blocks(path->block_coordinates, num_blocks, &path->merged_blocks);
+	int genome_length_excluding_blocks_and_gaps = calculate_genome_length_excluding_merged_blocks_and_gaps(child_sequence, length_of_original_genome, &path->merged_blocks, &path->excluded_bases);
 	
-	set_genome_length_excluding_blocks_and_gaps_for_sample(root->taxon,genome_length_excluding_blocks_and_gaps);
+	set_genome_length_excluding_blocks_and_gaps_for_sample_index(sequence_index,genome_length_excluding_blocks_and_gaps);
 	
-	int ** merged_block_coordinates;
-	merged_block_coordinates = (int **) calloc(3,sizeof(int *));
-	merged_block_coordinates[0] = (int*) calloc((num_blocks + root->number_of_blocks+1),sizeof(int ));
-	merged_block_coordinates[1] = (int*) calloc((num_blocks + root->number_of_blocks+1),sizeof(int ));
-	copy_and_concat_2d_integer_arrays(current_block_coordinates,num_blocks,root->block_coordinates, root->number_of_blocks,merged_block_coordinates );
+	push_recombinations_onto_path(path, root->recombinations, root->num_recombinations);
+	push_blocks_onto_path(path, root->block_coordinates, root->number_of_blocks);
 	
-	set_number_of_blocks_for_sample(root->taxon, root->number_of_blocks	);
- 	set_number_of_bases_in_recombinations(root->taxon, calculate_number_of_bases_in_recombations_excluding_gaps(merged_block_coordinates, (num_blocks + root->number_of_blocks), child_sequence, snp_locations,current_total_snps));
-	free(child_sequence); 	
+	set_number_of_blocks_for_sample_index(sequence_index, root->number_of_blocks	);
+	// The blocks on the path are left as they are and merged into a separate set, so the later siblings see them unchanged
+	int snps_before_node = (current_total_snps < number_of_snps ? current_total_snps : number_of_snps);
+	union_of_blocks(path->block_coordinates, path->num_blocks, &path->merged_blocks);
+	calculate_gap_prefix_counts(child_sequence, snps_before_node, path->gap_prefix_counts);
+ 	set_number_of_bases_in_recombinations_for_sample_index(sequence_index, count_bases_in_interval_set_excluding_gaps(&path->merged_blocks, path->gap_prefix_counts, snp_locations, snps_before_node));
+	// The bases are about to be overwritten with Ns, which would invalidate the view anyway
+	release_sequence_view_for_sample_index(sequence_index);
 
- 	for(i = 0; i < num_current_recombinations; i++)
- 	{
- 		update_sequence_base('N', sequence_index, current_recombinations[i]);
- 	}
+ 	update_sequence_bases('N', sequence_index, path->recombinations, path->num_recombinations);
 
 
     // TODO: The stats for the number of snps in recombinations will need to be updated.
-	int * snps_in_recombinations = (int *) calloc((number_of_snps +1),sizeof(int));
-	int num_snps_in_recombinations = get_list_of_snp_indices_which_fall_in_downstream_recombinations(merged_block_coordinates, (num_blocks + root->number_of_blocks),snp_locations, number_of_snps, snps_in_recombinations);
-    int num_snps_updated_from_downstream_recombintations=0;
- 	for(i = 0; i < num_snps_in_recombinations; i++)
- 	{
- 		update_sequence_base('N', sequence_index, snps_in_recombinations[i]);
- 	}
-	free(snps_in_recombinations); 	
+	int * merged_block_coordinates[2] = {path->merged_blocks.starts, path->merged_blocks.ends};
+	int num_snps_in_recombinations = get_list_of_snp_indices_which_fall_in_downstream_recombinations(merged_block_coordinates, path->merged_blocks.number_of_intervals,snp_locations, number_of_snps, path->snps_in_recombinations);
+ 	update_sequence_bases('N', sequence_index, path->snps_in_recombinations, num_snps_in_recombinations);
 
-	if (root->childNum > 0)
-	{
-		child = root->child;
-		set_internal_node(1,sequence_index);
+	set_internal_node((root->childNum > 0) ? 1 : 0, sequence_index);
+}
 
-		while (child != NULL)
+// The same as fill_in_recombinations_with_gaps, with a task for each node which starts once its parent is done. Each
+// worker keeps its own path, which only has to be rebuilt when a worker moves to a different part of the tree.
+void fill_in_recombinations_with_gaps_on_tree_tasks(newick_node *root, int * parent_recombinations, int parent_num_recombinations, int current_total_snps,int num_blocks, int ** current_block_coordinates,int length_of_original_genome,int * snp_locations, int number_of_snps, int num_threads)
+{
+	tree_traversal traversal;
+	recombination_fill_tasks tasks;
+	int i;
+	build_tree_traversal(root, &traversal);
+	
+	int maximum_depth = 0;
+	tasks.depths = (int *) calloc(traversal.number_of_nodes+1, sizeof(int));
+	for(i = 1; i < traversal.number_of_nodes; i++)
+	{
+		newick_node * node = traversal.pre_order[i];
+		tasks.depths[node->traversal_index] = tasks.depths[node->parent->traversal_index] + 1;
+		if(tasks.depths[node->traversal_index] > maximum_depth)
 		{
-			fill_in_recombinations_with_gaps(child->node, current_recombinations, num_current_recombinations,(current_total_snps + root->number_of_snps),(num_blocks + root->number_of_blocks),merged_block_coordinates,length_of_original_genome, snp_locations, number_of_snps );
-			child = child->next;
-
+			maximum_depth = tasks.depths[node->traversal_index];
 		}
 	}
-	else
+	tasks.length_of_original_genome = length_of_original_genome;
+	tasks.snp_locations = snp_locations;
+	tasks.number_of_snps = number_of_snps;
+	tasks.number_of_workers = get_number_of_tree_task_workers(&traversal, num_threads);
+	tasks.workers = (recombination_path_worker *) calloc(tasks.number_of_workers, sizeof(recombination_path_worker));
+	for(i = 0; i < tasks.number_of_workers; i++)
+	{
+		recombination_path_worker * worker = &(tasks.workers[i]);
+		initialise_recombination_path(&(worker->path), number_of_snps);
+		push_recombinations_onto_path(&(worker->path), parent_recombinations, parent_num_recombinations);
+		push_blocks_onto_path(&(worker->path), current_block_coordinates, num_blocks);
+		worker->nodes_on_path = (newick_node **) calloc(maximum_depth+1, sizeof(newick_node *));
+		worker->marks = (recombination_path_mark *) calloc(maximum_depth+2, sizeof(recombination_path_mark));
+		worker->marks[0] = get_recombination_path_mark(&(worker->path));
+		worker->marks[0].total_snps = current_total_snps;
+		worker->number_of_nodes_on_path = 0;
+	}
+	
+	// Every node masks the whole of its sequence, plus the recombinations found on its branch
+	double * node_costs = (double *) calloc(traversal.number_of_nodes+1, sizeof(double));
+	double * priorities = (double *) calloc(traversal.number_of_nodes+1, sizeof(double));
+	for(i = 0; i < traversal.number_of_nodes; i++)
+	{
+		node_costs[i] = number_of_snps + traversal.pre_order[i]->num_recombinations + 1;
+	}
+	calculate_critical_path_priorities(&traversal, TREE_TASKS_PRE_ORDER, node_costs, priorities);
+	run_tree_tasks(&traversal, TREE_TASKS_PRE_ORDER, priorities, num_threads, fill_in_recombinations_with_gaps_task, &tasks);
+	
+	for(i = 0; i < tasks.number_of_workers; i++)
+	{
+		free_recombination_path(&(tasks.workers[i].path));
+		free(tasks.workers[i].nodes_on_path);
+		free(tasks.workers[i].marks);
+	}
+	free(tasks.workers);
+	free(priorities);
+	free(node_costs);
+	free(tasks.depths);
+	free_tree_traversal(&traversal);
+}
+
+void fill_in_recombinations_with_gaps_task(newick_node * node, int worker_index, void * context)
+{
+	recombination_fill_tasks * tasks = (recombination_fill_tasks *) context;
+	recombination_path_worker * worker = &(tasks->workers[worker_index]);
+	int depth = tasks->depths[node->traversal_index];
+	if(depth > 0 && (worker->number_of_nodes_on_path < depth || worker->nodes_on_path[depth-1] != node->parent))
 	{
-	set_internal_node(0,sequence_index);	
+		rebuild_recombination_path(worker, node->parent, depth-1);
 	}
-	free(current_recombinations);
-	free(merged_block_coordinates[0]);
-	free(merged_block_coordinates[1]);
-	free(merged_block_coordinates);
+	
+	recombination_path_mark * parent_mark = &(worker->marks[depth]);
+	rewind_recombination_path(&(worker->path), parent_mark);
+	fill_in_recombinations_with_gaps_for_node(node, &(worker->path), parent_mark, tasks->length_of_original_genome, tasks->snp_locations, tasks->number_of_snps);
+	worker->nodes_on_path[depth] = node;
+	worker->marks[depth+1] = get_recombination_path_mark(&(worker->path));
+	worker->marks[depth+1].total_snps = parent_mark->total_snps + node->number_of_snps;
+	worker->number_of_nodes_on_path = depth+1;
 }
 
-int calculate_number_of_bases_in_recombations_excluding_gaps(int ** block_coordinates, int num_blocks,char * child_sequence, int * snp_locations,int length_of_original_genome)
+// Puts the recombinations and blocks of a node and its ancestors on the path of a worker, keeping the part of
+// the path which the worker already has in common with it
+void rebuild_recombination_path(recombination_path_worker * worker, newick_node * node, int depth)
 {
-	int total_bases = 0;
-	int current_block = 1;
-	int start_block = 0;
+	int i;
+	int shared_depth = depth;
+	newick_node * ancestor = node;
+	while(shared_depth >= 0 && (shared_depth >= worker->number_of_nodes_on_path || worker->nodes_on_path[shared_depth] != ancestor))
+	{
+		worker->nodes_on_path[shared_depth] = ancestor;
+		ancestor = ancestor->parent;
+		shared_depth--;
+	}
+	
+	rewind_recombination_path(&(worker->path), &(worker->marks[shared_depth+1]));
+	for(i = shared_depth+1; i <= depth; i++)
+	{
+		ancestor = worker->nodes_on_path[i];
+		push_recombinations_onto_path(&(worker->path), ancestor->recombinations, ancestor->num_recombinations);
+		push_blocks_onto_path(&(worker->path), ancestor->block_coordinates, ancestor->number_of_blocks);
+		worker->marks[i+1] = get_recombination_path_mark(&(worker->path));
+		worker->marks[i+1].total_snps = worker->marks[i].total_snps + ancestor->number_of_snps;
+	}
+	worker->number_of_nodes_on_path = depth+1;
+}
+
+void initialise_recombination_path(recombination_path * path, int number_of_snps)
+{
+	memset(path, 0, sizeof(recombination_path));
+	path->snps_in_recombinations = (int *) calloc((number_of_snps +1),sizeof(int));
+	path->gap_prefix_counts = (int *) calloc((number_of_snps +1),sizeof(int));
+	initialise_interval_set(&path->merged_blocks);
+	path->excluded_bases.words = NULL;
+	path->excluded_bases.length = -1;
+	path->excluded_bases.number_of_words = 0;
+}
+
+void push_recombinations_onto_path(recombination_path * path, int * recombinations, int num_recombinations)
+{
+	if(path->num_recombinations + num_recombinations >= path->recombinations_capacity)
+	{
+		path->recombinations_capacity = 2*(path->num_recombinations + num_recombinations) + 16;
+		path->recombinations = (int *) realloc(path->recombinations, path->recombinations_capacity*sizeof(int));
+	}
+	if(num_recombinations > 0)
+	{
+		memcpy(path->recombinations + path->num_recombinations, recombinations, num_recombinations*sizeof(int));
+	}
+	path->num_recombinations += num_recombinations;
+}
 
-	for(start_block = 0; start_block < num_blocks; start_block++)
+void push_blocks_onto_path(recombination_path * path, int ** block_coordinates, int num_blocks)
+{
+	int i;
+	if(path->num_blocks + num_blocks >= path->blocks_capacity)
+	{
+		path->blocks_capacity = 2*(path->num_blocks + num_blocks) + 16;
+		path->block_coordinates[0] = (int *) realloc(path->block_coordinates[0], path->blocks_capacity*sizeof(int));
+		path->block_coordinates[1] = (int *) realloc(path->block_coordinates[1], path->blocks_capacity*sizeof(int));
+	}
+	for(i = 0; i < num_blocks; i++)
 	{
-		if(block_coordinates[0][start_block] == -1 || block_coordinates[1][start_block] == -1)
+		path->block_coordinates[0][path->num_blocks + i] = block_coordinates[0][i];
+		path->block_coordinates[1][path->num_blocks + i] = block_coordinates[1][i];
+	}
+	path->num_blocks += num_blocks;
+}
+
+recombination_path_mark get_recombination_path_mark(recombination_path * path)
+{
+	recombination_path_mark mark;
+	mark.num_recombinations = path->num_recombinations;
+	mark.num_blocks = path->num_blocks;
+	mark.total_snps = 0;
+	return mark;
+}
+
+void rewind_recombination_path(recombination_path * path, recombination_path_mark * mark)
+{
+	path->num_recombinations = mark->num_recombinations;
+	path->num_blocks = mark->num_blocks;
+}
+
+void free_recombination_path(recombination_path * path)
+{
+	free(path->recombinations);
+	free(path->block_coordinates[0]);
+	free(path->block_coordinates[1]);
+	free(path->snps_in_recombinations);
+	free(path->gap_prefix_counts);
+	free_interval_set(&path->merged_blocks);
+	free_genome_bitset(&path->excluded_bases);
+	memset(path, 0, sizeof(recombination_path));
+}
+
+// Overlapping blocks are only counted once. The blocks themselves are left unchanged.
+int calculate_number_of_bases_in_recombations_excluding_gaps(int ** block_coordinates, int num_blocks,const char * child_sequence, int * snp_locations,int length_of_original_genome)
+{
+	interval_set merged_blocks;
+	int * gap_prefix_counts = (int *) calloc((length_of_original_genome +1),sizeof(int));
+	initialise_interval_set(&merged_blocks);
+	union_of_blocks(block_coordinates, num_blocks, &merged_blocks);
+	calculate_gap_prefix_counts(child_sequence, length_of_original_genome, gap_prefix_counts);
+	int total_bases = count_bases_in_interval_set_excluding_gaps(&merged_blocks, gap_prefix_counts, snp_locations, length_of_original_genome);
+	free_interval_set(&merged_blocks);
+	free(gap_prefix_counts);
+	return total_bases;
+}
+
+// Nodes which arent in the alignment keep the original error message
+const char * get_sequence_view_for_node(newick_node * node)
+{
+	if(node->sequence_index < 0 && find_sequence_index_from_sample_name(node->taxon) < 0)
+	{
+    printf("Couldnt find sequence name %s with index %d\n", node->taxon,node->sequence_index);
+	  exit(1);
+	}
+	return get_sequence_view_for_sample_index(node->sequence_index);
+}
+
+void carry_unambiguous_gaps_up_tree(newick_node *root)
+{
+	tree_traversal traversal;
+	int i;
+	build_tree_traversal(root, &traversal);
+	int * child_sequence_indices = (int *) calloc(traversal.maximum_number_of_children+1, sizeof(int));
+	
+	// Children are finished before their parents, so the gaps carry all the way up
+	for(i = 0; i < traversal.number_of_nodes; i++)
+	{
+		newick_node * node = traversal.post_order[i];
+		if(node->childNum > 0)
 		{
-			continue;
-		}
-		
-		for(current_block = 0 ; current_block < num_blocks; current_block++)
-		{ 
-			if(current_block == start_block)
+			newick_child *child = node->child;
+			int child_counter = 0;
+			while (child != NULL)
 			{
-				continue;	
-			}
-			
-			if(block_coordinates[0][current_block] == -1 || block_coordinates[1][current_block] == -1)
-			{
-				continue;
-			}
-			
-			
-			int found_overlap = 0;
-		  if(block_coordinates[0][start_block] >=  block_coordinates[0][current_block] && block_coordinates[0][start_block] <= block_coordinates[1][current_block] )
-		  {
-				block_coordinates[0][start_block] = block_coordinates[0][current_block];
-				found_overlap = 1;
+				child_sequence_indices[child_counter] = child->node->sequence_index;
+				child = child->next;
+				child_counter++;
 			}
 			
-			if(block_coordinates[1][start_block] >=  block_coordinates[0][current_block]  && block_coordinates[1][start_block] <= block_coordinates[1][current_block])
-		  {
-				block_coordinates[1][start_block] = block_coordinates[1][current_block];
-				found_overlap = 1;
-			}
-			
-			if(found_overlap == 1)
-			{
-				block_coordinates[0][current_block] = -1;
-				block_coordinates[1][current_block] = -1;
-			}
-		}	
-		
+			// compare the parent sequence to the each child sequence and update the gaps
+			fill_in_unambiguous_gaps_in_parent_from_children(node->sequence_index, child_sequence_indices,child_counter);
+			//fill_in_unambiguous_bases_in_parent_from_children_where_parent_has_a_gap(parent_sequence_index, child_sequence_indices,child_counter);
+		}
 	}
-	for(start_block = 0; start_block < num_blocks; start_block++)
+	free(child_sequence_indices);
+	free_tree_traversal(&traversal);
+}
+
+const char *generate_branch_sequences(newick_node *root, int * snp_locations, int number_of_snps, const char * leaf_sequence, int length_of_original_genome, FILE * block_file_pointer, FILE * gff_file_pointer,int min_snps,FILE * branch_snps_file_pointer, int window_min, int window_max, int num_threads)
+{
+	tree_traversal traversal;
+	int i;
+	build_tree_traversal(root, &traversal);
+	
+	// The node ids are handed out from the top of the tree down, and the branches are scanned from the bottom up
+	for(i = 0; i < traversal.number_of_nodes; i++)
 	{
-		if(block_coordinates[0][start_block] == -1 || block_coordinates[1][start_block] == -1)
+		traversal.pre_order[i]->current_node_id = ++node_counter;
+	}
+	
+	open_branch_scan_cache(hash_branch_scan_parameters(snp_locations, number_of_snps, length_of_original_genome, min_snps, window_min, window_max, multi_block_acceptance));
+	const char ** node_sequences = (const char **) calloc(traversal.number_of_nodes+1, sizeof(const char *));
+	const char ** child_sequences = (const char **) calloc(traversal.maximum_number_of_children+1, sizeof(const char *));
+	newick_node ** child_nodes = (newick_node **) calloc(traversal.maximum_number_of_children+1, sizeof(newick_node *));
+	for(i = 0; i < traversal.number_of_nodes; i++)
+	{
+		newick_node * node = traversal.post_order[i];
+		node_sequences[node->traversal_index] = generate_branch_sequence_for_node(node, node_sequences, child_sequences, child_nodes, snp_locations, number_of_snps, length_of_original_genome, block_file_pointer, gff_file_pointer, min_snps, branch_snps_file_pointer, window_min, window_max, num_threads);
+	}
+	leaf_sequence = node_sequences[root->traversal_index];
+	write_branch_scan_cache();
+	close_branch_scan_cache();
+	
+	free(child_nodes);
+	free(child_sequences);
+	free(node_sequences);
+	free_tree_traversal(&traversal);
+	return leaf_sequence;
+}
+
+// Scans the branches under the cut roots of one shard of the tree, keeping only their results in the shard's cache
+// file. The tab, gff and branch snps files are written when the shards are put back together, so here they arent opened.
+void scan_tree_shard(tree_shard_plan * plan, int shard_index, int * snp_locations, int number_of_snps, int length_of_original_genome, int min_snps, int window_min, int window_max, int num_threads)
+{
+	int i, j;
+	
+	open_branch_scan_cache(hash_branch_scan_parameters(snp_locations, number_of_snps, length_of_original_genome, min_snps, window_min, window_max, multi_block_acceptance));
+	for(i = 0; i < plan->number_of_cut_roots; i++)
+	{
+		if(plan->shard_of_cut_root[i] != shard_index)
 		{
 			continue;
 		}
 		
+		// The gaps carried up to a node only come from below it, so they are the same as for the whole tree
+		newick_node * cut_root = plan->cut_roots[i];
+		carry_unambiguous_gaps_up_tree(cut_root);
 		
-	  total_bases += calculate_block_size_without_gaps(child_sequence,  snp_locations, block_coordinates[0][start_block], block_coordinates[1][start_block], length_of_original_genome);
-  }
+		tree_traversal traversal;
+		build_tree_traversal(cut_root, &traversal);
+		const char ** node_sequences = (const char **) calloc(traversal.number_of_nodes+1, sizeof(const char *));
+		const char ** child_sequences = (const char **) calloc(traversal.maximum_number_of_children+1, sizeof(const char *));
+		newick_node ** child_nodes = (newick_node **) calloc(traversal.maximum_number_of_children+1, sizeof(newick_node *));
+		for(j = 0; j < traversal.number_of_nodes; j++)
+		{
+			newick_node * node = traversal.post_order[j];
+			node_sequences[node->traversal_index] = generate_branch_sequence_for_node(node, node_sequences, child_sequences, child_nodes, snp_locations, number_of_snps, length_of_original_genome, NULL, NULL, min_snps, NULL, window_min, window_max, num_threads);
+		}
+		release_sequence_views();
+		free(child_nodes);
+		free(child_sequences);
+		free(node_sequences);
+		free_tree_traversal(&traversal);
+	}
+	write_branch_scan_cache();
+	close_branch_scan_cache();
+}
+
+// Carries the gaps up the tree and scans every branch as one task per node, which starts as soon as the children of the
+// node are done rather than when the whole level is. The outputs of each branch are buffered and written in the same
+// order as generate_branch_sequences would write them.
+const char *generate_branch_sequences_on_tree_tasks(newick_node *root, int * snp_locations, int number_of_snps, int length_of_original_genome, FILE * block_file_pointer, FILE * gff_file_pointer,int min_snps,FILE * branch_snps_file_pointer, int window_min, int window_max, int num_threads)
+{
+	tree_traversal traversal;
+	branch_sequence_tasks tasks;
+	int i;
+	build_tree_traversal(root, &traversal);
 	
-	return total_bases;
+	for(i = 0; i < traversal.number_of_nodes; i++)
+	{
+		traversal.pre_order[i]->current_node_id = ++node_counter;
+	}
+	
+	open_branch_scan_cache(hash_branch_scan_parameters(snp_locations, number_of_snps, length_of_original_genome, min_snps, window_min, window_max, multi_block_acceptance));
+	int number_of_workers = get_number_of_tree_task_workers(&traversal, num_threads);
+	int children_per_worker = traversal.maximum_number_of_children+1;
+	tasks.traversal = &traversal;
+	tasks.node_sequences = (const char **) calloc(traversal.number_of_nodes+1, sizeof(const char *));
+	tasks.branches = (branch_scan_task *) calloc(traversal.number_of_nodes+1, sizeof(branch_scan_task));
+	tasks.finished_nodes = (int *) calloc(traversal.number_of_nodes+1, sizeof(int));
+	tasks.next_node_to_write = 0;
+	tasks.child_sequences = (const char **) calloc(number_of_workers*children_per_worker, sizeof(const char *));
+	tasks.child_nodes = (newick_node **) calloc(number_of_workers*children_per_worker, sizeof(newick_node *));
+	tasks.child_sequence_indices = (int *) calloc(number_of_workers*children_per_worker, sizeof(int));
+	tasks.block_file_pointer = block_file_pointer;
+	tasks.gff_file_pointer = gff_file_pointer;
+	tasks.branch_snps_file_pointer = branch_snps_file_pointer;
+	tasks.snp_locations = snp_locations;
+	tasks.number_of_snps = number_of_snps;
+	tasks.length_of_original_genome = length_of_original_genome;
+	tasks.min_snps = min_snps;
+	tasks.window_min = window_min;
+	tasks.window_max = window_max;
+	pthread_mutex_init(&(tasks.output_lock), NULL);
+	
+	// The workspaces cant move once the workers have started
+	allocate_branch_scan_workspaces(number_of_workers);
+	double * node_costs = (double *) calloc(traversal.number_of_nodes+1, sizeof(double));
+	double * priorities = (double *) calloc(traversal.number_of_nodes+1, sizeof(double));
+	estimate_branch_scan_costs(&traversal, number_of_snps, length_of_original_genome, node_costs);
+	calculate_critical_path_priorities(&traversal, TREE_TASKS_POST_ORDER, node_costs, priorities);
+	run_tree_tasks(&traversal, TREE_TASKS_POST_ORDER, priorities, num_threads, generate_branch_sequence_task, &tasks);
+	
+	const char * root_sequence = tasks.node_sequences[root->traversal_index];
+	write_branch_scan_cache();
+	close_branch_scan_cache();
+	
+	pthread_mutex_destroy(&(tasks.output_lock));
+	free(priorities);
+	free(node_costs);
+	free(tasks.child_sequence_indices);
+	free(tasks.child_nodes);
+	free(tasks.child_sequences);
+	free(tasks.finished_nodes);
+	free(tasks.branches);
+	free(tasks.node_sequences);
+	free_tree_traversal(&traversal);
+	return root_sequence;
 }
 
-void carry_unambiguous_gaps_up_tree(newick_node *root)
+// The work for a node is finding its sequence plus scanning the branches to its children, which is mostly
+// proportional to the snps on them. Before the scans the number of snps on a branch is estimated from its length.
+void estimate_branch_scan_costs(tree_traversal * traversal, int number_of_snps, int length_of_original_genome, double * node_costs)
 {
-	if(root->childNum > 0)
+	int i;
+	for(i = 0; i < traversal->number_of_nodes; i++)
 	{
-		newick_child *child;
-		int parent_sequence_index =  find_sequence_index_from_sample_name(root->taxon);
-		
-		child = root->child;
-		int child_sequence_indices[root->childNum];
+		newick_node * node = traversal->pre_order[i];
+		double cost = number_of_snps;
+		newick_child * child = node->child;
+		while(child != NULL)
+		{
+			double expected_branch_snps = child->node->dist * length_of_original_genome;
+			if(expected_branch_snps < 0)
+			{
+				expected_branch_snps = 0;
+			}
+			cost += (expected_branch_snps < number_of_snps) ? expected_branch_snps : number_of_snps;
+			child = child->next;
+		}
+		node_costs[node->traversal_index] = cost + 1;
+	}
+}
+
+// Once all of its children are done, carry their gaps up into a node, find its sequence and scan the branches down to them
+void generate_branch_sequence_task(newick_node * node, int worker_index, void * context)
+{
+	branch_sequence_tasks * tasks = (branch_sequence_tasks *) context;
+	int children_per_worker = tasks->traversal->maximum_number_of_children+1;
+	const char ** child_sequences = tasks->child_sequences + worker_index*children_per_worker;
+	newick_node ** child_nodes = tasks->child_nodes + worker_index*children_per_worker;
+	int * child_sequence_indices = tasks->child_sequence_indices + worker_index*children_per_worker;
+	int i;
+	
+	if(node->childNum > 0)
+	{
+		newick_child * child = node->child;
 		int child_counter = 0;
-		while (child != NULL)
+		while(child != NULL)
 		{
-			child_sequence_indices[child_counter] = find_sequence_index_from_sample_name(child->node->taxon);
-			carry_unambiguous_gaps_up_tree(child->node);
+			child_sequence_indices[child_counter] = child->node->sequence_index;
 			child = child->next;
 			child_counter++;
 		}
-		
-		// compare the parent sequence to the each child sequence and update the gaps
-		fill_in_unambiguous_gaps_in_parent_from_children(parent_sequence_index, child_sequence_indices,child_counter);
-		//fill_in_unambiguous_bases_in_parent_from_children_where_parent_has_a_gap(parent_sequence_index, child_sequence_indices,child_counter);
+		fill_in_unambiguous_gaps_in_parent_from_children(node->sequence_index, child_sequence_indices, child_counter);
+	}
+	
+	const char * node_sequence = find_sequence_of_node(node, tasks->node_sequences, child_sequences, child_nodes, tasks->number_of_snps, tasks->length_of_original_genome);
+	tasks->node_sequences[node->traversal_index] = node_sequence;
+	for(i = 0; i < node->childNum; i++)
+	{
+		branch_scan_task * branch = &(tasks->branches[child_nodes[i]->traversal_index]);
+		branch->child_node = child_nodes[i];
+		branch->child_sequence = child_sequences[i];
+		open_branch_scan_task_buffers(branch, tasks->block_file_pointer, tasks->gff_file_pointer, tasks->branch_snps_file_pointer);
+		scan_branch(child_nodes[i], child_sequences[i], node, node_sequence, tasks->snp_locations, tasks->number_of_snps, tasks->length_of_original_genome, branch->block_file_pointer, branch->gff_file_pointer, branch->branch_snps_file_pointer, tasks->min_snps, tasks->window_min, tasks->window_max, get_branch_scan_workspace(worker_index));
+		release_sequence_view_for_sample_index(child_nodes[i]->sequence_index);
+	}
+	write_finished_branch_scans(tasks, node);
+}
+
+// The buffers of a node are written once every node before it in post-order has been written
+void write_finished_branch_scans(branch_sequence_tasks * tasks, newick_node * node)
+{
+	pthread_mutex_lock(&(tasks->output_lock));
+	tasks->finished_nodes[node->traversal_index] = 1;
+	while(tasks->next_node_to_write < tasks->traversal->number_of_nodes && tasks->finished_nodes[tasks->traversal->post_order[tasks->next_node_to_write]->traversal_index])
+	{
+		newick_child * child = tasks->traversal->post_order[tasks->next_node_to_write]->child;
+		while(child != NULL)
+		{
+			flush_branch_scan_task_buffers(&(tasks->branches[child->node->traversal_index]), tasks->block_file_pointer, tasks->gff_file_pointer, tasks->branch_snps_file_pointer);
+			child = child->next;
+		}
+		tasks->next_node_to_write++;
+	}
+	pthread_mutex_unlock(&(tasks->output_lock));
+}
+
+// Once all of its children are done, find the sequence of a node and scan the branches down to its children
+const char *generate_branch_sequence_for_node(newick_node *root, const char ** node_sequences, const char ** child_sequences, newick_node ** child_nodes, int * snp_locations, int number_of_snps, int length_of_original_genome, FILE * block_file_pointer, FILE * gff_file_pointer,int min_snps,FILE * branch_snps_file_pointer, int window_min, int window_max, int num_threads)
+{
+	int current_branch =0;
+	const char * leaf_sequence = find_sequence_of_node(root, node_sequences, child_sequences, child_nodes, number_of_snps, length_of_original_genome);
+	if (root->childNum == 0)
+	{
+		return leaf_sequence;
+	}
+	
+	if(num_threads > 1 && root->childNum > 1)
+	{
+		scan_branches_in_parallel(child_nodes, child_sequences, root->childNum, root, leaf_sequence, snp_locations, number_of_snps, length_of_original_genome, block_file_pointer, gff_file_pointer, branch_snps_file_pointer, min_snps, window_min, window_max, num_threads);
 	}
+	else
+	{
+		for(current_branch = 0 ; current_branch< (root->childNum); current_branch++)
+		{
+			scan_branch(child_nodes[current_branch], child_sequences[current_branch], root, leaf_sequence, snp_locations, number_of_snps, length_of_original_genome, block_file_pointer, gff_file_pointer, branch_snps_file_pointer, min_snps, window_min, window_max, get_branch_scan_workspace(0));
+		}
+	}
+	
+	// The child sequences are only needed to scan the branches above them
+	for(current_branch = 0 ; current_branch< (root->childNum); current_branch++)
+	{
+		release_sequence_view_for_sample_index(child_nodes[current_branch]->sequence_index);
+	}
+	
+	return leaf_sequence;
 }
 
-char *generate_branch_sequences(newick_node *root, FILE *vcf_file_pointer,int * snp_locations, int number_of_snps, char** column_names, int number_of_columns, char * leaf_sequence, int length_of_original_genome, FILE * block_file_pointer, FILE * gff_file_pointer,int min_snps,FILE * branch_snps_file_pointer, int window_min, int window_max)
+// The view of the sequence of a node, with the children and their sequences put in order
+// for the scans of their branches
+const char * find_sequence_of_node(newick_node *root, const char ** node_sequences, const char ** child_sequences, newick_node ** child_nodes, int number_of_snps, int length_of_original_genome)
 {
 	newick_child *child;
 	int child_counter = 0;
-	int current_branch =0;
 	int branch_genome_size = 0;
-	int number_of_branch_snps=0;
-  root->current_node_id = ++node_counter;
+	const char * leaf_sequence;
 	
 	if (root->childNum == 0)
 	{
-		leaf_sequence = (char *) calloc((number_of_snps +1),sizeof(char));
-		get_sequence_for_sample_name(leaf_sequence, root->taxon);
-		
-		root->taxon_names = (char *) calloc(MAX_SAMPLE_NAME_SIZE,sizeof(char));
-		memcpy(root->taxon_names, root->taxon, size_of_string(root->taxon)+1);
+		leaf_sequence = get_sequence_view_for_node(root);
 
     // Save some statistics about the sequence
 		branch_genome_size = calculate_size_of_genome_without_gaps(leaf_sequence, 0,number_of_snps, length_of_original_genome);
-		set_genome_length_without_gaps_for_sample(root->taxon,branch_genome_size);
-		int number_of_gaps = length_of_original_genome-branch_genome_size;
+		set_genome_length_without_gaps_for_sample_index(root->sequence_index,branch_genome_size);
 		
 		return leaf_sequence;
 	}
+	
+	child = root->child;
+
+	// generate pointers for each child seuqn
+
+	while (child != NULL)
+	{
+		child_sequences[child_counter] = node_sequences[child->node->traversal_index];
+		child_nodes[child_counter] = child->node;
+		
+		child_counter++;
+		child = child->next;
+	}
+	
+	// For all bases update the parent sequence with N if all child sequences.
+	
+	// All child sequneces should be available use them to find the ancestor sequence
+	leaf_sequence = get_sequence_view_for_node(root);
+	
+	branch_genome_size = calculate_size_of_genome_without_gaps(leaf_sequence, 0,number_of_snps, length_of_original_genome);
+	set_genome_length_without_gaps_for_sample_index(root->sequence_index,branch_genome_size);
+	
+	return leaf_sequence;
+}
+
+// Look for recombinations on the branch between a node and one of its children
+void scan_branch(newick_node * child_node, const char * child_sequence, newick_node * root, const char * leaf_sequence, int * snp_locations, int number_of_snps, int length_of_original_genome, FILE * block_file_pointer, FILE * gff_file_pointer, FILE * branch_snps_file_pointer, int min_snps, int window_min, int window_max, branch_scan_workspace * workspace)
+{
+	// The temporary arrays for the branch all come out of the workspace, which is emptied but keeps its memory for the next branch
+	reset_branch_scan_workspace(workspace);
+	seq_arena * scratch_arena = &(workspace->scratch_arena);
+	int * branches_snp_sites;
+	branches_snp_sites = (int *) seq_arena_malloc(scratch_arena, (number_of_snps +1)*sizeof(int));
+	char * branch_snp_sequence;
+	char * branch_snp_ancestor_sequence;
+	branch_snp_sequence = (char *) seq_arena_malloc(scratch_arena, (number_of_snps +1)*sizeof(char));
+	branch_snp_ancestor_sequence = (char *) seq_arena_malloc(scratch_arena, (number_of_snps +1)*sizeof(char));
+	
+	int branch_genome_size = calculate_size_of_genome_without_gaps(child_sequence, 0,number_of_snps, length_of_original_genome);
+	// A child kept as its differences from this node only has to be compared where it differs
+	int * difference_positions;
+	char * difference_bases;
+	int number_of_differences = get_sequence_differences_from_parent(child_node->sequence_index, root->sequence_index, &difference_positions, &difference_bases);
+	int number_of_branch_snps;
+	if(number_of_differences >= 0)
+	{
+		number_of_branch_snps = calculate_number_of_snps_from_differences(leaf_sequence, child_sequence, number_of_snps, difference_positions, number_of_differences, branches_snp_sites, snp_locations,branch_snp_sequence,branch_snp_ancestor_sequence);
+	}
 	else
 	{
-		child = root->child;
-		char * child_sequences[root->childNum];
-		newick_node * child_nodes[root->childNum];
-		root->taxon_names = (char *) calloc(MAX_SAMPLE_NAME_SIZE*number_of_columns,sizeof(char));
+		number_of_branch_snps = calculate_number_of_snps_excluding_gaps(leaf_sequence, child_sequence, number_of_snps, branches_snp_sites, snp_locations,branch_snp_sequence,branch_snp_ancestor_sequence);
+	}
+	
+	child_node->number_of_snps = number_of_branch_snps;
+	print_branch_snp_details(branch_snps_file_pointer, child_node->taxon,root->taxon, branches_snp_sites, number_of_branch_snps, branch_snp_sequence, branch_snp_ancestor_sequence,&(child_node->taxa));
+	
+	// A branch scanned last time with the same sequences at both ends takes the same blocks again
+	branch_scan_cache_key cache_key = {{0, 0}};
+	if(branch_scan_cache_enabled())
+	{
+		cache_key = get_branch_scan_cache_key(child_sequence, leaf_sequence, number_of_snps);
+		if(reuse_branch_scan(&cache_key, child_node))
+		{
+			print_reused_blocks(child_node, root, block_file_pointer, gff_file_pointer);
+			return;
+		}
+	}
+	
+	get_likelihood_for_windows(child_sequence, number_of_snps, branches_snp_sites, branch_genome_size, number_of_branch_snps,snp_locations, child_node, block_file_pointer, root, gff_file_pointer,min_snps,length_of_original_genome,leaf_sequence, window_min, window_max, scratch_arena);
+	if(branch_scan_cache_enabled())
+	{
+		save_branch_scan(&cache_key, child_node);
+	}
+}
+
+// Prints the blocks of a reused scan in the order they were taken, as if the branch had been scanned
+void print_reused_blocks(newick_node * child_node, newick_node * root, FILE * block_file_pointer, FILE * gff_file_pointer)
+{
+	int i;
+	branch_profile counters;
+	memset(&counters, 0, sizeof(branch_profile));
+	for(i = 0; i < child_node->number_of_blocks; i++)
+	{
+		print_block_details(block_file_pointer, child_node->block_coordinates[0][i], child_node->block_coordinates[1][i], child_node->block_snp_counts[i], child_node->taxon, root->taxon, &(child_node->taxa), child_node->childNum, child_node->block_likelihoods[i]);
+		print_gff_line(gff_file_pointer, child_node->block_coordinates[0][i], child_node->block_coordinates[1][i], child_node->block_snp_counts[i], child_node->taxon, root->taxon, &(child_node->taxa), child_node->block_likelihoods[i]);
+	}
+	counters.number_of_snps = child_node->number_of_snps;
+	counters.number_of_accepted_blocks = child_node->number_of_blocks;
+	record_branch_profile(child_node->taxon, &counters);
+}
+
+// One workspace is kept for each worker thread. They have to be made before the workers start, since the array can move.
+void allocate_branch_scan_workspaces(int number_of_workspaces)
+{
+	int i;
+	if(number_of_workspaces <= number_of_branch_scan_workspaces)
+	{
+		return;
+	}
+	branch_scan_workspaces = (branch_scan_workspace *) realloc(branch_scan_workspaces, number_of_workspaces*sizeof(branch_scan_workspace));
+	for(i = number_of_branch_scan_workspaces; i < number_of_workspaces; i++)
+	{
+		initialise_seq_arena(&(branch_scan_workspaces[i].scratch_arena));
+	}
+	number_of_branch_scan_workspaces = number_of_workspaces;
+}
+
+branch_scan_workspace * get_branch_scan_workspace(int workspace_index)
+{
+	allocate_branch_scan_workspaces(workspace_index + 1);
+	return &branch_scan_workspaces[workspace_index];
+}
+
+void reset_branch_scan_workspace(branch_scan_workspace * workspace)
+{
+	seq_arena_mark empty_mark;
+	empty_mark.chunk = NULL;
+	empty_mark.used = 0;
+	seq_arena_rewind(&(workspace->scratch_arena), empty_mark);
+}
+
+void free_branch_scan_workspaces()
+{
+	int i;
+	for(i = 0; i < number_of_branch_scan_workspaces; i++)
+	{
+		free_seq_arena(&(branch_scan_workspaces[i].scratch_arena));
+	}
+	free(branch_scan_workspaces);
+	branch_scan_workspaces = NULL;
+	number_of_branch_scan_workspaces = 0;
+}
+
+FILE * open_branch_scan_buffer(char ** buffer, size_t * buffer_size)
+{
+	FILE * buffer_file_pointer = open_memstream(buffer, buffer_size);
+	if(buffer_file_pointer == NULL)
+	{
+		printf("Couldnt allocate an output buffer for scanning branches\n");
+		exit(1);
+	}
+	return buffer_file_pointer;
+}
+
+// Closing the stream can move the buffer, so it is only read through the pointer afterwards
+void flush_branch_scan_buffer(FILE * buffer_file_pointer, char ** buffer, size_t * buffer_size, FILE * output_file_pointer)
+{
+	if(buffer_file_pointer == NULL)
+	{
+		return;
+	}
+	fclose(buffer_file_pointer);
+	fwrite(*buffer, sizeof(char), *buffer_size, output_file_pointer);
+	fflush(output_file_pointer);
+	free(*buffer);
+	*buffer = NULL;
+}
+
+// Outputs which werent selected stay unopened here as well
+void open_branch_scan_task_buffers(branch_scan_task * task, FILE * block_file_pointer, FILE * gff_file_pointer, FILE * branch_snps_file_pointer)
+{
+	task->block_file_pointer = block_file_pointer == NULL ? NULL : open_branch_scan_buffer(&(task->block_buffer), &(task->block_buffer_size));
+	task->gff_file_pointer = gff_file_pointer == NULL ? NULL : open_branch_scan_buffer(&(task->gff_buffer), &(task->gff_buffer_size));
+	task->branch_snps_file_pointer = branch_snps_file_pointer == NULL ? NULL : open_branch_scan_buffer(&(task->branch_snps_buffer), &(task->branch_snps_buffer_size));
+}
 
-		// generate pointers for each child seuqn
+void flush_branch_scan_task_buffers(branch_scan_task * task, FILE * block_file_pointer, FILE * gff_file_pointer, FILE * branch_snps_file_pointer)
+{
+	double trace_start = start_trace_event();
+	flush_branch_scan_buffer(task->branch_snps_file_pointer, &(task->branch_snps_buffer), &(task->branch_snps_buffer_size), branch_snps_file_pointer);
+	flush_branch_scan_buffer(task->block_file_pointer, &(task->block_buffer), &(task->block_buffer_size), block_file_pointer);
+	flush_branch_scan_buffer(task->gff_file_pointer, &(task->gff_buffer), &(task->gff_buffer_size), gff_file_pointer);
+	end_trace_event("flush_branch_scan_buffers", task->child_node->current_node_id, trace_start);
+}
 
-		while (child != NULL)
+void * scan_branches_worker(void * pool_pointer)
+{
+	branch_scan_pool * pool = (branch_scan_pool *) pool_pointer;
+	pthread_mutex_lock(&(pool->task_lock));
+	branch_scan_workspace * workspace = &branch_scan_workspaces[pool->next_workspace];
+	pool->next_workspace++;
+	pthread_mutex_unlock(&(pool->task_lock));
+	while(1)
+	{
+		pthread_mutex_lock(&(pool->task_lock));
+		int task_index = pool->next_task;
+		pool->next_task++;
+		pthread_mutex_unlock(&(pool->task_lock));
+		if(task_index >= pool->number_of_tasks)
 		{
-			// recursion
-			child_sequences[child_counter] = generate_branch_sequences(child->node, vcf_file_pointer, snp_locations, number_of_snps, column_names, number_of_columns,  child_sequences[child_counter],length_of_original_genome, block_file_pointer,gff_file_pointer,min_snps,branch_snps_file_pointer, window_min, window_max);
-			child_nodes[child_counter] = child->node;
-			
-			char delimiter_string[3] = {" "};
-			concat_strings_created_with_malloc(root->taxon_names, delimiter_string);
-			concat_strings_created_with_malloc(root->taxon_names, child_nodes[child_counter]->taxon_names);
-			
-			child_counter++;
-			child = child->next;
+			break;
 		}
 		
-		// For all bases update the parent sequence with N if all child sequences.
-		
-		leaf_sequence = (char *) calloc((number_of_snps +1),sizeof(char));
-		// All child sequneces should be available use them to find the ancestor sequence
-		get_sequence_for_sample_name(leaf_sequence, root->taxon);
-		
-		branch_genome_size = calculate_size_of_genome_without_gaps(leaf_sequence, 0,number_of_snps, length_of_original_genome);
-		set_genome_length_without_gaps_for_sample(root->taxon,branch_genome_size);
-		
-		
-		
-		for(current_branch = 0 ; current_branch< (root->childNum); current_branch++)
+		branch_scan_task * task = &(pool->tasks[task_index]);
+		scan_branch(task->child_node, task->child_sequence, pool->root, pool->leaf_sequence, pool->snp_locations, pool->number_of_snps, pool->length_of_original_genome, task->block_file_pointer, task->gff_file_pointer, task->branch_snps_file_pointer, pool->min_snps, pool->window_min, pool->window_max, workspace);
+	}
+	return NULL;
+}
+
+// Scan the branches to each child at the same time. Each scan writes to its own in memory buffers which are
+// then copied to the output files in the order of the children, so the output matches a single threaded run.
+void scan_branches_in_parallel(newick_node ** child_nodes, const char ** child_sequences, int number_of_children, newick_node * root, const char * leaf_sequence, int * snp_locations, int number_of_snps, int length_of_original_genome, FILE * block_file_pointer, FILE * gff_file_pointer, FILE * branch_snps_file_pointer, int min_snps, int window_min, int window_max, int num_threads)
+{
+	int i = 0;
+	branch_scan_pool pool;
+	pool.tasks = (branch_scan_task *) calloc(number_of_children, sizeof(branch_scan_task));
+	pool.number_of_tasks = number_of_children;
+	pool.next_task = 0;
+	pool.next_workspace = 0;
+	pool.root = root;
+	pool.leaf_sequence = leaf_sequence;
+	pool.snp_locations = snp_locations;
+	pool.number_of_snps = number_of_snps;
+	pool.length_of_original_genome = length_of_original_genome;
+	pool.min_snps = min_snps;
+	pool.window_min = window_min;
+	pool.window_max = window_max;
+	pthread_mutex_init(&(pool.task_lock), NULL);
+	
+	for(i = 0; i < number_of_children; i++)
+	{
+		pool.tasks[i].child_node = child_nodes[i];
+		pool.tasks[i].child_sequence = child_sequences[i];
+		open_branch_scan_task_buffers(&(pool.tasks[i]), block_file_pointer, gff_file_pointer, branch_snps_file_pointer);
+	}
+	
+	int number_of_workers = num_threads;
+	if(number_of_workers > number_of_children)
+	{
+		number_of_workers = number_of_children;
+	}
+	pthread_t workers[number_of_workers];
+	allocate_branch_scan_workspaces(number_of_workers);
+	for(i = 0; i < number_of_workers; i++)
+	{
+		if(pthread_create(&workers[i], NULL, scan_branches_worker, &pool) != 0)
 		{
-			int * branches_snp_sites;
-			branches_snp_sites = (int *) calloc((number_of_snps +1),sizeof(int));
-			char * branch_snp_sequence;
-			char * branch_snp_ancestor_sequence;
-			branch_snp_sequence = (char *) calloc((number_of_snps +1),sizeof(char));
-			branch_snp_ancestor_sequence = (char *) calloc((number_of_snps +1),sizeof(char));
-			
-			branch_genome_size = calculate_size_of_genome_without_gaps(child_sequences[current_branch], 0,number_of_snps, length_of_original_genome);
-			number_of_branch_snps = calculate_number_of_snps_excluding_gaps(leaf_sequence, child_sequences[current_branch], number_of_snps, branches_snp_sites, snp_locations,branch_snp_sequence,branch_snp_ancestor_sequence);
-			
-			
-			child_nodes[current_branch]->number_of_snps = number_of_branch_snps;
-			print_branch_snp_details(branch_snps_file_pointer, child_nodes[current_branch]->taxon,root->taxon, branches_snp_sites, number_of_branch_snps, branch_snp_sequence, branch_snp_ancestor_sequence,child_nodes[current_branch]->taxon_names);
-			
-			get_likelihood_for_windows(child_sequences[current_branch], number_of_snps, branches_snp_sites, branch_genome_size, number_of_branch_snps,snp_locations, child_nodes[current_branch], block_file_pointer, root, branch_snp_sequence,gff_file_pointer,min_snps,length_of_original_genome,leaf_sequence, window_min, window_max);
-			free(branch_snp_sequence);
-			free(branch_snp_ancestor_sequence);
-			free(child_sequences[current_branch]);
-			free(branches_snp_sites);
-			
+			printf("Couldnt create a thread for scanning branches\n");
+			exit(1);
 		}
-		
-		return leaf_sequence;
 	}
+	for(i = 0; i < number_of_workers; i++)
+	{
+		pthread_join(workers[i], NULL);
+	}
+	
+	for(i = 0; i < number_of_children; i++)
+	{
+		flush_branch_scan_task_buffers(&(pool.tasks[i]), block_file_pointer, gff_file_pointer, branch_snps_file_pointer);
+	}
+	pthread_mutex_destroy(&(pool.task_lock));
+	free(pool.tasks);
 }
 
 
@@ -377,7 +975,7 @@ int calculate_window_size(int branch_genome_size, int number_of_branch_snps,int
 }
 
 
-void get_likelihood_for_windows(char * child_sequence, int length_of_sequence, int * snp_site_coords, int branch_genome_size, int number_of_branch_snps, int * snp_locations, newick_node * current_node, FILE * block_file_pointer, newick_node *root, char * branch_snp_sequence, FILE * gff_file_pointer, int min_snps, int length_of_original_genome, char * original_sequence,int window_min, int window_max)
+void get_likelihood_for_windows(const char * child_sequence, int length_of_sequence, int * snp_site_coords, int branch_genome_size, int number_of_branch_snps, int * snp_locations, newick_node * current_node, FILE * block_file_pointer, newick_node *root, FILE * gff_file_pointer, int min_snps, int length_of_original_genome, const char * original_sequence,int window_min, int window_max, seq_arena * scratch_arena)
 {
 	int i = 0;
 	int window_size = 0;
@@ -389,50 +987,47 @@ void get_likelihood_for_windows(char * child_sequence, int length_of_sequence, i
 	double block_snp_density = 0.0;
 	int number_of_blocks = 0 ;
 	int original_branch_genome_size = branch_genome_size;
+	branch_profile counters;
+	double trace_start = start_trace_event();
+	memset(&counters, 0, sizeof(branch_profile));
+	counters.number_of_snps = number_of_branch_snps;
 
 	// place to store coordinates of recombinations snps
 	current_node->recombinations = (int *) calloc((number_of_branch_snps+1),sizeof(int));
 	
 	int number_of_windows = (branch_genome_size/window_min) + 1;
-	int * block_coordinates[4];
-	block_coordinates[0] = (int *) calloc((number_of_windows+1),sizeof(int));
-	block_coordinates[1] = (int *) calloc((number_of_windows+1),sizeof(int));
-	block_coordinates[2] = (int *) calloc((number_of_windows+1),sizeof(int));
-	block_coordinates[3] = (int *) calloc((number_of_windows+1),sizeof(int));
+	candidate_block * blocks;
+	blocks = (candidate_block *) seq_arena_malloc(scratch_arena, (number_of_windows+1)*sizeof(candidate_block));
 	
-	double * block_likelihoods;	
-	block_likelihoods = (double *) calloc((number_of_windows+1),sizeof(double));
+	// Gaps in the child sequence, for counting the bases in a block without rescanning it
+	int * gap_prefix_counts;
+	gap_prefix_counts = (int *) seq_arena_malloc(scratch_arena, (length_of_sequence+1)*sizeof(int));
+	calculate_gap_prefix_counts(child_sequence, length_of_sequence, gap_prefix_counts);
 
 	while(number_of_branch_snps > min_snps)
 	{
-		if(number_of_branch_snps <= min_snps)
-		{
-			free(block_coordinates[0]) ;
-			free(block_coordinates[1]) ;
-			free(block_coordinates[2]) ;
-			free(block_coordinates[3]) ;
-			free(block_likelihoods);
-			return;
-		}
+		counters.number_of_passes++;
 		branch_snp_density = snp_density(branch_genome_size, number_of_branch_snps);
 
 		window_size = calculate_window_size(branch_genome_size, number_of_branch_snps,window_min,window_max);
 
     int cutoff = calculate_cutoff(branch_genome_size, window_size, number_of_branch_snps);
 
-		number_of_blocks = get_blocks(block_coordinates, length_of_original_genome, snp_site_coords, number_of_branch_snps,  window_size, cutoff, child_sequence,snp_locations,length_of_sequence);
+		double get_blocks_trace_start = start_trace_event();
+		number_of_blocks = get_blocks(blocks, length_of_original_genome, snp_site_coords, number_of_branch_snps,  window_size, cutoff, child_sequence,snp_locations,length_of_sequence, scratch_arena);
+		end_trace_event("get_blocks", current_node->current_node_id, get_blocks_trace_start);
+		counters.number_of_windows += number_of_blocks;
 
 
 		for(i = 0; i < number_of_blocks; i++)
 		{
-			number_of_snps_in_block = find_number_of_snps_in_block(block_coordinates[0][i], block_coordinates[1][i], snp_site_coords, branch_snp_sequence, number_of_branch_snps);
-			block_genome_size_without_gaps = calculate_block_size_without_gaps(child_sequence, snp_locations, block_coordinates[0][i], block_coordinates[1][i], length_of_sequence);
+			number_of_snps_in_block = find_number_of_snps_in_block_with_prefix_index(blocks[i].start, blocks[i].end, snp_site_coords, number_of_branch_snps);
+			block_genome_size_without_gaps = calculate_block_size_without_gaps_with_prefix_index(gap_prefix_counts, snp_locations, blocks[i].start, blocks[i].end, length_of_sequence);
 
 			// minimum number of snps to be statistically significant in block
 			if(number_of_snps_in_block <= min_snps)
 			{
-				block_coordinates[0][i] = -1;
-				block_coordinates[1][i] = -1;
+				blocks[i].live = 0;
 				continue;
 			}
 			
@@ -440,449 +1035,547 @@ void get_likelihood_for_windows(char * child_sequence, int length_of_sequence, i
 			// region with low number of snps so skip over
 			if(block_snp_density <= branch_snp_density)
 			{
-				block_coordinates[0][i] = -1;
-				block_coordinates[1][i] = -1;
+				blocks[i].live = 0;
 				continue;	
 			}
 			
-			block_likelihoods[i] = get_block_likelihood(branch_genome_size, number_of_branch_snps, block_genome_size_without_gaps, number_of_snps_in_block);
-			block_coordinates[2][i] = (int) block_likelihoods[i];
-			block_coordinates[3][i] = block_genome_size_without_gaps;
+			blocks[i].snp_count = number_of_snps_in_block;
+			blocks[i].genome_size_without_gaps = block_genome_size_without_gaps;
+			blocks[i].likelihood = get_block_likelihood(branch_genome_size, number_of_branch_snps, block_genome_size_without_gaps, number_of_snps_in_block);
 		}
 
-		move_blocks_inwards_while_likelihood_improves(number_of_blocks,block_coordinates, min_snps, snp_site_coords, number_of_branch_snps, branch_snp_sequence, snp_locations, branch_genome_size, child_sequence, length_of_sequence,block_likelihoods,cutoff);
+		counters.number_of_trimming_steps += move_blocks_inwards_while_likelihood_improves(number_of_blocks, blocks, min_snps, snp_site_coords, number_of_branch_snps, snp_locations, branch_genome_size, length_of_sequence, cutoff, gap_prefix_counts);
 
-		int * candidate_blocks[4];
-		candidate_blocks[0] = (int *) calloc((number_of_blocks+1),sizeof(int));
-		candidate_blocks[1] = (int *) calloc((number_of_blocks+1),sizeof(int));
-		candidate_blocks[2] = (int *) calloc((number_of_blocks+1),sizeof(int));
-		candidate_blocks[3] = (int *) calloc((number_of_blocks+1),sizeof(int));
-		
-		double * candidate_block_likelihoods;
-		candidate_block_likelihoods = (double *) calloc((number_of_blocks+1),sizeof(double));
-		
+		// The significant blocks are packed in order at the front, since the rest arent needed again
 		int number_of_candidate_blocks = 0;
-
 		for(i = 0 ; i < number_of_blocks; i++)
 		{
-			if(block_coordinates[0][i] == -1 || block_coordinates[1][i] == -1)
+			if(blocks[i].live == 0)
 			{
 				continue;
 			}
-			int current_start = block_coordinates[0][i];
-			int current_end = block_coordinates[1][i];
-		  int block_snp_count = find_number_of_snps_in_block(current_start, current_end, snp_site_coords, branch_snp_sequence, number_of_branch_snps);
-		  int block_genome_size_without_gaps = block_coordinates[3][i];
-
-			if(p_value_test(branch_genome_size, block_genome_size_without_gaps, number_of_branch_snps, block_snp_count, min_snps) == 1)
+			if(p_value_test(branch_genome_size, blocks[i].genome_size_without_gaps, number_of_branch_snps, blocks[i].snp_count, min_snps) == 1)
 			{
-				
-				candidate_blocks[0][number_of_candidate_blocks] = block_coordinates[0][i];
-				candidate_blocks[1][number_of_candidate_blocks] = block_coordinates[1][i];
-				// TODO use a float in a struct here, should be okay for the moment but assumes that there will be a clear integer difference between best and second best
-				candidate_blocks[2][number_of_candidate_blocks] = block_coordinates[2][i];
-				candidate_blocks[3][number_of_candidate_blocks] = block_genome_size_without_gaps;
-				
-				candidate_block_likelihoods[number_of_candidate_blocks] = block_likelihoods[i];
+				blocks[number_of_candidate_blocks] = blocks[i];
 				number_of_candidate_blocks++;
 			}
 		}
+		counters.number_of_candidate_blocks += number_of_candidate_blocks;
 		if(number_of_candidate_blocks == 0 )
 		{
-			free(block_coordinates[0]) ;
-			free(block_coordinates[1]) ;
-			free(block_coordinates[2]) ;
-			free(block_coordinates[3]) ;
-			free(block_likelihoods);
-			free(candidate_blocks[0]);
-		  free(candidate_blocks[1]);
-		  free(candidate_blocks[2]);
-		  free(candidate_blocks[3]);
-			free(candidate_block_likelihoods);
-			
-			int new_recombination_size = (current_node->num_recombinations+1)*sizeof(int);
-			if(new_recombination_size > 1024)
-			{
-			  current_node->recombinations = (int *) realloc(current_node->recombinations, new_recombination_size);
-		  }
-			return;	
+			break;
+		}
+		number_of_branch_snps = flag_smallest_log_likelihood_recombinations(blocks, number_of_candidate_blocks, number_of_branch_snps, snp_site_coords, current_node->recombinations, current_node->num_recombinations,current_node, block_file_pointer, root, snp_locations, length_of_sequence,gff_file_pointer);
+		if(multi_block_acceptance == 1)
+		{
+			number_of_branch_snps = flag_non_overlapping_recombinations(blocks, number_of_candidate_blocks, number_of_branch_snps, snp_site_coords, current_node, block_file_pointer, root, snp_locations, length_of_sequence, gff_file_pointer, original_branch_genome_size, min_snps);
 		}
-		number_of_branch_snps = flag_smallest_log_likelihood_recombinations(candidate_blocks, number_of_candidate_blocks, number_of_branch_snps, snp_site_coords, current_node->recombinations, current_node->num_recombinations,current_node, block_file_pointer, root, snp_locations, length_of_sequence,gff_file_pointer,candidate_block_likelihoods );
 		branch_genome_size = original_branch_genome_size  - current_node->total_bases_removed_excluding_gaps;
-	  free(candidate_blocks[0]);
-	  free(candidate_blocks[1]);
-	  free(candidate_blocks[2]);
-	  free(candidate_blocks[3]);
-		free(candidate_block_likelihoods);
-	
-	}
-	free(block_coordinates[0]) ;
-	free(block_coordinates[1]) ;
-	free(block_coordinates[2]) ;
-	free(block_coordinates[3]) ;
-	free(block_likelihoods);
+	
+	}
 	int new_recombination_size = (current_node->num_recombinations+1)*sizeof(int);
 	if(new_recombination_size > 1024)
 	{
 	  current_node->recombinations = (int *) realloc(current_node->recombinations, new_recombination_size);
   }
+	counters.number_of_accepted_blocks = current_node->number_of_blocks;
+	record_branch_profile(current_node->taxon, &counters);
+	end_trace_event("get_likelihood_for_windows", current_node->current_node_id, trace_start);
 }
 
-int extend_upper_part_of_window(int starting_coord, int initial_max_coord, int genome_size, int * gaps_in_original_genome_space)
+// The gaps are passed in as a sorted list of 0-based genome coordinates. Each gap crossed while walking
+// upwards from the snp pushes the end of the window out by one base.
+int extend_upper_part_of_window(int starting_coord, int initial_max_coord, int genome_size, int * gap_coordinates, int number_of_gaps)
 {
-		int max_snp_sliding_window_counter = initial_max_coord;
 		int upper_offset = 0;
-		int j = 0; 
-		for(j = starting_coord; (j < initial_max_coord + upper_offset) && (j < genome_size); j++)
+		int gap_index = find_first_index_greater_than_or_equal(starting_coord, gap_coordinates, number_of_gaps);
+		for(; gap_index < number_of_gaps; gap_index++)
 		{
-		  if(gaps_in_original_genome_space[j]  == 1)
+			if(gap_coordinates[gap_index] >= initial_max_coord + upper_offset || gap_coordinates[gap_index] >= genome_size)
 			{
-				upper_offset++;
+				break;
 			}
+			upper_offset++;
 		}
-
-		max_snp_sliding_window_counter = initial_max_coord + upper_offset;
-		return max_snp_sliding_window_counter;
+		return initial_max_coord + upper_offset;
 }
 
-int extend_lower_part_of_window(int starting_coord, int initial_min_coord, int genome_size, int * gaps_in_original_genome_space)
+int extend_lower_part_of_window(int starting_coord, int initial_min_coord, int * gap_coordinates, int number_of_gaps)
 {
 		int lower_offset = 0;
-		int snp_sliding_window_counter = initial_min_coord;
-		int j = 0; 
-		for(j = starting_coord; (j >= 0) && j > (initial_min_coord - lower_offset) && (initial_min_coord - lower_offset >= 0); j--)
+		int gap_index = find_first_index_greater_than_or_equal(starting_coord + 1, gap_coordinates, number_of_gaps) - 1;
+		for(; gap_index >= 0; gap_index--)
 		{
-			if(gaps_in_original_genome_space[j]  == 1)
+			if(initial_min_coord - lower_offset < 0 || gap_coordinates[gap_index] <= initial_min_coord - lower_offset)
 			{
-				lower_offset++;
+				break;
 			}
+			lower_offset++;
 		}
-		snp_sliding_window_counter = snp_sliding_window_counter - lower_offset;
-		return snp_sliding_window_counter;
+		return initial_min_coord - lower_offset;
 }
 
+int compare_integers(const void * a, const void * b)
+{
+	int first = *((const int *) a);
+	int second = *((const int *) b);
+	return (first > second) - (first < second);
+}
 
-int get_blocks(int ** block_coordinates, int genome_size,int * snp_site_coords,int number_of_branch_snps, int window_size, int cutoff, char * original_sequence, int * snp_locations, int number_of_snps)
+// Each snp has a window of influence around it. Rather than building a pileup across the whole genome,
+// the start and end of each window are sorted and swept over, so the work and memory are proportional
+// to the number of snps on the branch.
+int get_blocks(candidate_block * blocks, int genome_size,int * snp_site_coords,int number_of_branch_snps, int window_size, int cutoff, const char * original_sequence, int * snp_locations, int number_of_snps, seq_arena * scratch_arena)
 {
-	// Set up the window counter with 1 value per base in the branch
- 	int * window_count;
-	window_count = (int *) calloc((genome_size+1),sizeof(int));
-	
-	// Integer array with location of gaps
-	int * gaps_in_original_genome_space;
-	gaps_in_original_genome_space = (int *) calloc((genome_size+1),sizeof(int));
+	// The arrays here are only needed until the blocks are found
+	seq_arena_mark get_blocks_mark = seq_arena_get_mark(scratch_arena);
+	// Sorted 0-based coordinates of the gaps, taken from the snp sites
+	int * gap_coordinates;
+	gap_coordinates = (int *) seq_arena_malloc(scratch_arena, (number_of_snps+1)*sizeof(int));
+	int number_of_gaps = 0;
 	int x =0;
 	for(x=0; x< number_of_snps; x++)
 	{
 		if(original_sequence[x]  == 'N' || original_sequence[x]  == '-' )
 		{
-		  gaps_in_original_genome_space[snp_locations[x]-1] = 1;
+		  gap_coordinates[number_of_gaps] = snp_locations[x]-1;
+		  number_of_gaps++;
 	  }
 	}
 	
-	
-	// create the pileup of the snps and their sphere of influence
+	int * window_starts;
+	int * window_ends;
+	window_starts = (int *) seq_arena_malloc(scratch_arena, (number_of_branch_snps+1)*sizeof(int));
+	window_ends   = (int *) seq_arena_malloc(scratch_arena, (number_of_branch_snps+1)*sizeof(int));
+	int number_of_blocks = 0;
 	int snp_counter = 0;
-	for(snp_counter = 0; snp_counter < number_of_branch_snps; snp_counter++)
+	
+	// The windows are clipped to the contig of their snp, and each contig is swept on its own so no block crosses into the next
+	int contig_index;
+	for(contig_index = 0; contig_index < get_number_of_contigs(); contig_index++)
 	{
-		int j = 0;
-		// Lower bound of the window around a snp
-		int snp_sliding_window_counter = snp_site_coords[snp_counter]-(window_size/2);
+		int contig_start = get_contig_start(contig_index);
+		int contig_end = get_contig_end(contig_index, genome_size);
+		int first_snp_in_contig = find_first_index_greater_than_or_equal(contig_start + 1, snp_site_coords, number_of_branch_snps);
+		int last_contig = (contig_index == get_number_of_contigs() - 1);
+		int number_of_windows = 0;
 		
-		snp_sliding_window_counter = extend_lower_part_of_window(snp_site_coords[snp_counter] - 1 , snp_sliding_window_counter, genome_size,  gaps_in_original_genome_space);
-	
-		if(snp_sliding_window_counter < 0)
+		// find the sphere of influence of each snp, with any past the end of the genome left in the last contig
+		for(snp_counter = first_snp_in_contig; snp_counter < number_of_branch_snps && (last_contig || snp_site_coords[snp_counter] <= contig_end); snp_counter++)
 		{
-			snp_sliding_window_counter = 0;
+			// Lower bound of the window around a snp
+			int snp_sliding_window_counter = snp_site_coords[snp_counter]-(window_size/2);
+			snp_sliding_window_counter = extend_lower_part_of_window(snp_site_coords[snp_counter] - 1 , snp_sliding_window_counter, gap_coordinates, number_of_gaps);
+			if(snp_sliding_window_counter < contig_start)
+			{
+				snp_sliding_window_counter = contig_start;
+			}
+			
+			// Upper bound of the window around a snp
+			int max_snp_sliding_window_counter = snp_site_coords[snp_counter]+(window_size/2);
+			max_snp_sliding_window_counter = extend_upper_part_of_window(snp_site_coords[snp_counter] + 1, max_snp_sliding_window_counter, contig_end, gap_coordinates, number_of_gaps);
+			if(max_snp_sliding_window_counter>contig_end)
+			{
+				max_snp_sliding_window_counter = contig_end;
+			}
+			
+			if(snp_sliding_window_counter < max_snp_sliding_window_counter)
+			{
+				window_starts[number_of_windows] = snp_sliding_window_counter;
+				window_ends[number_of_windows] = max_snp_sliding_window_counter;
+				number_of_windows++;
+			}
 		}
-		
-		// Upper bound of the window around a snp
-		int max_snp_sliding_window_counter = snp_site_coords[snp_counter]+(window_size/2);
-		max_snp_sliding_window_counter = extend_upper_part_of_window(snp_site_coords[snp_counter] + 1, max_snp_sliding_window_counter, genome_size, gaps_in_original_genome_space);
-		
-		if(max_snp_sliding_window_counter>genome_size)
+		qsort(window_starts, number_of_windows, sizeof(int), compare_integers);
+		qsort(window_ends, number_of_windows, sizeof(int), compare_integers);
+		number_of_blocks = get_blocks_from_windows(blocks, number_of_blocks, window_starts, window_ends, number_of_windows, contig_end, cutoff);
+	}
+	
+  // Move blocks inwards to next SNP
+	int i;
+	for(i = 0; i < number_of_blocks; i++)
+	{
+		snp_counter = find_first_index_greater_than_or_equal(blocks[i].start, snp_site_coords, number_of_branch_snps);
+		if(snp_counter < number_of_branch_snps)
 		{
-			max_snp_sliding_window_counter = genome_size;
+			blocks[i].start = snp_site_coords[snp_counter];
 		}
 		
-		for(j = snp_sliding_window_counter; j < max_snp_sliding_window_counter; j++)
+		snp_counter = find_first_index_greater_than_or_equal(blocks[i].end + 1, snp_site_coords, number_of_branch_snps) - 1;
+		if(snp_counter >= 0)
 		{
-			window_count[j] += 1;	
+			blocks[i].end = snp_site_coords[snp_counter];
 		}
 	}
-	
-	int number_of_blocks = 0;
+
+	seq_arena_rewind(scratch_arena, get_blocks_mark);
+	return number_of_blocks;
+
+}
+
+// Sweep across the sorted window boundaries of a contig and add the blocks where more windows overlap than the cutoff
+int get_blocks_from_windows(candidate_block * blocks, int number_of_blocks, int * window_starts, int * window_ends, int number_of_windows, int contig_end, int cutoff)
+{
 	int in_block = 0;
 	int block_lower_bound = 0;
-	// Scan across the pileup and record where blocks are above the cutoff
-	int i;
-	for(i = 0; i < genome_size; i++)
+	int window_depth = 0;
+	int start_counter = 0;
+	int end_counter = 0;
+	while(start_counter < number_of_windows || end_counter < number_of_windows)
 	{
-		// Just entered the start of a block
-		if(window_count[i] > cutoff && in_block == 0)
+		int position = window_ends[end_counter];
+		if(start_counter < number_of_windows && window_starts[start_counter] < position)
 		{
-			block_lower_bound = i;
-			in_block = 1;
-    }
-
-		// Just left a block
-		if((window_count[i] <= cutoff || i+1 == genome_size ) && in_block == 1)
+			position = window_starts[start_counter];
+		}
+		if(position >= contig_end)
 		{
-			block_coordinates[0][number_of_blocks] = block_lower_bound;
-			block_coordinates[1][number_of_blocks] = i-1;
-			number_of_blocks++;
-			in_block = 0;
+			break;
 		}
 		
-	}
-
-  // Move blocks inwards to next SNP
-	for(i = 0; i < number_of_blocks; i++)
-	{		
-		for(snp_counter = 0; snp_counter < number_of_branch_snps; snp_counter++)
+		while(start_counter < number_of_windows && window_starts[start_counter] == position)
 		{
-			if(snp_site_coords[snp_counter] >= block_coordinates[0][i] )
-			{
-				block_coordinates[0][i] = snp_site_coords[snp_counter];
-				break;
-			}
+			window_depth++;
+			start_counter++;
+		}
+		while(end_counter < number_of_windows && window_ends[end_counter] == position)
+		{
+			window_depth--;
+			end_counter++;
 		}
 		
-		for(snp_counter = number_of_branch_snps-1; snp_counter >= 0 ; snp_counter--)
+		// Just entered the start of a block
+		if(window_depth > cutoff && in_block == 0)
 		{
-			if(snp_site_coords[snp_counter] <= block_coordinates[1][i] )
-			{
-				block_coordinates[1][i] = snp_site_coords[snp_counter];
-				break;
-			}
+			block_lower_bound = position;
+			in_block = 1;
+		}
+		// Just left a block
+		else if(window_depth <= cutoff && in_block == 1)
+		{
+			initialise_candidate_block(&blocks[number_of_blocks], block_lower_bound, position-1);
+			number_of_blocks++;
+			in_block = 0;
 		}
 	}
-
-
-	free(gaps_in_original_genome_space);
-	free(window_count);
+	
+	// A block which runs to the end of the contig stops one base short of it
+	if(in_block == 1)
+	{
+		initialise_candidate_block(&blocks[number_of_blocks], block_lower_bound, contig_end-2);
+		number_of_blocks++;
+	}
 	return number_of_blocks;
+}
 
+// The snp count, size and likelihood are filled in when the block is scored
+void initialise_candidate_block(candidate_block * block, int start, int end)
+{
+	block->start = start;
+	block->end = end;
+	block->snp_count = 0;
+	block->genome_size_without_gaps = -1;
+	block->likelihood = 0.0;
+	block->live = 1;
 }
 
 
 
-void move_blocks_inwards_while_likelihood_improves(int number_of_blocks,int ** block_coordinates, int min_snps, int * snp_site_coords,  int number_of_branch_snps,char * branch_snp_sequence, int * snp_locations, int branch_genome_size,char * child_sequence, int length_of_sequence, double * block_likelihoods, int cutoff_value)
+int move_blocks_inwards_while_likelihood_improves(int number_of_blocks, candidate_block * blocks, int min_snps, int * snp_site_coords,  int number_of_branch_snps, int * snp_locations, int branch_genome_size, int length_of_sequence, int cutoff_value, int * gap_prefix_counts)
 {
 	int i;
+	// The number of times a block edge moved in, for the profile
+	int number_of_trimming_steps = 0;
 	
-	int previous_start;
-	int previous_end;
+	int previous_start = -1;
+	int previous_end = -1;
 	
+	// Only the first of a run of blocks with the same coordinates is kept
 	for(i = 0 ; i < number_of_blocks; i++)
 	{
-		int current_start = block_coordinates[0][i];
-		int current_end = block_coordinates[1][i];
-		int start_index = find_starting_index( current_start, snp_site_coords,0, number_of_branch_snps);
-    int end_index   = find_starting_index( current_end, snp_site_coords, start_index, number_of_branch_snps);
-		if( i == 0)
+		if(blocks[i].live == 0)
 		{
-			previous_start = block_coordinates[0][i];
-			previous_end = block_coordinates[1][i];
+			previous_start = -1;
+			previous_end = -1;
 		}
-		else if(previous_start == block_coordinates[0][i] && previous_end == block_coordinates[1][i] && i > 0)
+		else if(previous_start == blocks[i].start && previous_end == blocks[i].end)
 		{
-			block_coordinates[0][i] = -1;
-			block_coordinates[1][i] = -1;
+			blocks[i].live = 0;
 		}
 		else
 		{
-			previous_start = block_coordinates[0][i];
-			previous_end = block_coordinates[1][i];
+			previous_start = blocks[i].start;
+			previous_end = blocks[i].end;
 		}
 	}
 	
 	
 	for(i = 0 ; i < number_of_blocks; i++)
 	{
-		if(block_coordinates[0][i] == -1 || block_coordinates[1][i] == -1)
+		if(blocks[i].live == 0)
 		{
 			continue;
 		}
 		
-		int current_start = block_coordinates[0][i];
-		int current_end = block_coordinates[1][i];
-		double current_block_likelihood = 0;
-		int block_genome_size_without_gaps = block_coordinates[3][i];
-		int block_snp_count;
-		
-	  int next_start_position = current_start;
-		int start_index = find_starting_index( current_start, snp_site_coords,0, number_of_branch_snps);
-    int end_index =  find_starting_index( current_end, snp_site_coords, start_index, number_of_branch_snps);
-
-		block_snp_count = find_number_of_snps_in_block_with_start_end_index(current_start, current_end, snp_site_coords, branch_snp_sequence, number_of_branch_snps,start_index,end_index);
-    
-		if(block_genome_size_without_gaps == -1)
+		blocks[i].snp_count = find_number_of_snps_in_block_with_prefix_index(blocks[i].start, blocks[i].end, snp_site_coords, number_of_branch_snps);
+		if(blocks[i].genome_size_without_gaps == -1)
 		{
-			
-			block_genome_size_without_gaps = calculate_block_size_without_gaps(child_sequence, snp_locations, current_start, current_end, length_of_sequence);
-			block_coordinates[2][i] = current_block_likelihood;
-			block_coordinates[3][i] = block_genome_size_without_gaps;
+			blocks[i].genome_size_without_gaps = calculate_block_size_without_gaps_with_prefix_index(gap_prefix_counts, snp_locations, blocks[i].start, blocks[i].end, length_of_sequence);
 		}
-		current_block_likelihood = get_block_likelihood(branch_genome_size, number_of_branch_snps, block_genome_size_without_gaps, block_snp_count);
+		blocks[i].likelihood = get_block_likelihood(branch_genome_size, number_of_branch_snps, blocks[i].genome_size_without_gaps, blocks[i].snp_count);
+		
+		// Move left inwards while the likelihood gets better, then right
+		number_of_trimming_steps += move_block_edge_inwards(&blocks[i], 1, min_snps, snp_site_coords, number_of_branch_snps, snp_locations, branch_genome_size, length_of_sequence, gap_prefix_counts);
+		number_of_trimming_steps += move_block_edge_inwards(&blocks[i], 0, min_snps, snp_site_coords, number_of_branch_snps, snp_locations, branch_genome_size, length_of_sequence, gap_prefix_counts);
+	}	
+	return number_of_trimming_steps;
+}
+
 
 
-		// Move left inwards while the likelihood gets better
-		while(current_start < current_end && block_snp_count >= min_snps)
+// Moves the start or the end of the block one snp at a time for as long as the likelihood doesnt get worse. The edge
+// only ever steps to the next branch snp, so the snp counts come from the index of that snp and the gaps from a search
+// which starts where the last one stopped. The next few positions are scored together, one to begin with since most
+// edges dont move, and twice as many each time they all improve. Returns the number of moves.
+int move_block_edge_inwards(candidate_block * block, int move_start, int min_snps, int * snp_site_coords, int number_of_branch_snps, int * snp_locations, int branch_genome_size, int length_of_sequence, int * gap_prefix_counts)
+{
+	int edge_positions[MAX_BLOCK_EDGE_BATCH];
+	int edge_snp_counts[MAX_BLOCK_EDGE_BATCH];
+	int edge_genome_sizes[MAX_BLOCK_EDGE_BATCH];
+	double edge_likelihoods[MAX_BLOCK_EDGE_BATCH];
+	int number_of_moves = 0;
+	int batch_size = 1;
+	
+	// The edge which isnt moving, as indexes into the branch snps and all the snps
+	int fixed_snp_index;
+	int fixed_gap_index;
+	// The next branch snp the edge could move to, and the search bound for its index in all the snps
+	int snp_index;
+	int gap_index;
+	if(move_start)
+	{
+		fixed_snp_index = find_first_index_greater_than_or_equal(block->end, snp_site_coords, number_of_branch_snps);
+		fixed_gap_index = find_first_index_greater_than_or_equal(block->end, snp_locations, length_of_sequence);
+		snp_index = find_first_index_greater_than_or_equal(block->start + 1, snp_site_coords, number_of_branch_snps);
+		gap_index = 0;
+	}
+	else
+	{
+		fixed_snp_index = find_first_index_greater_than_or_equal(block->start, snp_site_coords, number_of_branch_snps);
+		fixed_gap_index = find_first_index_greater_than_or_equal(block->start, snp_locations, length_of_sequence);
+		snp_index = find_first_index_greater_than_or_equal(block->end, snp_site_coords, number_of_branch_snps) - 1;
+		gap_index = length_of_sequence;
+	}
+	
+	while(block->start < block->end && block->snp_count >= min_snps)
+	{
+		int number_of_edges = 0;
+		int reached_other_edge = 0;
+		while(number_of_edges < batch_size)
 		{
-			  next_start_position++;
-			  next_start_position = advance_window_start_to_next_snp(next_start_position, snp_site_coords, branch_snp_sequence, number_of_branch_snps);
-			
-				if(next_start_position >= current_end)
+			int position;
+			if(move_start)
+			{
+				if(snp_index >= number_of_branch_snps || snp_site_coords[snp_index] >= block->end)
 				{
+					reached_other_edge = 1;
 					break;
 				}
-				if(next_start_position <= current_start)
+				position = snp_site_coords[snp_index];
+				gap_index += find_first_index_greater_than_or_equal(position, snp_locations + gap_index, length_of_sequence - gap_index);
+				edge_snp_counts[number_of_edges] = fixed_snp_index - snp_index;
+				edge_genome_sizes[number_of_edges] = (block->end - position) - (gap_prefix_counts[fixed_gap_index] - gap_prefix_counts[gap_index]);
+				for(snp_index++; snp_index < number_of_branch_snps && snp_site_coords[snp_index] == position; snp_index++);
+			}
+			else
+			{
+				if(snp_index < 0 || snp_site_coords[snp_index] <= block->start)
 				{
+					reached_other_edge = 1;
 					break;
 				}
-			
-				int previous_block_snp_count = block_snp_count;
-				int previous_block_genome_size_without_gaps = block_genome_size_without_gaps;
-			  block_snp_count = find_number_of_snps_in_block_with_start_end_index(next_start_position, current_end, snp_site_coords, branch_snp_sequence, number_of_branch_snps,start_index,end_index);
-			  block_genome_size_without_gaps = calculate_block_size_without_gaps(child_sequence, snp_locations, next_start_position, current_end, length_of_sequence);
-			  
-			  double next_block_likelihood = get_block_likelihood(branch_genome_size, number_of_branch_snps, block_genome_size_without_gaps, block_snp_count);
-				
-			if(next_block_likelihood <= current_block_likelihood)
-			  {
-			  	current_block_likelihood = next_block_likelihood;
-					current_start = next_start_position;
-					start_index++;
-			  }
-			  else
-			  {
-					block_snp_count = previous_block_snp_count;
-					block_genome_size_without_gaps = previous_block_genome_size_without_gaps;
-					break;
-			  }
+				position = snp_site_coords[snp_index];
+				// The snps at the end of a block arent counted in it, including any others at the same coordinate
+				for(; snp_index > 0 && snp_site_coords[snp_index-1] == position; snp_index--);
+				gap_index = fixed_gap_index + find_first_index_greater_than_or_equal(position, snp_locations + fixed_gap_index, gap_index - fixed_gap_index);
+				edge_snp_counts[number_of_edges] = snp_index - fixed_snp_index;
+				edge_genome_sizes[number_of_edges] = (position - block->start) - (gap_prefix_counts[gap_index] - gap_prefix_counts[fixed_gap_index]);
+				snp_index--;
+			}
+			edge_positions[number_of_edges] = position;
+			number_of_edges++;
 		}
-		
-		int next_end_position = current_end;
-		
-		// Move Right inwards while the likelihood gets better
-		while(current_start < current_end && block_snp_count >= min_snps)
+		if(number_of_edges == 0)
 		{
-			  next_end_position--;
-				next_end_position = rewind_window_end_to_last_snp(next_end_position, snp_site_coords, branch_snp_sequence, number_of_branch_snps);
-				
-				if(next_end_position <= current_start )
-				{
-					break;
-				}
-				if(next_end_position >= current_end)
-				{
-					break;
-				}
-				
-				int previous_block_snp_count = block_snp_count;
-				int previous_block_genome_size_without_gaps = block_genome_size_without_gaps;
-			  block_snp_count = find_number_of_snps_in_block(current_start, next_end_position, snp_site_coords, branch_snp_sequence, number_of_branch_snps);
-			  block_genome_size_without_gaps = calculate_block_size_without_gaps(child_sequence, snp_locations, current_start, next_end_position, length_of_sequence);
-			  
-			  double next_block_likelihood = get_block_likelihood(branch_genome_size, number_of_branch_snps, block_genome_size_without_gaps, block_snp_count);
-			  if(next_block_likelihood <= current_block_likelihood)
-			  {
-			  	current_block_likelihood = next_block_likelihood;
-					current_end = next_end_position;
-					end_index--;
-			  }
-			  else
-			  {
-					block_snp_count = previous_block_snp_count;
-					block_genome_size_without_gaps = previous_block_genome_size_without_gaps;
-					break;
-			  }
-			
+			break;
 		}
 		
-		  block_coordinates[0][i] = current_start;
-		  block_coordinates[1][i] = current_end;
-	  	block_coordinates[2][i] = (int) current_block_likelihood;
-		  block_coordinates[3][i] = block_genome_size_without_gaps;
-		
-		  block_likelihoods[i] = current_block_likelihood;
-	}	
+		get_block_likelihoods(branch_genome_size, number_of_branch_snps, edge_genome_sizes, edge_snp_counts, number_of_edges, edge_likelihoods);
+		int number_of_improving_moves = count_improving_block_edges(block->likelihood, edge_likelihoods, edge_snp_counts, number_of_edges, min_snps);
+		if(number_of_improving_moves > 0)
+		{
+			int last_move = number_of_improving_moves - 1;
+			if(move_start)
+			{
+				block->start = edge_positions[last_move];
+			}
+			else
+			{
+				block->end = edge_positions[last_move];
+			}
+			block->snp_count = edge_snp_counts[last_move];
+			block->genome_size_without_gaps = edge_genome_sizes[last_move];
+			block->likelihood = edge_likelihoods[last_move];
+			number_of_moves += number_of_improving_moves;
+		}
+		if(number_of_improving_moves < number_of_edges || reached_other_edge == 1)
+		{
+			break;
+		}
+		if(batch_size < MAX_BLOCK_EDGE_BATCH)
+		{
+			batch_size *= 2;
+		}
+	}
+	return number_of_moves;
 }
 
-
-
-int exclude_snp_sites_in_block(int window_start_coordinate, int window_end_coordinate, int * snp_site_coords, int number_of_branch_snps)
+// A move is taken if the likelihood is no worse than before it, and the block it starts from still has min_snps.
+// The stopping points are flagged for every edge first, without branches, so that loop can be vectorised.
+int count_improving_block_edges(double block_likelihood, double * edge_likelihoods, int * edge_snp_counts, int number_of_edges, int min_snps)
 {
 	int i;
-	// inefficient
-	int updated_snp_site_coords[number_of_branch_snps];
-	int number_of_branch_snps_excluding_block = 0 ;
-	
-	for(i = 0 ; i< number_of_branch_snps; i++)
+	int stops[MAX_BLOCK_EDGE_BATCH];
+	stops[0] = (edge_likelihoods[0] > block_likelihood);
+	for(i = 1; i < number_of_edges; i++)
 	{
-		if(snp_site_coords[i]>= window_start_coordinate && snp_site_coords[i] <= window_end_coordinate)
-		{
-		}
-		else
-		{
-			updated_snp_site_coords[number_of_branch_snps_excluding_block] = snp_site_coords[i];
-			number_of_branch_snps_excluding_block++;
-		}
+		stops[i] = (edge_likelihoods[i] > edge_likelihoods[i-1]) | (edge_snp_counts[i-1] < min_snps);
 	}
-	
-	for(i = 0; i < number_of_branch_snps_excluding_block; i++)
+	for(i = 0; i < number_of_edges; i++)
 	{
-	  snp_site_coords[i] = updated_snp_site_coords[i];
+		if(stops[i])
+		{
+			return i;
+		}
 	}
-	for(i=number_of_branch_snps_excluding_block; i< number_of_branch_snps; i++)
+	return number_of_edges;
+}
+
+// The branch snps are sorted, so the ones in the block are a single run which the rest are moved down over
+int exclude_snp_sites_in_block(int window_start_coordinate, int window_end_coordinate, int * snp_site_coords, int number_of_branch_snps)
+{
+	int first_snp_in_block = find_first_index_greater_than_or_equal(window_start_coordinate, snp_site_coords, number_of_branch_snps);
+	int first_snp_after_block = find_first_index_greater_than_or_equal(window_end_coordinate + 1, snp_site_coords, number_of_branch_snps);
+	if(first_snp_after_block <= first_snp_in_block)
 	{
-		snp_site_coords[i] = 0;
+		return number_of_branch_snps;
 	}
+	int number_of_snps_in_block = first_snp_after_block - first_snp_in_block;
+	int number_of_branch_snps_excluding_block = number_of_branch_snps - number_of_snps_in_block;
+	
+	memmove(snp_site_coords + first_snp_in_block, snp_site_coords + first_snp_after_block, (number_of_branch_snps - first_snp_after_block)*sizeof(int));
+	memset(snp_site_coords + number_of_branch_snps_excluding_block, 0, number_of_snps_in_block*sizeof(int));
 	
 	return number_of_branch_snps_excluding_block;
 }
 
-int flag_smallest_log_likelihood_recombinations(int ** candidate_blocks, int number_of_candidate_blocks, int number_of_branch_snps, int * snp_site_coords, int * recombinations, int number_of_recombinations,newick_node * current_node, FILE * block_file_pointer, newick_node *root,int * snp_locations, int total_num_snps, FILE * gff_file_pointer, double * block_likelihooods)
+int flag_smallest_log_likelihood_recombinations(candidate_block * candidate_blocks, int number_of_candidate_blocks, int number_of_branch_snps, int * snp_site_coords, int * recombinations, int number_of_recombinations,newick_node * current_node, FILE * block_file_pointer, newick_node *root,int * snp_locations, int total_num_snps, FILE * gff_file_pointer)
 {
 	int number_of_branch_snps_excluding_block = number_of_branch_snps;
 	if(number_of_candidate_blocks > 0)
 	{
 		int smallest_index = 0;
     int number_of_recombinations_in_window = 0;
-		smallest_index = get_smallest_log_likelihood(block_likelihooods, number_of_candidate_blocks);
-		number_of_recombinations_in_window = flag_recombinations_in_window(candidate_blocks[0][smallest_index], candidate_blocks[1][smallest_index],number_of_branch_snps, snp_site_coords, recombinations, number_of_recombinations,snp_locations,total_num_snps);	
+		smallest_index = get_smallest_log_likelihood(candidate_blocks, number_of_candidate_blocks);
+		candidate_block * block = &candidate_blocks[smallest_index];
+		number_of_recombinations_in_window = flag_recombinations_in_window(block->start, block->end,number_of_branch_snps, snp_site_coords, recombinations, number_of_recombinations,snp_locations,total_num_snps);	
     number_of_recombinations += number_of_recombinations_in_window;
-		number_of_branch_snps_excluding_block = exclude_snp_sites_in_block(candidate_blocks[0][smallest_index],candidate_blocks[1][smallest_index], snp_site_coords,number_of_branch_snps);
+		number_of_branch_snps_excluding_block = exclude_snp_sites_in_block(block->start, block->end, snp_site_coords,number_of_branch_snps);
 		
 		current_node->num_recombinations = number_of_recombinations;
 
-		print_block_details(block_file_pointer, candidate_blocks[0][smallest_index], candidate_blocks[1][smallest_index],  number_of_recombinations_in_window, current_node->taxon,  root->taxon, current_node->taxon_names, current_node->childNum, block_likelihooods[smallest_index]);
-		print_gff_line(gff_file_pointer, candidate_blocks[0][smallest_index], candidate_blocks[1][smallest_index],  number_of_recombinations_in_window, current_node->taxon,  root->taxon, current_node->taxon_names, block_likelihooods[smallest_index]);
+		print_block_details(block_file_pointer, block->start, block->end,  number_of_recombinations_in_window, current_node->taxon,  root->taxon, &(current_node->taxa), current_node->childNum, block->likelihood);
+		print_gff_line(gff_file_pointer, block->start, block->end,  number_of_recombinations_in_window, current_node->taxon,  root->taxon, &(current_node->taxa), block->likelihood);
 		current_node->number_of_blocks = current_node->number_of_blocks + 1;
 		
-		current_node->total_bases_removed_excluding_gaps = current_node->total_bases_removed_excluding_gaps  + candidate_blocks[3][smallest_index];
+		current_node->total_bases_removed_excluding_gaps = current_node->total_bases_removed_excluding_gaps  + block->genome_size_without_gaps;
 
 		current_node->block_coordinates[0] = realloc((int *)current_node->block_coordinates[0], ((int)current_node->number_of_blocks +1)*sizeof(int));
 		current_node->block_coordinates[1] = realloc((int *)current_node->block_coordinates[1], ((int)current_node->number_of_blocks +1)*sizeof(int));
 		
-		current_node->block_coordinates[0][current_node->number_of_blocks -1] = candidate_blocks[0][smallest_index];
-		current_node->block_coordinates[1][current_node->number_of_blocks -1] = candidate_blocks[1][smallest_index];
+		current_node->block_coordinates[0][current_node->number_of_blocks -1] = block->start;
+		current_node->block_coordinates[1][current_node->number_of_blocks -1] = block->end;
+		
+		// What was printed for the block, so the scan can be replayed from the cache
+		current_node->block_snp_counts = realloc(current_node->block_snp_counts, ((int)current_node->number_of_blocks +1)*sizeof(int));
+		current_node->block_likelihoods = realloc(current_node->block_likelihoods, ((int)current_node->number_of_blocks +1)*sizeof(double));
+		current_node->block_snp_counts[current_node->number_of_blocks -1] = number_of_recombinations_in_window;
+		current_node->block_likelihoods[current_node->number_of_blocks -1] = block->likelihood;
 	}
 	current_node->number_of_snps = number_of_branch_snps_excluding_block;
 	
 	return number_of_branch_snps_excluding_block;
 }
 
-// candidate blocks contains, start coordinate, end_coordinate and log likelihood
-int get_smallest_log_likelihood(double * candidate_blocks, int number_of_candidate_blocks)
+// After the best block has been taken, the other candidates which dont overlap any block taken so far are taken too, best first,
+// as long as they are still significant with the snps and genome left on the branch
+int flag_non_overlapping_recombinations(candidate_block * candidate_blocks, int number_of_candidate_blocks, int number_of_branch_snps, int * snp_site_coords, newick_node * current_node, FILE * block_file_pointer, newick_node *root, int * snp_locations, int total_num_snps, FILE * gff_file_pointer, int original_branch_genome_size, int min_snps)
+{
+	int i;
+	int accepted_index = get_smallest_log_likelihood(candidate_blocks, number_of_candidate_blocks);
+	while(number_of_candidate_blocks > 0)
+	{
+		number_of_candidate_blocks = remove_overlapping_candidate_blocks(candidate_blocks, number_of_candidate_blocks, candidate_blocks[accepted_index].start, candidate_blocks[accepted_index].end);
+		
+		int branch_genome_size = original_branch_genome_size - current_node->total_bases_removed_excluding_gaps;
+		int number_of_significant_blocks = 0;
+		for(i = 0; i < number_of_candidate_blocks && number_of_branch_snps > min_snps; i++)
+		{
+			int block_snp_count = find_number_of_snps_in_block_with_prefix_index(candidate_blocks[i].start, candidate_blocks[i].end, snp_site_coords, number_of_branch_snps);
+			if(p_value_test(branch_genome_size, candidate_blocks[i].genome_size_without_gaps, number_of_branch_snps, block_snp_count, min_snps) == 1)
+			{
+				candidate_blocks[number_of_significant_blocks] = candidate_blocks[i];
+				number_of_significant_blocks++;
+			}
+		}
+		number_of_candidate_blocks = number_of_significant_blocks;
+		if(number_of_candidate_blocks == 0)
+		{
+			break;
+		}
+		
+		accepted_index = get_smallest_log_likelihood(candidate_blocks, number_of_candidate_blocks);
+		number_of_branch_snps = flag_smallest_log_likelihood_recombinations(candidate_blocks, number_of_candidate_blocks, number_of_branch_snps, snp_site_coords, current_node->recombinations, current_node->num_recombinations,current_node, block_file_pointer, root, snp_locations, total_num_snps,gff_file_pointer);
+	}
+	return number_of_branch_snps;
+}
+
+// Removes the candidates which overlap the block, including the block itself, keeping the rest in order
+int remove_overlapping_candidate_blocks(candidate_block * candidate_blocks, int number_of_candidate_blocks, int block_start, int block_end)
+{
+	int i;
+	int number_of_remaining_blocks = 0;
+	for(i = 0; i < number_of_candidate_blocks; i++)
+	{
+		if(candidate_blocks[i].start <= block_end && candidate_blocks[i].end >= block_start)
+		{
+			continue;
+		}
+		candidate_blocks[number_of_remaining_blocks] = candidate_blocks[i];
+		number_of_remaining_blocks++;
+	}
+	return number_of_remaining_blocks;
+}
+
+// Ties go to the first block, so on the full double likelihood rather than a rounded copy of it
+int get_smallest_log_likelihood(candidate_block * candidate_blocks, int number_of_candidate_blocks)
 {
 	int i;
 	int smallest_index = 0 ; 
 	
 	for(i=0; i< number_of_candidate_blocks; i++)
 	{
-		if(candidate_blocks[i] < candidate_blocks[smallest_index] && candidate_blocks[i] > 0)
+		if(candidate_blocks[i].likelihood < candidate_blocks[smallest_index].likelihood && candidate_blocks[i].likelihood > 0)
 		{
 		   smallest_index = i;
 		}
@@ -890,7 +1583,6 @@ int get_smallest_log_likelihood(double * candidate_blocks, int number_of_candida
 	return smallest_index;
 }
 
-
 double snp_density(int length_of_sequence, int number_of_snps)
 {
 	return number_of_snps*1.0/length_of_sequence;
@@ -911,19 +1603,26 @@ int calculate_cutoff(int branch_genome_size, int window_size, int num_branch_snp
 	double pvalue = 0.0;
 	double part1, part2, part3 = 0.0;
 	
+	if(find_cached_cutoff(branch_genome_size, window_size, num_branch_snps, &cutoff) == 1)
+	{
+		return cutoff;
+	}
+	
 	threshold = calculate_threshold(branch_genome_size, window_size);
+	double log10_snp_probability = log10((num_branch_snps*1.0)/branch_genome_size);
+	double log10_no_snp_probability = log10(1.0-((num_branch_snps*1.0)/branch_genome_size));
 	
 	while( pvalue <= threshold)
 	{
-		part1 = reduce_factorial(window_size,cutoff)-reduce_factorial(cutoff,cutoff);
-		part2 = log10((num_branch_snps*1.0)/branch_genome_size)*cutoff;
-		part3 = log10(1.0-((num_branch_snps*1.0)/branch_genome_size))*(window_size-cutoff);
+		part1 = log10_binomial_coefficient(window_size,cutoff);
+		part2 = log10_snp_probability*cutoff;
+		part3 = log10_no_snp_probability*(window_size-cutoff);
 		pvalue = pvalue + pow(10,(part1 + part2 + part3));
 		cutoff++;
 	}
 	cutoff--;
 
-	
+	add_cached_cutoff(branch_genome_size, window_size, num_branch_snps, cutoff);
 	return cutoff;
 }
 
@@ -940,12 +1639,14 @@ int p_value_test(int branch_genome_size, int window_size, int num_branch_snps, i
 	}
 	
 	threshold = 0.05/branch_genome_size;
+	double log10_snp_probability = log10((num_branch_snps*1.0)/branch_genome_size);
+	double log10_no_snp_probability = log10(1.0-((num_branch_snps*1.0)/branch_genome_size));
 	
 	while( cutoff < block_snp_count)
 	{
-		part1 = reduce_factorial(window_size,cutoff)-reduce_factorial(cutoff,cutoff);
-		part2 = log10((num_branch_snps*1.0)/branch_genome_size)*cutoff;
-		part3 = log10(1.0-((num_branch_snps*1.0)/branch_genome_size))*(window_size-cutoff);
+		part1 = log10_binomial_coefficient(window_size,cutoff);
+		part2 = log10_snp_probability*cutoff;
+		part3 = log10_no_snp_probability*(window_size-cutoff);
 		pvalue = pvalue + pow(10,(part1 + part2 + part3));
 		cutoff++;
 	}
@@ -1027,43 +1728,64 @@ double get_block_likelihood(int branch_genome_size, int number_of_branch_snps, i
 	return (part1+part2+part3+part4)*-1;
 }
 
-int calculate_genome_length_excluding_blocks_and_gaps(char * sequence, int length_of_sequence, int ** block_coordinates, int num_blocks)
+// Scores many blocks on the same branch at once. Each one gets exactly the value of get_block_likelihood, since the edges
+// are chosen by comparing them, so the libm log10 is kept rather than a faster approximation.
+void get_block_likelihoods(int branch_genome_size, int number_of_branch_snps, int * block_genome_sizes_without_gaps, int * numbers_of_block_snps, int number_of_blocks, double * block_likelihoods)
+{
+	int i;
+	for(i = 0; i < number_of_blocks; i++)
+	{
+		block_likelihoods[i] = get_block_likelihood(branch_genome_size, number_of_branch_snps, block_genome_sizes_without_gaps[i], numbers_of_block_snps[i]);
+	}
+}
+
+int calculate_genome_length_excluding_blocks_and_gaps(const char * sequence, int length_of_sequence, int ** block_coordinates, int num_blocks)
+{
+	interval_set merged_blocks;
+	genome_bitset excluded_bases;
+	initialise_interval_set(&merged_blocks);
+	initialise_genome_bitset(&excluded_bases, length_of_sequence);
+	union_of_blocks(block_coordinates, num_blocks, &merged_blocks);
+	int genome_length = calculate_genome_length_excluding_merged_blocks_and_gaps(sequence, length_of_sequence, &merged_blocks, &excluded_bases);
+	free_genome_bitset(&excluded_bases);
+	free_interval_set(&merged_blocks);
+	return genome_length;
+}
+
+// The gaps and blocks are set as ranges in the bitset, which is reused between nodes, and the genome left over is counted in words
+int calculate_genome_length_excluding_merged_blocks_and_gaps(const char * sequence, int length_of_sequence, interval_set * merged_blocks, genome_bitset * excluded_bases)
 {
-	int * bases_to_be_excluded;  
-	bases_to_be_excluded = (int*) calloc((length_of_sequence + 1),sizeof(int));
-	
-  int genome_length = length_of_sequence;
 	int i = 0;
-	for(i = 0; i<length_of_sequence; i++)
+	if(excluded_bases->length != length_of_sequence)
 	{
-		if(sequence[i] == 'N' || sequence[i] == '-' )
-		{
-			bases_to_be_excluded[i] = 1;
-      genome_length--;
-		}
+		free_genome_bitset(excluded_bases);
+		initialise_genome_bitset(excluded_bases, length_of_sequence);
 	}
+	clear_genome_bitset(excluded_bases);
 	
-	int j = 0;
-	for(j = 0; j<num_blocks; j++)
+	// The sequence can be shorter than the genome, in which case the remaining bases arent gaps
+	while(i<length_of_sequence && sequence[i] != '\0')
 	{
-		if(block_coordinates[0][j] == -1)
+		if(sequence[i] != 'N' && sequence[i] != '-' )
 		{
+			i++;
 			continue;
 		}
-		
-		// Coordinates of blocks start at 1 and the index of the array starts at 0
-		int block_index = 0;
-		for(block_index = block_coordinates[0][j]; block_index <= block_coordinates[1][j]; block_index++ )
+		int start_of_gap = i;
+		while(i<length_of_sequence && (sequence[i] == 'N' || sequence[i] == '-'))
 		{
-      if(bases_to_be_excluded[block_index-1] == 0)
-      {
-        bases_to_be_excluded[block_index-1] = 1;
-        genome_length--;
-      }
+			i++;
 		}
+		set_range_in_genome_bitset(excluded_bases, start_of_gap, i);
 	}
 	
-	return genome_length;
+	// Coordinates of blocks start at 1 and include the end, the bitset starts at 0 and doesnt
+	for(i = 0; i<merged_blocks->number_of_intervals; i++)
+	{
+		set_range_in_genome_bitset(excluded_bases, merged_blocks->starts[i] - 1, merged_blocks->ends[i]);
+	}
+	
+	return length_of_sequence - count_bits_in_genome_bitset_range(excluded_bases, 0, length_of_sequence);
 }
 
 
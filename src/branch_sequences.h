@@ -19,36 +19,202 @@
 
 #ifndef _BRANCH_SEQUENCES_H_
 #define _BRANCH_SEQUENCES_H_
+#include <stdio.h>
+#include <pthread.h>
 #include "seqUtil.h"
 #include "Newickform.h"
-char *generate_branch_sequences(newick_node *root, FILE *vcf_file_pointer,int * snp_locations, int number_of_snps, char** column_names, int number_of_columns, char * leaf_sequence, int length_of_original_genome, FILE * block_file_pointer, FILE * gff_file_pointer,int min_snps, FILE * branch_snps_file_pointer, int window_min, int window_max);
+#include "interval_set.h"
+#include "genome_bitset.h"
+#include "tree_shards.h"
+#include "tree_traversal.h"
+
+// A window of a branch which might be a recombination, from when get_blocks finds it until it is taken or dropped
+typedef struct candidate_block
+{
+	int start;
+	int end;
+	int snp_count;
+	int genome_size_without_gaps;
+	double likelihood;
+	int live;
+} candidate_block;
+
+// The scratch memory for scanning branches, which only grows and is reused for every branch scanned on a thread
+typedef struct branch_scan_workspace
+{
+	seq_arena scratch_arena;
+} branch_scan_workspace;
+
+// The scan of a single branch, buffering its output when run on a worker thread
+typedef struct branch_scan_task
+{
+	newick_node * child_node;
+	const char * child_sequence;
+	FILE * block_file_pointer;
+	FILE * gff_file_pointer;
+	FILE * branch_snps_file_pointer;
+	char * block_buffer;
+	char * gff_buffer;
+	char * branch_snps_buffer;
+	size_t block_buffer_size;
+	size_t gff_buffer_size;
+	size_t branch_snps_buffer_size;
+} branch_scan_task;
+
+// The sibling branches of a node, shared between the worker threads
+typedef struct branch_scan_pool
+{
+	branch_scan_task * tasks;
+	int number_of_tasks;
+	int next_task;
+	int next_workspace;
+	pthread_mutex_t task_lock;
+	newick_node * root;
+	const char * leaf_sequence;
+	int * snp_locations;
+	int number_of_snps;
+	int length_of_original_genome;
+	int min_snps;
+	int window_min;
+	int window_max;
+} branch_scan_pool;
+
+// The post-order pass over the whole tree, shared between the workers. The buffers of each branch are kept under the
+// traversal index of its child until every node before it in post-order has been written out.
+typedef struct branch_sequence_tasks
+{
+	tree_traversal * traversal;
+	const char ** node_sequences;
+	branch_scan_task * branches;
+	int * finished_nodes;
+	int next_node_to_write;
+	pthread_mutex_t output_lock;
+	const char ** child_sequences;
+	newick_node ** child_nodes;
+	int * child_sequence_indices;
+	FILE * block_file_pointer;
+	FILE * gff_file_pointer;
+	FILE * branch_snps_file_pointer;
+	int * snp_locations;
+	int number_of_snps;
+	int length_of_original_genome;
+	int min_snps;
+	int window_min;
+	int window_max;
+} branch_sequence_tasks;
+
+// The recombinations and blocks on the path from the root down to the current node
+typedef struct recombination_path
+{
+	int * recombinations;
+	int num_recombinations;
+	int recombinations_capacity;
+	int * block_coordinates[2];
+	int num_blocks;
+	int blocks_capacity;
+	interval_set merged_blocks;
+	genome_bitset excluded_bases;
+	int * gap_prefix_counts;
+	int * snps_in_recombinations;
+} recombination_path;
+
+// Where the path was when a node finished, to go back to before each of its children
+typedef struct recombination_path_mark
+{
+	int num_recombinations;
+	int num_blocks;
+	int total_snps;
+} recombination_path_mark;
+
+// The path of one worker in the pre-order pass, with the nodes on it and the mark after each, by depth
+typedef struct recombination_path_worker
+{
+	recombination_path path;
+	newick_node ** nodes_on_path;
+	recombination_path_mark * marks;
+	int number_of_nodes_on_path;
+} recombination_path_worker;
+
+// The pre-order pass over the whole tree, shared between the workers
+typedef struct recombination_fill_tasks
+{
+	recombination_path_worker * workers;
+	int number_of_workers;
+	int * depths;
+	int length_of_original_genome;
+	int * snp_locations;
+	int number_of_snps;
+} recombination_fill_tasks;
+
+const char *generate_branch_sequences(newick_node *root, int * snp_locations, int number_of_snps, const char * leaf_sequence, int length_of_original_genome, FILE * block_file_pointer, FILE * gff_file_pointer,int min_snps, FILE * branch_snps_file_pointer, int window_min, int window_max, int num_threads);
+const char *generate_branch_sequences_on_tree_tasks(newick_node *root, int * snp_locations, int number_of_snps, int length_of_original_genome, FILE * block_file_pointer, FILE * gff_file_pointer,int min_snps,FILE * branch_snps_file_pointer, int window_min, int window_max, int num_threads);
+void estimate_branch_scan_costs(tree_traversal * traversal, int number_of_snps, int length_of_original_genome, double * node_costs);
+void generate_branch_sequence_task(newick_node * node, int worker_index, void * context);
+void write_finished_branch_scans(branch_sequence_tasks * tasks, newick_node * node);
+void scan_tree_shard(tree_shard_plan * plan, int shard_index, int * snp_locations, int number_of_snps, int length_of_original_genome, int min_snps, int window_min, int window_max, int num_threads);
+const char *generate_branch_sequence_for_node(newick_node *root, const char ** node_sequences, const char ** child_sequences, newick_node ** child_nodes, int * snp_locations, int number_of_snps, int length_of_original_genome, FILE * block_file_pointer, FILE * gff_file_pointer,int min_snps,FILE * branch_snps_file_pointer, int window_min, int window_max, int num_threads);
+const char * find_sequence_of_node(newick_node *root, const char ** node_sequences, const char ** child_sequences, newick_node ** child_nodes, int number_of_snps, int length_of_original_genome);
+void scan_branch(newick_node * child_node, const char * child_sequence, newick_node * root, const char * leaf_sequence, int * snp_locations, int number_of_snps, int length_of_original_genome, FILE * block_file_pointer, FILE * gff_file_pointer, FILE * branch_snps_file_pointer, int min_snps, int window_min, int window_max, branch_scan_workspace * workspace);
+void print_reused_blocks(newick_node * child_node, newick_node * root, FILE * block_file_pointer, FILE * gff_file_pointer);
+void allocate_branch_scan_workspaces(int number_of_workspaces);
+branch_scan_workspace * get_branch_scan_workspace(int workspace_index);
+void reset_branch_scan_workspace(branch_scan_workspace * workspace);
+void free_branch_scan_workspaces();
+void scan_branches_in_parallel(newick_node ** child_nodes, const char ** child_sequences, int number_of_children, newick_node * root, const char * leaf_sequence, int * snp_locations, int number_of_snps, int length_of_original_genome, FILE * block_file_pointer, FILE * gff_file_pointer, FILE * branch_snps_file_pointer, int min_snps, int window_min, int window_max, int num_threads);
+void * scan_branches_worker(void * pool_pointer);
+void open_branch_scan_task_buffers(branch_scan_task * task, FILE * block_file_pointer, FILE * gff_file_pointer, FILE * branch_snps_file_pointer);
+void flush_branch_scan_task_buffers(branch_scan_task * task, FILE * block_file_pointer, FILE * gff_file_pointer, FILE * branch_snps_file_pointer);
+FILE * open_branch_scan_buffer(char ** buffer, size_t * buffer_size);
+void flush_branch_scan_buffer(FILE * buffer_file_pointer, char ** buffer, size_t * buffer_size, FILE * output_file_pointer);
 void identify_recombinations(int number_of_branch_snps, int * branches_snp_sites,int length_of_original_genome);
 double calculate_snp_density(int * branches_snp_sites, int number_of_branch_snps, int index);
-void get_likelihood_for_windows(char * child_sequence, int length_of_sequence, int * snp_site_coords, int branch_genome_size, int number_of_branch_snps, int * snp_locations, newick_node * current_node, FILE * block_file_pointer, newick_node *root, char * branch_snp_sequence, FILE * gff_file_pointer,int min_snps, int length_of_original_genome, char * original_sequence,int window_min, int window_max);
+void get_likelihood_for_windows(const char * child_sequence, int length_of_sequence, int * snp_site_coords, int branch_genome_size, int number_of_branch_snps, int * snp_locations, newick_node * current_node, FILE * block_file_pointer, newick_node *root, FILE * gff_file_pointer,int min_snps, int length_of_original_genome, const char * original_sequence,int window_min, int window_max, seq_arena * scratch_arena);
 double get_block_likelihood(int branch_genome_size, int number_of_branch_snps, int block_genome_size_without_gaps, int number_of_block_snps);
+void get_block_likelihoods(int branch_genome_size, int number_of_branch_snps, int * block_genome_sizes_without_gaps, int * numbers_of_block_snps, int number_of_blocks, double * block_likelihoods);
+int move_block_edge_inwards(candidate_block * block, int move_start, int min_snps, int * snp_site_coords, int number_of_branch_snps, int * snp_locations, int branch_genome_size, int length_of_sequence, int * gap_prefix_counts);
+int count_improving_block_edges(double block_likelihood, double * edge_likelihoods, int * edge_snp_counts, int number_of_edges, int min_snps);
 int calculate_window_size(int branch_genome_size, int number_of_branch_snps,int window_min, int window_max);
 double calculate_threshold(int branch_genome_size, int window_size);
 int p_value_test(int branch_genome_size, int window_size, int num_branch_snps, int block_snp_count, int min_snps);
 double reduce_factorial(int l, int i);
 void fill_in_recombinations_with_gaps(newick_node *root, int * parent_recombinations, int parent_num_recombinations, int current_total_snps,int num_blocks, int ** current_block_coordinates,int length_of_original_genome,int * snp_locations, int number_of_snps);
+void fill_in_recombinations_with_gaps_for_node(newick_node *root, recombination_path * path, recombination_path_mark * parent_mark, int length_of_original_genome, int * snp_locations, int number_of_snps);
+void fill_in_recombinations_with_gaps_on_tree_tasks(newick_node *root, int * parent_recombinations, int parent_num_recombinations, int current_total_snps,int num_blocks, int ** current_block_coordinates,int length_of_original_genome,int * snp_locations, int number_of_snps, int num_threads);
+void fill_in_recombinations_with_gaps_task(newick_node * node, int worker_index, void * context);
+void rebuild_recombination_path(recombination_path_worker * worker, newick_node * node, int depth);
+void initialise_recombination_path(recombination_path * path, int number_of_snps);
+void push_recombinations_onto_path(recombination_path * path, int * recombinations, int num_recombinations);
+void push_blocks_onto_path(recombination_path * path, int ** block_coordinates, int num_blocks);
+recombination_path_mark get_recombination_path_mark(recombination_path * path);
+void rewind_recombination_path(recombination_path * path, recombination_path_mark * mark);
+void free_recombination_path(recombination_path * path);
 int copy_and_concat_integer_arrays(int * array_1, int array_1_size, int * array_2, int array_2_size, int * output_array);
 double snp_density(int length_of_sequence, int number_of_snps);
 int calculate_cutoff(int branch_genome_size, int window_size, int num_branch_snps);
-int get_smallest_log_likelihood(double * candidate_blocks, int number_of_candidate_blocks);
+int flag_non_overlapping_recombinations(candidate_block * candidate_blocks, int number_of_candidate_blocks, int number_of_branch_snps, int * snp_site_coords, newick_node * current_node, FILE * block_file_pointer, newick_node *root, int * snp_locations, int total_num_snps, FILE * gff_file_pointer, int original_branch_genome_size, int min_snps);
+int remove_overlapping_candidate_blocks(candidate_block * candidate_blocks, int number_of_candidate_blocks, int block_start, int block_end);
+void set_multi_block_acceptance(int accept_multiple_blocks);
+int get_smallest_log_likelihood(candidate_block * candidate_blocks, int number_of_candidate_blocks);
 int exclude_snp_sites_in_block(int window_start_coordinate, int window_end_coordinate, int * snp_site_coords, int number_of_branch_snps);
-int flag_smallest_log_likelihood_recombinations(int ** candidate_blocks, int number_of_candidate_blocks, int number_of_branch_snps, int * snp_site_coords, int * recombinations, int number_of_recombinations,newick_node * current_node, FILE * block_file_pointer, newick_node *root,int * snp_locations, int total_num_snps, FILE * gff_file_pointer, double * block_likelihooods);
-int calculate_number_of_bases_in_recombations_excluding_gaps(int ** block_coordinates, int num_blocks,char * child_sequence, int * snp_locations,int length_of_original_genome);
+int flag_smallest_log_likelihood_recombinations(candidate_block * candidate_blocks, int number_of_candidate_blocks, int number_of_branch_snps, int * snp_site_coords, int * recombinations, int number_of_recombinations,newick_node * current_node, FILE * block_file_pointer, newick_node *root,int * snp_locations, int total_num_snps, FILE * gff_file_pointer);
+int calculate_number_of_bases_in_recombations_excluding_gaps(int ** block_coordinates, int num_blocks,const char * child_sequence, int * snp_locations,int length_of_original_genome);
 void carry_unambiguous_gaps_up_tree(newick_node *root);
-void move_blocks_inwards_while_likelihood_improves(int number_of_blocks,int ** block_coordinates, int min_snps, int * snp_site_coords,  int number_of_branch_snps,char * branch_snp_sequence, int * snp_locations, int branch_genome_size,char * child_sequence, int length_of_sequence, double * block_likelihoods, int cutoff_value);
-int get_blocks(int ** block_coordinates, int branch_genome_size,int * snp_site_coords,int number_of_branch_snps, int window_size, int cutoff, char * original_sequence, int * snp_locations, int number_of_snps);
-int extend_lower_part_of_window(int starting_coord, int initial_min_coord, int genome_size, int * gaps_in_original_genome_space);
-int extend_upper_part_of_window(int starting_coord, int initial_max_coord, int genome_size, int * gaps_in_original_genome_space);
+const char * get_sequence_view_for_node(newick_node * node);
+int move_blocks_inwards_while_likelihood_improves(int number_of_blocks, candidate_block * blocks, int min_snps, int * snp_site_coords,  int number_of_branch_snps, int * snp_locations, int branch_genome_size, int length_of_sequence, int cutoff_value, int * gap_prefix_counts);
+int get_blocks(candidate_block * blocks, int branch_genome_size,int * snp_site_coords,int number_of_branch_snps, int window_size, int cutoff, const char * original_sequence, int * snp_locations, int number_of_snps, seq_arena * scratch_arena);
+int get_blocks_from_windows(candidate_block * blocks, int number_of_blocks, int * window_starts, int * window_ends, int number_of_windows, int contig_end, int cutoff);
+void initialise_candidate_block(candidate_block * block, int start, int end);
+int extend_lower_part_of_window(int starting_coord, int initial_min_coord, int * gap_coordinates, int number_of_gaps);
+int extend_upper_part_of_window(int starting_coord, int initial_max_coord, int genome_size, int * gap_coordinates, int number_of_gaps);
+int compare_integers(const void * a, const void * b);
 int get_list_of_snp_indices_which_fall_in_downstream_recombinations(int ** current_block_coordinates,int num_blocks, int * snp_locations,int current_total_snps, int * snps_in_recombinations);
 
-int calculate_genome_length_excluding_blocks_and_gaps(char * sequence, int length_of_sequence, int ** block_coordinates, int num_blocks);
+int calculate_genome_length_excluding_blocks_and_gaps(const char * sequence, int length_of_sequence, int ** block_coordinates, int num_blocks);
+int calculate_genome_length_excluding_merged_blocks_and_gaps(const char * sequence, int length_of_sequence, interval_set * merged_blocks, genome_bitset * excluded_bases);
 
 #define WINDOW_SNP_MODE_TARGET 10
 #define RANDOMNESS_DAMPNER 0.05
 #define MAX_SAMPLE_NAME_SIZE 1024
+#define MAX_BLOCK_EDGE_BATCH 64
 
 #endif
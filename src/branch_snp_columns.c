@@ -0,0 +1,278 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "branch_snp_columns.h"
+#include "block_tab_file.h"
+#include "Newickform.h"
+#include "profile.h"
+
+int binary_branch_snps = 0;
+branch_snp_columns_branch * branch_snp_columns_branches = NULL;
+int number_of_branch_snp_columns_branches = 0;
+int branch_snp_columns_branches_capacity = 0;
+pthread_mutex_t branch_snp_columns_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void set_binary_branch_snps(int binary)
+{
+	binary_branch_snps = binary;
+}
+
+int get_binary_branch_snps()
+{
+	return binary_branch_snps;
+}
+
+char * copy_branch_snp_string(char * string)
+{
+	size_t length = strlen(string);
+	char * copy = (char *) malloc(length + 1);
+	memcpy(copy, string, length + 1);
+	return copy;
+}
+
+// Branches can be scanned on any thread, so they are kept and sorted by node before the columns are written
+void add_branch_snps_to_columns(char * current_node_id, char * parent_node_id, int * branches_snp_sites, int number_of_branch_snps, char * branch_snp_sequence, char * branch_snp_ancestor_sequence, taxon_set * taxa)
+{
+	branch_snp_columns_branch branch;
+	branch.current_node_id = copy_branch_snp_string(current_node_id);
+	branch.parent_node_id = copy_branch_snp_string(parent_node_id);
+	branch.taxon_names = copy_taxon_names(taxa);
+	branch.number_of_snps = number_of_branch_snps;
+	branch.positions = (int *) malloc((number_of_branch_snps + 1)*sizeof(int));
+	branch.ancestral_bases = (char *) malloc(number_of_branch_snps + 1);
+	branch.derived_bases = (char *) malloc(number_of_branch_snps + 1);
+	memcpy(branch.positions, branches_snp_sites, number_of_branch_snps*sizeof(int));
+	memcpy(branch.ancestral_bases, branch_snp_ancestor_sequence, number_of_branch_snps);
+	memcpy(branch.derived_bases, branch_snp_sequence, number_of_branch_snps);
+	
+	pthread_mutex_lock(&branch_snp_columns_lock);
+	if(number_of_branch_snp_columns_branches == branch_snp_columns_branches_capacity)
+	{
+		branch_snp_columns_branches_capacity = (branch_snp_columns_branches_capacity == 0) ? 64 : branch_snp_columns_branches_capacity*2;
+		branch_snp_columns_branches = (branch_snp_columns_branch *) realloc(branch_snp_columns_branches, branch_snp_columns_branches_capacity*sizeof(branch_snp_columns_branch));
+	}
+	branch_snp_columns_branches[number_of_branch_snp_columns_branches] = branch;
+	number_of_branch_snp_columns_branches++;
+	pthread_mutex_unlock(&branch_snp_columns_lock);
+}
+
+int compare_branch_snp_columns_branches(const void * a, const void * b)
+{
+	return strcmp(((branch_snp_columns_branch *) a)->current_node_id, ((branch_snp_columns_branch *) b)->current_node_id);
+}
+
+// Never compressed, so it can be mapped
+FILE * open_branch_snp_columns_file(char filename[])
+{
+	FILE * columns_file_pointer = fopen(filename, "w");
+	if(columns_file_pointer == NULL)
+	{
+		printf("Cannot write the branch snps to '%s'\n", filename);
+		exit(1);
+	}
+	record_profile_output_file(filename);
+	return columns_file_pointer;
+}
+
+// The columns go in one file and the names of the nodes, once each, in a tab separated dictionary
+void write_branch_snp_columns(FILE * columns_file_pointer, char dictionary_filename[])
+{
+	int i, j;
+	qsort(branch_snp_columns_branches, number_of_branch_snp_columns_branches, sizeof(branch_snp_columns_branch), compare_branch_snp_columns_branches);
+	
+	FILE * dictionary_file_pointer = fopen(dictionary_filename, "w");
+	if(dictionary_file_pointer == NULL)
+	{
+		printf("Cannot write the branch snps dictionary to '%s'\n", dictionary_filename);
+		exit(1);
+	}
+	fprintf(dictionary_file_pointer, "ID\tNode\tParent\tTaxa\tSNPs\n");
+	
+	branch_snp_columns_header header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, BRANCH_SNP_COLUMNS_MAGIC, sizeof(header.magic));
+	header.version = BRANCH_SNP_COLUMNS_VERSION;
+	header.number_of_nodes = number_of_branch_snp_columns_branches;
+	for(i = 0; i < number_of_branch_snp_columns_branches; i++)
+	{
+		branch_snp_columns_branch * branch = &branch_snp_columns_branches[i];
+		fprintf(dictionary_file_pointer, "%d\t%s\t%s\t%s\t%d\n", i, branch->current_node_id, branch->parent_node_id, branch->taxon_names, branch->number_of_snps);
+		header.number_of_snps += branch->number_of_snps;
+	}
+	fclose(dictionary_file_pointer);
+	
+	// The columns of 4 byte values come first, so every column starts on an aligned offset
+	header.node_id_offset = sizeof(header);
+	header.position_offset = header.node_id_offset + header.number_of_snps*sizeof(uint32_t);
+	header.ancestral_base_offset = header.position_offset + header.number_of_snps*sizeof(uint32_t);
+	header.derived_base_offset = header.ancestral_base_offset + header.number_of_snps;
+	fwrite(&header, sizeof(header), 1, columns_file_pointer);
+	for(i = 0; i < number_of_branch_snp_columns_branches; i++)
+	{
+		uint32_t node_id = i;
+		for(j = 0; j < branch_snp_columns_branches[i].number_of_snps; j++)
+		{
+			fwrite(&node_id, sizeof(uint32_t), 1, columns_file_pointer);
+		}
+	}
+	for(i = 0; i < number_of_branch_snp_columns_branches; i++)
+	{
+		for(j = 0; j < branch_snp_columns_branches[i].number_of_snps; j++)
+		{
+			uint32_t position = branch_snp_columns_branches[i].positions[j];
+			fwrite(&position, sizeof(uint32_t), 1, columns_file_pointer);
+		}
+	}
+	for(i = 0; i < number_of_branch_snp_columns_branches; i++)
+	{
+		fwrite(branch_snp_columns_branches[i].ancestral_bases, 1, branch_snp_columns_branches[i].number_of_snps, columns_file_pointer);
+	}
+	for(i = 0; i < number_of_branch_snp_columns_branches; i++)
+	{
+		fwrite(branch_snp_columns_branches[i].derived_bases, 1, branch_snp_columns_branches[i].number_of_snps, columns_file_pointer);
+	}
+	free_branch_snp_columns();
+}
+
+void free_branch_snp_columns()
+{
+	int i;
+	for(i = 0; i < number_of_branch_snp_columns_branches; i++)
+	{
+		free(branch_snp_columns_branches[i].current_node_id);
+		free(branch_snp_columns_branches[i].parent_node_id);
+		free(branch_snp_columns_branches[i].taxon_names);
+		free(branch_snp_columns_branches[i].positions);
+		free(branch_snp_columns_branches[i].ancestral_bases);
+		free(branch_snp_columns_branches[i].derived_bases);
+	}
+	free(branch_snp_columns_branches);
+	branch_snp_columns_branches = NULL;
+	number_of_branch_snp_columns_branches = 0;
+	branch_snp_columns_branches_capacity = 0;
+}
+
+// The dictionary of tree.branch_snps.bin is tree.branch_snps.nodes
+void get_branch_snp_dictionary_filename(char columns_filename[], char dictionary_filename[])
+{
+	size_t length = strlen(columns_filename);
+	if(length >= 4 && strcmp(columns_filename + length - 4, ".bin") == 0)
+	{
+		length -= 4;
+	}
+	if(length + 7 > MAX_FILENAME_SIZE)
+	{
+		printf("The branch snps filename '%s' is too long\n", columns_filename);
+		exit(1);
+	}
+	memcpy(dictionary_filename, columns_filename, length);
+	memcpy(dictionary_filename + length, ".nodes", 7);
+}
+
+// Writes the same features as the text branch snps file, with the branches in the order of the dictionary
+void convert_branch_snp_columns_to_text(char columns_filename[], char output_filename[])
+{
+	int i;
+	char dictionary_filename[MAX_FILENAME_SIZE];
+	get_branch_snp_dictionary_filename(columns_filename, dictionary_filename);
+	
+	int file_descriptor = open(columns_filename, O_RDONLY);
+	struct stat file_status;
+	if(file_descriptor < 0 || fstat(file_descriptor, &file_status) != 0 || (size_t) file_status.st_size < sizeof(branch_snp_columns_header))
+	{
+		printf("Cannot read the branch snps file '%s'\n", columns_filename);
+		exit(1);
+	}
+	char * columns = (char *) mmap(NULL, file_status.st_size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+	close(file_descriptor);
+	branch_snp_columns_header * header = (branch_snp_columns_header *) columns;
+	if(columns == MAP_FAILED || memcmp(header->magic, BRANCH_SNP_COLUMNS_MAGIC, sizeof(header->magic)) != 0 ||
+	   header->version != BRANCH_SNP_COLUMNS_VERSION || header->derived_base_offset + header->number_of_snps > (uint64_t) file_status.st_size)
+	{
+		printf("The branch snps file '%s' isnt in the binary format\n", columns_filename);
+		exit(1);
+	}
+	uint32_t * node_ids = (uint32_t *) (columns + header->node_id_offset);
+	int * positions = (int *) (columns + header->position_offset);
+	char * ancestral_bases = columns + header->ancestral_base_offset;
+	char * derived_bases = columns + header->derived_base_offset;
+	
+	FILE * dictionary_file_pointer = fopen(dictionary_filename, "r");
+	FILE * output_file_pointer = fopen(output_filename, "w");
+	if(dictionary_file_pointer == NULL || output_file_pointer == NULL)
+	{
+		printf("Cannot read the branch snps dictionary '%s' or write '%s'\n", dictionary_filename, output_filename);
+		exit(1);
+	}
+	
+	// The rows of each node are next to each other, in the order of the lines of the dictionary after its header
+	char * line = NULL;
+	size_t line_capacity = 0;
+	uint64_t first_snp = 0;
+	getline(&line, &line_capacity, dictionary_file_pointer);
+	for(i = 0; i < (int) header->number_of_nodes; i++)
+	{
+		ssize_t line_length = getline(&line, &line_capacity, dictionary_file_pointer);
+		char * fields[5];
+		int number_of_fields = 0;
+		char * field = line;
+		if(line_length <= 0)
+		{
+			printf("The branch snps dictionary '%s' is missing nodes\n", dictionary_filename);
+			exit(1);
+		}
+		line[strcspn(line, "\n")] = '\0';
+		while(number_of_fields < 5 && field != NULL)
+		{
+			fields[number_of_fields] = field;
+			number_of_fields++;
+			field = strchr(field, '\t');
+			if(field != NULL)
+			{
+				*field = '\0';
+				field++;
+			}
+		}
+		if(number_of_fields < 5)
+		{
+			printf("The branch snps dictionary '%s' has a line without 5 columns\n", dictionary_filename);
+			exit(1);
+		}
+		
+		uint64_t end_snp = first_snp;
+		while(end_snp < header->number_of_snps && node_ids[end_snp] == (uint32_t) i)
+		{
+			end_snp++;
+		}
+		print_branch_snp_features(output_file_pointer, fields[1], fields[2], positions + first_snp, (int) (end_snp - first_snp), derived_bases + first_snp, ancestral_bases + first_snp, fields[3]);
+		first_snp = end_snp;
+	}
+	free(line);
+	fclose(dictionary_file_pointer);
+	fclose(output_file_pointer);
+	munmap(columns, file_status.st_size);
+}
@@ -0,0 +1,67 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _BRANCH_SNP_COLUMNS_H_
+#define _BRANCH_SNP_COLUMNS_H_
+#include <stdio.h>
+#include <stdint.h>
+#include "taxon_sets.h"
+
+// The snps of one branch, kept until the columns are written
+typedef struct branch_snp_columns_branch
+{
+	char * current_node_id;
+	char * parent_node_id;
+	char * taxon_names;
+	int number_of_snps;
+	int * positions;
+	char * ancestral_bases;
+	char * derived_bases;
+} branch_snp_columns_branch;
+
+// At the start of the binary branch snps file. Each column is an array of number_of_snps values in the byte order
+// of the machine which wrote it, starting at its offset from the start of the file, so the file can be mapped and
+// read in place. The node ids are the line numbers of the nodes in the dictionary written next to it.
+typedef struct branch_snp_columns_header
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t number_of_nodes;
+	uint64_t number_of_snps;
+	uint64_t node_id_offset;
+	uint64_t position_offset;
+	uint64_t ancestral_base_offset;
+	uint64_t derived_base_offset;
+} branch_snp_columns_header;
+
+void set_binary_branch_snps(int binary_branch_snps);
+int get_binary_branch_snps();
+void add_branch_snps_to_columns(char * current_node_id, char * parent_node_id, int * branches_snp_sites, int number_of_branch_snps, char * branch_snp_sequence, char * branch_snp_ancestor_sequence, taxon_set * taxa);
+FILE * open_branch_snp_columns_file(char filename[]);
+void write_branch_snp_columns(FILE * columns_file_pointer, char dictionary_filename[]);
+void free_branch_snp_columns();
+int compare_branch_snp_columns_branches(const void * a, const void * b);
+char * copy_branch_snp_string(char * string);
+void get_branch_snp_dictionary_filename(char columns_filename[], char dictionary_filename[]);
+void convert_branch_snp_columns_to_text(char columns_filename[], char output_filename[]);
+
+#define BRANCH_SNP_COLUMNS_MAGIC "GBSNPCOL"
+#define BRANCH_SNP_COLUMNS_VERSION 1
+
+#endif
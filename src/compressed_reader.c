@@ -0,0 +1,382 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "../config.h"
+#ifdef HAVE_LIBDEFLATE
+#include <libdeflate.h>
+#endif
+#include "compressed_reader.h"
+
+int decompression_threads = 1;
+
+void set_decompression_threads(int num_threads)
+{
+	decompression_threads = (num_threads < 1) ? 1 : num_threads;
+}
+
+int get_decompression_threads()
+{
+	return decompression_threads;
+}
+
+compressed_reader * open_compressed_reader(char filename[])
+{
+	int file_descriptor = open(filename, O_RDONLY);
+	if(file_descriptor < 0)
+	{
+		printf("Cannot open file '%s'\n", filename);
+		exit(1);
+	}
+	return open_compressed_reader_from_descriptor(file_descriptor);
+}
+
+// Takes over the descriptor and reads it from the start of the file, closing it with the reader
+compressed_reader * open_compressed_reader_from_descriptor(int file_descriptor)
+{
+	unsigned char header[BGZF_HEADER_SIZE];
+	lseek(file_descriptor, 0, SEEK_SET);
+	compressed_reader * reader = (compressed_reader *) calloc(1, sizeof(compressed_reader));
+	reader->num_threads = decompression_threads;
+	pthread_mutex_init(&(reader->queue_lock), NULL);
+	pthread_cond_init(&(reader->queue_not_empty), NULL);
+	pthread_cond_init(&(reader->queue_not_full), NULL);
+	
+	ssize_t header_length = pread(file_descriptor, header, BGZF_HEADER_SIZE, 0);
+	reader->is_bgzf = is_bgzf_header(header, header_length < 0 ? 0 : (size_t) header_length);
+	if(reader->is_bgzf)
+	{
+		reader->bgzf_file_pointer = fdopen(file_descriptor, "r");
+		reader->blocks = (bgzf_block *) calloc(reader->num_threads*BGZF_BLOCKS_PER_THREAD, sizeof(bgzf_block));
+		if(reader->bgzf_file_pointer == NULL || reader->blocks == NULL)
+		{
+			printf("Cannot read the BGZF file\n");
+			exit(1);
+		}
+	}
+	else
+	{
+		// gzread passes through files which arent compressed
+		reader->gzip_file = gzdopen(file_descriptor, "r");
+		if(reader->gzip_file == NULL)
+		{
+			printf("Cannot read the compressed file\n");
+			exit(1);
+		}
+		gzbuffer(reader->gzip_file, COMPRESSED_READER_BUFFER_SIZE);
+	}
+	
+	if(pthread_create(&(reader->decompression_thread), NULL, reader->is_bgzf ? decompress_bgzf_file : decompress_gzip_file, reader) != 0)
+	{
+		printf("Couldnt create a thread for decompressing\n");
+		exit(1);
+	}
+	return reader;
+}
+
+// Has the same arguments as gzread, so it can be given to KSEQ_INIT
+int read_compressed_reader(compressed_reader * reader, void * buffer, unsigned int length)
+{
+	unsigned int bytes_read = 0;
+	while(bytes_read < length)
+	{
+		if(reader->current_offset == reader->current.length && pop_decompressed_buffer(reader) == 0)
+		{
+			break;
+		}
+		size_t bytes_to_copy = reader->current.length - reader->current_offset;
+		if(bytes_to_copy > length - bytes_read)
+		{
+			bytes_to_copy = length - bytes_read;
+		}
+		memcpy((char *) buffer + bytes_read, reader->current.data + reader->current_offset, bytes_to_copy);
+		reader->current_offset += bytes_to_copy;
+		bytes_read += bytes_to_copy;
+	}
+	return (int) bytes_read;
+}
+
+// Stops the decompression thread even if it hasnt got to the end of the file, such as when only the first sequence was wanted
+void close_compressed_reader(compressed_reader * reader)
+{
+	int i;
+	pthread_mutex_lock(&(reader->queue_lock));
+	reader->closing = 1;
+	pthread_cond_broadcast(&(reader->queue_not_full));
+	pthread_mutex_unlock(&(reader->queue_lock));
+	pthread_join(reader->decompression_thread, NULL);
+	
+	for(i = 0; i < reader->queue_length; i++)
+	{
+		free(reader->queue[(reader->queue_start + i) % COMPRESSED_READER_QUEUE_SIZE].data);
+	}
+	free(reader->current.data);
+	if(reader->is_bgzf)
+	{
+		for(i = 0; i < reader->num_threads*BGZF_BLOCKS_PER_THREAD; i++)
+		{
+			free(reader->blocks[i].compressed);
+		}
+		free(reader->blocks);
+		fclose(reader->bgzf_file_pointer);
+	}
+	else
+	{
+		gzclose(reader->gzip_file);
+	}
+	pthread_cond_destroy(&(reader->queue_not_full));
+	pthread_cond_destroy(&(reader->queue_not_empty));
+	pthread_mutex_destroy(&(reader->queue_lock));
+	free(reader);
+}
+
+// A gzip header with only the BC extra field, which gives the size of the block
+int is_bgzf_header(unsigned char * header, size_t header_length)
+{
+	return header_length == BGZF_HEADER_SIZE && header[0] == 0x1f && header[1] == 0x8b && header[2] == 8 && (header[3] & 4) &&
+	       header[10] == 6 && header[11] == 0 && header[12] == 'B' && header[13] == 'C' && header[14] == 2 && header[15] == 0;
+}
+
+void * decompress_gzip_file(void * reader_pointer)
+{
+	compressed_reader * reader = (compressed_reader *) reader_pointer;
+	while(1)
+	{
+		char * data = (char *) malloc(COMPRESSED_READER_BUFFER_SIZE);
+		int bytes_read = gzread(reader->gzip_file, data, COMPRESSED_READER_BUFFER_SIZE);
+		if(bytes_read < 0)
+		{
+			printf("Cannot decompress the file\n");
+			exit(1);
+		}
+		if(bytes_read == 0 || push_decompressed_buffer(reader, data, bytes_read) == 0)
+		{
+			free(data);
+			break;
+		}
+	}
+	push_decompressed_buffer(reader, NULL, 0);
+	return NULL;
+}
+
+// Reads a batch of blocks, inflates them at the same time straight into one buffer, and queues it
+void * decompress_bgzf_file(void * reader_pointer)
+{
+	compressed_reader * reader = (compressed_reader *) reader_pointer;
+	int i;
+	int maximum_number_of_blocks = reader->num_threads*BGZF_BLOCKS_PER_THREAD;
+	pthread_t threads[reader->num_threads];
+	bgzf_block_range ranges[reader->num_threads];
+	
+	while(1)
+	{
+		int number_of_blocks = 0;
+		size_t uncompressed_length = 0;
+		while(number_of_blocks < maximum_number_of_blocks && read_bgzf_block(reader->bgzf_file_pointer, &(reader->blocks[number_of_blocks])))
+		{
+			uncompressed_length += reader->blocks[number_of_blocks].uncompressed_length;
+			number_of_blocks++;
+		}
+		if(number_of_blocks == 0)
+		{
+			break;
+		}
+		
+		char * data = (char *) malloc(uncompressed_length + 1);
+		size_t offset = 0;
+		for(i = 0; i < number_of_blocks; i++)
+		{
+			reader->blocks[i].uncompressed = data + offset;
+			offset += reader->blocks[i].uncompressed_length;
+		}
+		
+		int number_of_ranges = reader->num_threads < number_of_blocks ? reader->num_threads : number_of_blocks;
+		for(i = 0; i < number_of_ranges; i++)
+		{
+			ranges[i].blocks = reader->blocks;
+			ranges[i].first_block = (int) (((long) number_of_blocks*i)/number_of_ranges);
+			ranges[i].end_block = (int) (((long) number_of_blocks*(i+1))/number_of_ranges);
+		}
+		for(i = 1; i < number_of_ranges; i++)
+		{
+			pthread_create(&threads[i], NULL, inflate_bgzf_block_range, &ranges[i]);
+		}
+		inflate_bgzf_block_range(&ranges[0]);
+		for(i = 1; i < number_of_ranges; i++)
+		{
+			pthread_join(threads[i], NULL);
+		}
+		
+		if(uncompressed_length == 0)
+		{
+			free(data);
+			continue;
+		}
+		if(push_decompressed_buffer(reader, data, uncompressed_length) == 0)
+		{
+			free(data);
+			break;
+		}
+	}
+	push_decompressed_buffer(reader, NULL, 0);
+	return NULL;
+}
+
+// Returns 0 at the end of the file
+int read_bgzf_block(FILE * file_pointer, bgzf_block * block)
+{
+	if(block->compressed == NULL)
+	{
+		block->compressed = (unsigned char *) malloc(BGZF_MAX_BLOCK_SIZE);
+	}
+	size_t header_length = fread(block->compressed, 1, BGZF_HEADER_SIZE, file_pointer);
+	if(header_length == 0)
+	{
+		return 0;
+	}
+	if(is_bgzf_header(block->compressed, header_length) == 0)
+	{
+		printf("The BGZF file has a block which isnt BGZF\n");
+		exit(1);
+	}
+	
+	block->compressed_length = (block->compressed[16] | (block->compressed[17] << 8)) + 1;
+	if(block->compressed_length < BGZF_HEADER_SIZE + BGZF_FOOTER_SIZE ||
+	   fread(block->compressed + BGZF_HEADER_SIZE, 1, block->compressed_length - BGZF_HEADER_SIZE, file_pointer) != block->compressed_length - BGZF_HEADER_SIZE)
+	{
+		printf("The BGZF file is truncated\n");
+		exit(1);
+	}
+	unsigned char * footer = block->compressed + block->compressed_length - BGZF_FOOTER_SIZE;
+	block->uncompressed_length = footer[4] | (footer[5] << 8) | (footer[6] << 16) | ((size_t) footer[7] << 24);
+	if(block->uncompressed_length > BGZF_MAX_BLOCK_SIZE)
+	{
+		printf("The BGZF file has a block which is too big\n");
+		exit(1);
+	}
+	return 1;
+}
+
+void * inflate_bgzf_block_range(void * range_pointer)
+{
+	bgzf_block_range * range = (bgzf_block_range *) range_pointer;
+	int i;
+	for(i = range->first_block; i < range->end_block; i++)
+	{
+		inflate_bgzf_block(&(range->blocks[i]));
+	}
+	return NULL;
+}
+
+// Each block is a whole raw deflate stream, so libdeflate can inflate it in one call if it was found by configure
+void inflate_bgzf_block(bgzf_block * block)
+{
+	unsigned char * compressed_data = block->compressed + BGZF_HEADER_SIZE;
+	size_t compressed_data_length = block->compressed_length - BGZF_HEADER_SIZE - BGZF_FOOTER_SIZE;
+	unsigned char * footer = block->compressed + block->compressed_length - BGZF_FOOTER_SIZE;
+	unsigned long expected_crc = footer[0] | (footer[1] << 8) | (footer[2] << 16) | ((unsigned long) footer[3] << 24);
+	unsigned long crc;
+	int inflated = 0;
+	
+#ifdef HAVE_LIBDEFLATE
+	struct libdeflate_decompressor * decompressor = libdeflate_alloc_decompressor();
+	inflated = decompressor != NULL && libdeflate_deflate_decompress(decompressor, compressed_data, compressed_data_length, block->uncompressed, block->uncompressed_length, NULL) == LIBDEFLATE_SUCCESS;
+	libdeflate_free_decompressor(decompressor);
+	crc = libdeflate_crc32(0, block->uncompressed, block->uncompressed_length);
+#else
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if(inflateInit2(&stream, -15) == Z_OK)
+	{
+		stream.next_in = compressed_data;
+		stream.avail_in = compressed_data_length;
+		stream.next_out = (Bytef *) block->uncompressed;
+		stream.avail_out = block->uncompressed_length;
+		inflated = inflate(&stream, Z_FINISH) == Z_STREAM_END && stream.total_out == block->uncompressed_length;
+		inflateEnd(&stream);
+	}
+	crc = crc32(0L, (Bytef *) block->uncompressed, block->uncompressed_length);
+#endif
+	if(inflated == 0 || crc != expected_crc)
+	{
+		printf("Cannot decompress a block of the BGZF file\n");
+		exit(1);
+	}
+}
+
+// Waits while the queue is full. Returns 0 if the reader was closed, when the buffer wasnt taken. A NULL buffer marks the end.
+int push_decompressed_buffer(compressed_reader * reader, char * data, size_t length)
+{
+	pthread_mutex_lock(&(reader->queue_lock));
+	if(data == NULL)
+	{
+		reader->finished = 1;
+		pthread_cond_broadcast(&(reader->queue_not_empty));
+		pthread_mutex_unlock(&(reader->queue_lock));
+		return 1;
+	}
+	while(reader->queue_length == COMPRESSED_READER_QUEUE_SIZE && reader->closing == 0)
+	{
+		pthread_cond_wait(&(reader->queue_not_full), &(reader->queue_lock));
+	}
+	if(reader->closing)
+	{
+		pthread_mutex_unlock(&(reader->queue_lock));
+		return 0;
+	}
+	decompressed_buffer * buffer = &(reader->queue[(reader->queue_start + reader->queue_length) % COMPRESSED_READER_QUEUE_SIZE]);
+	buffer->data = data;
+	buffer->length = length;
+	reader->queue_length++;
+	pthread_cond_signal(&(reader->queue_not_empty));
+	pthread_mutex_unlock(&(reader->queue_lock));
+	return 1;
+}
+
+// Swaps the buffer being read for the next one, returning 0 at the end of the file
+int pop_decompressed_buffer(compressed_reader * reader)
+{
+	free(reader->current.data);
+	reader->current.data = NULL;
+	reader->current.length = 0;
+	reader->current_offset = 0;
+	
+	pthread_mutex_lock(&(reader->queue_lock));
+	while(reader->queue_length == 0 && reader->finished == 0)
+	{
+		pthread_cond_wait(&(reader->queue_not_empty), &(reader->queue_lock));
+	}
+	if(reader->queue_length == 0)
+	{
+		pthread_mutex_unlock(&(reader->queue_lock));
+		return 0;
+	}
+	reader->current = reader->queue[reader->queue_start];
+	reader->queue_start = (reader->queue_start + 1) % COMPRESSED_READER_QUEUE_SIZE;
+	reader->queue_length--;
+	pthread_cond_signal(&(reader->queue_not_full));
+	pthread_mutex_unlock(&(reader->queue_lock));
+	return 1;
+}
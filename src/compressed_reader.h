@@ -0,0 +1,85 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _COMPRESSED_READER_H_
+#define _COMPRESSED_READER_H_
+
+#include <stddef.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "bgzf_file.h"
+
+#define COMPRESSED_READER_QUEUE_SIZE 4
+#define COMPRESSED_READER_BUFFER_SIZE 1048576
+#define BGZF_BLOCKS_PER_THREAD 16
+
+// A buffer of inflated bytes, handed from the decompression thread to the reader
+typedef struct decompressed_buffer
+{
+	char * data;
+	size_t length;
+} decompressed_buffer;
+
+// Reads a plain, gzip or BGZF file, inflating it on another thread so the parser never waits for zlib.
+// The buffers go through a bounded queue, so the decompression is never more than a few buffers ahead.
+typedef struct compressed_reader
+{
+	int is_bgzf;
+	int num_threads;
+	gzFile gzip_file;
+	FILE * bgzf_file_pointer;
+	bgzf_block * blocks;
+	pthread_t decompression_thread;
+	pthread_mutex_t queue_lock;
+	pthread_cond_t queue_not_empty;
+	pthread_cond_t queue_not_full;
+	decompressed_buffer queue[COMPRESSED_READER_QUEUE_SIZE];
+	int queue_start;
+	int queue_length;
+	int finished;
+	int closing;
+	decompressed_buffer current;
+	size_t current_offset;
+} compressed_reader;
+
+// The blocks of a batch which are inflated on one thread
+typedef struct bgzf_block_range
+{
+	bgzf_block * blocks;
+	int first_block;
+	int end_block;
+} bgzf_block_range;
+
+void set_decompression_threads(int num_threads);
+int get_decompression_threads();
+compressed_reader * open_compressed_reader(char filename[]);
+compressed_reader * open_compressed_reader_from_descriptor(int file_descriptor);
+int read_compressed_reader(compressed_reader * reader, void * buffer, unsigned int length);
+void close_compressed_reader(compressed_reader * reader);
+int is_bgzf_header(unsigned char * header, size_t header_length);
+void * decompress_gzip_file(void * reader_pointer);
+void * decompress_bgzf_file(void * reader_pointer);
+int read_bgzf_block(FILE * file_pointer, bgzf_block * block);
+void * inflate_bgzf_block_range(void * range_pointer);
+void inflate_bgzf_block(bgzf_block * block);
+int push_decompressed_buffer(compressed_reader * reader, char * data, size_t length);
+int pop_decompressed_buffer(compressed_reader * reader);
+
+#endif
@@ -0,0 +1,300 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "contigs.h"
+#include "parse_vcf.h"
+
+contig * contigs = NULL;
+int number_of_contigs = 0;
+int contigs_capacity = 0;
+
+// The contigs go one after another, so each starts where the last one ended
+void add_contig(char * name, int length)
+{
+	if(length <= 0)
+	{
+		printf("Error: The contig '%s' has to have a length\n", name);
+		exit(1);
+	}
+	if(number_of_contigs == contigs_capacity)
+	{
+		contigs_capacity = (contigs_capacity == 0) ? 16 : contigs_capacity*2;
+		contigs = (contig *) realloc(contigs, contigs_capacity*sizeof(contig));
+	}
+	contigs[number_of_contigs].name = strdup(name);
+	contigs[number_of_contigs].offset = (number_of_contigs == 0) ? 0 : contigs[number_of_contigs-1].offset + contigs[number_of_contigs-1].length;
+	contigs[number_of_contigs].length = length;
+	number_of_contigs++;
+}
+
+void clear_contigs()
+{
+	int i;
+	for(i = 0; i < number_of_contigs; i++)
+	{
+		free(contigs[i].name);
+	}
+	free(contigs);
+	contigs = NULL;
+	number_of_contigs = 0;
+	contigs_capacity = 0;
+}
+
+// One contig per line, in the order they are in the alignment, as a name and then a length. Blank lines and ones
+// starting with a # are skipped.
+void load_contigs_from_file(char * filename)
+{
+	FILE * contigs_file_pointer = fopen(filename, "r");
+	char line[MAX_CONTIG_NAME_SIZE + 64];
+	char name[MAX_CONTIG_NAME_SIZE];
+	int length;
+	if(contigs_file_pointer == NULL)
+	{
+		printf("Error: Cannot read the contigs file '%s'\n", filename);
+		exit(1);
+	}
+	
+	clear_contigs();
+	while(fgets(line, sizeof(line), contigs_file_pointer) != NULL)
+	{
+		char first_character[2];
+		if(sscanf(line, "%1s", first_character) != 1 || first_character[0] == '#')
+		{
+			continue;
+		}
+		if(sscanf(line, "%1023s %d", name, &length) != 2)
+		{
+			printf("Error: Each line of the contigs file '%s' needs a name and a length\n", filename);
+			exit(1);
+		}
+		add_contig(name, length);
+	}
+	fclose(contigs_file_pointer);
+}
+
+// The contigs are the ##contig lines before the column names
+void load_contigs_from_vcf(FILE * vcf_file_pointer)
+{
+	vcf_index * index = get_vcf_index(vcf_file_pointer);
+	size_t header_length = index->data_size;
+	if(index->has_column_header)
+	{
+		header_length = index->column_header_start;
+	}
+	else if(index->number_of_rows > 0)
+	{
+		header_length = index->row_starts[0];
+	}
+	load_contigs_from_vcf_header(index->data, header_length);
+}
+
+// A single contig called 1 is what is written without any contigs, so its treated the same as none
+void load_contigs_from_vcf_header(char * header, size_t header_length)
+{
+	char name[MAX_CONTIG_NAME_SIZE];
+	int length;
+	size_t line_start = 0;
+	
+	clear_contigs();
+	while(line_start < header_length)
+	{
+		char * end_of_line = memchr(header + line_start, '\n', header_length - line_start);
+		size_t line_end = (end_of_line == NULL) ? header_length : (size_t)(end_of_line - header);
+		if(parse_vcf_contig_line(header + line_start, line_end - line_start, name, sizeof(name), &length))
+		{
+			add_contig(name, length);
+		}
+		line_start = line_end + 1;
+	}
+	
+	if(number_of_contigs == 1 && strcmp(contigs[0].name, "1") == 0)
+	{
+		clear_contigs();
+	}
+}
+
+// Returns 1 and fills in the ID and length of a ##contig=<ID=...,length=...> line, or 0 for any other line
+int parse_vcf_contig_line(char * line, size_t line_length, char * name, size_t name_size, int * length)
+{
+	size_t prefix_length = strlen("##contig=<");
+	size_t position = prefix_length;
+	int has_name = 0;
+	int has_length = 0;
+	if(line_length < prefix_length || strncmp(line, "##contig=<", prefix_length) != 0)
+	{
+		return 0;
+	}
+	
+	// Each field is a key=value up to the next comma or the closing >
+	while(position < line_length && line[position] != '>')
+	{
+		size_t field_end = position;
+		while(field_end < line_length && line[field_end] != ',' && line[field_end] != '>')
+		{
+			field_end++;
+		}
+		if(field_end - position > 3 && strncmp(line + position, "ID=", 3) == 0 && field_end - position - 3 < name_size)
+		{
+			memcpy(name, line + position + 3, field_end - position - 3);
+			name[field_end - position - 3] = '\0';
+			has_name = 1;
+		}
+		else if(field_end - position > 7 && strncmp(line + position, "length=", 7) == 0)
+		{
+			*length = atoi(line + position + 7);
+			has_length = 1;
+		}
+		position = (field_end < line_length && line[field_end] == ',') ? field_end + 1 : field_end;
+	}
+	
+	if(has_name && !has_length)
+	{
+		printf("Error: The contig '%s' in the VCF file doesnt have a length\n", name);
+		exit(1);
+	}
+	return has_name;
+}
+
+int contigs_have_been_given()
+{
+	return number_of_contigs > 0;
+}
+
+// Without any contigs the whole genome is the only one
+int get_number_of_contigs()
+{
+	return (number_of_contigs == 0) ? 1 : number_of_contigs;
+}
+
+char * get_contig_name(int contig_index, char * default_name)
+{
+	return (number_of_contigs == 0) ? default_name : contigs[contig_index].name;
+}
+
+// The first base of the contig, counting from 0 for the first base of the genome
+int get_contig_start(int contig_index)
+{
+	return (number_of_contigs == 0) ? 0 : contigs[contig_index].offset;
+}
+
+// One past the last base of the contig, counting from 0
+int get_contig_end(int contig_index, int genome_length)
+{
+	return (number_of_contigs == 0) ? genome_length : contigs[contig_index].offset + contigs[contig_index].length;
+}
+
+int get_longest_contig_name_length()
+{
+	int i;
+	int longest_name_length = 1;
+	for(i = 0; i < number_of_contigs; i++)
+	{
+		int name_length = strlen(contigs[i].name);
+		if(name_length > longest_name_length)
+		{
+			longest_name_length = name_length;
+		}
+	}
+	return longest_name_length;
+}
+
+// The contig which a position of the genome, counting from 1, falls in, with a binary search of the offsets
+int find_contig_for_position(int position)
+{
+	int lower = 0;
+	int upper = number_of_contigs - 1;
+	if(number_of_contigs == 0)
+	{
+		return 0;
+	}
+	while(lower < upper)
+	{
+		int middle = lower + (upper - lower + 1)/2;
+		if(contigs[middle].offset < position)
+		{
+			lower = middle;
+		}
+		else
+		{
+			upper = middle - 1;
+		}
+	}
+	return lower;
+}
+
+// The rows are in order along the genome, so the contig of the last row is tried first. Returns -1 if there
+// isnt a contig with the name.
+int find_contig_with_name(char * name, size_t name_length, int first_guess)
+{
+	int i;
+	for(i = 0; i < number_of_contigs; i++)
+	{
+		int contig_index = (first_guess + i) % number_of_contigs;
+		if(strlen(contigs[contig_index].name) == name_length && strncmp(contigs[contig_index].name, name, name_length) == 0)
+		{
+			return contig_index;
+		}
+	}
+	return -1;
+}
+
+void check_contigs_cover_genome(int genome_length)
+{
+	if(number_of_contigs == 0)
+	{
+		return;
+	}
+	if(get_contig_end(number_of_contigs - 1, genome_length) != genome_length)
+	{
+		printf("Error: The contigs add up to %d bases but the alignment has %d\n", get_contig_end(number_of_contigs - 1, genome_length), genome_length);
+		exit(1);
+	}
+}
+
+// The positions in a vcf with contigs count from the start of the contig in the CHROM column, so the offset of
+// the contig is added to each to give the position in the whole genome
+void convert_vcf_positions_to_genome(FILE * vcf_file_pointer, int * snp_locations, int number_of_snps)
+{
+	int row;
+	int contig_index = 0;
+	if(number_of_contigs == 0)
+	{
+		return;
+	}
+	
+	vcf_index * index = get_vcf_index(vcf_file_pointer);
+	for(row = 0; row < index->number_of_rows && row < number_of_snps; row++)
+	{
+		size_t field_start, field_end;
+		if(!find_field_in_line(index->data, index->row_starts[row], index->row_ends[row], 0, &field_start, &field_end))
+		{
+			continue;
+		}
+		contig_index = find_contig_with_name(index->data + field_start, field_end - field_start, contig_index);
+		if(contig_index < 0)
+		{
+			printf("Error: The contig '%.*s' in the VCF file isnt in its header\n", (int)(field_end - field_start), index->data + field_start);
+			exit(1);
+		}
+		snp_locations[row] += contigs[contig_index].offset;
+	}
+}
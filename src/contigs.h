@@ -0,0 +1,55 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _CONTIGS_H_
+#define _CONTIGS_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+// A contig of the reference, as the range of the concatenated alignment which it takes up. The alignment holds
+// the contigs one after another, so the offset of each is the total length of the ones before it. Without any
+// contigs the whole alignment is a single sequence, with the same names in the VCF and GFF files as always.
+typedef struct contig
+{
+	char * name;
+	int offset;
+	int length;
+} contig;
+
+void add_contig(char * name, int length);
+void clear_contigs();
+void load_contigs_from_file(char * filename);
+void load_contigs_from_vcf(FILE * vcf_file_pointer);
+void load_contigs_from_vcf_header(char * header, size_t header_length);
+int parse_vcf_contig_line(char * line, size_t line_length, char * name, size_t name_size, int * length);
+int contigs_have_been_given();
+int get_number_of_contigs();
+char * get_contig_name(int contig_index, char * default_name);
+int get_contig_start(int contig_index);
+int get_contig_end(int contig_index, int genome_length);
+int get_longest_contig_name_length();
+int find_contig_for_position(int position);
+int find_contig_with_name(char * name, size_t name_length, int first_guess);
+void check_contigs_cover_genome(int genome_length);
+void convert_vcf_positions_to_genome(FILE * vcf_file_pointer, int * snp_locations, int number_of_snps);
+
+#define MAX_CONTIG_NAME_SIZE 1024
+
+#endif
@@ -25,37 +25,80 @@
 #include "fasta_of_snp_sites.h"
 #include "parse_phylip.h"
 #include "string_cat.h"
+#include "output_buffer.h"
+#include "bgzf_file.h"
 
-void create_fasta_of_snp_sites(char filename[], int number_of_snps, char ** bases_for_snps, char ** sequence_names, int number_of_samples,int internal_nodes[])
+void create_fasta_of_snp_sites(char filename[], int number_of_snps, char ** bases_for_samples, char ** sequence_names, int number_of_samples,int internal_nodes[], int num_threads)
+{
+	FILE *fasta_file_pointer;
+	output_buffer buffer;
+	snp_sites_rows rows;
+	
+	fasta_file_pointer = open_fasta_of_snp_sites(filename);
+	
+	rows.bases_for_samples = bases_for_samples;
+	rows.sequence_names = sequence_names;
+	rows.number_of_snps = number_of_snps;
+	rows.internal_nodes = internal_nodes;
+	
+	initialise_output_buffer(&buffer, fasta_file_pointer, OUTPUT_BUFFER_SIZE);
+	write_rows(&buffer, &rows, number_of_samples, maximum_fasta_of_snp_sites_row_length, format_fasta_of_snp_sites_row, num_threads);
+	free_output_buffer(&buffer);
+  fclose(fasta_file_pointer);
+}
+
+FILE * open_fasta_of_snp_sites(char filename[])
 {
 	FILE *fasta_file_pointer;
-	int sample_counter;
-	int snp_counter; 
 	char * base_filename;
 	
 	base_filename = (char *) calloc(1024,sizeof(char));
 	memcpy(base_filename, filename, 1024*sizeof(char));
 	char extension[16] = {".snp_sites.aln"};
 	concat_strings_created_with_malloc(base_filename,extension);
-	fasta_file_pointer = fopen(base_filename, "w");
+	fasta_file_pointer = open_output_file(base_filename);
+	free(base_filename);
+	return fasta_file_pointer;
+}
+
+// The name line, the bases with a newline every FASTA_LINE_LENGTH bases and a final newline
+size_t maximum_fasta_of_snp_sites_row_length(void * rows, int row_index)
+{
+	snp_sites_rows * fasta = (snp_sites_rows *) rows;
+	if(fasta->internal_nodes[row_index] == 1)
+	{
+		return 0;
+	}
+	return strlen(fasta->sequence_names[row_index]) + 3 + fasta->number_of_snps + fasta->number_of_snps/FASTA_LINE_LENGTH;
+}
+
+size_t format_fasta_of_snp_sites_row(void * rows, int row_index, char * destination)
+{
+	snp_sites_rows * fasta = (snp_sites_rows *) rows;
+	size_t length = 0;
+	size_t name_length;
+	int snp_counter;
 	
-	for(sample_counter=0; sample_counter< number_of_samples; sample_counter++)
+	if(fasta->internal_nodes[row_index] == 1)
 	{
-		if(internal_nodes[sample_counter] == 1)
-		{
-			continue;
-		}
-		fprintf( fasta_file_pointer, ">%s\n", sequence_names[sample_counter]);
-		for(snp_counter=0; snp_counter< number_of_snps; snp_counter++)
+		return 0;
+	}
+	destination[length++] = '>';
+	name_length = strlen(fasta->sequence_names[row_index]);
+	memcpy(destination + length, fasta->sequence_names[row_index], name_length);
+	length += name_length;
+	destination[length++] = '\n';
+	
+	for(snp_counter=0; snp_counter< fasta->number_of_snps; snp_counter += FASTA_LINE_LENGTH)
+	{
+		int bases_on_line = fasta->number_of_snps - snp_counter < FASTA_LINE_LENGTH ? fasta->number_of_snps - snp_counter : FASTA_LINE_LENGTH;
+		if(snp_counter > 0)
 		{
-			if(snp_counter > 0 && snp_counter % FASTA_LINE_LENGTH == 0)
-			{
-				fprintf( fasta_file_pointer, "\n");
-			}
-			fprintf( fasta_file_pointer, "%c", bases_for_snps[snp_counter][sample_counter]);
+			destination[length++] = '\n';
 		}
-		fprintf( fasta_file_pointer, "\n");
+		memcpy(destination + length, fasta->bases_for_samples[row_index] + snp_counter, bases_on_line);
+		length += bases_on_line;
 	}
-  fclose(fasta_file_pointer);
-	free(base_filename);
-}
\ No newline at end of file
+	destination[length++] = '\n';
+	return length;
+}
@@ -21,6 +21,12 @@
 #ifndef _FASTA_OF_SNP_SITES_
 #define _FASTA_OF_SNP_SITES_
 
-void create_fasta_of_snp_sites(char filename[], int number_of_snps, char ** bases_for_snps, char ** sequence_names, int number_of_samples,int internal_nodes[]);
+#include <stddef.h>
+#include "phylip_of_snp_sites.h"
+
+FILE * open_fasta_of_snp_sites(char filename[]);
+void create_fasta_of_snp_sites(char filename[], int number_of_snps, char ** bases_for_samples, char ** sequence_names, int number_of_samples,int internal_nodes[], int num_threads);
+size_t maximum_fasta_of_snp_sites_row_length(void * rows, int row_index);
+size_t format_fasta_of_snp_sites_row(void * rows, int row_index, char * destination);
 #define FASTA_LINE_LENGTH 8191 
 #endif
\ No newline at end of file
@@ -0,0 +1,179 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gap_reinsertion.h"
+#include "parse_vcf.h"
+#include "alignment_file.h"
+#include "branch_sequences.h"
+#include "profile.h"
+
+// The snp alignment of the ancestors only has the columns of the vcf where a base differs. The columns where the
+// only alternative is a gap are put back in from the vcf, so the ancestors line up with the gapped leaf sequences.
+void reinsert_gaps_into_fasta_file(char input_fasta_filename[], char vcf_filename[], char output_fasta_filename[])
+{
+	FILE * vcf_file_pointer = fopen(vcf_filename, "r");
+	if(vcf_file_pointer == NULL)
+	{
+		printf("Cannot open the VCF file '%s'\n", vcf_filename);
+		exit(1);
+	}
+	reinsert_gaps_using_vcf(vcf_file_pointer, input_fasta_filename, output_fasta_filename);
+	free_vcf_index();
+	fclose(vcf_file_pointer);
+}
+
+// Appends the gapped sequence of every record which isnt a sample in the vcf, so the leaves already in the output are kept
+void reinsert_gaps_using_vcf(FILE * vcf_file_pointer, char input_fasta_filename[], char output_fasta_filename[])
+{
+	int i;
+	int number_of_columns = get_number_of_columns_from_file(vcf_file_pointer);
+	char ** column_names = (char **) calloc(number_of_columns + 1, sizeof(char *));
+	get_pooled_column_names(vcf_file_pointer, column_names, number_of_columns);
+	
+	// The samples come after the 9 fixed columns, and are sorted so each record is looked up with a binary search
+	int number_of_samples = (number_of_columns > 9) ? number_of_columns - 9 : 0;
+	char ** sample_names = column_names + (number_of_columns - number_of_samples);
+	qsort(sample_names, number_of_samples, sizeof(char *), compare_sample_names);
+	
+	vcf_index * index = get_vcf_index(vcf_file_pointer);
+	char * gap_only_bases = (char *) calloc(index->number_of_rows + 1, sizeof(char));
+	int number_of_vcf_columns = get_gap_only_columns_from_vcf(vcf_file_pointer, gap_only_bases);
+	
+	record_profile_input_file(input_fasta_filename);
+	loaded_alignment * alignment = load_alignment(input_fasta_filename);
+	FILE * output_file_pointer = fopen(output_fasta_filename, "a");
+	if(output_file_pointer == NULL)
+	{
+		printf("Cannot write to the FASTA file '%s'\n", output_fasta_filename);
+		exit(1);
+	}
+	record_profile_output_file(output_fasta_filename);
+	
+	char * gapped_sequence = (char *) calloc(number_of_vcf_columns + 2, sizeof(char));
+	for(i = 0; i < alignment->number_of_sequences; i++)
+	{
+		char * sequence_name = alignment->sequence_names[i];
+		if(bsearch(&sequence_name, sample_names, number_of_samples, sizeof(char *), compare_sample_names) != NULL)
+		{
+			continue;
+		}
+		
+		// Each base of the snp alignment fills the next column which isnt gap only, and any bases left over are dropped
+		char * sequence = alignment->sequences[i];
+		int sequence_length = alignment->sequence_lengths[i];
+		int base_index = 0;
+		int column;
+		for(column = 0; column < number_of_vcf_columns; column++)
+		{
+			if(gap_only_bases[column] != '\0')
+			{
+				gapped_sequence[column] = gap_only_bases[column];
+			}
+			else if(base_index < sequence_length)
+			{
+				gapped_sequence[column] = sequence[base_index];
+				base_index++;
+			}
+			else
+			{
+				gapped_sequence[column] = '-';
+			}
+		}
+		gapped_sequence[number_of_vcf_columns] = '\n';
+		fprintf(output_file_pointer, ">%s\n", sequence_name);
+		fwrite(gapped_sequence, sizeof(char), number_of_vcf_columns + 1, output_file_pointer);
+	}
+	fclose(output_file_pointer);
+	free_loaded_alignment();
+	
+	free(gapped_sequence);
+	free(gap_only_bases);
+	free(column_names);
+}
+
+// Sets the base of each gap only column, or \0 if the column has a snp, and returns the number of columns.
+// Every snp row is a column, whichever contig it is on.
+int get_gap_only_columns_from_vcf(FILE * vcf_file_pointer, char * gap_only_bases)
+{
+	int row;
+	int number_of_vcf_columns = 0;
+	vcf_index * index = get_vcf_index(vcf_file_pointer);
+	for(row = 0; row < index->number_of_rows; row++)
+	{
+		size_t line_start = index->row_starts[row];
+		size_t line_end = index->row_ends[row];
+		if(line_start >= line_end)
+		{
+			continue;
+		}
+		
+		size_t reference_start, reference_end, alternative_start, alternative_end;
+		char gap_only_base = '\0';
+		if(find_field_in_line(index->data, line_start, line_end, 3, &reference_start, &reference_end) &&
+		   find_field_in_line(index->data, line_start, line_end, 4, &alternative_start, &alternative_end) &&
+		   alternative_end < line_end)
+		{
+			is_gap_only_vcf_row(index->data + reference_start, reference_end - reference_start, index->data + alternative_start, alternative_end - alternative_start, &gap_only_base);
+		}
+		gap_only_bases[number_of_vcf_columns] = gap_only_base;
+		number_of_vcf_columns++;
+	}
+	return number_of_vcf_columns;
+}
+
+// A row is gap only if one of the reference and alternative is a single base and the other is a single character which
+// isnt one, either a gap or an N. The base is the one the column takes in every ancestor.
+int is_gap_only_vcf_row(char * reference, size_t reference_length, char * alternative, size_t alternative_length, char * gap_only_base)
+{
+	if(reference_length != 1 || alternative_length != 1)
+	{
+		return 0;
+	}
+	if(is_nucleotide(reference[0]) && !is_nucleotide(alternative[0]))
+	{
+		*gap_only_base = reference[0];
+		return 1;
+	}
+	if(!is_nucleotide(reference[0]) && is_nucleotide(alternative[0]))
+	{
+		*gap_only_base = alternative[0];
+		return 1;
+	}
+	return 0;
+}
+
+int is_nucleotide(char base)
+{
+	switch(base)
+	{
+		case 'A': case 'C': case 'G': case 'T':
+		case 'a': case 'c': case 'g': case 't':
+			return 1;
+		default:
+			return 0;
+	}
+}
+
+int compare_sample_names(const void * a, const void * b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
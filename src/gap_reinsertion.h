@@ -0,0 +1,33 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _GAP_REINSERTION_H_
+#define _GAP_REINSERTION_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+void reinsert_gaps_into_fasta_file(char input_fasta_filename[], char vcf_filename[], char output_fasta_filename[]);
+void reinsert_gaps_using_vcf(FILE * vcf_file_pointer, char input_fasta_filename[], char output_fasta_filename[]);
+int get_gap_only_columns_from_vcf(FILE * vcf_file_pointer, char * gap_only_bases);
+int is_gap_only_vcf_row(char * reference, size_t reference_length, char * alternative, size_t alternative_length, char * gap_only_base);
+int is_nucleotide(char base);
+int compare_sample_names(const void * a, const void * b);
+
+#endif
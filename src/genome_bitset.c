@@ -0,0 +1,130 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "genome_bitset.h"
+
+void initialise_genome_bitset(genome_bitset * bitset, int length)
+{
+	bitset->length = length;
+	bitset->number_of_words = (length + GENOME_BITSET_WORD_SIZE - 1)/GENOME_BITSET_WORD_SIZE;
+	bitset->words = (uint64_t *) calloc(bitset->number_of_words + 1, sizeof(uint64_t));
+	if(bitset->words == NULL)
+	{
+		printf("Couldnt allocate a bitset for a genome of length %d\n", length);
+		exit(1);
+	}
+}
+
+void clear_genome_bitset(genome_bitset * bitset)
+{
+	memset(bitset->words, 0, bitset->number_of_words*sizeof(uint64_t));
+}
+
+// Mask of the bits from start up to but not including end within a single word, where end can be the word size
+static uint64_t bits_in_word(int start, int end)
+{
+	uint64_t upper = (end >= GENOME_BITSET_WORD_SIZE) ? ~((uint64_t) 0) : ((((uint64_t) 1) << end) - 1);
+	uint64_t lower = (((uint64_t) 1) << start) - 1;
+	return upper & ~lower;
+}
+
+// Sets the bases from start up to but not including end. The range is clipped to the genome.
+void set_range_in_genome_bitset(genome_bitset * bitset, int start, int end)
+{
+	if(start < 0)
+	{
+		start = 0;
+	}
+	if(end > bitset->length)
+	{
+		end = bitset->length;
+	}
+	if(end <= start)
+	{
+		return;
+	}
+	
+	int first_word = start/GENOME_BITSET_WORD_SIZE;
+	int last_word = (end - 1)/GENOME_BITSET_WORD_SIZE;
+	int i;
+	if(first_word == last_word)
+	{
+		bitset->words[first_word] |= bits_in_word(start - first_word*GENOME_BITSET_WORD_SIZE, end - first_word*GENOME_BITSET_WORD_SIZE);
+		return;
+	}
+	bitset->words[first_word] |= bits_in_word(start - first_word*GENOME_BITSET_WORD_SIZE, GENOME_BITSET_WORD_SIZE);
+	for(i = first_word + 1; i < last_word; i++)
+	{
+		bitset->words[i] = ~((uint64_t) 0);
+	}
+	bitset->words[last_word] |= bits_in_word(0, end - last_word*GENOME_BITSET_WORD_SIZE);
+}
+
+// Counts the bases set from start up to but not including end
+int count_bits_in_genome_bitset_range(genome_bitset * bitset, int start, int end)
+{
+	if(start < 0)
+	{
+		start = 0;
+	}
+	if(end > bitset->length)
+	{
+		end = bitset->length;
+	}
+	if(end <= start)
+	{
+		return 0;
+	}
+	
+	int first_word = start/GENOME_BITSET_WORD_SIZE;
+	int last_word = (end - 1)/GENOME_BITSET_WORD_SIZE;
+	int i;
+	int count = 0;
+	if(first_word == last_word)
+	{
+		return __builtin_popcountll(bitset->words[first_word] & bits_in_word(start - first_word*GENOME_BITSET_WORD_SIZE, end - first_word*GENOME_BITSET_WORD_SIZE));
+	}
+	count += __builtin_popcountll(bitset->words[first_word] & bits_in_word(start - first_word*GENOME_BITSET_WORD_SIZE, GENOME_BITSET_WORD_SIZE));
+	for(i = first_word + 1; i < last_word; i++)
+	{
+		count += __builtin_popcountll(bitset->words[i]);
+	}
+	count += __builtin_popcountll(bitset->words[last_word] & bits_in_word(0, end - last_word*GENOME_BITSET_WORD_SIZE));
+	return count;
+}
+
+int genome_bitset_is_set(genome_bitset * bitset, int index)
+{
+	if(index < 0 || index >= bitset->length)
+	{
+		return 0;
+	}
+	return (bitset->words[index/GENOME_BITSET_WORD_SIZE] >> (index % GENOME_BITSET_WORD_SIZE)) & 1;
+}
+
+void free_genome_bitset(genome_bitset * bitset)
+{
+	free(bitset->words);
+	bitset->words = NULL;
+	bitset->length = 0;
+	bitset->number_of_words = 0;
+}
@@ -0,0 +1,41 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _GENOME_BITSET_H_
+#define _GENOME_BITSET_H_
+#include <stdint.h>
+
+// One bit for each base of the genome
+typedef struct genome_bitset
+{
+	uint64_t * words;
+	int length;
+	int number_of_words;
+} genome_bitset;
+
+#define GENOME_BITSET_WORD_SIZE 64
+
+void initialise_genome_bitset(genome_bitset * bitset, int length);
+void clear_genome_bitset(genome_bitset * bitset);
+void set_range_in_genome_bitset(genome_bitset * bitset, int start, int end);
+int count_bits_in_genome_bitset_range(genome_bitset * bitset, int start, int end);
+int genome_bitset_is_set(genome_bitset * bitset, int index);
+void free_genome_bitset(genome_bitset * bitset);
+
+#endif
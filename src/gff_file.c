@@ -21,24 +21,43 @@
 #include <stdlib.h>
 #include <string.h>
 #include "gff_file.h"
+#include "contigs.h"
 
 void print_gff_header(FILE * gff_file_pointer, int genome_length)
 {
+	if(gff_file_pointer == NULL)
+	{
+		return;
+	}
+	int i;
 	fprintf(gff_file_pointer, "##gff-version 3\n");
-	fprintf(gff_file_pointer, "##sequence-region SEQUENCE 1 %d\n", genome_length);
+	for(i = 0; i < get_number_of_contigs(); i++)
+	{
+		fprintf(gff_file_pointer, "##sequence-region %s 1 %d\n", get_contig_name(i, "SEQUENCE"), get_contig_end(i, genome_length) - get_contig_start(i));
+	}
 	fflush(gff_file_pointer);
 }
 
-void print_gff_line(FILE * gff_file_pointer, int start_coordinate, int end_coordinate, int number_of_snps, char * current_node_id, char * parent_node_id, char * taxon_names, double  neg_log_likelihood)
+// The blocks never cross the end of a contig, so both coordinates are counted from the start of the contig of the first
+void print_gff_line(FILE * gff_file_pointer, int start_coordinate, int end_coordinate, int number_of_snps, char * current_node_id, char * parent_node_id, taxon_set * taxa, double  neg_log_likelihood)
 {
-	fprintf(gff_file_pointer, "SEQUENCE\tGUBBINS\tCDS\t");
+	if(gff_file_pointer == NULL)
+	{
+		return;
+	}
+	int contig_index = find_contig_for_position(start_coordinate);
+	start_coordinate -= get_contig_start(contig_index);
+	end_coordinate -= get_contig_start(contig_index);
+	fprintf(gff_file_pointer, "%s\tGUBBINS\tCDS\t", get_contig_name(contig_index, "SEQUENCE"));
   fprintf(gff_file_pointer, "%d\t",start_coordinate);
   fprintf(gff_file_pointer, "%d\t",end_coordinate);
 	fprintf(gff_file_pointer, "0.000\t.\t0\t");
 	
 	fprintf(gff_file_pointer, "node=\"%s->%s\";", parent_node_id, current_node_id );
 	fprintf(gff_file_pointer, "neg_log_likelihood=\"%f\";", neg_log_likelihood);
-	fprintf(gff_file_pointer, "taxa=\"%s\";", taxon_names);
+	fprintf(gff_file_pointer, "taxa=\"");
+	print_taxon_names(gff_file_pointer, taxa);
+	fprintf(gff_file_pointer, "\";");
 	fprintf(gff_file_pointer, "snp_count=\"%d\";", number_of_snps);
 	fprintf(gff_file_pointer, "\n");
 	
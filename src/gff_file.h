@@ -19,7 +19,8 @@
 
 #ifndef _GFF_FILE_H_
 #define _GFF_FILE_H_
+#include "taxon_sets.h"
  void print_gff_header(FILE * gff_file_pointer, int genome_length);
- void print_gff_line(FILE * gff_file_pointer, int start_coordinate, int end_coordinate, int number_of_snps, char * current_node_id, char * parent_node_id, char * taxon_names, double  neg_log_likelihood);
+ void print_gff_line(FILE * gff_file_pointer, int start_coordinate, int end_coordinate, int number_of_snps, char * current_node_id, char * parent_node_id, taxon_set * taxa, double  neg_log_likelihood);
 #endif
 
@@ -33,51 +33,77 @@
 #include "Newickform.h"
 #include "tree_statistics.h"
 #include "fasta_of_snp_sites.h"
+#include "base_matrix.h"
+#include "profile.h"
+#include "branch_sequences.h"
+#include "tree_bipartitions.h"
+#include "string_cat.h"
+#include "contigs.h"
+#include "tree_shards.h"
+#include "branch_scan_cache.h"
+#include "binomial_statistics.h"
+#include "output_selection.h"
+#include "ancestral_reconstruction.h"
 
 
 // get reference sequence from VCF, and store snp locations
 // given a sample name extract the sequences from the vcf
 // compare two sequences to get pseudo sequnece and fill in with difference from reference sequence
 
-void run_gubbins(char vcf_filename[], char tree_filename[],char multi_fasta_filename[], int min_snps, char original_multi_fasta_filename[], int window_min, int window_max)
+void run_gubbins(char vcf_filename[], char tree_filename[],char multi_fasta_filename[], int min_snps, char original_multi_fasta_filename[], int window_min, int window_max, int num_threads)
 {
+	start_profile_phase("load_alignment");
 	load_sequences_from_multifasta_file(multi_fasta_filename);
-	extract_sequences(vcf_filename, tree_filename, multi_fasta_filename,min_snps,original_multi_fasta_filename,window_min, window_max);
+	end_profile_phase("load_alignment");
+	extract_sequences(vcf_filename, tree_filename, multi_fasta_filename,min_snps,original_multi_fasta_filename,window_min, window_max, num_threads);
+	start_profile_phase("tree_statistics");
 	create_tree_statistics_file(tree_filename,get_sample_statistics(),number_of_samples_from_parse_phylip());
+	end_profile_phase("tree_statistics");
 	freeup_memory();
-
+	free_branch_scan_workspaces();
 }
 
 
-void extract_sequences(char vcf_filename[], char tree_filename[],char multi_fasta_filename[],int min_snps, char original_multi_fasta_filename[], int window_min, int window_max)
+void extract_sequences(char vcf_filename[], char tree_filename[],char multi_fasta_filename[],int min_snps, char original_multi_fasta_filename[], int window_min, int window_max, int num_threads)
 {
 	FILE *vcf_file_pointer;
 	vcf_file_pointer=fopen(vcf_filename, "r");
+	record_profile_input_file(vcf_filename);
+	record_profile_input_file(original_multi_fasta_filename);
+	int length_of_original_genome;
+	start_profile_phase("original_genome_length");
+	length_of_original_genome = genome_length(original_multi_fasta_filename);	
+	end_profile_phase("original_genome_length");
 	
+	extract_sequences_using_vcf(vcf_file_pointer, tree_filename, min_snps, length_of_original_genome, window_min, window_max, num_threads);
+	free_vcf_index();
+	fclose(vcf_file_pointer);
+}
+
+// Does the work of extract_sequences with a vcf which is already open, so a session can keep it
+// open and indexed across iterations
+void extract_sequences_using_vcf(FILE * vcf_file_pointer, char tree_filename[], int min_snps, int length_of_original_genome, int window_min, int window_max, int num_threads)
+{
 	newick_node* root_node;
 	int number_of_snps;
 	int number_of_columns;
-	int i;
-	int length_of_original_genome;
-	length_of_original_genome = genome_length(original_multi_fasta_filename);	
 	
+	start_profile_phase("reconstruct_ancestors");
+	reconstruct_missing_ancestral_sequences(tree_filename);
+	end_profile_phase("reconstruct_ancestors");
+	
+	start_profile_phase("read_vcf");
 	number_of_columns = get_number_of_columns_from_file(vcf_file_pointer);
 	char* column_names[number_of_columns];
-	for(i = 0; i < number_of_columns; i++)
-	{
-		column_names[i] = calloc(MAX_SAMPLE_NAME_SIZE,sizeof(char));
-	}
-	get_column_names(vcf_file_pointer, column_names, number_of_columns);
+	get_pooled_column_names(vcf_file_pointer, column_names, number_of_columns);
 	
 	number_of_snps  = number_of_snps_in_phylip();
-	
-	int* snp_locations = calloc(number_of_snps, sizeof(int));
-	
-	get_integers_from_column_in_vcf(vcf_file_pointer, snp_locations, number_of_snps, column_number_for_column_name(column_names, "POS", number_of_columns));
+	int* snp_locations = get_snp_locations_from_vcf(vcf_file_pointer, column_names, number_of_columns, number_of_snps, length_of_original_genome);
+	end_profile_phase("read_vcf");
 
-	root_node = build_newick_tree(tree_filename, vcf_file_pointer,snp_locations, number_of_snps, column_names, number_of_columns, length_of_original_genome,min_snps,window_min, window_max);
-	fclose(vcf_file_pointer);
+	root_node = build_newick_tree(tree_filename, snp_locations, number_of_snps, length_of_original_genome,min_snps,window_min, window_max, num_threads);
 
+	start_profile_phase("write_outputs");
 	int* filtered_snp_locations = calloc(number_of_snps, sizeof(int));
 	int number_of_filtered_snps;
 	int number_of_samples = number_of_samples_from_parse_phylip();
@@ -96,47 +122,128 @@ void extract_sequences(char vcf_filename[], char tree_filename[],char multi_fast
 		internal_nodes[a] = get_internal_node(a);
 	}
 
-	number_of_filtered_snps = refilter_existing_snps(reference_sequence_bases, number_of_snps, snp_locations, filtered_snp_locations,internal_nodes);
-	char ** filtered_bases_for_snps = (char **) calloc(number_of_filtered_snps, sizeof(char *));
+	number_of_filtered_snps = refilter_existing_snps(reference_sequence_bases, number_of_snps, snp_locations, filtered_snp_locations,internal_nodes, num_threads);
+	char ** filtered_bases_for_samples = (char **) calloc(number_of_samples+1, sizeof(char *));
+	char ** filtered_bases_for_snps = (char **) calloc(number_of_filtered_snps+1, sizeof(char *));
 
-	filter_sequence_bases_and_rotate(reference_sequence_bases, filtered_bases_for_snps, number_of_filtered_snps);
+	// The phylip and fasta files are written a sample at a time and the vcf a snp at a time, so keep both layouts
+	filter_sequence_bases(reference_sequence_bases, filtered_bases_for_samples, number_of_filtered_snps, num_threads);
+	// Only the vcf is written a snp at a time
+	int number_of_rotated_snps = is_output_selected(GUBBINS_OUTPUT_VCF) ? number_of_filtered_snps : 0;
+	allocate_base_matrix(filtered_bases_for_snps, number_of_rotated_snps, number_of_samples);
+	transpose_base_matrix_in_parallel(filtered_bases_for_samples, number_of_samples, number_of_rotated_snps, filtered_bases_for_snps, num_threads);
 	
-	create_phylip_of_snp_sites(tree_filename, number_of_filtered_snps, filtered_bases_for_snps, sample_names, number_of_samples,internal_nodes);
-	create_vcf_file(tree_filename, filtered_snp_locations, number_of_filtered_snps, filtered_bases_for_snps, sample_names, number_of_samples,internal_nodes,0,length_of_original_genome);
-	create_fasta_of_snp_sites(tree_filename, number_of_filtered_snps, filtered_bases_for_snps, sample_names, number_of_samples,internal_nodes);
+	snp_sites_outputs outputs = {tree_filename, filtered_snp_locations, number_of_filtered_snps, filtered_bases_for_snps, filtered_bases_for_samples, sample_names, number_of_samples, internal_nodes, 0, length_of_original_genome, num_threads};
+	write_snp_sites_outputs(&outputs);
 	
 	// Create an new tree with updated distances
 	scale_branch_distances(root_node, number_of_filtered_snps);
 
 	FILE *output_tree_pointer;
 	output_tree_pointer=fopen(tree_filename, "w");
+	record_profile_output_file(tree_filename);
 	print_tree(root_node,output_tree_pointer);
 	fprintf(output_tree_pointer,";");
 	fflush(output_tree_pointer);
 	fclose(output_tree_pointer);
 	
+	// The splits of the tree, so the driver can look for a tree it has seen before without comparing every tree
+	char bipartitions_filename[MAX_FILENAME_SIZE] = {""};
+	char bipartitions_extension[14] = {".bipartitions"};
+	memcpy(bipartitions_filename, tree_filename, size_of_string(tree_filename) +1);
+	concat_strings_created_with_malloc(bipartitions_filename, bipartitions_extension);
+	write_tree_bipartitions(root_node, bipartitions_filename);
+	end_profile_phase("write_outputs");
 	
-	// Theres a seg fault in here
-	for(i = 0; i < number_of_columns; i++)
-	{
-		free(column_names[i] );
-	}
 	
-	for(i=0; i<number_of_samples; i++ )
-	{
-		free(sample_names[i]);
-	}
+	free_base_matrix(filtered_bases_for_snps, number_of_rotated_snps);
+	free(filtered_bases_for_snps);
+	free_base_matrix(filtered_bases_for_samples, number_of_samples);
+	free(filtered_bases_for_samples);
+	cleanup_node_memory(root_node);
+	seqFreeAll();
+	free(reference_sequence_bases);
+	free(snp_locations);
+	free(filtered_snp_locations);
+}
+
+// The positions of the snps in the whole genome, from the POS column of the vcf and the contigs in its header
+int * get_snp_locations_from_vcf(FILE * vcf_file_pointer, char ** column_names, int number_of_columns, int number_of_snps, int length_of_original_genome)
+{
+	int* snp_locations = calloc(number_of_snps, sizeof(int));
+	
+	get_integers_from_column_in_vcf(vcf_file_pointer, snp_locations, number_of_snps, column_number_for_column_name(column_names, "POS", number_of_columns));
+	load_contigs_from_vcf(vcf_file_pointer);
+	check_contigs_cover_genome(length_of_original_genome);
+	convert_vcf_positions_to_genome(vcf_file_pointer, snp_locations, number_of_snps);
+	return snp_locations;
+}
+
+// Scans the branches of one shard of the tree with only the sequences of its nodes loaded, for the run which puts
+// the shards back together to reuse. A shard past the last one has nothing to do, so a job array can ask for more.
+void run_gubbins_shard(char vcf_filename[], char tree_filename[], char multi_fasta_filename[], int min_snps, char original_multi_fasta_filename[], int window_min, int window_max, int num_threads, int maximum_leaves_per_shard, int shard_index)
+{
+	tree_shard_plan plan;
+	char * tree_string;
+	newick_node * root_node;
 	
-	for(i=0; i<number_of_filtered_snps; i++ )
+	seqMemInit();
+	start_profile_phase("load_tree");
+	record_profile_input_file(tree_filename);
+	tree_string = read_tree_file(tree_filename);
+	root_node = parseTree(tree_string);
+	free(tree_string);
+	plan_tree_shards(root_node, maximum_leaves_per_shard, &plan);
+	end_profile_phase("load_tree");
+	
+	if(shard_index >= plan.number_of_shards)
 	{
-		free(filtered_bases_for_snps[i]);
+		printf("Shard %d of %d has no branches to scan\n", shard_index, plan.number_of_shards);
+		free_tree_shard_plan(&plan);
+		cleanup_node_memory(root_node);
+		seqFreeAll();
+		return;
 	}
+	
+	start_profile_phase("load_alignment");
+	char ** shard_sample_names = (char **) calloc(plan.number_of_nodes_in_tree +1, sizeof(char *));
+	int number_of_shard_samples = get_sample_names_in_tree_shard(&plan, shard_index, shard_sample_names);
+	load_sequences_for_samples_from_multifasta_file(multi_fasta_filename, shard_sample_names, number_of_shard_samples);
+	bind_sequence_indices_to_nodes(root_node);
+	free(shard_sample_names);
+	end_profile_phase("load_alignment");
+	
+	start_profile_phase("read_vcf");
+	FILE * vcf_file_pointer = fopen(vcf_filename, "r");
+	record_profile_input_file(vcf_filename);
+	record_profile_input_file(original_multi_fasta_filename);
+	int length_of_original_genome = genome_length(original_multi_fasta_filename);
+	int number_of_columns = get_number_of_columns_from_file(vcf_file_pointer);
+	char* column_names[number_of_columns];
+	get_pooled_column_names(vcf_file_pointer, column_names, number_of_columns);
+	int number_of_snps = number_of_snps_in_phylip();
+	int * snp_locations = get_snp_locations_from_vcf(vcf_file_pointer, column_names, number_of_columns, number_of_snps, length_of_original_genome);
+	end_profile_phase("read_vcf");
+	
+	start_profile_phase("scan_branches");
+	initialise_log_factorial_table(length_of_original_genome > window_max ? length_of_original_genome : window_max);
+	set_branch_scan_shard(shard_index);
+	scan_tree_shard(&plan, shard_index, snp_locations, number_of_snps, length_of_original_genome, min_snps, window_min, window_max, num_threads);
+	set_branch_scan_shard(-1);
+	free_binomial_statistics();
+	end_profile_phase("scan_branches");
+	printf("Shard %d of %d scanned %d branches\n", shard_index, plan.number_of_shards, get_number_of_branches_in_tree_shard(&plan, shard_index));
+	
+	free(snp_locations);
+	free_tree_shard_plan(&plan);
 	cleanup_node_memory(root_node);
 	seqFreeAll();
-	free(reference_sequence_bases);
+	free_vcf_index();
+	fclose(vcf_file_pointer);
+	freeup_memory();
+	free_branch_scan_workspaces();
 }
 
-
 char find_first_real_base(int base_position,  int number_of_child_sequences, char ** child_sequences)
 {
 	int i = 0; 
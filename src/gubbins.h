@@ -23,8 +23,11 @@
 #include "seqUtil.h"
 #include "Newickform.h"
 
-void run_gubbins(char vcf_filename[], char tree_filename[], char multi_fasta_filename[], int min_snps, char original_multi_fasta_filename[], int window_min, int window_max);
-void extract_sequences(char vcf_filename[], char tree_filename[],char multi_fasta_filename[], int min_snps, char original_multi_fasta_filename[], int window_min, int window_max);
+void run_gubbins(char vcf_filename[], char tree_filename[], char multi_fasta_filename[], int min_snps, char original_multi_fasta_filename[], int window_min, int window_max, int num_threads);
+void extract_sequences(char vcf_filename[], char tree_filename[],char multi_fasta_filename[], int min_snps, char original_multi_fasta_filename[], int window_min, int window_max, int num_threads);
+void extract_sequences_using_vcf(FILE * vcf_file_pointer, char tree_filename[], int min_snps, int length_of_original_genome, int window_min, int window_max, int num_threads);
+int * get_snp_locations_from_vcf(FILE * vcf_file_pointer, char ** column_names, int number_of_columns, int number_of_snps, int length_of_original_genome);
+void run_gubbins_shard(char vcf_filename[], char tree_filename[], char multi_fasta_filename[], int min_snps, char original_multi_fasta_filename[], int window_min, int window_max, int num_threads, int maximum_leaves_per_shard, int shard_index);
 char find_first_real_base(int base_position,  int number_of_child_sequences, char ** child_sequences);
 
 
@@ -0,0 +1,140 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "gubbins_session.h"
+#include "gubbins.h"
+#include "alignment_file.h"
+#include "parse_phylip.h"
+#include "parse_vcf.h"
+#include "tree_statistics.h"
+#include "branch_sequences.h"
+#include "gap_reinsertion.h"
+#include "compressed_reader.h"
+#include "sample_name_pool.h"
+
+// The session is used inside other programs, so bad input is reported back to the caller rather than exiting.
+// There is no session if the files it needs dont exist.
+gubbins_session * create_gubbins_session(char vcf_filename[], char original_multi_fasta_filename[], int min_snps, int window_min, int window_max, int num_threads)
+{
+	if( access( vcf_filename, F_OK ) == -1 ) {
+		printf("Cannot start a session because the VCF file '%s' doesnt exist\n",vcf_filename);
+		return NULL;
+	}
+	if( access( original_multi_fasta_filename, F_OK ) == -1 ) {
+		printf("Cannot start a session because the alignment file '%s' doesnt exist\n",original_multi_fasta_filename);
+		return NULL;
+	}
+	
+	set_decompression_threads(num_threads);
+	gubbins_session * session = (gubbins_session *) calloc(1, sizeof(gubbins_session));
+	session->vcf_file_pointer = fopen(vcf_filename, "r");
+	session->length_of_original_genome = genome_length(original_multi_fasta_filename);
+	session->min_snps = min_snps;
+	session->window_min = window_min;
+	session->window_max = window_max;
+	session->num_threads = (num_threads < 1) ? 1 : num_threads;
+	return session;
+}
+
+int load_gubbins_session_sequences_from_file(gubbins_session * session, char multi_fasta_filename[])
+{
+	if( access( multi_fasta_filename, F_OK ) == -1 ) {
+		printf("Cannot load the sequences because the alignment file '%s' doesnt exist\n",multi_fasta_filename);
+		return GUBBINS_SESSION_MISSING_FILE;
+	}
+	if(session->sequences_loaded)
+	{
+		freeup_memory();
+	}
+	load_sequences_from_multifasta_file(multi_fasta_filename);
+	session->sequences_loaded = 1;
+	return GUBBINS_SESSION_OK;
+}
+
+// The bases are rows of length_of_sequences bytes starting row_stride bytes apart, such as a numpy array of bytes
+int load_gubbins_session_sequences(gubbins_session * session, char ** sample_names, char * bases, int number_of_samples, int length_of_sequences, size_t row_stride)
+{
+	int i;
+	char ** sample_sequences = (char **) calloc(number_of_samples+1, sizeof(char *));
+	int * sequence_lengths = (int *) calloc(number_of_samples+1, sizeof(int));
+	for(i = 0; i < number_of_samples; i++)
+	{
+		sample_sequences[i] = bases + i*row_stride;
+		sequence_lengths[i] = length_of_sequences;
+	}
+	
+	if(session->sequences_loaded)
+	{
+		freeup_memory();
+	}
+	load_sequences_from_rows(sample_names, sample_sequences, sequence_lengths, number_of_samples, length_of_sequences);
+	session->sequences_loaded = 1;
+	free(sample_sequences);
+	free(sequence_lengths);
+	return GUBBINS_SESSION_OK;
+}
+
+// Writes the same files as run_gubbins for the tree, and the sequences have to be loaded again before the next one
+int run_gubbins_session_iteration(gubbins_session * session, char tree_filename[])
+{
+	if(session->sequences_loaded == 0)
+	{
+		printf("Load the sequences for the tree '%s' before running the iteration\n", tree_filename);
+		return GUBBINS_SESSION_SEQUENCES_NOT_LOADED;
+	}
+	if( access( tree_filename, F_OK ) == -1 ) {
+		printf("Cannot run the iteration because the tree file '%s' doesnt exist\n",tree_filename);
+		return GUBBINS_SESSION_MISSING_FILE;
+	}
+	
+	extract_sequences_using_vcf(session->vcf_file_pointer, tree_filename, session->min_snps, session->length_of_original_genome, session->window_min, session->window_max, session->num_threads);
+	create_tree_statistics_file(tree_filename,get_sample_statistics(),number_of_samples_from_parse_phylip());
+	freeup_memory();
+	session->sequences_loaded = 0;
+	session->number_of_iterations++;
+	return GUBBINS_SESSION_OK;
+}
+
+// Uses the vcf the session already has indexed, rather than opening and indexing it again
+int reinsert_gaps_with_gubbins_session(gubbins_session * session, char input_multi_fasta_filename[], char output_multi_fasta_filename[])
+{
+	if( access( input_multi_fasta_filename, F_OK ) == -1 ) {
+		printf("Cannot reinsert gaps because the alignment file '%s' doesnt exist\n",input_multi_fasta_filename);
+		return GUBBINS_SESSION_MISSING_FILE;
+	}
+	reinsert_gaps_using_vcf(session->vcf_file_pointer, input_multi_fasta_filename, output_multi_fasta_filename);
+	return GUBBINS_SESSION_OK;
+}
+
+void free_gubbins_session(gubbins_session * session)
+{
+	if(session->sequences_loaded)
+	{
+		freeup_memory();
+	}
+	free_vcf_index();
+	free_branch_scan_workspaces();
+	free_sample_name_pool();
+	fclose(session->vcf_file_pointer);
+	free(session);
+}
@@ -0,0 +1,53 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _GUBBINS_SESSION_H_
+#define _GUBBINS_SESSION_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+// Keeps the vcf open and indexed and the length of the original genome between iterations, so a
+// caller which links to libgubbins can run one iteration after another without starting a new process.
+// Each iteration takes the sequences for the tree, either from a file or from rows already in memory.
+typedef struct gubbins_session
+{
+	FILE * vcf_file_pointer;
+	int length_of_original_genome;
+	int min_snps;
+	int window_min;
+	int window_max;
+	int num_threads;
+	int sequences_loaded;
+	int number_of_iterations;
+} gubbins_session;
+
+gubbins_session * create_gubbins_session(char vcf_filename[], char original_multi_fasta_filename[], int min_snps, int window_min, int window_max, int num_threads);
+int load_gubbins_session_sequences_from_file(gubbins_session * session, char multi_fasta_filename[]);
+int load_gubbins_session_sequences(gubbins_session * session, char ** sample_names, char * bases, int number_of_samples, int length_of_sequences, size_t row_stride);
+int run_gubbins_session_iteration(gubbins_session * session, char tree_filename[]);
+int reinsert_gaps_with_gubbins_session(gubbins_session * session, char input_multi_fasta_filename[], char output_multi_fasta_filename[]);
+void free_gubbins_session(gubbins_session * session);
+
+// What the session functions return, so a caller in another language can raise its own errors
+#define GUBBINS_SESSION_OK 0
+#define GUBBINS_SESSION_MISSING_FILE 1
+#define GUBBINS_SESSION_SEQUENCES_NOT_LOADED 2
+
+#endif
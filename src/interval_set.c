@@ -0,0 +1,110 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "interval_set.h"
+#include "snp_searching.h"
+
+void initialise_interval_set(interval_set * intervals)
+{
+	intervals->starts = NULL;
+	intervals->ends = NULL;
+	intervals->number_of_intervals = 0;
+	intervals->capacity = 0;
+}
+
+int compare_genome_intervals(const void * a, const void * b)
+{
+	const genome_interval * first_interval = (const genome_interval *) a;
+	const genome_interval * second_interval = (const genome_interval *) b;
+	if(first_interval->start != second_interval->start)
+	{
+		return (first_interval->start < second_interval->start) ? -1 : 1;
+	}
+	if(first_interval->end != second_interval->end)
+	{
+		return (first_interval->end < second_interval->end) ? -1 : 1;
+	}
+	return 0;
+}
+
+// Sort the blocks and merge them in one sweep. Blocks marked as removed with -1 are left out.
+void union_of_blocks(int ** block_coordinates, int num_blocks, interval_set * intervals)
+{
+	int i;
+	int number_of_blocks = 0;
+	genome_interval * blocks = (genome_interval *) malloc((num_blocks+1)*sizeof(genome_interval));
+	for(i = 0; i < num_blocks; i++)
+	{
+		if(block_coordinates[0][i] == -1 || block_coordinates[1][i] == -1)
+		{
+			continue;
+		}
+		blocks[number_of_blocks].start = block_coordinates[0][i];
+		blocks[number_of_blocks].end = block_coordinates[1][i];
+		number_of_blocks++;
+	}
+	qsort(blocks, number_of_blocks, sizeof(genome_interval), compare_genome_intervals);
+	
+	if(number_of_blocks > intervals->capacity)
+	{
+		intervals->capacity = number_of_blocks;
+		intervals->starts = (int *) realloc(intervals->starts, intervals->capacity*sizeof(int));
+		intervals->ends = (int *) realloc(intervals->ends, intervals->capacity*sizeof(int));
+	}
+	intervals->number_of_intervals = 0;
+	for(i = 0; i < number_of_blocks; i++)
+	{
+		int last_interval = intervals->number_of_intervals - 1;
+		if(last_interval >= 0 && blocks[i].start <= intervals->ends[last_interval])
+		{
+			if(blocks[i].end > intervals->ends[last_interval])
+			{
+				intervals->ends[last_interval] = blocks[i].end;
+			}
+		}
+		else
+		{
+			intervals->starts[intervals->number_of_intervals] = blocks[i].start;
+			intervals->ends[intervals->number_of_intervals] = blocks[i].end;
+			intervals->number_of_intervals++;
+		}
+	}
+	free(blocks);
+}
+
+// Each interval counts as end - start bases, less the gaps at the snps from its start up to its end
+int count_bases_in_interval_set_excluding_gaps(interval_set * intervals, int * gap_prefix_counts, int * snp_locations, int number_of_snps)
+{
+	int i;
+	int total_bases = 0;
+	for(i = 0; i < intervals->number_of_intervals; i++)
+	{
+		total_bases += calculate_block_size_without_gaps_with_prefix_index(gap_prefix_counts, snp_locations, intervals->starts[i], intervals->ends[i], number_of_snps);
+	}
+	return total_bases;
+}
+
+void free_interval_set(interval_set * intervals)
+{
+	free(intervals->starts);
+	free(intervals->ends);
+	initialise_interval_set(intervals);
+}
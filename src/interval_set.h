@@ -0,0 +1,45 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _INTERVAL_SET_H_
+#define _INTERVAL_SET_H_
+
+// Blocks of the genome sorted by their start, with overlapping and touching blocks merged into one.
+// The coordinates are inclusive at both ends, like the recombination blocks.
+typedef struct interval_set
+{
+	int * starts;
+	int * ends;
+	int number_of_intervals;
+	int capacity;
+} interval_set;
+
+typedef struct genome_interval
+{
+	int start;
+	int end;
+} genome_interval;
+
+void initialise_interval_set(interval_set * intervals);
+void union_of_blocks(int ** block_coordinates, int num_blocks, interval_set * intervals);
+int count_bases_in_interval_set_excluding_gaps(interval_set * intervals, int * gap_prefix_counts, int * snp_locations, int number_of_snps);
+int compare_genome_intervals(const void * a, const void * b);
+void free_interval_set(interval_set * intervals);
+
+#endif
@@ -26,6 +26,21 @@
 #include "gubbins.h"
 #include "../config.h"
 #include "string_cat.h"
+#include "bgzf_file.h"
+#include "alignment_cache.h"
+#include "branch_sequences.h"
+#include "profile.h"
+#include "trace_events.h"
+#include "gap_reinsertion.h"
+#include "branch_scan_cache.h"
+#include "contigs.h"
+#include "matrix_storage.h"
+#include "output_selection.h"
+#include "compressed_reader.h"
+#include "branch_snp_columns.h"
+#include "parse_phylip.h"
+#include "ancestral_reconstruction.h"
+#include "alignment_filter.h"
 
 #define MAX_FILENAME_SIZE 1024
 const char* program_name;
@@ -49,6 +64,28 @@ void print_usage(FILE* stream, int exit_code)
            "  -m    Min SNPs for identifying a recombination block\n"
 		   "  -a    Min window size\n"
 		   "  -b    Max window size\n"
+		   "  -j    Number of threads for scanning branches\n"
+		   "  -z    Compress the output files with BGZF\n"
+		   "  -c    Cache the parsed alignments in binary files next to them\n"
+		   "  -x    Accept all of the significant blocks which dont overlap in each pass of a branch\n"
+		   "  -p    Write the time and memory used by each phase to this JSON file\n"
+		   "  -e    Write when each branch was scanned, and on which thread, to this Chrome trace JSON file\n"
+		   "  -g    Reinsert the gap only columns of the VCF into the ancestral sequences of the alignment file\n"
+		   "  -o    Output file which the gapped ancestral sequences are appended to\n"
+		   "  -w    Directory to keep the scans of branches in, so branches which havent changed since the last run are reused\n"
+		   "  -s    Only scan the branches of this shard of the tree, counting from 0, into the -w directory\n"
+		   "  -l    Most leaves in a shard of the tree, cut into subtrees. A run with -w and without -s puts the shards together\n"
+		   "  -k    File of the contigs the alignment is made of, in order, with a name and length on each line\n"
+		   "  -M    Most memory in MB for the matrices of bases, bigger ones are kept in a file mapped into memory.\n"
+		   "        Without -r, snp sites too big for it are written a block of samples or snps at a time\n"
+		   "  -y    Write the branch snps as binary columns with a dictionary of the nodes, rather than as EMBL features\n"
+		   "  -d    Keep each sequence in the tree as its differences from its parent, which uses much less memory for big trees\n"
+		   "  -u    Convert the binary branch snps file to EMBL features in the -o output file\n"
+		   "  -A    Reconstruct the internal nodes missing from the alignment with parsimony or joint (maximum likelihood)\n"
+		   "  -F    Filter the alignment into the -o file, removing sequences with more than this percentage of missing data.\n"
+		   "        The names of the removed sequences are written to the -o file with .removed_taxa added\n"
+		   "  -I    With -F, also remove all but the last of each set of identical sequences\n"
+		   "  -O    Comma separated outputs to write, from tab, branch_snps, gff, stats, vcf, phylip and snp_sites (default all)\n"
            "  -h    Display this usage information.\n\n"
 );
   exit (exit_code);
@@ -73,11 +110,28 @@ int main (argc, argv) int argc; char **argv;
   char tree_filename[MAX_FILENAME_SIZE] = {""};
   char phylip_filename[MAX_FILENAME_SIZE] = {""};
   char original_multi_fasta_filename[MAX_FILENAME_SIZE] = {""};
+  char profile_filename[MAX_FILENAME_SIZE] = {""};
+  char trace_filename[MAX_FILENAME_SIZE] = {""};
+  char output_filename[MAX_FILENAME_SIZE] = {""};
+  char branch_scan_cache_directory[MAX_FILENAME_SIZE] = {""};
+  char contigs_filename[MAX_FILENAME_SIZE] = {""};
 
   int recombination_flag = 0 ;
+  int reinsert_gaps_flag = 0;
+  int convert_branch_snps_flag = 0;
+  int filter_alignment_flag = 0;
+  int remove_identical_sequences = 0;
+  double filter_percentage = 25;
+  int binary_branch_snps = 0;
   int min_snps = 3;
   int window_min = 100;
   int window_max = 10000;
+  int num_threads = 1;
+  int compress_output = 0;
+  int use_alignment_cache = 0;
+  int multi_block = 0;
+  int shard_index = -1;
+  int maximum_leaves_per_shard = 0;
   program_name = argv[0];
   
   while (1)
@@ -92,12 +146,32 @@ int main (argc, argv) int argc; char **argv;
           {"min_snps",            required_argument, 0, 'm'},
 		  {"window_min",                 required_argument, 0, 'a'},
 		  {"window_max",                 required_argument, 0, 'b'},
+		  {"threads",                    required_argument, 0, 'j'},
+		  {"compress",                   no_argument,       0, 'z'},
+		  {"alignment_cache",            no_argument,       0, 'c'},
+		  {"multi_block",                no_argument,       0, 'x'},
+		  {"profile",                    required_argument, 0, 'p'},
+		  {"trace",                      required_argument, 0, 'e'},
+		  {"reinsert_gaps",              no_argument,       0, 'g'},
+		  {"output",                     required_argument, 0, 'o'},
+		  {"branch_scan_cache",          required_argument, 0, 'w'},
+		  {"contigs",                    required_argument, 0, 'k'},
+		  {"shard",                      required_argument, 0, 's'},
+		  {"shard_leaves",               required_argument, 0, 'l'},
+		  {"max_memory",                 required_argument, 0, 'M'},
+		  {"outputs",                    required_argument, 0, 'O'},
+		  {"binary_branch_snps",         no_argument,       0, 'y'},
+		  {"branch_snps_to_text",        no_argument,       0, 'u'},
+		  {"sparse_ancestors",           no_argument,       0, 'd'},
+		  {"ancestral_reconstruction",   required_argument, 0, 'A'},
+		  {"filter_percentage",          required_argument, 0, 'F'},
+		  {"remove_identical_sequences", no_argument,       0, 'I'},
 		  
           {0, 0, 0, 0}
         };
       /* getopt_long stores the option index here. */
       int option_index = 0;
-      c = getopt_long (argc, argv, "hrv:f:t:m:a:b:",
+      c = getopt_long (argc, argv, "hrv:f:t:m:a:b:j:zcxp:e:go:w:k:s:l:M:O:yudA:F:I",
                        long_options, &option_index);
       /* Detect the end of the options. */
       if (c == -1)
@@ -134,6 +208,71 @@ int main (argc, argv) int argc; char **argv;
 	  	  case 'b':
 	  	      window_max = atoi(optarg);
 	  	      break;
+	  	  case 'j':
+	  	      num_threads = atoi(optarg);
+	  	      if(num_threads < 1)
+	  	      {
+	  	        num_threads = 1;
+	  	      }
+	  	      break;
+	  	  case 'c':
+	  	      use_alignment_cache = 1;
+	  	      break;
+	  	  case 'p':
+	  	      memcpy(profile_filename, optarg, size_of_string(optarg) +1);
+	  	      break;
+	  	  case 'e':
+	  	      memcpy(trace_filename, optarg, size_of_string(optarg) +1);
+	  	      break;
+	  	  case 'g':
+	  	      reinsert_gaps_flag = 1;
+	  	      break;
+	  	  case 'o':
+	  	      memcpy(output_filename, optarg, size_of_string(optarg) +1);
+	  	      break;
+	  	  case 'w':
+	  	      memcpy(branch_scan_cache_directory, optarg, size_of_string(optarg) +1);
+	  	      break;
+	  	  case 's':
+	  	      shard_index = atoi(optarg);
+	  	      break;
+	  	  case 'l':
+	  	      maximum_leaves_per_shard = atoi(optarg);
+	  	      break;
+	  	  case 'k':
+	  	      memcpy(contigs_filename, optarg, size_of_string(optarg) +1);
+	  	      break;
+	  	  case 'M':
+	  	      set_matrix_memory_budget((size_t) atol(optarg) * 1024 * 1024);
+	  	      break;
+	  	  case 'y':
+	  	      binary_branch_snps = 1;
+	  	      break;
+	  	  case 'u':
+	  	      convert_branch_snps_flag = 1;
+	  	      break;
+	  	  case 'd':
+	  	      set_sparse_sequence_rows(1);
+	  	      break;
+	  	  case 'F':
+	  	      filter_alignment_flag = 1;
+	  	      filter_percentage = atof(optarg);
+	  	      break;
+	  	  case 'I':
+	  	      remove_identical_sequences = 1;
+	  	      break;
+	  	  case 'A':
+	  	      set_ancestral_reconstruction(parse_ancestral_reconstruction(optarg));
+	  	      break;
+	  	  case 'O':
+	  	      set_selected_outputs(parse_selected_outputs(optarg));
+	  	      break;
+	  	  case 'x':
+	  	      multi_block = 1;
+	  	      break;
+	  	  case 'z':
+	  	      compress_output = 1;
+	  	      break;
           case 't':
 	          memcpy(tree_filename, optarg, size_of_string(optarg) +1);
             break;
@@ -153,19 +292,102 @@ int main (argc, argv) int argc; char **argv;
     }
 
 	
+		set_output_compression(compress_output, num_threads);
+		set_decompression_threads(num_threads);
+		set_alignment_cache(use_alignment_cache);
+		set_multi_block_acceptance(multi_block);
+		set_binary_branch_snps(binary_branch_snps);
+		set_branch_scan_cache_directory(branch_scan_cache_directory);
+		if(contigs_filename[0] != '\0')
+		{
+			check_file_exists_or_exit(contigs_filename);
+			load_contigs_from_file(contigs_filename);
+		}
+		if(profile_filename[0] != '\0')
+		{
+			start_profile(profile_filename);
+		}
+		if(trace_filename[0] != '\0')
+		{
+			start_trace(trace_filename);
+		}
 		check_file_exists_or_exit(multi_fasta_filename);
-    if(recombination_flag == 1)
+    if(recombination_flag == 1 && shard_index >= 0)
+    {
+			check_file_exists_or_exit(vcf_filename);
+			check_file_exists_or_exit(tree_filename);
+			check_file_exists_or_exit(original_multi_fasta_filename);
+			if(branch_scan_cache_directory[0] == '\0' || maximum_leaves_per_shard < 2)
+			{
+				printf("Error: A shard needs the directory to keep its scans in and at least 2 leaves\n");
+				print_usage(stderr, EXIT_FAILURE);
+			}
+      run_gubbins_shard(vcf_filename,tree_filename,multi_fasta_filename, min_snps,original_multi_fasta_filename,window_min, window_max, num_threads, maximum_leaves_per_shard, shard_index);
+    }
+    else if(recombination_flag == 1)
     {
 			check_file_exists_or_exit(vcf_filename);
 			check_file_exists_or_exit(tree_filename);
 			check_file_exists_or_exit(original_multi_fasta_filename);
-      run_gubbins(vcf_filename,tree_filename,multi_fasta_filename, min_snps,original_multi_fasta_filename,window_min, window_max);
+      run_gubbins(vcf_filename,tree_filename,multi_fasta_filename, min_snps,original_multi_fasta_filename,window_min, window_max, num_threads);
+    }
+    else if(reinsert_gaps_flag == 1)
+    {
+			check_file_exists_or_exit(vcf_filename);
+			if(output_filename[0] == '\0')
+			{
+				printf("Error: The output file for the gapped alignment is needed\n");
+				print_usage(stderr, EXIT_FAILURE);
+			}
+      start_profile_phase("reinsert_gaps");
+      reinsert_gaps_into_fasta_file(multi_fasta_filename, vcf_filename, output_filename);
+      end_profile_phase("reinsert_gaps");
+    }
+    else if(filter_alignment_flag == 1)
+    {
+			if(output_filename[0] == '\0')
+			{
+				printf("Error: The output file for the filtered alignment is needed\n");
+				print_usage(stderr, EXIT_FAILURE);
+			}
+			char removed_taxa_filename[MAX_FILENAME_SIZE + 16];
+			snprintf(removed_taxa_filename, sizeof(removed_taxa_filename), "%s.removed_taxa", output_filename);
+      start_profile_phase("filter_alignment");
+      int filter_status = filter_alignment_file(multi_fasta_filename, output_filename, removed_taxa_filename, filter_percentage, remove_identical_sequences, num_threads);
+      end_profile_phase("filter_alignment");
+			if(filter_status == ALIGNMENT_FILTER_TOO_FEW_SEQUENCES)
+			{
+				printf("Not enough sequences are left after removing duplicates.Please check you input data.\n");
+				exit(1);
+			}
+			else if(filter_status == ALIGNMENT_FILTER_CANNOT_WRITE_OUTPUT)
+			{
+				printf("Cannot write to the FASTA file '%s'\n", output_filename);
+				exit(1);
+			}
+			else if(filter_status == ALIGNMENT_FILTER_CANNOT_WRITE_REMOVED_TAXA)
+			{
+				printf("Cannot write the removed sequences to '%s'\n", removed_taxa_filename);
+				exit(1);
+			}
+    }
+    else if(convert_branch_snps_flag == 1)
+    {
+			if(output_filename[0] == '\0')
+			{
+				printf("Error: The output file for the branch snps features is needed\n");
+				print_usage(stderr, EXIT_FAILURE);
+			}
+      convert_branch_snp_columns_to_text(multi_fasta_filename, output_filename);
     }
     else
     {
-      generate_snp_sites(multi_fasta_filename, 0, ".gaps");
-			generate_snp_sites(multi_fasta_filename, 1, "");
+      start_profile_phase("generate_snp_sites");
+      generate_snp_sites_including_and_excluding_gaps(multi_fasta_filename, ".gaps", "", num_threads);
+      end_profile_phase("generate_snp_sites");
     }
+    write_profile_report();
+    write_trace();
 
     exit(EXIT_SUCCESS);
 }
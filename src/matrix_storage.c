@@ -0,0 +1,164 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "matrix_storage.h"
+
+#define MAX_MATRIX_STORAGE_FILENAME_SIZE 1024
+
+// 0 means there is no budget and everything is kept on the heap
+size_t matrix_memory_budget = 0;
+size_t matrix_storage_bytes_on_heap = 0;
+matrix_storage_block * matrix_storage_blocks = NULL;
+int number_of_matrix_storage_blocks = 0;
+int matrix_storage_blocks_capacity = 0;
+
+void set_matrix_memory_budget(size_t budget_in_bytes)
+{
+	matrix_memory_budget = budget_in_bytes;
+}
+
+size_t get_matrix_memory_budget()
+{
+	return matrix_memory_budget;
+}
+
+size_t get_matrix_storage_bytes_on_heap()
+{
+	return matrix_storage_bytes_on_heap;
+}
+
+// Zeroed memory like calloc, the matrices are only ever allocated and freed on the main thread
+void * allocate_matrix_storage(size_t size)
+{
+	matrix_storage_block block;
+	block.size = size > 0 ? size : 1;
+	block.is_mapped = matrix_memory_budget > 0 && matrix_storage_bytes_on_heap + block.size > matrix_memory_budget;
+	if(block.is_mapped)
+	{
+		block.data = map_matrix_storage_file(block.size);
+	}
+	else
+	{
+		block.data = calloc(block.size, sizeof(char));
+		if(block.data == NULL)
+		{
+			printf("Couldnt allocate %zu bytes for a matrix of bases\n", block.size);
+			exit(1);
+		}
+		matrix_storage_bytes_on_heap += block.size;
+	}
+	
+	if(number_of_matrix_storage_blocks == matrix_storage_blocks_capacity)
+	{
+		matrix_storage_blocks_capacity = matrix_storage_blocks_capacity == 0 ? 4 : matrix_storage_blocks_capacity*2;
+		matrix_storage_blocks = (matrix_storage_block *) realloc(matrix_storage_blocks, matrix_storage_blocks_capacity*sizeof(matrix_storage_block));
+	}
+	matrix_storage_blocks[number_of_matrix_storage_blocks] = block;
+	number_of_matrix_storage_blocks++;
+	return block.data;
+}
+
+// The file is in TMPDIR, or the working directory next to the outputs if it isnt set, since /tmp is
+// often held in memory itself. It is removed straight away so nothing is left behind if the run is killed.
+void * map_matrix_storage_file(size_t size)
+{
+	char filename[MAX_MATRIX_STORAGE_FILENAME_SIZE];
+	const char * directory = getenv("TMPDIR");
+	if(directory == NULL || directory[0] == '\0')
+	{
+		directory = ".";
+	}
+	snprintf(filename, sizeof(filename), "%s/%s", directory, MATRIX_STORAGE_FILE_TEMPLATE);
+	
+	int file_descriptor = mkstemp(filename);
+	if(file_descriptor == -1)
+	{
+		printf("Couldnt create a file in %s to hold a matrix of bases\n", directory);
+		exit(1);
+	}
+	unlink(filename);
+	if(ftruncate(file_descriptor, (off_t) size) != 0)
+	{
+		printf("Couldnt make a file of %zu bytes in %s to hold a matrix of bases\n", size, directory);
+		exit(1);
+	}
+	void * data = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file_descriptor, 0);
+	close(file_descriptor);
+	if(data == MAP_FAILED)
+	{
+		printf("Couldnt map a file of %zu bytes in %s to hold a matrix of bases\n", size, directory);
+		exit(1);
+	}
+	return data;
+}
+
+void free_matrix_storage(void * data)
+{
+	int i;
+	for(i = 0; i < number_of_matrix_storage_blocks; i++)
+	{
+		if(matrix_storage_blocks[i].data != data)
+		{
+			continue;
+		}
+		if(matrix_storage_blocks[i].is_mapped)
+		{
+			munmap(data, matrix_storage_blocks[i].size);
+		}
+		else
+		{
+			free(data);
+			matrix_storage_bytes_on_heap -= matrix_storage_blocks[i].size;
+		}
+		number_of_matrix_storage_blocks--;
+		matrix_storage_blocks[i] = matrix_storage_blocks[number_of_matrix_storage_blocks];
+		return;
+	}
+}
+
+int matrix_storage_is_mapped(void * data)
+{
+	int i;
+	for(i = 0; i < number_of_matrix_storage_blocks; i++)
+	{
+		if(matrix_storage_blocks[i].data == data)
+		{
+			return matrix_storage_blocks[i].is_mapped;
+		}
+	}
+	return 0;
+}
+
+// The pages wholly inside the range are dropped from memory, anything written to them is kept in the
+// file and they are read back in the next time they are touched. Only call this on mapped storage.
+void release_matrix_storage_pages(void * address, size_t size)
+{
+	size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+	size_t first_page = ((size_t) address + page_size - 1) / page_size * page_size;
+	size_t end_of_last_page = ((size_t) address + size) / page_size * page_size;
+	if(end_of_last_page > first_page)
+	{
+		madvise((void *) first_page, end_of_last_page - first_page, MADV_DONTNEED);
+	}
+}
@@ -0,0 +1,45 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _MATRIX_STORAGE_H_
+#define _MATRIX_STORAGE_H_
+#include <stddef.h>
+
+// The big matrices of bases are allocated here. While they fit in the memory budget they are
+// kept on the heap, and past it they live in a file which is mapped into memory, so the kernel
+// can page them out to disk rather than the run being killed for running out of memory.
+typedef struct matrix_storage_block
+{
+	void * data;
+	size_t size;
+	int is_mapped;
+} matrix_storage_block;
+
+void set_matrix_memory_budget(size_t budget_in_bytes);
+size_t get_matrix_memory_budget();
+size_t get_matrix_storage_bytes_on_heap();
+void * allocate_matrix_storage(size_t size);
+void * map_matrix_storage_file(size_t size);
+void free_matrix_storage(void * data);
+int matrix_storage_is_mapped(void * data);
+void release_matrix_storage_pages(void * address, size_t size);
+
+#define MATRIX_STORAGE_FILE_TEMPLATE "gubbins_matrix.XXXXXX"
+
+#endif
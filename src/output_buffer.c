@@ -0,0 +1,189 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "output_buffer.h"
+
+void initialise_output_buffer(output_buffer * buffer, FILE * file_pointer, size_t capacity)
+{
+	buffer->file_pointer = file_pointer;
+	buffer->data = (char *) malloc(capacity);
+	buffer->length = 0;
+	buffer->capacity = capacity;
+}
+
+// Returns somewhere to write the next number_of_bytes, the caller then adds what it actually used to the length
+char * reserve_output_buffer_space(output_buffer * buffer, size_t number_of_bytes)
+{
+	if(buffer->length + number_of_bytes > buffer->capacity)
+	{
+		flush_output_buffer(buffer);
+		if(number_of_bytes > buffer->capacity)
+		{
+			buffer->capacity = number_of_bytes;
+			buffer->data = (char *) realloc(buffer->data, buffer->capacity);
+		}
+	}
+	return buffer->data + buffer->length;
+}
+
+void append_string_to_output_buffer(output_buffer * buffer, char * input_string)
+{
+	size_t length_of_string = strlen(input_string);
+	memcpy(reserve_output_buffer_space(buffer, length_of_string), input_string, length_of_string);
+	buffer->length += length_of_string;
+}
+
+void flush_output_buffer(output_buffer * buffer)
+{
+	if(buffer->length > 0)
+	{
+		fwrite(buffer->data, 1, buffer->length, buffer->file_pointer);
+		buffer->length = 0;
+	}
+}
+
+void free_output_buffer(output_buffer * buffer)
+{
+	flush_output_buffer(buffer);
+	free(buffer->data);
+	buffer->data = NULL;
+	buffer->capacity = 0;
+}
+
+// Same digits as printf("%d"), written without going through the format string parser
+size_t format_integer(char * destination, int value)
+{
+	char digits[12];
+	int number_of_digits = 0;
+	size_t length = 0;
+	unsigned int remaining_value = (value < 0) ? -(unsigned int) value : (unsigned int) value;
+
+	if(value < 0)
+	{
+		destination[length++] = '-';
+	}
+	do
+	{
+		digits[number_of_digits++] = '0' + (remaining_value % 10);
+		remaining_value /= 10;
+	}
+	while(remaining_value > 0);
+
+	while(number_of_digits > 0)
+	{
+		destination[length++] = digits[--number_of_digits];
+	}
+	return length;
+}
+
+void * format_row_chunk(void * chunk)
+{
+	row_chunk * current_chunk = (row_chunk *) chunk;
+	int i;
+	current_chunk->length = 0;
+	for(i = current_chunk->first_row; i < current_chunk->first_row + current_chunk->number_of_rows; i++)
+	{
+		current_chunk->length += current_chunk->format_row(current_chunk->rows, i, current_chunk->data + current_chunk->length);
+	}
+	return NULL;
+}
+
+// With more than one thread, a batch of chunks is formatted at the same time and then written out in row order
+void write_rows(output_buffer * buffer, void * rows, int number_of_rows, row_length_function maximum_row_length, row_format_function format_row, int num_threads)
+{
+	int i;
+	if(num_threads <= 1)
+	{
+		for(i = 0; i < number_of_rows; i++)
+		{
+			char * destination = reserve_output_buffer_space(buffer, maximum_row_length(rows, i));
+			buffer->length += format_row(rows, i, destination);
+		}
+		return;
+	}
+
+	row_chunk * chunks = (row_chunk *) calloc(num_threads, sizeof(row_chunk));
+	size_t * chunk_capacities = (size_t *) calloc(num_threads, sizeof(size_t));
+	pthread_t * threads = (pthread_t *) calloc(num_threads, sizeof(pthread_t));
+	int next_row = 0;
+	int rows_per_chunk = (number_of_rows + num_threads - 1)/num_threads;
+
+	while(next_row < number_of_rows)
+	{
+		int number_of_chunks = 0;
+		while(number_of_chunks < num_threads && next_row < number_of_rows)
+		{
+			row_chunk * chunk = &chunks[number_of_chunks];
+			size_t chunk_length = 0;
+			chunk->rows = rows;
+			chunk->first_row = next_row;
+			chunk->number_of_rows = 0;
+			chunk->maximum_row_length = maximum_row_length;
+			chunk->format_row = format_row;
+
+			// Each chunk gets at least one row, and then more rows up to its share or the size of the output buffer
+			do
+			{
+				chunk_length += maximum_row_length(rows, next_row);
+				chunk->number_of_rows++;
+				next_row++;
+			}
+			while(next_row < number_of_rows && chunk->number_of_rows < rows_per_chunk && chunk_length + maximum_row_length(rows, next_row) <= OUTPUT_BUFFER_SIZE);
+
+			if(chunk_length > chunk_capacities[number_of_chunks])
+			{
+				chunk_capacities[number_of_chunks] = chunk_length;
+				chunk->data = (char *) realloc(chunk->data, chunk_length);
+			}
+			number_of_chunks++;
+		}
+
+		for(i = 1; i < number_of_chunks; i++)
+		{
+			pthread_create(&threads[i], NULL, format_row_chunk, &chunks[i]);
+		}
+		format_row_chunk(&chunks[0]);
+		for(i = 1; i < number_of_chunks; i++)
+		{
+			pthread_join(threads[i], NULL);
+		}
+
+		flush_output_buffer(buffer);
+		for(i = 0; i < number_of_chunks; i++)
+		{
+			// A chunk of rows which are all empty never gets any data
+			if(chunks[i].length > 0)
+			{
+				fwrite(chunks[i].data, 1, chunks[i].length, buffer->file_pointer);
+			}
+		}
+	}
+
+	for(i = 0; i < num_threads; i++)
+	{
+		free(chunks[i].data);
+	}
+	free(chunks);
+	free(chunk_capacities);
+	free(threads);
+}
@@ -0,0 +1,62 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _OUTPUT_BUFFER_H_
+#define _OUTPUT_BUFFER_H_
+
+#include <stdio.h>
+
+// Output is formatted straight into a large buffer which is written to the file in one go when it fills up
+typedef struct output_buffer
+{
+	FILE * file_pointer;
+	char * data;
+	size_t length;
+	size_t capacity;
+} output_buffer;
+
+// A row formatter writes one row into destination, which has room for at least the maximum row length,
+// and returns how many bytes it wrote. Rows can be formatted on several threads in chunks of about
+// OUTPUT_BUFFER_SIZE bytes, but are always written out in order.
+typedef size_t (*row_length_function)(void * rows, int row_index);
+typedef size_t (*row_format_function)(void * rows, int row_index, char * destination);
+
+typedef struct row_chunk
+{
+	void * rows;
+	int first_row;
+	int number_of_rows;
+	row_length_function maximum_row_length;
+	row_format_function format_row;
+	char * data;
+	size_t length;
+} row_chunk;
+
+void initialise_output_buffer(output_buffer * buffer, FILE * file_pointer, size_t capacity);
+char * reserve_output_buffer_space(output_buffer * buffer, size_t number_of_bytes);
+void append_string_to_output_buffer(output_buffer * buffer, char * input_string);
+void flush_output_buffer(output_buffer * buffer);
+void free_output_buffer(output_buffer * buffer);
+size_t format_integer(char * destination, int value);
+void write_rows(output_buffer * buffer, void * rows, int number_of_rows, row_length_function maximum_row_length, row_format_function format_row, int num_threads);
+void * format_row_chunk(void * chunk);
+
+#define OUTPUT_BUFFER_SIZE 4194304
+
+#endif
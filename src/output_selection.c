@@ -0,0 +1,88 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "output_selection.h"
+
+// Named after the suffix of each file
+static const gubbins_output_name gubbins_output_names[] = {
+	{"tab", GUBBINS_OUTPUT_TAB},
+	{"branch_snps", GUBBINS_OUTPUT_BRANCH_SNPS},
+	{"gff", GUBBINS_OUTPUT_GFF},
+	{"stats", GUBBINS_OUTPUT_STATS},
+	{"vcf", GUBBINS_OUTPUT_VCF},
+	{"phylip", GUBBINS_OUTPUT_PHYLIP},
+	{"snp_sites", GUBBINS_OUTPUT_SNP_SITES}
+};
+
+int selected_outputs = GUBBINS_ALL_OUTPUTS;
+
+void set_selected_outputs(int outputs)
+{
+	selected_outputs = outputs;
+}
+
+int get_selected_outputs()
+{
+	return selected_outputs;
+}
+
+int is_output_selected(int output)
+{
+	return (selected_outputs & output) != 0;
+}
+
+// A comma separated list of the names, such as "tab,phylip", or "all" for every file
+int parse_selected_outputs(char * output_names)
+{
+	int outputs = 0;
+	char * name = output_names;
+	while(*name != '\0')
+	{
+		size_t name_length = strcspn(name, ",");
+		int i;
+		int found = name_length == 0;
+		if(name_length == 3 && strncmp(name, "all", 3) == 0)
+		{
+			outputs |= GUBBINS_ALL_OUTPUTS;
+			found = 1;
+		}
+		for(i = 0; i < (int) (sizeof(gubbins_output_names)/sizeof(gubbins_output_name)) && found == 0; i++)
+		{
+			if(strlen(gubbins_output_names[i].name) == name_length && strncmp(name, gubbins_output_names[i].name, name_length) == 0)
+			{
+				outputs |= gubbins_output_names[i].output;
+				found = 1;
+			}
+		}
+		if(found == 0)
+		{
+			printf("Unknown output '%.*s', the outputs are all, tab, branch_snps, gff, stats, vcf, phylip and snp_sites\n", (int) name_length, name);
+			exit(1);
+		}
+		name += name_length;
+		if(*name == ',')
+		{
+			name++;
+		}
+	}
+	return outputs;
+}
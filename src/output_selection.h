@@ -0,0 +1,46 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _OUTPUT_SELECTION_H_
+#define _OUTPUT_SELECTION_H_
+
+// The files a run writes can be cut down to the ones the next step needs. The tree, its bipartitions and
+// the recombination fingerprint are always written, and a file which isnt selected is never opened, so
+// its printing functions are given a NULL file pointer and do nothing.
+typedef struct gubbins_output_name
+{
+	char * name;
+	int output;
+} gubbins_output_name;
+
+void set_selected_outputs(int selected_outputs);
+int get_selected_outputs();
+int is_output_selected(int output);
+int parse_selected_outputs(char * output_names);
+
+#define GUBBINS_OUTPUT_TAB 1
+#define GUBBINS_OUTPUT_BRANCH_SNPS 2
+#define GUBBINS_OUTPUT_GFF 4
+#define GUBBINS_OUTPUT_STATS 8
+#define GUBBINS_OUTPUT_VCF 16
+#define GUBBINS_OUTPUT_PHYLIP 32
+#define GUBBINS_OUTPUT_SNP_SITES 64
+#define GUBBINS_ALL_OUTPUTS 127
+
+#endif
@@ -0,0 +1,404 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *  
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "packed_sequence.h"
+
+static const char packed_base_characters[4] = {'A','C','G','T'};
+
+void initialise_packed_sequence(packed_sequence * sequence, int length)
+{
+	sequence->length = length;
+	sequence->bases = (unsigned char *) calloc((length/4)+1, sizeof(unsigned char));
+	sequence->non_acgt_mask = (unsigned char *) calloc((length/8)+1, sizeof(unsigned char));
+	sequence->exception_positions = NULL;
+	sequence->exception_bases = NULL;
+	sequence->number_of_exceptions = 0;
+	sequence->exception_capacity = 0;
+	sequence->storage_is_shared = 0;
+}
+
+// The storage is packed_sequence_storage_size(length) zeroed bytes, holding the bases then the mask
+void initialise_packed_sequence_in_storage(packed_sequence * sequence, int length, unsigned char * storage)
+{
+	sequence->length = length;
+	sequence->bases = storage;
+	sequence->non_acgt_mask = storage + (length/4)+1;
+	sequence->exception_positions = NULL;
+	sequence->exception_bases = NULL;
+	sequence->number_of_exceptions = 0;
+	sequence->exception_capacity = 0;
+	sequence->storage_is_shared = 1;
+}
+
+size_t packed_sequence_storage_size(int length)
+{
+	return (size_t) (length/4)+1 + (length/8)+1;
+}
+
+void free_packed_sequence(packed_sequence * sequence)
+{
+	if(!sequence->storage_is_shared)
+	{
+		free(sequence->bases);
+		free(sequence->non_acgt_mask);
+	}
+	free(sequence->exception_positions);
+	free(sequence->exception_bases);
+	sequence->bases = NULL;
+	sequence->non_acgt_mask = NULL;
+	sequence->exception_positions = NULL;
+	sequence->exception_bases = NULL;
+	sequence->number_of_exceptions = 0;
+	sequence->exception_capacity = 0;
+}
+
+// Index of the first exception at or after the position
+int find_exception_index(packed_sequence * sequence, int position)
+{
+	int start_index = 0;
+	int end_index = sequence->number_of_exceptions;
+	while(start_index < end_index)
+	{
+		int current_index = start_index + (end_index - start_index)/2;
+		if(sequence->exception_positions[current_index] < position)
+		{
+			start_index = current_index + 1;
+		}
+		else
+		{
+			end_index = current_index;
+		}
+	}
+	return start_index;
+}
+
+void set_exception_base(packed_sequence * sequence, int position, char base)
+{
+	int index = find_exception_index(sequence, position);
+	if(index < sequence->number_of_exceptions && sequence->exception_positions[index] == position)
+	{
+		sequence->exception_bases[index] = base;
+		return;
+	}
+	
+	if(sequence->number_of_exceptions == sequence->exception_capacity)
+	{
+		sequence->exception_capacity = (sequence->exception_capacity == 0) ? 4 : sequence->exception_capacity*2;
+		sequence->exception_positions = (int *) realloc(sequence->exception_positions, sequence->exception_capacity*sizeof(int));
+		sequence->exception_bases = (char *) realloc(sequence->exception_bases, sequence->exception_capacity*sizeof(char));
+	}
+	memmove(&sequence->exception_positions[index+1], &sequence->exception_positions[index], (sequence->number_of_exceptions - index)*sizeof(int));
+	memmove(&sequence->exception_bases[index+1], &sequence->exception_bases[index], (sequence->number_of_exceptions - index)*sizeof(char));
+	sequence->exception_positions[index] = position;
+	sequence->exception_bases[index] = base;
+	sequence->number_of_exceptions++;
+}
+
+void remove_exception_base(packed_sequence * sequence, int position)
+{
+	int index = find_exception_index(sequence, position);
+	if(index < sequence->number_of_exceptions && sequence->exception_positions[index] == position)
+	{
+		memmove(&sequence->exception_positions[index], &sequence->exception_positions[index+1], (sequence->number_of_exceptions - index - 1)*sizeof(int));
+		memmove(&sequence->exception_bases[index], &sequence->exception_bases[index+1], (sequence->number_of_exceptions - index - 1)*sizeof(char));
+		sequence->number_of_exceptions--;
+	}
+}
+
+char get_packed_base(packed_sequence * sequence, int position)
+{
+	int code = (sequence->bases[position >> 2] >> ((position & 3) << 1)) & 3;
+	if((sequence->non_acgt_mask[position >> 3] & (1 << (position & 7))) == 0)
+	{
+		return packed_base_characters[code];
+	}
+	
+	if(code == PACKED_GAP_CODE)
+	{
+		return '-';
+	}
+	else if(code == PACKED_N_CODE)
+	{
+		return 'N';
+	}
+	return sequence->exception_bases[find_exception_index(sequence, position)];
+}
+
+void set_packed_base(packed_sequence * sequence, int position, char base)
+{
+	int code;
+	int is_acgt = 1;
+	switch(base)
+	{
+		case 'A': code = 0; break;
+		case 'C': code = 1; break;
+		case 'G': code = 2; break;
+		case 'T': code = 3; break;
+		case '-': code = PACKED_GAP_CODE; is_acgt = 0; break;
+		case 'N': code = PACKED_N_CODE; is_acgt = 0; break;
+		default:  code = PACKED_EXCEPTION_CODE; is_acgt = 0; break;
+	}
+	
+	if((sequence->non_acgt_mask[position >> 3] & (1 << (position & 7))) != 0 && ((sequence->bases[position >> 2] >> ((position & 3) << 1)) & 3) == PACKED_EXCEPTION_CODE)
+	{
+		remove_exception_base(sequence, position);
+	}
+	
+	sequence->bases[position >> 2] = (sequence->bases[position >> 2] & ~(3 << ((position & 3) << 1))) | (code << ((position & 3) << 1));
+	if(is_acgt == 1)
+	{
+		sequence->non_acgt_mask[position >> 3] &= ~(1 << (position & 7));
+	}
+	else
+	{
+		sequence->non_acgt_mask[position >> 3] |= (1 << (position & 7));
+	}
+	
+	if(code == PACKED_EXCEPTION_CODE && is_acgt == 0)
+	{
+		set_exception_base(sequence, position, base);
+	}
+}
+
+int get_number_of_packed_words(int length)
+{
+	return (length + PACKED_WORD_SIZE - 1)/PACKED_WORD_SIZE;
+}
+
+// Moves bits 0, 2, 4 and 6 of the byte down into bits 0 to 3
+static int gather_even_bits(int bits)
+{
+	bits = (bits | (bits >> 1)) & 0x33;
+	return (bits | (bits >> 2)) & 0x0F;
+}
+
+// The codes of 8 bases are in 2 bytes, but the last byte of bases can be on its own
+static int get_packed_code_byte(packed_sequence * sequence, int byte_index)
+{
+	return byte_index <= sequence->length/4 ? sequence->bases[byte_index] : 0;
+}
+
+uint64_t get_packed_non_acgt_word(packed_sequence * sequence, int word_index)
+{
+	uint64_t word = 0;
+	int first_byte = word_index*(PACKED_WORD_SIZE/8);
+	int i;
+	for(i = 0; i < PACKED_WORD_SIZE/8 && first_byte + i <= sequence->length/8; i++)
+	{
+		word |= (uint64_t) sequence->non_acgt_mask[first_byte + i] << (8*i);
+	}
+	return word;
+}
+
+// Bit i is set when the base is a gap or an N, in either case. Gaps and Ns have codes 0 and 1 so the
+// high bit of the code picks out the exceptions, which only need looking at when there are any.
+uint64_t get_packed_missing_word(packed_sequence * sequence, int word_index)
+{
+	uint64_t non_acgt = get_packed_non_acgt_word(sequence, word_index);
+	if(non_acgt == 0)
+	{
+		return 0;
+	}
+	
+	uint64_t high_bits = 0;
+	int first_byte = word_index*(PACKED_WORD_SIZE/4);
+	int i;
+	for(i = 0; i < PACKED_WORD_SIZE/4; i++)
+	{
+		high_bits |= (uint64_t) gather_even_bits((get_packed_code_byte(sequence, first_byte + i) >> 1) & 0x55) << (4*i);
+	}
+	
+	uint64_t exceptions = non_acgt & high_bits;
+	uint64_t missing = non_acgt & ~high_bits;
+	while(exceptions != 0)
+	{
+		int position = word_index*PACKED_WORD_SIZE + __builtin_ctzll(exceptions);
+		if(sequence->exception_bases[find_exception_index(sequence, position)] == 'n')
+		{
+			missing |= exceptions & -exceptions;
+		}
+		exceptions &= exceptions - 1;
+	}
+	return missing;
+}
+
+// Bit i is set when the 2 bit codes of the two sequences differ, which is only a difference in the
+// bases where neither of them have the base in their non ACGT mask
+uint64_t get_packed_differing_codes_word(packed_sequence * sequence, packed_sequence * other_sequence, int word_index)
+{
+	uint64_t differing = 0;
+	int first_byte = word_index*(PACKED_WORD_SIZE/4);
+	int i;
+	for(i = 0; i < PACKED_WORD_SIZE/4; i++)
+	{
+		int differing_codes = get_packed_code_byte(sequence, first_byte + i) ^ get_packed_code_byte(other_sequence, first_byte + i);
+		differing |= (uint64_t) gather_even_bits((differing_codes | (differing_codes >> 1)) & 0x55) << (4*i);
+	}
+	return differing;
+}
+
+// Replaces the whole sequence. Exceptions are found in order so they can be appended to the list.
+void pack_sequence(packed_sequence * sequence, char * sequence_bases)
+{
+	int i;
+	memset(sequence->bases, 0, (sequence->length/4)+1);
+	memset(sequence->non_acgt_mask, 0, (sequence->length/8)+1);
+	sequence->number_of_exceptions = 0;
+	
+	for(i = 0; i < sequence->length; i++)
+	{
+		int code;
+		switch(sequence_bases[i])
+		{
+			case 'A': continue;
+			case 'C': code = 1; break;
+			case 'G': code = 2; break;
+			case 'T': code = 3; break;
+			case '-': code = PACKED_GAP_CODE; sequence->non_acgt_mask[i >> 3] |= (1 << (i & 7)); break;
+			case 'N': code = PACKED_N_CODE;   sequence->non_acgt_mask[i >> 3] |= (1 << (i & 7)); break;
+			default:
+				code = PACKED_EXCEPTION_CODE;
+				sequence->non_acgt_mask[i >> 3] |= (1 << (i & 7));
+				set_exception_base(sequence, i, sequence_bases[i]);
+				break;
+		}
+		sequence->bases[i >> 2] |= (code << ((i & 3) << 1));
+	}
+}
+
+// Writes every base followed by a terminator
+void unpack_sequence(packed_sequence * sequence, char * sequence_bases)
+{
+	int i;
+	int exception_index = 0;
+	for(i = 0; i + 4 <= sequence->length; i += 4)
+	{
+		unsigned char packed_bases = sequence->bases[i >> 2];
+		sequence_bases[i]   = packed_base_characters[packed_bases & 3];
+		sequence_bases[i+1] = packed_base_characters[(packed_bases >> 2) & 3];
+		sequence_bases[i+2] = packed_base_characters[(packed_bases >> 4) & 3];
+		sequence_bases[i+3] = packed_base_characters[(packed_bases >> 6) & 3];
+	}
+	for(; i < sequence->length; i++)
+	{
+		sequence_bases[i] = packed_base_characters[(sequence->bases[i >> 2] >> ((i & 3) << 1)) & 3];
+	}
+	
+	// Then overwrite anything which isnt A, C, G or T
+	for(i = 0; i < sequence->length; i += 8)
+	{
+		if(sequence->non_acgt_mask[i >> 3] == 0)
+		{
+			continue;
+		}
+		int j;
+		for(j = i; j < i + 8 && j < sequence->length; j++)
+		{
+			if((sequence->non_acgt_mask[j >> 3] & (1 << (j & 7))) == 0)
+			{
+				continue;
+			}
+			int code = (sequence->bases[j >> 2] >> ((j & 3) << 1)) & 3;
+			if(code == PACKED_GAP_CODE)
+			{
+				sequence_bases[j] = '-';
+			}
+			else if(code == PACKED_N_CODE)
+			{
+				sequence_bases[j] = 'N';
+			}
+			else
+			{
+				sequence_bases[j] = sequence->exception_bases[exception_index];
+				exception_index++;
+			}
+		}
+	}
+	sequence_bases[sequence->length] = '\0';
+}
+
+// Same as copying a string, stopping after the first terminator. Returns the number of bases copied.
+int unpack_sequence_to_first_terminator(packed_sequence * sequence, char * sequence_bases)
+{
+	int i;
+	unpack_sequence(sequence, sequence_bases);
+	for(i = 0; i < sequence->number_of_exceptions; i++)
+	{
+		if(sequence->exception_bases[i] == '\0')
+		{
+			memset(&sequence_bases[sequence->exception_positions[i]], '\0', sequence->length - sequence->exception_positions[i]);
+			return sequence->exception_positions[i];
+		}
+	}
+	return sequence->length;
+}
+
+// The other sequence has to be the same length, and keeps its own exceptions
+void copy_packed_sequence(packed_sequence * sequence, packed_sequence * other_sequence)
+{
+	memcpy(sequence->bases, other_sequence->bases, (sequence->length/4)+1);
+	memcpy(sequence->non_acgt_mask, other_sequence->non_acgt_mask, (sequence->length/8)+1);
+	if(sequence->exception_capacity < other_sequence->number_of_exceptions)
+	{
+		sequence->exception_capacity = other_sequence->number_of_exceptions;
+		sequence->exception_positions = (int *) realloc(sequence->exception_positions, sequence->exception_capacity*sizeof(int));
+		sequence->exception_bases = (char *) realloc(sequence->exception_bases, sequence->exception_capacity*sizeof(char));
+	}
+	if(other_sequence->number_of_exceptions > 0)
+	{
+		memcpy(sequence->exception_positions, other_sequence->exception_positions, other_sequence->number_of_exceptions*sizeof(int));
+		memcpy(sequence->exception_bases, other_sequence->exception_bases, other_sequence->number_of_exceptions*sizeof(char));
+	}
+	sequence->number_of_exceptions = other_sequence->number_of_exceptions;
+}
+
+// The positions where the bases of the two sequences differ, in order, with the bases of the first sequence.
+// Only positions which differ in their codes or masks, or which arent A, C, G or T in both, are looked at one by one.
+int find_packed_sequence_differences(packed_sequence * sequence, packed_sequence * other_sequence, int * positions, char * bases)
+{
+	int number_of_differences = 0;
+	int word_index;
+	for(word_index = 0; word_index < get_number_of_packed_words(sequence->length); word_index++)
+	{
+		uint64_t non_acgt = get_packed_non_acgt_word(sequence, word_index);
+		uint64_t other_non_acgt = get_packed_non_acgt_word(other_sequence, word_index);
+		uint64_t candidates = get_packed_differing_codes_word(sequence, other_sequence, word_index) | non_acgt | other_non_acgt;
+		while(candidates != 0)
+		{
+			int position = word_index*PACKED_WORD_SIZE + __builtin_ctzll(candidates);
+			candidates &= candidates - 1;
+			if(position >= sequence->length)
+			{
+				break;
+			}
+			char base = get_packed_base(sequence, position);
+			if(base != get_packed_base(other_sequence, position))
+			{
+				positions[number_of_differences] = position;
+				bases[number_of_differences] = base;
+				number_of_differences++;
+			}
+		}
+	}
+	return number_of_differences;
+}
@@ -0,0 +1,67 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *  
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+
+#ifndef _PACKED_SEQUENCE_H_
+#define _PACKED_SEQUENCE_H_
+#include <stddef.h>
+#include <stdint.h>
+
+// A sequence stored with 2 bits per base for A, C, G and T, and a bitmask of the positions which hold
+// anything else. For those positions the 2 bit code says whether it is a gap, an N, or another character
+// which is kept in a small sorted list of exceptions. The bases and mask can be in storage shared by many
+// sequences, which is then freed by whoever gave it.
+typedef struct packed_sequence
+{
+	int length;
+	unsigned char * bases;
+	unsigned char * non_acgt_mask;
+	int * exception_positions;
+	char * exception_bases;
+	int number_of_exceptions;
+	int exception_capacity;
+	int storage_is_shared;
+} packed_sequence;
+
+void initialise_packed_sequence(packed_sequence * sequence, int length);
+void initialise_packed_sequence_in_storage(packed_sequence * sequence, int length, unsigned char * storage);
+size_t packed_sequence_storage_size(int length);
+void free_packed_sequence(packed_sequence * sequence);
+char get_packed_base(packed_sequence * sequence, int position);
+void set_packed_base(packed_sequence * sequence, int position, char base);
+void pack_sequence(packed_sequence * sequence, char * sequence_bases);
+void unpack_sequence(packed_sequence * sequence, char * sequence_bases);
+int unpack_sequence_to_first_terminator(packed_sequence * sequence, char * sequence_bases);
+int find_exception_index(packed_sequence * sequence, int position);
+void set_exception_base(packed_sequence * sequence, int position, char base);
+void remove_exception_base(packed_sequence * sequence, int position);
+int get_number_of_packed_words(int length);
+uint64_t get_packed_non_acgt_word(packed_sequence * sequence, int word_index);
+uint64_t get_packed_missing_word(packed_sequence * sequence, int word_index);
+uint64_t get_packed_differing_codes_word(packed_sequence * sequence, packed_sequence * other_sequence, int word_index);
+void copy_packed_sequence(packed_sequence * sequence, packed_sequence * other_sequence);
+int find_packed_sequence_differences(packed_sequence * sequence, packed_sequence * other_sequence, int * positions, char * bases);
+
+#define PACKED_GAP_CODE 0
+#define PACKED_N_CODE 1
+#define PACKED_EXCEPTION_CODE 2
+// The word queries give one bit per base for 64 bases at a time, bit i being base 64*word_index+i
+#define PACKED_WORD_SIZE 64
+
+#endif
@@ -24,31 +24,431 @@
 #include "parse_phylip.h"
 #include "alignment_file.h"
 
-#include <zlib.h>
+#include <ctype.h>
+#include <pthread.h>
 #include <sys/types.h>
-#include "kseq.h"
 #include "string_cat.h"
-
-KSEQ_INIT(gzFile, gzread)
+#include "packed_sequence.h"
+#include "base_matrix.h"
+#include "matrix_storage.h"
+#include "profile.h"
+#include "sample_name_pool.h"
+#include "sequence_differences.h"
 
 int num_samples;
 int num_snps;
-char ** sequences;
+packed_sequence * sequences;
+// The packed bases of every sequence share one block, mapped from a file if it doesnt fit in the memory budget
+unsigned char * sequence_storage;
+size_t sequence_storage_row_size;
+// Borrowed from the sample name pool
 char ** phylip_sample_names;
 int * internal_node;
 sample_statistics ** statistics_for_samples;
+// The sequence of each pooled name, up to the names pooled when the sequences were loaded
+int * sequence_index_of_sample_name_id;
+int number_of_indexed_sample_name_ids;
+char ** sequence_views;
+// With sparse rows, a row which is encoded keeps only its differences from the row of its parent, and the
+// rows encoded against each row are listed after encoded_child_offsets[row]. Nothing is encoded while
+// parent_of_encoded_row is NULL, and a dense row has -1 as its parent.
+int use_sparse_sequence_rows = 0;
+int * parent_of_encoded_row;
+sequence_differences * differences_from_parent;
+int * encoded_child_offsets;
+int * encoded_children;
+// The encoded rows can be read by one node of the tree while another is changed, so they are only walked with the lock held
+pthread_mutex_t sparse_sequence_rows_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void set_sparse_sequence_rows(int sparse_sequence_rows)
+{
+	use_sparse_sequence_rows = sparse_sequence_rows;
+}
+
+int sequence_row_is_encoded(int sequence_index)
+{
+	return parent_of_encoded_row != NULL && parent_of_encoded_row[sequence_index] >= 0;
+}
+
+// Walks up from the row until it has a difference at the position or reaches a dense row
+char find_encoded_sequence_base(int sequence_index, int base_index)
+{
+	char base;
+	while(parent_of_encoded_row[sequence_index] >= 0)
+	{
+		if(find_sequence_difference(&differences_from_parent[sequence_index], base_index, &base))
+		{
+			return base;
+		}
+		sequence_index = parent_of_encoded_row[sequence_index];
+	}
+	return get_packed_base(&sequences[sequence_index], base_index);
+}
+
+char get_sequence_base(int sequence_index, int base_index)
+{
+	if(!sequence_row_is_encoded(sequence_index))
+	{
+		return get_packed_base(&sequences[sequence_index], base_index);
+	}
+	pthread_mutex_lock(&sparse_sequence_rows_lock);
+	char base = find_encoded_sequence_base(sequence_index, base_index);
+	pthread_mutex_unlock(&sparse_sequence_rows_lock);
+	return base;
+}
+
+// A dense row is returned as it is. An encoded row is built in the buffer, which starts out zeroed
+// and kept for the next row, from the nearest dense row above it and the differences on the way down.
+packed_sequence * acquire_packed_row(int sequence_index, packed_sequence * row_buffer)
+{
+	if(!sequence_row_is_encoded(sequence_index))
+	{
+		return &sequences[sequence_index];
+	}
+	pthread_mutex_lock(&sparse_sequence_rows_lock);
+	build_encoded_row(sequence_index, row_buffer);
+	pthread_mutex_unlock(&sparse_sequence_rows_lock);
+	return row_buffer;
+}
+
+// Builds any row in the buffer, with the lock already held
+void build_encoded_row(int sequence_index, packed_sequence * row_buffer)
+{
+	int chain[SPARSE_ROW_CHECKPOINT_GENERATIONS+1];
+	int chain_length = 0;
+	int i, j;
+	if(row_buffer->bases == NULL)
+	{
+		initialise_packed_sequence(row_buffer, num_snps);
+	}
+	while(parent_of_encoded_row[sequence_index] >= 0)
+	{
+		chain[chain_length] = sequence_index;
+		chain_length++;
+		sequence_index = parent_of_encoded_row[sequence_index];
+	}
+	copy_packed_sequence(row_buffer, &sequences[sequence_index]);
+	for(i = chain_length - 1; i >= 0; i--)
+	{
+		sequence_differences * differences = &differences_from_parent[chain[i]];
+		for(j = 0; j < differences->number_of_differences; j++)
+		{
+			set_packed_base(row_buffer, differences->positions[j], differences->bases[j]);
+		}
+	}
+}
+
+// The rows encoded against the row keep their bases, so only the differences of the row and its encoded children change
+int set_sequence_base(int sequence_index, int base_index, char new_sequence_base)
+{
+	int i;
+	if(parent_of_encoded_row == NULL)
+	{
+		if(get_packed_base(&sequences[sequence_index], base_index) == new_sequence_base)
+		{
+			return 0;
+		}
+		set_packed_base(&sequences[sequence_index], base_index, new_sequence_base);
+		return 1;
+	}
+	
+	pthread_mutex_lock(&sparse_sequence_rows_lock);
+	char old_sequence_base = find_encoded_sequence_base(sequence_index, base_index);
+	if(old_sequence_base == new_sequence_base)
+	{
+		pthread_mutex_unlock(&sparse_sequence_rows_lock);
+		return 0;
+	}
+	
+	for(i = encoded_child_offsets[sequence_index]; i < encoded_child_offsets[sequence_index+1]; i++)
+	{
+		sequence_differences * child_differences = &differences_from_parent[encoded_children[i]];
+		char child_base;
+		if(!find_sequence_difference(child_differences, base_index, &child_base))
+		{
+			set_sequence_difference(child_differences, base_index, old_sequence_base);
+		}
+		else if(child_base == new_sequence_base)
+		{
+			remove_sequence_difference(child_differences, base_index);
+		}
+	}
+	
+	int parent_index = parent_of_encoded_row[sequence_index];
+	if(parent_index < 0)
+	{
+		set_packed_base(&sequences[sequence_index], base_index, new_sequence_base);
+	}
+	else if(find_encoded_sequence_base(parent_index, base_index) == new_sequence_base)
+	{
+		remove_sequence_difference(&differences_from_parent[sequence_index], base_index);
+	}
+	else
+	{
+		set_sequence_difference(&differences_from_parent[sequence_index], base_index, new_sequence_base);
+	}
+	pthread_mutex_unlock(&sparse_sequence_rows_lock);
+	return 1;
+}
+
+// The positions and bases where the row differs from the parent row, or -1 if it isnt encoded against that row
+int get_sequence_differences_from_parent(int sequence_index, int parent_sequence_index, int ** positions, char ** bases)
+{
+	if(sequence_index < 0 || !sequence_row_is_encoded(sequence_index) || parent_of_encoded_row[sequence_index] != parent_sequence_index)
+	{
+		return -1;
+	}
+	*positions = differences_from_parent[sequence_index].positions;
+	*bases = differences_from_parent[sequence_index].bases;
+	return differences_from_parent[sequence_index].number_of_differences;
+}
+
+// The rows are given parents first, with the parent of each row or -1. Each row is encoded against its parent unless that
+// would take it SPARSE_ROW_CHECKPOINT_GENERATIONS rows from a dense one, and the storage is then cut down to the dense rows.
+void encode_sequence_rows_as_differences(int * sequence_indices, int * parent_sequence_indices, int number_of_sequence_indices)
+{
+	int i;
+	if(!use_sparse_sequence_rows || parent_of_encoded_row != NULL || num_samples == 0)
+	{
+		return;
+	}
+	
+	parent_of_encoded_row = (int *) malloc((num_samples+1)*sizeof(int));
+	int * generation = (int *) calloc(num_samples+1, sizeof(int));
+	int * is_seen = (int *) calloc(num_samples+1, sizeof(int));
+	for(i = 0; i < num_samples; i++)
+	{
+		parent_of_encoded_row[i] = -1;
+	}
+	for(i = 0; i < number_of_sequence_indices; i++)
+	{
+		int sequence_index = sequence_indices[i];
+		int parent_index = parent_sequence_indices[i];
+		if(sequence_index < 0 || is_seen[sequence_index])
+		{
+			continue;
+		}
+		is_seen[sequence_index] = 1;
+		if(parent_index >= 0 && parent_index != sequence_index && is_seen[parent_index] && generation[parent_index] + 1 < SPARSE_ROW_CHECKPOINT_GENERATIONS)
+		{
+			parent_of_encoded_row[sequence_index] = parent_index;
+			generation[sequence_index] = generation[parent_index] + 1;
+		}
+	}
+	free(is_seen);
+	free(generation);
+	
+	// Every difference is found while all the rows are still dense
+	differences_from_parent = (sequence_differences *) calloc(num_samples+1, sizeof(sequence_differences));
+	encoded_child_offsets = (int *) calloc(num_samples+2, sizeof(int));
+	int * positions = (int *) malloc((num_snps+1)*sizeof(int));
+	char * bases = (char *) malloc((num_snps+1)*sizeof(char));
+	int number_of_dense_rows = 0;
+	for(i = 0; i < num_samples; i++)
+	{
+		int parent_index = parent_of_encoded_row[i];
+		if(parent_index < 0)
+		{
+			number_of_dense_rows++;
+			continue;
+		}
+		int number_of_differences = find_packed_sequence_differences(&sequences[i], &sequences[parent_index], positions, bases);
+		initialise_sequence_differences(&differences_from_parent[i], positions, bases, number_of_differences);
+		encoded_child_offsets[parent_index+1]++;
+	}
+	free(positions);
+	free(bases);
+	
+	for(i = 0; i < num_samples; i++)
+	{
+		encoded_child_offsets[i+1] += encoded_child_offsets[i];
+	}
+	encoded_children = (int *) malloc((encoded_child_offsets[num_samples]+1)*sizeof(int));
+	int * number_of_children_placed = (int *) calloc(num_samples+1, sizeof(int));
+	for(i = 0; i < num_samples; i++)
+	{
+		int parent_index = parent_of_encoded_row[i];
+		if(parent_index >= 0)
+		{
+			encoded_children[encoded_child_offsets[parent_index] + number_of_children_placed[parent_index]] = i;
+			number_of_children_placed[parent_index]++;
+		}
+	}
+	free(number_of_children_placed);
+	
+	// The encoded rows give up their bases and exceptions, the dense rows move into storage of their own
+	release_sequence_views();
+	unsigned char * dense_storage = (unsigned char *) allocate_matrix_storage(number_of_dense_rows*sequence_storage_row_size);
+	int number_placed = 0;
+	for(i = 0; i < num_samples; i++)
+	{
+		if(parent_of_encoded_row[i] >= 0)
+		{
+			free_packed_sequence(&sequences[i]);
+			continue;
+		}
+		unsigned char * row = dense_storage + number_placed*sequence_storage_row_size;
+		memcpy(row, sequences[i].bases, sequence_storage_row_size);
+		sequences[i].bases = row;
+		sequences[i].non_acgt_mask = row + (num_snps/4)+1;
+		number_placed++;
+	}
+	free_matrix_storage(sequence_storage);
+	sequence_storage = dense_storage;
+}
+
+void free_sparse_sequence_rows()
+{
+	int i;
+	if(parent_of_encoded_row == NULL)
+	{
+		return;
+	}
+	for(i = 0; i < num_samples; i++)
+	{
+		free_sequence_differences(&differences_from_parent[i]);
+	}
+	free(differences_from_parent);
+	free(encoded_child_offsets);
+	free(encoded_children);
+	free(parent_of_encoded_row);
+	differences_from_parent = NULL;
+	encoded_child_offsets = NULL;
+	encoded_children = NULL;
+	parent_of_encoded_row = NULL;
+}
 
 
 int update_sequence_base(char new_sequence_base, int sequence_index, int base_index)
 {
-	if(sequences[sequence_index][base_index] != new_sequence_base)
+	if(set_sequence_base(sequence_index, base_index, new_sequence_base))
 	{
-	   sequences[sequence_index][base_index] = new_sequence_base;	
+	   release_sequence_view_for_sample_index(sequence_index);
 	   return 1;
     }
 	return 0;
 }
 
+int compare_base_indices(const void * a, const void * b)
+{
+	return *(const int *) a - *(const int *) b;
+}
+
+// update_sequence_base for many bases of one sequence. With sparse rows the bases are sorted so the
+// differences of the sequence and of each row encoded against it are merged once.
+int update_sequence_bases(char new_sequence_base, int sequence_index, int * base_indices, int number_of_base_indices)
+{
+	int i, j;
+	int number_changed = 0;
+	if(parent_of_encoded_row == NULL)
+	{
+		for(i = 0; i < number_of_base_indices; i++)
+		{
+			number_changed += set_sequence_base(sequence_index, base_indices[i], new_sequence_base);
+		}
+		if(number_changed > 0)
+		{
+			release_sequence_view_for_sample_index(sequence_index);
+		}
+		return number_changed;
+	}
+	
+	if(number_of_base_indices == 0)
+	{
+		return 0;
+	}
+	int * positions = (int *) malloc((number_of_base_indices+1)*sizeof(int));
+	char * old_bases = (char *) malloc((number_of_base_indices+1)*sizeof(char));
+	int * update_positions = (int *) malloc((number_of_base_indices+1)*sizeof(int));
+	char * update_bases = (char *) malloc((number_of_base_indices+1)*sizeof(char));
+	int * keep = (int *) malloc((number_of_base_indices+1)*sizeof(int));
+	memcpy(positions, base_indices, number_of_base_indices*sizeof(int));
+	qsort(positions, number_of_base_indices, sizeof(int), compare_base_indices);
+	
+	// The sequence and its parent are built once rather than walked up to for every base
+	packed_sequence row, parent_row;
+	memset(&row, 0, sizeof(packed_sequence));
+	memset(&parent_row, 0, sizeof(packed_sequence));
+	int parent_index = parent_of_encoded_row[sequence_index];
+	pthread_mutex_lock(&sparse_sequence_rows_lock);
+	packed_sequence * current_row = &sequences[sequence_index];
+	if(parent_index >= 0)
+	{
+		build_encoded_row(sequence_index, &row);
+		build_encoded_row(parent_index, &parent_row);
+		current_row = &row;
+	}
+	for(i = 0; i < number_of_base_indices; i++)
+	{
+		if(i > 0 && positions[i] == positions[i-1])
+		{
+			continue;
+		}
+		char old_base = get_packed_base(current_row, positions[i]);
+		if(old_base != new_sequence_base)
+		{
+			positions[number_changed] = positions[i];
+			old_bases[number_changed] = old_base;
+			number_changed++;
+		}
+	}
+	
+	// A child without a difference keeps the old base, and one which already had the new base no longer differs
+	for(i = encoded_child_offsets[sequence_index]; i < encoded_child_offsets[sequence_index+1]; i++)
+	{
+		sequence_differences * child_differences = &differences_from_parent[encoded_children[i]];
+		int number_of_updates = 0;
+		int difference_index = 0;
+		for(j = 0; j < number_changed; j++)
+		{
+			while(difference_index < child_differences->number_of_differences && child_differences->positions[difference_index] < positions[j])
+			{
+				difference_index++;
+			}
+			int has_difference = difference_index < child_differences->number_of_differences && child_differences->positions[difference_index] == positions[j];
+			if(has_difference && child_differences->bases[difference_index] != new_sequence_base)
+			{
+				continue;
+			}
+			update_positions[number_of_updates] = positions[j];
+			update_bases[number_of_updates] = old_bases[j];
+			keep[number_of_updates] = !has_difference;
+			number_of_updates++;
+		}
+		update_sequence_differences(child_differences, update_positions, update_bases, keep, number_of_updates);
+	}
+	
+	for(j = 0; j < number_changed; j++)
+	{
+		if(parent_index < 0)
+		{
+			set_packed_base(&sequences[sequence_index], positions[j], new_sequence_base);
+			continue;
+		}
+		update_positions[j] = positions[j];
+		update_bases[j] = new_sequence_base;
+		keep[j] = get_packed_base(&parent_row, positions[j]) != new_sequence_base;
+	}
+	if(parent_index >= 0)
+	{
+		update_sequence_differences(&differences_from_parent[sequence_index], update_positions, update_bases, keep, number_changed);
+	}
+	pthread_mutex_unlock(&sparse_sequence_rows_lock);
+	
+	free_packed_sequence(&row);
+	free_packed_sequence(&parent_row);
+	free(positions);
+	free(old_bases);
+	free(update_positions);
+	free(update_bases);
+	free(keep);
+	if(number_changed > 0)
+	{
+		release_sequence_view_for_sample_index(sequence_index);
+	}
+	return number_changed;
+}
+
 void set_internal_node(int internal_node_value,int sequence_index)
 {
 	internal_node[sequence_index] = internal_node_value;
@@ -69,31 +469,133 @@ void get_sequence_for_sample_name(char * sequence_bases, char * sample_name)
 	  exit(1);
   }
 
-	memcpy(sequence_bases, sequences[sequence_index], size_of_string(sequences[sequence_index]) +1);
+	get_sequence_for_sample_index(sequence_bases, sequence_index);
 }
 
+void get_sequence_for_sample_index(char * sequence_bases, int sequence_index)
+{
+	if(sequence_index < 0 || sequence_index >= num_samples)
+	{
+    printf("Couldnt find sequence with index %d\n", sequence_index);
+	  exit(1);
+  }
+
+	packed_sequence row_buffer;
+	memset(&row_buffer, 0, sizeof(packed_sequence));
+	unpack_sequence_to_first_terminator(acquire_packed_row(sequence_index, &row_buffer), sequence_bases);
+	free_packed_sequence(&row_buffer);
+}
 
+// Read only view of a sequence, which is decoded once and shared until the sequence is changed or released.
+// Dont hold on to a view across an update of the same sequence.
+const char * get_sequence_view_for_sample_index(int sequence_index)
+{
+	if(sequence_index < 0 || sequence_index >= num_samples)
+	{
+    printf("Couldnt find sequence with index %d\n", sequence_index);
+	  exit(1);
+  }
+	
+	if(sequence_views[sequence_index] == NULL)
+	{
+		sequence_views[sequence_index] = (char *) calloc((num_snps+1),sizeof(char));
+		get_sequence_for_sample_index(sequence_views[sequence_index], sequence_index);
+	}
+	return sequence_views[sequence_index];
+}
+
+// Once its view is gone a mapped sequence isnt needed in memory until it is next read
+void release_sequence_view_for_sample_index(int sequence_index)
+{
+	if(sequence_views[sequence_index] != NULL && matrix_storage_is_mapped(sequence_storage) && !sequence_row_is_encoded(sequence_index))
+	{
+		release_matrix_storage_pages(sequences[sequence_index].bases, sequence_storage_row_size);
+	}
+	free(sequence_views[sequence_index]);
+	sequence_views[sequence_index] = NULL;
+}
+
+void release_sequence_views()
+{
+	int i;
+	if(sequence_views == NULL)
+	{
+		return;
+	}
+	for(i = 0; i < num_samples; i++)
+	{
+		release_sequence_view_for_sample_index(i);
+	}
+}
+
+
+// A base of the parent becomes an N where every child has a gap or an N, 64 bases at a time
 void fill_in_unambiguous_gaps_in_parent_from_children(int parent_sequence_index, int * child_sequence_indices, int num_children)
 {
-	int snp_counter = 0; 
-	for(snp_counter = 0; snp_counter < num_snps ; snp_counter++)
+	int word_index;
+	int parent_changed = 0;
+	int number_of_words = get_number_of_packed_words(num_snps);
+	if(parent_of_encoded_row == NULL)
 	{
-		int real_base_found = 0;
-		int child_counter = 0;
-		for(child_counter = 0 ; child_counter < num_children ; child_counter++)
+		for(word_index = 0; word_index < number_of_words; word_index++)
 		{
-			int child_index = child_sequence_indices[child_counter];
-			if(!( toupper(sequences[child_index][snp_counter]) == 'N' || sequences[child_index][snp_counter] == '-' ))
+			uint64_t missing_in_all_children = ~((uint64_t) 0);
+			int child_counter;
+			for(child_counter = 0; child_counter < num_children && missing_in_all_children != 0; child_counter++)
 			{
-				real_base_found = 1;
-				break;
+				missing_in_all_children &= get_packed_missing_word(&sequences[child_sequence_indices[child_counter]], word_index);
+			}
+			
+			uint64_t bases_to_fill_in = missing_in_all_children & ~get_packed_missing_word(&sequences[parent_sequence_index], word_index);
+			while(bases_to_fill_in != 0)
+			{
+				set_packed_base(&sequences[parent_sequence_index], word_index*PACKED_WORD_SIZE + __builtin_ctzll(bases_to_fill_in), 'N');
+				bases_to_fill_in &= bases_to_fill_in - 1;
+				parent_changed = 1;
+			}
+		}
+	}
+	else
+	{
+		// The rows are built one at a time, so the children are gathered a row at a time into one word per word of bases
+		packed_sequence row_buffer;
+		memset(&row_buffer, 0, sizeof(packed_sequence));
+		uint64_t * missing_in_all_children = (uint64_t *) malloc((number_of_words+1)*sizeof(uint64_t));
+		int child_counter;
+		for(word_index = 0; word_index < number_of_words; word_index++)
+		{
+			missing_in_all_children[word_index] = ~((uint64_t) 0);
+		}
+		for(child_counter = 0; child_counter < num_children; child_counter++)
+		{
+			packed_sequence * child_row = acquire_packed_row(child_sequence_indices[child_counter], &row_buffer);
+			for(word_index = 0; word_index < number_of_words; word_index++)
+			{
+				missing_in_all_children[word_index] &= get_packed_missing_word(child_row, word_index);
 			}
 		}
 		
-		if(real_base_found == 0 &&  toupper(sequences[parent_sequence_index][snp_counter]) != 'N' && sequences[parent_sequence_index][snp_counter] != '-')
+		packed_sequence * parent_row = acquire_packed_row(parent_sequence_index, &row_buffer);
+		for(word_index = 0; word_index < number_of_words; word_index++)
+		{
+			missing_in_all_children[word_index] &= ~get_packed_missing_word(parent_row, word_index);
+		}
+		for(word_index = 0; word_index < number_of_words; word_index++)
 		{
-			sequences[parent_sequence_index][snp_counter] = 'N';	
+			uint64_t bases_to_fill_in = missing_in_all_children[word_index];
+			while(bases_to_fill_in != 0)
+			{
+				set_sequence_base(parent_sequence_index, word_index*PACKED_WORD_SIZE + __builtin_ctzll(bases_to_fill_in), 'N');
+				bases_to_fill_in &= bases_to_fill_in - 1;
+				parent_changed = 1;
+			}
 		}
+		free(missing_in_all_children);
+		free_packed_sequence(&row_buffer);
+	}
+	if(parent_changed)
+	{
+		release_sequence_view_for_sample_index(parent_sequence_index);
 	}
 }
 
@@ -103,7 +605,8 @@ void fill_in_unambiguous_bases_in_parent_from_children_where_parent_has_a_gap(in
 
 	for(snp_counter = 0; snp_counter < num_snps ; snp_counter++)
 	{
-		if(toupper(sequences[parent_sequence_index][snp_counter]) != 'N' && sequences[parent_sequence_index][snp_counter] != '-')
+		char parent_base = get_sequence_base(parent_sequence_index, snp_counter);
+		if(toupper(parent_base) != 'N' && parent_base != '-')
 		{
 			break;
 		}
@@ -116,18 +619,19 @@ void fill_in_unambiguous_bases_in_parent_from_children_where_parent_has_a_gap(in
 			int child_index = child_sequence_indices[child_counter];
 		  if(child_counter == 0)
 			{
-				comparison_base = toupper(sequences[child_index][snp_counter]);
+				comparison_base = toupper(get_sequence_base(child_index, snp_counter));
 			}
 		
-			if(comparison_base !=  toupper(sequences[child_index][snp_counter])  )
+			if(comparison_base !=  toupper(get_sequence_base(child_index, snp_counter))  )
 			{
 				break;
 			}
 		}
 		
-		if(toupper(sequences[parent_sequence_index][snp_counter]) != comparison_base)
+		if(toupper(parent_base) != comparison_base)
 		{
-			sequences[parent_sequence_index][snp_counter] = comparison_base;
+			set_sequence_base(parent_sequence_index, snp_counter, comparison_base);
+			release_sequence_view_for_sample_index(parent_sequence_index);
 		}
 	}
 }
@@ -143,12 +647,13 @@ int does_column_contain_snps(int snp_column, char reference_base)
 			continue;	
 		}
 		
-		if(sequences[i][snp_column] == '\0' || sequences[i][snp_column] == '\n')
+		char base = get_sequence_base(i, snp_column);
+		if(base == '\0' || base == '\n')
 		{
 			return 0;	
 		}
 		
-		if(sequences[i][snp_column]  != '-' && toupper(sequences[i][snp_column])  != 'N' && sequences[i][snp_column] != reference_base)
+		if(base  != '-' && toupper(base)  != 'N' && base != reference_base)
 		{
 			return 1;
 		}
@@ -157,6 +662,182 @@ int does_column_contain_snps(int snp_column, char reference_base)
 }
 
 
+// does_column_contain_snps for every column at once. The sequences are read a row at a time, 64 columns to
+// a word, and each column is settled by the first sequence which would end its loop. The columns are split
+// into ranges of whole words, one for each thread.
+void find_columns_which_contain_snps(char * reference_bases, int number_of_columns, int * column_contains_snps, int num_threads)
+{
+	int i;
+	int number_of_words = get_number_of_packed_words(number_of_columns);
+	int words_per_range = num_threads > 1 ? (number_of_words + num_threads - 1)/num_threads : number_of_words;
+	int number_of_ranges = words_per_range > 0 ? (number_of_words + words_per_range - 1)/words_per_range : 0;
+	snp_column_range * ranges = (snp_column_range *) calloc(number_of_ranges+1, sizeof(snp_column_range));
+	char * real_reference_bases = (char *) calloc(number_of_columns+1, sizeof(char));
+	memcpy(real_reference_bases, reference_bases, number_of_columns);
+	packed_sequence real_reference;
+	
+	for(i = 0; i < number_of_ranges; i++)
+	{
+		ranges[i].reference_bases = reference_bases;
+		ranges[i].real_reference_bases = real_reference_bases;
+		ranges[i].real_reference = &real_reference;
+		ranges[i].column_contains_snps = column_contains_snps;
+		ranges[i].first_word = i*words_per_range;
+		ranges[i].number_of_words = (i+1)*words_per_range < number_of_words ? words_per_range : number_of_words - i*words_per_range;
+		ranges[i].number_of_columns = number_of_columns;
+	}
+	
+	// A gap or N in the reference is replaced by the first base in its column which isnt one, then with the
+	// reference packed, the leaves with a base in A, C, G and T on both sides are compared a word at a time
+	run_on_snp_column_ranges(ranges, number_of_ranges, find_real_reference_bases_in_range);
+	initialise_packed_sequence(&real_reference, number_of_columns);
+	pack_sequence(&real_reference, real_reference_bases);
+	run_on_snp_column_ranges(ranges, number_of_ranges, find_snps_in_range);
+	
+	free_packed_sequence(&real_reference);
+	free(real_reference_bases);
+	free(ranges);
+}
+
+void run_on_snp_column_ranges(snp_column_range * ranges, int number_of_ranges, void * (*range_function)(void *))
+{
+	int i;
+	if(number_of_ranges == 1)
+	{
+		range_function(&ranges[0]);
+		return;
+	}
+	pthread_t * threads = (pthread_t *) calloc(number_of_ranges+1, sizeof(pthread_t));
+	for(i = 0; i < number_of_ranges; i++)
+	{
+		pthread_create(&threads[i], NULL, range_function, &ranges[i]);
+	}
+	for(i = 0; i < number_of_ranges; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+}
+
+// The bits of the columns of a word which are in the range
+uint64_t get_columns_in_snp_column_word(snp_column_range * range, int word_index)
+{
+	int columns_in_word = range->number_of_columns - word_index*PACKED_WORD_SIZE;
+	return columns_in_word >= PACKED_WORD_SIZE ? ~((uint64_t) 0) : (((uint64_t) 1 << columns_in_word) - 1);
+}
+
+void * find_real_reference_bases_in_range(void * range_pointer)
+{
+	snp_column_range * range = (snp_column_range *) range_pointer;
+	int i, word_index;
+	uint64_t * unsettled_columns = (uint64_t *) calloc(range->number_of_words+1, sizeof(uint64_t));
+	int number_of_unsettled_words = 0;
+	for(word_index = 0; word_index < range->number_of_words; word_index++)
+	{
+		int first_column = (range->first_word + word_index)*PACKED_WORD_SIZE;
+		uint64_t columns = get_columns_in_snp_column_word(range, range->first_word + word_index);
+		for(i = 0; i < PACKED_WORD_SIZE && ((columns >> i) & 1); i++)
+		{
+			range->column_contains_snps[first_column + i] = 0;
+			if(range->reference_bases[first_column + i] == '-' || toupper(range->reference_bases[first_column + i]) == 'N')
+			{
+				unsettled_columns[word_index] |= (uint64_t) 1 << i;
+			}
+		}
+		number_of_unsettled_words += unsettled_columns[word_index] != 0;
+	}
+	
+	packed_sequence row_buffer;
+	memset(&row_buffer, 0, sizeof(packed_sequence));
+	for(i = 0; i < num_samples && number_of_unsettled_words > 0; i++)
+	{
+		packed_sequence * row = acquire_packed_row(i, &row_buffer);
+		for(word_index = 0; word_index < range->number_of_words; word_index++)
+		{
+			if(unsettled_columns[word_index] == 0)
+			{
+				continue;
+			}
+			uint64_t settled_columns = unsettled_columns[word_index] & ~get_packed_missing_word(row, range->first_word + word_index);
+			unsettled_columns[word_index] &= ~settled_columns;
+			number_of_unsettled_words -= unsettled_columns[word_index] == 0;
+			while(settled_columns != 0)
+			{
+				int column = (range->first_word + word_index)*PACKED_WORD_SIZE + __builtin_ctzll(settled_columns);
+				char base = get_packed_base(row, column);
+				if(base != '\0' && base != '\n')
+				{
+					range->real_reference_bases[column] = base;
+				}
+				settled_columns &= settled_columns - 1;
+			}
+		}
+	}
+	free_packed_sequence(&row_buffer);
+	free(unsettled_columns);
+	return NULL;
+}
+
+void * find_snps_in_range(void * range_pointer)
+{
+	snp_column_range * range = (snp_column_range *) range_pointer;
+	int i, word_index;
+	uint64_t * unsettled_columns = (uint64_t *) calloc(range->number_of_words+1, sizeof(uint64_t));
+	int number_of_unsettled_words = range->number_of_words;
+	for(word_index = 0; word_index < range->number_of_words; word_index++)
+	{
+		unsettled_columns[word_index] = get_columns_in_snp_column_word(range, range->first_word + word_index);
+	}
+	
+	packed_sequence row_buffer;
+	memset(&row_buffer, 0, sizeof(packed_sequence));
+	for(i = 0; i < num_samples && number_of_unsettled_words > 0; i++)
+	{
+		if(internal_node[i]==1)
+		{
+			continue;
+		}
+		packed_sequence * row = acquire_packed_row(i, &row_buffer);
+		for(word_index = 0; word_index < range->number_of_words; word_index++)
+		{
+			if(unsettled_columns[word_index] == 0)
+			{
+				continue;
+			}
+			int sequence_word_index = range->first_word + word_index;
+			uint64_t bases = unsettled_columns[word_index] & ~get_packed_missing_word(row, sequence_word_index);
+			uint64_t non_acgt = get_packed_non_acgt_word(row, sequence_word_index) | get_packed_non_acgt_word(range->real_reference, sequence_word_index);
+			uint64_t snps = bases & ~non_acgt & get_packed_differing_codes_word(row, range->real_reference, sequence_word_index);
+			uint64_t other_bases = bases & non_acgt;
+			while(other_bases != 0)
+			{
+				int column = sequence_word_index*PACKED_WORD_SIZE + __builtin_ctzll(other_bases);
+				char base = get_packed_base(row, column);
+				if(base == '\0' || base == '\n')
+				{
+					unsettled_columns[word_index] &= ~(other_bases & -other_bases);
+				}
+				else if(base != range->real_reference_bases[column])
+				{
+					snps |= other_bases & -other_bases;
+				}
+				other_bases &= other_bases - 1;
+			}
+			
+			unsettled_columns[word_index] &= ~snps;
+			number_of_unsettled_words -= unsettled_columns[word_index] == 0;
+			while(snps != 0)
+			{
+				range->column_contains_snps[sequence_word_index*PACKED_WORD_SIZE + __builtin_ctzll(snps)] = 1;
+				snps &= snps - 1;
+			}
+		}
+	}
+	free_packed_sequence(&row_buffer);
+	free(unsettled_columns);
+	return NULL;
+}
+
 char convert_reference_to_real_base_in_column(int snp_column, char reference_base)
 {
 	int i;
@@ -167,14 +848,15 @@ char convert_reference_to_real_base_in_column(int snp_column, char reference_bas
 	
 	for(i = 0; i < num_samples; i++)
 	{
-		if(sequences[i][snp_column] == '\0' || sequences[i][snp_column] == '\n')
+		char base = get_sequence_base(i, snp_column);
+		if(base == '\0' || base == '\n')
 		{
 			return reference_base;	
 		}
 		
-		if(sequences[i][snp_column]  != '-' && toupper(sequences[i][snp_column])  != 'N')
+		if(base  != '-' && toupper(base)  != 'N')
 		{
-			return sequences[i][snp_column];
+			return base;
 		}
 	}
 	return reference_base;
@@ -191,120 +873,181 @@ sample_statistics ** get_sample_statistics()
 }
 
 
+// The names are borrowed from the sample name pool, so they arent freed
 void get_sample_names_from_parse_phylip(char ** sample_names)
 {
 	int i;
 	for(i = 0; i< num_samples; i++)
 	{
-		sample_names[i] =  (char *) calloc(MAX_SAMPLE_NAME_SIZE,sizeof(char));
-		memcpy(sample_names[i], phylip_sample_names[i], size_of_string(phylip_sample_names[i]) +1);
+		sample_names[i] = phylip_sample_names[i];
 	}
 }
 	
 
-void filter_sequence_bases_and_rotate(char * reference_bases, char ** filtered_bases_for_snps, int number_of_filtered_snps)
+// Each sample's bases at the filtered snps, one row per sample in sample order. The columns to keep are
+// found once, then each thread fills in the rows of its own samples.
+void filter_sequence_bases(char * reference_bases, char ** filtered_bases_for_samples, int number_of_filtered_snps, int num_threads)
 {
-	int i,j,reference_index;
+	int i;
+	allocate_base_matrix(filtered_bases_for_samples, num_samples, number_of_filtered_snps);
+	int * kept_columns = (int *) calloc(num_snps+1, sizeof(int));
+	int number_of_kept_columns = 0;
+	for(i = 0; i < num_snps && reference_bases[i] != '\0'; i++)
+	{
+		if(reference_bases[i] != '*')
+		{
+			kept_columns[number_of_kept_columns] = i;
+			number_of_kept_columns++;
+		}
+	}
 	
-	for(j = 0; j < number_of_filtered_snps; j++)
+	int samples_per_range = num_threads > 1 ? (num_samples + num_threads - 1)/num_threads : num_samples;
+	int number_of_ranges = samples_per_range > 0 ? (num_samples + samples_per_range - 1)/samples_per_range : 0;
+	filtered_sample_range * ranges = (filtered_sample_range *) calloc(number_of_ranges+1, sizeof(filtered_sample_range));
+	pthread_t * threads = (pthread_t *) calloc(number_of_ranges+1, sizeof(pthread_t));
+	for(i = 0; i < number_of_ranges; i++)
 	{
-		filtered_bases_for_snps[j] = (char *) calloc((num_samples+1),sizeof(char));
+		ranges[i].kept_columns = kept_columns;
+		ranges[i].number_of_kept_columns = number_of_kept_columns;
+		ranges[i].filtered_bases_for_samples = filtered_bases_for_samples;
+		ranges[i].first_sample = i*samples_per_range;
+		ranges[i].end_sample = (i+1)*samples_per_range < num_samples ? (i+1)*samples_per_range : num_samples;
+		if(number_of_ranges > 1)
+		{
+			pthread_create(&threads[i], NULL, filter_sequence_bases_in_range, &ranges[i]);
+		}
+		else
+		{
+			filter_sequence_bases_in_range(&ranges[i]);
+		}
 	}
-		
-	for(i = 0; i < num_samples; i++)
+	for(i = 0; i < number_of_ranges && number_of_ranges > 1; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+	free(ranges);
+	free(kept_columns);
+}
+
+void * filter_sequence_bases_in_range(void * range_pointer)
+{
+	filtered_sample_range * range = (filtered_sample_range *) range_pointer;
+	int i, j;
+	char * sequence_bases = (char *) calloc((num_snps+1),sizeof(char));
+	packed_sequence row_buffer;
+	memset(&row_buffer, 0, sizeof(packed_sequence));
+	for(i = range->first_sample; i < range->end_sample; i++)
 	{
 		int filtered_base_counter = 0;
-		
-		for(reference_index = 0; reference_index < num_snps; reference_index++)
+		unpack_sequence(acquire_packed_row(i, &row_buffer), sequence_bases);
+		for(j = 0; j < range->number_of_kept_columns; j++)
 		{
-
-			if(reference_bases[reference_index] == '\0')
-			{
-				break;	
-			}
-			
-			if(reference_bases[reference_index] != '*' && sequences[i][reference_index] != '\0' && sequences[i][reference_index] != '\n')
+			char base = sequence_bases[range->kept_columns[j]];
+			if(base != '\0' && base != '\n')
 			{
-				filtered_bases_for_snps[filtered_base_counter][i] = sequences[i][reference_index];
+				range->filtered_bases_for_samples[i][filtered_base_counter] = base;
 				filtered_base_counter++;
 			}
 		}
 	}
-	for(j = 0; j < number_of_filtered_snps; j++)
-	{
-		 filtered_bases_for_snps[j][num_samples] = '\0';	
-	}
+	free_packed_sequence(&row_buffer);
+	free(sequence_bases);
+	return NULL;
+}
 
+// The same bases one row per snp, the rows share one block which is freed with free_base_matrix
+void filter_sequence_bases_and_rotate(char * reference_bases, char ** filtered_bases_for_snps, int number_of_filtered_snps)
+{
+	char ** filtered_bases_for_samples = (char **) calloc(num_samples+1, sizeof(char *));
+	filter_sequence_bases(reference_bases, filtered_bases_for_samples, number_of_filtered_snps, 1);
+	
+	allocate_base_matrix(filtered_bases_for_snps, number_of_filtered_snps, num_samples);
+	transpose_base_matrix(filtered_bases_for_samples, num_samples, number_of_filtered_snps, filtered_bases_for_snps);
+	
+	free_base_matrix(filtered_bases_for_samples, num_samples);
+	free(filtered_bases_for_samples);
 }
 
 
 void set_number_of_recombinations_for_sample(char * sample_name, int number_of_recombinations)
 {
-	int sample_index ;
-	sample_index = find_sequence_index_from_sample_name( sample_name);
-  if( sample_index == -1)
+	set_number_of_recombinations_for_sample_index(find_sequence_index_from_sample_name( sample_name), number_of_recombinations);
+}
+
+void set_number_of_recombinations_for_sample_index(int sample_index, int number_of_recombinations)
+{
+  if( sample_index < 0)
   {
 		return;
 	}
 	((sample_statistics *) statistics_for_samples[sample_index])->number_of_recombinations = number_of_recombinations;
 }
 
-
 void set_number_of_snps_for_sample(char * sample_name, int number_of_snps)
 {
-	int sample_index ;
-	sample_index = find_sequence_index_from_sample_name( sample_name);
-  if( sample_index == -1)
+	set_number_of_snps_for_sample_index(find_sequence_index_from_sample_name( sample_name), number_of_snps);
+}
+
+void set_number_of_snps_for_sample_index(int sample_index, int number_of_snps)
+{
+  if( sample_index < 0)
   {
 		return;
 	}
-	
 	((sample_statistics *) statistics_for_samples[sample_index])->number_of_snps = number_of_snps;
 }
 
-void set_number_of_blocks_for_sample(char * sample_name,int num_blocks)
+void set_number_of_blocks_for_sample(char * sample_name, int num_blocks)
+{
+	set_number_of_blocks_for_sample_index(find_sequence_index_from_sample_name( sample_name), num_blocks);
+}
+
+void set_number_of_blocks_for_sample_index(int sample_index, int num_blocks)
 {
-	int sample_index ;
-	sample_index = find_sequence_index_from_sample_name( sample_name);
-  if( sample_index == -1)
+  if( sample_index < 0)
   {
 		return;
 	}
-	
 	((sample_statistics *) statistics_for_samples[sample_index])->number_of_blocks = num_blocks;
 }
 
-
-
 void set_genome_length_without_gaps_for_sample(char * sample_name, int genome_length_without_gaps)
 {
-	int sample_index ;
-	sample_index = find_sequence_index_from_sample_name( sample_name);
-  if( sample_index == -1)
+	set_genome_length_without_gaps_for_sample_index(find_sequence_index_from_sample_name( sample_name), genome_length_without_gaps);
+}
+
+void set_genome_length_without_gaps_for_sample_index(int sample_index, int genome_length_without_gaps)
+{
+  if( sample_index < 0)
   {
 		return;
 	}
-	
 	((sample_statistics *) statistics_for_samples[sample_index])->genome_length_without_gaps = genome_length_without_gaps;
 }
 
 void set_genome_length_excluding_blocks_and_gaps_for_sample(char * sample_name, int genome_length_excluding_blocks_and_gaps)
 {
-	int sample_index ;
-	sample_index = find_sequence_index_from_sample_name( sample_name);
-    if( sample_index == -1)
-    {
+	set_genome_length_excluding_blocks_and_gaps_for_sample_index(find_sequence_index_from_sample_name( sample_name), genome_length_excluding_blocks_and_gaps);
+}
+
+void set_genome_length_excluding_blocks_and_gaps_for_sample_index(int sample_index, int genome_length_excluding_blocks_and_gaps)
+{
+  if( sample_index < 0)
+  {
 		return;
 	}
-	
 	((sample_statistics *) statistics_for_samples[sample_index])->genome_length_excluding_blocks_and_gaps = genome_length_excluding_blocks_and_gaps;
 }
 
 void set_number_of_bases_in_recombinations(char * sample_name, int bases_in_recombinations)
 {
-	int sample_index ;
-	sample_index = find_sequence_index_from_sample_name( sample_name);
-  if( sample_index == -1)
+	set_number_of_bases_in_recombinations_for_sample_index(find_sequence_index_from_sample_name( sample_name), bases_in_recombinations);
+}
+
+void set_number_of_bases_in_recombinations_for_sample_index(int sample_index, int bases_in_recombinations)
+{
+  if( sample_index < 0)
   {
 		return;
 	}
@@ -312,20 +1055,36 @@ void set_number_of_bases_in_recombinations(char * sample_name, int bases_in_reco
 }
 
 
-
-
 int find_sequence_index_from_sample_name( char * sample_name)
 {
-	int i;
+	int sample_name_id = find_sample_name_id(sample_name);
+	if(sample_name_id < 0 || sample_name_id >= number_of_indexed_sample_name_ids)
+	{
+		return -1;
+	}
+	return sequence_index_of_sample_name_id[sample_name_id];
+}
+
+// If a name is repeated the first sequence with that name is used, as with a linear search
+void initialise_sample_name_index()
+{
+	int i = 0;
+	free(sequence_index_of_sample_name_id);
+	number_of_indexed_sample_name_ids = get_number_of_pooled_sample_names();
+	sequence_index_of_sample_name_id = (int *) malloc((number_of_indexed_sample_name_ids+1)*sizeof(int));
+	for(i = 0; i < number_of_indexed_sample_name_ids; i++)
+	{
+		sequence_index_of_sample_name_id[i] = -1;
+	}
 	
-	for(i =0; i< num_samples; i++)
+	for(i = 0; i < num_samples; i++)
 	{
-		if(strcmp(sample_name,phylip_sample_names[i]) == 0)	
+		int sample_name_id = find_sample_name_id(phylip_sample_names[i]);
+		if(sequence_index_of_sample_name_id[sample_name_id] == -1)
 		{
-			return i;
+			sequence_index_of_sample_name_id[sample_name_id] = i;
 		}
 	}
-	return -1;
 }
 
 void initialise_internal_node()
@@ -347,75 +1106,180 @@ void initialise_statistics()
 		sample_statistics * sample_statistics_placeholder;
 		sample_statistics_placeholder = (sample_statistics *) calloc(1, sizeof(sample_statistics));
 		
-		sample_statistics_placeholder->sample_name = (char *) calloc( MAX_SAMPLE_NAME_SIZE,sizeof(char));
-		memcpy(sample_statistics_placeholder->sample_name, phylip_sample_names[i], size_of_string(phylip_sample_names[i]) +1);
-		
+		sample_statistics_placeholder->sample_name = phylip_sample_names[i];
 		statistics_for_samples[i] = sample_statistics_placeholder;
 	}
 }
 
+// The statistics outlive freeup_memory, so the sequences can be reloaded once they are written out
+void free_sample_statistics()
+{
+	int i;
+	if(statistics_for_samples == NULL)
+	{
+		return;
+	}
+	for(i = 0; i < num_samples; i++)
+	{
+		free(statistics_for_samples[i]);
+	}
+	free(statistics_for_samples);
+	statistics_for_samples = NULL;
+}
+
 int number_of_snps_in_phylip()
 {
 	return num_snps;
 }
 
 void load_sequences_from_multifasta_file(char filename[])
+{
+	record_profile_input_file(filename);
+	loaded_alignment * alignment = load_alignment(filename);
+	load_sequences_from_rows(alignment->sequence_names, alignment->sequences, alignment->sequence_lengths, alignment->number_of_sequences, genome_length(filename));
+	// The bases are all packed now so the file isnt needed any more
+	free_loaded_alignment();
+}
+
+// Only the rows with one of the names are kept, so a shard of the tree holds the sequences of its own nodes and no others
+void load_sequences_for_samples_from_multifasta_file(char filename[], char ** sample_names, int number_of_sample_names)
 {
 	int i;
+	record_profile_input_file(filename);
+	loaded_alignment * alignment = load_alignment(filename);
+	char ** sorted_sample_names = (char **) calloc(number_of_sample_names +1, sizeof(char *));
+	memcpy(sorted_sample_names, sample_names, number_of_sample_names*sizeof(char *));
+	qsort(sorted_sample_names, number_of_sample_names, sizeof(char *), compare_phylip_sample_names);
+	
+	char ** kept_sample_names = (char **) calloc(alignment->number_of_sequences +1, sizeof(char *));
+	char ** kept_sequences = (char **) calloc(alignment->number_of_sequences +1, sizeof(char *));
+	int * kept_sequence_lengths = (int *) calloc(alignment->number_of_sequences +1, sizeof(int));
+	int number_of_kept_sequences = 0;
+	for(i = 0; i < alignment->number_of_sequences; i++)
+	{
+		if(bsearch(&alignment->sequence_names[i], sorted_sample_names, number_of_sample_names, sizeof(char *), compare_phylip_sample_names) == NULL)
+		{
+			continue;
+		}
+		kept_sample_names[number_of_kept_sequences] = alignment->sequence_names[i];
+		kept_sequences[number_of_kept_sequences] = alignment->sequences[i];
+		kept_sequence_lengths[number_of_kept_sequences] = alignment->sequence_lengths[i];
+		number_of_kept_sequences++;
+	}
+	load_sequences_from_rows(kept_sample_names, kept_sequences, kept_sequence_lengths, number_of_kept_sequences, genome_length(filename));
+	free_loaded_alignment();
+	
+	free(kept_sequence_lengths);
+	free(kept_sequences);
+	free(kept_sample_names);
+	free(sorted_sample_names);
+}
 
-	num_snps    = genome_length(filename);
-	num_samples = number_of_sequences_in_file(filename);
+int compare_phylip_sample_names(const void * a, const void * b)
+{
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+// The rows are only read, so they can belong to the caller, for example a buffer passed in from python.
+// Every row is cut or padded to length_of_genome, the length of the first sequence in a file.
+void load_sequences_from_rows(char ** sample_names, char ** sample_sequences, int * sequence_lengths, int number_of_samples, int length_of_genome)
+{
+	int i;
+	num_snps    = length_of_genome;
+	num_samples = number_of_samples;
 	
-	sequences = (char **) calloc((num_samples+1),sizeof(char *));
+	sequences = (packed_sequence *) calloc((num_samples+1),sizeof(packed_sequence));
 	phylip_sample_names = (char **) calloc((num_samples+1),sizeof(char *));
+	sequence_views = (char **) calloc((num_samples+1),sizeof(char *));
 	
+	sequence_storage_row_size = packed_sequence_storage_size(num_snps);
+	sequence_storage = (unsigned char *) allocate_matrix_storage(num_samples*sequence_storage_row_size);
 	for(i = 0; i < num_samples; i++)
 	{
-		sequences[i] = (char *) calloc((num_snps+1),sizeof(char));
-		phylip_sample_names[i] = (char *) calloc((MAX_SAMPLE_NAME_SIZE+1),sizeof(char));
+		initialise_packed_sequence_in_storage(&sequences[i], num_snps, sequence_storage + i*sequence_storage_row_size);
+		phylip_sample_names[i] = pool_sample_name(sample_names[i]);
 	}
-	get_sample_names_for_header(filename, phylip_sample_names, num_samples);
 	
-  int l;
-  i = 0;
   int sequence_number = 0;
+  char * sequence_bases = (char *) calloc((num_snps+1),sizeof(char));
 
- 	gzFile fp;
- 	kseq_t *seq;
-
- 	fp = gzopen(filename, "r");
- 	seq = kseq_init(fp);
-
- 	while ((l = kseq_read(seq)) >= 0) 
+ 	for(sequence_number = 0; sequence_number < num_samples; sequence_number++)
  	{
+     char * sequence = sample_sequences[sequence_number];
+     int length_of_sequence = sequence_lengths[sequence_number];
      for(i = 0; i< num_snps; i++)
  		{
- 			sequences[sequence_number][i] = toupper(((char *) seq->seq.s)[i]);
- 			if(sequences[sequence_number][i] == 'N')
+ 			sequence_bases[i] = (i < length_of_sequence) ? toupper(sequence[i]) : '\0';
+ 			if(sequence_bases[i] == 'N')
  			{
- 				sequences[sequence_number][i]  = '-';
+ 				sequence_bases[i]  = '-';
  			}
  		}
-     sequence_number++;
+     pack_sequence(&sequences[sequence_number], sequence_bases);
    }
-
- 	kseq_destroy(seq);
- 	gzclose(fp);
+ 	free(sequence_bases);
 
 	initialise_statistics();
 	initialise_internal_node();
+	initialise_sample_name_index();
+}
+
+// Moves the packed sequences in mapped storage so they are in the order given, with any left out after them.
+// Given the order the tree is traversed in, the sequences of a subtree are next to each other in the file and
+// are paged in together. Storage on the heap is left as it is, and so are encoded rows, which dont have any.
+void order_sequence_storage(int * sequence_indices, int number_of_sequence_indices)
+{
+	int i;
+	if(num_samples == 0 || !matrix_storage_is_mapped(sequence_storage))
+	{
+		return;
+	}
+	
+	int number_of_dense_rows = 0;
+	for(i = 0; i < num_samples; i++)
+	{
+		number_of_dense_rows += !sequence_row_is_encoded(i);
+	}
+	unsigned char * ordered_storage = (unsigned char *) allocate_matrix_storage(number_of_dense_rows*sequence_storage_row_size);
+	int * is_placed = (int *) calloc(num_samples+1, sizeof(int));
+	int number_placed = 0;
+	for(i = 0; i < number_of_sequence_indices + num_samples; i++)
+	{
+		int sequence_index = i < number_of_sequence_indices ? sequence_indices[i] : i - number_of_sequence_indices;
+		if(sequence_index < 0 || sequence_index >= num_samples || is_placed[sequence_index] || sequence_row_is_encoded(sequence_index))
+		{
+			continue;
+		}
+		unsigned char * row = ordered_storage + number_placed*sequence_storage_row_size;
+		memcpy(row, sequences[sequence_index].bases, sequence_storage_row_size);
+		sequences[sequence_index].bases = row;
+		sequences[sequence_index].non_acgt_mask = row + (num_snps/4)+1;
+		is_placed[sequence_index] = 1;
+		number_placed++;
+	}
+	free(is_placed);
+	free_matrix_storage(sequence_storage);
+	sequence_storage = ordered_storage;
 }
 
 void freeup_memory()
 {
 	int i;
+	release_sequence_views();
+	free_sparse_sequence_rows();
 	for(i = 0; i < num_samples; i++)
 	{
-	  free(sequences[i]);
-		free(phylip_sample_names[i]);
+	  free_packed_sequence(&sequences[i]);
   }
   free(sequences);
+	free_matrix_storage(sequence_storage);
+	sequence_storage = NULL;
 	free(phylip_sample_names);
 	free(internal_node);
+	free(sequence_views);
+	sequence_views = NULL;
+	free(sequence_index_of_sample_name_id);
+	sequence_index_of_sample_name_id = NULL;
+	number_of_indexed_sample_name_ids = 0;
 }
 
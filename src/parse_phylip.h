@@ -19,6 +19,8 @@
 
 #ifndef _PARSE_PHYLIP_H_
 #define _PARSE_PHYLIP_H_
+#include <stdint.h>
+#include "packed_sequence.h"
 
  typedef struct sample_statistics
  {
@@ -31,32 +33,91 @@
    int genome_length_excluding_blocks_and_gaps;
  } sample_statistics;
 
+// The samples which one thread cuts down to the filtered snps
+typedef struct filtered_sample_range
+{
+	int * kept_columns;
+	int number_of_kept_columns;
+	char ** filtered_bases_for_samples;
+	int first_sample;
+	int end_sample;
+} filtered_sample_range;
+
+// Whole words of snp columns, which one thread checks for snps
+typedef struct snp_column_range
+{
+	char * reference_bases;
+	char * real_reference_bases;
+	packed_sequence * real_reference;
+	int * column_contains_snps;
+	int first_word;
+	int number_of_words;
+	int number_of_columns;
+} snp_column_range;
+
 void get_sequence_for_sample_name(char * sequence_bases, char * sample_name);
+void get_sequence_for_sample_index(char * sequence_bases, int sequence_index);
+const char * get_sequence_view_for_sample_index(int sequence_index);
+void release_sequence_view_for_sample_index(int sequence_index);
+void release_sequence_views();
 int find_sequence_index_from_sample_name( char * sample_name);
+void initialise_sample_name_index();
 int update_sequence_base(char new_sequence_base, int sequence_index, int base_index);
+int compare_base_indices(const void * a, const void * b);
+int update_sequence_bases(char new_sequence_base, int sequence_index, int * base_indices, int number_of_base_indices);
 int does_column_contain_snps(int snp_column, char reference_base);
 int number_of_samples_from_parse_phylip();
 void get_sample_names_from_parse_phylip(char ** sample_names);
 char convert_reference_to_real_base_in_column(int snp_column, char reference_base);
+void find_columns_which_contain_snps(char * reference_bases, int number_of_columns, int * column_contains_snps, int num_threads);
+void run_on_snp_column_ranges(snp_column_range * ranges, int number_of_ranges, void * (*range_function)(void *));
+uint64_t get_columns_in_snp_column_word(snp_column_range * range, int word_index);
+void * find_real_reference_bases_in_range(void * range_pointer);
+void * find_snps_in_range(void * range_pointer);
 void set_genome_length_without_gaps_for_sample(char * sample_name, int genome_length_without_gaps);
 void set_number_of_snps_for_sample(char * sample_name, int number_of_snps);
 void set_number_of_recombinations_for_sample(char * sample_name, int number_of_recombinations);
 void set_number_of_blocks_for_sample(char * sample_name,int num_blocks);
 sample_statistics ** get_sample_statistics();
+void free_sample_statistics();
 int number_of_snps_in_phylip();
 void load_sequences_from_multifasta_file(char filename[]);
+void load_sequences_for_samples_from_multifasta_file(char filename[], char ** sample_names, int number_of_sample_names);
+int compare_phylip_sample_names(const void * a, const void * b);
+void load_sequences_from_rows(char ** sample_names, char ** sample_sequences, int * sequence_lengths, int number_of_samples, int length_of_genome);
 void set_internal_node(int internal_node_value,int sequence_index);
 void initialise_internal_node();
 int get_internal_node(int sequence_index);
 void fill_in_unambiguous_bases_in_parent_from_children_where_parent_has_a_gap(int parent_sequence_index, int * child_sequence_indices, int num_children);
 void fill_in_unambiguous_gaps_in_parent_from_children(int parent_sequence_index, int * child_sequence_indices, int num_children);
+void order_sequence_storage(int * sequence_indices, int number_of_sequence_indices);
 void freeup_memory();
+void set_sparse_sequence_rows(int sparse_sequence_rows);
+int sequence_row_is_encoded(int sequence_index);
+char find_encoded_sequence_base(int sequence_index, int base_index);
+char get_sequence_base(int sequence_index, int base_index);
+packed_sequence * acquire_packed_row(int sequence_index, packed_sequence * row_buffer);
+void build_encoded_row(int sequence_index, packed_sequence * row_buffer);
+int set_sequence_base(int sequence_index, int base_index, char new_sequence_base);
+int get_sequence_differences_from_parent(int sequence_index, int parent_sequence_index, int ** positions, char ** bases);
+void encode_sequence_rows_as_differences(int * sequence_indices, int * parent_sequence_indices, int number_of_sequence_indices);
+void free_sparse_sequence_rows();
 void set_number_of_bases_in_recombinations(char * sample_name, int bases_in_recombinations);
+void filter_sequence_bases(char * reference_bases, char ** filtered_bases_for_samples, int number_of_filtered_snps, int num_threads);
+void * filter_sequence_bases_in_range(void * range_pointer);
 void filter_sequence_bases_and_rotate(char * reference_bases, char ** filtered_bases_for_snps, int number_of_filtered_snps);
 void set_genome_length_excluding_blocks_and_gaps_for_sample(char * sample_name, int genome_length_excluding_blocks_and_gaps);
+void set_genome_length_without_gaps_for_sample_index(int sample_index, int genome_length_without_gaps);
+void set_number_of_snps_for_sample_index(int sample_index, int number_of_snps);
+void set_number_of_recombinations_for_sample_index(int sample_index, int number_of_recombinations);
+void set_number_of_blocks_for_sample_index(int sample_index, int num_blocks);
+void set_number_of_bases_in_recombinations_for_sample_index(int sample_index, int bases_in_recombinations);
+void set_genome_length_excluding_blocks_and_gaps_for_sample_index(int sample_index, int genome_length_excluding_blocks_and_gaps);
 
 #define MAX_READ_BUFFER 65536
 #define MAX_SAMPLE_NAME_SIZE 1024
+// An encoded row is never more than this many rows below a dense one, which bounds the work of building it
+#define SPARSE_ROW_CHECKPOINT_GENERATIONS 32
 
 
 #endif
@@ -22,69 +22,211 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
 #include <regex.h>
 #include "vcf.h"
 #include "parse_vcf.h"
 #include "alignment_file.h"
+#include "compressed_reader.h"
+#include "sample_name_pool.h"
 
 int * column_data;
+vcf_index * cached_vcf_index = NULL;
 
-void get_integers_from_column_in_vcf(FILE * vcf_file_pointer, int * integer_values, int number_of_snps, int column_number)
+// The index is built the first time a file is used and shared by all of the column accessors
+vcf_index * get_vcf_index(FILE * vcf_file_pointer)
 {
-	rewind(vcf_file_pointer);
-	char * szBuffer;
-	szBuffer = (char *) calloc(MAX_READ_BUFFER,sizeof(char));
-	int reference_index = 0;
-	char result[1000] = {0};  
+	struct stat file_status;
+	fflush(vcf_file_pointer);
+	if(fstat(fileno(vcf_file_pointer), &file_status) != 0)
+	{
+		printf("Cannot read the VCF file\n");
+		exit(1);
+	}
 	
-	do{
-		szBuffer[0] = '\0';
- 		// check the first character of the line to see if its in the header
-  	szBuffer = read_line(szBuffer, vcf_file_pointer);
-		
-		if(szBuffer[0] == '\0')
+	if(cached_vcf_index != NULL && cached_vcf_index->vcf_file_pointer == vcf_file_pointer &&
+	   cached_vcf_index->device == file_status.st_dev && cached_vcf_index->inode == file_status.st_ino &&
+	   cached_vcf_index->file_size == file_status.st_size && cached_vcf_index->modification_time == file_status.st_mtime)
+	{
+		return cached_vcf_index;
+	}
+	free_vcf_index();
+	
+	vcf_index * index = (vcf_index *) calloc(1, sizeof(vcf_index));
+	index->vcf_file_pointer = vcf_file_pointer;
+	index->device = file_status.st_dev;
+	index->inode = file_status.st_ino;
+	index->file_size = file_status.st_size;
+	index->modification_time = file_status.st_mtime;
+	
+	if(is_vcf_file_compressed(vcf_file_pointer))
+	{
+		read_compressed_vcf_data(index, vcf_file_pointer);
+	}
+	else if(file_status.st_size > 0)
+	{
+		index->data_is_mapped = 1;
+		index->data = (char *) mmap(NULL, file_status.st_size, PROT_READ, MAP_PRIVATE, fileno(vcf_file_pointer), 0);
+		if(index->data == MAP_FAILED)
 		{
-			break;
+			printf("Cannot map the VCF file\n");
+			exit(1);
 		}
-		
-		if(szBuffer[0] != '#')
+		index->data_size = file_status.st_size;
+	}
+	index_vcf_lines(index);
+	
+	cached_vcf_index = index;
+	return index;
+}
+
+int is_vcf_file_compressed(FILE * vcf_file_pointer)
+{
+	unsigned char magic_number[2] = {0, 0};
+	return pread(fileno(vcf_file_pointer), magic_number, 2, 0) == 2 && magic_number[0] == 0x1f && magic_number[1] == 0x8b;
+}
+
+// A gzip or BGZF compressed vcf is inflated into memory instead of being mapped
+void read_compressed_vcf_data(vcf_index * index, FILE * vcf_file_pointer)
+{
+	int file_descriptor = dup(fileno(vcf_file_pointer));
+	if(file_descriptor < 0)
+	{
+		printf("Cannot read the compressed VCF file\n");
+		exit(1);
+	}
+	compressed_reader * reader = open_compressed_reader_from_descriptor(file_descriptor);
+	size_t capacity = MAX_READ_BUFFER;
+	int bytes_read;
+	index->data = (char *) malloc(capacity);
+	while((bytes_read = read_compressed_reader(reader, index->data + index->data_size, capacity - index->data_size)) > 0)
+	{
+		index->data_size += bytes_read;
+		if(index->data_size == capacity)
 		{
-			split_string_and_return_specific_index(result, szBuffer, column_number,100000);
-			integer_values[reference_index] = atoi(result);
-			reference_index++;
+			capacity *= 2;
+			index->data = (char *) realloc(index->data, capacity);
 		}
+	}
+	close_compressed_reader(reader);
+}
+
+// Every line which doesnt start with a # is a snp row, and the column names come from the first #CHROM line in the header
+void index_vcf_lines(vcf_index * index)
+{
+	size_t line_start = 0;
+	int in_header = 1;
+	while(line_start < index->data_size)
+	{
+		char * end_of_line = memchr(index->data + line_start, '\n', index->data_size - line_start);
+		size_t line_end = (end_of_line == NULL) ? index->data_size : (size_t)(end_of_line - index->data);
 		
-	}while(szBuffer[0] != '\0');
-	free(szBuffer);
+		if(index->data[line_start] == '#')
+		{
+			if(in_header && index->has_column_header == 0 && line_end - line_start >= 6 && strncmp(index->data + line_start, "#CHROM", 6) == 0 &&
+			   (line_end - line_start == 6 || index->data[line_start + 6] == '\t'))
+			{
+				index->has_column_header = 1;
+				index->column_header_start = line_start;
+				index->column_header_end = line_end;
+			}
+		}
+		else
+		{
+			in_header = 0;
+			if(index->number_of_rows == index->capacity)
+			{
+				index->capacity = (index->capacity == 0) ? 1024 : index->capacity*2;
+				index->row_starts = (size_t *) realloc(index->row_starts, index->capacity*sizeof(size_t));
+				index->row_ends = (size_t *) realloc(index->row_ends, index->capacity*sizeof(size_t));
+			}
+			index->row_starts[index->number_of_rows] = line_start;
+			index->row_ends[index->number_of_rows] = line_end;
+			index->number_of_rows++;
+		}
+		line_start = line_end + 1;
+	}
 }
 
+// Skip over whole columns with memchr, returns 0 if the line has fewer columns
+int find_field_in_line(char * data, size_t line_start, size_t line_end, int column_number, size_t * field_start, size_t * field_end)
+{
+	int i;
+	size_t position = line_start;
+	for(i = 0; i < column_number; i++)
+	{
+		char * next_tab = memchr(data + position, '\t', line_end - position);
+		if(next_tab == NULL)
+		{
+			return 0;
+		}
+		position = (next_tab - data) + 1;
+	}
+	
+	char * next_tab = memchr(data + position, '\t', line_end - position);
+	*field_start = position;
+	*field_end = (next_tab == NULL) ? line_end : (size_t)(next_tab - data);
+	return 1;
+}
 
-void get_sequence_from_column_in_vcf(FILE * vcf_file_pointer, char * sequence_bases, int number_of_snps, int column_number)
+void free_vcf_index()
 {
-	rewind(vcf_file_pointer);
-	char * szBuffer;
-	szBuffer = (char *) calloc(MAX_READ_BUFFER,sizeof(char));
+	if(cached_vcf_index == NULL)
+	{
+		return;
+	}
+	if(cached_vcf_index->data_is_mapped)
+	{
+		munmap(cached_vcf_index->data, cached_vcf_index->data_size);
+	}
+	else
+	{
+		free(cached_vcf_index->data);
+	}
+	free(cached_vcf_index->row_starts);
+	free(cached_vcf_index->row_ends);
+	free(cached_vcf_index);
+	cached_vcf_index = NULL;
+}
+
+void get_integers_from_column_in_vcf(FILE * vcf_file_pointer, int * integer_values, int number_of_snps, int column_number)
+{
+	vcf_index * index = get_vcf_index(vcf_file_pointer);
 	int reference_index = 0;
-	char result[1000] = {0};  
-		
-	do{
-		szBuffer[0] = '\0';
-		// check the first character of the line to see if its in the header
-		szBuffer = read_line(szBuffer, vcf_file_pointer);
-		
-		if(szBuffer[0] == '\0')
+	char result[100] = {0};
+	
+	for(reference_index = 0; reference_index < index->number_of_rows && reference_index < number_of_snps; reference_index++)
+	{
+		size_t field_start, field_end;
+		result[0] = '\0';
+		if(find_field_in_line(index->data, index->row_starts[reference_index], index->row_ends[reference_index], column_number, &field_start, &field_end))
 		{
-			break;
+			size_t field_length = (field_end - field_start < sizeof(result) - 1) ? field_end - field_start : sizeof(result) - 1;
+			memcpy(result, index->data + field_start, field_length);
+			result[field_length] = '\0';
 		}
-		
-		if(szBuffer[0] != '#')
+		integer_values[reference_index] = atoi(result);
+	}
+}
+
+
+void get_sequence_from_column_in_vcf(FILE * vcf_file_pointer, char * sequence_bases, int number_of_snps, int column_number)
+{
+	vcf_index * index = get_vcf_index(vcf_file_pointer);
+	int reference_index = 0;
+	
+	for(reference_index = 0; reference_index < index->number_of_rows; reference_index++)
+	{
+		size_t field_start, field_end;
+		sequence_bases[reference_index] = '\0';
+		if(find_field_in_line(index->data, index->row_starts[reference_index], index->row_ends[reference_index], column_number, &field_start, &field_end) && field_end > field_start)
 		{
-			split_string_and_return_specific_index(result, szBuffer, column_number, 1000);
-			sequence_bases[reference_index] = result[0];
-			reference_index++;
+			sequence_bases[reference_index] = index->data[field_start];
 		}
-		
-	}while(szBuffer[0] != '\0');
+	}
 	
 	sequence_bases[reference_index] = '\0';
 }
@@ -166,69 +308,80 @@ int get_number_of_columns(char * column_header)
 }
 
 // Assumes that all column headers have something in them
+//#CHROM  POS     ID      REF     ALT     QUAL    FILTER  INFO    FORMAT  _S_pneumoniae_Spanis    _3948_7_10
 int get_number_of_columns_from_file(FILE * vcf_file_pointer)
 {
-	rewind(vcf_file_pointer);
-	char result[100] = {0};
+	vcf_index * index = get_vcf_index(vcf_file_pointer);
+	int number_of_columns = 0;
+	size_t field_start = index->column_header_start;
+	size_t field_end;
 	
-	char * szBuffer;
-	szBuffer = (char *) calloc(MAX_READ_BUFFER,sizeof(char));
+	if(index->has_column_header == 0)
+	{
+		return 0;
+	}
 	
-	do{
-		szBuffer[0] = '\0';
-		// check the first character of the line to see if its in the header
-		szBuffer = read_line(szBuffer, vcf_file_pointer);
-		if(szBuffer[0] == '\0' || szBuffer[0] != '#')
+	// Count up to the first empty column
+	while(find_field_in_line(index->data, field_start, index->column_header_end, 0, &field_start, &field_end) && field_end > field_start)
+	{
+		number_of_columns++;
+		if(field_end == index->column_header_end)
 		{
 			break;
 		}
-		
-		//#CHROM  POS     ID      REF     ALT     QUAL    FILTER  INFO    FORMAT  _S_pneumoniae_Spanis    _3948_7_10
-		split_string_and_return_specific_index( result, szBuffer, 0,100000);
-		if(strcmp(result, "#CHROM")==0)
-		{
-			int number_of_columns =  get_number_of_columns(szBuffer);
-			free(szBuffer);
-			return number_of_columns;
-		}
-		
-	}while(szBuffer[0] != '\0');
-	free(szBuffer);
-	return 0;
+		field_start = field_end + 1;
+	}
+	return number_of_columns;
 }
 
 
 void get_column_names(FILE * vcf_file_pointer, char ** column_names, int number_of_columns)
 {
-	rewind(vcf_file_pointer);
-	char * szBuffer;
-	szBuffer = (char *) calloc(MAX_READ_BUFFER,sizeof(char));
-	char result[100] = {0};  
+	vcf_index * index = get_vcf_index(vcf_file_pointer);
+	size_t field_start = index->column_header_start;
+	size_t field_end;
 	int i;
 	
-	do{
-		szBuffer[0] = '\0';
-		// check the first character of the line to see if its in the header
-		szBuffer = read_line(szBuffer, vcf_file_pointer);
-		
-		if(szBuffer[0] == '\0' || szBuffer[0] != '#')
+	if(index->has_column_header == 0)
+	{
+		return;
+	}
+	
+	for(i = 0; i< number_of_columns; i++)
+	{
+		column_names[i][0] = '\0';
+		if(field_start > index->column_header_end || find_field_in_line(index->data, field_start, index->column_header_end, 0, &field_start, &field_end) == 0)
 		{
-			break;
+			continue;
 		}
-		
-		//#CHROM  POS     ID      REF     ALT     QUAL    FILTER  INFO    FORMAT  _S_pneumoniae_Spanis    _3948_7_10
-		split_string_and_return_specific_index( result, szBuffer, 0,100000);
-		if(strcmp(result, "#CHROM")==0)
+		size_t field_length = (field_end - field_start < MAX_SAMPLE_NAME_SIZE - 1) ? field_end - field_start : MAX_SAMPLE_NAME_SIZE - 1;
+		memcpy(column_names[i], index->data + field_start, field_length);
+		column_names[i][field_length] = '\0';
+		field_start = field_end + 1;
+	}
+}
+
+// The same names as get_column_names, borrowed from the sample name pool rather than copied into buffers of the caller
+void get_pooled_column_names(FILE * vcf_file_pointer, char ** column_names, int number_of_columns)
+{
+	vcf_index * index = get_vcf_index(vcf_file_pointer);
+	size_t field_start = index->column_header_start;
+	size_t field_end;
+	char column_name[MAX_SAMPLE_NAME_SIZE];
+	int i;
+	
+	for(i = 0; i< number_of_columns; i++)
+	{
+		column_name[0] = '\0';
+		if(index->has_column_header && field_start <= index->column_header_end && find_field_in_line(index->data, field_start, index->column_header_end, 0, &field_start, &field_end) != 0)
 		{
-			for(i = 0; i< number_of_columns; i++)
-			{
-				split_string_and_return_specific_index( result, szBuffer, i,100000);
-				memcpy(column_names[i], result, (strlen(result)+1)*sizeof(char));
-			}
+			size_t field_length = (field_end - field_start < MAX_SAMPLE_NAME_SIZE - 1) ? field_end - field_start : MAX_SAMPLE_NAME_SIZE - 1;
+			memcpy(column_name, index->data + field_start, field_length);
+			column_name[field_length] = '\0';
+			field_start = field_end + 1;
 		}
-		
-	}while(szBuffer[0] != '\0');
-	free(szBuffer);
+		column_names[i] = pool_sample_name(column_name);
+	}
 }
 
 // Assume the sample names are unique
@@ -21,6 +21,30 @@
 #ifndef _PARSE_VCF_H_
 #define _PARSE_VCF_H_
 
+#include <stdio.h>
+#include <sys/types.h>
+
+// A vcf file mapped into memory with the start and end of each snp row indexed, so that a column can be
+// read from every row by jumping straight to it rather than re-reading and splitting the whole line.
+typedef struct vcf_index
+{
+	FILE * vcf_file_pointer;
+	dev_t device;
+	ino_t inode;
+	off_t file_size;
+	time_t modification_time;
+	char * data;
+	size_t data_size;
+	int data_is_mapped;
+	int number_of_rows;
+	int capacity;
+	size_t * row_starts;
+	size_t * row_ends;
+	int has_column_header;
+	size_t column_header_start;
+	size_t column_header_end;
+} vcf_index;
+
 void get_sequence_from_column_in_vcf(FILE * vcf_file_pointer, char * sequence_bases, int number_of_snps, int column_number);
 int get_number_of_snps(FILE * vcf_file_pointer);
 int get_number_of_samples(FILE * vcf_file_pointer);
@@ -28,9 +52,16 @@ void split_string_and_return_specific_index(char * result, char * input_string,
 int get_number_of_columns(char * column_header);
 int get_number_of_columns_from_file(FILE * vcf_file_pointer);
 void get_column_names(FILE * vcf_file_pointer, char ** column_names, int number_of_columns);
+void get_pooled_column_names(FILE * vcf_file_pointer, char ** column_names, int number_of_columns);
 int column_number_for_column_name(char ** column_names, char * column_name, int number_of_columns);
 
 void get_integers_from_column_in_vcf(FILE * vcf_file_pointer, int * integer_values, int number_of_snps, int column_number);
+vcf_index * get_vcf_index(FILE * vcf_file_pointer);
+int is_vcf_file_compressed(FILE * vcf_file_pointer);
+void read_compressed_vcf_data(vcf_index * index, FILE * vcf_file_pointer);
+void index_vcf_lines(vcf_index * index);
+int find_field_in_line(char * data, size_t line_start, size_t line_end, int column_number, size_t * field_start, size_t * field_end);
+void free_vcf_index();
 #define MAX_READ_BUFFER 65536
 
 #endif
\ No newline at end of file
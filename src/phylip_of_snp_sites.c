@@ -24,20 +24,42 @@
 #include "phylip_of_snp_sites.h"
 #include "parse_phylip.h"
 #include "string_cat.h"
+#include "output_buffer.h"
+#include "bgzf_file.h"
 
 
-void create_phylip_of_snp_sites(char filename[], int number_of_snps, char ** bases_for_snps, char ** sequence_names, int number_of_samples, int internal_nodes[])
+void create_phylip_of_snp_sites(char filename[], int number_of_snps, char ** bases_for_samples, char ** sequence_names, int number_of_samples, int internal_nodes[], int num_threads)
+{
+	FILE *fasta_file_pointer;
+	output_buffer buffer;
+	snp_sites_rows rows;
+	
+	fasta_file_pointer = open_phylip_of_snp_sites(filename, number_of_snps, number_of_samples, internal_nodes);
+	
+	rows.bases_for_samples = bases_for_samples;
+	rows.sequence_names = sequence_names;
+	rows.number_of_snps = number_of_snps;
+	rows.internal_nodes = internal_nodes;
+	
+	initialise_output_buffer(&buffer, fasta_file_pointer, OUTPUT_BUFFER_SIZE);
+	write_rows(&buffer, &rows, number_of_samples, maximum_phylip_of_snp_sites_row_length, format_phylip_of_snp_sites_row, num_threads);
+	free_output_buffer(&buffer);
+  fclose(fasta_file_pointer);
+}
+
+// Opens filename.phylip and writes the numbers of leaves and snps, so the samples can be written after it
+// in as many goes as needed
+FILE * open_phylip_of_snp_sites(char filename[], int number_of_snps, int number_of_samples, int internal_nodes[])
 {
 	FILE *fasta_file_pointer;
 	int sample_counter;
-	int snp_counter;
 	char * base_filename;
 	
 	base_filename = (char *) calloc(1024,sizeof(char));
 	memcpy(base_filename, filename, 1024*sizeof(char));
 	char extension[8] = {".phylip"};
 	concat_strings_created_with_malloc(base_filename,extension);
-	fasta_file_pointer = fopen(base_filename, "w");
+	fasta_file_pointer = open_output_file(base_filename);
 	
 	int number_of_leaves = number_of_samples;
 	for(sample_counter=0; sample_counter< number_of_samples; sample_counter++)
@@ -49,23 +71,37 @@ void create_phylip_of_snp_sites(char filename[], int number_of_snps, char ** bas
 	}
 	
 	fprintf( fasta_file_pointer, "%d %d\n", number_of_leaves, number_of_snps);
+	free(base_filename);
+	return fasta_file_pointer;
+}
+
+size_t maximum_phylip_of_snp_sites_row_length(void * rows, int row_index)
+{
+	snp_sites_rows * phylip = (snp_sites_rows *) rows;
+	if(phylip->internal_nodes[row_index] == 1)
+	{
+		return 0;
+	}
+	return strlen(phylip->sequence_names[row_index]) + 2 + phylip->number_of_snps;
+}
+
+size_t format_phylip_of_snp_sites_row(void * rows, int row_index, char * destination)
+{
+	snp_sites_rows * phylip = (snp_sites_rows *) rows;
+	size_t length;
 	
-	for(sample_counter=0; sample_counter< number_of_samples; sample_counter++)
+	// sequence_name can be more than 10 (relaxed phylip format) and contain [\w\s]
+	//TODO check for illegal characters [^\w\s]
+	if(phylip->internal_nodes[row_index] == 1)
 	{
-		// sequence_name can be more than 10 (relaxed phylip format) and contain [\w\s]
-		//TODO check for illegal characters [^\w\s]
-		if(internal_nodes[sample_counter] == 1)
-		{
-			continue;
-		}
-		fprintf( fasta_file_pointer, "%s\t", sequence_names[sample_counter]);
-		
-		for(snp_counter=0; snp_counter< number_of_snps; snp_counter++)
-		{
-			fprintf( fasta_file_pointer, "%c", bases_for_snps[snp_counter][sample_counter]);
-		}
-		fprintf( fasta_file_pointer, "\n");
+		return 0;
 	}
-  fclose(fasta_file_pointer);
-	free(base_filename);
+	length = strlen(phylip->sequence_names[row_index]);
+	memcpy(destination, phylip->sequence_names[row_index], length);
+	destination[length++] = '\t';
+	
+	memcpy(destination + length, phylip->bases_for_samples[row_index], phylip->number_of_snps);
+	length += phylip->number_of_snps;
+	destination[length++] = '\n';
+	return length;
 }
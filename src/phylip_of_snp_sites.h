@@ -21,6 +21,21 @@
 #ifndef _PHYLIP_OF_SNP_SITES_
 #define _PHYLIP_OF_SNP_SITES_
 
-void create_phylip_of_snp_sites(char filename[], int number_of_snps, char ** bases_for_snps, char ** sequence_names, int number_of_samples,int internal_nodes[]);
+#include <stddef.h>
+#include <stdio.h>
+
+// One row per sample, written straight from that sample's bases at each snp
+typedef struct snp_sites_rows
+{
+	char ** bases_for_samples;
+	char ** sequence_names;
+	int number_of_snps;
+	int * internal_nodes;
+} snp_sites_rows;
+
+FILE * open_phylip_of_snp_sites(char filename[], int number_of_snps, int number_of_samples, int internal_nodes[]);
+void create_phylip_of_snp_sites(char filename[], int number_of_snps, char ** bases_for_samples, char ** sequence_names, int number_of_samples,int internal_nodes[], int num_threads);
+size_t maximum_phylip_of_snp_sites_row_length(void * rows, int row_index);
+size_t format_phylip_of_snp_sites_row(void * rows, int row_index, char * destination);
 
 #endif
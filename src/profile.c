@@ -0,0 +1,284 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include "profile.h"
+
+// Nothing is recorded unless a profile has been started, so the calls cost a branch each when profiling is off
+char * profile_report_filename = NULL;
+double profile_wall_start;
+double profile_cpu_start;
+profile_phase profile_phases[MAX_NUMBER_OF_PROFILE_PHASES];
+int number_of_profile_phases = 0;
+profile_file profile_files[MAX_NUMBER_OF_PROFILE_FILES];
+int number_of_profile_files = 0;
+profiled_branch * profiled_branches = NULL;
+int number_of_profiled_branches = 0;
+int profiled_branches_capacity = 0;
+pthread_mutex_t profiled_branches_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t profiled_files_lock = PTHREAD_MUTEX_INITIALIZER;
+
+double profile_wall_time()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec/1e9;
+}
+
+// The cpu time of every thread in the process
+double profile_cpu_time()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+	return now.tv_sec + now.tv_nsec/1e9;
+}
+
+void start_profile(char * profile_filename)
+{
+	int i;
+	if(profile_report_filename != NULL)
+	{
+		free(profile_report_filename);
+	}
+	profile_report_filename = strdup(profile_filename);
+	for(i = 0; i < number_of_profile_files; i++)
+	{
+		free(profile_files[i].filename);
+	}
+	for(i = 0; i < number_of_profiled_branches; i++)
+	{
+		free(profiled_branches[i].taxon);
+	}
+	number_of_profile_phases = 0;
+	number_of_profile_files = 0;
+	number_of_profiled_branches = 0;
+	profile_wall_start = profile_wall_time();
+	profile_cpu_start = profile_cpu_time();
+}
+
+int profile_enabled()
+{
+	return (profile_report_filename != NULL) ? 1 : 0;
+}
+
+profile_phase * find_profile_phase(char * phase_name)
+{
+	int i;
+	for(i = 0; i < number_of_profile_phases; i++)
+	{
+		if(strcmp(profile_phases[i].name, phase_name) == 0)
+		{
+			return &profile_phases[i];
+		}
+	}
+	if(number_of_profile_phases == MAX_NUMBER_OF_PROFILE_PHASES)
+	{
+		return NULL;
+	}
+	profile_phase * phase = &profile_phases[number_of_profile_phases];
+	number_of_profile_phases++;
+	memset(phase, 0, sizeof(profile_phase));
+	phase->name = phase_name;
+	return phase;
+}
+
+// Phases are named with string literals and are only started and ended on the main thread
+void start_profile_phase(char * phase_name)
+{
+	if(profile_enabled() == 0)
+	{
+		return;
+	}
+	profile_phase * phase = find_profile_phase(phase_name);
+	if(phase != NULL)
+	{
+		phase->wall_start = profile_wall_time();
+		phase->cpu_start = profile_cpu_time();
+	}
+}
+
+void end_profile_phase(char * phase_name)
+{
+	if(profile_enabled() == 0)
+	{
+		return;
+	}
+	profile_phase * phase = find_profile_phase(phase_name);
+	if(phase != NULL)
+	{
+		phase->wall_seconds += profile_wall_time() - phase->wall_start;
+		phase->cpu_seconds += profile_cpu_time() - phase->cpu_start;
+		phase->count++;
+	}
+}
+
+void record_profile_input_file(char * filename)
+{
+	record_profile_file(filename, 0);
+}
+
+void record_profile_output_file(char * filename)
+{
+	record_profile_file(filename, 1);
+}
+
+// Input files are measured straight away, since some are overwritten later as outputs, and output files
+// when the report is written, once they are complete. The output files of the snp sites are opened on
+// separate threads, so they are added under a lock.
+void record_profile_file(char * filename, int is_output)
+{
+	int i;
+	if(profile_enabled() == 0)
+	{
+		return;
+	}
+	pthread_mutex_lock(&profiled_files_lock);
+	for(i = 0; i < number_of_profile_files; i++)
+	{
+		if(profile_files[i].is_output == is_output && strcmp(profile_files[i].filename, filename) == 0)
+		{
+			pthread_mutex_unlock(&profiled_files_lock);
+			return;
+		}
+	}
+	if(number_of_profile_files < MAX_NUMBER_OF_PROFILE_FILES)
+	{
+		profile_files[number_of_profile_files].filename = strdup(filename);
+		profile_files[number_of_profile_files].is_output = is_output;
+		profile_files[number_of_profile_files].bytes = is_output ? -1 : size_of_profiled_file(filename);
+		number_of_profile_files++;
+	}
+	pthread_mutex_unlock(&profiled_files_lock);
+}
+
+// Branches are scanned on worker threads, so they are added under a lock
+void record_branch_profile(char * taxon, branch_profile * counters)
+{
+	if(profile_enabled() == 0)
+	{
+		return;
+	}
+	pthread_mutex_lock(&profiled_branches_lock);
+	if(number_of_profiled_branches == profiled_branches_capacity)
+	{
+		profiled_branches_capacity = 2*profiled_branches_capacity + 64;
+		profiled_branches = (profiled_branch *) realloc(profiled_branches, profiled_branches_capacity*sizeof(profiled_branch));
+	}
+	profiled_branches[number_of_profiled_branches].taxon = strdup((taxon != NULL) ? taxon : "");
+	profiled_branches[number_of_profiled_branches].counters = *counters;
+	number_of_profiled_branches++;
+	pthread_mutex_unlock(&profiled_branches_lock);
+}
+
+long size_of_profiled_file(char * filename)
+{
+	struct stat file_status;
+	if(stat(filename, &file_status) != 0)
+	{
+		return -1;
+	}
+	return (long) file_status.st_size;
+}
+
+void print_json_string(FILE * file_pointer, char * text)
+{
+	fputc('"', file_pointer);
+	for(; *text != '\0'; text++)
+	{
+		if(*text == '"' || *text == '\\')
+		{
+			fputc('\\', file_pointer);
+			fputc(*text, file_pointer);
+		}
+		else if((unsigned char) *text < 0x20)
+		{
+			fprintf(file_pointer, "\\u%04x", (unsigned char) *text);
+		}
+		else
+		{
+			fputc(*text, file_pointer);
+		}
+	}
+	fputc('"', file_pointer);
+}
+
+// Writes the report as JSON and stops profiling until the next start_profile
+void write_profile_report()
+{
+	int i;
+	if(profile_enabled() == 0)
+	{
+		return;
+	}
+	FILE * report_file_pointer = fopen(profile_report_filename, "w");
+	if(report_file_pointer == NULL)
+	{
+		printf("Cannot write the profile to '%s'\n", profile_report_filename);
+		exit(1);
+	}
+	
+	// Peak resident memory of the whole process, which Linux reports in kilobytes
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	
+	fprintf(report_file_pointer, "{\n  \"wall_seconds\": %.6f,\n  \"cpu_seconds\": %.6f,\n  \"peak_rss_kb\": %ld,\n", profile_wall_time() - profile_wall_start, profile_cpu_time() - profile_cpu_start, (long) usage.ru_maxrss);
+	
+	fprintf(report_file_pointer, "  \"phases\": [");
+	for(i = 0; i < number_of_profile_phases; i++)
+	{
+		fprintf(report_file_pointer, "%s\n    {\"name\": ", (i > 0) ? "," : "");
+		print_json_string(report_file_pointer, profile_phases[i].name);
+		fprintf(report_file_pointer, ", \"count\": %d, \"wall_seconds\": %.6f, \"cpu_seconds\": %.6f}", profile_phases[i].count, profile_phases[i].wall_seconds, profile_phases[i].cpu_seconds);
+	}
+	fprintf(report_file_pointer, "\n  ],\n  \"files\": [");
+	for(i = 0; i < number_of_profile_files; i++)
+	{
+		fprintf(report_file_pointer, "%s\n    {\"filename\": ", (i > 0) ? "," : "");
+		print_json_string(report_file_pointer, profile_files[i].filename);
+		fprintf(report_file_pointer, ", \"%s\": %ld}", profile_files[i].is_output ? "bytes_written" : "bytes_read", profile_files[i].is_output ? size_of_profiled_file(profile_files[i].filename) : profile_files[i].bytes);
+		free(profile_files[i].filename);
+	}
+	fprintf(report_file_pointer, "\n  ],\n  \"branches\": [");
+	for(i = 0; i < number_of_profiled_branches; i++)
+	{
+		branch_profile * counters = &profiled_branches[i].counters;
+		fprintf(report_file_pointer, "%s\n    {\"taxon\": ", (i > 0) ? "," : "");
+		print_json_string(report_file_pointer, profiled_branches[i].taxon);
+		fprintf(report_file_pointer, ", \"snps\": %d, \"passes\": %d, \"windows\": %d, \"candidate_blocks\": %d, \"trimming_steps\": %d, \"accepted_blocks\": %d}",
+			counters->number_of_snps, counters->number_of_passes, counters->number_of_windows, counters->number_of_candidate_blocks, counters->number_of_trimming_steps, counters->number_of_accepted_blocks);
+		free(profiled_branches[i].taxon);
+	}
+	fprintf(report_file_pointer, "\n  ]\n}\n");
+	fclose(report_file_pointer);
+	
+	free(profiled_branches);
+	profiled_branches = NULL;
+	profiled_branches_capacity = 0;
+	number_of_profiled_branches = 0;
+	number_of_profile_phases = 0;
+	number_of_profile_files = 0;
+	free(profile_report_filename);
+	profile_report_filename = NULL;
+}
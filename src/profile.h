@@ -0,0 +1,76 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+// The work done scanning one branch for recombinations
+typedef struct branch_profile
+{
+	int number_of_snps;
+	int number_of_passes;
+	int number_of_windows;
+	int number_of_candidate_blocks;
+	int number_of_trimming_steps;
+	int number_of_accepted_blocks;
+} branch_profile;
+
+// The time spent in a phase, added up over every time it ran
+typedef struct profile_phase
+{
+	char * name;
+	int count;
+	double wall_seconds;
+	double cpu_seconds;
+	double wall_start;
+	double cpu_start;
+} profile_phase;
+
+typedef struct profile_file
+{
+	char * filename;
+	int is_output;
+	long bytes;
+} profile_file;
+
+typedef struct profiled_branch
+{
+	char * taxon;
+	branch_profile counters;
+} profiled_branch;
+
+#define MAX_NUMBER_OF_PROFILE_PHASES 64
+#define MAX_NUMBER_OF_PROFILE_FILES 128
+
+void start_profile(char * profile_filename);
+int profile_enabled();
+void start_profile_phase(char * phase_name);
+void end_profile_phase(char * phase_name);
+void record_profile_input_file(char * filename);
+void record_profile_output_file(char * filename);
+void record_profile_file(char * filename, int is_output);
+void record_branch_profile(char * taxon, branch_profile * counters);
+void write_profile_report();
+void print_json_string(FILE * file_pointer, char * text);
+long size_of_profiled_file(char * filename);
+double profile_wall_time();
+double profile_cpu_time();
+profile_phase * find_profile_phase(char * phase_name);
+
+#endif
@@ -0,0 +1,177 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sample_name_pool.h"
+
+// Every sample name is kept once, whether it came from the alignment, the vcf or the tree, and its id is the
+// order it was first seen in. Names are only added while the inputs are read, before any threads start.
+char ** pooled_sample_names = NULL;
+int number_of_pooled_sample_names = 0;
+int capacity_of_pooled_sample_names = 0;
+sample_name_pool_block * sample_name_pool_blocks = NULL;
+
+// Open addressing table from a name to its id, kept at most half full
+int * sample_name_table = NULL;
+int sample_name_table_size = 0;
+
+int intern_sample_name(char * sample_name)
+{
+	int sample_name_id = find_sample_name_id(sample_name);
+	if(sample_name_id >= 0)
+	{
+		return sample_name_id;
+	}
+	
+	if(2*(number_of_pooled_sample_names+1) > sample_name_table_size)
+	{
+		grow_sample_name_table();
+	}
+	if(number_of_pooled_sample_names == capacity_of_pooled_sample_names)
+	{
+		capacity_of_pooled_sample_names = (capacity_of_pooled_sample_names == 0) ? 64 : capacity_of_pooled_sample_names*2;
+		pooled_sample_names = (char **) realloc(pooled_sample_names, capacity_of_pooled_sample_names*sizeof(char *));
+	}
+	sample_name_id = number_of_pooled_sample_names;
+	pooled_sample_names[sample_name_id] = copy_into_sample_name_pool(sample_name, strlen(sample_name));
+	number_of_pooled_sample_names++;
+	
+	unsigned int i = hash_sample_name(sample_name) & (sample_name_table_size - 1);
+	while(sample_name_table[i] != -1)
+	{
+		i = (i + 1) & (sample_name_table_size - 1);
+	}
+	sample_name_table[i] = sample_name_id;
+	return sample_name_id;
+}
+
+int find_sample_name_id(char * sample_name)
+{
+	if(sample_name_table == NULL)
+	{
+		return -1;
+	}
+	unsigned int i = hash_sample_name(sample_name) & (sample_name_table_size - 1);
+	while(sample_name_table[i] != -1)
+	{
+		if(strcmp(sample_name, pooled_sample_names[sample_name_table[i]]) == 0)
+		{
+			return sample_name_table[i];
+		}
+		i = (i + 1) & (sample_name_table_size - 1);
+	}
+	return -1;
+}
+
+char * get_pooled_sample_name(int sample_name_id)
+{
+	if(sample_name_id < 0 || sample_name_id >= number_of_pooled_sample_names)
+	{
+		return NULL;
+	}
+	return pooled_sample_names[sample_name_id];
+}
+
+// The copy which every module shares, so the name can be kept without copying it again
+char * pool_sample_name(char * sample_name)
+{
+	int sample_name_id = intern_sample_name(sample_name);
+	return pooled_sample_names[sample_name_id];
+}
+
+int get_number_of_pooled_sample_names()
+{
+	return number_of_pooled_sample_names;
+}
+
+unsigned int hash_sample_name(char * sample_name)
+{
+	// FNV-1a
+	unsigned int hash = 2166136261u;
+	while(*sample_name != '\0')
+	{
+		hash ^= (unsigned char) *sample_name;
+		hash *= 16777619u;
+		sample_name++;
+	}
+	return hash;
+}
+
+// The table size is a power of two, doubled and refilled from the ids
+void grow_sample_name_table()
+{
+	int i;
+	sample_name_table_size = (sample_name_table_size == 0) ? 128 : sample_name_table_size*2;
+	free(sample_name_table);
+	sample_name_table = (int *) malloc(sample_name_table_size*sizeof(int));
+	for(i = 0; i < sample_name_table_size; i++)
+	{
+		sample_name_table[i] = -1;
+	}
+	for(i = 0; i < number_of_pooled_sample_names; i++)
+	{
+		unsigned int hash_index = hash_sample_name(pooled_sample_names[i]) & (sample_name_table_size - 1);
+		while(sample_name_table[hash_index] != -1)
+		{
+			hash_index = (hash_index + 1) & (sample_name_table_size - 1);
+		}
+		sample_name_table[hash_index] = i;
+	}
+}
+
+// A name longer than a block gets a block of its own
+char * copy_into_sample_name_pool(char * sample_name, size_t length_of_name)
+{
+	sample_name_pool_block * block = sample_name_pool_blocks;
+	if(block == NULL || block->size - block->used < length_of_name + 1)
+	{
+		block = (sample_name_pool_block *) malloc(sizeof(sample_name_pool_block));
+		block->size = (length_of_name + 1 > SAMPLE_NAME_POOL_BLOCK_SIZE) ? length_of_name + 1 : SAMPLE_NAME_POOL_BLOCK_SIZE;
+		block->names = (char *) malloc(block->size);
+		block->used = 0;
+		block->next = sample_name_pool_blocks;
+		sample_name_pool_blocks = block;
+	}
+	char * pooled_name = block->names + block->used;
+	memcpy(pooled_name, sample_name, length_of_name);
+	pooled_name[length_of_name] = '\0';
+	block->used += length_of_name + 1;
+	return pooled_name;
+}
+
+// Every borrowed name is invalid afterwards
+void free_sample_name_pool()
+{
+	while(sample_name_pool_blocks != NULL)
+	{
+		sample_name_pool_block * next_block = sample_name_pool_blocks->next;
+		free(sample_name_pool_blocks->names);
+		free(sample_name_pool_blocks);
+		sample_name_pool_blocks = next_block;
+	}
+	free(pooled_sample_names);
+	free(sample_name_table);
+	pooled_sample_names = NULL;
+	sample_name_table = NULL;
+	number_of_pooled_sample_names = 0;
+	capacity_of_pooled_sample_names = 0;
+	sample_name_table_size = 0;
+}
@@ -0,0 +1,43 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _SAMPLE_NAME_POOL_H_
+#define _SAMPLE_NAME_POOL_H_
+
+// A run of names packed one after another. The blocks never move, so the names can be borrowed for as long as the pool lasts.
+typedef struct sample_name_pool_block
+{
+	char * names;
+	size_t size;
+	size_t used;
+	struct sample_name_pool_block * next;
+} sample_name_pool_block;
+
+int intern_sample_name(char * sample_name);
+int find_sample_name_id(char * sample_name);
+char * get_pooled_sample_name(int sample_name_id);
+char * pool_sample_name(char * sample_name);
+int get_number_of_pooled_sample_names();
+unsigned int hash_sample_name(char * sample_name);
+void grow_sample_name_table();
+char * copy_into_sample_name_pool(char * sample_name, size_t length_of_name);
+void free_sample_name_pool();
+
+#define SAMPLE_NAME_POOL_BLOCK_SIZE 65536
+#endif
@@ -1,133 +1,168 @@
-#define __SEQUTIL_C__
-
-#include "seqUtil.h"
-#include "string_cat.h"
-
-/*
- *  Yu-Wei Wu  http://yuweibioinfo.blogspot.com/2008/10/newick-tree-parser-in-c-make-use-of.html
- *  Copyright (C) 2011  Yu-Wei Wu
- *  
- *  This program is free software; you can redistribute it and/or
- *  modify it under the terms of the GNU General Public License
- *  as published by the Free Software Foundation; either version 2
- *  of the License, or (at your option) any later version.
- *  
- *  This program is distributed in the hope that it will be useful,
- *  but WITHOUT ANY WARRANTY; without even the implied warranty of
- *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
- *  GNU General Public License for more details.
- *  
- *  You should have received a copy of the GNU General Public License
- *  along with this program; if not, write to the Free Software
- *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
- */
-
-typedef struct seqMem
-{
-	void *pos;
-	struct seqMem *next;
-} seqMem;
-
-seqMem *start;
-seqMem *current;
-
-void seqMemInit()
-{
-	start = NULL;
-}
-
-void* seqMalloc(int size)
-{
-	if (start == NULL)
-	{
-		start = malloc(sizeof(seqMem));
-		memset(start, '\0', sizeof(seqMem));
-		current = start;
-	}
-	else
-	{
-		current->next = malloc(sizeof(seqMem));
-		memset(current->next, '\0', sizeof(seqMem));
-		current = current->next;
-	}
-	current->pos = malloc(size);
-	memset(current->pos, '\0', size);
-	return(current->pos);
-}
-
-void seqFreeAll()
-{
-	while (start != NULL)
-	{
-		current = start->next;
-		free(start->pos);
-		free(start);
-		start = current;
-	}
-
-	start = NULL;
-}
-
-void seqFree(void* pos)
-{
-	seqMem *node, *prenode;
-	node = start;
-	prenode = start;
-	while (node != NULL)
-	{
-		if (node->pos == pos)
-		{
-			free(node->pos);
-			if (node == start)
-			{
-				start = node->next;
-			}
-			else if (node->next == NULL)
-			{
-				current = prenode;
-				prenode->next = NULL;
-			}
-			else
-			{
-				prenode->next = node->next;
-			}
-			free(node);
-			break;
-		}
-
-		prenode = node;
-		node = node->next;
-	}
-}
-
-void inputString(char *input, char **ppcStr, int *iLen, int *iMaxLen)
-{
-	int inputLen;
-	char *temp;
-	inputLen = size_of_string(input);
-	if (inputLen == 0)
-	{
-		return;
-	}
-	while (*iMaxLen < (*iLen + inputLen) + 1)
-	{
-		*iMaxLen = *iMaxLen + APPEND_LEN;
-	}
-	temp = seqMalloc(*iMaxLen);
-	if (*ppcStr == NULL)
-	{
-		memcpy(temp, input, inputLen);
-	}
-	else
-	{
-		memcpy(temp, *ppcStr, *iLen);
-		strcat(temp, input);
-	}
-	*iLen = *iLen + inputLen;
-	if (*ppcStr != NULL)
-	{
-		seqFree(*ppcStr);
-	}
-	*ppcStr = temp;
-}
-
+#define __SEQUTIL_C__
+
+#include "seqUtil.h"
+#include "string_cat.h"
+
+/*
+ *  Yu-Wei Wu  http://yuweibioinfo.blogspot.com/2008/10/newick-tree-parser-in-c-make-use-of.html
+ *  Copyright (C) 2011  Yu-Wei Wu
+ *  
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *  
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *  
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+// The tree and its taxon names are allocated from one region, which is released all at once by seqFreeAll
+seq_arena tree_arena;
+
+void initialise_seq_arena(seq_arena * arena)
+{
+	arena->first = NULL;
+	arena->current = NULL;
+	arena->last_allocation = NULL;
+}
+
+seq_arena_chunk * new_seq_arena_chunk(size_t size)
+{
+	seq_arena_chunk * chunk = (seq_arena_chunk *) malloc(sizeof(seq_arena_chunk) + size);
+	if(chunk == NULL)
+	{
+		printf("Couldnt allocate %zu bytes of memory\n", size);
+		exit(1);
+	}
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+	return chunk;
+}
+
+// Bumps a pointer through the current chunk, moving on to the next chunk when it is full. The memory is zeroed like calloc.
+void* seq_arena_malloc(seq_arena * arena, size_t size)
+{
+	size_t aligned_size = (size + SEQ_ARENA_ALIGNMENT - 1) & ~((size_t) SEQ_ARENA_ALIGNMENT - 1);
+	if(arena->current == NULL || arena->current->used + aligned_size > arena->current->size)
+	{
+		seq_arena_chunk * next_chunk = (arena->current == NULL) ? arena->first : arena->current->next;
+		if(next_chunk == NULL || next_chunk->size < aligned_size)
+		{
+			// Chunks left over from a rewind are reused if they are big enough, otherwise a new one goes in front of them
+			next_chunk = new_seq_arena_chunk(aligned_size > SEQ_ARENA_CHUNK_SIZE ? aligned_size : SEQ_ARENA_CHUNK_SIZE);
+			if(arena->current == NULL)
+			{
+				next_chunk->next = arena->first;
+				arena->first = next_chunk;
+			}
+			else
+			{
+				next_chunk->next = arena->current->next;
+				arena->current->next = next_chunk;
+			}
+		}
+		next_chunk->used = 0;
+		arena->current = next_chunk;
+	}
+	
+	char * allocation = arena->current->data + arena->current->used;
+	arena->current->used += aligned_size;
+	arena->last_allocation = allocation;
+	memset(allocation, '\0', size);
+	return allocation;
+}
+
+// Everything allocated after the mark is given back by seq_arena_rewind
+seq_arena_mark seq_arena_get_mark(seq_arena * arena)
+{
+	seq_arena_mark mark;
+	mark.chunk = arena->current;
+	mark.used = (arena->current == NULL) ? 0 : arena->current->used;
+	return mark;
+}
+
+void seq_arena_rewind(seq_arena * arena, seq_arena_mark mark)
+{
+	arena->current = mark.chunk;
+	if(mark.chunk != NULL)
+	{
+		mark.chunk->used = mark.used;
+	}
+	arena->last_allocation = NULL;
+}
+
+void free_seq_arena(seq_arena * arena)
+{
+	seq_arena_chunk * chunk = arena->first;
+	while(chunk != NULL)
+	{
+		seq_arena_chunk * next_chunk = chunk->next;
+		free(chunk);
+		chunk = next_chunk;
+	}
+	initialise_seq_arena(arena);
+}
+
+void seqMemInit()
+{
+	initialise_seq_arena(&tree_arena);
+}
+
+void* seqMalloc(int size)
+{
+	return seq_arena_malloc(&tree_arena, size);
+}
+
+void seqFreeAll()
+{
+	free_seq_arena(&tree_arena);
+}
+
+// Memory in the arena is only given back by seqFreeAll, apart from the most recent allocation which can be reused straight away
+void seqFree(void* pos)
+{
+	if(pos != NULL && pos == tree_arena.last_allocation)
+	{
+		tree_arena.current->used = (char *) pos - tree_arena.current->data;
+		tree_arena.last_allocation = NULL;
+	}
+}
+
+void inputString(char *input, char **ppcStr, int *iLen, int *iMaxLen)
+{
+	int inputLen;
+	char *temp;
+	inputLen = size_of_string(input);
+	if (inputLen == 0)
+	{
+		return;
+	}
+	while (*iMaxLen < (*iLen + inputLen) + 1)
+	{
+		*iMaxLen = *iMaxLen + APPEND_LEN;
+	}
+	temp = seqMalloc(*iMaxLen);
+	if (*ppcStr == NULL)
+	{
+		memcpy(temp, input, inputLen);
+	}
+	else
+	{
+		memcpy(temp, *ppcStr, *iLen);
+		strcat(temp, input);
+	}
+	*iLen = *iLen + inputLen;
+	if (*ppcStr != NULL)
+	{
+		seqFree(*ppcStr);
+	}
+	*ppcStr = temp;
+}
+
@@ -0,0 +1,156 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "sequence_differences.h"
+
+// Copies the differences, which have to be sorted by position already
+void initialise_sequence_differences(sequence_differences * differences, int * positions, char * bases, int number_of_differences)
+{
+	differences->positions = NULL;
+	differences->bases = NULL;
+	differences->number_of_differences = number_of_differences;
+	differences->capacity = number_of_differences;
+	if(number_of_differences > 0)
+	{
+		differences->positions = (int *) malloc(number_of_differences*sizeof(int));
+		differences->bases = (char *) malloc(number_of_differences*sizeof(char));
+		memcpy(differences->positions, positions, number_of_differences*sizeof(int));
+		memcpy(differences->bases, bases, number_of_differences*sizeof(char));
+	}
+}
+
+// Index of the first difference at or after the position
+int find_sequence_difference_index(sequence_differences * differences, int position)
+{
+	int low = 0;
+	int high = differences->number_of_differences;
+	while(low < high)
+	{
+		int middle = low + (high - low)/2;
+		if(differences->positions[middle] < position)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+	return low;
+}
+
+// 1 with the base if the sequence differs from its parent at the position, otherwise 0
+int find_sequence_difference(sequence_differences * differences, int position, char * base)
+{
+	int index = find_sequence_difference_index(differences, position);
+	if(index < differences->number_of_differences && differences->positions[index] == position)
+	{
+		*base = differences->bases[index];
+		return 1;
+	}
+	return 0;
+}
+
+void set_sequence_difference(sequence_differences * differences, int position, char base)
+{
+	int index = find_sequence_difference_index(differences, position);
+	if(index < differences->number_of_differences && differences->positions[index] == position)
+	{
+		differences->bases[index] = base;
+		return;
+	}
+	
+	if(differences->number_of_differences == differences->capacity)
+	{
+		differences->capacity = differences->capacity > 0 ? 2*differences->capacity : 4;
+		differences->positions = (int *) realloc(differences->positions, differences->capacity*sizeof(int));
+		differences->bases = (char *) realloc(differences->bases, differences->capacity*sizeof(char));
+	}
+	memmove(differences->positions + index + 1, differences->positions + index, (differences->number_of_differences - index)*sizeof(int));
+	memmove(differences->bases + index + 1, differences->bases + index, (differences->number_of_differences - index)*sizeof(char));
+	differences->positions[index] = position;
+	differences->bases[index] = base;
+	differences->number_of_differences++;
+}
+
+void remove_sequence_difference(sequence_differences * differences, int position)
+{
+	int index = find_sequence_difference_index(differences, position);
+	if(index >= differences->number_of_differences || differences->positions[index] != position)
+	{
+		return;
+	}
+	memmove(differences->positions + index, differences->positions + index + 1, (differences->number_of_differences - index - 1)*sizeof(int));
+	memmove(differences->bases + index, differences->bases + index + 1, (differences->number_of_differences - index - 1)*sizeof(char));
+	differences->number_of_differences--;
+}
+
+// Many changes at once, sorted by position with no position twice. A change either sets the difference at its
+// position to its base or, if it isnt kept, removes it. The two lists are merged once rather than moved for each change.
+void update_sequence_differences(sequence_differences * differences, int * positions, char * bases, int * keep, int number_of_updates)
+{
+	int i = 0, j = 0, number_merged = 0;
+	int capacity = differences->number_of_differences + number_of_updates;
+	if(number_of_updates == 0)
+	{
+		return;
+	}
+	int * merged_positions = (int *) malloc((capacity+1)*sizeof(int));
+	char * merged_bases = (char *) malloc((capacity+1)*sizeof(char));
+	while(i < differences->number_of_differences || j < number_of_updates)
+	{
+		if(j == number_of_updates || (i < differences->number_of_differences && differences->positions[i] < positions[j]))
+		{
+			merged_positions[number_merged] = differences->positions[i];
+			merged_bases[number_merged] = differences->bases[i];
+			number_merged++;
+			i++;
+			continue;
+		}
+		if(i < differences->number_of_differences && differences->positions[i] == positions[j])
+		{
+			i++;
+		}
+		if(keep[j])
+		{
+			merged_positions[number_merged] = positions[j];
+			merged_bases[number_merged] = bases[j];
+			number_merged++;
+		}
+		j++;
+	}
+	free(differences->positions);
+	free(differences->bases);
+	differences->positions = merged_positions;
+	differences->bases = merged_bases;
+	differences->number_of_differences = number_merged;
+	differences->capacity = capacity+1;
+}
+
+void free_sequence_differences(sequence_differences * differences)
+{
+	free(differences->positions);
+	free(differences->bases);
+	differences->positions = NULL;
+	differences->bases = NULL;
+	differences->number_of_differences = 0;
+	differences->capacity = 0;
+}
@@ -0,0 +1,40 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _SEQUENCE_DIFFERENCES_H_
+#define _SEQUENCE_DIFFERENCES_H_
+
+// The bases of a sequence where it differs from the sequence of its parent, sorted by position
+typedef struct sequence_differences
+{
+	int * positions;
+	char * bases;
+	int number_of_differences;
+	int capacity;
+} sequence_differences;
+
+void initialise_sequence_differences(sequence_differences * differences, int * positions, char * bases, int number_of_differences);
+int find_sequence_difference_index(sequence_differences * differences, int position);
+int find_sequence_difference(sequence_differences * differences, int position, char * base);
+void set_sequence_difference(sequence_differences * differences, int position, char base);
+void remove_sequence_difference(sequence_differences * differences, int position);
+void update_sequence_differences(sequence_differences * differences, int * positions, char * bases, int * keep, int number_of_updates);
+void free_sequence_differences(sequence_differences * differences);
+
+#endif
@@ -0,0 +1,262 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include "snp_detection.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define X86_SNP_KERNELS
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__) && defined(__ARM_NEON)
+#define NEON_SNP_KERNELS
+#include <arm_neon.h>
+#endif
+
+mark_snps_kernel selected_mark_snps_kernel = NULL;
+
+int mark_snps(char reference_sequence[], char * sequence, int length_to_compare, int exclude_gaps)
+{
+	if(selected_mark_snps_kernel == NULL)
+	{
+		selected_mark_snps_kernel = select_mark_snps_kernel();
+	}
+	return selected_mark_snps_kernel(reference_sequence, sequence, length_to_compare, exclude_gaps);
+}
+
+// Pick the widest kernel the cpu running the program supports
+mark_snps_kernel select_mark_snps_kernel()
+{
+#ifdef X86_SNP_KERNELS
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+	{
+		return mark_snps_avx2;
+	}
+	if(__builtin_cpu_supports("sse2"))
+	{
+		return mark_snps_sse2;
+	}
+#endif
+#ifdef NEON_SNP_KERNELS
+	return mark_snps_neon;
+#endif
+	return mark_snps_scalar;
+}
+
+int mark_snps_scalar(char reference_sequence[], char * sequence, int length_to_compare, int exclude_gaps)
+{
+  int i;
+  int number_of_snps = 0;
+  for(i = 0; i < length_to_compare; i++)
+  {
+
+    if(exclude_gaps)
+    {
+      // If there is an indel in the reference sequence, replace with the first proper base you find
+      if((reference_sequence[i] == '-' && sequence[i] != '-' ) || (toupper(reference_sequence[i]) == 'N' && sequence[i] != 'N' ))
+      {
+        reference_sequence[i] = toupper(sequence[i]);
+      }
+
+      if(reference_sequence[i] != '*' && sequence[i] != '-' && toupper(sequence[i]) != 'N' && reference_sequence[i] != toupper(sequence[i]))
+      {
+        reference_sequence[i] = '*';
+        number_of_snps++;
+      }
+    }
+    else
+    {
+
+			char input_base = toupper(sequence[i]);
+			if(input_base == 'N')
+			{
+				input_base = '-';
+			}
+
+      if(reference_sequence[i] != '*' && reference_sequence[i] != input_base)
+      {
+       reference_sequence[i] = '*';
+       number_of_snps++;
+      }
+    }
+  }
+  return number_of_snps;
+}
+
+#ifdef X86_SNP_KERNELS
+
+// Upper case letters without going through the locale, which is what toupper does in the C locale
+__attribute__((target("sse2")))
+static inline __m128i upper_case_sse2(__m128i bases)
+{
+	__m128i is_lower_case = _mm_and_si128(_mm_cmpgt_epi8(bases, _mm_set1_epi8('a'-1)), _mm_cmplt_epi8(bases, _mm_set1_epi8('z'+1)));
+	return _mm_sub_epi8(bases, _mm_and_si128(is_lower_case, _mm_set1_epi8(0x20)));
+}
+
+__attribute__((target("sse2")))
+static inline __m128i select_sse2(__m128i mask, __m128i if_set, __m128i if_not_set)
+{
+	return _mm_or_si128(_mm_and_si128(mask, if_set), _mm_andnot_si128(mask, if_not_set));
+}
+
+__attribute__((target("sse2")))
+int mark_snps_sse2(char reference_sequence[], char * sequence, int length_to_compare, int exclude_gaps)
+{
+	int i = 0;
+	int number_of_snps = 0;
+	__m128i snp_marker = _mm_set1_epi8('*');
+	__m128i gap = _mm_set1_epi8('-');
+	__m128i unknown = _mm_set1_epi8('N');
+	for(; i + 16 <= length_to_compare; i += 16)
+	{
+		__m128i reference_bases = _mm_loadu_si128((__m128i *) (reference_sequence + i));
+		__m128i bases = _mm_loadu_si128((__m128i *) (sequence + i));
+		__m128i upper_case_bases = upper_case_sse2(bases);
+		__m128i new_snps;
+		if(exclude_gaps)
+		{
+			__m128i replace_reference = _mm_or_si128(_mm_andnot_si128(_mm_cmpeq_epi8(bases, gap), _mm_cmpeq_epi8(reference_bases, gap)),
+			                                         _mm_andnot_si128(_mm_cmpeq_epi8(bases, unknown), _mm_cmpeq_epi8(upper_case_sse2(reference_bases), unknown)));
+			reference_bases = select_sse2(replace_reference, upper_case_bases, reference_bases);
+			// toupper of a negative char is out of the range of a char, so the scalar version never finds those bases equal
+			__m128i same_base = _mm_andnot_si128(_mm_cmplt_epi8(bases, _mm_setzero_si128()), _mm_cmpeq_epi8(reference_bases, upper_case_bases));
+			new_snps = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(reference_bases, snp_marker), _mm_cmpeq_epi8(bases, gap)),
+			                        _mm_or_si128(_mm_cmpeq_epi8(upper_case_bases, unknown), same_base));
+		}
+		else
+		{
+			__m128i input_bases = select_sse2(_mm_cmpeq_epi8(upper_case_bases, unknown), gap, upper_case_bases);
+			new_snps = _mm_or_si128(_mm_cmpeq_epi8(reference_bases, snp_marker), _mm_cmpeq_epi8(reference_bases, input_bases));
+		}
+		new_snps = _mm_andnot_si128(new_snps, _mm_set1_epi8(-1));
+		_mm_storeu_si128((__m128i *) (reference_sequence + i), select_sse2(new_snps, snp_marker, reference_bases));
+		number_of_snps += __builtin_popcount(_mm_movemask_epi8(new_snps));
+	}
+	return number_of_snps + mark_snps_scalar(reference_sequence + i, sequence + i, length_to_compare - i, exclude_gaps);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i upper_case_avx2(__m256i bases)
+{
+	__m256i is_lower_case = _mm256_and_si256(_mm256_cmpgt_epi8(bases, _mm256_set1_epi8('a'-1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z'+1), bases));
+	return _mm256_sub_epi8(bases, _mm256_and_si256(is_lower_case, _mm256_set1_epi8(0x20)));
+}
+
+__attribute__((target("avx2")))
+int mark_snps_avx2(char reference_sequence[], char * sequence, int length_to_compare, int exclude_gaps)
+{
+	int i = 0;
+	int number_of_snps = 0;
+	__m256i snp_marker = _mm256_set1_epi8('*');
+	__m256i gap = _mm256_set1_epi8('-');
+	__m256i unknown = _mm256_set1_epi8('N');
+	for(; i + 32 <= length_to_compare; i += 32)
+	{
+		__m256i reference_bases = _mm256_loadu_si256((__m256i *) (reference_sequence + i));
+		__m256i bases = _mm256_loadu_si256((__m256i *) (sequence + i));
+		__m256i upper_case_bases = upper_case_avx2(bases);
+		__m256i new_snps;
+		if(exclude_gaps)
+		{
+			__m256i replace_reference = _mm256_or_si256(_mm256_andnot_si256(_mm256_cmpeq_epi8(bases, gap), _mm256_cmpeq_epi8(reference_bases, gap)),
+			                                            _mm256_andnot_si256(_mm256_cmpeq_epi8(bases, unknown), _mm256_cmpeq_epi8(upper_case_avx2(reference_bases), unknown)));
+			reference_bases = _mm256_blendv_epi8(reference_bases, upper_case_bases, replace_reference);
+			__m256i same_base = _mm256_andnot_si256(_mm256_cmpgt_epi8(_mm256_setzero_si256(), bases), _mm256_cmpeq_epi8(reference_bases, upper_case_bases));
+			new_snps = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(reference_bases, snp_marker), _mm256_cmpeq_epi8(bases, gap)),
+			                           _mm256_or_si256(_mm256_cmpeq_epi8(upper_case_bases, unknown), same_base));
+		}
+		else
+		{
+			__m256i input_bases = _mm256_blendv_epi8(upper_case_bases, gap, _mm256_cmpeq_epi8(upper_case_bases, unknown));
+			new_snps = _mm256_or_si256(_mm256_cmpeq_epi8(reference_bases, snp_marker), _mm256_cmpeq_epi8(reference_bases, input_bases));
+		}
+		new_snps = _mm256_andnot_si256(new_snps, _mm256_set1_epi8(-1));
+		_mm256_storeu_si256((__m256i *) (reference_sequence + i), _mm256_blendv_epi8(reference_bases, snp_marker, new_snps));
+		number_of_snps += __builtin_popcount((unsigned int) _mm256_movemask_epi8(new_snps));
+	}
+	return number_of_snps + mark_snps_sse2(reference_sequence + i, sequence + i, length_to_compare - i, exclude_gaps);
+}
+
+#else
+
+int mark_snps_sse2(char reference_sequence[], char * sequence, int length_to_compare, int exclude_gaps)
+{
+	return mark_snps_scalar(reference_sequence, sequence, length_to_compare, exclude_gaps);
+}
+
+int mark_snps_avx2(char reference_sequence[], char * sequence, int length_to_compare, int exclude_gaps)
+{
+	return mark_snps_scalar(reference_sequence, sequence, length_to_compare, exclude_gaps);
+}
+
+#endif
+
+#ifdef NEON_SNP_KERNELS
+
+static inline uint8x16_t upper_case_neon(uint8x16_t bases)
+{
+	uint8x16_t is_lower_case = vandq_u8(vcgeq_u8(bases, vdupq_n_u8('a')), vcleq_u8(bases, vdupq_n_u8('z')));
+	return vsubq_u8(bases, vandq_u8(is_lower_case, vdupq_n_u8(0x20)));
+}
+
+int mark_snps_neon(char reference_sequence[], char * sequence, int length_to_compare, int exclude_gaps)
+{
+	int i = 0;
+	int number_of_snps = 0;
+	uint8x16_t snp_marker = vdupq_n_u8('*');
+	uint8x16_t gap = vdupq_n_u8('-');
+	uint8x16_t unknown = vdupq_n_u8('N');
+	for(; i + 16 <= length_to_compare; i += 16)
+	{
+		uint8x16_t reference_bases = vld1q_u8((uint8_t *) (reference_sequence + i));
+		uint8x16_t bases = vld1q_u8((uint8_t *) (sequence + i));
+		uint8x16_t upper_case_bases = upper_case_neon(bases);
+		uint8x16_t new_snps;
+		if(exclude_gaps)
+		{
+			uint8x16_t replace_reference = vorrq_u8(vbicq_u8(vceqq_u8(reference_bases, gap), vceqq_u8(bases, gap)),
+			                                        vbicq_u8(vceqq_u8(upper_case_neon(reference_bases), unknown), vceqq_u8(bases, unknown)));
+			reference_bases = vbslq_u8(replace_reference, upper_case_bases, reference_bases);
+			new_snps = vorrq_u8(vorrq_u8(vceqq_u8(reference_bases, snp_marker), vceqq_u8(bases, gap)),
+			                    vorrq_u8(vceqq_u8(upper_case_bases, unknown), vceqq_u8(reference_bases, upper_case_bases)));
+		}
+		else
+		{
+			uint8x16_t input_bases = vbslq_u8(vceqq_u8(upper_case_bases, unknown), gap, upper_case_bases);
+			new_snps = vorrq_u8(vceqq_u8(reference_bases, snp_marker), vceqq_u8(reference_bases, input_bases));
+		}
+		new_snps = vmvnq_u8(new_snps);
+		vst1q_u8((uint8_t *) (reference_sequence + i), vbslq_u8(new_snps, snp_marker, reference_bases));
+		number_of_snps += vaddvq_u8(vandq_u8(new_snps, vdupq_n_u8(1)));
+	}
+	return number_of_snps + mark_snps_scalar(reference_sequence + i, sequence + i, length_to_compare - i, exclude_gaps);
+}
+
+#else
+
+int mark_snps_neon(char reference_sequence[], char * sequence, int length_to_compare, int exclude_gaps)
+{
+	return mark_snps_scalar(reference_sequence, sequence, length_to_compare, exclude_gaps);
+}
+
+#endif
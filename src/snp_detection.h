@@ -0,0 +1,34 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _SNP_DETECTION_H_
+#define _SNP_DETECTION_H_
+
+// Compares a sequence against the reference, marking the columns which differ with a * and returning
+// how many new snps were found. The vector versions give exactly the same result as the scalar one.
+typedef int (*mark_snps_kernel)(char reference_sequence[], char * sequence, int length_to_compare, int exclude_gaps);
+
+int mark_snps(char reference_sequence[], char * sequence, int length_to_compare, int exclude_gaps);
+mark_snps_kernel select_mark_snps_kernel();
+int mark_snps_scalar(char reference_sequence[], char * sequence, int length_to_compare, int exclude_gaps);
+int mark_snps_sse2(char reference_sequence[], char * sequence, int length_to_compare, int exclude_gaps);
+int mark_snps_avx2(char reference_sequence[], char * sequence, int length_to_compare, int exclude_gaps);
+int mark_snps_neon(char reference_sequence[], char * sequence, int length_to_compare, int exclude_gaps);
+
+#endif
@@ -25,7 +25,7 @@
 
 // Most of the methods in this file look the same, so should be DRYed out.
 
-int advance_window_start_to_next_snp_with_start_end_index(int window_start_coordinate, int * snp_locations, char * child_sequence, int number_of_branch_snps, int start_index,int end_index)
+int advance_window_start_to_next_snp_with_start_end_index(int window_start_coordinate, int * snp_locations, const char * child_sequence, int number_of_branch_snps, int start_index,int end_index)
 {
 	int i;
   start_index = find_starting_index( window_start_coordinate, snp_locations,start_index, end_index);
@@ -47,7 +47,7 @@ int advance_window_start_to_next_snp_with_start_end_index(int window_start_coord
 	return window_start_coordinate;
 }
 
-int advance_window_start_to_next_snp(int window_start_coordinate, int * snp_locations, char * child_sequence, int number_of_branch_snps)
+int advance_window_start_to_next_snp(int window_start_coordinate, int * snp_locations, const char * child_sequence, int number_of_branch_snps)
 {
 	return advance_window_start_to_next_snp_with_start_end_index(window_start_coordinate,snp_locations, child_sequence, number_of_branch_snps, 0,number_of_branch_snps);
 }
@@ -96,7 +96,88 @@ int find_starting_index(int window_start_coordinate, int * snp_locations, int st
 	return find_starting_index(window_start_coordinate, snp_locations, start_index, end_index);
 }
 
-int rewind_window_end_to_last_snp_with_start_end_index(int window_end_coordinate, int * snp_locations, char * child_sequence, int number_of_branch_snps, int start_index,int end_index)
+// Index of the first coordinate which is greater than or equal to the given coordinate in a sorted array,
+// or number_of_coordinates if there is none.
+int find_first_index_greater_than_or_equal(int coordinate, int * sorted_coordinates, int number_of_coordinates)
+{
+	int start_index = 0;
+	int end_index = number_of_coordinates;
+	while(start_index < end_index)
+	{
+		int current_index = start_index + (end_index - start_index)/2;
+		if(sorted_coordinates[current_index] < coordinate)
+		{
+			start_index = current_index + 1;
+		}
+		else
+		{
+			end_index = current_index;
+		}
+	}
+	return start_index;
+}
+
+// Number of gaps in the child sequence before each snp site, so the gaps in any range of snp sites can be
+// counted with a subtraction. The gaps dont change while a branch is scanned so it only needs to be built once.
+void calculate_gap_prefix_counts(const char * child_sequence, int number_of_snps, int * gap_prefix_counts)
+{
+	int i;
+	gap_prefix_counts[0] = 0;
+	for(i = 0; i < number_of_snps; i++)
+	{
+		gap_prefix_counts[i+1] = gap_prefix_counts[i];
+		if(child_sequence[i] == '-' || child_sequence[i] == 'N')
+		{
+			gap_prefix_counts[i+1]++;
+		}
+	}
+}
+
+// The branch snp coordinates are sorted and exclude_snp_sites_in_block keeps them compacted, so the rank of a
+// coordinate is the number of branch snps before it.
+int find_number_of_snps_in_block_with_prefix_index(int window_start_coordinate, int window_end_coordinate, int * snp_locations, int number_of_snps)
+{
+	if(window_end_coordinate <= window_start_coordinate)
+	{
+		return 0;
+	}
+	return find_first_index_greater_than_or_equal(window_end_coordinate, snp_locations, number_of_snps) - find_first_index_greater_than_or_equal(window_start_coordinate, snp_locations, number_of_snps);
+}
+
+int calculate_block_size_without_gaps_with_prefix_index(int * gap_prefix_counts, int * snp_locations, int starting_coordinate, int ending_coordinate, int number_of_snps)
+{
+	int block_size = ending_coordinate - starting_coordinate;
+	if(ending_coordinate <= starting_coordinate)
+	{
+		return block_size;
+	}
+	int start_index = find_first_index_greater_than_or_equal(starting_coordinate, snp_locations, number_of_snps);
+	int end_index   = find_first_index_greater_than_or_equal(ending_coordinate, snp_locations, number_of_snps);
+	return block_size - (gap_prefix_counts[end_index] - gap_prefix_counts[start_index]);
+}
+
+// Branch snps never contain gaps, so the next snp is found with a binary search
+int advance_window_start_to_next_snp_with_prefix_index(int window_start_coordinate, int * snp_locations, int number_of_branch_snps)
+{
+	int index = find_first_index_greater_than_or_equal(window_start_coordinate, snp_locations, number_of_branch_snps);
+	if(index < number_of_branch_snps)
+	{
+		return snp_locations[index];
+	}
+	return window_start_coordinate;
+}
+
+int rewind_window_end_to_last_snp_with_prefix_index(int window_end_coordinate, int * snp_locations, int number_of_branch_snps)
+{
+	int index = find_first_index_greater_than_or_equal(window_end_coordinate + 1, snp_locations, number_of_branch_snps) - 1;
+	if(index >= 0)
+	{
+		return snp_locations[index];
+	}
+	return window_end_coordinate;
+}
+
+int rewind_window_end_to_last_snp_with_start_end_index(int window_end_coordinate, int * snp_locations, const char * child_sequence, int number_of_branch_snps, int start_index,int end_index)
 {
 	int i = 0;
 	
@@ -123,12 +204,12 @@ int rewind_window_end_to_last_snp_with_start_end_index(int window_end_coordinate
 	return window_end_coordinate;
 }
 
-int rewind_window_end_to_last_snp(int window_end_coordinate, int * snp_locations, char * child_sequence, int number_of_branch_snps)
+int rewind_window_end_to_last_snp(int window_end_coordinate, int * snp_locations, const char * child_sequence, int number_of_branch_snps)
 {
 	return rewind_window_end_to_last_snp_with_start_end_index(window_end_coordinate, snp_locations, child_sequence,  number_of_branch_snps, 0, number_of_branch_snps);
 }
 
-int get_window_end_coordinates_excluding_gaps_with_start_end_index(int window_start_coordinate, int window_size, int * snp_locations, char * child_sequence, int number_of_snps, int start_index,int end_index)
+int get_window_end_coordinates_excluding_gaps_with_start_end_index(int window_start_coordinate, int window_size, int * snp_locations, const char * child_sequence, int number_of_snps, int start_index,int end_index)
 {
 	int i;
 	int window_end_coordinate = window_start_coordinate + window_size;
@@ -162,13 +243,13 @@ int get_window_end_coordinates_excluding_gaps_with_start_end_index(int window_st
 }
 
 
-int get_window_end_coordinates_excluding_gaps(int window_start_coordinate, int window_size, int * snp_locations, char * child_sequence, int number_of_snps)
+int get_window_end_coordinates_excluding_gaps(int window_start_coordinate, int window_size, int * snp_locations, const char * child_sequence, int number_of_snps)
 {
 	return get_window_end_coordinates_excluding_gaps_with_start_end_index( window_start_coordinate,  window_size,  snp_locations,  child_sequence,  number_of_snps, 0, number_of_snps);
 }
 
 
-int find_number_of_snps_in_block_with_start_end_index(int window_start_coordinate, int window_end_coordinate, int * snp_locations,  char * child_sequence, int number_of_snps, int start_index,int end_index)
+int find_number_of_snps_in_block_with_start_end_index(int window_start_coordinate, int window_end_coordinate, int * snp_locations,  const char * child_sequence, int number_of_snps, int start_index,int end_index)
 {
 	if(number_of_snps == 0)
 	{
@@ -196,17 +277,17 @@ int find_number_of_snps_in_block_with_start_end_index(int window_start_coordinat
 }
 
 
-int find_number_of_snps_in_block(int window_start_coordinate, int window_end_coordinate, int * snp_locations,  char * child_sequence, int number_of_snps)
+int find_number_of_snps_in_block(int window_start_coordinate, int window_end_coordinate, int * snp_locations,  const char * child_sequence, int number_of_snps)
 {
 	return find_number_of_snps_in_block_with_start_end_index( window_start_coordinate,  window_end_coordinate, snp_locations,   child_sequence, number_of_snps, 0, number_of_snps);
 }
 
-int calculate_block_size_without_gaps(char * child_sequence, int * snp_locations, int starting_coordinate, int ending_coordinate,  int length_of_original_genome)
+int calculate_block_size_without_gaps(const char * child_sequence, int * snp_locations, int starting_coordinate, int ending_coordinate,  int length_of_original_genome)
 {
 	return calculate_block_size_without_gaps_with_start_end_index( child_sequence,  snp_locations,starting_coordinate,  ending_coordinate,   length_of_original_genome,0, length_of_original_genome);
 }
 
-int calculate_block_size_without_gaps_with_start_end_index(char * child_sequence, int * snp_locations, int starting_coordinate, int ending_coordinate,  int length_of_original_genome, int start_index,int end_index)
+int calculate_block_size_without_gaps_with_start_end_index(const char * child_sequence, int * snp_locations, int starting_coordinate, int ending_coordinate,  int length_of_original_genome, int start_index,int end_index)
 {
 	int i;
 	int block_size = ending_coordinate - starting_coordinate;
@@ -233,7 +314,7 @@ int calculate_block_size_without_gaps_with_start_end_index(char * child_sequence
 
 
 // take in a sequence, and calculate the size of the genome when gaps are excluded
-int calculate_size_of_genome_without_gaps(char * child_sequence, int start_index, int length_of_sequence,  int length_of_original_genome)
+int calculate_size_of_genome_without_gaps(const char * child_sequence, int start_index, int length_of_sequence,  int length_of_original_genome)
 {
 	int i;
 	int total_length_of_genome = length_of_original_genome;
@@ -252,7 +333,7 @@ int calculate_size_of_genome_without_gaps(char * child_sequence, int start_index
 	return length_of_original_genome;
 }
 
-int calculate_number_of_snps_excluding_gaps(char * ancestor_sequence, char * child_sequence, int child_sequence_size, int * branch_snp_coords, int * snp_locations,char * branch_snp_sequence, char * branch_snp_ancestor_sequence)
+int calculate_number_of_snps_excluding_gaps(const char * ancestor_sequence, const char * child_sequence, int child_sequence_size, int * branch_snp_coords, int * snp_locations,char * branch_snp_sequence, char * branch_snp_ancestor_sequence)
 {
 	int i ;
 	int number_of_branch_snp_sites = 0;
@@ -279,6 +360,36 @@ int calculate_number_of_snps_excluding_gaps(char * ancestor_sequence, char * chi
 	return number_of_branch_snp_sites;
 }
 
+// The same snps when the child sequence is encoded as its differences from the ancestor, looking only at the
+// positions where they differ rather than the whole sequence
+int calculate_number_of_snps_from_differences(const char * ancestor_sequence, const char * child_sequence, int child_sequence_size, int * difference_positions, int number_of_differences, int * branch_snp_coords, int * snp_locations,char * branch_snp_sequence, char * branch_snp_ancestor_sequence)
+{
+	int i;
+	int number_of_branch_snp_sites = 0;
+	int ancestor_length = strnlen(ancestor_sequence, child_sequence_size);
+	int child_length = strnlen(child_sequence, child_sequence_size);
+	int sequence_length = (ancestor_length < child_length ? ancestor_length : child_length);
+	
+	for(i = 0; i < number_of_differences && difference_positions[i] < sequence_length; i++)
+	{
+		int position = difference_positions[i];
+		if(child_sequence[position] != ancestor_sequence[position] && child_sequence[position] != '-' && child_sequence[position] != 'N'  && child_sequence[position] != '.' &&   ancestor_sequence[position] != '-'  &&  ancestor_sequence[position] != 'N')
+		{
+			branch_snp_coords[number_of_branch_snp_sites]   = snp_locations[position];
+			branch_snp_sequence[number_of_branch_snp_sites] = child_sequence[position];
+			branch_snp_ancestor_sequence[number_of_branch_snp_sites] = ancestor_sequence[position];
+			number_of_branch_snp_sites++;
+		}
+	}
+	if(number_of_branch_snp_sites < child_sequence_size)
+	{
+		branch_snp_coords[number_of_branch_snp_sites] = 0;
+	}
+	
+	branch_snp_sequence[number_of_branch_snp_sites] = '\0';
+	branch_snp_ancestor_sequence[number_of_branch_snp_sites] = '\0';
+	return number_of_branch_snp_sites;
+}
 
 int flag_recombinations_in_window(int window_start_coordinate, int window_end_coordinate, int number_of_snps, int * branch_snp_sites, int * recombinations, int number_of_recombinations,int * snp_locations, int total_num_snps)
 {
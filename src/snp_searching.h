@@ -19,21 +19,28 @@
 
 #ifndef _SNP_SEARCHING_H_
 #define _SNP_SEARCHING_H_
-int advance_window_start_to_next_snp(int window_start_coordinate, int * snp_locations, char * child_sequence, int number_of_branch_snps);
+int advance_window_start_to_next_snp(int window_start_coordinate, int * snp_locations, const char * child_sequence, int number_of_branch_snps);
 int find_starting_index(int window_start_coordinate, int * snp_locations, int start_index, int end_index);
-int rewind_window_end_to_last_snp(int window_end_coordinate, int * snp_locations, char * child_sequence, int number_of_branch_snps);
-int get_window_end_coordinates_excluding_gaps(int window_start_coordinate, int window_size, int * snp_locations, char * child_sequence, int number_of_snps);
-int find_number_of_snps_in_block(int window_start_coordinate, int window_end_coordinate, int * snp_locations,  char * child_sequence, int number_of_snps);
-int calculate_block_size_without_gaps(char * child_sequence, int * snp_locations, int starting_coordinate, int ending_coordinate,  int length_of_original_genome);
-int calculate_size_of_genome_without_gaps(char * child_sequence, int start_index, int length_of_sequence,  int length_of_original_genome);
-int calculate_number_of_snps_excluding_gaps(char * ancestor_sequence, char * child_sequence, int child_sequence_size, int * branch_snp_coords, int * snp_locations, char * branch_snp_sequence, char * branch_snp_ancestor_sequence);
+int find_first_index_greater_than_or_equal(int coordinate, int * sorted_coordinates, int number_of_coordinates);
+void calculate_gap_prefix_counts(const char * child_sequence, int number_of_snps, int * gap_prefix_counts);
+int find_number_of_snps_in_block_with_prefix_index(int window_start_coordinate, int window_end_coordinate, int * snp_locations, int number_of_snps);
+int calculate_block_size_without_gaps_with_prefix_index(int * gap_prefix_counts, int * snp_locations, int starting_coordinate, int ending_coordinate, int number_of_snps);
+int advance_window_start_to_next_snp_with_prefix_index(int window_start_coordinate, int * snp_locations, int number_of_branch_snps);
+int rewind_window_end_to_last_snp_with_prefix_index(int window_end_coordinate, int * snp_locations, int number_of_branch_snps);
+int rewind_window_end_to_last_snp(int window_end_coordinate, int * snp_locations, const char * child_sequence, int number_of_branch_snps);
+int get_window_end_coordinates_excluding_gaps(int window_start_coordinate, int window_size, int * snp_locations, const char * child_sequence, int number_of_snps);
+int find_number_of_snps_in_block(int window_start_coordinate, int window_end_coordinate, int * snp_locations,  const char * child_sequence, int number_of_snps);
+int calculate_block_size_without_gaps(const char * child_sequence, int * snp_locations, int starting_coordinate, int ending_coordinate,  int length_of_original_genome);
+int calculate_size_of_genome_without_gaps(const char * child_sequence, int start_index, int length_of_sequence,  int length_of_original_genome);
+int calculate_number_of_snps_from_differences(const char * ancestor_sequence, const char * child_sequence, int child_sequence_size, int * difference_positions, int number_of_differences, int * branch_snp_coords, int * snp_locations,char * branch_snp_sequence, char * branch_snp_ancestor_sequence);
+int calculate_number_of_snps_excluding_gaps(const char * ancestor_sequence, const char * child_sequence, int child_sequence_size, int * branch_snp_coords, int * snp_locations, char * branch_snp_sequence, char * branch_snp_ancestor_sequence);
 int flag_recombinations_in_window(int window_start_coordinate, int window_end_coordinate, int number_of_snps, int * branch_snp_sites, int * recombinations, int number_of_recombinations,int * snp_locations, int total_num_snps);
 int find_matching_coordinate_index(int window_start_coordinate, int * snp_sites, int number_of_snps, int starting_index);
-int advance_window_start_to_next_snp_with_start_index(int window_start_coordinate, int * snp_locations, char * child_sequence, int number_of_branch_snps, int start_index);
-int rewind_window_end_to_last_snp_with_start_end_index(int window_end_coordinate, int * snp_locations, char * child_sequence, int number_of_branch_snps, int start_index,int end_index);
-int find_number_of_snps_in_block_with_start_end_index(int window_start_coordinate, int window_end_coordinate, int * snp_locations,  char * child_sequence, int number_of_snps, int start_index,int end_index);
-int get_window_end_coordinates_excluding_gaps_with_start_end_index(int window_start_coordinate, int window_size, int * snp_locations, char * child_sequence, int number_of_snps, int start_index,int end_index);
-int calculate_block_size_without_gaps_with_start_end_index(char * child_sequence, int * snp_locations, int starting_coordinate, int ending_coordinate,  int length_of_original_genome, int start_index,int end_index);
+int advance_window_start_to_next_snp_with_start_index(int window_start_coordinate, int * snp_locations, const char * child_sequence, int number_of_branch_snps, int start_index);
+int rewind_window_end_to_last_snp_with_start_end_index(int window_end_coordinate, int * snp_locations, const char * child_sequence, int number_of_branch_snps, int start_index,int end_index);
+int find_number_of_snps_in_block_with_start_end_index(int window_start_coordinate, int window_end_coordinate, int * snp_locations,  const char * child_sequence, int number_of_snps, int start_index,int end_index);
+int get_window_end_coordinates_excluding_gaps_with_start_end_index(int window_start_coordinate, int window_size, int * snp_locations, const char * child_sequence, int number_of_snps, int start_index,int end_index);
+int calculate_block_size_without_gaps_with_start_end_index(const char * child_sequence, int * snp_locations, int starting_coordinate, int ending_coordinate,  int length_of_original_genome, int start_index,int end_index);
 
 
 #endif
\ No newline at end of file
@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <regex.h>
+#include <pthread.h>
 #include "vcf.h"
 #include "alignment_file.h"
 #include "snp_sites.h"
@@ -29,6 +30,10 @@
 #include "parse_phylip.h"
 #include "string_cat.h"
 #include "fasta_of_snp_sites.h"
+#include "base_matrix.h"
+#include "contigs.h"
+#include "output_selection.h"
+#include "snp_sites_stream.h"
 
 
 void build_snp_locations(int snp_locations[], char reference_sequence[])
@@ -56,7 +61,10 @@ int generate_snp_sites(char filename[],  int exclude_gaps, char suffix[])
 	int number_of_samples;
 	int i;
 	
+	// Every pass below is served from this one read of the file
+	load_alignment(filename);
 	length_of_genome = genome_length(filename);
+	check_contigs_cover_genome(length_of_genome);
 	reference_sequence = (char *) calloc((length_of_genome+1),sizeof(char));
 	
 	build_reference_sequence(reference_sequence,filename);
@@ -71,12 +79,7 @@ int generate_snp_sites(char filename[],  int exclude_gaps, char suffix[])
 	// Find out the names of the sequences
 	char* sequence_names[number_of_samples];
 	sequence_names[number_of_samples-1] = '\0';
-	for(i = 0; i < number_of_samples; i++)
-	{
-		sequence_names[i] = calloc(MAX_SAMPLE_NAME_SIZE,sizeof(char));
-	}
-	
-	get_sample_names_for_header(filename, sequence_names, number_of_samples);
+	get_pooled_sample_names_for_header(filename, sequence_names, number_of_samples);
 	
 	int internal_nodes[number_of_samples];
 	int a = 0;
@@ -85,7 +88,15 @@ int generate_snp_sites(char filename[],  int exclude_gaps, char suffix[])
 		internal_nodes[a] = 0;
 	}
 	
-	char** bases_for_snps = malloc(number_of_snps * sizeof(char *));
+	// Past the memory budget the files are written straight from the alignment, without gathering all the bases first
+	if(snp_sites_need_streaming(number_of_snps, number_of_samples))
+	{
+		stream_snp_sites_files(filename, suffix, snp_locations, number_of_snps, sequence_names, number_of_samples, internal_nodes, length_of_genome, 1);
+		free(snp_locations);
+		return 1;
+	}
+	
+	char** bases_for_snps = malloc((number_of_snps+1) * sizeof(char *));
 	
 	for(i = 0; i < number_of_snps; i++)
 	{
@@ -94,17 +105,188 @@ int generate_snp_sites(char filename[],  int exclude_gaps, char suffix[])
 	
 	get_bases_for_each_snp(filename, snp_locations, bases_for_snps, length_of_genome, number_of_snps);
 	
+	write_snp_sites_files(filename, suffix, snp_locations, number_of_snps, bases_for_snps, sequence_names, number_of_samples, internal_nodes, length_of_genome, 1);
+
+	for(i = 0; i < number_of_snps; i++)
+	{
+		free(bases_for_snps[i]);
+	}
+	free(bases_for_snps);
+	free(snp_locations);
+	return 1;
+}
+
+// Gives the same files as generate_snp_sites with and then without exclude_gaps, but finds both sets
+// of snps and extracts both sets of bases in the same scans of the alignment.
+int generate_snp_sites_including_and_excluding_gaps(char filename[], char suffix_including_gaps[], char suffix_excluding_gaps[], int num_threads)
+{
+	int length_of_genome;
+	char * reference_sequence_including_gaps;
+	char * reference_sequence_excluding_gaps;
+	int number_of_snps_including_gaps;
+	int number_of_snps_excluding_gaps;
+	int * snp_locations_including_gaps;
+	int * snp_locations_excluding_gaps;
+	int number_of_samples;
+	int i;
+	
+	load_alignment(filename);
+	length_of_genome = genome_length(filename);
+	check_contigs_cover_genome(length_of_genome);
+	reference_sequence_including_gaps = (char *) calloc((length_of_genome+1),sizeof(char));
+	reference_sequence_excluding_gaps = (char *) calloc((length_of_genome+1),sizeof(char));
+	
+	build_reference_sequence(reference_sequence_including_gaps,filename);
+	memcpy(reference_sequence_excluding_gaps, reference_sequence_including_gaps, length_of_genome+1);
+	detect_snps_including_and_excluding_gaps(reference_sequence_including_gaps, reference_sequence_excluding_gaps, filename, length_of_genome, &number_of_snps_including_gaps, &number_of_snps_excluding_gaps);
+	
+	snp_locations_including_gaps = (int *) calloc((number_of_snps_including_gaps+1),sizeof(int));
+	snp_locations_excluding_gaps = (int *) calloc((number_of_snps_excluding_gaps+1),sizeof(int));
+	build_snp_locations(snp_locations_including_gaps, reference_sequence_including_gaps);
+	build_snp_locations(snp_locations_excluding_gaps, reference_sequence_excluding_gaps);
+	free(reference_sequence_including_gaps);
+	free(reference_sequence_excluding_gaps);
+	
+	number_of_samples = number_of_sequences_in_file(filename);
+	
+	char* sequence_names[number_of_samples];
+	get_pooled_sample_names_for_header(filename, sequence_names, number_of_samples);
+	
+	int internal_nodes[number_of_samples];
+	for(i =0; i < number_of_samples; i++)
+	{
+		internal_nodes[i] = 0;
+	}
+	
+	if(snp_sites_need_streaming(number_of_snps_including_gaps, number_of_samples))
+	{
+		stream_snp_sites_files(filename, suffix_including_gaps, snp_locations_including_gaps, number_of_snps_including_gaps, sequence_names, number_of_samples, internal_nodes, length_of_genome, num_threads);
+		stream_snp_sites_files(filename, suffix_excluding_gaps, snp_locations_excluding_gaps, number_of_snps_excluding_gaps, sequence_names, number_of_samples, internal_nodes, length_of_genome, num_threads);
+		free(snp_locations_including_gaps);
+		free(snp_locations_excluding_gaps);
+		return 1;
+	}
+	
+	char** bases_for_snps_including_gaps = malloc((number_of_snps_including_gaps+1) * sizeof(char *));
+	char** bases_for_snps_excluding_gaps = malloc((number_of_snps_excluding_gaps+1) * sizeof(char *));
+	for(i = 0; i < number_of_snps_including_gaps; i++)
+	{
+		bases_for_snps_including_gaps[i] = calloc((number_of_samples+1),sizeof(char));
+	}
+	for(i = 0; i < number_of_snps_excluding_gaps; i++)
+	{
+		bases_for_snps_excluding_gaps[i] = calloc((number_of_samples+1),sizeof(char));
+	}
+	
+	get_bases_for_each_snp_including_and_excluding_gaps(filename, snp_locations_including_gaps, bases_for_snps_including_gaps, number_of_snps_including_gaps, snp_locations_excluding_gaps, bases_for_snps_excluding_gaps, number_of_snps_excluding_gaps);
+	
+	write_snp_sites_files(filename, suffix_including_gaps, snp_locations_including_gaps, number_of_snps_including_gaps, bases_for_snps_including_gaps, sequence_names, number_of_samples, internal_nodes, length_of_genome, num_threads);
+	write_snp_sites_files(filename, suffix_excluding_gaps, snp_locations_excluding_gaps, number_of_snps_excluding_gaps, bases_for_snps_excluding_gaps, sequence_names, number_of_samples, internal_nodes, length_of_genome, num_threads);
+	
+	for(i = 0; i < number_of_snps_including_gaps; i++)
+	{
+		free(bases_for_snps_including_gaps[i]);
+	}
+	for(i = 0; i < number_of_snps_excluding_gaps; i++)
+	{
+		free(bases_for_snps_excluding_gaps[i]);
+	}
+	free(bases_for_snps_including_gaps);
+	free(bases_for_snps_excluding_gaps);
+	free(snp_locations_including_gaps);
+	free(snp_locations_excluding_gaps);
+	return 1;
+}
+
+// Write out the vcf, phylip and snp_sites.aln files for a set of snps
+void write_snp_sites_files(char filename[], char suffix[], int * snp_locations, int number_of_snps, char ** bases_for_snps, char ** sequence_names, int number_of_samples, int * internal_nodes, int length_of_genome, int num_threads)
+{
   char filename_without_directory[MAX_FILENAME_SIZE];
   strip_directory_from_filename(filename, filename_without_directory);
 	
 	concat_strings_created_with_malloc(filename_without_directory,suffix);
 	
-	create_vcf_file(filename_without_directory, snp_locations, number_of_snps, bases_for_snps, sequence_names, number_of_samples,internal_nodes,1,length_of_genome);
-	create_phylip_of_snp_sites(filename_without_directory, number_of_snps, bases_for_snps, sequence_names, number_of_samples,internal_nodes);
-	create_fasta_of_snp_sites(filename_without_directory, number_of_snps, bases_for_snps, sequence_names, number_of_samples,internal_nodes);
+	// The phylip and fasta files are written a sample at a time
+	char ** bases_for_samples = (char **) calloc(number_of_samples+1, sizeof(char *));
+	allocate_base_matrix(bases_for_samples, number_of_samples, number_of_snps);
+	transpose_base_matrix_in_parallel(bases_for_snps, number_of_snps, number_of_samples, bases_for_samples, num_threads);
+	
+	snp_sites_outputs outputs = {filename_without_directory, snp_locations, number_of_snps, bases_for_snps, bases_for_samples, sequence_names, number_of_samples, internal_nodes, 1, length_of_genome, num_threads};
+	write_snp_sites_outputs(&outputs);
+	free_base_matrix(bases_for_samples, number_of_samples);
+	free(bases_for_samples);
+}
 
-	free(snp_locations);
-	return 1;
+// The same files as write_snp_sites_files, with the bases read from the loaded alignment a block at a time
+void stream_snp_sites_files(char filename[], char suffix[], int * snp_locations, int number_of_snps, char ** sequence_names, int number_of_samples, int * internal_nodes, int length_of_genome, int num_threads)
+{
+  char filename_without_directory[MAX_FILENAME_SIZE];
+  strip_directory_from_filename(filename, filename_without_directory);
+	
+	concat_strings_created_with_malloc(filename_without_directory,suffix);
+	
+	snp_sites_stream stream = {filename_without_directory, load_alignment(filename), snp_locations, number_of_snps, sequence_names, number_of_samples, internal_nodes, length_of_genome, num_threads};
+	stream_snp_sites_outputs(&stream);
+}
+
+// The selected files are independent, so with more than one thread they are written at the same time and
+// share the threads out between them
+void write_snp_sites_outputs(snp_sites_outputs * outputs)
+{
+	int i;
+	void * (*all_writers[3])(void *) = {write_vcf_of_snp_sites_outputs, write_phylip_of_snp_sites_outputs, write_fasta_of_snp_sites_outputs};
+	int writer_outputs[3] = {GUBBINS_OUTPUT_VCF, GUBBINS_OUTPUT_PHYLIP, GUBBINS_OUTPUT_SNP_SITES};
+	void * (*writers[3])(void *);
+	int number_of_writers = 0;
+	for(i = 0; i < 3; i++)
+	{
+		if(is_output_selected(writer_outputs[i]))
+		{
+			writers[number_of_writers] = all_writers[i];
+			number_of_writers++;
+		}
+	}
+	if(outputs->num_threads <= 1 || number_of_writers <= 1)
+	{
+		for(i = 0; i < number_of_writers; i++)
+		{
+			writers[i](outputs);
+		}
+		return;
+	}
+	
+	snp_sites_outputs shared_outputs = *outputs;
+	shared_outputs.num_threads = (outputs->num_threads + number_of_writers - 1)/number_of_writers;
+	pthread_t threads[3];
+	for(i = 0; i < number_of_writers; i++)
+	{
+		pthread_create(&threads[i], NULL, writers[i], &shared_outputs);
+	}
+	for(i = 0; i < number_of_writers; i++)
+	{
+		pthread_join(threads[i], NULL);
+	}
+}
+
+void * write_vcf_of_snp_sites_outputs(void * outputs_pointer)
+{
+	snp_sites_outputs * outputs = (snp_sites_outputs *) outputs_pointer;
+	create_vcf_file(outputs->filename, outputs->snp_locations, outputs->number_of_snps, outputs->bases_for_snps, outputs->sequence_names, outputs->number_of_samples, outputs->internal_nodes, outputs->vcf_offset, outputs->length_of_genome, outputs->num_threads);
+	return NULL;
+}
+
+void * write_phylip_of_snp_sites_outputs(void * outputs_pointer)
+{
+	snp_sites_outputs * outputs = (snp_sites_outputs *) outputs_pointer;
+	create_phylip_of_snp_sites(outputs->filename, outputs->number_of_snps, outputs->bases_for_samples, outputs->sequence_names, outputs->number_of_samples, outputs->internal_nodes, outputs->num_threads);
+	return NULL;
+}
+
+void * write_fasta_of_snp_sites_outputs(void * outputs_pointer)
+{
+	snp_sites_outputs * outputs = (snp_sites_outputs *) outputs_pointer;
+	create_fasta_of_snp_sites(outputs->filename, outputs->number_of_snps, outputs->bases_for_samples, outputs->sequence_names, outputs->number_of_samples, outputs->internal_nodes, outputs->num_threads);
+	return NULL;
 }
 
 // Inefficient
@@ -137,14 +319,16 @@ void strip_directory_from_filename(char * input_filename, char * output_filename
 }
 
 // return new number of snps
-int refilter_existing_snps(char * reference_bases, int number_of_snps, int * snp_locations, int * filtered_snp_locations, int internal_nodes[])
+int refilter_existing_snps(char * reference_bases, int number_of_snps, int * snp_locations, int * filtered_snp_locations, int internal_nodes[], int num_threads)
 {
 	// go through each snp column and check to see if there is still variation
 	int i;
 	int number_of_filtered_snps = number_of_snps;
+	int * column_contains_snps = (int *) calloc(number_of_snps+1, sizeof(int));
+	find_columns_which_contain_snps(reference_bases, number_of_snps, column_contains_snps, num_threads);
 	for(i = 0; i < number_of_snps; i++)
 	{
-		if( does_column_contain_snps(i, reference_bases[i]) == 0)
+		if( column_contains_snps[i] == 0)
 		{
 			snp_locations[i] = -1;
 			reference_bases[i] = '*';
@@ -152,6 +336,7 @@ int refilter_existing_snps(char * reference_bases, int number_of_snps, int * snp
 			number_of_filtered_snps--;
 		}
 	}
+	free(column_contains_snps);
 	
 	remove_filtered_snp_locations(filtered_snp_locations, snp_locations, number_of_snps);
 	return number_of_filtered_snps;
@@ -20,9 +20,32 @@
 #ifndef _SNP_SITES_H_
 #define _SNP_SITES_H_
 
+// The vcf, phylip and fasta files of a set of snps, with the bases both one row per snp and one row per sample
+typedef struct snp_sites_outputs
+{
+	char * filename;
+	int * snp_locations;
+	int number_of_snps;
+	char ** bases_for_snps;
+	char ** bases_for_samples;
+	char ** sequence_names;
+	int number_of_samples;
+	int * internal_nodes;
+	int vcf_offset;
+	int length_of_genome;
+	int num_threads;
+} snp_sites_outputs;
+
 void build_snp_locations(int snp_locations[], char reference_sequence[]);
 int generate_snp_sites(char filename[],  int exclude_gaps, char suffix[]);
-int refilter_existing_snps(char * reference_bases, int number_of_snps, int * snp_locations, int * filtered_snp_locations, int internal_nodes[]);
+int generate_snp_sites_including_and_excluding_gaps(char filename[], char suffix_including_gaps[], char suffix_excluding_gaps[], int num_threads);
+void write_snp_sites_files(char filename[], char suffix[], int * snp_locations, int number_of_snps, char ** bases_for_snps, char ** sequence_names, int number_of_samples, int * internal_nodes, int length_of_genome, int num_threads);
+void stream_snp_sites_files(char filename[], char suffix[], int * snp_locations, int number_of_snps, char ** sequence_names, int number_of_samples, int * internal_nodes, int length_of_genome, int num_threads);
+void write_snp_sites_outputs(snp_sites_outputs * outputs);
+void * write_vcf_of_snp_sites_outputs(void * outputs_pointer);
+void * write_phylip_of_snp_sites_outputs(void * outputs_pointer);
+void * write_fasta_of_snp_sites_outputs(void * outputs_pointer);
+int refilter_existing_snps(char * reference_bases, int number_of_snps, int * snp_locations, int * filtered_snp_locations, int internal_nodes[], int num_threads);
 void remove_filtered_snp_locations(int * filtered_snp_locations, int * snp_locations, int number_of_snps);
 void strip_directory_from_filename(char * input_filename, char * output_filename);
 
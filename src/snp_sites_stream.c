@@ -0,0 +1,188 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <limits.h>
+#include "snp_sites_stream.h"
+#include "alignment_file.h"
+#include "base_matrix.h"
+#include "matrix_storage.h"
+#include "output_buffer.h"
+#include "output_selection.h"
+#include "vcf.h"
+#include "phylip_of_snp_sites.h"
+#include "fasta_of_snp_sites.h"
+
+// The bases are held once per snp for the vcf and once per sample for the phylip and fasta files, so
+// streaming is only worth it when both copies wont fit in the budget together
+int snp_sites_need_streaming(int number_of_snps, int number_of_samples)
+{
+	size_t budget = get_matrix_memory_budget();
+	if(budget == 0)
+	{
+		return 0;
+	}
+	return (size_t) number_of_snps*(number_of_samples+1) + (size_t) number_of_samples*(number_of_snps+1) > budget;
+}
+
+// How many rows of row_length bases fit in the budget as a block, always at least one
+int rows_per_streamed_block(int row_length)
+{
+	size_t rows = get_matrix_memory_budget()/((size_t) row_length+1);
+	if(rows < 1)
+	{
+		return 1;
+	}
+	return rows > INT_MAX ? INT_MAX : (int) rows;
+}
+
+void stream_snp_sites_outputs(snp_sites_stream * stream)
+{
+	if(is_output_selected(GUBBINS_OUTPUT_VCF))
+	{
+		stream_vcf_of_snp_sites(stream);
+	}
+	if(is_output_selected(GUBBINS_OUTPUT_PHYLIP) || is_output_selected(GUBBINS_OUTPUT_SNP_SITES))
+	{
+		stream_phylip_and_fasta_of_snp_sites(stream);
+	}
+}
+
+// The snps are taken a block at a time in order along the genome, so each block only reads its own stretch of
+// every sequence and the whole alignment is still only read once
+void stream_vcf_of_snp_sites(snp_sites_stream * stream)
+{
+	int first_snp;
+	int sequence_number;
+	int snps_per_block = rows_per_streamed_block(stream->number_of_samples);
+	if(snps_per_block > stream->number_of_snps)
+	{
+		snps_per_block = stream->number_of_snps;
+	}
+	char ** bases_for_snps = (char **) calloc(snps_per_block+1, sizeof(char *));
+	allocate_base_matrix(bases_for_snps, snps_per_block, stream->number_of_samples);
+	
+	FILE * vcf_file_pointer = open_vcf_file(stream->filename, stream->sequence_names, stream->number_of_samples, stream->internal_nodes, stream->length_of_genome);
+	output_buffer buffer;
+	vcf_rows rows;
+	rows.bases_for_snps = bases_for_snps;
+	rows.number_of_samples = stream->number_of_samples;
+	rows.internal_nodes = stream->internal_nodes;
+	rows.offset = 1;
+	initialise_output_buffer(&buffer, vcf_file_pointer, OUTPUT_BUFFER_SIZE);
+	
+	for(first_snp = 0; first_snp < stream->number_of_snps; first_snp += snps_per_block)
+	{
+		int snps_in_block = stream->number_of_snps - first_snp < snps_per_block ? stream->number_of_snps - first_snp : snps_per_block;
+		for(sequence_number = 0; sequence_number < stream->number_of_samples; sequence_number++)
+		{
+			fill_in_bases_for_each_snp(stream->alignment->sequences[sequence_number], sequence_number, stream->snp_locations + first_snp, bases_for_snps, snps_in_block);
+		}
+		rows.snp_locations = stream->snp_locations + first_snp;
+		write_rows(&buffer, &rows, snps_in_block, maximum_vcf_row_length, format_vcf_row_from_rows, stream->num_threads);
+	}
+	
+	free_output_buffer(&buffer);
+	fclose(vcf_file_pointer);
+	free_base_matrix(bases_for_snps, snps_per_block);
+	free(bases_for_snps);
+}
+
+// Both files have a row per sample, so each chunk of samples is written to both of them as soon as it is read
+void stream_phylip_and_fasta_of_snp_sites(snp_sites_stream * stream)
+{
+	int first_sample;
+	int sequence_number;
+	int write_phylip = is_output_selected(GUBBINS_OUTPUT_PHYLIP);
+	int write_fasta = is_output_selected(GUBBINS_OUTPUT_SNP_SITES);
+	int samples_per_chunk = rows_per_streamed_block(stream->number_of_snps);
+	if(samples_per_chunk > stream->number_of_samples)
+	{
+		samples_per_chunk = stream->number_of_samples;
+	}
+	char ** bases_for_samples = (char **) calloc(samples_per_chunk+1, sizeof(char *));
+	allocate_base_matrix(bases_for_samples, samples_per_chunk, stream->number_of_snps);
+	
+	FILE * phylip_file_pointer = NULL;
+	FILE * fasta_file_pointer = NULL;
+	output_buffer phylip_buffer;
+	output_buffer fasta_buffer;
+	if(write_phylip)
+	{
+		phylip_file_pointer = open_phylip_of_snp_sites(stream->filename, stream->number_of_snps, stream->number_of_samples, stream->internal_nodes);
+		initialise_output_buffer(&phylip_buffer, phylip_file_pointer, OUTPUT_BUFFER_SIZE);
+	}
+	if(write_fasta)
+	{
+		fasta_file_pointer = open_fasta_of_snp_sites(stream->filename);
+		initialise_output_buffer(&fasta_buffer, fasta_file_pointer, OUTPUT_BUFFER_SIZE);
+	}
+	snp_sites_rows rows;
+	rows.bases_for_samples = bases_for_samples;
+	rows.number_of_snps = stream->number_of_snps;
+	
+	for(first_sample = 0; first_sample < stream->number_of_samples; first_sample += samples_per_chunk)
+	{
+		int samples_in_chunk = stream->number_of_samples - first_sample < samples_per_chunk ? stream->number_of_samples - first_sample : samples_per_chunk;
+		for(sequence_number = 0; sequence_number < samples_in_chunk; sequence_number++)
+		{
+			fill_in_snp_bases_of_sample(stream->alignment->sequences[first_sample + sequence_number], stream->snp_locations, stream->number_of_snps, bases_for_samples[sequence_number]);
+		}
+		rows.sequence_names = stream->sequence_names + first_sample;
+		rows.internal_nodes = stream->internal_nodes + first_sample;
+		if(write_phylip)
+		{
+			write_rows(&phylip_buffer, &rows, samples_in_chunk, maximum_phylip_of_snp_sites_row_length, format_phylip_of_snp_sites_row, stream->num_threads);
+		}
+		if(write_fasta)
+		{
+			write_rows(&fasta_buffer, &rows, samples_in_chunk, maximum_fasta_of_snp_sites_row_length, format_fasta_of_snp_sites_row, stream->num_threads);
+		}
+	}
+	
+	if(write_phylip)
+	{
+		free_output_buffer(&phylip_buffer);
+		fclose(phylip_file_pointer);
+	}
+	if(write_fasta)
+	{
+		free_output_buffer(&fasta_buffer);
+		fclose(fasta_file_pointer);
+	}
+	free_base_matrix(bases_for_samples, samples_per_chunk);
+	free(bases_for_samples);
+}
+
+// The same bases as fill_in_bases_for_each_snp, but laid out along one row for the sample
+void fill_in_snp_bases_of_sample(char * sequence, int * snp_locations, int number_of_snps, char * bases)
+{
+	int i;
+	for(i = 0; i < number_of_snps; i++)
+	{
+		bases[i] = toupper(sequence[snp_locations[i]]);
+		// Present gaps and unknowns in the same way to Gubbins
+		if(bases[i] == 'N')
+		{
+			bases[i] = '-';
+		}
+	}
+}
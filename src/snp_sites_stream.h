@@ -0,0 +1,47 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _SNP_SITES_STREAM_H_
+#define _SNP_SITES_STREAM_H_
+
+#include "alignment_file.h"
+
+// The snp sites files written straight from the loaded alignment, a few samples or snps at a time, so no more
+// than the matrix memory budget of bases is held at once however many samples and snps there are
+typedef struct snp_sites_stream
+{
+	char * filename;
+	loaded_alignment * alignment;
+	int * snp_locations;
+	int number_of_snps;
+	char ** sequence_names;
+	int number_of_samples;
+	int * internal_nodes;
+	int length_of_genome;
+	int num_threads;
+} snp_sites_stream;
+
+int snp_sites_need_streaming(int number_of_snps, int number_of_samples);
+int rows_per_streamed_block(int row_length);
+void stream_snp_sites_outputs(snp_sites_stream * stream);
+void stream_vcf_of_snp_sites(snp_sites_stream * stream);
+void stream_phylip_and_fasta_of_snp_sites(snp_sites_stream * stream);
+void fill_in_snp_bases_of_sample(char * sequence, int * snp_locations, int number_of_snps, char * bases);
+
+#endif
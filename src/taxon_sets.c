@@ -0,0 +1,145 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Newickform.h"
+#include "taxon_sets.h"
+#include "tree_traversal.h"
+
+// The names of a node used to be built by joining " " and the names of each child, so a name is preceded by a
+// space for every node between it and the previous leaf. Only the leaves are kept here, and the names are written
+// out from them when they are needed, rather than a string of every name being held by every internal node.
+void build_taxon_sets(newick_node * root)
+{
+	tree_traversal traversal;
+	int i;
+	build_tree_traversal(root, &traversal);
+	
+	taxon_leaves * leaves = (taxon_leaves *) calloc(1, sizeof(taxon_leaves));
+	leaves->taxa = (char **) calloc(traversal.number_of_nodes+1, sizeof(char *));
+	leaves->spaces_before_taxa = (int *) calloc(traversal.number_of_nodes+1, sizeof(int));
+	int * leaf_positions = (int *) calloc(traversal.number_of_nodes+1, sizeof(int));
+	for(i = 0; i < traversal.number_of_nodes; i++)
+	{
+		newick_node * node = traversal.pre_order[i];
+		node->taxa.leaves = leaves;
+		node->taxa.first_leaf = leaves->number_of_leaves;
+		node->taxa.number_of_leaves = 0;
+		node->taxa.leading_spaces = 0;
+		if(node->childNum == 0)
+		{
+			leaf_positions[leaves->number_of_leaves] = i;
+			leaves->taxa[leaves->number_of_leaves] = node->taxon;
+			leaves->spaces_before_taxa[leaves->number_of_leaves] = leaves->number_of_leaves > 0 ? i - leaf_positions[leaves->number_of_leaves-1] : 0;
+			leaves->number_of_leaves++;
+		}
+	}
+	
+	for(i = 0; i < traversal.number_of_nodes; i++)
+	{
+		newick_node * node = traversal.post_order[i];
+		if(node->childNum == 0)
+		{
+			node->taxa.number_of_leaves = 1;
+			continue;
+		}
+		newick_child * child = node->child;
+		while(child != NULL)
+		{
+			node->taxa.number_of_leaves += child->node->taxa.number_of_leaves;
+			child = child->next;
+		}
+		if(node->taxa.number_of_leaves > 0)
+		{
+			node->taxa.leading_spaces = leaf_positions[node->taxa.first_leaf] - node->traversal_index;
+		}
+	}
+	free(leaf_positions);
+	free_tree_traversal(&traversal);
+}
+
+// The leaves are shared by every node of the tree, so they are freed once from the root
+void free_taxon_sets(newick_node * root)
+{
+	if(root->taxa.leaves == NULL)
+	{
+		return;
+	}
+	free(root->taxa.leaves->taxa);
+	free(root->taxa.leaves->spaces_before_taxa);
+	free(root->taxa.leaves);
+	root->taxa.leaves = NULL;
+}
+
+void print_taxon_names(FILE * output_file_pointer, taxon_set * taxa)
+{
+	int i, j;
+	for(j = 0; j < taxa->leading_spaces; j++)
+	{
+		fputc(' ', output_file_pointer);
+	}
+	for(i = taxa->first_leaf; i < taxa->first_leaf + taxa->number_of_leaves; i++)
+	{
+		for(j = 0; i > taxa->first_leaf && j < taxa->leaves->spaces_before_taxa[i]; j++)
+		{
+			fputc(' ', output_file_pointer);
+		}
+		fputs(taxa->leaves->taxa[i], output_file_pointer);
+	}
+}
+
+size_t length_of_taxon_names(taxon_set * taxa)
+{
+	size_t length = taxa->leading_spaces;
+	int i;
+	for(i = taxa->first_leaf; i < taxa->first_leaf + taxa->number_of_leaves; i++)
+	{
+		if(i > taxa->first_leaf)
+		{
+			length += taxa->leaves->spaces_before_taxa[i];
+		}
+		length += strlen(taxa->leaves->taxa[i]);
+	}
+	return length;
+}
+
+// The same names as print_taxon_names writes, for the few places which keep them
+char * copy_taxon_names(taxon_set * taxa)
+{
+	char * taxon_names = (char *) malloc(length_of_taxon_names(taxa) + 1);
+	char * end_of_names = taxon_names;
+	int i;
+	memset(end_of_names, ' ', taxa->leading_spaces);
+	end_of_names += taxa->leading_spaces;
+	for(i = taxa->first_leaf; i < taxa->first_leaf + taxa->number_of_leaves; i++)
+	{
+		if(i > taxa->first_leaf)
+		{
+			memset(end_of_names, ' ', taxa->leaves->spaces_before_taxa[i]);
+			end_of_names += taxa->leaves->spaces_before_taxa[i];
+		}
+		size_t taxon_length = strlen(taxa->leaves->taxa[i]);
+		memcpy(end_of_names, taxa->leaves->taxa[i], taxon_length);
+		end_of_names += taxon_length;
+	}
+	*end_of_names = '\0';
+	return taxon_names;
+}
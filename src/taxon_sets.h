@@ -0,0 +1,50 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _TAXON_SETS_H_
+#define _TAXON_SETS_H_
+#include <stdio.h>
+
+struct newick_node;
+
+// The leaves of a tree in pre-order, so the leaves under any node are a contiguous run of them. Between two leaves
+// the names of an internal node have one space for each node passed in pre-order, which is the same for every node.
+typedef struct taxon_leaves
+{
+	char ** taxa;
+	int * spaces_before_taxa;
+	int number_of_leaves;
+} taxon_leaves;
+
+// The leaves under a node, with the spaces its names start with. A leaf is the only taxon in its own set.
+typedef struct taxon_set
+{
+	taxon_leaves * leaves;
+	int first_leaf;
+	int number_of_leaves;
+	int leading_spaces;
+} taxon_set;
+
+void build_taxon_sets(struct newick_node * root);
+void free_taxon_sets(struct newick_node * root);
+void print_taxon_names(FILE * output_file_pointer, taxon_set * taxa);
+size_t length_of_taxon_names(taxon_set * taxa);
+char * copy_taxon_names(taxon_set * taxa);
+
+#endif
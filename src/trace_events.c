@@ -0,0 +1,155 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include "trace_events.h"
+#include "profile.h"
+
+// Nothing is recorded unless a trace has been started, so the calls cost a branch each when tracing is off
+char * trace_report_filename = NULL;
+double trace_start_microseconds;
+trace_event * trace_events = NULL;
+int number_of_trace_events = 0;
+int trace_events_capacity = 0;
+pthread_t traced_threads[MAX_NUMBER_OF_TRACED_THREADS];
+int number_of_traced_threads = 0;
+pthread_mutex_t trace_events_lock = PTHREAD_MUTEX_INITIALIZER;
+
+double trace_time_in_microseconds()
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec*1e6 + now.tv_nsec/1e3;
+}
+
+// The thread starting the trace is thread 0, and the worker threads are numbered in the order they first record
+void start_trace(char * trace_filename)
+{
+	if(trace_report_filename != NULL)
+	{
+		free(trace_report_filename);
+	}
+	trace_report_filename = strdup(trace_filename);
+	number_of_trace_events = 0;
+	traced_threads[0] = pthread_self();
+	number_of_traced_threads = 1;
+	trace_start_microseconds = trace_time_in_microseconds();
+}
+
+int trace_enabled()
+{
+	return (trace_report_filename != NULL) ? 1 : 0;
+}
+
+// Returns the time to pass to end_trace_event
+double start_trace_event()
+{
+	if(trace_enabled() == 0)
+	{
+		return 0.0;
+	}
+	return trace_time_in_microseconds();
+}
+
+// Only called under the lock
+int index_of_traced_thread(pthread_t thread)
+{
+	int i;
+	for(i = 0; i < number_of_traced_threads; i++)
+	{
+		if(pthread_equal(traced_threads[i], thread))
+		{
+			return i;
+		}
+	}
+	if(number_of_traced_threads == MAX_NUMBER_OF_TRACED_THREADS)
+	{
+		return MAX_NUMBER_OF_TRACED_THREADS;
+	}
+	traced_threads[number_of_traced_threads] = thread;
+	number_of_traced_threads++;
+	return number_of_traced_threads - 1;
+}
+
+// Events are named with string literals and can be recorded on any thread
+void end_trace_event(char * event_name, int node_id, double start_microseconds)
+{
+	if(trace_enabled() == 0)
+	{
+		return;
+	}
+	double end_microseconds = trace_time_in_microseconds();
+	pthread_mutex_lock(&trace_events_lock);
+	if(number_of_trace_events == trace_events_capacity)
+	{
+		trace_events_capacity = 2*trace_events_capacity + 1024;
+		trace_events = (trace_event *) realloc(trace_events, trace_events_capacity*sizeof(trace_event));
+	}
+	trace_event * event = &trace_events[number_of_trace_events];
+	event->name = event_name;
+	event->node_id = node_id;
+	event->thread_index = index_of_traced_thread(pthread_self());
+	event->start_microseconds = start_microseconds - trace_start_microseconds;
+	event->duration_microseconds = end_microseconds - start_microseconds;
+	number_of_trace_events++;
+	pthread_mutex_unlock(&trace_events_lock);
+}
+
+// Writes the events as JSON, which chrome://tracing and Perfetto open, and stops tracing until the next start_trace
+void write_trace()
+{
+	int i;
+	if(trace_enabled() == 0)
+	{
+		return;
+	}
+	FILE * trace_file_pointer = fopen(trace_report_filename, "w");
+	if(trace_file_pointer == NULL)
+	{
+		printf("Cannot write the trace to '%s'\n", trace_report_filename);
+		exit(1);
+	}
+	
+	fprintf(trace_file_pointer, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+	for(i = 0; i < number_of_traced_threads; i++)
+	{
+		fprintf(trace_file_pointer, "%s\n  {\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": \"%s %d\"}}", (i > 0) ? "," : "", i, (i == 0) ? "main" : "worker", i);
+	}
+	for(i = 0; i < number_of_trace_events; i++)
+	{
+		fprintf(trace_file_pointer, ",\n  {\"name\": ");
+		print_json_string(trace_file_pointer, trace_events[i].name);
+		fprintf(trace_file_pointer, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"node\": %d}}",
+			trace_events[i].thread_index, trace_events[i].start_microseconds, trace_events[i].duration_microseconds, trace_events[i].node_id);
+	}
+	fprintf(trace_file_pointer, "\n]}\n");
+	fclose(trace_file_pointer);
+	
+	free(trace_events);
+	trace_events = NULL;
+	trace_events_capacity = 0;
+	number_of_trace_events = 0;
+	number_of_traced_threads = 0;
+	free(trace_report_filename);
+	trace_report_filename = NULL;
+}
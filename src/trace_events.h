@@ -0,0 +1,44 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _TRACE_EVENTS_H_
+#define _TRACE_EVENTS_H_
+#include <pthread.h>
+
+// A span of work on one thread, written as a complete event of the Chrome trace event format
+typedef struct trace_event
+{
+	char * name;
+	int node_id;
+	int thread_index;
+	double start_microseconds;
+	double duration_microseconds;
+} trace_event;
+
+#define MAX_NUMBER_OF_TRACED_THREADS 1024
+
+void start_trace(char * trace_filename);
+int trace_enabled();
+double start_trace_event();
+void end_trace_event(char * event_name, int node_id, double start_microseconds);
+int index_of_traced_thread(pthread_t thread);
+double trace_time_in_microseconds();
+void write_trace();
+
+#endif
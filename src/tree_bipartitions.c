@@ -0,0 +1,141 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "tree_bipartitions.h"
+#include "tree_traversal.h"
+#include "profile.h"
+
+void get_tree_bipartitions(newick_node * root, tree_bipartitions * bipartitions)
+{
+	tree_traversal traversal;
+	int i;
+	build_tree_traversal(root, &traversal);
+	uint64_t * leaf_sums = (uint64_t *) calloc(traversal.number_of_nodes, sizeof(uint64_t));
+	tree_split * splits = (tree_split *) calloc(traversal.number_of_nodes, sizeof(tree_split));
+	
+	for(i = 0; i < traversal.number_of_nodes; i++)
+	{
+		newick_node * node = traversal.post_order[i];
+		if(node->childNum == 0)
+		{
+			leaf_sums[node->traversal_index] = hash_taxon_name(node->taxon);
+			continue;
+		}
+		newick_child * child;
+		for(child = node->child; child != NULL; child = child->next)
+		{
+			leaf_sums[node->traversal_index] += leaf_sums[child->node->traversal_index];
+		}
+	}
+	
+	// Both edges below a root with two children make the same split, so they are merged by sorting
+	uint64_t all_leaves = leaf_sums[root->traversal_index];
+	int number_of_splits = 0;
+	for(i = 0; i < traversal.number_of_nodes; i++)
+	{
+		newick_node * node = traversal.pre_order[i];
+		uint64_t split = leaf_sums[node->traversal_index];
+		uint64_t complement = all_leaves - split;
+		if(node == root || split == 0 || complement == 0)
+		{
+			continue;
+		}
+		splits[number_of_splits].split = (split < complement) ? split : complement;
+		// The tree is written with 6 decimal places, so anything shorter is read back as zero
+		splits[number_of_splits].has_length = (fabs(node->dist) > 0.0000005) ? 1 : 0;
+		number_of_splits++;
+	}
+	qsort(splits, number_of_splits, sizeof(tree_split), compare_tree_splits);
+	
+	bipartitions->topology_hash = 0;
+	bipartitions->weighted_topology_hash = 0;
+	bipartitions->number_of_splits = 0;
+	i = 0;
+	while(i < number_of_splits)
+	{
+		int has_length = 0;
+		int j = i;
+		for(; j < number_of_splits && splits[j].split == splits[i].split; j++)
+		{
+			has_length |= splits[j].has_length;
+		}
+		uint64_t split_hash = mix_split_hash(splits[i].split);
+		bipartitions->topology_hash += split_hash;
+		if(has_length)
+		{
+			bipartitions->weighted_topology_hash += split_hash;
+		}
+		bipartitions->number_of_splits++;
+		i = j;
+	}
+	
+	free(splits);
+	free(leaf_sums);
+	free_tree_traversal(&traversal);
+}
+
+// Both hashes and the number of splits, on one line
+void write_tree_bipartitions(newick_node * root, char filename[])
+{
+	tree_bipartitions bipartitions;
+	get_tree_bipartitions(root, &bipartitions);
+	
+	FILE * bipartitions_file_pointer = fopen(filename, "w");
+	if(bipartitions_file_pointer == NULL)
+	{
+		printf("Cannot write the tree bipartitions to '%s'\n", filename);
+		exit(1);
+	}
+	record_profile_output_file(filename);
+	fprintf(bipartitions_file_pointer, "%016llx %016llx %d\n", (unsigned long long) bipartitions.topology_hash, (unsigned long long) bipartitions.weighted_topology_hash, bipartitions.number_of_splits);
+	fclose(bipartitions_file_pointer);
+}
+
+// FNV-1a then mixed, so the sums of the hashes of different sets of leaves are unlikely to collide
+uint64_t hash_taxon_name(char * taxon)
+{
+	uint64_t hash = 14695981039346656037ULL;
+	for(; *taxon != '\0'; taxon++)
+	{
+		hash ^= (unsigned char) *taxon;
+		hash *= 1099511628211ULL;
+	}
+	return mix_split_hash(hash);
+}
+
+uint64_t mix_split_hash(uint64_t hash)
+{
+	hash ^= hash >> 30;
+	hash *= 0xbf58476d1ce4e5b9ULL;
+	hash ^= hash >> 27;
+	hash *= 0x94d049bb133111ebULL;
+	hash ^= hash >> 31;
+	return hash;
+}
+
+int compare_tree_splits(const void * a, const void * b)
+{
+	uint64_t split_a = ((const tree_split *) a)->split;
+	uint64_t split_b = ((const tree_split *) b)->split;
+	return (split_a > split_b) - (split_a < split_b);
+}
@@ -0,0 +1,48 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _TREE_BIPARTITIONS_H_
+#define _TREE_BIPARTITIONS_H_
+#include <stdint.h>
+#include "Newickform.h"
+
+// The splits of the leaves made by the edges of a tree, each as the sum of the hashes of the leaves on one side,
+// taking the smaller of the sum and its complement so the splits dont depend on where the tree is rooted.
+// The topology hash covers every split, and the weighted hash only those with a length which would be printed
+// as more than zero, as both robinson foulds distances are zero only if those sets of splits are the same.
+typedef struct tree_bipartitions
+{
+	uint64_t topology_hash;
+	uint64_t weighted_topology_hash;
+	int number_of_splits;
+} tree_bipartitions;
+
+typedef struct tree_split
+{
+	uint64_t split;
+	int has_length;
+} tree_split;
+
+void get_tree_bipartitions(newick_node * root, tree_bipartitions * bipartitions);
+void write_tree_bipartitions(newick_node * root, char filename[]);
+uint64_t hash_taxon_name(char * taxon);
+uint64_t mix_split_hash(uint64_t hash);
+int compare_tree_splits(const void * a, const void * b);
+
+#endif
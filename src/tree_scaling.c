@@ -23,48 +23,37 @@
 #include "seqUtil.h"
 #include "Newickform.h"
 #include "tree_scaling.h"
+#include "tree_traversal.h"
 
 void scale_branch_distances(newick_node * root_node, int number_of_filtered_snps)
 {
-
-	if (root_node->childNum == 0)
-	{
-		root_node->dist = (root_node->dist * number_of_filtered_snps);
-	}
-	else
+	tree_traversal traversal;
+	int i;
+	build_tree_traversal(root_node, &traversal);
+	for(i = 0; i < traversal.number_of_nodes; i++)
 	{
-		root_node->dist = root_node->dist * number_of_filtered_snps;
-		newick_child *child;
-		child = root_node->child;
-		while (child != NULL)
-		{
-			scale_branch_distances(child->node, number_of_filtered_snps);
-			child = child->next;
-		}
+		traversal.pre_order[i]->dist = traversal.pre_order[i]->dist * number_of_filtered_snps;
 	}
+	free_taxon_sets(root_node);
+	free_tree_traversal(&traversal);
 }
 
 
 void cleanup_node_memory(newick_node * root_node)
 {
-  free(root_node->recombinations);
-	free(root_node->taxon_names);
-	free(root_node->seq);
-	free(root_node->block_coordinates[0]);
-	free(root_node->block_coordinates[1]);
-	free(root_node->block_coordinates);
-
-	if (root_node->childNum == 0)
-	{
-	}
-	else
+	tree_traversal traversal;
+	int i;
+	build_tree_traversal(root_node, &traversal);
+	for(i = 0; i < traversal.number_of_nodes; i++)
 	{
-		newick_child *child;
-		child = root_node->child;
-		while (child != NULL)
-		{
-			cleanup_node_memory(child->node);
-			child = child->next;
-		}
+		newick_node * node = traversal.pre_order[i];
+		free(node->recombinations);
+		free(node->seq);
+		free(node->block_coordinates[0]);
+		free(node->block_coordinates[1]);
+		free(node->block_coordinates);
+		free(node->block_snp_counts);
+		free(node->block_likelihoods);
 	}
+	free_tree_traversal(&traversal);
 }
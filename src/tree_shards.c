@@ -0,0 +1,128 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "tree_shards.h"
+#include "tree_traversal.h"
+
+void plan_tree_shards(newick_node * root, int maximum_leaves_per_shard, tree_shard_plan * plan)
+{
+	tree_traversal traversal;
+	int i;
+	build_tree_traversal(root, &traversal);
+	memset(plan, 0, sizeof(tree_shard_plan));
+	plan->number_of_nodes_in_tree = traversal.number_of_nodes;
+	plan->cut_roots = (newick_node **) calloc(traversal.number_of_nodes +1, sizeof(newick_node *));
+	plan->shard_of_cut_root = (int *) calloc(traversal.number_of_nodes +1, sizeof(int));
+	plan->leaves_under_cut_root = (int *) calloc(traversal.number_of_nodes +1, sizeof(int));
+	
+	// Children come before their parents, so the leaves under each node are added up in one pass
+	int * leaves_under_node = (int *) calloc(traversal.number_of_nodes +1, sizeof(int));
+	for(i = 0; i < traversal.number_of_nodes; i++)
+	{
+		newick_node * node = traversal.post_order[i];
+		newick_child * child;
+		if(node->childNum == 0)
+		{
+			leaves_under_node[node->traversal_index] = 1;
+		}
+		for(child = node->child; child != NULL; child = child->next)
+		{
+			leaves_under_node[node->traversal_index] += leaves_under_node[child->node->traversal_index];
+		}
+	}
+	
+	// A leaf on its own has no branches to scan, so only internal nodes are cut. The subtrees are packed into
+	// shards in the order they come in the tree, starting a new shard when the next one no longer fits.
+	int leaves_in_shard = 0;
+	for(i = 0; i < traversal.number_of_nodes; i++)
+	{
+		newick_node * node = traversal.pre_order[i];
+		int leaves = leaves_under_node[node->traversal_index];
+		if(node->childNum == 0 || leaves > maximum_leaves_per_shard ||
+		   (node->parent != NULL && node != root && leaves_under_node[node->parent->traversal_index] <= maximum_leaves_per_shard))
+		{
+			continue;
+		}
+		if(plan->number_of_shards == 0 || leaves_in_shard + leaves > maximum_leaves_per_shard)
+		{
+			plan->number_of_shards++;
+			leaves_in_shard = 0;
+		}
+		leaves_in_shard += leaves;
+		plan->cut_roots[plan->number_of_cut_roots] = node;
+		plan->shard_of_cut_root[plan->number_of_cut_roots] = plan->number_of_shards - 1;
+		plan->leaves_under_cut_root[plan->number_of_cut_roots] = leaves;
+		plan->number_of_cut_roots++;
+	}
+	free(leaves_under_node);
+	free_tree_traversal(&traversal);
+}
+
+void free_tree_shard_plan(tree_shard_plan * plan)
+{
+	free(plan->cut_roots);
+	free(plan->shard_of_cut_root);
+	free(plan->leaves_under_cut_root);
+	memset(plan, 0, sizeof(tree_shard_plan));
+}
+
+// The names of every node under the cut roots of the shard, which are the only sequences it needs.
+// sample_names needs room for all of the nodes in the tree.
+int get_sample_names_in_tree_shard(tree_shard_plan * plan, int shard_index, char ** sample_names)
+{
+	int number_of_sample_names = 0;
+	int i, j;
+	for(i = 0; i < plan->number_of_cut_roots; i++)
+	{
+		if(plan->shard_of_cut_root[i] != shard_index)
+		{
+			continue;
+		}
+		tree_traversal traversal;
+		build_tree_traversal(plan->cut_roots[i], &traversal);
+		for(j = 0; j < traversal.number_of_nodes; j++)
+		{
+			sample_names[number_of_sample_names] = traversal.pre_order[j]->taxon;
+			number_of_sample_names++;
+		}
+		free_tree_traversal(&traversal);
+	}
+	return number_of_sample_names;
+}
+
+// Every node under a cut root apart from the cut root itself has its branch scanned in the shard
+int get_number_of_branches_in_tree_shard(tree_shard_plan * plan, int shard_index)
+{
+	int number_of_branches = 0;
+	int i;
+	for(i = 0; i < plan->number_of_cut_roots; i++)
+	{
+		if(plan->shard_of_cut_root[i] == shard_index)
+		{
+			tree_traversal traversal;
+			build_tree_traversal(plan->cut_roots[i], &traversal);
+			number_of_branches += traversal.number_of_nodes - 1;
+			free_tree_traversal(&traversal);
+		}
+	}
+	return number_of_branches;
+}
@@ -0,0 +1,43 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _TREE_SHARDS_H_
+#define _TREE_SHARDS_H_
+
+#include "Newickform.h"
+
+// The tree cut into subtrees of at most a number of leaves, which are packed into shards that can each be scanned on a
+// different machine with only the sequences of their own nodes. Each cut root is the top of the biggest subtree
+// under the limit, and the branches above the cut roots are left to the run which puts the shards back together.
+typedef struct tree_shard_plan
+{
+	newick_node ** cut_roots;
+	int * shard_of_cut_root;
+	int * leaves_under_cut_root;
+	int number_of_cut_roots;
+	int number_of_shards;
+	int number_of_nodes_in_tree;
+} tree_shard_plan;
+
+void plan_tree_shards(newick_node * root, int maximum_leaves_per_shard, tree_shard_plan * plan);
+void free_tree_shard_plan(tree_shard_plan * plan);
+int get_sample_names_in_tree_shard(tree_shard_plan * plan, int shard_index, char ** sample_names);
+int get_number_of_branches_in_tree_shard(tree_shard_plan * plan, int shard_index);
+
+#endif
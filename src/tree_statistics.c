@@ -23,9 +23,14 @@
 #include "parse_phylip.h"
 #include "tree_statistics.h"
 #include "string_cat.h"
+#include "output_selection.h"
 
 void create_tree_statistics_file(char filename[], sample_statistics ** statistics_for_samples, int number_of_samples)
 {
+	if(!is_output_selected(GUBBINS_OUTPUT_STATS))
+	{
+		return;
+	}
 	FILE *file_pointer;
 	int sample_counter;
 	char * base_filename;
@@ -52,7 +57,6 @@ void create_tree_statistics_file(char filename[], sample_statistics ** statistic
 		fprintf( file_pointer, "%i", sample_details->genome_length_excluding_blocks_and_gaps);
 		fprintf( file_pointer, "\n");
 
-    	free(sample_details->sample_name);
 		free(sample_details);
 	}
 	
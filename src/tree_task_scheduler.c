@@ -0,0 +1,401 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "tree_task_scheduler.h"
+
+// Never more workers than nodes, so every worker can have something to do
+int get_number_of_tree_task_workers(tree_traversal * traversal, int num_threads)
+{
+	int number_of_workers = num_threads;
+	if(number_of_workers > traversal->number_of_nodes)
+	{
+		number_of_workers = traversal->number_of_nodes;
+	}
+	if(number_of_workers < 1)
+	{
+		number_of_workers = 1;
+	}
+	return number_of_workers;
+}
+
+// The priority of a node is the cost of the longest chain of tasks starting with it. Going up the tree every
+// ancestor waits for the node, and going down every descendant does, so it is the node that holds up the
+// most work which gets run first.
+void calculate_critical_path_priorities(tree_traversal * traversal, int post_order, double * node_costs, double * priorities)
+{
+	int i;
+	newick_node * root = traversal->pre_order[0];
+	if(post_order)
+	{
+		for(i = 0; i < traversal->number_of_nodes; i++)
+		{
+			newick_node * node = traversal->pre_order[i];
+			priorities[node->traversal_index] = node_costs[node->traversal_index];
+			if(node != root)
+			{
+				priorities[node->traversal_index] += priorities[node->parent->traversal_index];
+			}
+		}
+	}
+	else
+	{
+		for(i = 0; i < traversal->number_of_nodes; i++)
+		{
+			newick_node * node = traversal->post_order[i];
+			double longest_child_chain = 0;
+			newick_child * child = node->child;
+			while(child != NULL)
+			{
+				if(priorities[child->node->traversal_index] > longest_child_chain)
+				{
+					longest_child_chain = priorities[child->node->traversal_index];
+				}
+				child = child->next;
+			}
+			priorities[node->traversal_index] = node_costs[node->traversal_index] + longest_child_chain;
+		}
+	}
+}
+
+// Each worker starts on its own share of the nodes which are ready straight away, and after that makes ready the
+// nodes which were waiting on the ones it finishes. Only a worker which runs out takes from the others.
+void run_tree_tasks(tree_traversal * traversal, int post_order, double * priorities, int num_threads, tree_task_function run_task, void * context)
+{
+	int i;
+	tree_task_scheduler scheduler;
+	scheduler.traversal = traversal;
+	scheduler.post_order = post_order;
+	scheduler.priorities = priorities;
+	scheduler.run_task = run_task;
+	scheduler.context = context;
+	scheduler.number_of_workers = get_number_of_tree_task_workers(traversal, num_threads);
+	scheduler.next_worker_index = 0;
+	scheduler.number_of_queued_tasks = 0;
+	scheduler.number_of_unfinished_tasks = traversal->number_of_nodes;
+	pthread_mutex_init(&(scheduler.lock), NULL);
+	pthread_cond_init(&(scheduler.tasks_available), NULL);
+	
+	scheduler.queues = (tree_task_queue *) calloc(scheduler.number_of_workers, sizeof(tree_task_queue));
+	for(i = 0; i < scheduler.number_of_workers; i++)
+	{
+		scheduler.queues[i].tasks = (newick_node **) calloc(traversal->number_of_nodes+1, sizeof(newick_node *));
+		pthread_mutex_init(&(scheduler.queues[i].lock), NULL);
+	}
+	scheduler.ready_children = (newick_node **) calloc(scheduler.number_of_workers*(traversal->maximum_number_of_children+1), sizeof(newick_node *));
+	scheduler.unfinished_dependencies = (int *) calloc(traversal->number_of_nodes+1, sizeof(int));
+	
+	if(post_order)
+	{
+		// The leaves are dealt out in order of priority, so the highest ones go to different workers and each
+		// worker starts with the highest of its own
+		newick_node ** leaves = (newick_node **) calloc(traversal->number_of_nodes+1, sizeof(newick_node *));
+		int number_of_leaves = 0;
+		for(i = 0; i < traversal->number_of_nodes; i++)
+		{
+			newick_node * node = traversal->pre_order[i];
+			scheduler.unfinished_dependencies[node->traversal_index] = node->childNum;
+			if(node->childNum == 0)
+			{
+				leaves[number_of_leaves] = node;
+				number_of_leaves++;
+			}
+		}
+		sort_tree_tasks_by_priority(leaves, number_of_leaves, priorities);
+		for(i = 0; i < number_of_leaves; i++)
+		{
+			push_tree_task(&scheduler, i % scheduler.number_of_workers, leaves[i]);
+		}
+		free(leaves);
+	}
+	else
+	{
+		// Every other node only waits on its parent, so is ready as soon as the parent is finished
+		push_tree_task(&scheduler, 0, traversal->pre_order[0]);
+	}
+	
+	pthread_t workers[scheduler.number_of_workers];
+	for(i = 0; i < scheduler.number_of_workers; i++)
+	{
+		if(pthread_create(&workers[i], NULL, run_tree_tasks_worker, &scheduler) != 0)
+		{
+			printf("Couldnt create a thread for the tasks of the tree\n");
+			exit(1);
+		}
+	}
+	for(i = 0; i < scheduler.number_of_workers; i++)
+	{
+		pthread_join(workers[i], NULL);
+	}
+	
+	for(i = 0; i < scheduler.number_of_workers; i++)
+	{
+		pthread_mutex_destroy(&(scheduler.queues[i].lock));
+		free(scheduler.queues[i].tasks);
+	}
+	free(scheduler.queues);
+	free(scheduler.ready_children);
+	free(scheduler.unfinished_dependencies);
+	pthread_cond_destroy(&(scheduler.tasks_available));
+	pthread_mutex_destroy(&(scheduler.lock));
+}
+
+void * run_tree_tasks_worker(void * scheduler_pointer)
+{
+	tree_task_scheduler * scheduler = (tree_task_scheduler *) scheduler_pointer;
+	pthread_mutex_lock(&(scheduler->lock));
+	int worker_index = scheduler->next_worker_index;
+	scheduler->next_worker_index++;
+	pthread_mutex_unlock(&(scheduler->lock));
+	
+	while(1)
+	{
+		newick_node * node = take_tree_task(scheduler, worker_index);
+		if(node == NULL)
+		{
+			node = steal_tree_task(scheduler, worker_index);
+		}
+		if(node != NULL)
+		{
+			scheduler->run_task(node, worker_index, scheduler->context);
+			finish_tree_task(scheduler, worker_index, node);
+			continue;
+		}
+		
+		// Nothing is ready, so wait for another worker to finish a node
+		pthread_mutex_lock(&(scheduler->lock));
+		while(scheduler->number_of_queued_tasks <= 0 && scheduler->number_of_unfinished_tasks > 0)
+		{
+			pthread_cond_wait(&(scheduler->tasks_available), &(scheduler->lock));
+		}
+		int all_tasks_finished = (scheduler->number_of_unfinished_tasks == 0);
+		pthread_mutex_unlock(&(scheduler->lock));
+		if(all_tasks_finished)
+		{
+			break;
+		}
+	}
+	return NULL;
+}
+
+void push_tree_task(tree_task_scheduler * scheduler, int worker_index, newick_node * node)
+{
+	tree_task_queue * queue = &(scheduler->queues[worker_index]);
+	pthread_mutex_lock(&(queue->lock));
+	queue->tasks[queue->end_of_tasks] = node;
+	queue->end_of_tasks++;
+	pthread_mutex_unlock(&(queue->lock));
+	
+	pthread_mutex_lock(&(scheduler->lock));
+	scheduler->number_of_queued_tasks++;
+	pthread_cond_signal(&(scheduler->tasks_available));
+	pthread_mutex_unlock(&(scheduler->lock));
+}
+
+// The lowest priority goes in first, so the worker takes the highest next
+void push_tree_tasks_by_priority(tree_task_scheduler * scheduler, int worker_index, newick_node ** nodes, int number_of_nodes)
+{
+	int i;
+	sort_tree_tasks_by_priority(nodes, number_of_nodes, scheduler->priorities);
+	for(i = 0; i < number_of_nodes; i++)
+	{
+		push_tree_task(scheduler, worker_index, nodes[i]);
+	}
+}
+
+// Lowest priority first. There are only ever a few children, and the leaves are only sorted once.
+void sort_tree_tasks_by_priority(newick_node ** nodes, int number_of_nodes, double * priorities)
+{
+	int i, j;
+	if(number_of_nodes > 16)
+	{
+		sort_many_tree_tasks_by_priority(nodes, number_of_nodes, priorities);
+		return;
+	}
+	for(i = 1; i < number_of_nodes; i++)
+	{
+		newick_node * node = nodes[i];
+		for(j = i; j > 0 && priorities[nodes[j-1]->traversal_index] > priorities[node->traversal_index]; j--)
+		{
+			nodes[j] = nodes[j-1];
+		}
+		nodes[j] = node;
+	}
+}
+
+int compare_prioritised_tree_tasks(const void * a, const void * b)
+{
+	const prioritised_tree_task * task_a = (const prioritised_tree_task *) a;
+	const prioritised_tree_task * task_b = (const prioritised_tree_task *) b;
+	if(task_a->priority != task_b->priority)
+	{
+		return (task_a->priority < task_b->priority) ? -1 : 1;
+	}
+	return task_a->node->traversal_index - task_b->node->traversal_index;
+}
+
+void sort_many_tree_tasks_by_priority(newick_node ** nodes, int number_of_nodes, double * priorities)
+{
+	int i;
+	prioritised_tree_task * tasks = (prioritised_tree_task *) calloc(number_of_nodes, sizeof(prioritised_tree_task));
+	for(i = 0; i < number_of_nodes; i++)
+	{
+		tasks[i].node = nodes[i];
+		tasks[i].priority = priorities[nodes[i]->traversal_index];
+	}
+	qsort(tasks, number_of_nodes, sizeof(prioritised_tree_task), compare_prioritised_tree_tasks);
+	for(i = 0; i < number_of_nodes; i++)
+	{
+		nodes[i] = tasks[i].node;
+	}
+	free(tasks);
+}
+
+void count_taken_tree_task(tree_task_scheduler * scheduler)
+{
+	pthread_mutex_lock(&(scheduler->lock));
+	scheduler->number_of_queued_tasks--;
+	pthread_mutex_unlock(&(scheduler->lock));
+}
+
+// A worker carries on from the node it made ready last, which is usually next to the one it just finished
+newick_node * take_tree_task(tree_task_scheduler * scheduler, int worker_index)
+{
+	newick_node * node = NULL;
+	tree_task_queue * queue = &(scheduler->queues[worker_index]);
+	pthread_mutex_lock(&(queue->lock));
+	if(queue->end_of_tasks > queue->first_task)
+	{
+		queue->end_of_tasks--;
+		node = queue->tasks[queue->end_of_tasks];
+	}
+	pthread_mutex_unlock(&(queue->lock));
+	if(node != NULL)
+	{
+		count_taken_tree_task(scheduler);
+	}
+	return node;
+}
+
+// Takes the highest priority node from either end of any other worker's queue
+newick_node * steal_tree_task(tree_task_scheduler * scheduler, int worker_index)
+{
+	int i;
+	int victim_index = -1;
+	double highest_priority = 0;
+	for(i = 1; i < scheduler->number_of_workers; i++)
+	{
+		tree_task_queue * queue = &(scheduler->queues[(worker_index + i) % scheduler->number_of_workers]);
+		pthread_mutex_lock(&(queue->lock));
+		if(queue->end_of_tasks > queue->first_task)
+		{
+			double priority = highest_priority_at_either_end(scheduler, queue);
+			if(victim_index < 0 || priority > highest_priority)
+			{
+				victim_index = (worker_index + i) % scheduler->number_of_workers;
+				highest_priority = priority;
+			}
+		}
+		pthread_mutex_unlock(&(queue->lock));
+	}
+	if(victim_index < 0)
+	{
+		return NULL;
+	}
+	
+	// The queue could have changed since it was looked at, so the ends are compared again
+	newick_node * node = NULL;
+	tree_task_queue * queue = &(scheduler->queues[victim_index]);
+	pthread_mutex_lock(&(queue->lock));
+	if(queue->end_of_tasks > queue->first_task)
+	{
+		newick_node * first_node = queue->tasks[queue->first_task];
+		newick_node * last_node = queue->tasks[queue->end_of_tasks - 1];
+		if(scheduler->priorities[first_node->traversal_index] > scheduler->priorities[last_node->traversal_index])
+		{
+			node = first_node;
+			queue->first_task++;
+		}
+		else
+		{
+			node = last_node;
+			queue->end_of_tasks--;
+		}
+	}
+	pthread_mutex_unlock(&(queue->lock));
+	if(node != NULL)
+	{
+		count_taken_tree_task(scheduler);
+	}
+	return node;
+}
+
+// Only call this with the queue locked and not empty
+double highest_priority_at_either_end(tree_task_scheduler * scheduler, tree_task_queue * queue)
+{
+	double first_priority = scheduler->priorities[queue->tasks[queue->first_task]->traversal_index];
+	double last_priority = scheduler->priorities[queue->tasks[queue->end_of_tasks - 1]->traversal_index];
+	return (first_priority > last_priority) ? first_priority : last_priority;
+}
+
+// Makes ready the nodes which were only waiting on this one. They go on the worker's own queue, so it carries on
+// down (or up) the same part of the tree.
+void finish_tree_task(tree_task_scheduler * scheduler, int worker_index, newick_node * node)
+{
+	newick_node * root = scheduler->traversal->pre_order[0];
+	if(scheduler->post_order)
+	{
+		int parent_is_ready = 0;
+		pthread_mutex_lock(&(scheduler->lock));
+		if(node != root)
+		{
+			scheduler->unfinished_dependencies[node->parent->traversal_index]--;
+			parent_is_ready = (scheduler->unfinished_dependencies[node->parent->traversal_index] == 0);
+		}
+		pthread_mutex_unlock(&(scheduler->lock));
+		if(parent_is_ready)
+		{
+			push_tree_task(scheduler, worker_index, node->parent);
+		}
+	}
+	else
+	{
+		newick_node ** ready_children = scheduler->ready_children + worker_index*(scheduler->traversal->maximum_number_of_children+1);
+		int number_of_ready_children = 0;
+		newick_child * child = node->child;
+		while(child != NULL)
+		{
+			ready_children[number_of_ready_children] = child->node;
+			number_of_ready_children++;
+			child = child->next;
+		}
+		push_tree_tasks_by_priority(scheduler, worker_index, ready_children, number_of_ready_children);
+	}
+	
+	// Only after anything it made ready is queued, so the workers cant see no tasks left while there are some
+	pthread_mutex_lock(&(scheduler->lock));
+	scheduler->number_of_unfinished_tasks--;
+	if(scheduler->number_of_unfinished_tasks == 0)
+	{
+		pthread_cond_broadcast(&(scheduler->tasks_available));
+	}
+	pthread_mutex_unlock(&(scheduler->lock));
+}
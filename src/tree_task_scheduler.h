@@ -0,0 +1,84 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _TREE_TASK_SCHEDULER_H_
+#define _TREE_TASK_SCHEDULER_H_
+#include <pthread.h>
+#include "Newickform.h"
+#include "tree_traversal.h"
+
+// The work for one node of a tree, run on a worker thread once the nodes it depends on are finished
+typedef void (*tree_task_function)(newick_node * node, int worker_index, void * context);
+
+// The ready nodes of one worker. The worker takes from the end it last added to, the other workers take
+// whichever end has the higher priority. Every node is only added once, so nothing is ever moved up.
+typedef struct tree_task_queue
+{
+	newick_node ** tasks;
+	int first_task;
+	int end_of_tasks;
+	pthread_mutex_t lock;
+} tree_task_queue;
+
+// A node with its priority, for sorting a lot of them at once
+typedef struct prioritised_tree_task
+{
+	newick_node * node;
+	double priority;
+} prioritised_tree_task;
+
+// Runs a task for each node of a traversal, either after all of its children (post-order) or after its
+// parent (pre-order). Nodes with a higher priority are run first when there is a choice.
+typedef struct tree_task_scheduler
+{
+	tree_traversal * traversal;
+	int post_order;
+	double * priorities;
+	int * unfinished_dependencies;
+	tree_task_queue * queues;
+	newick_node ** ready_children;
+	int number_of_workers;
+	int next_worker_index;
+	int number_of_queued_tasks;
+	int number_of_unfinished_tasks;
+	pthread_mutex_t lock;
+	pthread_cond_t tasks_available;
+	tree_task_function run_task;
+	void * context;
+} tree_task_scheduler;
+
+void run_tree_tasks(tree_traversal * traversal, int post_order, double * priorities, int num_threads, tree_task_function run_task, void * context);
+int get_number_of_tree_task_workers(tree_traversal * traversal, int num_threads);
+void calculate_critical_path_priorities(tree_traversal * traversal, int post_order, double * node_costs, double * priorities);
+void * run_tree_tasks_worker(void * scheduler_pointer);
+void push_tree_task(tree_task_scheduler * scheduler, int worker_index, newick_node * node);
+void push_tree_tasks_by_priority(tree_task_scheduler * scheduler, int worker_index, newick_node ** nodes, int number_of_nodes);
+void sort_tree_tasks_by_priority(newick_node ** nodes, int number_of_nodes, double * priorities);
+void sort_many_tree_tasks_by_priority(newick_node ** nodes, int number_of_nodes, double * priorities);
+int compare_prioritised_tree_tasks(const void * a, const void * b);
+void count_taken_tree_task(tree_task_scheduler * scheduler);
+newick_node * take_tree_task(tree_task_scheduler * scheduler, int worker_index);
+newick_node * steal_tree_task(tree_task_scheduler * scheduler, int worker_index);
+double highest_priority_at_either_end(tree_task_scheduler * scheduler, tree_task_queue * queue);
+void finish_tree_task(tree_task_scheduler * scheduler, int worker_index, newick_node * node);
+
+#define TREE_TASKS_PRE_ORDER 0
+#define TREE_TASKS_POST_ORDER 1
+
+#endif
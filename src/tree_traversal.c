@@ -0,0 +1,89 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "tree_traversal.h"
+
+// Walks the tree with an explicit stack of child iterators instead of recursion, so the depth of the tree
+// is only limited by memory. A node goes into pre_order when it is reached and into post_order when its
+// last child is finished.
+void build_tree_traversal(newick_node * root, tree_traversal * traversal)
+{
+	int capacity = 64;
+	int number_of_finished_nodes = 0;
+	int depth = 0;
+	newick_node ** open_nodes = (newick_node **) malloc(capacity*sizeof(newick_node *));
+	newick_child ** next_children = (newick_child **) malloc(capacity*sizeof(newick_child *));
+	traversal->pre_order = (newick_node **) malloc(capacity*sizeof(newick_node *));
+	traversal->post_order = (newick_node **) malloc(capacity*sizeof(newick_node *));
+	traversal->number_of_nodes = 0;
+	traversal->maximum_number_of_children = 0;
+	
+	newick_node * node = root;
+	while(node != NULL)
+	{
+		if(traversal->number_of_nodes == capacity)
+		{
+			capacity *= 2;
+			open_nodes = (newick_node **) realloc(open_nodes, capacity*sizeof(newick_node *));
+			next_children = (newick_child **) realloc(next_children, capacity*sizeof(newick_child *));
+			traversal->pre_order = (newick_node **) realloc(traversal->pre_order, capacity*sizeof(newick_node *));
+			traversal->post_order = (newick_node **) realloc(traversal->post_order, capacity*sizeof(newick_node *));
+		}
+		node->traversal_index = traversal->number_of_nodes;
+		traversal->pre_order[traversal->number_of_nodes] = node;
+		traversal->number_of_nodes++;
+		if(node->childNum > traversal->maximum_number_of_children)
+		{
+			traversal->maximum_number_of_children = node->childNum;
+		}
+		open_nodes[depth] = node;
+		next_children[depth] = node->child;
+		depth++;
+		
+		// Finish every node which has no children left, then move on to the next child of the deepest open node
+		node = NULL;
+		while(depth > 0 && node == NULL)
+		{
+			if(next_children[depth-1] == NULL)
+			{
+				depth--;
+				traversal->post_order[number_of_finished_nodes] = open_nodes[depth];
+				number_of_finished_nodes++;
+			}
+			else
+			{
+				node = next_children[depth-1]->node;
+				next_children[depth-1] = next_children[depth-1]->next;
+			}
+		}
+	}
+	free(open_nodes);
+	free(next_children);
+}
+
+void free_tree_traversal(tree_traversal * traversal)
+{
+	free(traversal->pre_order);
+	free(traversal->post_order);
+	traversal->pre_order = NULL;
+	traversal->post_order = NULL;
+	traversal->number_of_nodes = 0;
+}
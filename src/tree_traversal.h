@@ -0,0 +1,38 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _TREE_TRAVERSAL_H_
+#define _TREE_TRAVERSAL_H_
+#include "Newickform.h"
+
+// The nodes of a tree in pre-order (each node before its children) and post-order (each node after its
+// children), with the children in the order they appear in the tree. Each node's traversal_index is its
+// position in pre_order, so per node state can be kept in flat arrays.
+typedef struct tree_traversal
+{
+	newick_node ** pre_order;
+	newick_node ** post_order;
+	int number_of_nodes;
+	int maximum_number_of_children;
+} tree_traversal;
+
+void build_tree_traversal(newick_node * root, tree_traversal * traversal);
+void free_tree_traversal(tree_traversal * traversal);
+
+#endif
@@ -27,9 +27,21 @@
 #include "snp_sites.h"
 #include "parse_phylip.h"
 #include "string_cat.h"
+#include "output_buffer.h"
+#include "bgzf_file.h"
+#include "contigs.h"
 
 
-void create_vcf_file(char filename[], int snp_locations[],int number_of_snps, char ** bases_for_snps, char ** sequence_names, int number_of_samples,int internal_nodes[], int offset, int length_of_original_genome)
+void create_vcf_file(char filename[], int snp_locations[],int number_of_snps, char ** bases_for_snps, char ** sequence_names, int number_of_samples,int internal_nodes[], int offset, int length_of_original_genome, int num_threads)
+{
+	FILE *vcf_file_pointer;
+	vcf_file_pointer = open_vcf_file(filename, sequence_names, number_of_samples, internal_nodes, length_of_original_genome);
+	output_vcf_snps(vcf_file_pointer, bases_for_snps, snp_locations, number_of_snps, number_of_samples,internal_nodes,offset, num_threads);
+    fclose(vcf_file_pointer);
+}
+
+// Opens filename.vcf and writes its header, so the snps can be written after it in as many goes as needed
+FILE * open_vcf_file(char filename[], char ** sequence_names, int number_of_samples, int internal_nodes[], int length_of_original_genome)
 {
 	FILE *vcf_file_pointer;
 	char * base_filename;
@@ -37,27 +49,35 @@ void create_vcf_file(char filename[], int snp_locations[],int number_of_snps, ch
 	memcpy(base_filename, filename, (1024+1)*sizeof(char));
 	char extension[5] = {".vcf"};
 	concat_strings_created_with_malloc(base_filename,extension);
-	vcf_file_pointer=fopen(base_filename, "w");
+	vcf_file_pointer=open_output_file(base_filename);
 	output_vcf_header(vcf_file_pointer,sequence_names, number_of_samples,internal_nodes,length_of_original_genome);
-	output_vcf_snps(vcf_file_pointer, bases_for_snps, snp_locations, number_of_snps, number_of_samples,internal_nodes,offset);
-    fclose(vcf_file_pointer);
 	free(base_filename);
+	return vcf_file_pointer;
 }
 
-void output_vcf_snps(FILE * vcf_file_pointer, char ** bases_for_snps, int * snp_locations, int number_of_snps, int number_of_samples,int internal_nodes[], int offset)
+void output_vcf_snps(FILE * vcf_file_pointer, char ** bases_for_snps, int * snp_locations, int number_of_snps, int number_of_samples,int internal_nodes[], int offset, int num_threads)
 {
-	int i;
-	for(i=0; i < number_of_snps; i++)
-	{
-		output_vcf_row(vcf_file_pointer, bases_for_snps[i], snp_locations[i], number_of_samples,internal_nodes, offset);
-	}
+	output_buffer buffer;
+	vcf_rows rows;
+	rows.bases_for_snps = bases_for_snps;
+	rows.snp_locations = snp_locations;
+	rows.number_of_samples = number_of_samples;
+	rows.internal_nodes = internal_nodes;
+	rows.offset = offset;
+
+	initialise_output_buffer(&buffer, vcf_file_pointer, OUTPUT_BUFFER_SIZE);
+	write_rows(&buffer, &rows, number_of_snps, maximum_vcf_row_length, format_vcf_row_from_rows, num_threads);
+	free_output_buffer(&buffer);
 }
 
 void output_vcf_header( FILE * vcf_file_pointer, char ** sequence_names, int number_of_samples,int internal_nodes[], int length_of_original_genome)
 {
 	int i;
 	fprintf( vcf_file_pointer, "##fileformat=VCFv4.2\n" );
-	fprintf( vcf_file_pointer, "##contig=<ID=1,length=%d>\n",length_of_original_genome );
+	for(i=0; i<get_number_of_contigs(); i++)
+	{
+		fprintf( vcf_file_pointer, "##contig=<ID=%s,length=%d>\n", get_contig_name(i, "1"), get_contig_end(i, length_of_original_genome) - get_contig_start(i) );
+	}
 	fprintf( vcf_file_pointer, "##FORMAT=<ID=AB,Number=1,Type=String,Description=\"Alt Base\">\n" );
 	
 	fprintf( vcf_file_pointer, "#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\tFORMAT" );
@@ -74,49 +94,69 @@ void output_vcf_header( FILE * vcf_file_pointer, char ** sequence_names, int num
 	fprintf( vcf_file_pointer, "\n");
 }
 
-void output_vcf_row(FILE * vcf_file_pointer, char * bases_for_snp, int snp_location, int number_of_samples,int internal_nodes[], int offset)
+// The name of the snp's contig, fixed columns, a position, up to 29 characters of alt bases and then a base and a tab per sample
+size_t maximum_vcf_row_length(void * rows, int row_index)
+{
+	vcf_rows * vcf = (vcf_rows *) rows;
+	int contig_index = find_contig_for_position(vcf->snp_locations[row_index] + vcf->offset);
+	return 64 + strlen(get_contig_name(contig_index, "1")) + 2*vcf->number_of_samples;
+}
+
+size_t format_vcf_row_from_rows(void * rows, int row_index, char * destination)
+{
+	vcf_rows * vcf = (vcf_rows *) rows;
+	return format_vcf_row(destination, vcf->bases_for_snps[row_index], vcf->snp_locations[row_index], vcf->number_of_samples, vcf->internal_nodes, vcf->offset);
+}
+
+size_t format_vcf_row(char * destination, char * bases_for_snp, int snp_location, int number_of_samples,int internal_nodes[], int offset)
 {
 	char reference_base =  bases_for_snp[0];
 	char alt_bases[30];
+	size_t length = 0;
+	size_t alt_bases_length;
 	if(reference_base == '\0')
 	{
-		return;	
+		return 0;
 	}
 	
-	// Chromosome
-	fprintf( vcf_file_pointer, "1\t");
+	// Chromosome, and the position within it
+	int position = snp_location + offset;
+	int contig_index = find_contig_for_position(position);
+	char * contig_name = get_contig_name(contig_index, "1");
+	size_t contig_name_length = strlen(contig_name);
+	memcpy(destination, contig_name, contig_name_length);
+	length += contig_name_length;
+	destination[length++] = '\t';
 	
 	// Position
-	fprintf( vcf_file_pointer, "%d\t", (int) snp_location + offset);	
+	length += format_integer(destination + length, position - get_contig_start(contig_index));
+	destination[length++] = '\t';
 	
 	//ID
-	fprintf( vcf_file_pointer, ".\t");
+	destination[length++] = '.';
+	destination[length++] = '\t';
 	
 	// REF
-	fprintf( vcf_file_pointer, "%c\t", (char) reference_base );
+	destination[length++] = reference_base;
+	destination[length++] = '\t';
 	
 	// ALT
 	// Need to look through list and find unique characters
-	
 	alternative_bases(reference_base, bases_for_snp, alt_bases, number_of_samples);
-	fprintf( vcf_file_pointer, "%s\t", alt_bases);
+	alt_bases_length = strlen(alt_bases);
+	memcpy(destination + length, alt_bases, alt_bases_length);
+	length += alt_bases_length;
+	destination[length++] = '\t';
 	
-	// QUAL
-	fprintf( vcf_file_pointer, ".\t");
-	
-	// FILTER
-	fprintf( vcf_file_pointer, ".\t");
-	
-	// INFO
-	fprintf( vcf_file_pointer, ".\t");
-	
-	// FORMAT
-	fprintf( vcf_file_pointer, "AB\t");
+	// QUAL, FILTER, INFO and FORMAT
+	memcpy(destination + length, ".\t.\t.\tAB\t", 9);
+	length += 9;
 	
 	// Bases for each sample
-	output_vcf_row_samples_bases(vcf_file_pointer, reference_base, bases_for_snp, number_of_samples,internal_nodes );
+	length += format_vcf_row_samples_bases(destination + length, bases_for_snp, number_of_samples,internal_nodes );
 	
-	fprintf( vcf_file_pointer, "\n");	
+	destination[length++] = '\n';
+	return length;
 }
 
 
@@ -160,9 +200,10 @@ int check_if_char_in_string(char search_string[], char target_char, int search_s
 	return 0;
 }
 
-void output_vcf_row_samples_bases(FILE * vcf_file_pointer, char reference_base, char * bases_for_snp, int number_of_samples,int internal_nodes[])
+size_t format_vcf_row_samples_bases(char * destination, char * bases_for_snp, int number_of_samples,int internal_nodes[])
 {
 	int i;
+	size_t length = 0;
 	
 	for(i=0; i < number_of_samples ; i++ )
 	{
@@ -170,21 +211,11 @@ void output_vcf_row_samples_bases(FILE * vcf_file_pointer, char reference_base,
 		{
 			continue;
 		}
-		if(bases_for_snp[i] == reference_base)
-		{
-			fprintf( vcf_file_pointer, "%c", (char) reference_base );	
-		}
-		else
-		{
-			fprintf( vcf_file_pointer, "%c", (char) bases_for_snp[i] );	
-		}
+		destination[length++] = bases_for_snp[i];
 		if(i+1 != number_of_samples)
 		{
-			fprintf( vcf_file_pointer, "\t");
+			destination[length++] = '\t';
 		}
 	}
+	return length;
 }
-
-
-
-
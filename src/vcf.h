@@ -20,11 +20,26 @@
 #ifndef _VCF_H_
 #define _VCF_H_
 
+#include <stdio.h>
+
+// What a vcf row formatter needs to write the row for any snp
+typedef struct vcf_rows
+{
+	char ** bases_for_snps;
+	int * snp_locations;
+	int number_of_samples;
+	int * internal_nodes;
+	int offset;
+} vcf_rows;
+
 void output_vcf_header( FILE * vcf_file_pointer, char ** sequence_names, int number_of_samples,int internal_nodes[], int length_of_original_genome);
-void create_vcf_file(char filename[], int snp_locations[], int number_of_snps, char ** bases_for_snps, char ** sequence_names, int number_of_samples,int internal_nodes[], int offset, int length_of_original_genome);
-void output_vcf_snps(FILE * vcf_file_pointer, char ** bases_for_snps, int * snp_locations, int number_of_snps, int number_of_samples,int internal_nodes[], int offset);
-void output_vcf_row(FILE * vcf_file_pointer, char * bases_for_snp, int snp_location, int number_of_samples,int internal_nodes[], int offset);
-void output_vcf_row_samples_bases(FILE * vcf_file_pointer, char reference_base, char * bases_for_snp, int number_of_samples,int internal_nodes[]);
+FILE * open_vcf_file(char filename[], char ** sequence_names, int number_of_samples, int internal_nodes[], int length_of_original_genome);
+void create_vcf_file(char filename[], int snp_locations[], int number_of_snps, char ** bases_for_snps, char ** sequence_names, int number_of_samples,int internal_nodes[], int offset, int length_of_original_genome, int num_threads);
+void output_vcf_snps(FILE * vcf_file_pointer, char ** bases_for_snps, int * snp_locations, int number_of_snps, int number_of_samples,int internal_nodes[], int offset, int num_threads);
+size_t maximum_vcf_row_length(void * rows, int row_index);
+size_t format_vcf_row_from_rows(void * rows, int row_index, char * destination);
+size_t format_vcf_row(char * destination, char * bases_for_snp, int snp_location, int number_of_samples,int internal_nodes[], int offset);
+size_t format_vcf_row_samples_bases(char * destination, char * bases_for_snp, int number_of_samples,int internal_nodes[]);
 void alternative_bases(char reference_base, char * bases_for_snp, char alt_bases[], int number_of_samples);
 int check_if_char_in_string(char search_string[], char target_char, int search_string_length);
 
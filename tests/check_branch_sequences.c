@@ -2,11 +2,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <check.h>
 #include "check_branch_sequences.h"
 #include "helper_methods.h"
 
 #include "branch_sequences.h"
+#include "binomial_statistics.h"
+#include "interval_set.h"
+#include "genome_bitset.h"
+#include "contigs.h"
 
 
 
@@ -34,6 +39,30 @@ START_TEST (check_exclude_snp_sites_in_block)
 }
 END_TEST
 
+START_TEST (check_exclude_snp_sites_in_block_on_large_branch)
+{
+	// More snps than would fit on the stack
+	int number_of_branch_snps = 3000000;
+	int * snp_sites = (int *) malloc((number_of_branch_snps+1)*sizeof(int));
+	int i;
+	for(i = 0; i < number_of_branch_snps; i++)
+	{
+		snp_sites[i] = 2*i + 1;
+	}
+	
+	fail_unless(exclude_snp_sites_in_block(100, 2000000, snp_sites, number_of_branch_snps) == number_of_branch_snps - 999950);
+	fail_unless(snp_sites[49] == 99);
+	fail_unless(snp_sites[50] == 2000001);
+	fail_unless(snp_sites[number_of_branch_snps - 999951] == 2*(number_of_branch_snps-1) + 1);
+	fail_unless(snp_sites[number_of_branch_snps - 999950] == 0);
+	fail_unless(snp_sites[number_of_branch_snps - 1] == 0);
+	
+	// A block without any snps in it leaves them alone
+	fail_unless(exclude_snp_sites_in_block(100, 101, snp_sites, number_of_branch_snps - 999950) == number_of_branch_snps - 999950);
+	free(snp_sites);
+}
+END_TEST
+
 START_TEST (check_copy_and_concat_2d_integer_arrays)
 {
 	int ** block_coords;  
@@ -253,12 +282,281 @@ START_TEST (check_calculate_genome_length_clonal_frame_complex)
 }
 END_TEST
 
+START_TEST (check_get_blocks)
+{
+	int snp_locations[12] = {3,5,8,10,12,14,30,33,35,37,39,48};
+	char * original_sequence = "AANAAAA-AAAA";
+	int snp_site_coords[9] = {4,7,9,11,13,32,34,36,38};
+	candidate_block blocks[50];
+	seq_arena scratch_arena;
+	initialise_seq_arena(&scratch_arena);
+
+	fail_unless(get_blocks(blocks, 50, snp_site_coords, 9, 10, 3, original_sequence, snp_locations, 12, &scratch_arena) == 2);
+	fail_unless(blocks[0].start == 7);
+	fail_unless(blocks[0].end == 11);
+	fail_unless(blocks[1].start == 34);
+	fail_unless(blocks[1].end == 36);
+	fail_unless(blocks[1].live == 1);
+	fail_unless(blocks[1].genome_size_without_gaps == -1);
+
+	fail_unless(get_blocks(blocks, 50, snp_site_coords, 9, 10, 4, original_sequence, snp_locations, 12, &scratch_arena) == 1);
+	fail_unless(blocks[0].start == 9);
+	fail_unless(blocks[0].end == 9);
+	
+	fail_unless(get_blocks(blocks, 50, snp_site_coords, 9, 10, 5, original_sequence, snp_locations, 12, &scratch_arena) == 0);
+	free_seq_arena(&scratch_arena);
+}
+END_TEST
+
+START_TEST (check_get_blocks_stops_at_contig_ends)
+{
+	int snp_locations[12] = {3,5,8,10,12,14,30,33,35,37,39,48};
+	char * original_sequence = "AAAAAAAAAAAA";
+	int snp_site_coords[8] = {14,16,18,19,21,22,24,26};
+	candidate_block blocks[50];
+	seq_arena scratch_arena;
+	initialise_seq_arena(&scratch_arena);
+	
+	fail_unless(get_blocks(blocks, 50, snp_site_coords, 8, 10, 3, original_sequence, snp_locations, 12, &scratch_arena) == 1);
+	fail_unless(blocks[0].start == 14);
+	fail_unless(blocks[0].end == 24);
+	
+	// The same snps split into a block at the end of the chromosome and one at the start of the plasmid
+	add_contig("chromosome", 20);
+	add_contig("plasmid", 30);
+	fail_unless(get_blocks(blocks, 50, snp_site_coords, 8, 10, 3, original_sequence, snp_locations, 12, &scratch_arena) == 2);
+	fail_unless(blocks[0].start == 14);
+	fail_unless(blocks[0].end == 18);
+	fail_unless(blocks[1].start == 21);
+	fail_unless(blocks[1].end == 24);
+	clear_contigs();
+	free_seq_arena(&scratch_arena);
+}
+END_TEST
+
+START_TEST (check_binomial_statistics_match_reduce_factorial)
+{
+	initialise_log_factorial_table(1000);
+	fail_unless( fabs(log10_binomial_coefficient(10,3) - log10(120.0)) < 0.0000000001);
+	fail_unless( fabs(log10_binomial_coefficient(500,40) - (reduce_factorial(500,40) - reduce_factorial(40,40))) < 0.0000000001);
+	fail_unless( fabs(log10_binomial_coefficient(5000,17) - (reduce_factorial(5000,17) - reduce_factorial(17,17))) < 0.0000000001);
+	fail_unless( log10_binomial_coefficient(10,0) == 0.0);
+	fail_unless( isinf(log10_binomial_coefficient(10,11)));
+	fail_unless( isnan(log10_binomial_coefficient(10,12)));
+	
+	int cutoff = 0;
+	fail_unless( find_cached_cutoff(10000, 300, 50, &cutoff) == 0);
+	int calculated_cutoff = calculate_cutoff(10000, 300, 50);
+	fail_unless( find_cached_cutoff(10000, 300, 50, &cutoff) == 1);
+	fail_unless( cutoff == calculated_cutoff);
+	fail_unless( calculate_cutoff(10000, 300, 50) == calculated_cutoff);
+	free_binomial_statistics();
+	fail_unless( find_cached_cutoff(10000, 300, 50, &cutoff) == 0);
+	fail_unless( calculate_cutoff(10000, 300, 50) == calculated_cutoff);
+	free_binomial_statistics();
+}
+END_TEST
+
+START_TEST (check_scratch_arena_rewinds_and_zeroes)
+{
+	int i;
+	seq_arena arena;
+	initialise_seq_arena(&arena);
+	
+	int * first_array = (int *) seq_arena_malloc(&arena, 10*sizeof(int));
+	double * second_array = (double *) seq_arena_malloc(&arena, 3*sizeof(double));
+	fail_unless(((size_t) second_array) % SEQ_ARENA_ALIGNMENT == 0);
+	fail_unless((char *) second_array >= (char *) (first_array + 10));
+	
+	// Memory after a rewind is handed out again, and zeroed again
+	seq_arena_mark mark = seq_arena_get_mark(&arena);
+	int * scratch_array = (int *) seq_arena_malloc(&arena, 100*sizeof(int));
+	for(i = 0; i < 100; i++)
+	{
+		scratch_array[i] = i+1;
+	}
+	seq_arena_rewind(&arena, mark);
+	int * reused_array = (int *) seq_arena_malloc(&arena, 100*sizeof(int));
+	fail_unless(reused_array == scratch_array);
+	for(i = 0; i < 100; i++)
+	{
+		fail_unless(reused_array[i] == 0);
+	}
+	
+	// Allocations bigger than a chunk get a chunk of their own
+	char * large_array = (char *) seq_arena_malloc(&arena, 3*SEQ_ARENA_CHUNK_SIZE);
+	large_array[3*SEQ_ARENA_CHUNK_SIZE - 1] = 'A';
+	fail_unless(arena.current->size >= 3*SEQ_ARENA_CHUNK_SIZE);
+	fail_unless(first_array[9] == 0);
+	
+	free_seq_arena(&arena);
+	fail_unless(arena.first == NULL);
+}
+END_TEST
+
+START_TEST (check_recombination_path_keeps_parent_blocks_for_siblings)
+{
+	int parent_starts[2] = {10, 40};
+	int parent_ends[2] = {20, 50};
+	int * parent_blocks[2] = {parent_starts, parent_ends};
+	int child_starts[1] = {15};
+	int child_ends[1] = {45};
+	int * child_blocks[2] = {child_starts, child_ends};
+	int parent_recombinations[3] = {1, 2, 3};
+	int child_recombinations[1] = {7};
+	recombination_path path;
+	
+	initialise_recombination_path(&path, 10);
+	push_recombinations_onto_path(&path, parent_recombinations, 3);
+	push_blocks_onto_path(&path, parent_blocks, 2);
+	recombination_path_mark parent_mark = get_recombination_path_mark(&path);
+	
+	// The child block joins up both of the parent blocks
+	push_recombinations_onto_path(&path, child_recombinations, 1);
+	push_blocks_onto_path(&path, child_blocks, 1);
+	union_of_blocks(path.block_coordinates, path.num_blocks, &path.merged_blocks);
+	fail_unless(path.num_recombinations == 4);
+	fail_unless(path.num_blocks == 3);
+	fail_unless(path.merged_blocks.number_of_intervals == 1);
+	fail_unless(path.merged_blocks.starts[0] == 10);
+	fail_unless(path.merged_blocks.ends[0] == 50);
+	
+	// and a sibling sees the parent blocks as they were
+	rewind_recombination_path(&path, &parent_mark);
+	fail_unless(path.num_recombinations == 3);
+	fail_unless(path.num_blocks == 2);
+	fail_unless(path.block_coordinates[0][0] == 10);
+	fail_unless(path.block_coordinates[1][0] == 20);
+	fail_unless(path.block_coordinates[0][1] == 40);
+	fail_unless(path.block_coordinates[1][1] == 50);
+	free_recombination_path(&path);
+}
+END_TEST
+
+START_TEST (check_union_of_chained_overlapping_blocks)
+{
+	// Merging these one pair at a time used to leave [10,26] and [23,49] overlapping
+	int starts[8] = {54, 10, 27, 23, 39, 13, 23, -1};
+	int ends[8] = {75, 21, 27, 45, 49, 26, 23, -1};
+	int * block_coordinates[2] = {starts, ends};
+	int snp_locations[4] = {5, 30, 60, 80};
+	interval_set merged_blocks;
+	
+	initialise_interval_set(&merged_blocks);
+	union_of_blocks(block_coordinates, 8, &merged_blocks);
+	fail_unless(merged_blocks.number_of_intervals == 2);
+	fail_unless(merged_blocks.starts[0] == 10);
+	fail_unless(merged_blocks.ends[0] == 49);
+	fail_unless(merged_blocks.starts[1] == 54);
+	fail_unless(merged_blocks.ends[1] == 75);
+	free_interval_set(&merged_blocks);
+	
+	// The gaps at 30 and 60 are inside the blocks, the one at 80 isnt
+	fail_unless(calculate_number_of_bases_in_recombations_excluding_gaps(block_coordinates, 8, "A-N-", snp_locations, 4) == 58);
+	fail_unless(starts[3] == 23);
+	fail_unless(ends[3] == 45);
+}
+END_TEST
+
+START_TEST (check_genome_bitset_sets_and_counts_ranges)
+{
+	genome_bitset bitset;
+	initialise_genome_bitset(&bitset, 200);
+	set_range_in_genome_bitset(&bitset, 60, 130);
+	set_range_in_genome_bitset(&bitset, 5, 6);
+	// clipped to the end of the genome
+	set_range_in_genome_bitset(&bitset, 190, 250);
+	fail_unless(count_bits_in_genome_bitset_range(&bitset, 0, 200) == 81);
+	fail_unless(count_bits_in_genome_bitset_range(&bitset, 64, 128) == 64);
+	fail_unless(count_bits_in_genome_bitset_range(&bitset, 6, 61) == 1);
+	fail_unless(genome_bitset_is_set(&bitset, 5) == 1);
+	fail_unless(genome_bitset_is_set(&bitset, 130) == 0);
+	fail_unless(genome_bitset_is_set(&bitset, 199) == 1);
+	
+	clear_genome_bitset(&bitset);
+	fail_unless(count_bits_in_genome_bitset_range(&bitset, 0, 200) == 0);
+	free_genome_bitset(&bitset);
+}
+END_TEST
+
+START_TEST (check_branch_scan_workspace_is_reused)
+{
+	branch_scan_workspace * workspace = get_branch_scan_workspace(1);
+	int * first_branch = (int *) seq_arena_malloc(&(workspace->scratch_arena), 100*sizeof(int));
+	first_branch[99] = 5;
+	
+	// The next branch gets the same memory back, zeroed
+	reset_branch_scan_workspace(workspace);
+	int * second_branch = (int *) seq_arena_malloc(&(workspace->scratch_arena), 100*sizeof(int));
+	fail_unless(second_branch == first_branch);
+	fail_unless(second_branch[99] == 0);
+	fail_unless(get_branch_scan_workspace(0) != workspace);
+	free_branch_scan_workspaces();
+}
+END_TEST
+
+START_TEST (check_remove_overlapping_candidate_blocks)
+{
+	candidate_block candidate_blocks[4] = {{10, 20, 4, 11, 1.5, 1}, {30, 40, 4, 11, 2.5, 1}, {45, 60, 5, 16, 3.5, 1}, {70, 80, 4, 11, 4.5, 1}};
+	
+	// Touching either end counts as overlapping
+	fail_unless(remove_overlapping_candidate_blocks(candidate_blocks, 4, 40, 45) == 2);
+	fail_unless(candidate_blocks[0].start == 10);
+	fail_unless(candidate_blocks[1].end == 80);
+	fail_unless(candidate_blocks[1].genome_size_without_gaps == 11);
+	fail_unless(candidate_blocks[1].likelihood == 4.5);
+	fail_unless(remove_overlapping_candidate_blocks(candidate_blocks, 2, 21, 69) == 2);
+}
+END_TEST
+
+START_TEST (check_block_likelihoods_match_one_at_a_time)
+{
+	int block_genome_sizes[5] = {100, 250, 40, 0, 90};
+	int block_snps[5] = {10, 12, 40, 0, 30};
+	double block_likelihoods[5];
+	int i;
+	get_block_likelihoods(10000, 80, block_genome_sizes, block_snps, 5, block_likelihoods);
+	for(i = 0; i < 5; i++)
+	{
+		fail_unless(block_likelihoods[i] == get_block_likelihood(10000, 80, block_genome_sizes[i], block_snps[i]));
+	}
+}
+END_TEST
+
+START_TEST (check_edges_move_while_likelihood_improves)
+{
+	double edge_likelihoods[5] = {9.0, 8.0, 8.0, 8.5, 7.0};
+	int edge_snp_counts[5] = {9, 8, 7, 6, 5};
+	
+	// Equal likelihoods still move, and the first one which gets worse stops it
+	fail_unless(count_improving_block_edges(10.0, edge_likelihoods, edge_snp_counts, 5, 3) == 3);
+	fail_unless(count_improving_block_edges(8.5, edge_likelihoods, edge_snp_counts, 5, 3) == 0);
+	
+	// A move isnt tried from a block with fewer than min_snps
+	fail_unless(count_improving_block_edges(10.0, edge_likelihoods, edge_snp_counts, 5, 10) == 1);
+	edge_likelihoods[3] = 7.5;
+	fail_unless(count_improving_block_edges(10.0, edge_likelihoods, edge_snp_counts, 5, 3) == 5);
+}
+END_TEST
+
+START_TEST (check_smallest_log_likelihood_is_not_rounded)
+{
+	candidate_block candidate_blocks[3] = {{10, 20, 4, 11, 12.75, 1}, {30, 40, 4, 11, 12.25, 1}, {50, 60, 4, 11, 12.5, 1}};
+	fail_unless(get_smallest_log_likelihood(candidate_blocks, 3) == 1);
+	
+	// An exact tie goes to the first block
+	candidate_blocks[2].likelihood = 12.25;
+	fail_unless(get_smallest_log_likelihood(candidate_blocks, 3) == 1);
+}
+END_TEST
+
 Suite * check_branch_sequences_suite (void)
 {
   Suite *s = suite_create ("checking branch sequences");
 
   TCase *tc_branch_sequences = tcase_create ("excluding_recombinations");
 	tcase_add_test (tc_branch_sequences, check_exclude_snp_sites_in_block);
+	tcase_add_test (tc_branch_sequences, check_exclude_snp_sites_in_block_on_large_branch);
 	tcase_add_test (tc_branch_sequences, check_copy_and_concat_2d_integer_arrays);
 	tcase_add_test (tc_branch_sequences, check_calculate_number_of_bases_in_recombations);
 	tcase_add_test (tc_branch_sequences, check_get_list_of_snp_indices_which_fall_in_downstream_recombinations);
@@ -267,6 +565,18 @@ Suite * check_branch_sequences_suite (void)
 	tcase_add_test (tc_branch_sequences, check_calculate_genome_length_clonal_frame_only_gaps);
 	tcase_add_test (tc_branch_sequences, check_calculate_genome_length_clonal_frame_complex);
 	tcase_add_test (tc_branch_sequences, check_calculate_genome_length_clonal_frame_gaps_within_block);
+	tcase_add_test (tc_branch_sequences, check_get_blocks);
+	tcase_add_test (tc_branch_sequences, check_get_blocks_stops_at_contig_ends);
+	tcase_add_test (tc_branch_sequences, check_binomial_statistics_match_reduce_factorial);
+	tcase_add_test (tc_branch_sequences, check_scratch_arena_rewinds_and_zeroes);
+	tcase_add_test (tc_branch_sequences, check_recombination_path_keeps_parent_blocks_for_siblings);
+	tcase_add_test (tc_branch_sequences, check_union_of_chained_overlapping_blocks);
+	tcase_add_test (tc_branch_sequences, check_genome_bitset_sets_and_counts_ranges);
+	tcase_add_test (tc_branch_sequences, check_branch_scan_workspace_is_reused);
+	tcase_add_test (tc_branch_sequences, check_remove_overlapping_candidate_blocks);
+	tcase_add_test (tc_branch_sequences, check_smallest_log_likelihood_is_not_rounded);
+	tcase_add_test (tc_branch_sequences, check_block_likelihoods_match_one_at_a_time);
+	tcase_add_test (tc_branch_sequences, check_edges_move_while_likelihood_improves);
   suite_add_tcase (s, tc_branch_sequences);
 
   return s;
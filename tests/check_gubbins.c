@@ -1,16 +1,35 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <check.h>
 #include "check_parse_phylip.h"
 #include "helper_methods.h"
 #include "gubbins.h"
+#include "gubbins_session.h"
+#include "alignment_file.h"
+#include "parse_phylip.h"
+#include "seqUtil.h"
+#include "Newickform.h"
+#include "tree_traversal.h"
+#include "tree_scaling.h"
+#include "trace_events.h"
+#include "gap_reinsertion.h"
+#include "block_tab_file.h"
+#include "tree_bipartitions.h"
+#include "branch_scan_cache.h"
+#include "tree_shards.h"
+#include "output_selection.h"
+#include "branch_snp_columns.h"
+#include "tree_task_scheduler.h"
+#include "ancestral_reconstruction.h"
 
 START_TEST (check_gubbins_no_recombinations)
 {
 	remove("../tests/data/no_recombinations.tre");
 	cp("../tests/data/no_recombinations.tre", "../tests/data/no_recombinations.original.tre");
-	run_gubbins("../tests/data/no_recombinations.aln.vcf", "../tests/data/no_recombinations.tre","../tests/data/no_recombinations.aln.snp_sites.aln",3,"../tests/data/no_recombinations.aln.snp_sites.aln",100,10000);
+	run_gubbins("../tests/data/no_recombinations.aln.vcf", "../tests/data/no_recombinations.tre","../tests/data/no_recombinations.aln.snp_sites.aln",3,"../tests/data/no_recombinations.aln.snp_sites.aln",100,10000,1);
 	fail_unless(file_exists("../tests/data/no_recombinations.tre.tab") == 1);
 	fail_unless(file_exists("../tests/data/no_recombinations.tre.vcf") == 1);
 	fail_unless(file_exists("../tests/data/no_recombinations.tre.phylip") == 1);
@@ -24,6 +43,8 @@ START_TEST (check_gubbins_no_recombinations)
 
   remove("../tests/data/no_recombinations.tre");
 	remove("../tests/data/no_recombinations.tre.tab");
+	remove("../tests/data/no_recombinations.tre.tab.fingerprint");
+	remove("../tests/data/no_recombinations.tre.bipartitions");
 	remove("../tests/data/no_recombinations.tre.vcf");
 	remove("../tests/data/no_recombinations.tre.phylip");
 	remove("../tests/data/no_recombinations.tre.stats");
@@ -37,7 +58,7 @@ START_TEST (check_gubbins_one_recombination)
 {
 	remove("../tests/data/one_recombination.tre");
 	cp("../tests/data/one_recombination.tre", "../tests/data/one_recombination.original.tre");
-	run_gubbins("../tests/data/one_recombination.aln.vcf", "../tests/data/one_recombination.tre","../tests/data/one_recombination.aln.snp_sites.aln",3,"../tests/data/one_recombination.aln.snp_sites.aln",100,10000);
+	run_gubbins("../tests/data/one_recombination.aln.vcf", "../tests/data/one_recombination.tre","../tests/data/one_recombination.aln.snp_sites.aln",3,"../tests/data/one_recombination.aln.snp_sites.aln",100,10000,1);
 	fail_unless(file_exists("../tests/data/one_recombination.tre.tab") == 1);
 	fail_unless(file_exists("../tests/data/one_recombination.tre.vcf") == 1);
 	fail_unless(file_exists("../tests/data/one_recombination.tre.phylip") == 1);
@@ -54,6 +75,8 @@ START_TEST (check_gubbins_one_recombination)
   
   remove("../tests/data/one_recombination.tre");
 	remove("../tests/data/one_recombination.tre.tab");
+	remove("../tests/data/one_recombination.tre.tab.fingerprint");
+	remove("../tests/data/one_recombination.tre.bipartitions");
 	remove("../tests/data/one_recombination.tre.vcf");
 	remove("../tests/data/one_recombination.tre.phylip");
 	remove("../tests/data/one_recombination.tre.stats");
@@ -68,7 +91,7 @@ START_TEST (check_gubbins_multiple_recombinations)
 	remove("../tests/data/multiple_recombinations.tre");
 	cp("../tests/data/multiple_recombinations.tre", "../tests/data/multiple_recombinations.original.tre");
 
-	run_gubbins("../tests/data/multiple_recombinations.aln.vcf", "../tests/data/multiple_recombinations.tre","../tests/data/multiple_recombinations.aln.snp_sites.aln",3,"../tests/data/multiple_recombinations.aln.snp_sites.aln",100,10000);
+	run_gubbins("../tests/data/multiple_recombinations.aln.vcf", "../tests/data/multiple_recombinations.tre","../tests/data/multiple_recombinations.aln.snp_sites.aln",3,"../tests/data/multiple_recombinations.aln.snp_sites.aln",100,10000,1);
 	fail_unless(file_exists("../tests/data/multiple_recombinations.tre.tab") == 1);
 	fail_unless(file_exists("../tests/data/multiple_recombinations.tre.vcf") == 1);
 	fail_unless(file_exists("../tests/data/multiple_recombinations.tre.phylip") == 1);
@@ -82,6 +105,8 @@ START_TEST (check_gubbins_multiple_recombinations)
 
 	remove("../tests/data/multiple_recombinations.tre");
 	remove("../tests/data/multiple_recombinations.tre.tab");
+	remove("../tests/data/multiple_recombinations.tre.tab.fingerprint");
+	remove("../tests/data/multiple_recombinations.tre.bipartitions");
 	remove("../tests/data/multiple_recombinations.tre.vcf");
 	remove("../tests/data/multiple_recombinations.tre.phylip");
 	remove("../tests/data/multiple_recombinations.tre.stats");
@@ -91,13 +116,405 @@ START_TEST (check_gubbins_multiple_recombinations)
 }
 END_TEST
 
+START_TEST (check_gubbins_multiple_recombinations_with_threads)
+{
+	remove("../tests/data/multiple_recombinations.tre");
+	cp("../tests/data/multiple_recombinations.tre", "../tests/data/multiple_recombinations.original.tre");
+
+	run_gubbins("../tests/data/multiple_recombinations.aln.vcf", "../tests/data/multiple_recombinations.tre","../tests/data/multiple_recombinations.aln.snp_sites.aln",3,"../tests/data/multiple_recombinations.aln.snp_sites.aln",100,10000,4);
+	cp("../tests/data/multiple_recombinations.tre.threads.fingerprint", "../tests/data/multiple_recombinations.tre.tab.fingerprint");
+	fail_unless(file_exists("../tests/data/multiple_recombinations.tre.tab") == 1);
+	fail_unless(file_exists("../tests/data/multiple_recombinations.tre.vcf") == 1);
+	fail_unless(file_exists("../tests/data/multiple_recombinations.tre.phylip") == 1);
+	fail_unless(file_exists("../tests/data/multiple_recombinations.tre.stats") == 1);
+	fail_unless(file_exists("../tests/data/multiple_recombinations.tre.gff") == 1);
+	fail_unless(file_exists("../tests/data/multiple_recombinations.tre.snp_sites.aln") == 1);
+
+	fail_unless(number_of_recombinations_in_file("../tests/data/multiple_recombinations.tre.tab") == 3);
+  fail_unless(compare_files("../tests/data/multiple_recombinations.tre","../tests/data/multiple_recombinations.expected.tre") == 1);
+  fail_unless(compare_files("../tests/data/multiple_recombinations.tre.branch_snps.tab","../tests/data/multiple_recombinations.tre.branch_snps.expected.tab") == 1);
+	
+	// The recombinations found on the worker threads have the same fingerprint as in a single thread
+	remove("../tests/data/multiple_recombinations.tre");
+	cp("../tests/data/multiple_recombinations.tre", "../tests/data/multiple_recombinations.original.tre");
+	run_gubbins("../tests/data/multiple_recombinations.aln.vcf", "../tests/data/multiple_recombinations.tre","../tests/data/multiple_recombinations.aln.snp_sites.aln",3,"../tests/data/multiple_recombinations.aln.snp_sites.aln",100,10000,1);
+	fail_unless(compare_files("../tests/data/multiple_recombinations.tre.tab.fingerprint","../tests/data/multiple_recombinations.tre.threads.fingerprint") == 1);
+
+	remove("../tests/data/multiple_recombinations.tre");
+	remove("../tests/data/multiple_recombinations.tre.tab");
+	remove("../tests/data/multiple_recombinations.tre.tab.fingerprint");
+	remove("../tests/data/multiple_recombinations.tre.bipartitions");
+	remove("../tests/data/multiple_recombinations.tre.threads.fingerprint");
+	remove("../tests/data/multiple_recombinations.tre.vcf");
+	remove("../tests/data/multiple_recombinations.tre.phylip");
+	remove("../tests/data/multiple_recombinations.tre.stats");
+	remove("../tests/data/multiple_recombinations.tre.gff");
+	remove("../tests/data/multiple_recombinations.tre.snp_sites.aln");
+	remove("../tests/data/multiple_recombinations.tre.branch_snps.tab");
+}
+END_TEST
+
+START_TEST (check_gubbins_writes_only_selected_outputs)
+{
+	fail_unless(parse_selected_outputs("tab,phylip") == (GUBBINS_OUTPUT_TAB | GUBBINS_OUTPUT_PHYLIP));
+	fail_unless(parse_selected_outputs("all") == GUBBINS_ALL_OUTPUTS);
+	fail_unless(parse_selected_outputs("snp_sites,,branch_snps") == (GUBBINS_OUTPUT_SNP_SITES | GUBBINS_OUTPUT_BRANCH_SNPS));
+	
+	remove("../tests/data/multiple_recombinations.tre");
+	cp("../tests/data/multiple_recombinations.tre", "../tests/data/multiple_recombinations.original.tre");
+	set_selected_outputs(parse_selected_outputs("tab,phylip"));
+	run_gubbins("../tests/data/multiple_recombinations.aln.vcf", "../tests/data/multiple_recombinations.tre","../tests/data/multiple_recombinations.aln.snp_sites.aln",3,"../tests/data/multiple_recombinations.aln.snp_sites.aln",100,10000,4);
+	set_selected_outputs(GUBBINS_ALL_OUTPUTS);
+	fail_unless(file_exists("../tests/data/multiple_recombinations.tre.tab") == 1);
+	fail_unless(file_exists("../tests/data/multiple_recombinations.tre.tab.fingerprint") == 1);
+	fail_unless(file_exists("../tests/data/multiple_recombinations.tre.phylip") == 1);
+	fail_unless(file_exists("../tests/data/multiple_recombinations.tre.vcf") == 0);
+	fail_unless(file_exists("../tests/data/multiple_recombinations.tre.stats") == 0);
+	fail_unless(file_exists("../tests/data/multiple_recombinations.tre.gff") == 0);
+	fail_unless(file_exists("../tests/data/multiple_recombinations.tre.snp_sites.aln") == 0);
+	fail_unless(file_exists("../tests/data/multiple_recombinations.tre.branch_snps.tab") == 0);
+	
+	// Leaving files out doesnt change the recombinations or the tree
+	fail_unless(number_of_recombinations_in_file("../tests/data/multiple_recombinations.tre.tab") == 3);
+	fail_unless(compare_files("../tests/data/multiple_recombinations.tre","../tests/data/multiple_recombinations.expected.tre") == 1);
+
+	remove("../tests/data/multiple_recombinations.tre");
+	remove("../tests/data/multiple_recombinations.tre.tab");
+	remove("../tests/data/multiple_recombinations.tre.tab.fingerprint");
+	remove("../tests/data/multiple_recombinations.tre.bipartitions");
+	remove("../tests/data/multiple_recombinations.tre.phylip");
+}
+END_TEST
+
+START_TEST (check_branch_snps_written_as_binary_columns)
+{
+	remove("../tests/data/multiple_recombinations.tre");
+	cp("../tests/data/multiple_recombinations.tre", "../tests/data/multiple_recombinations.original.tre");
+	set_binary_branch_snps(1);
+	run_gubbins("../tests/data/multiple_recombinations.aln.vcf", "../tests/data/multiple_recombinations.tre","../tests/data/multiple_recombinations.aln.snp_sites.aln",3,"../tests/data/multiple_recombinations.aln.snp_sites.aln",100,10000,4);
+	set_binary_branch_snps(0);
+	fail_unless(file_exists("../tests/data/multiple_recombinations.tre.branch_snps.tab") == 0);
+	fail_unless(file_exists("../tests/data/multiple_recombinations.tre.branch_snps.nodes") == 1);
+	
+	FILE * columns_file_pointer = fopen("../tests/data/multiple_recombinations.tre.branch_snps.bin", "r");
+	branch_snp_columns_header header;
+	fail_unless(columns_file_pointer != NULL);
+	fail_unless(fread(&header, sizeof(header), 1, columns_file_pointer) == 1);
+	fclose(columns_file_pointer);
+	fail_unless(memcmp(header.magic, BRANCH_SNP_COLUMNS_MAGIC, 8) == 0);
+	fail_unless(header.number_of_snps == 242);
+	fail_unless(header.number_of_nodes == 17);
+	fail_unless(header.derived_base_offset == header.ancestral_base_offset + 242);
+	
+	// The branches are in the order of the dictionary rather than of the scan, but the features are the same
+	convert_branch_snp_columns_to_text("../tests/data/multiple_recombinations.tre.branch_snps.bin", "../tests/data/multiple_recombinations.tre.branch_snps.converted.tab");
+	fail_unless(compare_features_in_any_order("../tests/data/multiple_recombinations.tre.branch_snps.expected.tab", "../tests/data/multiple_recombinations.tre.branch_snps.converted.tab") == 1);
+	fail_unless(compare_features_in_any_order("../tests/data/multiple_recombinations.tre.branch_snps.expected.tab", "../tests/data/multiple_recombinations.tre.tab") == 0);
+
+	remove("../tests/data/multiple_recombinations.tre");
+	remove("../tests/data/multiple_recombinations.tre.tab");
+	remove("../tests/data/multiple_recombinations.tre.tab.fingerprint");
+	remove("../tests/data/multiple_recombinations.tre.bipartitions");
+	remove("../tests/data/multiple_recombinations.tre.vcf");
+	remove("../tests/data/multiple_recombinations.tre.phylip");
+	remove("../tests/data/multiple_recombinations.tre.stats");
+	remove("../tests/data/multiple_recombinations.tre.gff");
+	remove("../tests/data/multiple_recombinations.tre.snp_sites.aln");
+	remove("../tests/data/multiple_recombinations.tre.branch_snps.bin");
+	remove("../tests/data/multiple_recombinations.tre.branch_snps.nodes");
+	remove("../tests/data/multiple_recombinations.tre.branch_snps.converted.tab");
+}
+END_TEST
+
+START_TEST (check_trace_records_branch_scans_on_each_thread)
+{
+	remove("../tests/data/multiple_recombinations.tre");
+	cp("../tests/data/multiple_recombinations.tre", "../tests/data/multiple_recombinations.original.tre");
+
+	start_trace("../tests/data/multiple_recombinations.trace.json");
+	run_gubbins("../tests/data/multiple_recombinations.aln.vcf", "../tests/data/multiple_recombinations.tre","../tests/data/multiple_recombinations.aln.snp_sites.aln",3,"../tests/data/multiple_recombinations.aln.snp_sites.aln",100,10000,4);
+	fail_unless(trace_enabled() == 1);
+	write_trace();
+	fail_unless(trace_enabled() == 0);
+
+	FILE * trace_file_pointer = fopen("../tests/data/multiple_recombinations.trace.json", "r");
+	fail_unless(trace_file_pointer != NULL);
+	char trace[65536];
+	size_t trace_size = fread(trace, 1, sizeof(trace) - 1, trace_file_pointer);
+	trace[trace_size] = '\0';
+	fclose(trace_file_pointer);
+	fail_unless(strstr(trace, "\"traceEvents\"") != NULL);
+	fail_unless(strstr(trace, "\"name\": \"get_likelihood_for_windows\", \"ph\": \"X\"") != NULL);
+	fail_unless(strstr(trace, "\"name\": \"get_blocks\"") != NULL);
+	fail_unless(strstr(trace, "\"name\": \"flush_branch_scan_buffers\"") != NULL);
+	fail_unless(strstr(trace, "\"name\": \"main 0\"") != NULL);
+	fail_unless(strstr(trace, "\"name\": \"worker 1\"") != NULL);
+
+	remove("../tests/data/multiple_recombinations.trace.json");
+	remove("../tests/data/multiple_recombinations.tre");
+	remove("../tests/data/multiple_recombinations.tre.tab");
+	remove("../tests/data/multiple_recombinations.tre.tab.fingerprint");
+	remove("../tests/data/multiple_recombinations.tre.bipartitions");
+	remove("../tests/data/multiple_recombinations.tre.vcf");
+	remove("../tests/data/multiple_recombinations.tre.phylip");
+	remove("../tests/data/multiple_recombinations.tre.stats");
+	remove("../tests/data/multiple_recombinations.tre.gff");
+	remove("../tests/data/multiple_recombinations.tre.snp_sites.aln");
+	remove("../tests/data/multiple_recombinations.tre.branch_snps.tab");
+}
+END_TEST
+
+START_TEST (check_unchanged_branches_reuse_their_scans)
+{
+	int run;
+	remove("../tests/data/branch_scan_cache/branch_scans.gubbins_cache");
+	rmdir("../tests/data/branch_scan_cache");
+	set_branch_scan_cache_directory("../tests/data/branch_scan_cache");
+	
+	// Nothing is reused the first time, and every branch the second, with the same output both times
+	for(run = 0; run < 2; run++)
+	{
+		remove("../tests/data/multiple_recombinations.tre");
+		cp("../tests/data/multiple_recombinations.tre", "../tests/data/multiple_recombinations.original.tre");
+		run_gubbins("../tests/data/multiple_recombinations.aln.vcf", "../tests/data/multiple_recombinations.tre","../tests/data/multiple_recombinations.aln.snp_sites.aln",3,"../tests/data/multiple_recombinations.aln.snp_sites.aln",100,10000,run+1);
+		fail_unless(get_number_of_reused_branch_scans() == (run == 0 ? 0 : 17));
+		fail_unless(number_of_recombinations_in_file("../tests/data/multiple_recombinations.tre.tab") == 3);
+		fail_unless(compare_files("../tests/data/multiple_recombinations.tre","../tests/data/multiple_recombinations.expected.tre") == 1);
+		fail_unless(compare_files("../tests/data/multiple_recombinations.tre.branch_snps.tab","../tests/data/multiple_recombinations.tre.branch_snps.expected.tab") == 1);
+	}
+	
+	// The scans arent reused with other parameters
+	remove("../tests/data/multiple_recombinations.tre");
+	cp("../tests/data/multiple_recombinations.tre", "../tests/data/multiple_recombinations.original.tre");
+	run_gubbins("../tests/data/multiple_recombinations.aln.vcf", "../tests/data/multiple_recombinations.tre","../tests/data/multiple_recombinations.aln.snp_sites.aln",4,"../tests/data/multiple_recombinations.aln.snp_sites.aln",100,10000,1);
+	fail_unless(get_number_of_reused_branch_scans() == 0);
+	
+	set_branch_scan_cache_directory(NULL);
+	remove("../tests/data/branch_scan_cache/branch_scans.gubbins_cache");
+	rmdir("../tests/data/branch_scan_cache");
+	remove("../tests/data/multiple_recombinations.tre");
+	remove("../tests/data/multiple_recombinations.tre.tab");
+	remove("../tests/data/multiple_recombinations.tre.tab.fingerprint");
+	remove("../tests/data/multiple_recombinations.tre.bipartitions");
+	remove("../tests/data/multiple_recombinations.tre.vcf");
+	remove("../tests/data/multiple_recombinations.tre.phylip");
+	remove("../tests/data/multiple_recombinations.tre.stats");
+	remove("../tests/data/multiple_recombinations.tre.gff");
+	remove("../tests/data/multiple_recombinations.tre.snp_sites.aln");
+	remove("../tests/data/multiple_recombinations.tre.branch_snps.tab");
+}
+END_TEST
+
+START_TEST (check_branch_scan_cache_filename_fits)
+{
+	char cache_filename[MAX_FILENAME_SIZE];
+	char long_directory[MAX_FILENAME_SIZE];
+	
+	set_branch_scan_cache_directory("../tests/data/branch_scan_cache");
+	set_branch_scan_shard(3);
+	fail_unless(branch_scan_cache_filename(cache_filename) == 1);
+	fail_unless(strcmp(cache_filename, "../tests/data/branch_scan_cache/branch_scans.shard3.gubbins_cache") == 0);
+	set_branch_scan_shard(-1);
+	fail_unless(branch_scan_cache_filename(cache_filename) == 1);
+	fail_unless(strcmp(cache_filename, "../tests/data/branch_scan_cache/branch_scans.gubbins_cache") == 0);
+	
+	// A directory with too long a name for the cache in it has no cache, rather than one with a cut off name
+	memset(long_directory, 'd', MAX_FILENAME_SIZE - 10);
+	long_directory[MAX_FILENAME_SIZE - 10] = '\0';
+	set_branch_scan_cache_directory(long_directory);
+	fail_unless(branch_scan_cache_filename(cache_filename) == 0);
+	set_branch_scan_cache_directory(NULL);
+}
+END_TEST
+
+START_TEST (check_tree_shards_are_put_back_together)
+{
+	int shard;
+	tree_shard_plan plan;
+	seqMemInit();
+	char * tree_string = read_tree_file("../tests/data/multiple_recombinations.original.tre");
+	newick_node * root = parseTree(tree_string);
+	free(tree_string);
+	
+	// The subtrees of N5 and N8 dont fit in one shard of 4 leaves together
+	plan_tree_shards(root, 4, &plan);
+	fail_unless(plan.number_of_cut_roots == 2);
+	fail_unless(plan.number_of_shards == 2);
+	fail_unless(strcmp(plan.cut_roots[0]->taxon, "N5") == 0);
+	fail_unless(strcmp(plan.cut_roots[1]->taxon, "N8") == 0);
+	fail_unless(get_number_of_branches_in_tree_shard(&plan, 0) == 6);
+	fail_unless(get_number_of_branches_in_tree_shard(&plan, 1) == 2);
+	free_tree_shard_plan(&plan);
+	plan_tree_shards(root, 10, &plan);
+	fail_unless(plan.number_of_shards == 1);
+	fail_unless(plan.cut_roots[0] == root);
+	free_tree_shard_plan(&plan);
+	seqFreeAll();
+	
+	// The run after the shards only scans the branches above them, and gives the same output as scanning them all
+	remove("../tests/data/branch_scan_cache/branch_scans.gubbins_cache");
+	rmdir("../tests/data/branch_scan_cache");
+	set_branch_scan_cache_directory("../tests/data/branch_scan_cache");
+	remove("../tests/data/multiple_recombinations.tre");
+	cp("../tests/data/multiple_recombinations.tre", "../tests/data/multiple_recombinations.original.tre");
+	for(shard = 0; shard < 3; shard++)
+	{
+		run_gubbins_shard("../tests/data/multiple_recombinations.aln.vcf", "../tests/data/multiple_recombinations.tre","../tests/data/multiple_recombinations.aln.snp_sites.aln",3,"../tests/data/multiple_recombinations.aln.snp_sites.aln",100,10000,1,4,shard);
+	}
+	fail_unless(file_exists("../tests/data/branch_scan_cache/branch_scans.shard0.gubbins_cache") == 1);
+	fail_unless(file_exists("../tests/data/branch_scan_cache/branch_scans.shard1.gubbins_cache") == 1);
+	fail_unless(file_exists("../tests/data/branch_scan_cache/branch_scans.shard2.gubbins_cache") == 0);
+	fail_unless(file_exists("../tests/data/multiple_recombinations.tre.tab") == 0);
+	
+	// The 8 branches of the shards are reused, and so is one above them with the same sequences as one of those
+	run_gubbins("../tests/data/multiple_recombinations.aln.vcf", "../tests/data/multiple_recombinations.tre","../tests/data/multiple_recombinations.aln.snp_sites.aln",3,"../tests/data/multiple_recombinations.aln.snp_sites.aln",100,10000,2);
+	fail_unless(get_number_of_reused_branch_scans() == 9);
+	fail_unless(number_of_recombinations_in_file("../tests/data/multiple_recombinations.tre.tab") == 3);
+	fail_unless(compare_files("../tests/data/multiple_recombinations.tre","../tests/data/multiple_recombinations.expected.tre") == 1);
+	fail_unless(compare_files("../tests/data/multiple_recombinations.tre.branch_snps.tab","../tests/data/multiple_recombinations.tre.branch_snps.expected.tab") == 1);
+	fail_unless(file_exists("../tests/data/branch_scan_cache/branch_scans.shard0.gubbins_cache") == 0);
+	fail_unless(file_exists("../tests/data/branch_scan_cache/branch_scans.shard1.gubbins_cache") == 0);
+	
+	set_branch_scan_cache_directory(NULL);
+	remove("../tests/data/branch_scan_cache/branch_scans.gubbins_cache");
+	rmdir("../tests/data/branch_scan_cache");
+	remove("../tests/data/multiple_recombinations.tre");
+	remove("../tests/data/multiple_recombinations.tre.tab");
+	remove("../tests/data/multiple_recombinations.tre.tab.fingerprint");
+	remove("../tests/data/multiple_recombinations.tre.bipartitions");
+	remove("../tests/data/multiple_recombinations.tre.vcf");
+	remove("../tests/data/multiple_recombinations.tre.phylip");
+	remove("../tests/data/multiple_recombinations.tre.stats");
+	remove("../tests/data/multiple_recombinations.tre.gff");
+	remove("../tests/data/multiple_recombinations.tre.snp_sites.aln");
+	remove("../tests/data/multiple_recombinations.tre.branch_snps.tab");
+}
+END_TEST
+
+START_TEST (check_gubbins_session_runs_several_iterations)
+{
+	int i;
+	gubbins_session * session = create_gubbins_session("../tests/data/multiple_recombinations.aln.vcf", "../tests/data/multiple_recombinations.aln.snp_sites.aln",3,100,10000,1);
+	
+	// The first iteration reads the sequences from the file
+	remove("../tests/data/multiple_recombinations.tre");
+	cp("../tests/data/multiple_recombinations.tre", "../tests/data/multiple_recombinations.original.tre");
+	fail_unless(load_gubbins_session_sequences_from_file(session, "../tests/data/multiple_recombinations.aln.snp_sites.aln") == GUBBINS_SESSION_OK);
+	fail_unless(run_gubbins_session_iteration(session, "../tests/data/multiple_recombinations.tre") == GUBBINS_SESSION_OK);
+	fail_unless(number_of_recombinations_in_file("../tests/data/multiple_recombinations.tre.tab") == 3);
+	fail_unless(compare_files("../tests/data/multiple_recombinations.tre","../tests/data/multiple_recombinations.expected.tre") == 1);
+	fail_unless(compare_files("../tests/data/multiple_recombinations.tre.branch_snps.tab","../tests/data/multiple_recombinations.tre.branch_snps.expected.tab") == 1);
+	
+	// and the second gets the same sequences from rows in memory, spaced out like a padded array
+	loaded_alignment * alignment = load_alignment("../tests/data/multiple_recombinations.aln.snp_sites.aln");
+	int number_of_samples = alignment->number_of_sequences;
+	int length_of_sequences = alignment->sequence_lengths[0];
+	size_t row_stride = length_of_sequences + 5;
+	char * bases = (char *) calloc(number_of_samples*row_stride, sizeof(char));
+	char ** sample_names = (char **) calloc(number_of_samples, sizeof(char *));
+	for(i = 0; i < number_of_samples; i++)
+	{
+		memcpy(bases + i*row_stride, alignment->sequences[i], length_of_sequences);
+		sample_names[i] = strdup(alignment->sequence_names[i]);
+	}
+	free_loaded_alignment();
+	
+	remove("../tests/data/multiple_recombinations.tre");
+	cp("../tests/data/multiple_recombinations.tre", "../tests/data/multiple_recombinations.original.tre");
+	fail_unless(load_gubbins_session_sequences(session, sample_names, bases, number_of_samples, length_of_sequences, row_stride) == GUBBINS_SESSION_OK);
+	fail_unless(run_gubbins_session_iteration(session, "../tests/data/multiple_recombinations.tre") == GUBBINS_SESSION_OK);
+	fail_unless(session->number_of_iterations == 2);
+	fail_unless(number_of_recombinations_in_file("../tests/data/multiple_recombinations.tre.tab") == 3);
+	fail_unless(compare_files("../tests/data/multiple_recombinations.tre","../tests/data/multiple_recombinations.expected.tre") == 1);
+	fail_unless(compare_files("../tests/data/multiple_recombinations.tre.branch_snps.tab","../tests/data/multiple_recombinations.tre.branch_snps.expected.tab") == 1);
+	free_gubbins_session(session);
+	
+	for(i = 0; i < number_of_samples; i++)
+	{
+		free(sample_names[i]);
+	}
+	free(sample_names);
+	free(bases);
+	remove("../tests/data/multiple_recombinations.tre");
+	remove("../tests/data/multiple_recombinations.tre.tab");
+	remove("../tests/data/multiple_recombinations.tre.tab.fingerprint");
+	remove("../tests/data/multiple_recombinations.tre.bipartitions");
+	remove("../tests/data/multiple_recombinations.tre.vcf");
+	remove("../tests/data/multiple_recombinations.tre.phylip");
+	remove("../tests/data/multiple_recombinations.tre.stats");
+	remove("../tests/data/multiple_recombinations.tre.gff");
+	remove("../tests/data/multiple_recombinations.tre.snp_sites.aln");
+	remove("../tests/data/multiple_recombinations.tre.branch_snps.tab");
+}
+END_TEST
+
+START_TEST (check_gubbins_session_reports_bad_input)
+{
+	// Bad input is returned to the caller, which may be a whole Python process, rather than exiting
+	fail_unless(create_gubbins_session("../tests/data/does_not_exist.vcf", "../tests/data/multiple_recombinations.aln.snp_sites.aln",3,100,10000,1) == NULL);
+	fail_unless(create_gubbins_session("../tests/data/multiple_recombinations.aln.vcf", "../tests/data/does_not_exist.aln",3,100,10000,1) == NULL);
+	gubbins_session * session = create_gubbins_session("../tests/data/multiple_recombinations.aln.vcf", "../tests/data/multiple_recombinations.aln.snp_sites.aln",3,100,10000,1);
+	fail_unless(session != NULL);
+	fail_unless(run_gubbins_session_iteration(session, "../tests/data/multiple_recombinations.original.tre") == GUBBINS_SESSION_SEQUENCES_NOT_LOADED);
+	fail_unless(load_gubbins_session_sequences_from_file(session, "../tests/data/does_not_exist.aln") == GUBBINS_SESSION_MISSING_FILE);
+	fail_unless(load_gubbins_session_sequences_from_file(session, "../tests/data/multiple_recombinations.aln.snp_sites.aln") == GUBBINS_SESSION_OK);
+	fail_unless(run_gubbins_session_iteration(session, "../tests/data/does_not_exist.tre") == GUBBINS_SESSION_MISSING_FILE);
+	fail_unless(reinsert_gaps_with_gubbins_session(session, "../tests/data/does_not_exist.aln", "does_not_exist.gaps.aln") == GUBBINS_SESSION_MISSING_FILE);
+	fail_unless(session->number_of_iterations == 0);
+	free_gubbins_session(session);
+}
+END_TEST
+
+START_TEST (check_recombination_fingerprint_ignores_order)
+{
+	reset_recombination_fingerprint();
+	add_block_to_recombination_fingerprint(10, 20, "sequence_1 sequence_2");
+	add_block_to_recombination_fingerprint(30, 40, "sequence_3");
+	uint64_t fingerprint = get_recombination_fingerprint();
+	fail_unless(fingerprint != 0);
+	
+	// The same taxa and coordinates split over other blocks, in another order
+	reset_recombination_fingerprint();
+	add_block_to_recombination_fingerprint(30, 40, "sequence_3");
+	add_block_to_recombination_fingerprint(10, 20, "sequence_2");
+	add_block_to_recombination_fingerprint(10, 20, "sequence_1");
+	fail_unless(get_recombination_fingerprint() == fingerprint);
+	
+	reset_recombination_fingerprint();
+	add_block_to_recombination_fingerprint(10, 21, "sequence_1 sequence_2");
+	add_block_to_recombination_fingerprint(30, 40, "sequence_3");
+	fail_unless(get_recombination_fingerprint() != fingerprint);
+	reset_recombination_fingerprint();
+	add_block_to_recombination_fingerprint(20, 10, "sequence_1 sequence_2");
+	add_block_to_recombination_fingerprint(30, 40, "sequence_3");
+	fail_unless(get_recombination_fingerprint() != fingerprint);
+	reset_recombination_fingerprint();
+}
+END_TEST
+
+START_TEST (check_reinsert_gaps_into_fasta_file)
+{
+	// Only the sequences which arent samples in the vcf are added, onto whatever is in the output already
+	remove("../tests/data/gaps_to_be_reinserted.aln.gapped");
+	reinsert_gaps_into_fasta_file("../tests/data/gaps_to_be_reinserted.aln", "../tests/data/gaps_to_be_reinserted.vcf", "../tests/data/gaps_to_be_reinserted.aln.gapped");
+	fail_unless(compare_files("../tests/data/gaps_to_be_reinserted.aln.gapped","../tests/data/gaps_to_be_reinserted.expected.aln") == 1);
+	remove("../tests/data/gaps_to_be_reinserted.aln.gapped");
+	
+	char gap_only_base = '\0';
+	fail_unless(is_gap_only_vcf_row("A", 1, "-", 1, &gap_only_base) == 1 && gap_only_base == 'A');
+	fail_unless(is_gap_only_vcf_row("N", 1, "c", 1, &gap_only_base) == 1 && gap_only_base == 'c');
+	fail_unless(is_gap_only_vcf_row("A", 1, "C", 1, &gap_only_base) == 0);
+	fail_unless(is_gap_only_vcf_row("A", 1, "-,C", 3, &gap_only_base) == 0);
+}
+END_TEST
+
 START_TEST (check_recombination_at_root)
 {
 	remove("../tests/data/recombination_at_root/RAxML_result.recombination_at_root.iteration_1");
 	cp("../tests/data/recombination_at_root/RAxML_result.recombination_at_root.iteration_1", "../tests/data/recombination_at_root/RAxML_result.recombination_at_root.iteration_1.original.tre");
 
     
-	run_gubbins("../tests/data/recombination_at_root/recombination_at_root.aln.gaps.vcf", "../tests/data/recombination_at_root/RAxML_result.recombination_at_root.iteration_1", "../tests/data/recombination_at_root/recombination_at_root.aln.gaps.snp_sites.aln",3,"../tests/data/recombination_at_root/recombination_at_root.aln",100,10000);
+	run_gubbins("../tests/data/recombination_at_root/recombination_at_root.aln.gaps.vcf", "../tests/data/recombination_at_root/RAxML_result.recombination_at_root.iteration_1", "../tests/data/recombination_at_root/recombination_at_root.aln.gaps.snp_sites.aln",3,"../tests/data/recombination_at_root/recombination_at_root.aln",100,10000,1);
     
     fail_unless(compare_files("../tests/data/recombination_at_root/RAxML_result.recombination_at_root.iteration_1.tab","../tests/data/recombination_at_root/expected_RAxML_result.recombination_at_root.iteration_1.tab") == 1);
     
@@ -111,6 +528,8 @@ START_TEST (check_recombination_at_root)
     
     remove("../tests/data/recombination_at_root/RAxML_result.recombination_at_root.iteration_1.vcf");
     remove("../tests/data/recombination_at_root/RAxML_result.recombination_at_root.iteration_1.tab");
+    remove("../tests/data/recombination_at_root/RAxML_result.recombination_at_root.iteration_1.tab.fingerprint");
+    remove("../tests/data/recombination_at_root/RAxML_result.recombination_at_root.iteration_1.bipartitions");
     remove("../tests/data/recombination_at_root/RAxML_result.recombination_at_root.iteration_1.stats");
     remove("../tests/data/recombination_at_root/RAxML_result.recombination_at_root.iteration_1.snp_sites.aln");
     remove("../tests/data/recombination_at_root/RAxML_result.recombination_at_root.iteration_1.phylip");
@@ -122,6 +541,446 @@ END_TEST
 
 
 
+// The names are spaced as if each node joined " " and the names of each of its children
+START_TEST (check_taxon_sets_write_the_names_of_the_leaves_under_each_node)
+{
+	char tree_string[] = "((a,b),c,(d,(e,f)))root;";
+	seqMemInit();
+	newick_node * root = parseTree(tree_string);
+	newick_node * last_child = root->child->next->next->node;
+	fail_unless(root->taxa.number_of_leaves == 6);
+	fail_unless(last_child->taxa.first_leaf == 3);
+	fail_unless(last_child->taxa.number_of_leaves == 3);
+	
+	char * taxon_names = copy_taxon_names(&(root->taxa));
+	fail_unless(strcmp(taxon_names, "  a b c  d  e f") == 0);
+	fail_unless(length_of_taxon_names(&(root->taxa)) == strlen(taxon_names));
+	free(taxon_names);
+	taxon_names = copy_taxon_names(&(last_child->taxa));
+	fail_unless(strcmp(taxon_names, " d  e f") == 0);
+	free(taxon_names);
+	taxon_names = copy_taxon_names(&(root->child->next->node->taxa));
+	fail_unless(strcmp(taxon_names, "c") == 0);
+	free(taxon_names);
+	
+	FILE * names_file_pointer = fopen("../tests/data/taxon_names.txt", "w");
+	print_taxon_names(names_file_pointer, &(root->child->node->taxa));
+	fclose(names_file_pointer);
+	char * printed_names = read_tree_file("../tests/data/taxon_names.txt");
+	fail_unless(strcmp(printed_names, " a b") == 0);
+	free(printed_names);
+	remove("../tests/data/taxon_names.txt");
+	free_taxon_sets(root);
+	seqFreeAll();
+}
+END_TEST
+
+START_TEST (check_parse_tree_keeps_quotes_and_branch_lengths)
+{
+	char tree_string[] = "(('seq 1':0.5,seq2:1.25)'n''1':0.75,(a:b:2,c):3)root;\n";
+	FILE * output_tree_pointer;
+	seqMemInit();
+	newick_node * root = parseTree(tree_string);
+	fail_unless(root->childNum == 2);
+	fail_unless(strcmp(root->taxon, "root") == 0);
+	fail_unless(strcmp(root->child->node->taxon, "n1") == 0);
+	fail_unless(strcmp(root->child->node->child->node->taxon, "seq 1") == 0);
+	fail_unless(strcmp(root->child->next->node->child->node->taxon, "a:b") == 0);
+	fail_unless(root->child->next->node->child->node->dist == 2.0);
+	fail_unless(root->child->next->node->child->next->node->dist == 0.0);
+	fail_unless(root->child->next->node->taxon == NULL);
+	fail_unless(root->child->node->child->node->parent == root->child->node);
+	
+	output_tree_pointer = fopen("../tests/data/parsed_tree.tre", "w");
+	print_tree(root, output_tree_pointer);
+	fclose(output_tree_pointer);
+	char * printed_tree = read_tree_file("../tests/data/parsed_tree.tre");
+	fail_unless(strcmp(printed_tree, "((seq 1:0.500000,seq2:1.250000)n1:0.750000,(a:b:2.000000,c:0.000000):3.000000)root:0.000000") == 0);
+	free(printed_tree);
+	remove("../tests/data/parsed_tree.tre");
+	seqFreeAll();
+}
+END_TEST
+
+void get_bipartitions_of_tree_string(char * tree_string, tree_bipartitions * bipartitions)
+{
+	char * tree_copy = strdup(tree_string);
+	seqMemInit();
+	newick_node * root = parseTree(tree_copy);
+	get_tree_bipartitions(root, bipartitions);
+	seqFreeAll();
+	free(tree_copy);
+}
+
+START_TEST (check_tree_bipartitions_ignore_rooting_and_child_order)
+{
+	tree_bipartitions bipartitions, other_bipartitions;
+	get_bipartitions_of_tree_string("((a:1,b:1)n1:1,(c:1,(d:1,e:0)n3:1)n2:1)root;", &bipartitions);
+	fail_unless(bipartitions.number_of_splits == 7);
+	
+	// Rooted somewhere else, with the children the other way round
+	get_bipartitions_of_tree_string("(((e:0,d:1)n3:1,c:1)n2:2,b:1,a:1)root;", &other_bipartitions);
+	fail_unless(other_bipartitions.topology_hash == bipartitions.topology_hash);
+	fail_unless(other_bipartitions.weighted_topology_hash == bipartitions.weighted_topology_hash);
+	
+	// A split with a length is in both hashes, and one without is only in the topology hash
+	get_bipartitions_of_tree_string("((a:1,c:1)n1:1,(b:1,(d:1,e:0)n3:1)n2:1)root;", &other_bipartitions);
+	fail_unless(other_bipartitions.topology_hash != bipartitions.topology_hash);
+	fail_unless(other_bipartitions.weighted_topology_hash != bipartitions.weighted_topology_hash);
+	get_bipartitions_of_tree_string("((a:1,b:1)n1:1,(c:1,(d:1,e:0)n3:0)n2:1)root;", &other_bipartitions);
+	fail_unless(other_bipartitions.topology_hash == bipartitions.topology_hash);
+	fail_unless(other_bipartitions.weighted_topology_hash != bipartitions.weighted_topology_hash);
+	get_bipartitions_of_tree_string("((a:1,b:1)n1:1,(c:1,d:1,e:0)n2:1)root;", &bipartitions);
+	fail_unless(other_bipartitions.topology_hash != bipartitions.topology_hash);
+	fail_unless(other_bipartitions.weighted_topology_hash == bipartitions.weighted_topology_hash);
+}
+END_TEST
+
+// (t0:1,(t1:1,( ... ,t99999:1)):1)):1;
+char * caterpillar_tree_string(int number_of_taxa)
+{
+	int i;
+	char * tree_string = (char *) calloc(number_of_taxa*16, sizeof(char));
+	char * current_position = tree_string;
+	for(i = 0; i < number_of_taxa - 1; i++)
+	{
+		current_position += sprintf(current_position, "(t%d:1,", i);
+	}
+	current_position += sprintf(current_position, "t%d:1", i);
+	for(i = 0; i < number_of_taxa - 1; i++)
+	{
+		current_position += sprintf(current_position, "):1");
+	}
+	sprintf(current_position, ";");
+	return tree_string;
+}
+
+START_TEST (check_parse_deep_caterpillar_tree)
+{
+	int number_of_taxa = 100000;
+	int depth = 0;
+	char * tree_string = caterpillar_tree_string(number_of_taxa);
+	
+	seqMemInit();
+	newick_node * node = parseTree(tree_string);
+	while(node->childNum == 2)
+	{
+		fail_unless(node->child->node->childNum == 0);
+		node = node->child->next->node;
+		depth++;
+	}
+	fail_unless(depth == number_of_taxa - 1);
+	fail_unless(strcmp(node->taxon, "t99999") == 0);
+	seqFreeAll();
+	free(tree_string);
+}
+END_TEST
+
+START_TEST (check_tree_traversal_orders)
+{
+	char tree_string[] = "((A:1,B:1)X:1,C:1,(D:1)Y:1)R;";
+	char * expected_pre_order[7] = {"R", "X", "A", "B", "C", "Y", "D"};
+	char * expected_post_order[7] = {"A", "B", "X", "C", "D", "Y", "R"};
+	tree_traversal traversal;
+	int i;
+	seqMemInit();
+	newick_node * root = parseTree(tree_string);
+	build_tree_traversal(root, &traversal);
+	fail_unless(traversal.number_of_nodes == 7);
+	fail_unless(traversal.maximum_number_of_children == 3);
+	for(i = 0; i < 7; i++)
+	{
+		fail_unless(strcmp(traversal.pre_order[i]->taxon, expected_pre_order[i]) == 0);
+		fail_unless(strcmp(traversal.post_order[i]->taxon, expected_post_order[i]) == 0);
+		fail_unless(traversal.pre_order[i]->traversal_index == i);
+	}
+	free_tree_traversal(&traversal);
+	seqFreeAll();
+}
+END_TEST
+
+START_TEST (check_tree_passes_on_deep_caterpillar_tree)
+{
+	int number_of_taxa = 100000;
+	int i;
+	char * tree_string = caterpillar_tree_string(number_of_taxa);
+	FILE * output_tree_pointer;
+	seqMemInit();
+	newick_node * root = parseTree(tree_string);
+	
+	scale_branch_distances(root, 2);
+	output_tree_pointer = fopen("../tests/data/deep_tree.tre", "w");
+	print_tree(root, output_tree_pointer);
+	fclose(output_tree_pointer);
+	char * printed_tree = read_tree_file("../tests/data/deep_tree.tre");
+	fail_unless(strncmp(printed_tree, "(t0:2.000000,(t1:2.000000,(t2:2.000000,", 39) == 0);
+	
+	// and every internal node is closed after the innermost pair
+	char * closing_brackets = strstr(printed_tree, "(t99998:2.000000,t99999:2.000000)");
+	fail_unless(closing_brackets != NULL);
+	closing_brackets += strlen("(t99998:2.000000,t99999:2.000000)");
+	for(i = 0; i < number_of_taxa - 2; i++)
+	{
+		fail_unless(strncmp(closing_brackets, ":2.000000)", 10) == 0);
+		closing_brackets += 10;
+	}
+	fail_unless(strcmp(closing_brackets, ":2.000000") == 0);
+	remove("../tests/data/deep_tree.tre");
+	
+	cleanup_node_memory(root);
+	seqFreeAll();
+	free(printed_tree);
+	free(tree_string);
+}
+END_TEST
+
+// The position each node finished in, to check the tasks ran in an order the tree allows
+typedef struct tree_task_order
+{
+	int * finishing_positions;
+	int number_of_finished_tasks;
+	pthread_mutex_t lock;
+} tree_task_order;
+
+void record_tree_task_order(newick_node * node, int worker_index, void * context)
+{
+	tree_task_order * order = (tree_task_order *) context;
+	pthread_mutex_lock(&(order->lock));
+	fail_unless(order->finishing_positions[node->traversal_index] == 0);
+	order->number_of_finished_tasks++;
+	order->finishing_positions[node->traversal_index] = order->number_of_finished_tasks;
+	pthread_mutex_unlock(&(order->lock));
+}
+
+START_TEST (check_tree_tasks_wait_for_their_dependencies)
+{
+	int number_of_taxa = 20000;
+	int i;
+	tree_traversal traversal;
+	tree_task_order order;
+	char * tree_string = caterpillar_tree_string(number_of_taxa);
+	seqMemInit();
+	newick_node * root = parseTree(tree_string);
+	build_tree_traversal(root, &traversal);
+	double * node_costs = (double *) calloc(traversal.number_of_nodes, sizeof(double));
+	double * priorities = (double *) calloc(traversal.number_of_nodes, sizeof(double));
+	for(i = 0; i < traversal.number_of_nodes; i++)
+	{
+		node_costs[i] = 1;
+	}
+	
+	// Going up, the spine is the critical path, so the deepest leaf is the most urgent
+	calculate_critical_path_priorities(&traversal, TREE_TASKS_POST_ORDER, node_costs, priorities);
+	fail_unless(priorities[root->traversal_index] == 1);
+	fail_unless(priorities[traversal.pre_order[traversal.number_of_nodes - 1]->traversal_index] == number_of_taxa);
+	pthread_mutex_init(&(order.lock), NULL);
+	order.finishing_positions = (int *) calloc(traversal.number_of_nodes, sizeof(int));
+	order.number_of_finished_tasks = 0;
+	run_tree_tasks(&traversal, TREE_TASKS_POST_ORDER, priorities, 4, record_tree_task_order, &order);
+	fail_unless(order.number_of_finished_tasks == traversal.number_of_nodes);
+	for(i = 1; i < traversal.number_of_nodes; i++)
+	{
+		newick_node * node = traversal.pre_order[i];
+		fail_unless(order.finishing_positions[node->traversal_index] < order.finishing_positions[node->parent->traversal_index]);
+	}
+	
+	// and going down, the root holds up everything
+	calculate_critical_path_priorities(&traversal, TREE_TASKS_PRE_ORDER, node_costs, priorities);
+	fail_unless(priorities[root->traversal_index] == number_of_taxa);
+	memset(order.finishing_positions, 0, traversal.number_of_nodes*sizeof(int));
+	order.number_of_finished_tasks = 0;
+	run_tree_tasks(&traversal, TREE_TASKS_PRE_ORDER, priorities, 4, record_tree_task_order, &order);
+	fail_unless(order.number_of_finished_tasks == traversal.number_of_nodes);
+	for(i = 1; i < traversal.number_of_nodes; i++)
+	{
+		newick_node * node = traversal.pre_order[i];
+		fail_unless(order.finishing_positions[node->traversal_index] > order.finishing_positions[node->parent->traversal_index]);
+	}
+	
+	pthread_mutex_destroy(&(order.lock));
+	free(order.finishing_positions);
+	free(priorities);
+	free(node_costs);
+	free_tree_traversal(&traversal);
+	seqFreeAll();
+	free(tree_string);
+}
+END_TEST
+
+START_TEST (check_tree_tasks_write_the_same_outputs_as_one_thread)
+{
+	char * extensions[6] = {".tab", ".gff", ".branch_snps.tab", ".stats", ".phylip", ".vcf"};
+	char output_filename[MAX_FILENAME_SIZE];
+	char single_thread_filename[MAX_FILENAME_SIZE];
+	int i;
+	remove("../tests/data/multiple_recombinations.tre");
+	cp("../tests/data/multiple_recombinations.tre", "../tests/data/multiple_recombinations.original.tre");
+	run_gubbins("../tests/data/multiple_recombinations.aln.vcf", "../tests/data/multiple_recombinations.tre","../tests/data/multiple_recombinations.aln.snp_sites.aln",3,"../tests/data/multiple_recombinations.aln.snp_sites.aln",100,10000,1);
+	for(i = 0; i < 6; i++)
+	{
+		sprintf(output_filename, "../tests/data/multiple_recombinations.tre%s", extensions[i]);
+		sprintf(single_thread_filename, "../tests/data/multiple_recombinations.single_thread%s", extensions[i]);
+		cp(single_thread_filename, output_filename);
+	}
+	
+	remove("../tests/data/multiple_recombinations.tre");
+	cp("../tests/data/multiple_recombinations.tre", "../tests/data/multiple_recombinations.original.tre");
+	run_gubbins("../tests/data/multiple_recombinations.aln.vcf", "../tests/data/multiple_recombinations.tre","../tests/data/multiple_recombinations.aln.snp_sites.aln",3,"../tests/data/multiple_recombinations.aln.snp_sites.aln",100,10000,3);
+	for(i = 0; i < 6; i++)
+	{
+		sprintf(output_filename, "../tests/data/multiple_recombinations.tre%s", extensions[i]);
+		sprintf(single_thread_filename, "../tests/data/multiple_recombinations.single_thread%s", extensions[i]);
+		fail_unless(compare_files(output_filename, single_thread_filename) == 1);
+		remove(output_filename);
+		remove(single_thread_filename);
+	}
+	fail_unless(compare_files("../tests/data/multiple_recombinations.tre","../tests/data/multiple_recombinations.expected.tre") == 1);
+
+	remove("../tests/data/multiple_recombinations.tre");
+	remove("../tests/data/multiple_recombinations.tre.tab.fingerprint");
+	remove("../tests/data/multiple_recombinations.tre.bipartitions");
+	remove("../tests/data/multiple_recombinations.tre.snp_sites.aln");
+}
+END_TEST
+
+START_TEST (check_sparse_ancestors_write_the_same_outputs)
+{
+	char * extensions[6] = {".tab", ".gff", ".branch_snps.tab", ".stats", ".phylip", ".vcf"};
+	char output_filename[MAX_FILENAME_SIZE];
+	char dense_filename[MAX_FILENAME_SIZE];
+	int i;
+	remove("../tests/data/multiple_recombinations.tre");
+	cp("../tests/data/multiple_recombinations.tre", "../tests/data/multiple_recombinations.original.tre");
+	run_gubbins("../tests/data/multiple_recombinations.aln.vcf", "../tests/data/multiple_recombinations.tre","../tests/data/multiple_recombinations.aln.snp_sites.aln",3,"../tests/data/multiple_recombinations.aln.snp_sites.aln",100,10000,1);
+	for(i = 0; i < 6; i++)
+	{
+		sprintf(output_filename, "../tests/data/multiple_recombinations.tre%s", extensions[i]);
+		sprintf(dense_filename, "../tests/data/multiple_recombinations.dense%s", extensions[i]);
+		cp(dense_filename, output_filename);
+	}
+	
+	// The threads read the encoded rows while other nodes change theirs
+	set_sparse_sequence_rows(1);
+	remove("../tests/data/multiple_recombinations.tre");
+	cp("../tests/data/multiple_recombinations.tre", "../tests/data/multiple_recombinations.original.tre");
+	run_gubbins("../tests/data/multiple_recombinations.aln.vcf", "../tests/data/multiple_recombinations.tre","../tests/data/multiple_recombinations.aln.snp_sites.aln",3,"../tests/data/multiple_recombinations.aln.snp_sites.aln",100,10000,3);
+	set_sparse_sequence_rows(0);
+	for(i = 0; i < 6; i++)
+	{
+		sprintf(output_filename, "../tests/data/multiple_recombinations.tre%s", extensions[i]);
+		sprintf(dense_filename, "../tests/data/multiple_recombinations.dense%s", extensions[i]);
+		fail_unless(compare_files(output_filename, dense_filename) == 1);
+		remove(output_filename);
+		remove(dense_filename);
+	}
+	fail_unless(compare_files("../tests/data/multiple_recombinations.tre","../tests/data/multiple_recombinations.expected.tre") == 1);
+
+	remove("../tests/data/multiple_recombinations.tre");
+	remove("../tests/data/multiple_recombinations.tre.tab.fingerprint");
+	remove("../tests/data/multiple_recombinations.tre.bipartitions");
+	remove("../tests/data/multiple_recombinations.tre.snp_sites.aln");
+}
+END_TEST
+
+// The leaves of ((a,b)n1,(c,d)n2)root, in pre-order, with the internal nodes left for the reconstruction to fill in
+void reconstruct_small_tree(int method, char * leaf_sequences[4], char * expected_sequences[3])
+{
+	char tree_string[] = "((a:0.1,b:0.1)n1:0.1,(c:0.1,d:0.1)n2:0.1)root;";
+	int internal_nodes[3] = {0, 1, 4};
+	int leaves[4] = {2, 3, 5, 6};
+	char * node_sequences[7];
+	int is_reconstructed[7] = {1, 1, 0, 0, 1, 0, 0};
+	tree_traversal traversal;
+	int i;
+	seqMemInit();
+	newick_node * root = parseTree(tree_string);
+	build_tree_traversal(root, &traversal);
+	for(i = 0; i < 4; i++)
+	{
+		node_sequences[leaves[i]] = leaf_sequences[i];
+	}
+	for(i = 0; i < 3; i++)
+	{
+		node_sequences[internal_nodes[i]] = (char *) calloc(strlen(leaf_sequences[0])+1, sizeof(char));
+	}
+	reconstruct_ancestral_sequences(&traversal, node_sequences, is_reconstructed, strlen(leaf_sequences[0]), method);
+	for(i = 0; i < 3; i++)
+	{
+		fail_unless(strcmp(node_sequences[internal_nodes[i]], expected_sequences[i]) == 0);
+		free(node_sequences[internal_nodes[i]]);
+	}
+	free_tree_traversal(&traversal);
+	seqFreeAll();
+}
+
+START_TEST (check_parsimony_reconstructs_internal_nodes)
+{
+	char * leaf_sequences[4] = {"ACA", "ACN", "GCA", "GT-"};
+	char * expected_sequences[3] = {"ACA", "ACA", "GCA"};
+	reconstruct_small_tree(ANCESTRAL_RECONSTRUCTION_PARSIMONY, leaf_sequences, expected_sequences);
+	
+	// More than one word of columns, where the last column is the only one which differs between c and d
+	char * long_sequences[4];
+	char * long_expected_sequences[3];
+	char long_bases[7] = {'G', 'T', 'G', 'T', 'T', 'G', 'G'};
+	int i;
+	for(i = 0; i < 7; i++)
+	{
+		char * long_sequence = (char *) calloc(131, sizeof(char));
+		memset(long_sequence, long_bases[i], 130);
+		if(i < 3)
+		{
+			long_expected_sequences[i] = long_sequence;
+		}
+		else
+		{
+			long_sequences[i-3] = long_sequence;
+		}
+	}
+	long_sequences[3][129] = 'C';
+	long_expected_sequences[0][129] = 'C';
+	long_expected_sequences[2][129] = 'C';
+	reconstruct_small_tree(ANCESTRAL_RECONSTRUCTION_PARSIMONY, long_sequences, long_expected_sequences);
+	for(i = 0; i < 4; i++)
+	{
+		free(long_sequences[i]);
+	}
+	for(i = 0; i < 3; i++)
+	{
+		free(long_expected_sequences[i]);
+	}
+}
+END_TEST
+
+START_TEST (check_joint_likelihood_reconstructs_internal_nodes)
+{
+	char * leaf_sequences[4] = {"ACA", "ACN", "GCA", "GT-"};
+	char * expected_sequences[3] = {"ACA", "ACA", "GCA"};
+	reconstruct_small_tree(ANCESTRAL_RECONSTRUCTION_JOINT, leaf_sequences, expected_sequences);
+}
+END_TEST
+
+START_TEST (check_missing_ancestral_sequences_are_added_to_the_alignment)
+{
+	char * expected_names[7] = {"a", "b", "c", "d", "root", "n1", "n2"};
+	char * expected_sequences[7] = {"AC", "AC", "GC", "GT", "AC", "AC", "GC"};
+	char sequence[3] = {0};
+	int i;
+	load_sequences_from_multifasta_file("../tests/data/ancestral_reconstruction.aln");
+	set_ancestral_reconstruction(parse_ancestral_reconstruction("parsimony"));
+	reconstruct_missing_ancestral_sequences("../tests/data/ancestral_reconstruction.tre");
+	set_ancestral_reconstruction(ANCESTRAL_RECONSTRUCTION_NONE);
+	fail_unless(number_of_samples_from_parse_phylip() == 7);
+	for(i = 0; i < 7; i++)
+	{
+		get_sequence_for_sample_index(sequence, find_sequence_index_from_sample_name(expected_names[i]));
+		fail_unless(strcmp(sequence, expected_sequences[i]) == 0);
+	}
+	free_sample_statistics();
+	freeup_memory();
+}
+END_TEST
+
 Suite * run_gubbins_suite(void)
 {
   Suite *s = suite_create ("Checking the gubbins functionality");
@@ -129,7 +988,30 @@ Suite * run_gubbins_suite(void)
   tcase_add_test (tc_gubbins, check_gubbins_no_recombinations);
   //tcase_add_test (tc_gubbins, check_gubbins_one_recombination);
   tcase_add_test (tc_gubbins, check_gubbins_multiple_recombinations);
+  tcase_add_test (tc_gubbins, check_gubbins_multiple_recombinations_with_threads);
+  tcase_add_test (tc_gubbins, check_gubbins_writes_only_selected_outputs);
+  tcase_add_test (tc_gubbins, check_branch_snps_written_as_binary_columns);
+  tcase_add_test (tc_gubbins, check_trace_records_branch_scans_on_each_thread);
+  tcase_add_test (tc_gubbins, check_unchanged_branches_reuse_their_scans);
+  tcase_add_test (tc_gubbins, check_branch_scan_cache_filename_fits);
+  tcase_add_test (tc_gubbins, check_tree_shards_are_put_back_together);
+  tcase_add_test (tc_gubbins, check_gubbins_session_runs_several_iterations);
+  tcase_add_test (tc_gubbins, check_gubbins_session_reports_bad_input);
+  tcase_add_test (tc_gubbins, check_recombination_fingerprint_ignores_order);
+  tcase_add_test (tc_gubbins, check_reinsert_gaps_into_fasta_file);
   tcase_add_test (tc_gubbins, check_recombination_at_root);
+  tcase_add_test (tc_gubbins, check_parse_tree_keeps_quotes_and_branch_lengths);
+  tcase_add_test (tc_gubbins, check_taxon_sets_write_the_names_of_the_leaves_under_each_node);
+  tcase_add_test (tc_gubbins, check_parse_deep_caterpillar_tree);
+  tcase_add_test (tc_gubbins, check_tree_bipartitions_ignore_rooting_and_child_order);
+  tcase_add_test (tc_gubbins, check_tree_traversal_orders);
+  tcase_add_test (tc_gubbins, check_tree_passes_on_deep_caterpillar_tree);
+  tcase_add_test (tc_gubbins, check_tree_tasks_wait_for_their_dependencies);
+  tcase_add_test (tc_gubbins, check_tree_tasks_write_the_same_outputs_as_one_thread);
+  tcase_add_test (tc_gubbins, check_sparse_ancestors_write_the_same_outputs);
+  tcase_add_test (tc_gubbins, check_parsimony_reconstructs_internal_nodes);
+  tcase_add_test (tc_gubbins, check_joint_likelihood_reconstructs_internal_nodes);
+  tcase_add_test (tc_gubbins, check_missing_ancestral_sequences_are_added_to_the_alignment);
   suite_add_tcase (s, tc_gubbins);
   return s;
 }
@@ -5,6 +5,10 @@
 #include "check_parse_phylip.h"
 #include "helper_methods.h"
 #include "parse_phylip.h"
+#include "packed_sequence.h"
+#include "base_matrix.h"
+#include "matrix_storage.h"
+#include "sample_name_pool.h"
 
 
 START_TEST (phylip_read_in_small_file)
@@ -80,7 +84,349 @@ START_TEST (phylip_fill_in_unambiguous_bases_in_parent_from_children_where_paren
 }
 END_TEST
 
+START_TEST (phylip_lookup_by_sample_index)
+{
+  load_sequences_from_multifasta_file("../tests/data/small_phylip_file.aln");
+  fail_unless( find_sequence_index_from_sample_name("2956_6_3") == 2);
+  fail_unless( find_sequence_index_from_sample_name("2956_6_4") == -1);
+  fail_unless( find_sequence_index_from_sample_name("") == -1);
+  
+  char sequence_bases[10];
+  get_sequence_for_sample_index(sequence_bases, 1);
+  fail_unless( strcmp(sequence_bases, "AAGGC") == 0);
+  
+  set_number_of_snps_for_sample_index(2, 5);
+  set_number_of_blocks_for_sample("2956_6_3", 7);
+  set_number_of_snps_for_sample_index(-1, 9);
+  sample_statistics ** statistics = get_sample_statistics();
+  fail_unless( statistics[2]->number_of_snps == 5);
+  fail_unless( statistics[2]->number_of_blocks == 7);
+  freeup_memory();
+}
+END_TEST
+
+
+
+START_TEST (phylip_sequence_views_follow_updates)
+{
+  load_sequences_from_multifasta_file("../tests/data/small_phylip_file.aln");
+  const char * sequence_view = get_sequence_view_for_sample_index(1);
+  fail_unless( strcmp(sequence_view, "AAGGC") == 0);
+  fail_unless( get_sequence_view_for_sample_index(1) == sequence_view);
+  
+  update_sequence_base('N', 1, 2);
+  fail_unless( strcmp(get_sequence_view_for_sample_index(1), "AANGC") == 0);
+  fail_unless( strcmp(get_sequence_view_for_sample_index(0), "AACGC") == 0);
+  release_sequence_views();
+  fail_unless( strcmp(get_sequence_view_for_sample_index(1), "AANGC") == 0);
+  freeup_memory();
+}
+END_TEST
+
+START_TEST (phylip_sparse_rows_follow_updates)
+{
+  int * positions;
+  char * bases;
+  char sequence_bases[10];
+  int sequence_indices[3] = {0, 1, 2};
+  int parent_sequence_indices[3] = {-1, 0, 1};
+  set_sparse_sequence_rows(1);
+  load_sequences_from_multifasta_file("../tests/data/small_phylip_file.aln");
+  encode_sequence_rows_as_differences(sequence_indices, parent_sequence_indices, 3);
+  fail_unless( sequence_row_is_encoded(0) == 0 );
+  fail_unless( get_sequence_differences_from_parent(1, 0, &positions, &bases) == 1 );
+  fail_unless( positions[0] == 2 && bases[0] == 'G' );
+  fail_unless( get_sequence_differences_from_parent(2, 1, &positions, &bases) == 4 );
+  fail_unless( get_sequence_differences_from_parent(2, 0, &positions, &bases) == -1 );
+  get_sequence_for_sample_index(sequence_bases, 2);
+  fail_unless( strcmp(sequence_bases, "ATTTT") == 0 );
+  
+  // Changing a row leaves the rows encoded against it as they were
+  update_sequence_base('N', 1, 2);
+  fail_unless( strcmp(get_sequence_view_for_sample_index(1), "AANGC") == 0 );
+  fail_unless( strcmp(get_sequence_view_for_sample_index(2), "ATTTT") == 0 );
+  update_sequence_base('C', 0, 3);
+  fail_unless( strcmp(get_sequence_view_for_sample_index(0), "AACCC") == 0 );
+  fail_unless( strcmp(get_sequence_view_for_sample_index(1), "AANGC") == 0 );
+  fail_unless( get_sequence_differences_from_parent(1, 0, &positions, &bases) == 2 );
+  update_sequence_base('C', 1, 2);
+  fail_unless( get_sequence_differences_from_parent(1, 0, &positions, &bases) == 1 );
+  fail_unless( positions[0] == 3 && bases[0] == 'G' );
+  fail_unless( get_sequence_base(2, 1) == 'T' );
+  
+  int child_sequence_indices[1] = {2};
+  update_sequence_base('-', 2, 4);
+  fill_in_unambiguous_gaps_in_parent_from_children(1, child_sequence_indices, 1);
+  fail_unless( strcmp(get_sequence_view_for_sample_index(1), "AACGN") == 0 );
+  fail_unless( strcmp(get_sequence_view_for_sample_index(2), "ATTT-") == 0 );
+  freeup_memory();
+  set_sparse_sequence_rows(0);
+}
+END_TEST
+
+START_TEST (phylip_packed_sequence_round_trip)
+{
+  packed_sequence sequence;
+  char unpacked_bases[11];
+  initialise_packed_sequence(&sequence, 10);
+  pack_sequence(&sequence, "AC-GNTXaTA");
+  
+  fail_unless( get_packed_base(&sequence, 0) == 'A');
+  fail_unless( get_packed_base(&sequence, 2) == '-');
+  fail_unless( get_packed_base(&sequence, 4) == 'N');
+  fail_unless( get_packed_base(&sequence, 6) == 'X');
+  fail_unless( get_packed_base(&sequence, 7) == 'a');
+  unpack_sequence(&sequence, unpacked_bases);
+  fail_unless( strcmp(unpacked_bases, "AC-GNTXaTA") == 0 );
+  
+  set_packed_base(&sequence, 6, 'G');
+  set_packed_base(&sequence, 1, 'Z');
+  set_packed_base(&sequence, 2, 'T');
+  fail_unless( sequence.number_of_exceptions == 2);
+  unpack_sequence(&sequence, unpacked_bases);
+  fail_unless( strcmp(unpacked_bases, "AZTGNTGaTA") == 0 );
+  free_packed_sequence(&sequence);
+}
+END_TEST
 
+START_TEST (base_matrix_transpose_matches_naive_transpose)
+{
+  int number_of_rows = 37;
+  int number_of_columns = 53;
+  int i, j;
+  char * source_rows[37];
+  char * destination_rows[53];
+  allocate_base_matrix(source_rows, number_of_rows, number_of_columns);
+  allocate_base_matrix(destination_rows, number_of_columns, number_of_rows);
+  for(i = 0; i < number_of_rows; i++)
+  {
+    for(j = 0; j < number_of_columns; j++)
+    {
+      source_rows[i][j] = "ACGTN-"[(i*7 + j*3 + i*j) % 6];
+    }
+  }
+  transpose_base_matrix(source_rows, number_of_rows, number_of_columns, destination_rows);
+  for(i = 0; i < number_of_rows; i++)
+  {
+    for(j = 0; j < number_of_columns; j++)
+    {
+      fail_unless( destination_rows[j][i] == source_rows[i][j] );
+    }
+  }
+  for(j = 0; j < number_of_columns; j++)
+  {
+    fail_unless( destination_rows[j][number_of_rows] == '\0' );
+  }
+  free_base_matrix(source_rows, number_of_rows);
+  free_base_matrix(destination_rows, number_of_columns);
+}
+END_TEST
+
+START_TEST (phylip_sequences_in_mapped_storage_match_the_heap)
+{
+  char heap_sequences[3][10];
+  char sequence_bases[10];
+  int i;
+  load_sequences_from_multifasta_file("../tests/data/small_phylip_file.aln");
+  for(i = 0; i < 3; i++)
+  {
+    get_sequence_for_sample_index(heap_sequences[i], i);
+  }
+  freeup_memory();
+  
+  // A budget this small puts everything in a mapped file
+  set_matrix_memory_budget(1);
+  load_sequences_from_multifasta_file("../tests/data/small_phylip_file.aln");
+  for(i = 0; i < 3; i++)
+  {
+    get_sequence_for_sample_index(sequence_bases, i);
+    fail_unless( strcmp(sequence_bases, heap_sequences[i]) == 0 );
+  }
+  int sequence_indices[4] = {2, -1, 0, 2};
+  order_sequence_storage(sequence_indices, 4);
+  fail_unless( strcmp(get_sequence_view_for_sample_index(1), heap_sequences[1]) == 0 );
+  release_sequence_view_for_sample_index(1);
+  update_sequence_base('X', 1, 4);
+  get_sequence_for_sample_index(sequence_bases, 1);
+  fail_unless( strcmp(sequence_bases, "AAGGX") == 0 );
+  get_sequence_for_sample_index(sequence_bases, 2);
+  fail_unless( strcmp(sequence_bases, heap_sequences[2]) == 0 );
+  
+  char * rows[2];
+  allocate_base_matrix(rows, 2, 3);
+  fail_unless( matrix_storage_is_mapped(rows[0]) == 1 );
+  fail_unless( rows[1][3] == '\0' );
+  free_base_matrix(rows, 2);
+  freeup_memory();
+  fail_unless( get_matrix_storage_bytes_on_heap() == 0 );
+  set_matrix_memory_budget(0);
+}
+END_TEST
+
+START_TEST (phylip_packed_words_match_the_bases)
+{
+  packed_sequence sequence, other_sequence;
+  char bases[131], other_bases[131];
+  int i, word_index;
+  for(i = 0; i < 130; i++)
+  {
+    bases[i] = "ACGT-NnXa"[(i*7 + i/5) % 9];
+    other_bases[i] = "ACGT"[(i*3 + i/7) % 4];
+  }
+  bases[130] = other_bases[130] = '\0';
+  initialise_packed_sequence(&sequence, 130);
+  initialise_packed_sequence(&other_sequence, 130);
+  pack_sequence(&sequence, bases);
+  pack_sequence(&other_sequence, other_bases);
+  
+  fail_unless( get_number_of_packed_words(130) == 3 );
+  for(word_index = 0; word_index < 3; word_index++)
+  {
+    uint64_t missing = get_packed_missing_word(&sequence, word_index);
+    uint64_t non_acgt = get_packed_non_acgt_word(&sequence, word_index);
+    uint64_t differing = get_packed_differing_codes_word(&sequence, &other_sequence, word_index);
+    for(i = 0; i < PACKED_WORD_SIZE; i++)
+    {
+      int position = word_index*PACKED_WORD_SIZE + i;
+      int is_missing = position < 130 && (bases[position] == '-' || bases[position] == 'N' || bases[position] == 'n');
+      int is_acgt = position < 130 && strchr("ACGT", bases[position]) != NULL;
+      fail_unless( (int) ((missing >> i) & 1) == is_missing );
+      fail_unless( (int) ((non_acgt >> i) & 1) == (position < 130 && !is_acgt) );
+      if(is_acgt)
+      {
+        fail_unless( (int) ((differing >> i) & 1) == (bases[position] != other_bases[position]) );
+      }
+    }
+  }
+  free_packed_sequence(&sequence);
+  free_packed_sequence(&other_sequence);
+}
+END_TEST
+
+START_TEST (phylip_columns_with_snps_match_each_column_on_its_own)
+{
+  char * alignments[2] = {"../tests/data/small_phylip_file.aln", "../tests/data/alignment_with_gaps.aln"};
+  char * references[2] = {"N-AXC", "A-G-TN"};
+  int column_contains_snps[6];
+  int i, j;
+  for(i = 0; i < 2; i++)
+  {
+    load_sequences_from_multifasta_file(alignments[i]);
+    set_internal_node(1, 0);
+    int number_of_columns = strlen(references[i]);
+    find_columns_which_contain_snps(references[i], number_of_columns, column_contains_snps, 1);
+    for(j = 0; j < number_of_columns; j++)
+    {
+      fail_unless( column_contains_snps[j] == does_column_contain_snps(j, references[i][j]) );
+    }
+    freeup_memory();
+  }
+}
+END_TEST
+
+START_TEST (phylip_filtering_on_threads_matches_one_thread)
+{
+  char reference_bases[1001];
+  char * rows[3];
+  char * names[3] = {"first", "second", "third"};
+  int lengths[3] = {1000, 1000, 1000};
+  int column_contains_snps[1000], column_contains_snps_on_threads[1000];
+  int i, j;
+  for(i = 0; i < 3; i++)
+  {
+    rows[i] = (char *) calloc(1001, sizeof(char));
+    for(j = 0; j < 1000; j++)
+    {
+      rows[i][j] = "ACGT-N"[(j*(i+1) + j/13) % (j % 5 == 0 ? 6 : 4)];
+    }
+  }
+  load_sequences_from_rows(names, rows, lengths, 3, 1000);
+  get_sequence_for_sample_index(reference_bases, 0);
+  find_columns_which_contain_snps(reference_bases, 1000, column_contains_snps, 1);
+  find_columns_which_contain_snps(reference_bases, 1000, column_contains_snps_on_threads, 4);
+  int number_of_filtered_snps = 0;
+  for(j = 0; j < 1000; j++)
+  {
+    fail_unless( column_contains_snps_on_threads[j] == column_contains_snps[j] );
+    fail_unless( column_contains_snps[j] == does_column_contain_snps(j, reference_bases[j]) );
+    if(column_contains_snps[j] == 0)
+    {
+      reference_bases[j] = '*';
+    }
+    else
+    {
+      number_of_filtered_snps++;
+    }
+  }
+  
+  char * filtered_bases_for_samples[3];
+  char * filtered_bases_on_threads[3];
+  filter_sequence_bases(reference_bases, filtered_bases_for_samples, number_of_filtered_snps, 1);
+  filter_sequence_bases(reference_bases, filtered_bases_on_threads, number_of_filtered_snps, 2);
+  for(i = 0; i < 3; i++)
+  {
+    fail_unless( strcmp(filtered_bases_on_threads[i], filtered_bases_for_samples[i]) == 0 );
+  }
+  
+  char * filtered_bases_for_snps[1000];
+  char * filtered_bases_for_snps_on_threads[1000];
+  allocate_base_matrix(filtered_bases_for_snps, number_of_filtered_snps, 3);
+  allocate_base_matrix(filtered_bases_for_snps_on_threads, number_of_filtered_snps, 3);
+  transpose_base_matrix(filtered_bases_for_samples, 3, number_of_filtered_snps, filtered_bases_for_snps);
+  transpose_base_matrix_in_parallel(filtered_bases_for_samples, 3, number_of_filtered_snps, filtered_bases_for_snps_on_threads, 4);
+  for(j = 0; j < number_of_filtered_snps; j++)
+  {
+    fail_unless( strcmp(filtered_bases_for_snps_on_threads[j], filtered_bases_for_snps[j]) == 0 );
+  }
+  
+  // Rows rather than columns are split between the threads
+  char * transposed_rows[3];
+  allocate_base_matrix(transposed_rows, 3, number_of_filtered_snps);
+  transpose_base_matrix_in_parallel(filtered_bases_for_snps, number_of_filtered_snps, 3, transposed_rows, 4);
+  for(i = 0; i < 3; i++)
+  {
+    fail_unless( strcmp(transposed_rows[i], filtered_bases_for_samples[i]) == 0 );
+  }
+  
+  free_base_matrix(transposed_rows, 3);
+  free_base_matrix(filtered_bases_for_snps, number_of_filtered_snps);
+  free_base_matrix(filtered_bases_for_snps_on_threads, number_of_filtered_snps);
+  free_base_matrix(filtered_bases_for_samples, 3);
+  free_base_matrix(filtered_bases_on_threads, 3);
+  freeup_memory();
+  for(i = 0; i < 3; i++)
+  {
+    free(rows[i]);
+  }
+}
+END_TEST
+
+// The sequences, statistics and vcf columns share one copy of each name
+START_TEST (phylip_sample_names_are_shared_through_the_pool)
+{
+  load_sequences_from_multifasta_file("../tests/data/small_phylip_file.aln");
+  
+  int sample_name_id = find_sample_name_id("2956_6_2");
+  fail_unless( sample_name_id >= 0 );
+  fail_unless( intern_sample_name("2956_6_2") == sample_name_id );
+  fail_unless( find_sample_name_id("not_a_sample") == -1 );
+  
+  char *sample_names[3];
+  get_sample_names_from_parse_phylip(sample_names);
+  fail_unless( sample_names[1] == get_pooled_sample_name(sample_name_id) );
+  fail_unless( get_sample_statistics()[1]->sample_name == sample_names[1] );
+  fail_unless( pool_sample_name("2956_6_2") == sample_names[1] );
+  
+  // Names pooled after the sequences were loaded arent samples
+  int number_of_pooled_sample_names = get_number_of_pooled_sample_names();
+  char * new_name = pool_sample_name("not_a_sample");
+  fail_unless( get_number_of_pooled_sample_names() == number_of_pooled_sample_names + 1 );
+  fail_unless( strcmp(new_name, "not_a_sample") == 0 );
+  fail_unless( find_sequence_index_from_sample_name("not_a_sample") == -1 );
+  fail_unless( find_sequence_index_from_sample_name("2956_6_2") == 1 );
+  freeup_memory();
+}
+END_TEST
 
 Suite * parse_phylip_suite(void)
 {
@@ -89,6 +435,16 @@ Suite * parse_phylip_suite(void)
   tcase_add_test (tc_phylip, phylip_read_in_small_file);
   tcase_add_test (tc_phylip, phylip_read_in_file_with_gaps);
   tcase_add_test (tc_phylip, phylip_fill_in_unambiguous_bases_in_parent_from_children_where_parent_has_a_gap);
+  tcase_add_test (tc_phylip, phylip_lookup_by_sample_index);
+  tcase_add_test (tc_phylip, phylip_sequence_views_follow_updates);
+  tcase_add_test (tc_phylip, phylip_packed_sequence_round_trip);
+  tcase_add_test (tc_phylip, base_matrix_transpose_matches_naive_transpose);
+  tcase_add_test (tc_phylip, phylip_sequences_in_mapped_storage_match_the_heap);
+  tcase_add_test (tc_phylip, phylip_packed_words_match_the_bases);
+  tcase_add_test (tc_phylip, phylip_columns_with_snps_match_each_column_on_its_own);
+  tcase_add_test (tc_phylip, phylip_filtering_on_threads_matches_one_thread);
+  tcase_add_test (tc_phylip, phylip_sample_names_are_shared_through_the_pool);
+  tcase_add_test (tc_phylip, phylip_sparse_rows_follow_updates);
   suite_add_tcase (s, tc_phylip);
   return s;
 }
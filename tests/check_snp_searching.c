@@ -219,6 +219,44 @@ START_TEST (check_find_number_of_snps_in_block)
   fail_unless( find_number_of_snps_in_block(0,20, coords_even, child_sequence, 8) == 8);
 	
 }
+END_TEST
+
+START_TEST (check_find_number_of_snps_in_block_with_prefix_index)
+{
+  int coords_empty[0] = {};
+  int coords_even[8]  = {1,3,5,7,11,13,17,19};
+
+	fail_unless( find_number_of_snps_in_block_with_prefix_index(1,3,  coords_empty, 0) == 0);
+	fail_unless( find_number_of_snps_in_block_with_prefix_index(2,2,  coords_even, 8) == 0);
+	fail_unless( find_number_of_snps_in_block_with_prefix_index(1,3,  coords_even, 8) == 1);
+  fail_unless( find_number_of_snps_in_block_with_prefix_index(1,4,  coords_even, 8) == 2);
+  fail_unless( find_number_of_snps_in_block_with_prefix_index(1,5,  coords_even, 8) == 2);
+  fail_unless( find_number_of_snps_in_block_with_prefix_index(1,19, coords_even, 8) == 7);
+  fail_unless( find_number_of_snps_in_block_with_prefix_index(0,20, coords_even, 8) == 8);
+	
+	fail_unless( advance_window_start_to_next_snp_with_prefix_index(4,  coords_even, 8) == 5);
+	fail_unless( advance_window_start_to_next_snp_with_prefix_index(5,  coords_even, 8) == 5);
+	fail_unless( advance_window_start_to_next_snp_with_prefix_index(20, coords_even, 8) == 20);
+	fail_unless( rewind_window_end_to_last_snp_with_prefix_index(10, coords_even, 8) == 7);
+	fail_unless( rewind_window_end_to_last_snp_with_prefix_index(11, coords_even, 8) == 11);
+	fail_unless( rewind_window_end_to_last_snp_with_prefix_index(0,  coords_even, 8) == 0);
+}
+END_TEST
+
+START_TEST (check_calculate_block_size_without_gaps_with_prefix_index)
+{
+  int coords_even[8]  = {1,3,5,7,11,13,17,19};
+	char *child_sequence = "AA-AN-AA";
+	int gap_prefix_counts[9];
+	calculate_gap_prefix_counts(child_sequence, 8, gap_prefix_counts);
+	
+	fail_unless( gap_prefix_counts[8] == 3);
+	fail_unless( calculate_block_size_without_gaps_with_prefix_index(gap_prefix_counts, coords_even, 1, 5, 8) == 4);
+	fail_unless( calculate_block_size_without_gaps_with_prefix_index(gap_prefix_counts, coords_even, 1, 6, 8) == 4);
+	fail_unless( calculate_block_size_without_gaps_with_prefix_index(gap_prefix_counts, coords_even, 5, 14, 8) == 6);
+	fail_unless( calculate_block_size_without_gaps_with_prefix_index(gap_prefix_counts, coords_even, 0, 20, 8) == 17);
+	fail_unless( calculate_block_size_without_gaps_with_prefix_index(gap_prefix_counts, coords_even, 5, 14, 8) == calculate_block_size_without_gaps(child_sequence, coords_even, 5, 14, 8));
+}
 END_TEST
 
 	//int calculate_number_of_snps_excluding_gaps(char * ancestor_sequence, char * child_sequence, int child_sequence_size, int * branch_snp_coords, int * snp_locations)
@@ -296,6 +334,8 @@ Suite * check_snp_searching_suite (void)
 	tcase_add_test (tc_snp_searching, check_rewind_window_end_to_last_snp);
 	tcase_add_test (tc_snp_searching, check_get_window_end_coordinates_excluding_gaps);
 	tcase_add_test (tc_snp_searching, check_find_number_of_snps_in_block);
+	tcase_add_test (tc_snp_searching, check_find_number_of_snps_in_block_with_prefix_index);
+	tcase_add_test (tc_snp_searching, check_calculate_block_size_without_gaps_with_prefix_index);
 	tcase_add_test (tc_snp_searching, check_calculate_number_of_snps_excluding_gaps);
   suite_add_tcase (s, tc_snp_searching);
 
@@ -8,6 +8,12 @@
 
 #include "snp_sites.h"
 #include "alignment_file.h"
+#include "snp_detection.h"
+#include "bgzf_file.h"
+#include "alignment_cache.h"
+#include "compressed_reader.h"
+#include "alignment_filter.h"
+#include "matrix_storage.h"
 	
 	
 START_TEST (valid_alignment_with_large_numbers_of_snps)
@@ -77,6 +83,154 @@ START_TEST (valid_alignment_with_multiple_lines_per_sequence)
 }
 END_TEST
 
+START_TEST (snp_sites_including_and_excluding_gaps_in_one_pass)
+{
+  generate_snp_sites("../tests/data/alignment_file_with_n.aln",0,".separate_gaps");
+  generate_snp_sites("../tests/data/alignment_file_with_n.aln",1,".separate");
+  generate_snp_sites_including_and_excluding_gaps("../tests/data/alignment_file_with_n.aln",".fused_gaps",".fused",1);
+  fail_unless( compare_files("alignment_file_with_n.aln.separate_gaps.vcf", "alignment_file_with_n.aln.fused_gaps.vcf" ) == 1 );
+  fail_unless( compare_files("alignment_file_with_n.aln.separate_gaps.phylip", "alignment_file_with_n.aln.fused_gaps.phylip" ) == 1 );
+  fail_unless( compare_files("alignment_file_with_n.aln.separate_gaps.snp_sites.aln", "alignment_file_with_n.aln.fused_gaps.snp_sites.aln" ) == 1 );
+  fail_unless( compare_files("alignment_file_with_n.aln.separate.vcf", "alignment_file_with_n.aln.fused.vcf" ) == 1 );
+  fail_unless( compare_files("alignment_file_with_n.aln.separate.phylip", "alignment_file_with_n.aln.fused.phylip" ) == 1 );
+  fail_unless( compare_files("alignment_file_with_n.aln.separate.snp_sites.aln", "alignment_file_with_n.aln.fused.snp_sites.aln" ) == 1 );
+  remove("alignment_file_with_n.aln.separate_gaps.vcf");
+  remove("alignment_file_with_n.aln.separate_gaps.phylip");
+  remove("alignment_file_with_n.aln.separate_gaps.snp_sites.aln");
+  remove("alignment_file_with_n.aln.separate.vcf");
+  remove("alignment_file_with_n.aln.separate.phylip");
+  remove("alignment_file_with_n.aln.separate.snp_sites.aln");
+  remove("alignment_file_with_n.aln.fused_gaps.vcf");
+  remove("alignment_file_with_n.aln.fused_gaps.phylip");
+  remove("alignment_file_with_n.aln.fused_gaps.snp_sites.aln");
+  remove("alignment_file_with_n.aln.fused.vcf");
+  remove("alignment_file_with_n.aln.fused.phylip");
+  remove("alignment_file_with_n.aln.fused.snp_sites.aln");
+}
+END_TEST
+
+START_TEST (snp_sites_written_on_several_threads)
+{
+  generate_snp_sites_including_and_excluding_gaps("../tests/data/alignment_file_with_large_number_of_snps.aln",".threaded_gaps","",4);
+  fail_unless( compare_files("../tests/data/alignment_file_with_large_number_of_snps.aln.vcf", "alignment_file_with_large_number_of_snps.aln.vcf" ) == 1 );
+  fail_unless( compare_files("../tests/data/alignment_file_with_large_number_of_snps.aln.phylip", "alignment_file_with_large_number_of_snps.aln.phylip" ) == 1 );
+  fail_unless( compare_files("../tests/data/alignment_file_with_large_number_of_snps.aln.snp_sites.aln", "alignment_file_with_large_number_of_snps.aln.snp_sites.aln" ) == 1 );
+  remove("alignment_file_with_large_number_of_snps.aln.threaded_gaps.vcf");
+  remove("alignment_file_with_large_number_of_snps.aln.threaded_gaps.phylip");
+  remove("alignment_file_with_large_number_of_snps.aln.threaded_gaps.snp_sites.aln");
+  remove("alignment_file_with_large_number_of_snps.aln.vcf");
+  remove("alignment_file_with_large_number_of_snps.aln.phylip");
+  remove("alignment_file_with_large_number_of_snps.aln.snp_sites.aln");
+}
+END_TEST
+
+START_TEST (snp_sites_streamed_within_the_memory_budget)
+{
+  // A few bytes only holds one sample or a couple of snps at a time, so every file is written in many blocks
+  set_matrix_memory_budget(8);
+  generate_snp_sites_including_and_excluding_gaps("../tests/data/alignment_file_with_large_number_of_snps.aln",".streamed_gaps","",4);
+  generate_snp_sites("../tests/data/alignment_file_with_n.aln",0,".streamed");
+  set_matrix_memory_budget(0);
+  fail_unless( compare_files("../tests/data/alignment_file_with_large_number_of_snps.aln.vcf", "alignment_file_with_large_number_of_snps.aln.vcf" ) == 1 );
+  fail_unless( compare_files("../tests/data/alignment_file_with_large_number_of_snps.aln.phylip", "alignment_file_with_large_number_of_snps.aln.phylip" ) == 1 );
+  fail_unless( compare_files("../tests/data/alignment_file_with_large_number_of_snps.aln.snp_sites.aln", "alignment_file_with_large_number_of_snps.aln.snp_sites.aln" ) == 1 );
+  fail_unless( compare_files("../tests/data/alignment_file_one_line_per_sequence.aln.vcf", "alignment_file_with_n.aln.streamed.vcf" ) == 1 );
+  fail_unless( compare_files("../tests/data/alignment_file_one_line_per_sequence.aln.phylip", "alignment_file_with_n.aln.streamed.phylip" ) == 1 );
+  fail_unless( compare_files("../tests/data/alignment_file_one_line_per_sequence.aln.snp_sites.aln", "alignment_file_with_n.aln.streamed.snp_sites.aln" ) == 1 );
+  remove("alignment_file_with_large_number_of_snps.aln.streamed_gaps.vcf");
+  remove("alignment_file_with_large_number_of_snps.aln.streamed_gaps.phylip");
+  remove("alignment_file_with_large_number_of_snps.aln.streamed_gaps.snp_sites.aln");
+  remove("alignment_file_with_large_number_of_snps.aln.vcf");
+  remove("alignment_file_with_large_number_of_snps.aln.phylip");
+  remove("alignment_file_with_large_number_of_snps.aln.snp_sites.aln");
+  remove("alignment_file_with_n.aln.streamed.vcf");
+  remove("alignment_file_with_n.aln.streamed.phylip");
+  remove("alignment_file_with_n.aln.streamed.snp_sites.aln");
+}
+END_TEST
+
+START_TEST (snp_sites_written_compressed)
+{
+  set_output_compression(1, 4);
+  generate_snp_sites("../tests/data/alignment_file_with_large_number_of_snps.aln",0,".compressed");
+  set_output_compression(0, 1);
+  fail_unless( is_bgzf_file("alignment_file_with_large_number_of_snps.aln.compressed.vcf") == 1 );
+  fail_unless( is_bgzf_file("alignment_file_with_large_number_of_snps.aln.compressed.phylip") == 1 );
+  fail_unless( is_bgzf_file("alignment_file_with_large_number_of_snps.aln.compressed.snp_sites.aln") == 1 );
+  fail_unless( decompress_file("alignment_file_with_large_number_of_snps.aln.compressed.vcf", "alignment_file_with_large_number_of_snps.aln.decompressed.vcf") == 1 );
+  fail_unless( decompress_file("alignment_file_with_large_number_of_snps.aln.compressed.phylip", "alignment_file_with_large_number_of_snps.aln.decompressed.phylip") == 1 );
+  fail_unless( decompress_file("alignment_file_with_large_number_of_snps.aln.compressed.snp_sites.aln", "alignment_file_with_large_number_of_snps.aln.decompressed.snp_sites.aln") == 1 );
+  fail_unless( compare_files("../tests/data/alignment_file_with_large_number_of_snps.aln.vcf", "alignment_file_with_large_number_of_snps.aln.decompressed.vcf" ) == 1 );
+  fail_unless( compare_files("../tests/data/alignment_file_with_large_number_of_snps.aln.phylip", "alignment_file_with_large_number_of_snps.aln.decompressed.phylip" ) == 1 );
+  fail_unless( compare_files("../tests/data/alignment_file_with_large_number_of_snps.aln.snp_sites.aln", "alignment_file_with_large_number_of_snps.aln.decompressed.snp_sites.aln" ) == 1 );
+  remove("alignment_file_with_large_number_of_snps.aln.compressed.vcf");
+  remove("alignment_file_with_large_number_of_snps.aln.compressed.phylip");
+  remove("alignment_file_with_large_number_of_snps.aln.compressed.snp_sites.aln");
+  remove("alignment_file_with_large_number_of_snps.aln.decompressed.vcf");
+  remove("alignment_file_with_large_number_of_snps.aln.decompressed.phylip");
+  remove("alignment_file_with_large_number_of_snps.aln.decompressed.snp_sites.aln");
+}
+END_TEST
+
+// Reads the file through the compressed reader in pieces which dont line up with its buffers
+int compressed_file_matches(char filename[], char * expected, size_t expected_length)
+{
+  char piece[1000];
+  size_t offset = 0;
+  int bytes_read;
+  int matches = 1;
+  compressed_reader * reader = open_compressed_reader(filename);
+  while((bytes_read = read_compressed_reader(reader, piece, sizeof(piece))) > 0)
+  {
+    if(offset + bytes_read > expected_length || memcmp(piece, expected + offset, bytes_read) != 0)
+    {
+      matches = 0;
+      break;
+    }
+    offset += bytes_read;
+  }
+  close_compressed_reader(reader);
+  return matches && offset == expected_length;
+}
+
+START_TEST (compressed_files_read_on_threads)
+{
+  int i;
+  FILE * alignment_file_pointer = fopen("../tests/data/alignment_file_one_line_per_sequence.aln", "r");
+  char * alignment = (char *) malloc(220000*8);
+  size_t alignment_length = fread(alignment, 1, 220000, alignment_file_pointer);
+  fclose(alignment_file_pointer);
+  for(i = 1; i < 8; i++)
+  {
+    memcpy(alignment + i*alignment_length, alignment, alignment_length);
+  }
+  
+  // Enough copies of the alignment for several batches of blocks
+  set_output_compression(1, 4);
+  FILE * compressed_file_pointer = open_output_file("alignment_file_one_line_per_sequence.aln.bgzf");
+  fwrite(alignment, 1, alignment_length*8, compressed_file_pointer);
+  fclose(compressed_file_pointer);
+  set_output_compression(0, 1);
+  fail_unless( is_bgzf_file("alignment_file_one_line_per_sequence.aln.bgzf") == 1 );
+  
+  set_decompression_threads(1);
+  fail_unless( compressed_file_matches("alignment_file_one_line_per_sequence.aln.bgzf", alignment, alignment_length*8) == 1 );
+  set_decompression_threads(4);
+  fail_unless( compressed_file_matches("alignment_file_one_line_per_sequence.aln.bgzf", alignment, alignment_length*8) == 1 );
+  
+  // Plain gzip and uncompressed files go through the same reader
+  fail_unless( compressed_file_matches("../tests/data/alignment_file_one_line_per_sequence.aln.gz", alignment, alignment_length) == 1 );
+  fail_unless( compressed_file_matches("../tests/data/alignment_file_one_line_per_sequence.aln", alignment, alignment_length) == 1 );
+  
+  // Only the first sequence is read for the length, so the reader is closed while it is still decompressing
+  fail_unless( genome_length("alignment_file_one_line_per_sequence.aln.bgzf") == 2000 );
+  set_decompression_threads(1);
+  
+  free(alignment);
+  remove("alignment_file_one_line_per_sequence.aln.bgzf");
+}
+END_TEST
+
 START_TEST (two_sequences)
 {
     generate_snp_sites("../tests/data/two_sequences.aln",0,"");
@@ -148,6 +302,100 @@ START_TEST (number_of_snps_detected_small)
 END_TEST
 
 
+START_TEST (alignment_loaded_once_and_indexed)
+{
+  loaded_alignment * alignment = load_alignment("../tests/data/alignment_file_multiple_lines_per_sequence.aln");
+  fail_unless( alignment->number_of_sequences == 109 );
+  fail_unless( strcmp(alignment->sequence_names[0], "2956_6_1") == 0 );
+  fail_unless( alignment->sequence_lengths[0] == 2000 );
+  fail_unless( alignment->sequence_lengths[108] == 2000 );
+  fail_unless( alignment->record_offsets[0] == 0 );
+  fail_unless( strncmp(alignment->sequences[0] + 52, "ACTATTAAGG", 10) == 0 );
+  fail_unless( load_alignment("../tests/data/alignment_file_multiple_lines_per_sequence.aln") == alignment );
+  
+  alignment = load_alignment("../tests/data/small_alignment.aln");
+  fail_unless( alignment->number_of_sequences == 3 );
+  fail_unless( strcmp(alignment->sequence_names[2], "another_comparison_sequence") == 0 );
+  fail_unless( strncmp(alignment->sequences[0], "aaccggtt", 8) == 0 );
+  free_loaded_alignment();
+}
+END_TEST
+
+START_TEST (alignment_read_back_from_binary_cache)
+{
+  remove("cached_alignment.aln");
+  remove("cached_alignment.aln.gubbins_cache");
+  cp("cached_alignment.aln", "../tests/data/alignment_file_multiple_lines_per_sequence.aln");
+  set_alignment_cache(1);
+  loaded_alignment * alignment = load_alignment("cached_alignment.aln");
+  fail_unless( alignment->number_of_sequences == 109 );
+  free_loaded_alignment();
+  fail_unless( file_exists("cached_alignment.aln.gubbins_cache") == 1 );
+  fail_unless( cached_genome_length("cached_alignment.aln") == 2000 );
+  
+  // Only the cache is read the second time
+  alignment = load_alignment("cached_alignment.aln");
+  fail_unless( alignment->number_of_sequences == 109 );
+  fail_unless( strcmp(alignment->sequence_names[0], "2956_6_1") == 0 );
+  fail_unless( alignment->sequence_lengths[108] == 2000 );
+  fail_unless( strncmp(alignment->sequences[0] + 52, "ACTATTAAGG", 10) == 0 );
+  fail_unless( alignment->sequences[0][2000] == '\0' );
+  fail_unless( genome_length("cached_alignment.aln") == 2000 );
+  free_loaded_alignment();
+  
+  // A different alignment with the same name isnt served from the old cache
+  remove("cached_alignment.aln");
+  cp("cached_alignment.aln", "../tests/data/small_alignment.aln");
+  fail_unless( cached_genome_length("cached_alignment.aln") == -1 );
+  alignment = load_alignment("cached_alignment.aln");
+  fail_unless( alignment->number_of_sequences == 3 );
+  fail_unless( strcmp(alignment->sequence_names[2], "another_comparison_sequence") == 0 );
+  free_loaded_alignment();
+  
+  set_alignment_cache(0);
+  remove("cached_alignment.aln");
+  remove("cached_alignment.aln.gubbins_cache");
+}
+END_TEST
+
+START_TEST (vector_snp_kernels_match_scalar_kernel)
+{
+  char alphabet[] = "ACGTacgtNn-*X\xe9";
+  mark_snps_kernel kernels[] = {mark_snps_sse2, mark_snps_avx2, mark_snps_neon, mark_snps};
+  int length_of_genome = 1003;
+  char sequences[20][1003];
+  char scalar_reference[1004];
+  char kernel_reference[1004];
+  int exclude_gaps, kernel_index, sequence_number, i;
+  
+  srand(1);
+  for(sequence_number = 0; sequence_number < 20; sequence_number++)
+  {
+    for(i = 0; i < length_of_genome; i++)
+    {
+      // Mostly agreeing columns so that both references change gradually
+      sequences[sequence_number][i] = (rand() % 4 == 0) ? alphabet[rand() % 14] : alphabet[i % 4];
+    }
+  }
+  
+  for(exclude_gaps = 0; exclude_gaps <= 1; exclude_gaps++)
+  {
+    for(kernel_index = 0; kernel_index < 4; kernel_index++)
+    {
+      memcpy(scalar_reference, sequences[0], length_of_genome);
+      memcpy(kernel_reference, sequences[0], length_of_genome);
+      for(sequence_number = 1; sequence_number < 20; sequence_number++)
+      {
+        int scalar_snps = mark_snps_scalar(scalar_reference, sequences[sequence_number], length_of_genome, exclude_gaps);
+        int kernel_snps = kernels[kernel_index](kernel_reference, sequences[sequence_number], length_of_genome, exclude_gaps);
+        fail_unless( scalar_snps == kernel_snps );
+        fail_unless( memcmp(scalar_reference, kernel_reference, length_of_genome) == 0 );
+      }
+    }
+  }
+}
+END_TEST
+
 START_TEST (sample_names_from_alignment_file)
 {
   char *expected_sequence_names[] ={"reference_sequence","comparison_sequence","another_comparison_sequence"};
@@ -187,6 +435,39 @@ END_TEST
 
 
 
+START_TEST (missing_bases_counted_eight_at_a_time)
+{
+	char sequence[] = "ANnN-ACG-nTTTTTTTTTn";
+	fail_unless(count_missing_bases(sequence, 20) == 7);
+	fail_unless(count_missing_bases(sequence, 8) == 4);
+	fail_unless(count_missing_bases(sequence, 3) == 2);
+	fail_unless(count_missing_bases(sequence, 0) == 0);
+}
+END_TEST
+
+START_TEST (alignment_filtered_of_missing_data_and_identical_sequences)
+{
+	int number_of_threads;
+	for(number_of_threads = 1; number_of_threads <= 3; number_of_threads += 2)
+	{
+		fail_unless(filter_alignment_file("../tests/data/filter_alignment.aln", "../tests/data/filter_alignment.filtered.aln", "../tests/data/filter_alignment.removed_taxa", 25, 1, number_of_threads) == ALIGNMENT_FILTER_OK);
+		fail_unless(compare_files("../tests/data/filter_alignment.filtered.aln", "../tests/data/filter_alignment.expected.aln") == 1);
+		fail_unless(compressed_file_matches("../tests/data/filter_alignment.removed_taxa", "sample1\nsample3\n", 16) == 1);
+	}
+	
+	// None has more than half its bases missing, and the identical sequences are kept
+	filter_alignment_file("../tests/data/filter_alignment.aln", "../tests/data/filter_alignment.filtered.aln", "../tests/data/filter_alignment.removed_taxa", 50, 0, 1);
+	fail_unless(compressed_file_matches("../tests/data/filter_alignment.removed_taxa", "", 0) == 1);
+	
+	// None is left when every sequence is excluded, and the failures are returned rather than exiting
+	fail_unless(filter_alignment_file("../tests/data/filter_alignment.aln", "../tests/data/filter_alignment.filtered.aln", "../tests/data/filter_alignment.removed_taxa", -1, 1, 1) == ALIGNMENT_FILTER_TOO_FEW_SEQUENCES);
+	fail_unless(filter_alignment_file("../tests/data/filter_alignment.aln", "../tests/data/no_such_directory/filter_alignment.filtered.aln", "../tests/data/filter_alignment.removed_taxa", 50, 0, 1) == ALIGNMENT_FILTER_CANNOT_WRITE_OUTPUT);
+	remove("../tests/data/filter_alignment.filtered.aln");
+	remove("../tests/data/filter_alignment.removed_taxa");
+	free_loaded_alignment();
+}
+END_TEST
+
 Suite * snp_sites_suite (void)
 {
   Suite *s = suite_create ("Creating_SNP_Sites");
@@ -202,6 +483,9 @@ Suite * snp_sites_suite (void)
   tcase_add_test (tc_alignment_file, number_of_snps_detected);
 	tcase_add_test (tc_alignment_file, number_of_snps_detected_include_gaps);
   tcase_add_test (tc_alignment_file, sample_names_from_alignment_file);
+  tcase_add_test (tc_alignment_file, alignment_loaded_once_and_indexed);
+  tcase_add_test (tc_alignment_file, alignment_read_back_from_binary_cache);
+  tcase_add_test (tc_alignment_file, vector_snp_kernels_match_scalar_kernel);
   tcase_add_test (tc_alignment_file, check_strip_directory_from_filename_without_directory);
 	tcase_add_test (tc_alignment_file, check_strip_directory_from_filename_with_directory);
   suite_add_tcase (s, tc_alignment_file);
@@ -213,6 +497,13 @@ Suite * snp_sites_suite (void)
   tcase_add_test (tc_snp_sites, valid_alignment_with_one_line_per_sequence_gzipped);
 	tcase_add_test (tc_snp_sites, valid_alignment_with_n_as_gap);
 	tcase_add_test (tc_snp_sites, two_sequences);
+	tcase_add_test (tc_snp_sites, snp_sites_including_and_excluding_gaps_in_one_pass);
+	tcase_add_test (tc_snp_sites, snp_sites_written_on_several_threads);
+	tcase_add_test (tc_snp_sites, snp_sites_streamed_within_the_memory_budget);
+	tcase_add_test (tc_snp_sites, snp_sites_written_compressed);
+	tcase_add_test (tc_snp_sites, compressed_files_read_on_threads);
+	tcase_add_test (tc_snp_sites, missing_bases_counted_eight_at_a_time);
+	tcase_add_test (tc_snp_sites, alignment_filtered_of_missing_data_and_identical_sequences);
   suite_add_tcase (s, tc_snp_sites);
 
   return s;
@@ -5,20 +5,161 @@
 #include "check_vcf_parsing.h"
 #include "helper_methods.h"
 #include "parse_vcf.h"
+#include "alignment_file.h"
+#include "bgzf_file.h"
+#include "vcf.h"
+#include "contigs.h"
+#include "sample_name_pool.h"
 
 
 START_TEST (check_parsing_of_vcf_files)
 {
-  // Todo insert tests
+  FILE * vcf_file_pointer = fopen("../tests/data/one_recombination.expected.vcf", "r");
+  int number_of_columns = get_number_of_columns_from_file(vcf_file_pointer);
+  fail_unless( number_of_columns == 19 );
+  
+  char * column_names[19];
+  int i;
+  for(i = 0; i < 19; i++)
+  {
+    column_names[i] = calloc(MAX_SAMPLE_NAME_SIZE,sizeof(char));
+  }
+  get_column_names(vcf_file_pointer, column_names, number_of_columns);
+  fail_unless( strcmp(column_names[0], "#CHROM") == 0 );
+  fail_unless( strcmp(column_names[9], "sequence_1") == 0 );
+  fail_unless( strcmp(column_names[18], "sequence_10") == 0 );
+  fail_unless( column_number_for_column_name(column_names, "POS", number_of_columns) == 1 );
+  
+  int snp_locations[32];
+  get_integers_from_column_in_vcf(vcf_file_pointer, snp_locations, 32, 1);
+  fail_unless( snp_locations[0] == 1 );
+  fail_unless( snp_locations[1] == 6 );
+  fail_unless( snp_locations[2] == 8 );
+  fail_unless( snp_locations[31] == 169 );
+  
+  char sequence_bases[33];
+  get_sequence_from_column_in_vcf(vcf_file_pointer, sequence_bases, 32, 10);
+  fail_unless( strncmp(sequence_bases, "C-----C-AAAA", 12) == 0 );
+  fail_unless( strlen(sequence_bases) == 32 );
+  
+  for(i = 0; i < 19; i++)
+  {
+    free(column_names[i]);
+  }
+  free_vcf_index();
+  fclose(vcf_file_pointer);
 }
 END_TEST
 
 
+START_TEST (check_parsing_of_compressed_vcf_files)
+{
+  char vcf_line[4096];
+  FILE * input_file_pointer = fopen("../tests/data/one_recombination.expected.vcf", "r");
+  set_output_compression(1, 2);
+  FILE * compressed_file_pointer = open_output_file("one_recombination.compressed.vcf");
+  set_output_compression(0, 1);
+  while(fgets(vcf_line, sizeof(vcf_line), input_file_pointer) != NULL)
+  {
+    fputs(vcf_line, compressed_file_pointer);
+  }
+  fclose(input_file_pointer);
+  fclose(compressed_file_pointer);
+  fail_unless( is_bgzf_file("one_recombination.compressed.vcf") == 1 );
+  
+  FILE * vcf_file_pointer = fopen("one_recombination.compressed.vcf", "r");
+  fail_unless( get_number_of_columns_from_file(vcf_file_pointer) == 19 );
+  int snp_locations[32];
+  get_integers_from_column_in_vcf(vcf_file_pointer, snp_locations, 32, 1);
+  fail_unless( snp_locations[0] == 1 );
+  fail_unless( snp_locations[31] == 169 );
+  char sequence_bases[33];
+  get_sequence_from_column_in_vcf(vcf_file_pointer, sequence_bases, 32, 10);
+  fail_unless( strncmp(sequence_bases, "C-----C-AAAA", 12) == 0 );
+  free_vcf_index();
+  fclose(vcf_file_pointer);
+  remove("one_recombination.compressed.vcf");
+}
+END_TEST
+
+START_TEST (check_vcf_positions_are_counted_from_the_start_of_their_contig)
+{
+  char vcf_row[256];
+  char * bases_for_snp = "ACC";
+  int internal_nodes[3] = {0, 0, 0};
+  add_contig("chromosome", 20);
+  add_contig("plasmid", 30);
+  fail_unless( find_contig_for_position(20) == 0 );
+  fail_unless( find_contig_for_position(21) == 1 );
+  
+  vcf_row[format_vcf_row(vcf_row, bases_for_snp, 19, 3, internal_nodes, 1)] = '\0';
+  fail_unless( strcmp(vcf_row, "chromosome\t20\t.\tA\tC\t.\t.\t.\tAB\tA\tC\tC\n") == 0 );
+  vcf_row[format_vcf_row(vcf_row, bases_for_snp, 23, 3, internal_nodes, 0)] = '\0';
+  fail_unless( strcmp(vcf_row, "plasmid\t3\t.\tA\tC\t.\t.\t.\tAB\tA\tC\tC\n") == 0 );
+  
+  // Reading the vcf back gives the same contigs, and the positions in the whole genome
+  char * sample_names[3] = {"sequence_1", "sequence_2", "sequence_3"};
+  FILE * vcf_file_pointer = tmpfile();
+  output_vcf_header(vcf_file_pointer, sample_names, 3, internal_nodes, 50);
+  fputs("chromosome\t20\t.\tA\tC\t.\t.\t.\tAB\tA\tC\tC\n", vcf_file_pointer);
+  fputs("plasmid\t3\t.\tA\tC\t.\t.\t.\tAB\tA\tC\tC\n", vcf_file_pointer);
+  fflush(vcf_file_pointer);
+  clear_contigs();
+  load_contigs_from_vcf(vcf_file_pointer);
+  fail_unless( get_number_of_contigs() == 2 );
+  fail_unless( strcmp(get_contig_name(1, "1"), "plasmid") == 0 );
+  fail_unless( get_contig_start(1) == 20 );
+  fail_unless( get_contig_end(1, 50) == 50 );
+  int snp_locations[2];
+  get_integers_from_column_in_vcf(vcf_file_pointer, snp_locations, 2, 1);
+  convert_vcf_positions_to_genome(vcf_file_pointer, snp_locations, 2);
+  fail_unless( snp_locations[0] == 20 );
+  fail_unless( snp_locations[1] == 23 );
+  free_vcf_index();
+  fclose(vcf_file_pointer);
+  
+  // The single contig written without any contigs is the same as none
+  char * header = "##fileformat=VCFv4.2\n##contig=<ID=1,length=50>\n";
+  load_contigs_from_vcf_header(header, strlen(header));
+  fail_unless( contigs_have_been_given() == 0 );
+  fail_unless( get_number_of_contigs() == 1 );
+  vcf_row[format_vcf_row(vcf_row, bases_for_snp, 23, 3, internal_nodes, 0)] = '\0';
+  fail_unless( strncmp(vcf_row, "1\t23\t", 5) == 0 );
+}
+END_TEST
+
+START_TEST (check_pooled_column_names_match_the_copied_names)
+{
+  FILE * vcf_file_pointer = fopen("../tests/data/one_recombination.expected.vcf", "r");
+  int number_of_columns = get_number_of_columns_from_file(vcf_file_pointer);
+  char * column_names[19];
+  char * pooled_column_names[19];
+  int i;
+  for(i = 0; i < 19; i++)
+  {
+    column_names[i] = calloc(MAX_SAMPLE_NAME_SIZE,sizeof(char));
+  }
+  get_column_names(vcf_file_pointer, column_names, number_of_columns);
+  get_pooled_column_names(vcf_file_pointer, pooled_column_names, number_of_columns);
+  for(i = 0; i < 19; i++)
+  {
+    fail_unless( strcmp(column_names[i], pooled_column_names[i]) == 0 );
+    fail_unless( pool_sample_name(column_names[i]) == pooled_column_names[i] );
+    free(column_names[i]);
+  }
+  free_vcf_index();
+  fclose(vcf_file_pointer);
+}
+END_TEST
+
 Suite * parse_vcf_suite(void)
 {
   Suite *s = suite_create ("Parsing a vcf file");
   TCase *tc_parse_vcf = tcase_create ("check_parsing_of_vcf_files");
   tcase_add_test (tc_parse_vcf, check_parsing_of_vcf_files);
+  tcase_add_test (tc_parse_vcf, check_parsing_of_compressed_vcf_files);
+  tcase_add_test (tc_parse_vcf, check_vcf_positions_are_counted_from_the_start_of_their_contig);
+  tcase_add_test (tc_parse_vcf, check_pooled_column_names_match_the_copied_names);
   suite_add_tcase (s, tc_parse_vcf);
   return s;
 }
@@ -5,6 +5,7 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <zlib.h>
 #include "helper_methods.h"
 
 
@@ -138,3 +139,102 @@ int cp(const char *to, const char *from)
     errno = saved_errno;
     return -1;
 }
+
+// Inflate a gzip or BGZF file so it can be compared with compare_files
+int decompress_file(char compressed_filename[], char output_filename[])
+{
+  char buffer[4096];
+  int bytes_read;
+  gzFile compressed_file = gzopen(compressed_filename, "r");
+  FILE * output_file_pointer = fopen(output_filename, "w");
+  if(compressed_file == NULL || output_file_pointer == NULL)
+  {
+    return 0;
+  }
+  while((bytes_read = gzread(compressed_file, buffer, sizeof(buffer))) > 0)
+  {
+    fwrite(buffer, 1, bytes_read, output_file_pointer);
+  }
+  gzclose(compressed_file);
+  fclose(output_file_pointer);
+  return bytes_read == 0;
+}
+
+// A BGZF block starts with a gzip header carrying the BC extra field
+int is_bgzf_file(char * fileName)
+{
+  unsigned char header[16] = {0};
+  FILE * file_pointer = fopen(fileName, "r");
+  if(file_pointer == NULL)
+  {
+    return 0;
+  }
+  size_t header_size = fread(header, 1, sizeof(header), file_pointer);
+  fclose(file_pointer);
+  return header_size == sizeof(header) && header[0] == 0x1f && header[1] == 0x8b && (header[3] & 4) && header[12] == 'B' && header[13] == 'C';
+}
+
+int compare_feature_strings(const void * a, const void * b)
+{
+  return strcmp(*(char **) a, *(char **) b);
+}
+
+// Splits the file into its EMBL features, which start on the lines with a key after the FT, and sorts them
+char ** read_sorted_features(char * fileName, int * number_of_features)
+{
+  FILE * file_pointer = fopen(fileName, "r");
+  char ** features = NULL;
+  char * line = NULL;
+  size_t line_capacity = 0;
+  ssize_t line_length;
+  *number_of_features = 0;
+  if(file_pointer == NULL)
+  {
+    return NULL;
+  }
+  while((line_length = getline(&line, &line_capacity, file_pointer)) > 0)
+  {
+    if(line_length > 5 && strncmp(line, "FT   ", 5) == 0 && line[5] != ' ')
+    {
+      features = (char **) realloc(features, (*number_of_features + 1)*sizeof(char *));
+      features[*number_of_features] = (char *) calloc(1, sizeof(char));
+      (*number_of_features)++;
+    }
+    if(*number_of_features > 0)
+    {
+      char * feature = features[*number_of_features - 1];
+      size_t feature_length = strlen(feature);
+      feature = (char *) realloc(feature, feature_length + line_length + 1);
+      memcpy(feature + feature_length, line, line_length + 1);
+      features[*number_of_features - 1] = feature;
+    }
+  }
+  free(line);
+  fclose(file_pointer);
+  qsort(features, *number_of_features, sizeof(char *), compare_feature_strings);
+  return features;
+}
+
+int compare_features_in_any_order(char expected_output_filename[], char actual_output_filename[])
+{
+  int i;
+  int number_of_expected_features, number_of_actual_features;
+  char ** expected_features = read_sorted_features(expected_output_filename, &number_of_expected_features);
+  char ** actual_features = read_sorted_features(actual_output_filename, &number_of_actual_features);
+  int matches = number_of_expected_features == number_of_actual_features;
+  for(i = 0; i < number_of_expected_features && matches; i++)
+  {
+    matches = strcmp(expected_features[i], actual_features[i]) == 0;
+  }
+  for(i = 0; i < number_of_expected_features; i++)
+  {
+    free(expected_features[i]);
+  }
+  for(i = 0; i < number_of_actual_features; i++)
+  {
+    free(actual_features[i]);
+  }
+  free(expected_features);
+  free(actual_features);
+  return matches;
+}
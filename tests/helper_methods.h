@@ -23,6 +23,9 @@
 int compare_files(char expected_output_filename[],char actual_output_filename[] );
 int file_exists(char * fileName);
 int cp(const char *to, const char *from);
+int decompress_file(char compressed_filename[], char output_filename[]);
+int is_bgzf_file(char * fileName);
+int compare_features_in_any_order(char expected_output_filename[], char actual_output_filename[]);
 #endif
 
 
@@ -0,0 +1,389 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+// Times the core kernels on synthetic data and prints the results as JSON. Run it with "make bench",
+// passing any options in BENCH_ARGS, such as make bench BENCH_ARGS="--taxa 500 --genome_length 5000000"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <unistd.h>
+#include "synthetic_data.h"
+#include "branch_sequences.h"
+#include "snp_searching.h"
+#include "snp_sites.h"
+#include "Newickform.h"
+#include "tree_scaling.h"
+#include "seqUtil.h"
+#include "alignment_file.h"
+#include "alignment_cache.h"
+#include "parse_vcf.h"
+#include "vcf.h"
+
+#define BENCHMARK_FILENAME_SIZE 1024
+
+// Everything the operations need, made once before any of them are timed
+typedef struct benchmark_state
+{
+	synthetic_parameters * parameters;
+	synthetic_branch branch;
+	seq_arena scratch_arena;
+	int window_size;
+	int cutoff;
+	candidate_block * blocks;
+	candidate_block * working_blocks;
+	int number_of_blocks;
+	int * gap_prefix_counts;
+	char * tree_string;
+	char * tree_buffer;
+	size_t length_of_tree_string;
+	char alignment_filename[BENCHMARK_FILENAME_SIZE+1];
+	char vcf_base_filename[BENCHMARK_FILENAME_SIZE+1];
+	char vcf_filename[BENCHMARK_FILENAME_SIZE+1];
+	char * reference_sequence;
+	char * working_reference_sequence;
+	int * vcf_snp_locations;
+	int number_of_vcf_snps;
+	char ** bases_for_snps;
+	char ** sample_names;
+	int * internal_nodes;
+	long number_of_calls;
+	double checksum;
+} benchmark_state;
+
+typedef void (*benchmark_operation)(benchmark_state * state);
+
+double benchmark_min_seconds = 0.5;
+int number_of_benchmark_results = 0;
+
+double elapsed_seconds(struct timespec * start_time, struct timespec * end_time)
+{
+	return (end_time->tv_sec - start_time->tv_sec) + (end_time->tv_nsec - start_time->tv_nsec)/1e9;
+}
+
+// Runs the operation in batches which double in size until a batch takes at least benchmark_min_seconds
+void run_benchmark(char * name, benchmark_operation operation, benchmark_state * state, double items_per_operation, char * item_name)
+{
+	struct timespec start_time;
+	struct timespec end_time;
+	long batch_size = 1;
+	long i;
+	double seconds = 0.0;
+	
+	// once to warm up the caches
+	operation(state);
+	while(1)
+	{
+		clock_gettime(CLOCK_MONOTONIC, &start_time);
+		for(i = 0; i < batch_size; i++)
+		{
+			operation(state);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end_time);
+		seconds = elapsed_seconds(&start_time, &end_time);
+		if(seconds >= benchmark_min_seconds || batch_size >= (1L << 30))
+		{
+			break;
+		}
+		batch_size *= 2;
+	}
+	
+	printf("%s\n    {\"name\": \"%s\", \"iterations\": %ld, \"ns_per_op\": %.1f, \"%s_per_second\": %.1f}",
+		(number_of_benchmark_results > 0) ? "," : "", name, batch_size, seconds*1e9/batch_size, item_name,
+		(seconds > 0) ? items_per_operation*batch_size/seconds : 0.0);
+	fflush(stdout);
+	number_of_benchmark_results++;
+}
+
+void benchmark_get_blocks(benchmark_state * state)
+{
+	synthetic_branch * branch = &state->branch;
+	state->checksum += get_blocks(state->working_blocks, state->parameters->genome_length, branch->branch_snp_coords, branch->number_of_branch_snps, state->window_size, state->cutoff, branch->child_sequence, branch->snp_locations, branch->number_of_snps, &state->scratch_arena);
+}
+
+// The blocks are moved in place, so each run starts from a copy of the ones get_blocks found
+void benchmark_move_blocks_inwards(benchmark_state * state)
+{
+	synthetic_branch * branch = &state->branch;
+	memcpy(state->working_blocks, state->blocks, state->number_of_blocks*sizeof(candidate_block));
+	move_blocks_inwards_while_likelihood_improves(state->number_of_blocks, state->working_blocks, 3, branch->branch_snp_coords, branch->number_of_branch_snps, branch->snp_locations, branch->branch_genome_size, branch->number_of_snps, state->cutoff, state->gap_prefix_counts);
+	state->checksum += state->working_blocks[0].start;
+}
+
+void benchmark_get_block_likelihood(benchmark_state * state)
+{
+	int variation = (int) (state->number_of_calls % 100);
+	state->number_of_calls++;
+	state->checksum += get_block_likelihood(state->branch.branch_genome_size, state->branch.number_of_branch_snps, 1000 + 10*variation, 5 + variation/10);
+}
+
+void benchmark_calculate_cutoff(benchmark_state * state)
+{
+	int variation = (int) (state->number_of_calls % 100);
+	state->number_of_calls++;
+	state->checksum += calculate_cutoff(state->branch.branch_genome_size, state->window_size + variation, state->branch.number_of_branch_snps);
+}
+
+void benchmark_parse_tree(benchmark_state * state)
+{
+	memcpy(state->tree_buffer, state->tree_string, state->length_of_tree_string + 1);
+	seqMemInit();
+	newick_node * root = parseTree(state->tree_buffer);
+	state->checksum += root->childNum;
+	cleanup_node_memory(root);
+	seqFreeAll();
+}
+
+void benchmark_detect_snps(benchmark_state * state)
+{
+	memcpy(state->working_reference_sequence, state->reference_sequence, state->parameters->genome_length + 1);
+	state->checksum += detect_snps(state->working_reference_sequence, state->alignment_filename, state->parameters->genome_length, 0);
+}
+
+void benchmark_write_vcf(benchmark_state * state)
+{
+	create_vcf_file(state->vcf_base_filename, state->vcf_snp_locations, state->number_of_vcf_snps, state->bases_for_snps, state->sample_names, state->parameters->number_of_taxa, state->internal_nodes, 0, state->parameters->genome_length, 1);
+}
+
+void benchmark_read_vcf(benchmark_state * state)
+{
+	int i;
+	FILE * vcf_file_pointer = fopen(state->vcf_filename, "r");
+	if(vcf_file_pointer == NULL)
+	{
+		printf("Couldnt open the benchmark vcf '%s'\n", state->vcf_filename);
+		exit(1);
+	}
+	int number_of_columns = get_number_of_columns_from_file(vcf_file_pointer);
+	char ** column_names = (char **) calloc(number_of_columns + 1, sizeof(char *));
+	for(i = 0; i < number_of_columns; i++)
+	{
+		column_names[i] = (char *) calloc(MAX_SAMPLE_NAME_SIZE, sizeof(char));
+	}
+	get_column_names(vcf_file_pointer, column_names, number_of_columns);
+	get_integers_from_column_in_vcf(vcf_file_pointer, state->vcf_snp_locations, state->number_of_vcf_snps, column_number_for_column_name(column_names, "POS", number_of_columns));
+	state->checksum += state->vcf_snp_locations[0];
+	
+	for(i = 0; i < number_of_columns; i++)
+	{
+		free(column_names[i]);
+	}
+	free(column_names);
+	free_vcf_index();
+	fclose(vcf_file_pointer);
+}
+
+// The blocks get_likelihood_for_windows would move inwards, with their likelihoods
+void find_blocks_for_branch(benchmark_state * state)
+{
+	int i;
+	synthetic_branch * branch = &state->branch;
+	int maximum_number_of_blocks = branch->number_of_branch_snps + 1;
+	state->blocks = (candidate_block *) calloc(maximum_number_of_blocks, sizeof(candidate_block));
+	state->working_blocks = (candidate_block *) calloc(maximum_number_of_blocks, sizeof(candidate_block));
+	state->gap_prefix_counts = (int *) calloc(branch->number_of_snps + 1, sizeof(int));
+	calculate_gap_prefix_counts(branch->child_sequence, branch->number_of_snps, state->gap_prefix_counts);
+	
+	state->window_size = calculate_window_size(branch->branch_genome_size, branch->number_of_branch_snps, 100, 10000);
+	state->cutoff = calculate_cutoff(branch->branch_genome_size, state->window_size, branch->number_of_branch_snps);
+	state->number_of_blocks = get_blocks(state->blocks, state->parameters->genome_length, branch->branch_snp_coords, branch->number_of_branch_snps, state->window_size, state->cutoff, branch->child_sequence, branch->snp_locations, branch->number_of_snps, &state->scratch_arena);
+	for(i = 0; i < state->number_of_blocks; i++)
+	{
+		candidate_block * block = &state->blocks[i];
+		block->snp_count = find_number_of_snps_in_block_with_prefix_index(block->start, block->end, branch->branch_snp_coords, branch->number_of_branch_snps);
+		block->genome_size_without_gaps = calculate_block_size_without_gaps_with_prefix_index(state->gap_prefix_counts, branch->snp_locations, block->start, block->end, branch->number_of_snps);
+		block->likelihood = get_block_likelihood(branch->branch_genome_size, branch->number_of_branch_snps, block->genome_size_without_gaps, block->snp_count);
+	}
+}
+
+// The snps of the synthetic alignment with random bases for each sample, in the layout create_vcf_file takes
+void make_vcf_data(benchmark_state * state)
+{
+	int i;
+	int j;
+	int number_of_taxa = state->parameters->number_of_taxa;
+	unsigned int seed = state->parameters->seed;
+	char bases[4] = {'A','C','G','T'};
+	
+	state->vcf_snp_locations = (int *) calloc(state->number_of_vcf_snps + 1, sizeof(int));
+	build_snp_locations(state->vcf_snp_locations, state->working_reference_sequence);
+	state->bases_for_snps = (char **) calloc(state->number_of_vcf_snps + 1, sizeof(char *));
+	for(i = 0; i < state->number_of_vcf_snps; i++)
+	{
+		state->bases_for_snps[i] = (char *) calloc(number_of_taxa + 1, sizeof(char));
+		for(j = 0; j < number_of_taxa; j++)
+		{
+			state->bases_for_snps[i][j] = bases[synthetic_random_number(&seed, 4)];
+		}
+	}
+	state->sample_names = (char **) calloc(number_of_taxa + 1, sizeof(char *));
+	state->internal_nodes = (int *) calloc(number_of_taxa + 1, sizeof(int));
+	for(j = 0; j < number_of_taxa; j++)
+	{
+		state->sample_names[j] = (char *) calloc(64, sizeof(char));
+		sprintf(state->sample_names[j], "taxon_%d", j);
+	}
+}
+
+void free_benchmark_state(benchmark_state * state)
+{
+	int i;
+	free(state->blocks);
+	free(state->working_blocks);
+	free(state->gap_prefix_counts);
+	free(state->tree_string);
+	free(state->tree_buffer);
+	free(state->reference_sequence);
+	free(state->working_reference_sequence);
+	free(state->vcf_snp_locations);
+	for(i = 0; i < state->number_of_vcf_snps; i++)
+	{
+		free(state->bases_for_snps[i]);
+	}
+	free(state->bases_for_snps);
+	for(i = 0; i < state->parameters->number_of_taxa; i++)
+	{
+		free(state->sample_names[i]);
+	}
+	free(state->sample_names);
+	free(state->internal_nodes);
+	free_seq_arena(&state->scratch_arena);
+	free_synthetic_branch(&state->branch);
+}
+
+void print_benchmark_usage(FILE * stream, char * program_name, int exit_code)
+{
+	fprintf(stream, "Usage: %s [options]\n", program_name);
+	fprintf(stream,
+		"  -n    Number of taxa (default 100)\n"
+		"  -l    Genome length (default 1000000)\n"
+		"  -d    SNP density, the fraction of columns which are snps (default 0.01)\n"
+		"  -r    Number of recombinations (default 20)\n"
+		"  -g    Length of each recombination (default 5000)\n"
+		"  -s    Random seed (default 1)\n"
+		"  -t    Minimum seconds to time each benchmark for (default 0.5)\n"
+		"  -o    Directory for the temporary files (default /tmp)\n"
+		"  -h    Display this usage information\n");
+	exit(exit_code);
+}
+
+int main(int argc, char ** argv)
+{
+	int c;
+	synthetic_parameters parameters;
+	benchmark_state state;
+	char temporary_directory[BENCHMARK_FILENAME_SIZE+1] = {"/tmp"};
+	set_default_synthetic_parameters(&parameters);
+	memset(&state, 0, sizeof(benchmark_state));
+	state.parameters = &parameters;
+	
+	while(1)
+	{
+		static struct option long_options[] =
+		{
+			{"taxa",                 required_argument, 0, 'n'},
+			{"genome_length",        required_argument, 0, 'l'},
+			{"snp_density",          required_argument, 0, 'd'},
+			{"recombinations",       required_argument, 0, 'r'},
+			{"recombination_length", required_argument, 0, 'g'},
+			{"seed",                 required_argument, 0, 's'},
+			{"min_time",             required_argument, 0, 't'},
+			{"directory",            required_argument, 0, 'o'},
+			{"help",                 no_argument,       0, 'h'},
+			{0, 0, 0, 0}
+		};
+		int option_index = 0;
+		c = getopt_long(argc, argv, "n:l:d:r:g:s:t:o:h", long_options, &option_index);
+		if(c == -1)
+		{
+			break;
+		}
+		switch(c)
+		{
+			case 'n': parameters.number_of_taxa = atoi(optarg); break;
+			case 'l': parameters.genome_length = atoi(optarg); break;
+			case 'd': parameters.snp_density = atof(optarg); break;
+			case 'r': parameters.number_of_recombinations = atoi(optarg); break;
+			case 'g': parameters.recombination_length = atoi(optarg); break;
+			case 's': parameters.seed = (unsigned int) atoi(optarg); break;
+			case 't': benchmark_min_seconds = atof(optarg); break;
+			case 'o': snprintf(temporary_directory, sizeof(temporary_directory), "%s", optarg); break;
+			case 'h': print_benchmark_usage(stdout, argv[0], EXIT_SUCCESS);
+			default: print_benchmark_usage(stderr, argv[0], EXIT_FAILURE);
+		}
+	}
+	if(parameters.number_of_taxa < 2 || parameters.genome_length < 1000 || parameters.snp_density <= 0 || parameters.snp_density >= 1 || parameters.recombination_length >= parameters.genome_length)
+	{
+		printf("Need at least 2 taxa, a genome of at least 1000 bases, a snp density between 0 and 1 and recombinations shorter than the genome\n");
+		exit(1);
+	}
+	
+	// The synthetic alignment, tree and branch
+	char directory_template[BENCHMARK_FILENAME_SIZE+1];
+	snprintf(directory_template, sizeof(directory_template), "%s/gubbins_bench_XXXXXX", temporary_directory);
+	if(mkdtemp(directory_template) == NULL)
+	{
+		printf("Couldnt make a temporary directory in '%s'\n", temporary_directory);
+		exit(1);
+	}
+	snprintf(state.alignment_filename, BENCHMARK_FILENAME_SIZE, "%s/synthetic.aln", directory_template);
+	snprintf(state.vcf_base_filename, BENCHMARK_FILENAME_SIZE, "%s/synthetic", directory_template);
+	snprintf(state.vcf_filename, BENCHMARK_FILENAME_SIZE, "%s/synthetic.vcf", directory_template);
+	set_alignment_cache(0);
+	write_synthetic_alignment(&parameters, state.alignment_filename);
+	unsigned int tree_seed = parameters.seed;
+	state.tree_string = generate_synthetic_tree_string(parameters.number_of_taxa, &tree_seed);
+	state.length_of_tree_string = strlen(state.tree_string);
+	state.tree_buffer = (char *) calloc(state.length_of_tree_string + 1, sizeof(char));
+	generate_synthetic_branch(&parameters, &state.branch);
+	initialise_seq_arena(&state.scratch_arena);
+	find_blocks_for_branch(&state);
+	
+	state.reference_sequence = (char *) calloc(parameters.genome_length + 1, sizeof(char));
+	state.working_reference_sequence = (char *) calloc(parameters.genome_length + 1, sizeof(char));
+	build_reference_sequence(state.reference_sequence, state.alignment_filename);
+	memcpy(state.working_reference_sequence, state.reference_sequence, parameters.genome_length + 1);
+	state.number_of_vcf_snps = detect_snps(state.working_reference_sequence, state.alignment_filename, parameters.genome_length, 0);
+	make_vcf_data(&state);
+	
+	printf("{\n  \"parameters\": {\"taxa\": %d, \"genome_length\": %d, \"snp_density\": %g, \"recombinations\": %d, \"recombination_length\": %d, \"seed\": %u,",
+		parameters.number_of_taxa, parameters.genome_length, parameters.snp_density, parameters.number_of_recombinations, parameters.recombination_length, parameters.seed);
+	printf(" \"snps\": %d, \"branch_snps\": %d, \"blocks\": %d},\n  \"benchmarks\": [",
+		state.number_of_vcf_snps, state.branch.number_of_branch_snps, state.number_of_blocks);
+	
+	run_benchmark("get_blocks", benchmark_get_blocks, &state, state.branch.number_of_branch_snps, "branch_snps");
+	run_benchmark("move_blocks_inwards_while_likelihood_improves", benchmark_move_blocks_inwards, &state, state.number_of_blocks, "blocks");
+	run_benchmark("get_block_likelihood", benchmark_get_block_likelihood, &state, 1, "calls");
+	run_benchmark("calculate_cutoff", benchmark_calculate_cutoff, &state, 1, "calls");
+	run_benchmark("parseTree", benchmark_parse_tree, &state, parameters.number_of_taxa, "taxa");
+	run_benchmark("detect_snps", benchmark_detect_snps, &state, ((double) parameters.number_of_taxa)*parameters.genome_length, "bases");
+	run_benchmark("create_vcf_file", benchmark_write_vcf, &state, state.number_of_vcf_snps, "snps");
+	run_benchmark("read_vcf", benchmark_read_vcf, &state, state.number_of_vcf_snps, "snps");
+	
+	// The checksum keeps the compiler from throwing away the results
+	printf("\n  ],\n  \"checksum\": %g\n}\n", state.checksum);
+	
+	unlink(state.alignment_filename);
+	unlink(state.vcf_filename);
+	rmdir(directory_template);
+	free_benchmark_state(&state);
+	return 0;
+}
@@ -0,0 +1,239 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "synthetic_data.h"
+
+static const char synthetic_bases[4] = {'A','C','G','T'};
+
+void set_default_synthetic_parameters(synthetic_parameters * parameters)
+{
+	parameters->number_of_taxa = 100;
+	parameters->genome_length = 1000000;
+	parameters->snp_density = 0.01;
+	parameters->number_of_recombinations = 20;
+	parameters->recombination_length = 5000;
+	parameters->seed = 1;
+}
+
+// The same seed always gives the same data, so runs can be compared
+int synthetic_random_number(unsigned int * seed, int maximum)
+{
+	if(maximum <= 0)
+	{
+		return 0;
+	}
+	*seed = (*seed)*1103515245 + 12345;
+	return (int) (((*seed) >> 1) % ((unsigned int) maximum));
+}
+
+static char different_base(char base, unsigned int * seed)
+{
+	char new_base = synthetic_bases[synthetic_random_number(seed, 4)];
+	while(new_base == base)
+	{
+		new_base = synthetic_bases[synthetic_random_number(seed, 4)];
+	}
+	return new_base;
+}
+
+// Each taxon is the reference with mutations shared out so that about snp_density of the columns are snps,
+// and each recombination gives one taxon a stretch of recombination_length bases with ten times as many mutations
+void write_synthetic_alignment(synthetic_parameters * parameters, char * alignment_filename)
+{
+	int i;
+	int j;
+	unsigned int seed = parameters->seed;
+	int genome_length = parameters->genome_length;
+	int mutation_threshold = (int) (parameters->snp_density*1000000/parameters->number_of_taxa);
+	FILE * alignment_file_pointer = fopen(alignment_filename, "w");
+	if(alignment_file_pointer == NULL)
+	{
+		printf("Couldnt write the synthetic alignment '%s'\n", alignment_filename);
+		exit(1);
+	}
+	
+	char * reference_sequence = (char *) calloc(genome_length + 1, sizeof(char));
+	char * taxon_sequence = (char *) calloc(genome_length + 1, sizeof(char));
+	for(i = 0; i < genome_length; i++)
+	{
+		reference_sequence[i] = synthetic_bases[synthetic_random_number(&seed, 4)];
+	}
+	int * recombination_taxa = (int *) calloc(parameters->number_of_recombinations + 1, sizeof(int));
+	int * recombination_starts = (int *) calloc(parameters->number_of_recombinations + 1, sizeof(int));
+	for(i = 0; i < parameters->number_of_recombinations; i++)
+	{
+		recombination_taxa[i] = synthetic_random_number(&seed, parameters->number_of_taxa);
+		recombination_starts[i] = synthetic_random_number(&seed, genome_length - parameters->recombination_length);
+	}
+	
+	for(j = 0; j < parameters->number_of_taxa; j++)
+	{
+		memcpy(taxon_sequence, reference_sequence, genome_length);
+		for(i = 0; i < genome_length; i++)
+		{
+			if(synthetic_random_number(&seed, 1000000) < mutation_threshold)
+			{
+				taxon_sequence[i] = different_base(reference_sequence[i], &seed);
+			}
+		}
+		for(i = 0; i < parameters->number_of_recombinations; i++)
+		{
+			int k;
+			if(recombination_taxa[i] != j)
+			{
+				continue;
+			}
+			for(k = recombination_starts[i]; k < recombination_starts[i] + parameters->recombination_length && k < genome_length; k++)
+			{
+				if(synthetic_random_number(&seed, 1000000) < 10*(int) (parameters->snp_density*1000000))
+				{
+					taxon_sequence[k] = different_base(reference_sequence[k], &seed);
+				}
+			}
+		}
+		fprintf(alignment_file_pointer, ">taxon_%d\n", j);
+		fwrite(taxon_sequence, sizeof(char), genome_length, alignment_file_pointer);
+		fprintf(alignment_file_pointer, "\n");
+	}
+	
+	fclose(alignment_file_pointer);
+	free(recombination_taxa);
+	free(recombination_starts);
+	free(reference_sequence);
+	free(taxon_sequence);
+}
+
+// A random binary tree, made by joining random pairs of subtrees until only one is left
+char * generate_synthetic_tree_string(int number_of_taxa, unsigned int * seed)
+{
+	int i;
+	int number_of_subtrees = number_of_taxa;
+	char ** subtrees = (char **) calloc(number_of_taxa + 1, sizeof(char *));
+	for(i = 0; i < number_of_taxa; i++)
+	{
+		subtrees[i] = (char *) calloc(64, sizeof(char));
+		sprintf(subtrees[i], "taxon_%d:0.%03d", i, synthetic_random_number(seed, 1000));
+	}
+	
+	while(number_of_subtrees > 1)
+	{
+		int first = synthetic_random_number(seed, number_of_subtrees);
+		int second = synthetic_random_number(seed, number_of_subtrees - 1);
+		if(second >= first)
+		{
+			second++;
+		}
+		size_t joined_size = strlen(subtrees[first]) + strlen(subtrees[second]) + 64;
+		char * joined_subtree = (char *) calloc(joined_size, sizeof(char));
+		if(number_of_subtrees == 2)
+		{
+			sprintf(joined_subtree, "(%s,%s);", subtrees[first], subtrees[second]);
+		}
+		else
+		{
+			sprintf(joined_subtree, "(%s,%s):0.%03d", subtrees[first], subtrees[second], synthetic_random_number(seed, 1000));
+		}
+		free(subtrees[first]);
+		free(subtrees[second]);
+		
+		// The joined subtree takes the lower slot and the last subtree fills the higher one
+		int lower = (first < second) ? first : second;
+		int higher = (first < second) ? second : first;
+		subtrees[lower] = joined_subtree;
+		subtrees[higher] = subtrees[number_of_subtrees - 1];
+		number_of_subtrees--;
+	}
+	
+	char * tree_string = subtrees[0];
+	free(subtrees);
+	return tree_string;
+}
+
+// The snps of the whole alignment are spread at random over the genome with a few gaps. A branch
+// carries one in fifty of them in the background and every snp inside each of its recombinations.
+void generate_synthetic_branch(synthetic_parameters * parameters, synthetic_branch * branch)
+{
+	int i;
+	int j;
+	unsigned int seed = parameters->seed;
+	int genome_length = parameters->genome_length;
+	int number_of_snps = (int) (genome_length*parameters->snp_density);
+	if(number_of_snps < 1)
+	{
+		number_of_snps = 1;
+	}
+	
+	branch->snp_locations = (int *) calloc(number_of_snps + 1, sizeof(int));
+	branch->child_sequence = (char *) calloc(number_of_snps + 1, sizeof(char));
+	branch->branch_snp_coords = (int *) calloc(number_of_snps + 1, sizeof(int));
+	branch->branch_snp_sequence = (char *) calloc(number_of_snps + 1, sizeof(char));
+	
+	// Evenly spaced slots with a random snp in each keeps the locations sorted and distinct
+	double spacing = ((double) genome_length)/number_of_snps;
+	for(i = 0; i < number_of_snps; i++)
+	{
+		int slot_start = (int) (i*spacing);
+		int slot_size = (int) ((i+1)*spacing) - slot_start;
+		branch->snp_locations[i] = slot_start + 1 + synthetic_random_number(&seed, slot_size);
+		branch->child_sequence[i] = (synthetic_random_number(&seed, 100) == 0) ? '-' : synthetic_bases[synthetic_random_number(&seed, 4)];
+	}
+	branch->number_of_snps = number_of_snps;
+	
+	int * recombination_starts = (int *) calloc(parameters->number_of_recombinations + 1, sizeof(int));
+	for(i = 0; i < parameters->number_of_recombinations; i++)
+	{
+		recombination_starts[i] = synthetic_random_number(&seed, genome_length - parameters->recombination_length);
+	}
+	branch->number_of_branch_snps = 0;
+	for(i = 0; i < number_of_snps; i++)
+	{
+		if(branch->child_sequence[i] == '-')
+		{
+			continue;
+		}
+		int in_recombination = 0;
+		for(j = 0; j < parameters->number_of_recombinations; j++)
+		{
+			if(branch->snp_locations[i] >= recombination_starts[j] && branch->snp_locations[i] < recombination_starts[j] + parameters->recombination_length)
+			{
+				in_recombination = 1;
+				break;
+			}
+		}
+		if(in_recombination == 1 || synthetic_random_number(&seed, 50) == 0)
+		{
+			branch->branch_snp_coords[branch->number_of_branch_snps] = branch->snp_locations[i];
+			branch->branch_snp_sequence[branch->number_of_branch_snps] = branch->child_sequence[i];
+			branch->number_of_branch_snps++;
+		}
+	}
+	branch->branch_genome_size = genome_length - number_of_snps/100;
+	free(recombination_starts);
+}
+
+void free_synthetic_branch(synthetic_branch * branch)
+{
+	free(branch->snp_locations);
+	free(branch->child_sequence);
+	free(branch->branch_snp_coords);
+	free(branch->branch_snp_sequence);
+}
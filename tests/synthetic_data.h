@@ -0,0 +1,53 @@
+/*
+ *  Wellcome Trust Sanger Institute
+ *  Copyright (C) 2011  Wellcome Trust Sanger Institute
+ *
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+#ifndef _SYNTHETIC_DATA_H_
+#define _SYNTHETIC_DATA_H_
+
+// The size and shape of the made up data the benchmarks run on
+typedef struct synthetic_parameters
+{
+	int number_of_taxa;
+	int genome_length;
+	double snp_density;
+	int number_of_recombinations;
+	int recombination_length;
+	unsigned int seed;
+} synthetic_parameters;
+
+// The snps of one branch, laid out the way get_likelihood_for_windows sees them
+typedef struct synthetic_branch
+{
+	int * snp_locations;
+	int number_of_snps;
+	char * child_sequence;
+	int * branch_snp_coords;
+	int number_of_branch_snps;
+	char * branch_snp_sequence;
+	int branch_genome_size;
+} synthetic_branch;
+
+void set_default_synthetic_parameters(synthetic_parameters * parameters);
+int synthetic_random_number(unsigned int * seed, int maximum);
+void write_synthetic_alignment(synthetic_parameters * parameters, char * alignment_filename);
+char * generate_synthetic_tree_string(int number_of_taxa, unsigned int * seed);
+void generate_synthetic_branch(synthetic_parameters * parameters, synthetic_branch * branch);
+void free_synthetic_branch(synthetic_branch * branch);
+
+#endif